@@ -175,6 +175,7 @@ static void errfd_recv(void *);
 static void timeout_repfd(void *);
 static void protocol_recv(void *, pkt_t *, security_status_t);
 static void process_readnetfd(void *);
+static void readnetfd_eof(struct datafd_handle *);
 static void process_writenetfd(void *, void *, ssize_t);
 static struct active_service *service_new(security_handle_t *,
     const char *, service_t, const char *);
@@ -1420,6 +1421,25 @@ process_readnetfd(
 
     nak.body = NULL;
 
+    /* Unless the data must be scanned for sendbackup's "info end" line,
+     * let the security layer move it from the pipe to the network itself,
+     * where it can do so without copying it through as->databuf */
+    if (security_stream_can_write_from_fd(dh->netfd) &&
+	!(as->service == SERVICE_SENDBACKUP && !as->seen_info_end &&
+	  dh == &as->data[1])) {
+	n = security_stream_write_from_fd(dh->netfd, dh->fd_read,
+					  sizeof(as->databuf));
+	if (n < 0) {
+	    pkt_init(&nak, P_NAK, _("ERROR relay error on stream %d: %s\n"),
+		security_stream_id(dh->netfd),
+		security_stream_geterror(dh->netfd));
+	    goto sendnak;
+	}
+	if (n == 0)
+	    readnetfd_eof(dh);
+	return;
+    }
+
     do {
 	n = read(dh->fd_read, as->databuf, sizeof(as->databuf));
     } while ((n < 0) && ((errno == EINTR) || (errno == EAGAIN)));
@@ -1437,17 +1457,7 @@ process_readnetfd(
      * If all pipes are closed, shut down this service.
      */
     if (n == 0) {
-	event_release(dh->ev_read);
-	dh->ev_read = NULL;
-	if(dh->ev_write == NULL) {
-	    security_stream_close(dh->netfd);
-	    dh->netfd = NULL;
-	}
-	for (dh = &as->data[0]; dh < &as->data[DATA_FD_COUNT]; dh++) {
-	    if (dh->netfd != NULL)
-		return;
-	}
-	service_delete(as);
+	readnetfd_eof(dh);
 	return;
     }
 
@@ -1494,6 +1504,29 @@ sendnak:
     amfree(nak.body);
 }
 
+/*
+ * One of the process's pipes was closed.  Just remove its event handler.
+ * If all pipes are closed, shut down the service.
+ */
+static void
+readnetfd_eof(
+    struct datafd_handle *	dh)
+{
+    struct active_service *as = dh->as;
+
+    event_release(dh->ev_read);
+    dh->ev_read = NULL;
+    if(dh->ev_write == NULL) {
+	security_stream_close(dh->netfd);
+	dh->netfd = NULL;
+    }
+    for (dh = &as->data[0]; dh < &as->data[DATA_FD_COUNT]; dh++) {
+	if (dh->netfd != NULL)
+	    return;
+    }
+    service_delete(as);
+}
+
 /*
  * This is a generic relay function that just read data from one of
  * the security_stream_t and passes it up the equivalent process's pipes
@@ -70,6 +70,7 @@
 #include "client_util.h"
 #include "conffile.h"
 #include "getopt.h"
+#include "tar-index.h"
 
 int debug_application = 1;
 #define application_debug(i, ...) do {	\
@@ -151,6 +152,7 @@ static int gnutar_xattrs;
 static int gnutar_checkdevice;
 static int gnutar_no_unquote;
 static int gnutar_sparse;
+static int gnutar_index_offsets;
 static GSList *normal_message = NULL;
 static GSList *ignore_message = NULL;
 static GSList *strange_message = NULL;
@@ -194,6 +196,7 @@ static struct option long_options[] = {
     {"include-list-glob", 1, NULL, 34},
     {"exclude-list-glob", 1, NULL, 35},
     {"verbose"          , 1, NULL, 36},
+    {"index-offsets"    , 1, NULL, 37},
     {NULL, 0, NULL, 0}
 };
 
@@ -306,6 +309,7 @@ main(
     gnutar_checkdevice = 1;
     gnutar_sparse = 1;
     gnutar_no_unquote = 0;
+    gnutar_index_offsets = 0;
     exit_handling = NULL;
 
     /* initialize */
@@ -502,6 +506,13 @@ main(
 	case 36: if (strcasecmp(optarg, "YES") == 0)
 		     argument.verbose = 1;
 		 break;
+	case 37: if (strcasecmp(optarg, "NO") == 0)
+		     gnutar_index_offsets = 0;
+		 else if (strcasecmp(optarg, "YES") == 0)
+		     gnutar_index_offsets = 1;
+		 else if (strcasecmp(command, "selfcheck") == 0)
+		     printf(_("ERROR [%s: bad INDEX-OFFSETS property value (%s)]\n"), get_pname(), optarg);
+		 break;
 	case ':':
 	case '?':
 		break;
@@ -574,6 +585,7 @@ main(
     dbprintf("SELINUX %s\n", gnutar_selinux? "yes":"no");
     dbprintf("XATTRS %s\n", gnutar_xattrs? "yes":"no");
     dbprintf("CHECK-DEVICE %s\n", gnutar_checkdevice? "yes":"no");
+    dbprintf("INDEX-OFFSETS %s\n", gnutar_index_offsets? "yes":"no");
     {
 	amregex_t *rp;
 	for (rp = re_table; rp->regex != NULL; rp++) {
@@ -912,6 +924,91 @@ common_error:
     return;
 }
 
+/* Report a line of gtar's output as the regexes in re_table classify it */
+static void
+amgtar_backup_message(
+    char      *line,
+    FILE      *mesgstream,
+    off_t     *dump_size)
+{
+    amregex_t *rp;
+    char      *type;
+    char       startchr;
+
+    if (*line == '.' && *(line+1) == '/') { /* filename */
+	/* the index is built from the archive itself */
+	return;
+    }
+
+    for(rp = re_table; rp->regex != NULL; rp++) {
+	if(match(rp->regex, line)) {
+	    break;
+	}
+    }
+    if(rp->typ == DMP_SIZE) {
+	*dump_size = (off_t)((the_num(line, rp->field)* rp->scale+1023.0)/1024.0);
+    }
+    switch(rp->typ) {
+    case DMP_NORMAL:
+	type = "normal";
+	startchr = '|';
+	break;
+    case DMP_IGNORE:
+	return;
+    case DMP_STRANGE:
+	type = "strange";
+	startchr = '?';
+	break;
+    case DMP_SIZE:
+	type = "size";
+	startchr = '|';
+	break;
+    case DMP_ERROR:
+	type = "error";
+	startchr = '?';
+	break;
+    default:
+	type = "unknown";
+	startchr = '!';
+	break;
+    }
+    dbprintf("%3d: %7s(%c): %s\n", rp->srcline, type, startchr, line);
+    fprintf(mesgstream,"%c %s\n", startchr, line);
+}
+
+/* Keep the index of the dump, with the offset of each file in it, next to
+ * the gtar state file BASENAME */
+static void
+amgtar_write_index_offsets(
+    tar_index_t *tar_index,
+    char        *basename,
+    FILE        *mesgstream)
+{
+    char *filename = g_strconcat(basename, ".idx", NULL);
+    char *tmpname = g_strconcat(filename, ".new", NULL);
+    int   fd;
+
+    fd = open(tmpname, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+    if (fd == -1 || !tar_index_write_offsets(tar_index, fd) || close(fd) != 0) {
+	dbprintf(_("%s: warning [writing %s: %s]\n"),
+		 get_pname(), tmpname, strerror(errno));
+	g_fprintf(mesgstream, _("? warning [writing %s: %s]\n"),
+		  tmpname, strerror(errno));
+	if (fd != -1)
+	    close(fd);
+	unlink(tmpname);
+    } else if (rename(tmpname, filename)) {
+	dbprintf(_("%s: warning [renaming %s to %s: %s]\n"),
+		 get_pname(), tmpname, filename, strerror(errno));
+	g_fprintf(mesgstream, _("? warning [renaming %s to %s: %s]\n"),
+		  tmpname, filename, strerror(errno));
+	unlink(tmpname);
+    }
+
+    amfree(filename);
+    amfree(tmpname);
+}
+
 static void
 amgtar_backup(
     application_argument_t *argument)
@@ -920,18 +1017,20 @@ amgtar_backup(
     char      *cmd = NULL;
     char      *qdisk;
     char      *incrname;
-    char       line[32768];
-    amregex_t *rp;
+    char       buf[32768];
     off_t      dump_size = -1;
-    char      *type;
-    char       startchr;
     int        dataf = 1;
+    int        datain = -1;
     int        mesgf = 3;
     int        indexf = 4;
     int        outf;
     FILE      *mesgstream;
-    FILE      *indexstream = NULL;
-    FILE      *outstream;
+    GString   *outline;
+    char      *nl;
+    fd_set     readset;
+    int        maxfd;
+    ssize_t    nread;
+    tar_index_t *tar_index = NULL;
     char      *errmsg = NULL;
     amwait_t   wait_status;
     GPtrArray *argv_ptr;
@@ -973,70 +1072,84 @@ amgtar_backup(
     argv_ptr = amgtar_build_argv(argument, incrname, &file_exclude,
 				 &file_include, CMD_BACKUP);
 
-    tarpid = pipespawnv(cmd, STDIN_PIPE|STDERR_PIPE, 1,
-			&dumpin, &dataf, &outf, (char **)argv_ptr->pdata);
-    /* close the write ends of the pipes */
-
-    aclose(dumpin);
-    aclose(dataf);
     if (argument->dle.create_index) {
-	indexstream = fdopen(indexf, "w");
-	if (!indexstream) {
-	    error(_("error indexstream(%d): %s\n"), indexf, strerror(errno));
-	}
-    }
-    outstream = fdopen(outf, "r");
-    if (!outstream) {
-	error(_("error outstream(%d): %s\n"), outf, strerror(errno));
+	/* read the archive, to index it on its way to the server */
+	tarpid = pipespawnv(cmd, STDIN_PIPE|STDOUT_PIPE|STDERR_PIPE, 1,
+			    &dumpin, &datain, &outf, (char **)argv_ptr->pdata);
+	tar_index = tar_index_new();
+    } else {
+	tarpid = pipespawnv(cmd, STDIN_PIPE|STDERR_PIPE, 1,
+			    &dumpin, &dataf, &outf, (char **)argv_ptr->pdata);
+	/* close the write end of the pipe */
+	aclose(dataf);
     }
+    aclose(dumpin);
 
-    while (fgets(line, sizeof(line), outstream) != NULL) {
-	if (strlen(line) > 0 && line[strlen(line)-1] == '\n') {
-	    /* remove trailling \n */
-	    line[strlen(line)-1] = '\0';
+    outline = g_string_new(NULL);
+    while (datain != -1 || outf != -1) {
+	FD_ZERO(&readset);
+	maxfd = -1;
+	if (datain != -1) {
+	    FD_SET(datain, &readset);
+	    maxfd = datain;
 	}
-	if (*line == '.' && *(line+1) == '/') { /* filename */
-	    if (argument->dle.create_index) {
-		fprintf(indexstream, "%s\n", &line[1]); /* remove . */
-	    }
-	} else { /* message */
-	    for(rp = re_table; rp->regex != NULL; rp++) {
-		if(match(rp->regex, line)) {
-		    break;
+	if (outf != -1) {
+	    FD_SET(outf, &readset);
+	    maxfd = MAX(maxfd, outf);
+	}
+	if (select(maxfd + 1, &readset, NULL, NULL, NULL) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    error(_("select failed: %s"), strerror(errno));
+	}
+
+	if (datain != -1 && FD_ISSET(datain, &readset)) {
+	    nread = read(datain, buf, sizeof(buf));
+	    if (nread < 0 && errno != EINTR && errno != EAGAIN) {
+		error(_("error reading from %s: %s"), cmd, strerror(errno));
+	    } else if (nread == 0) {
+		aclose(datain);
+		aclose(dataf);
+	    } else if (nread > 0) {
+		if (tar_index && !tar_index_add_data(tar_index, buf, nread)) {
+		    dbprintf(_("%s output is not a tar archive\n"), cmd);
+		    fprintf(mesgstream, _("? %s output is not a tar archive; no index\n"), cmd);
+		    tar_index_free(tar_index);
+		    tar_index = NULL;
+		}
+		if (full_write(dataf, buf, nread) < (size_t)nread) {
+		    error(_("error writing the dump: %s"), strerror(errno));
 		}
 	    }
-	    if(rp->typ == DMP_SIZE) {
-		dump_size = (off_t)((the_num(line, rp->field)* rp->scale+1023.0)/1024.0);
-	    }
-	    switch(rp->typ) {
-	    case DMP_NORMAL:
-		type = "normal";
-		startchr = '|';
-		break;
-	    case DMP_IGNORE:
+	}
+
+	if (outf != -1 && FD_ISSET(outf, &readset)) {
+	    nread = read(outf, buf, sizeof(buf));
+	    if (nread < 0 && (errno == EINTR || errno == EAGAIN))
+		continue;
+	    if (nread <= 0) {
+		aclose(outf);
+		if (outline->len > 0)
+		    amgtar_backup_message(outline->str, mesgstream, &dump_size);
 		continue;
-	    case DMP_STRANGE:
-		type = "strange";
-		startchr = '?';
-		break;
-	    case DMP_SIZE:
-		type = "size";
-		startchr = '|';
-		break;
-	    case DMP_ERROR:
-		type = "error";
-		startchr = '?';
-		break;
-	    default:
-		type = "unknown";
-		startchr = '!';
-		break;
 	    }
-	    dbprintf("%3d: %7s(%c): %s\n", rp->srcline, type, startchr, line);
-	    fprintf(mesgstream,"%c %s\n", startchr, line);
-        }
+	    g_string_append_len(outline, buf, nread);
+	    while ((nl = strchr(outline->str, '\n')) != NULL) {
+		*nl = '\0';
+		amgtar_backup_message(outline->str, mesgstream, &dump_size);
+		g_string_erase(outline, 0, nl + 1 - outline->str);
+	    }
+	}
+    }
+    g_string_free(outline, TRUE);
+
+    if (tar_index) {
+	dbprintf(_("index of %u files\n"), tar_index_count(tar_index));
+	if (!tar_index_write(tar_index, indexf)) {
+	    dbprintf(_("error writing the index: %s\n"), strerror(errno));
+	    fprintf(mesgstream, _("? error writing the index: %s\n"), strerror(errno));
+	}
     }
-    fclose(outstream);
 
     waitpid(tarpid, &wait_status, 0);
     if (WIFSIGNALED(wait_status)) {
@@ -1071,6 +1184,8 @@ amgtar_backup(
 		g_fprintf(mesgstream, _("? warning [renaming %s to %s: %s]\n"),
 			  incrname, nodotnew, strerror(errno));
 	    }
+	    if (tar_index && gnutar_index_offsets)
+		amgtar_write_index_offsets(tar_index, nodotnew, mesgstream);
 	    amfree(nodotnew);
 	} else {
 	    if (unlink(incrname) == -1) {
@@ -1088,7 +1203,8 @@ amgtar_backup(
     fprintf(mesgstream, "sendbackup: end\n");
 
     if (argument->dle.create_index)
-	fclose(indexstream);
+	aclose(indexf);
+    tar_index_free(tar_index);
 
     fclose(mesgstream);
 
@@ -1582,8 +1698,6 @@ GPtrArray *amgtar_build_argv(
     g_ptr_array_add(argv_ptr, g_strdup(gnutar_path));
 
     g_ptr_array_add(argv_ptr, g_strdup("--create"));
-    if (command == CMD_BACKUP && argument->dle.create_index)
-        g_ptr_array_add(argv_ptr, g_strdup("--verbose"));
     g_ptr_array_add(argv_ptr, g_strdup("--file"));
     if (command == CMD_ESTIMATE) {
         g_ptr_array_add(argv_ptr, g_strdup("/dev/null"));
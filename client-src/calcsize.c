@@ -109,11 +109,13 @@ void add_file_unknown(int, struct stat *);
 off_t final_size_unknown(int, char *);
 
 sl_t *calc_load_file(char *filename);
+match_set_t *calc_compile_exclude(sl_t *sl);
 int calc_check_exclude(char *filename);
 
 int use_star_excl = 0;
 int use_gtar_excl = 0;
 sl_t *include_sl=NULL, *exclude_sl=NULL;
+match_set_t *exclude_set=NULL;
 
 int
 main(
@@ -281,6 +283,8 @@ main(
 		g_fprintf(stderr,"Cannot open exclude file %s: %s\n", qfilename,
 			strerror(errno));
 		use_gtar_excl = use_star_excl = 0;
+	    } else {
+		exclude_set = calc_compile_exclude(exclude_sl);
 	    }
 	}
 	amfree(qfilename);
@@ -711,19 +715,39 @@ calc_load_file(
     return sl_list;
 }
 
-int
-calc_check_exclude(
-    char *	filename)
+/*
+ * Compile all exclude patterns in a single pattern set, so that each file is
+ * matched once rather than once per pattern.
+ */
+match_set_t *
+calc_compile_exclude(
+    sl_t *	sl)
 {
+    match_set_t *set = match_set_new(MATCH_SET_TAR);
     sle_t *an_exclude;
-    if(is_empty_sl(exclude_sl)) return 0;
+    char *errmsg;
 
-    an_exclude=exclude_sl->first;
-    while(an_exclude != NULL) {
-	if(match_tar(an_exclude->name, filename)) {
-	    return 1;
+    for (an_exclude = sl->first; an_exclude != NULL;
+	 an_exclude = an_exclude->next) {
+	if ((errmsg = match_set_add(set, an_exclude->name)) != NULL) {
+	    error(_("exclude pattern \"%s\": %s"), an_exclude->name, errmsg);
+	    /*NOTREACHED*/
 	}
-	an_exclude=an_exclude->next;
     }
-    return 0;
+
+    if ((errmsg = match_set_compile(set)) != NULL) {
+	error(_("exclude patterns: %s"), errmsg);
+	/*NOTREACHED*/
+    }
+
+    return set;
+}
+
+int
+calc_check_exclude(
+    char *	filename)
+{
+    if(is_empty_sl(exclude_sl) || !exclude_set) return 0;
+
+    return match_set_match(exclude_set, filename);
 }
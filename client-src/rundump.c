@@ -185,6 +185,7 @@ main(
 
     dbprintf(_("running: %s\n"), cmdline);
     amfree(cmdline);
+    dbflush();
 
     execve(dump_program, argv, safe_env());
 
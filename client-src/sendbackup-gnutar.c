@@ -139,7 +139,6 @@ start_backup(
     char tmppath[PATH_MAX];
     int dumpin, dumpout, compout;
     char *cmd = NULL;
-    char *indexcmd = NULL;
     char *dirname = NULL;
     int l;
     char dumptimestr[80] = "UNUSED";
@@ -350,19 +349,6 @@ start_backup(
     cur_dumptime = time(0);
     cur_level = level;
     cur_disk = g_strdup(dle->disk);
-#ifdef GNUTAR
-#  define PROGRAM_GNUTAR GNUTAR
-#else
-#  define PROGRAM_GNUTAR "tar"
-#endif
-    indexcmd = g_strjoin(NULL, 
-			 PROGRAM_GNUTAR,
-			 " -tf", " -",
-			 " 2>/dev/null",
-			 " | sed", " -e",
-			 " \'s/^\\.//\'",
-			 NULL);
-
 #ifdef SAMBA_CLIENT							/* { */
     /* Use sambatar if the disk to back up is a PC disk */
     if (dle->device[0] == '/' && dle->device[1]=='/') {
@@ -454,7 +440,7 @@ start_backup(
 	cmd = g_strdup(program->backup_name);
 	info_tapeheader(dle);
 
-	start_index(dle->create_index, dumpout, mesgf, indexf, indexcmd);
+	start_index(dle->create_index, dumpout, mesgf, indexf, NULL);
 
 	if (pwtext_len > 0) {
 	    pw_fd_env = "PASSWD_FD";
@@ -524,7 +510,7 @@ start_backup(
 	cmd = g_strjoin(NULL, amlibexecdir, "/", "runtar", NULL);
 	info_tapeheader(dle);
 
-	start_index(dle->create_index, dumpout, mesgf, indexf, indexcmd);
+	start_index(dle->create_index, dumpout, mesgf, indexf, NULL);
 
 	g_ptr_array_add(argv_ptr, g_strdup("runtar"));
 	if (g_options->config)
@@ -589,7 +575,6 @@ start_backup(
     amfree(qdisk);
     amfree(dirname);
     amfree(cmd);
-    amfree(indexcmd);
     amfree(error_pn);
 
     /* close the write ends of the pipes */
@@ -38,6 +38,7 @@
 #include "getfsent.h"
 #include "conffile.h"
 #include "amandates.h"
+#include "tar-index.h"
 
 #define sendbackup_debug(i, ...) do {	\
 	if ((i) <= debug_sendbackup) {	\
@@ -1188,7 +1189,8 @@ process_dumpline(
  * If createindex is not enabled, it does nothing.  If it is not, a
  * new process will be created that tees input both to a pipe whose
  * read fd is dup2'ed input and to a program that outputs an index
- * file to `index'.
+ * file to `index'.  If cmd is NULL, the output is a tar archive, and
+ * the tee builds the index itself from the tar headers as they go by.
  *
  * make sure that the chat from restore doesn't go to stderr cause
  * this goes back to amanda which doesn't expect to see it
@@ -1219,6 +1221,59 @@ save_fd(
     dbprintf(_("Dupped file descriptor %i to %i\n"), origfd, *fd);
 }
 
+/*
+ * Copy a tar archive from fd 0 to fd 3, then write the index of its
+ * members to fd 1, already sorted.
+ */
+static void
+tar_index_tee(void)
+{
+  tar_index_t *ti = tar_index_new();
+  gboolean is_tar = TRUE;
+  char buffer[32768];
+  ssize_t bytes_read;
+
+  dbprintf(_("Indexing the tar headers\n"));
+  while (1) {
+    do {
+	bytes_read = read(0, buffer, sizeof(buffer));
+    } while ((bytes_read < 0) && ((errno == EINTR) || (errno == EAGAIN)));
+
+    if (bytes_read < 0) {
+      error(_("index tee cannot read [%s]"), strerror(errno));
+      /*NOTREACHED*/
+    }
+
+    if (bytes_read == 0)
+      break; /* finished */
+
+    if (is_tar && !tar_index_add_data(ti, buffer, (size_t)bytes_read)) {
+      dbprintf(_("Index tee: the dump is not a tar archive\n"));
+      is_tar = FALSE;
+    }
+
+    if (full_write(3, buffer, (size_t)bytes_read) < (size_t)bytes_read) {
+      error(_("index tee cannot write [%s]"), strerror(errno));
+      /*NOTREACHED*/
+    }
+  }
+
+  if (!is_tar) {
+    tar_index_free(ti);
+    exit(1);
+  }
+
+  if (!tar_index_write(ti, 1)) {
+    dbprintf(_("Index tee cannot write the index [%s]\n"), strerror(errno));
+    tar_index_free(ti);
+    exit(1);
+  }
+
+  dbprintf(_("Index created successfully: %u entries\n"), tar_index_count(ti));
+  tar_index_free(ti);
+  exit(0);
+}
+
 void
 start_index(
     int		createindex,
@@ -1272,6 +1327,9 @@ start_index(
     }
   }
 
+  if (cmd == NULL)
+    tar_index_tee();
+
   if ((pipe_fp = popen(cmd, "w")) == NULL) {
     error(_("couldn't start index creator [%s]"), strerror(errno));
     /*NOTREACHED*/
@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94085, USA, or: http://www.zmanda.com
+ */
+
+#include "amanda.h"
+#include "testutils.h"
+#include "full-read.h"
+#include "tar-index.h"
+
+#define BLOCK 512
+
+/*
+ * Utils
+ */
+
+/* Append a header block to the archive AR.  MAGIC is "ustar" for a ustar
+ * or pax header, or "gnu" for a GNU one. */
+static void
+add_header(
+    GString    *ar,
+    const char *name,
+    char	typeflag,
+    guint64	size,
+    const char *magic,
+    const char *prefix)
+{
+    char block[BLOCK];
+    guint sum = 0;
+    int i;
+
+    memset(block, 0, sizeof(block));
+    strncpy(block, name, 100);
+    g_snprintf(block + 100, 8, "%07o", 0644);
+    g_snprintf(block + 108, 8, "%07o", 0);
+    g_snprintf(block + 116, 8, "%07o", 0);
+    g_snprintf(block + 124, 12, "%011llo", (unsigned long long)size);
+    g_snprintf(block + 136, 12, "%011o", 1300000000);
+    block[156] = typeflag;
+    if (g_str_equal(magic, "gnu")) {
+	memcpy(block + 257, "ustar  \0", 8);
+    } else {
+	memcpy(block + 257, "ustar\0" "00", 8);
+	if (prefix)
+	    strncpy(block + 345, prefix, 155);
+    }
+
+    memset(block + 148, ' ', 8);
+    for (i = 0; i < BLOCK; i++)
+	sum += (guchar)block[i];
+    g_snprintf(block + 148, 8, "%06o", sum);
+
+    g_string_append_len(ar, block, BLOCK);
+}
+
+/* Append LEN bytes of member data, padded to a block */
+static void
+add_data(
+    GString    *ar,
+    const char *data,
+    size_t	len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+	g_string_append_c(ar, data ? data[i] : (char)('a' + i % 26));
+    while (ar->len % BLOCK)
+	g_string_append_c(ar, '\0');
+}
+
+/* Append a pax extended header with the given records */
+static void
+add_pax(
+    GString    *ar,
+    char	typeflag,
+    ...)
+{
+    GString *records = g_string_new(NULL);
+    const char *record;
+    va_list ap;
+
+    va_start(ap, typeflag);
+    while ((record = va_arg(ap, const char *)) != NULL) {
+	/* the length counts its own digits */
+	size_t len = strlen(record) + 3;
+	char *line = g_strdup_printf("%zu %s\n", len, record);
+	while (strlen(line) != len) {
+	    len = strlen(line);
+	    g_free(line);
+	    line = g_strdup_printf("%zu %s\n", len, record);
+	}
+	g_string_append(records, line);
+	g_free(line);
+    }
+    va_end(ap);
+
+    add_header(ar, "./PaxHeaders/x", typeflag, records->len, "ustar", NULL);
+    add_data(ar, records->str, records->len);
+    g_string_free(records, TRUE);
+}
+
+static void
+add_end(
+    GString *ar)
+{
+    while (ar->len % (20 * BLOCK) || ar->len == 0)
+	g_string_append_c(ar, '\0');
+}
+
+/* Index AR, fed in pieces of PIECE bytes */
+static tar_index_t *
+index_archive(
+    GString  *ar,
+    size_t    len,
+    size_t    piece,
+    gboolean *ok)
+{
+    tar_index_t *ti = tar_index_new();
+    size_t done;
+
+    *ok = TRUE;
+    for (done = 0; done < len; done += piece) {
+	if (!tar_index_add_data(ti, ar->str + done, MIN(piece, len - done))) {
+	    *ok = FALSE;
+	    break;
+	}
+    }
+    return ti;
+}
+
+/* the contents of a temporary file written by WRITE_FN */
+static char *
+written_by(
+    tar_index_t *ti,
+    gboolean (*write_fn)(tar_index_t *, int),
+    size_t *len)
+{
+    FILE *f = tmpfile();
+    char buf[65536];
+    size_t n;
+
+    if (!f)
+	return NULL;
+    if (!write_fn(ti, fileno(f)) || lseek(fileno(f), 0, SEEK_SET) < 0) {
+	fclose(f);
+	return NULL;
+    }
+    n = full_read(fileno(f), buf, sizeof(buf) - 1);
+    fclose(f);
+    buf[n] = '\0';
+    if (len)
+	*len = n;
+    return g_memdup(buf, n + 1);
+}
+
+static void
+collect_offset(
+    const char *name,
+    guint64	offset,
+    gpointer	user_data)
+{
+    GString *str = user_data;
+
+    g_string_append_printf(str, "%llu %s\n", (unsigned long long)offset, name);
+}
+
+/* the names and offsets in the binary index of TI, read back */
+static char *
+offsets_of(
+    tar_index_t *ti)
+{
+    FILE *f = tmpfile();
+    GString *str = g_string_new(NULL);
+
+    if (!f || !tar_index_write_offsets(ti, fileno(f)) ||
+	lseek(fileno(f), 0, SEEK_SET) < 0 ||
+	!tar_index_read_offsets(fileno(f), collect_offset, str)) {
+	tu_dbg("could not write and read back the binary index\n");
+	if (f)
+	    fclose(f);
+	g_string_free(str, TRUE);
+	return NULL;
+    }
+    fclose(f);
+    return g_string_free(str, FALSE);
+}
+
+static gboolean
+check_string(
+    const char *what,
+    const char *got,
+    const char *expected)
+{
+    if (!got) {
+	tu_dbg("no %s\n", what);
+	return FALSE;
+    }
+    if (!g_str_equal(got, expected)) {
+	tu_dbg("%s is:\n%s\nexpected:\n%s\n", what, got, expected);
+	return FALSE;
+    }
+    return TRUE;
+}
+
+/* check both forms of the index of AR, fed whole and in odd pieces */
+static gboolean
+check_index(
+    GString    *ar,
+    const char *expected_names,
+    const char *expected_offsets)
+{
+    static const size_t pieces[] = { 1 << 20, 1, 7, 511, 513, 4096 };
+    gboolean ok = TRUE, added;
+    char *got;
+    guint i;
+
+    for (i = 0; ok && i < G_N_ELEMENTS(pieces); i++) {
+	tar_index_t *ti = index_archive(ar, ar->len, pieces[i], &added);
+
+	if (!added) {
+	    tu_dbg("the archive was refused, in pieces of %zu\n", pieces[i]);
+	    ok = FALSE;
+	}
+	got = written_by(ti, tar_index_write, NULL);
+	ok = ok && check_string("the index", got, expected_names);
+	g_free(got);
+	got = offsets_of(ti);
+	ok = ok && check_string("the offsets", got, expected_offsets);
+	g_free(got);
+	tar_index_free(ti);
+    }
+    return ok;
+}
+
+/*
+ * Tests
+ */
+
+/* ustar and GNU headers, the members' data skipped, and the index sorted */
+static gboolean
+test_plain(void)
+{
+    GString *ar = g_string_new(NULL);
+    gboolean ok;
+
+    add_header(ar, "./", '5', 0, "gnu", NULL);			/* 0 */
+    add_header(ar, "./zeta", '0', 1000, "gnu", NULL);		/* 512 */
+    add_data(ar, NULL, 1000);
+    add_header(ar, "./alpha", '0', 512, "ustar", NULL);		/* 2048 */
+    add_data(ar, NULL, 512);
+    add_header(ar, "./empty", '0', 0, "ustar", NULL);		/* 3072 */
+    add_header(ar, "./link", '2', 0, "gnu", NULL);		/* 3584 */
+    add_end(ar);
+
+    ok = check_index(ar,
+	"/\n/alpha\n/empty\n/link\n/zeta\n",
+	"0 /\n2048 /alpha\n3072 /empty\n3584 /link\n512 /zeta\n");
+
+    g_string_free(ar, TRUE);
+    return ok;
+}
+
+/* Names longer than the header's field, from a GNU long name or a ustar
+ * prefix; the member starts at its first extended header */
+static gboolean
+test_long_names(void)
+{
+    GString *ar = g_string_new(NULL);
+    char *dirname = g_strnfill(150, 'd');
+    char *longname = g_strdup_printf("./%s/file-with-a-long-name", dirname);
+    char *expected_names, *expected_offsets;
+    gboolean ok;
+
+    add_header(ar, "././@LongLink", 'L', strlen(longname) + 1, "gnu", NULL); /* 0 */
+    add_data(ar, longname, strlen(longname) + 1);
+    add_header(ar, "./ddddd", '0', 600, "gnu", NULL);
+    add_data(ar, NULL, 600);
+    /* a long link target is not a name */
+    add_header(ar, "././@LongLink", 'K', 200, "gnu", NULL);	/* 2560 */
+    add_data(ar, NULL, 200);
+    add_header(ar, "./symlink", '2', 0, "gnu", NULL);
+    add_header(ar, "file", '0', 10, "ustar", "./some/dir/with/a/prefix"); /* 4096 */
+    add_data(ar, NULL, 10);
+    add_end(ar);
+
+    expected_names = g_strdup_printf("/%s\n/some/dir/with/a/prefix/file\n/symlink\n",
+				     longname + 2);
+    expected_offsets = g_strdup_printf("0 /%s\n4096 /some/dir/with/a/prefix/file\n2560 /symlink\n",
+				       longname + 2);
+    ok = check_index(ar, expected_names, expected_offsets);
+
+    g_free(expected_names);
+    g_free(expected_offsets);
+    g_free(longname);
+    g_free(dirname);
+    g_string_free(ar, TRUE);
+    return ok;
+}
+
+/* pax headers give the name and the size of the next member, GNU sparse
+ * files their real name, and global headers are not members */
+static gboolean
+test_pax(void)
+{
+    GString *ar = g_string_new(NULL);
+    gboolean ok;
+
+    add_pax(ar, 'g', "comment=not a member", NULL);		/* 0 */
+    add_pax(ar, 'x', "path=./pax name\twith a tab",		/* 1024 */
+		     "size=700", NULL);
+    /* the header's size is wrong; the pax size says where the next is */
+    add_header(ar, "./pax name", '0', 0, "ustar", NULL);
+    add_data(ar, NULL, 700);
+    add_pax(ar, 'x', "GNU.sparse.name=./sparse",		/* 3584 */
+		     "path=./GNUSparseFile.0/sparse", "size=100", NULL);
+    add_header(ar, "./GNUSparseFile.0/sparse", '0', 100, "ustar", NULL);
+    add_data(ar, NULL, 100);
+    add_header(ar, "./after", '0', 1, "ustar", NULL);		/* 5632 */
+    add_data(ar, NULL, 1);
+    add_end(ar);
+
+    ok = check_index(ar,
+	"/after\n/pax name\\twith a tab\n/sparse\n",
+	"5632 /after\n1024 /pax name\\twith a tab\n3584 /sparse\n");
+
+    g_string_free(ar, TRUE);
+    return ok;
+}
+
+/* Names are quoted as gtar --list quotes them */
+static gboolean
+test_quoting(void)
+{
+    GString *ar = g_string_new(NULL);
+    gboolean ok;
+
+    add_header(ar, "./back\\slash", '0', 0, "gnu", NULL);	/* 0 */
+    add_header(ar, "./new\nline", '0', 0, "gnu", NULL);		/* 512 */
+    add_header(ar, "./caf\303\251", '0', 0, "gnu", NULL);	/* 1024 */
+    add_end(ar);
+
+    ok = check_index(ar,
+	"/back\\\\slash\n/caf\\303\\251\n/new\\nline\n",
+	"0 /back\\\\slash\n1024 /caf\\303\\251\n512 /new\\nline\n");
+
+    g_string_free(ar, TRUE);
+    return ok;
+}
+
+/* A truncated archive keeps the members seen so far, a damaged header stops
+ * the index, and a truncated binary index is refused */
+static gboolean
+test_truncated(void)
+{
+    GString *ar = g_string_new(NULL);
+    tar_index_t *ti;
+    gboolean ok = TRUE, added;
+    char *got;
+    size_t len;
+    FILE *f;
+    int dummy;
+
+    add_header(ar, "./one", '0', 1000, "gnu", NULL);
+    add_data(ar, NULL, 1000);
+    add_header(ar, "./two", '0', 10, "gnu", NULL);		/* 1536 */
+    add_data(ar, NULL, 10);
+    add_end(ar);
+
+    /* in the data of the second member, and in its header */
+    ti = index_archive(ar, 1536 + BLOCK + 5, 100, &added);
+    got = written_by(ti, tar_index_write, NULL);
+    ok = check_string("the index cut in the data", got, "/one\n/two\n") && ok;
+    ok = added && ok;
+    g_free(got);
+    tar_index_free(ti);
+
+    ti = index_archive(ar, 1536 + 100, 100, &added);
+    got = written_by(ti, tar_index_write, NULL);
+    ok = check_string("the index cut in a header", got, "/one\n") && ok;
+    ok = added && ok;
+    g_free(got);
+    tar_index_free(ti);
+
+    /* a header whose checksum is wrong */
+    ar->str[1536 + 10] ^= 1;
+    ti = index_archive(ar, ar->len, 4096, &added);
+    if (added) {
+	tu_dbg("a damaged header was accepted\n");
+	ok = FALSE;
+    }
+    if (tar_index_count(ti) != 1) {
+	tu_dbg("%u members before the damaged header\n", tar_index_count(ti));
+	ok = FALSE;
+    }
+    ar->str[1536 + 10] ^= 1;
+
+    /* the binary index, cut short */
+    got = written_by(ti, tar_index_write_offsets, &len);
+    tar_index_free(ti);
+    if (!got || len < 2)
+	return FALSE;
+    if (!(f = tmpfile()) ||
+	full_write(fileno(f), got, len - 1) < len - 1 ||
+	lseek(fileno(f), 0, SEEK_SET) < 0)
+	return FALSE;
+    if (tar_index_read_offsets(fileno(f), collect_offset, NULL)) {
+	tu_dbg("a truncated binary index was read\n");
+	ok = FALSE;
+    }
+    fclose(f);
+    g_free(got);
+
+    /* and something else altogether */
+    if (!(f = tmpfile()) ||
+	full_write(fileno(f), "/one\n/two\n", 10) < 10 ||
+	lseek(fileno(f), 0, SEEK_SET) < 0)
+	return FALSE;
+    if (tar_index_read_offsets(fileno(f), collect_offset, &dummy)) {
+	tu_dbg("a text index was read as a binary one\n");
+	ok = FALSE;
+    }
+    fclose(f);
+
+    g_string_free(ar, TRUE);
+    return ok;
+}
+
+/*
+ * Main driver
+ */
+
+int
+main(int argc, char **argv)
+{
+    static TestUtilsTest tests[] = {
+	TU_TEST(test_plain, 90),
+	TU_TEST(test_long_names, 90),
+	TU_TEST(test_pax, 90),
+	TU_TEST(test_quoting, 90),
+	TU_TEST(test_truncated, 90),
+	TU_END()
+    };
+
+    glib_init();
+
+    return testutils_run_tests(argc, argv, tests);
+}
@@ -0,0 +1,627 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94085, USA, or: http://www.zmanda.com
+ */
+
+#include "amanda.h"
+#include "util.h"
+#include "full-read.h"
+#include "full-write.h"
+#include "tar-index.h"
+
+#define TAR_BLOCK_SIZE 512
+
+/* offsets of the header fields we use */
+#define TAR_NAME	  0	/* 100 bytes */
+#define TAR_SIZE	124	/* 12 bytes */
+#define TAR_CHKSUM	148	/* 8 bytes */
+#define TAR_TYPEFLAG	156
+#define TAR_MAGIC	257	/* 6 bytes, then 2 of version */
+#define TAR_PREFIX	345	/* 155 bytes; ustar only */
+#define GNU_ISEXTENDED	482	/* in a GNU sparse header */
+#define GNU_EXT_ISEXTENDED 504	/* in a sparse extension block */
+
+#define TAR_INDEX_MAGIC "AMTIDX\0\1"
+#define TAR_INDEX_MAGIC_LEN 8
+
+typedef enum {
+    TI_HEADER,		/* expecting a header block */
+    TI_SPARSE_EXT,	/* expecting a GNU sparse extension block */
+    TI_EXTENDED,	/* collecting the data of an extended header */
+    TI_END,		/* past the end-of-archive block */
+    TI_ERROR		/* not a tar archive */
+} ti_state_t;
+
+/* the kinds of extended header whose data is collected */
+typedef enum {
+    EXT_LONGNAME,	/* GNU 'L' */
+    EXT_LONGLINK,	/* GNU 'K'; collected only to be skipped */
+    EXT_PAX		/* pax 'x' */
+} ti_extended_t;
+
+typedef struct {
+    const char *name;	/* quoted, in names */
+    guint64 offset;
+} tar_index_entry_t;
+
+struct tar_index_s {
+    ti_state_t state;
+
+    char block[TAR_BLOCK_SIZE];	/* the header block being filled */
+    size_t block_len;
+    guint64 offset;		/* bytes of the archive parsed so far */
+    guint64 skip;		/* bytes of member data still to skip */
+
+    /* extended header data being collected */
+    ti_extended_t ext_kind;
+    GString *ext_data;
+    guint64 ext_remaining;
+    guint64 ext_padding;
+
+    /* what the extended headers say about the next member */
+    gboolean have_pending;
+    guint64 pending_offset;
+    char *pending_name;
+    gboolean have_sparse_name;
+    gboolean have_pending_size;
+    guint64 pending_size;
+
+    guint64 sparse_data_size;	/* data following the sparse extensions */
+
+    GStringChunk *names;
+    GArray *entries;
+    gboolean sorted;
+};
+
+static guint64
+round_to_block(
+    guint64	size)
+{
+    return (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+}
+
+/* Parse an octal header field, or a GNU base-256 one */
+static guint64
+parse_number(
+    const char *field,
+    size_t	len)
+{
+    const guchar *p = (const guchar *)field;
+    const guchar *end = p + len;
+    guint64 n = 0;
+
+    if (*p & 0x80) {
+	n = *p++ & 0x3f;
+	while (p < end)
+	    n = (n << 8) | *p++;
+	return n;
+    }
+
+    while (p < end && *p == ' ')
+	p++;
+    while (p < end && *p >= '0' && *p <= '7')
+	n = (n << 3) | (*p++ - '0');
+    return n;
+}
+
+static gboolean
+is_zero_block(
+    const char *block)
+{
+    int i;
+
+    for (i = 0; i < TAR_BLOCK_SIZE; i++) {
+	if (block[i])
+	    return FALSE;
+    }
+    return TRUE;
+}
+
+/* Check the header checksum, which old tars computed with signed chars */
+static gboolean
+checksum_ok(
+    const char *block)
+{
+    guint64 recorded = parse_number(block + TAR_CHKSUM, 8);
+    guint64 usum = 0;
+    gint64 ssum = 0;
+    int i;
+
+    for (i = 0; i < TAR_BLOCK_SIZE; i++) {
+	if (i >= TAR_CHKSUM && i < TAR_CHKSUM + 8) {
+	    usum += ' ';
+	    ssum += ' ';
+	} else {
+	    usum += (guchar)block[i];
+	    ssum += (signed char)block[i];
+	}
+    }
+
+    return recorded == usum || (gint64)recorded == ssum;
+}
+
+/* Append NAME to STR quoted as GNU tar quotes names in the C locale */
+static void
+append_quoted(
+    GString    *str,
+    const char *name,
+    size_t	len)
+{
+    const guchar *p = (const guchar *)name;
+    const guchar *end = p + len;
+
+    for (; p < end; p++) {
+	switch (*p) {
+	case '\\': g_string_append(str, "\\\\"); break;
+	case '\a': g_string_append(str, "\\a"); break;
+	case '\b': g_string_append(str, "\\b"); break;
+	case '\f': g_string_append(str, "\\f"); break;
+	case '\n': g_string_append(str, "\\n"); break;
+	case '\r': g_string_append(str, "\\r"); break;
+	case '\t': g_string_append(str, "\\t"); break;
+	case '\v': g_string_append(str, "\\v"); break;
+	default:
+	    if (*p < 0x20 || *p >= 0x7f)
+		g_string_append_printf(str, "\\%03o", *p);
+	    else
+		g_string_append_c(str, *p);
+	}
+    }
+}
+
+static void
+add_entry(
+    tar_index_t *ti,
+    const char  *name,
+    size_t	 len,
+    guint64	 offset)
+{
+    GString *quoted = g_string_sized_new(len + 16);
+    tar_index_entry_t entry;
+
+    len = strnlen(name, len);
+    /* the index has "./foo" as "/foo" */
+    if (len > 0 && name[0] == '.') {
+	name++;
+	len--;
+    }
+    append_quoted(quoted, name, len);
+
+    entry.name = g_string_chunk_insert(ti->names, quoted->str);
+    entry.offset = offset;
+    g_array_append_val(ti->entries, entry);
+    ti->sorted = FALSE;
+
+    g_string_free(quoted, TRUE);
+}
+
+static void
+clear_pending(
+    tar_index_t *ti)
+{
+    ti->have_pending = FALSE;
+    amfree(ti->pending_name);
+    ti->have_sparse_name = FALSE;
+    ti->have_pending_size = FALSE;
+}
+
+/* Take the path and size out of the records of a pax extended header */
+static void
+parse_pax(
+    tar_index_t *ti,
+    const char  *data,
+    size_t	 len)
+{
+    const char *p = data, *end = data + len;
+    const char *rec_end, *key, *eq;
+    guint64 rec_len;
+    char *endp;
+
+    while (p < end) {
+	rec_len = g_ascii_strtoull(p, &endp, 10);
+	if (endp == p || *endp != ' ' || rec_len == 0 ||
+	    rec_len > (guint64)(end - p))
+	    return;
+	rec_end = p + rec_len;
+	key = endp + 1;
+	eq = memchr(key, '=', rec_end - key);
+	if (!eq || rec_end[-1] != '\n')
+	    return;
+
+	/* a sparse file's real name is in GNU.sparse.name */
+	if ((eq - key == 4 && strncmp(key, "path", 4) == 0 &&
+	     !ti->have_sparse_name) ||
+	    (eq - key == 15 && strncmp(key, "GNU.sparse.name", 15) == 0)) {
+	    ti->have_sparse_name = (*key == 'G');
+	    g_free(ti->pending_name);
+	    ti->pending_name = g_strndup(eq + 1, rec_end - 1 - (eq + 1));
+	} else if (eq - key == 4 && strncmp(key, "size", 4) == 0) {
+	    ti->pending_size = g_ascii_strtoull(eq + 1, NULL, 10);
+	    ti->have_pending_size = TRUE;
+	}
+	p = rec_end;
+    }
+}
+
+static void
+finish_extended(
+    tar_index_t *ti)
+{
+    switch (ti->ext_kind) {
+    case EXT_LONGNAME:
+	g_free(ti->pending_name);
+	ti->pending_name = g_strndup(ti->ext_data->str, ti->ext_data->len);
+	break;
+    case EXT_LONGLINK:
+	break;
+    case EXT_PAX:
+	parse_pax(ti, ti->ext_data->str, ti->ext_data->len);
+	break;
+    }
+    g_string_truncate(ti->ext_data, 0);
+    ti->skip = ti->ext_padding;
+    ti->state = TI_HEADER;
+}
+
+/* Handle the header block in ti->block, which starts at HEADER_OFFSET */
+static void
+parse_header(
+    tar_index_t *ti,
+    guint64	 header_offset)
+{
+    const char *b = ti->block;
+    gboolean ustar, gnu;
+    guint64 size;
+    char typeflag;
+
+    if (ti->state == TI_SPARSE_EXT) {
+	if (!b[GNU_EXT_ISEXTENDED]) {
+	    ti->skip = round_to_block(ti->sparse_data_size);
+	    ti->state = TI_HEADER;
+	}
+	return;
+    }
+
+    if (is_zero_block(b)) {
+	ti->state = TI_END;
+	return;
+    }
+    if (!checksum_ok(b)) {
+	ti->state = TI_ERROR;
+	return;
+    }
+
+    ustar = memcmp(b + TAR_MAGIC, "ustar\0" "00", 8) == 0;
+    gnu = memcmp(b + TAR_MAGIC, "ustar  \0", 8) == 0;
+    size = parse_number(b + TAR_SIZE, 12);
+    typeflag = b[TAR_TYPEFLAG];
+
+    if (!ti->have_pending) {
+	ti->have_pending = TRUE;
+	ti->pending_offset = header_offset;
+    }
+
+    switch (typeflag) {
+    case 'L':
+    case 'K':
+    case 'x':
+	ti->ext_kind = typeflag == 'L'? EXT_LONGNAME :
+		       typeflag == 'K'? EXT_LONGLINK : EXT_PAX;
+	ti->ext_remaining = size;
+	ti->ext_padding = round_to_block(size) - size;
+	if (size > 0)
+	    ti->state = TI_EXTENDED;
+	else
+	    finish_extended(ti);
+	return;
+
+    case 'g':	/* pax global header */
+    case 'V':	/* volume label */
+    case 'M':	/* continuation of a member from the previous volume */
+	ti->skip = round_to_block(size);
+	clear_pending(ti);
+	return;
+    }
+
+    if (ti->have_pending_size)
+	size = ti->pending_size;
+
+    if (ti->pending_name) {
+	add_entry(ti, ti->pending_name, strlen(ti->pending_name),
+		  ti->pending_offset);
+    } else if (ustar && b[TAR_PREFIX]) {
+	char *name = g_strdup_printf("%.155s/%.100s", b + TAR_PREFIX,
+				     b + TAR_NAME);
+	add_entry(ti, name, strlen(name), ti->pending_offset);
+	g_free(name);
+    } else {
+	add_entry(ti, b + TAR_NAME, 100, ti->pending_offset);
+    }
+    clear_pending(ti);
+
+    if (typeflag == 'S' && gnu && b[GNU_ISEXTENDED]) {
+	ti->sparse_data_size = size;
+	ti->state = TI_SPARSE_EXT;
+    } else {
+	ti->skip = round_to_block(size);
+    }
+}
+
+tar_index_t *
+tar_index_new(void)
+{
+    tar_index_t *ti = g_new0(tar_index_t, 1);
+
+    ti->state = TI_HEADER;
+    ti->ext_data = g_string_new(NULL);
+    ti->names = g_string_chunk_new(65536);
+    ti->entries = g_array_new(FALSE, FALSE, sizeof(tar_index_entry_t));
+    ti->sorted = TRUE;
+
+    return ti;
+}
+
+void
+tar_index_free(
+    tar_index_t *ti)
+{
+    if (!ti)
+	return;
+
+    g_string_free(ti->ext_data, TRUE);
+    g_free(ti->pending_name);
+    g_string_chunk_free(ti->names);
+    g_array_free(ti->entries, TRUE);
+    g_free(ti);
+}
+
+gboolean
+tar_index_add_data(
+    tar_index_t *ti,
+    const char  *buf,
+    size_t	 len)
+{
+    size_t n;
+
+    while (len > 0) {
+	switch (ti->state) {
+	case TI_END:
+	    ti->offset += len;
+	    return TRUE;
+
+	case TI_ERROR:
+	    return FALSE;
+
+	case TI_EXTENDED:
+	    n = MIN(len, ti->ext_remaining);
+	    g_string_append_len(ti->ext_data, buf, n);
+	    ti->ext_remaining -= n;
+	    if (ti->ext_remaining == 0)
+		finish_extended(ti);
+	    break;
+
+	case TI_HEADER:
+	case TI_SPARSE_EXT:
+	    if (ti->skip > 0) {
+		n = MIN(len, ti->skip);
+		ti->skip -= n;
+		break;
+	    }
+	    n = MIN(len, TAR_BLOCK_SIZE - ti->block_len);
+	    memcpy(ti->block + ti->block_len, buf, n);
+	    ti->block_len += n;
+	    if (ti->block_len == TAR_BLOCK_SIZE) {
+		ti->block_len = 0;
+		parse_header(ti, ti->offset + n - TAR_BLOCK_SIZE);
+	    }
+	    break;
+
+	default:
+	    g_assert_not_reached();
+	}
+
+	buf += n;
+	len -= n;
+	ti->offset += n;
+    }
+
+    return ti->state != TI_ERROR;
+}
+
+guint
+tar_index_count(
+    tar_index_t *ti)
+{
+    return ti->entries->len;
+}
+
+static gint
+compare_entries(
+    gconstpointer a,
+    gconstpointer b)
+{
+    return strcmp(((const tar_index_entry_t *)a)->name,
+		  ((const tar_index_entry_t *)b)->name);
+}
+
+static void
+sort_entries(
+    tar_index_t *ti)
+{
+    if (!ti->sorted) {
+	g_array_sort(ti->entries, compare_entries);
+	ti->sorted = TRUE;
+    }
+}
+
+/* Write out BUF if it is full enough, or if FLUSH */
+static gboolean
+write_buffer(
+    int		fd,
+    GString    *buf,
+    gboolean	flush)
+{
+    if (buf->len == 0 || (!flush && buf->len < 65536))
+	return TRUE;
+    if (full_write(fd, buf->str, buf->len) < buf->len)
+	return FALSE;
+    g_string_truncate(buf, 0);
+    return TRUE;
+}
+
+gboolean
+tar_index_write(
+    tar_index_t *ti,
+    int		 fd)
+{
+    GString *buf = g_string_sized_new(65536 + 4096);
+    tar_index_entry_t *entry;
+    guint i;
+    gboolean ok = TRUE;
+
+    sort_entries(ti);
+    for (i = 0; ok && i < ti->entries->len; i++) {
+	entry = &g_array_index(ti->entries, tar_index_entry_t, i);
+	g_string_append(buf, entry->name);
+	g_string_append_c(buf, '\n');
+	ok = write_buffer(fd, buf, FALSE);
+    }
+    if (ok)
+	ok = write_buffer(fd, buf, TRUE);
+
+    g_string_free(buf, TRUE);
+    return ok;
+}
+
+static void
+append_varint(
+    GString *buf,
+    guint64  n)
+{
+    while (n >= 0x80) {
+	g_string_append_c(buf, (char)((n & 0x7f) | 0x80));
+	n >>= 7;
+    }
+    g_string_append_c(buf, (char)n);
+}
+
+static gboolean
+read_varint(
+    const guchar **p,
+    const guchar  *end,
+    guint64	  *n)
+{
+    int shift = 0;
+
+    *n = 0;
+    while (*p < end && shift < 64) {
+	*n |= (guint64)(**p & 0x7f) << shift;
+	if (!(*(*p)++ & 0x80))
+	    return TRUE;
+	shift += 7;
+    }
+    return FALSE;
+}
+
+gboolean
+tar_index_write_offsets(
+    tar_index_t *ti,
+    int		 fd)
+{
+    GString *buf = g_string_sized_new(65536 + 4096);
+    tar_index_entry_t *entry;
+    const char *prev = "";
+    size_t shared, len;
+    guint i;
+    gboolean ok = TRUE;
+
+    sort_entries(ti);
+    g_string_append_len(buf, TAR_INDEX_MAGIC, TAR_INDEX_MAGIC_LEN);
+    append_varint(buf, ti->entries->len);
+
+    for (i = 0; ok && i < ti->entries->len; i++) {
+	entry = &g_array_index(ti->entries, tar_index_entry_t, i);
+	for (shared = 0; prev[shared] && prev[shared] == entry->name[shared];
+	     shared++)
+	    ;
+	len = strlen(entry->name + shared);
+	append_varint(buf, shared);
+	append_varint(buf, len);
+	g_string_append_len(buf, entry->name + shared, len);
+	/* members start on a block boundary */
+	append_varint(buf, entry->offset / TAR_BLOCK_SIZE);
+	prev = entry->name;
+	ok = write_buffer(fd, buf, FALSE);
+    }
+    if (ok)
+	ok = write_buffer(fd, buf, TRUE);
+
+    g_string_free(buf, TRUE);
+    return ok;
+}
+
+gboolean
+tar_index_read_offsets(
+    int		   fd,
+    tar_index_func func,
+    gpointer	   user_data)
+{
+    GString *data = g_string_new(NULL);
+    GString *name = g_string_new(NULL);
+    char buf[65536];
+    const guchar *p, *end;
+    guint64 count, shared, len, blocks;
+    size_t n;
+    gboolean ok = FALSE;
+
+    /* full_read sets errno only on an error */
+    errno = 0;
+    do {
+	n = full_read(fd, buf, sizeof(buf));
+	g_string_append_len(data, buf, n);
+    } while (n == sizeof(buf));
+    if (errno != 0)
+	goto out;
+
+    p = (const guchar *)data->str;
+    end = p + data->len;
+    if (data->len < TAR_INDEX_MAGIC_LEN ||
+	memcmp(p, TAR_INDEX_MAGIC, TAR_INDEX_MAGIC_LEN) != 0)
+	goto out;
+    p += TAR_INDEX_MAGIC_LEN;
+
+    if (!read_varint(&p, end, &count))
+	goto out;
+    while (count-- > 0) {
+	if (!read_varint(&p, end, &shared) || !read_varint(&p, end, &len) ||
+	    shared > name->len || len > (guint64)(end - p))
+	    goto out;
+	g_string_truncate(name, shared);
+	g_string_append_len(name, (const char *)p, len);
+	p += len;
+	if (!read_varint(&p, end, &blocks))
+	    goto out;
+	func(name->str, blocks * TAR_BLOCK_SIZE, user_data);
+    }
+    ok = (p == end);
+
+out:
+    g_string_free(data, TRUE);
+    g_string_free(name, TRUE);
+    return ok;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94085, USA, or: http://www.zmanda.com
+ */
+
+/*
+ * Build the index of a tar archive from the archive itself, as it is
+ * written, rather than by listing it with a second tar.
+ *
+ * The archive is fed to the index in pieces of any size.  The index parses
+ * each member's header as it goes by, skipping the member's data, and
+ * remembers the member's name and the offset of its first header block.
+ * GNU (long names, sparse files, incremental directories), ustar and pax
+ * headers are understood.
+ */
+
+#ifndef TAR_INDEX_H
+#define TAR_INDEX_H
+
+#include "amanda.h"
+
+typedef struct tar_index_s tar_index_t;
+
+/* Create an empty index */
+tar_index_t *tar_index_new(void);
+
+/* Free an index */
+void tar_index_free(tar_index_t *ti);
+
+/* Parse the next LEN bytes of the archive.
+ *
+ * @returns: FALSE once the data is found not to be a tar archive; the index
+ * then stops growing, and the caller should not trust it.
+ */
+gboolean tar_index_add_data(tar_index_t *ti, const char *buf, size_t len);
+
+/* The number of members seen so far */
+guint tar_index_count(tar_index_t *ti);
+
+/* Write the index in the form the server stores: one line per member, with
+ * the name quoted as 'gtar --list' quotes it and the leading '.' dropped,
+ * sorted in the C locale's order.
+ *
+ * @returns: FALSE on a write error, with errno set
+ */
+gboolean tar_index_write(tar_index_t *ti, int fd);
+
+/* Write the index, with the offset of each member, in a compact binary form,
+ * sorted as for tar_index_write.  Each name is stored as the length it
+ * shares with the previous name, and the rest of it.
+ *
+ * @returns: FALSE on a write error, with errno set
+ */
+gboolean tar_index_write_offsets(tar_index_t *ti, int fd);
+
+/* Read an index written by tar_index_write_offsets, calling FUNC with each
+ * member's name, as tar_index_write writes it, and offset, in order.
+ *
+ * @returns: FALSE if the file could not be read or is not such an index
+ */
+typedef void (*tar_index_func)(const char *name, guint64 offset,
+			       gpointer user_data);
+gboolean tar_index_read_offsets(int fd, tar_index_func func,
+				gpointer user_data);
+
+#endif /* TAR_INDEX_H */
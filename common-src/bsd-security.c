@@ -37,6 +37,7 @@
 #include "packet.h"
 #include "security.h"
 #include "security-util.h"
+#include "resolver.h"
 #include "sockaddr-util.h"
 #include "stream.h"
 
@@ -90,6 +91,7 @@ const security_driver_t bsd_security_driver = {
     bsd_stream_read_cancel,
     sec_close_connection_none,
     NULL,
+    NULL,
     NULL
 };
 
@@ -108,6 +110,7 @@ static int newhandle = 0;
 /*
  * These are the internal helper functions
  */
+static void	bsd_connect_resolved(void *, int, struct addrinfo *, char *);
 static void	stream_read_callback(void *);
 static void	stream_read_sync_callback(void *);
 
@@ -124,26 +127,46 @@ bsd_connect(
     void *		datap)
 {
     struct sec_handle *bh;
-    in_port_t port = 0;
-    struct timeval sequence_time;
-    int sequence;
-    char *handle;
-    int result;
-    struct addrinfo *res, *res_addr;
-    char *canonname;
-    int result_bind;
-    char *service;
 
     assert(hostname != NULL);
 
-    (void)conf_fn;	/* Quiet unused parameter warning */
-    (void)datap;        /* Quiet unused parameter warning */
-
     bh = g_new0(struct sec_handle, 1);
     bh->proto_handle=NULL;
     security_handleinit(&bh->sech, &bsd_security_driver);
 
-    result = resolve_hostname(hostname, SOCK_DGRAM, &res, &canonname);
+    /*
+     * Look the host up without blocking the other connections; the rest
+     * is done in bsd_connect_resolved.
+     */
+    bh->hostname = g_strdup(hostname);
+    bh->conf_fn = conf_fn;
+    bh->fn.connect = fn;
+    bh->arg = arg;
+    bh->datap = datap;
+    resolver_resolve_async(hostname, SOCK_DGRAM, bsd_connect_resolved, bh);
+}
+
+static void
+bsd_connect_resolved(
+    void *		cookie,
+    int			result,
+    struct addrinfo *	res,
+    char *		canonname)
+{
+    struct sec_handle *bh = cookie;
+    const char *hostname = bh->hostname;
+    char *(*conf_fn)(char *, void *) = bh->conf_fn;
+    void (*fn)(void *, security_handle_t *, security_status_t) = bh->fn.connect;
+    void *arg = bh->arg;
+    void *datap = bh->datap;
+    in_port_t port = 0;
+    struct timeval sequence_time;
+    int sequence;
+    char *handle;
+    struct addrinfo *res_addr;
+    int result_bind;
+    char *service;
+
     if(result != 0) {
 	dbprintf(_("resolve_hostname(%s): %s\n"), hostname, gai_strerror(result));
 	security_seterror(&bh->sech, _("resolve_hostname(%s): %s\n"), hostname,
@@ -156,7 +179,7 @@ bsd_connect(
 	security_seterror(&bh->sech,
 	        _("resolve_hostname(%s) did not return a canonical name\n"), hostname);
 	(*fn)(arg, &bh->sech, S_ERROR);
-	if (res) freeaddrinfo(res);
+	if (res) resolver_free_addrinfo(res);
 	return;
     }
     if (res == NULL) {
@@ -199,7 +222,7 @@ bsd_connect(
 		    _("unable to bind to a reserved port (got port %u)"),
 		    (unsigned int)port);
 		(*fn)(arg, &bh->sech, S_ERROR);
-		freeaddrinfo(res);
+		resolver_free_addrinfo(res);
 		amfree(canonname);
 		return;
 	    }
@@ -239,7 +262,7 @@ bsd_connect(
 		    "unable to bind to a reserved port (got port %u)",
 		    (unsigned int)port);
 		(*fn)(arg, &bh->sech, S_ERROR);
-		freeaddrinfo(res);
+		resolver_free_addrinfo(res);
 		amfree(canonname);
 		return;
 	    }
@@ -255,7 +278,7 @@ bsd_connect(
 	        _("Can't bind a socket to connect to %s\n"), hostname);
 	(*fn)(arg, &bh->sech, S_ERROR);
 	amfree(canonname);
-	freeaddrinfo(res);
+	resolver_free_addrinfo(res);
 	return;
     }
 
@@ -280,7 +303,7 @@ bsd_connect(
         security_seterror(&bh->sech, _("%s/udp unknown protocol"), service);
 	(*fn)(arg, &bh->sech, S_ERROR);
         amfree(canonname);
-	freeaddrinfo(res);
+	resolver_free_addrinfo(res);
 	return;
     }
 
@@ -288,6 +311,7 @@ bsd_connect(
     sequence = (int)sequence_time.tv_sec ^ (int)sequence_time.tv_usec;
     handle=g_malloc(15);
     g_snprintf(handle, 14, "000-%08x",  (unsigned)newhandle++);
+    amfree(bh->hostname);	/* udp_inithandle sets it */
     if (udp_inithandle(bh->udp, bh, canonname,
 	(sockaddr_union *)res_addr->ai_addr, port, handle, sequence) < 0) {
 	(*fn)(arg, &bh->sech, S_ERROR);
@@ -300,7 +324,7 @@ bsd_connect(
     amfree(handle);
     amfree(canonname);
 
-    freeaddrinfo(res);
+    resolver_free_addrinfo(res);
 }
 
 /*
@@ -367,24 +391,7 @@ bsd_close(
     auth_debug(1, _("bsd: close handle '%s'\n"), bh->proto_handle);
 
     udp_recvpkt_cancel(bh);
-    if(bh->next) {
-	bh->next->prev = bh->prev;
-    }
-    else {
-	if (!not_init6 && netfd6.bh_last == bh)
-	    netfd6.bh_last = bh->prev;
-	else
-	    netfd4.bh_last = bh->prev;
-    }
-    if(bh->prev) {
-	bh->prev->next = bh->next;
-    }
-    else {
-	if (!not_init6 && netfd6.bh_first == bh)
-	    netfd6.bh_first = bh->next;
-	else
-	    netfd4.bh_first = bh->next;
-    }
+    udp_removehandle(bh);
 
     amfree(bh->proto_handle);
     amfree(bh->hostname);
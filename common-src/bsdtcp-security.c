@@ -39,6 +39,7 @@
 #include "packet.h"
 #include "security.h"
 #include "security-util.h"
+#include "resolver.h"
 #include "sockaddr-util.h"
 #include "stream.h"
 
@@ -83,7 +84,8 @@ const security_driver_t bsdtcp_security_driver = {
     tcpm_stream_read_cancel,
     tcpm_close_connection,
     NULL,
-    NULL
+    NULL,
+    tcpm_stream_write_from_fd
 };
 
 static int newhandle = 1;
@@ -92,6 +94,7 @@ static int newhandle = 1;
  * Local functions
  */
 static int runbsdtcp(struct sec_handle *, in_port_t port);
+static void bsdtcp_connect_resolved(void *, int, struct addrinfo *, char *);
 
 
 /*
@@ -107,26 +110,47 @@ bsdtcp_connect(
     void *	datap)
 {
     struct sec_handle *rh;
-    int result;
-    char *canonname;
-    char *service;
-    in_port_t port;
 
     assert(fn != NULL);
     assert(hostname != NULL);
-    (void)conf_fn;	/* Quiet unused parameter warning */
-    (void)datap;	/* Quiet unused parameter warning */
 
     auth_debug(1, _("bsdtcp: bsdtcp_connect: %s\n"), hostname);
 
     rh = g_new0(struct sec_handle, 1);
     security_handleinit(&rh->sech, &bsdtcp_security_driver);
-    rh->hostname = NULL;
     rh->rs = NULL;
     rh->ev_timeout = NULL;
     rh->rc = NULL;
 
-    result = resolve_hostname(hostname, 0, NULL, &canonname);
+    /*
+     * Look the host up without blocking the other connections; the rest
+     * is done in bsdtcp_connect_resolved.
+     */
+    rh->hostname = g_strdup(hostname);
+    rh->conf_fn = conf_fn;
+    rh->fn.connect = fn;
+    rh->arg = arg;
+    rh->datap = datap;
+    resolver_resolve_async(hostname, 0, bsdtcp_connect_resolved, rh);
+}
+
+static void
+bsdtcp_connect_resolved(
+    void *		cookie,
+    int			result,
+    struct addrinfo *	res,
+    char *		canonname)
+{
+    struct sec_handle *rh = cookie;
+    char *hostname = rh->hostname;
+    char *(*conf_fn)(char *, void *) = rh->conf_fn;
+    void (*fn)(void *, security_handle_t *, security_status_t) = rh->fn.connect;
+    void *arg = rh->arg;
+    void *datap = rh->datap;
+    char *service;
+    in_port_t port;
+
+    resolver_free_addrinfo(res);
     if(result != 0) {
 	dbprintf(_("resolve_hostname(%s): %s\n"), hostname, gai_strerror(result));
 	security_seterror(&rh->sech, _("resolve_hostname(%s): %s\n"), hostname,
@@ -144,6 +168,7 @@ bsdtcp_connect(
 
     rh->hostname = canonname;	/* will be replaced */
     canonname = NULL; /* steal reference */
+    amfree(hostname);
     rh->rs = tcpma_stream_client(rh, newhandle++);
     rh->rc->recv_security_ok = &bsd_recv_security_ok;
     rh->rc->prefix_packet = &bsd_prefix_packet;
@@ -214,7 +239,7 @@ bsdtcp_accept(
     sockaddr_union sin;
     socklen_t_equiv len;
     struct tcp_conn *rc;
-    char hostname[NI_MAXHOST];
+    char *hostname;
     int result;
     char *errmsg = NULL;
 
@@ -223,19 +248,20 @@ bsdtcp_accept(
 	dbprintf(_("getpeername returned: %s\n"), strerror(errno));
 	return;
     }
-    if ((result = getnameinfo((struct sockaddr *)&sin, len,
-			      hostname, NI_MAXHOST, NULL, 0, 0) != 0)) {
+    if ((result = resolver_name_info(&sin, &hostname)) != 0) {
 	dbprintf(_("getnameinfo failed: %s\n"),
 		  gai_strerror(result));
 	return;
     }
     if (check_name_give_sockaddr(hostname,
 				 (struct sockaddr *)&sin, &errmsg) < 0) {
+	amfree(hostname);
 	amfree(errmsg);
 	return;
     }
 
     rc = sec_tcp_conn_get(hostname, 0);
+    amfree(hostname);
     rc->recv_security_ok = &bsd_recv_security_ok;
     rc->prefix_packet = &bsd_prefix_packet;
     copy_sockaddr(&rc->peer, &sin);
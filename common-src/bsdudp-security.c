@@ -37,6 +37,7 @@
 #include "packet.h"
 #include "security.h"
 #include "security-util.h"
+#include "resolver.h"
 #include "stream.h"
 
 #ifndef SO_RCVBUF
@@ -55,6 +56,7 @@ static void bsdudp_accept(const struct security_driver *,
     void (*)(security_handle_t *, pkt_t *),
     void *);
 static void bsdudp_close(void *);
+static void bsdudp_connect_resolved(void *, int, struct addrinfo *, char *);
 
 /*
  * This is our interface to the outside world
@@ -80,6 +82,7 @@ const security_driver_t bsdudp_security_driver = {
     tcpm_stream_read_cancel,
     sec_close_connection_none,
     NULL,
+    NULL,
     NULL
 };
 
@@ -107,18 +110,7 @@ bsdudp_connect(
     void *	datap)
 {
     struct sec_handle *bh;
-    in_port_t port;
-    struct timeval sequence_time;
-    int sequence;
-    char *handle;
-    int result;
-    char *canonname;
-    struct addrinfo *res = NULL, *res_addr;
-    int result_bind;
-    char *service;
 
-    (void)conf_fn;	/* Quiet unused parameter warning */
-    (void)datap;	/* Quiet unused parameter warning */
     assert(hostname != NULL);
 
     bh = g_new0(struct sec_handle, 1);
@@ -126,7 +118,39 @@ bsdudp_connect(
     bh->rc = NULL;
     security_handleinit(&bh->sech, &bsdudp_security_driver);
 
-    result = resolve_hostname(hostname, SOCK_DGRAM, &res, &canonname);
+    /*
+     * Look the host up without blocking the other connections; the rest
+     * is done in bsdudp_connect_resolved.
+     */
+    bh->hostname = g_strdup(hostname);
+    bh->conf_fn = conf_fn;
+    bh->fn.connect = fn;
+    bh->arg = arg;
+    bh->datap = datap;
+    resolver_resolve_async(hostname, SOCK_DGRAM, bsdudp_connect_resolved, bh);
+}
+
+static void
+bsdudp_connect_resolved(
+    void *		cookie,
+    int			result,
+    struct addrinfo *	res,
+    char *		canonname)
+{
+    struct sec_handle *bh = cookie;
+    const char *hostname = bh->hostname;
+    char *(*conf_fn)(char *, void *) = bh->conf_fn;
+    void (*fn)(void *, security_handle_t *, security_status_t) = bh->fn.connect;
+    void *arg = bh->arg;
+    void *datap = bh->datap;
+    in_port_t port;
+    struct timeval sequence_time;
+    int sequence;
+    char *handle;
+    struct addrinfo *res_addr;
+    int result_bind;
+    char *service;
+
     if(result != 0) {
 	dbprintf(_("resolve_hostname(%s): %s\n"), hostname, gai_strerror(result));
 	security_seterror(&bh->sech, _("resolve_hostname(%s): %s\n"), hostname,
@@ -181,7 +205,7 @@ bsdudp_connect(
 		    _("unable to bind to a reserved port (got port %u)"),
 		    (unsigned int)port);
 		(*fn)(arg, &bh->sech, S_ERROR);
-		freeaddrinfo(res);
+		resolver_free_addrinfo(res);
 		amfree(canonname);
 		return;
 	    }
@@ -221,7 +245,7 @@ bsdudp_connect(
 		    "unable to bind to a reserved port (got port %u)",
 		    (unsigned int)port);
 		(*fn)(arg, &bh->sech, S_ERROR);
-		freeaddrinfo(res);
+		resolver_free_addrinfo(res);
 		amfree(canonname);
 		return;
 	    }
@@ -267,6 +291,7 @@ bsdudp_connect(
     sequence = (int)sequence_time.tv_sec ^ (int)sequence_time.tv_usec;
     handle=g_malloc(15);
     g_snprintf(handle,14,"000-%08x", newhandle++);
+    amfree(bh->hostname);	/* udp_inithandle sets it */
     if (udp_inithandle(bh->udp, bh, canonname,
 		       (sockaddr_union *)res_addr->ai_addr, port,
 		       handle, sequence) < 0) {
@@ -279,7 +304,7 @@ bsdudp_connect(
     amfree(handle);
     amfree(canonname);
 
-    if (res) freeaddrinfo(res);
+    if (res) resolver_free_addrinfo(res);
 }
 
 /*
@@ -339,24 +364,7 @@ bsdudp_close(
     auth_debug(1, _("bsdudp: close handle '%s'\n"), bh->proto_handle);
 
     udp_recvpkt_cancel(bh);
-    if(bh->next) {
-	bh->next->prev = bh->prev;
-    }
-    else {
-	if (!not_init6 && netfd6.bh_last == bh)
-	    netfd6.bh_last = bh->prev;
-	else
-	    netfd4.bh_last = bh->prev;
-    }
-    if(bh->prev) {
-	bh->prev->next = bh->next;
-    }
-    else {
-	if (!not_init6 && netfd6.bh_first == bh)
-	    netfd6.bh_first = bh->next;
-	else
-	    netfd4.bh_first = bh->next;
-    }
+    udp_removehandle(bh);
 
     amfree(bh->proto_handle);
     amfree(bh->hostname);
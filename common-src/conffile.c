@@ -35,6 +35,9 @@
 #include "conffile.h"
 #include "clock.h"
 #include <glib.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 
 /*
  * Lexical analysis
@@ -90,7 +93,9 @@ typedef enum {
     CONF_DEVICE,               CONF_ORDER,		CONF_SINGLE_EXECUTION,
     CONF_DATA_PATH,            CONF_AMANDA,		CONF_DIRECTTCP,
     CONF_TAPER_PARALLEL_WRITE, CONF_INTERACTIVITY,	CONF_TAPERSCAN,
-    CONF_MAX_DLE_BY_VOLUME,    CONF_EJECT_VOLUME,
+    CONF_MAX_DLE_BY_VOLUME,    CONF_EJECT_VOLUME,		CONF_CONFIG_CACHE,
+    CONF_DUMPER_PARALLEL_DUMPS,
+    CONF_DEVICE_OUTPUT_BUFFER_WATERMARK, CONF_DEVICE_READ_BUFFER_SIZE,
 
     /* execute on */
     CONF_PRE_AMCHECK,          CONF_POST_AMCHECK,
@@ -169,6 +174,7 @@ typedef enum {
     /* part_cache_type */
     CONF_PART_SIZE,		CONF_PART_CACHE_TYPE,	CONF_PART_CACHE_DIR,
     CONF_PART_CACHE_MAX_SIZE,	CONF_DISK,		CONF_MEMORY,
+    CONF_PART_SIZE_MIN,		CONF_PART_SIZE_MAX,
 
     /* host-limit */
     CONF_RECOVERY_LIMIT,	CONF_SAME_HOST,		CONF_DUMP_LIMIT,
@@ -588,6 +594,7 @@ static void validate_non_zero(conf_var_t *, val_t *);
 static void validate_positive(conf_var_t *, val_t *);
 static void validate_runspercycle(conf_var_t *, val_t *);
 static void validate_bumppercent(conf_var_t *, val_t *);
+static void validate_watermark(conf_var_t *, val_t *);
 static void validate_bumpmult(conf_var_t *, val_t *);
 static void validate_inparallel(conf_var_t *, val_t *);
 static void validate_displayunit(conf_var_t *, val_t *);
@@ -674,6 +681,25 @@ int debug_sendbackup = 0;
  * cases, come from --with-foo options at build time) */
 static void init_defaults(void);
 
+/* Free all configuration values and subsections (but not the config name,
+ * directory or overrides) */
+static void free_config_values(void);
+
+/* Load a configuration snapshot written by write_config_snapshot(), if one
+ * exists and none of the files it was built from have changed.
+ *
+ * @param stale: (result) set to TRUE if a snapshot exists but was not used
+ * @returns: TRUE if the snapshot was loaded
+ */
+static gboolean read_config_snapshot(gboolean *stale);
+
+/* Write the current configuration to a snapshot for later processes
+ *
+ * @param parse_start: time at which parsing began; files modified after this
+ * are not trusted
+ */
+static void write_config_snapshot(time_t parse_start);
+
 /* Update all dervied values based on the current configuration.  This
  * function can be called multiple times, once after each adjustment
  * to the current configuration.
@@ -916,6 +942,7 @@ keytab_t server_keytab[] = {
     { "COMMENT", CONF_COMMENT },
     { "COMPRATE", CONF_COMPRATE },
     { "COMPRESS", CONF_COMPRESS },
+    { "CONFIG_CACHE", CONF_CONFIG_CACHE },
     { "CONNECT_TRIES", CONF_CONNECT_TRIES },
     { "CTIMEOUT", CONF_CTIMEOUT },
     { "CUSTOM", CONF_CUSTOM },
@@ -948,6 +975,7 @@ keytab_t server_keytab[] = {
     { "DISPLAYUNIT", CONF_DISPLAYUNIT },
     { "DTIMEOUT", CONF_DTIMEOUT },
     { "DUMPCYCLE", CONF_DUMPCYCLE },
+    { "DUMPER_PARALLEL_DUMPS", CONF_DUMPER_PARALLEL_DUMPS },
     { "DUMPORDER", CONF_DUMPORDER },
     { "DUMPTYPE", CONF_DUMPTYPE },
     { "DUMPUSER", CONF_DUMPUSER },
@@ -1019,6 +1047,8 @@ keytab_t server_keytab[] = {
     { "PART_CACHE_MAX_SIZE", CONF_PART_CACHE_MAX_SIZE },
     { "PART_CACHE_TYPE", CONF_PART_CACHE_TYPE },
     { "PART_SIZE", CONF_PART_SIZE },
+    { "PART_SIZE_MAX", CONF_PART_SIZE_MAX },
+    { "PART_SIZE_MIN", CONF_PART_SIZE_MIN },
     { "PLUGIN", CONF_PLUGIN },
     { "PRE_AMCHECK", CONF_PRE_AMCHECK },
     { "PRE_DLE_AMCHECK", CONF_PRE_DLE_AMCHECK },
@@ -1079,6 +1109,8 @@ keytab_t server_keytab[] = {
     { "STRANGE", CONF_STRANGE },
     { "STRATEGY", CONF_STRATEGY },
     { "DEVICE_OUTPUT_BUFFER_SIZE", CONF_DEVICE_OUTPUT_BUFFER_SIZE },
+    { "DEVICE_OUTPUT_BUFFER_WATERMARK", CONF_DEVICE_OUTPUT_BUFFER_WATERMARK },
+    { "DEVICE_READ_BUFFER_SIZE", CONF_DEVICE_READ_BUFFER_SIZE },
     { "TAPECYCLE", CONF_TAPECYCLE },
     { "TAPEDEV", CONF_TAPEDEV },
     { "TAPELIST", CONF_TAPELIST },
@@ -1258,6 +1290,7 @@ conf_var_t server_var [] = {
    { CONF_BUMPMULT             , CONFTYPE_REAL     , read_real        , CNF_BUMPMULT             , validate_bumpmult },
    { CONF_NETUSAGE             , CONFTYPE_INT      , read_int         , CNF_NETUSAGE             , validate_positive },
    { CONF_INPARALLEL           , CONFTYPE_INT      , read_int         , CNF_INPARALLEL           , validate_inparallel },
+   { CONF_DUMPER_PARALLEL_DUMPS, CONFTYPE_INT      , read_int         , CNF_DUMPER_PARALLEL_DUMPS, validate_positive },
    { CONF_DUMPORDER            , CONFTYPE_STR      , read_str         , CNF_DUMPORDER            , NULL },
    { CONF_MAXDUMPS             , CONFTYPE_INT      , read_int         , CNF_MAXDUMPS             , validate_positive },
    { CONF_MAX_DLE_BY_VOLUME    , CONFTYPE_INT      , read_int         , CNF_MAX_DLE_BY_VOLUME    , validate_positive },
@@ -1265,6 +1298,8 @@ conf_var_t server_var [] = {
    { CONF_DTIMEOUT             , CONFTYPE_INT      , read_int         , CNF_DTIMEOUT             , validate_positive },
    { CONF_CTIMEOUT             , CONFTYPE_INT      , read_int         , CNF_CTIMEOUT             , validate_positive },
    { CONF_DEVICE_OUTPUT_BUFFER_SIZE, CONFTYPE_SIZE , read_size_byte   , CNF_DEVICE_OUTPUT_BUFFER_SIZE, validate_positive },
+   { CONF_DEVICE_OUTPUT_BUFFER_WATERMARK, CONFTYPE_INT, read_int       , CNF_DEVICE_OUTPUT_BUFFER_WATERMARK, validate_watermark },
+   { CONF_DEVICE_READ_BUFFER_SIZE, CONFTYPE_SIZE   , read_size_byte   , CNF_DEVICE_READ_BUFFER_SIZE, validate_positive },
    { CONF_COLUMNSPEC           , CONFTYPE_STR      , read_str         , CNF_COLUMNSPEC           , validate_columnspec },
    { CONF_TAPERALGO            , CONFTYPE_TAPERALGO, read_taperalgo   , CNF_TAPERALGO            , NULL },
    { CONF_TAPER_PARALLEL_WRITE , CONFTYPE_INT      , read_int         , CNF_TAPER_PARALLEL_WRITE , NULL },
@@ -1282,6 +1317,7 @@ conf_var_t server_var [] = {
    { CONF_AUTOLABEL            , CONFTYPE_AUTOLABEL, read_autolabel   , CNF_AUTOLABEL            , NULL },
    { CONF_META_AUTOLABEL       , CONFTYPE_STR      , read_str         , CNF_META_AUTOLABEL       , NULL },
    { CONF_EJECT_VOLUME         , CONFTYPE_BOOLEAN  , read_bool        , CNF_EJECT_VOLUME         , NULL },
+   { CONF_CONFIG_CACHE         , CONFTYPE_BOOLEAN  , read_bool        , CNF_CONFIG_CACHE         , NULL },
    { CONF_USETIMESTAMPS        , CONFTYPE_BOOLEAN  , read_bool        , CNF_USETIMESTAMPS        , NULL },
    { CONF_AMRECOVER_DO_FSF     , CONFTYPE_BOOLEAN  , read_bool        , CNF_AMRECOVER_DO_FSF     , NULL },
    { CONF_AMRECOVER_CHANGER    , CONFTYPE_STR      , read_str         , CNF_AMRECOVER_CHANGER    , NULL },
@@ -1328,6 +1364,8 @@ conf_var_t tapetype_var [] = {
    { CONF_PART_CACHE_TYPE      , CONFTYPE_PART_CACHE_TYPE, read_part_cache_type, TAPETYPE_PART_CACHE_TYPE, NULL },
    { CONF_PART_CACHE_DIR       , CONFTYPE_STR      , read_str         , TAPETYPE_PART_CACHE_DIR	 , NULL },
    { CONF_PART_CACHE_MAX_SIZE  , CONFTYPE_INT64    , read_int64       , TAPETYPE_PART_CACHE_MAX_SIZE, validate_nonnegative },
+   { CONF_PART_SIZE_MIN        , CONFTYPE_INT64    , read_int64       , TAPETYPE_PART_SIZE_MIN   , validate_nonnegative },
+   { CONF_PART_SIZE_MAX        , CONFTYPE_INT64    , read_int64       , TAPETYPE_PART_SIZE_MAX   , validate_nonnegative },
    { CONF_UNKNOWN              , CONFTYPE_INT     , NULL              , TAPETYPE_TAPETYPE        , NULL }
 };
 
@@ -2504,6 +2542,8 @@ init_tapetype_defaults(void)
     conf_init_part_cache_type(&tpcur.value[TAPETYPE_PART_CACHE_TYPE], PART_CACHE_TYPE_NONE);
     conf_init_str(&tpcur.value[TAPETYPE_PART_CACHE_DIR], "");
     conf_init_int64(&tpcur.value[TAPETYPE_PART_CACHE_MAX_SIZE], 0);
+    conf_init_int64(&tpcur.value[TAPETYPE_PART_SIZE_MIN], 0);
+    conf_init_int64(&tpcur.value[TAPETYPE_PART_SIZE_MAX], 0);
 }
 
 static void
@@ -4913,6 +4953,15 @@ validate_bumppercent(
 	conf_parserror(_("bumppercent must be between 0 and 100"));
 }
 
+static void
+validate_watermark(
+    struct conf_var_s *np G_GNUC_UNUSED,
+    val_t        *val)
+{
+    if(val_t__int(val) < 0 || val_t__int(val) > 100)
+	conf_parserror(_("device-output-buffer-watermark must be between 0 and 100"));
+}
+
 static void
 validate_inparallel(
     struct conf_var_s *np G_GNUC_UNUSED,
@@ -5170,6 +5219,937 @@ static void validate_columnspec(conf_var_t *var G_GNUC_UNUSED, val_t *value)
     g_strfreev(elements);
 }
 
+/*
+ * Configuration Snapshot Implementation
+ *
+ * A snapshot is a binary image of everything read_conffile() produced for a
+ * server configuration: the global parameters and every subsection list.  It
+ * begins with a header identifying the Amanda version and the layout of the
+ * parameter tables, followed by the name, mtime and size of every file that
+ * was read, so that any edit to amanda.conf or an included file invalidates
+ * it.  Values are stored in native byte order, since a snapshot is only ever
+ * read back on the host that wrote it.
+ */
+
+#define CONFIG_SNAPSHOT_NAME	"amanda.conf.snapshot"
+#define CONFIG_SNAPSHOT_MAGIC	"AMCONFSNAP"
+#define CONFIG_SNAPSHOT_FORMAT	1
+#define CONFIG_SNAPSHOT_BOM	0x01020304
+
+typedef struct snap_writer_s {
+    GString *buf;
+    gboolean ok;
+} snap_writer_t;
+
+typedef struct snap_reader_s {
+    const char *p;
+    const char *end;
+    GPtrArray *files;	/* seen filenames, by index */
+    gboolean ok;
+} snap_reader_t;
+
+static char *
+config_snapshot_filename(void)
+{
+    return g_strconcat(config_dir, "/", CONFIG_SNAPSHOT_NAME, NULL);
+}
+
+static void
+snap_put_int32(
+    snap_writer_t *w,
+    gint32 i)
+{
+    g_string_append_len(w->buf, (char *)&i, sizeof(i));
+}
+
+static void
+snap_put_int64(
+    snap_writer_t *w,
+    gint64 i)
+{
+    g_string_append_len(w->buf, (char *)&i, sizeof(i));
+}
+
+static void
+snap_put_double(
+    snap_writer_t *w,
+    double r)
+{
+    g_string_append_len(w->buf, (char *)&r, sizeof(r));
+}
+
+static void
+snap_put_str(
+    snap_writer_t *w,
+    const char *s)
+{
+    if (!s) {
+	snap_put_int32(w, -1);
+	return;
+    }
+    snap_put_int32(w, (gint32)strlen(s));
+    g_string_append(w->buf, s);
+}
+
+static void
+snap_put_strlist(
+    snap_writer_t *w,
+    GSList *list)
+{
+    snap_put_int32(w, (gint32)g_slist_length(list));
+    for (; list != NULL; list = list->next)
+	snap_put_str(w, list->data);
+}
+
+static void
+snap_put_sl(
+    snap_writer_t *w,
+    sl_t *sl)
+{
+    sle_t *sle;
+
+    if (!sl) {
+	snap_put_int32(w, -1);
+	return;
+    }
+    snap_put_int32(w, sl->nb_element);
+    for (sle = sl->first; sle != NULL; sle = sle->next)
+	snap_put_str(w, sle->name);
+}
+
+static void
+snap_put_seen(
+    snap_writer_t *w,
+    seen_t *seen)
+{
+    gint32 idx = -1;
+
+    /* filenames are stored as an index into seen_filenames */
+    if (seen->filename) {
+	idx = g_slist_index(seen_filenames, seen->filename);
+	if (idx < 0)
+	    w->ok = FALSE;
+    }
+    snap_put_int32(w, idx);
+    snap_put_int32(w, seen->linenum);
+}
+
+static void
+snap_put_property_fn(
+    gpointer key_p,
+    gpointer value_p,
+    gpointer user_data_p)
+{
+    snap_writer_t *w = user_data_p;
+    property_t *property = value_p;
+
+    snap_put_str(w, key_p);
+    snap_put_int32(w, property->append);
+    snap_put_int32(w, property->priority);
+    snap_put_strlist(w, property->values);
+}
+
+static void
+snap_put_val(
+    snap_writer_t *w,
+    val_t *val)
+{
+    GSList *iter;
+
+    snap_put_int32(w, val->type);
+    snap_put_seen(w, &val->seen);
+
+    switch (val->type) {
+	case CONFTYPE_INT:
+	case CONFTYPE_BOOLEAN:
+	case CONFTYPE_NO_YES_ALL:
+	case CONFTYPE_COMPRESS:
+	case CONFTYPE_ENCRYPT:
+	case CONFTYPE_HOLDING:
+	case CONFTYPE_EXECUTE_ON:
+	case CONFTYPE_EXECUTE_WHERE:
+	case CONFTYPE_SEND_AMREPORT_ON:
+	case CONFTYPE_DATA_PATH:
+	case CONFTYPE_STRATEGY:
+	case CONFTYPE_TAPERALGO:
+	case CONFTYPE_PRIORITY:
+	case CONFTYPE_PART_CACHE_TYPE:
+	    snap_put_int32(w, val->v.i);
+	    break;
+
+	case CONFTYPE_SIZE:
+	    snap_put_int64(w, val->v.size);
+	    break;
+
+	case CONFTYPE_INT64:
+	    snap_put_int64(w, val->v.int64);
+	    break;
+
+	case CONFTYPE_TIME:
+	    snap_put_int64(w, val->v.t);
+	    break;
+
+	case CONFTYPE_REAL:
+	    snap_put_double(w, val->v.r);
+	    break;
+
+	case CONFTYPE_RATE:
+	    snap_put_double(w, val->v.rate[0]);
+	    snap_put_double(w, val->v.rate[1]);
+	    break;
+
+	case CONFTYPE_INTRANGE:
+	    snap_put_int32(w, val->v.intrange[0]);
+	    snap_put_int32(w, val->v.intrange[1]);
+	    break;
+
+	case CONFTYPE_IDENT:
+	case CONFTYPE_STR:
+	case CONFTYPE_APPLICATION:
+	    snap_put_str(w, val->v.s);
+	    break;
+
+	case CONFTYPE_IDENTLIST:
+	    snap_put_strlist(w, val->v.identlist);
+	    break;
+
+	case CONFTYPE_HOST_LIMIT:
+	    snap_put_int32(w, val->v.host_limit.server);
+	    snap_put_int32(w, val->v.host_limit.same_host);
+	    snap_put_strlist(w, val->v.host_limit.match_pats);
+	    break;
+
+	case CONFTYPE_ESTIMATELIST:
+	    snap_put_int32(w, (gint32)g_slist_length(val->v.estimatelist));
+	    for (iter = val->v.estimatelist; iter != NULL; iter = iter->next)
+		snap_put_int32(w, GPOINTER_TO_INT(iter->data));
+	    break;
+
+	case CONFTYPE_EXINCLUDE:
+	    snap_put_int32(w, val->v.exinclude.optional);
+	    snap_put_sl(w, val->v.exinclude.sl_list);
+	    snap_put_sl(w, val->v.exinclude.sl_file);
+	    break;
+
+	case CONFTYPE_PROPLIST:
+	    if (!val->v.proplist) {
+		snap_put_int32(w, -1);
+		break;
+	    }
+	    snap_put_int32(w, (gint32)g_hash_table_size(val->v.proplist));
+	    g_hash_table_foreach(val->v.proplist, snap_put_property_fn, w);
+	    break;
+
+	case CONFTYPE_AUTOLABEL:
+	    snap_put_str(w, val->v.autolabel.template);
+	    snap_put_int32(w, val->v.autolabel.autolabel);
+	    break;
+
+	default:
+	    w->ok = FALSE;
+	    break;
+    }
+}
+
+static void
+snap_put_values(
+    snap_writer_t *w,
+    val_t *values,
+    int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	snap_put_val(w, &values[i]);
+}
+
+static void
+snap_put_header(
+    snap_writer_t *w)
+{
+    g_string_append_len(w->buf, CONFIG_SNAPSHOT_MAGIC,
+			sizeof(CONFIG_SNAPSHOT_MAGIC));
+    snap_put_int32(w, CONFIG_SNAPSHOT_BOM);
+    snap_put_int32(w, CONFIG_SNAPSHOT_FORMAT);
+    snap_put_str(w, VERSION);
+
+    /* the layout of the parameter tables */
+    snap_put_int32(w, CNF_CNF);
+    snap_put_int32(w, TAPETYPE_TAPETYPE);
+    snap_put_int32(w, DUMPTYPE_DUMPTYPE);
+    snap_put_int32(w, INTER_INTER);
+    snap_put_int32(w, HOLDING_HOLDING);
+    snap_put_int32(w, APPLICATION_APPLICATION);
+    snap_put_int32(w, PP_SCRIPT_PP_SCRIPT);
+    snap_put_int32(w, DEVICE_CONFIG_DEVICE_CONFIG);
+    snap_put_int32(w, CHANGER_CONFIG_CHANGER_CONFIG);
+    snap_put_int32(w, INTERACTIVITY_INTERACTIVITY);
+    snap_put_int32(w, TAPERSCAN_TAPERSCAN);
+
+    snap_put_str(w, config_filename);
+}
+
+static void
+write_config_snapshot(
+    time_t parse_start)
+{
+    snap_writer_t w;
+    GSList *iter;
+    GSList *hp;
+    holdingdisk_t *hd;
+    changer_config_t *cc;
+    char *filename, *tmp_filename;
+    int fd;
+
+    w.buf = g_string_sized_new(65536);
+    w.ok = TRUE;
+
+    snap_put_header(&w);
+
+    /* the files the configuration was read from */
+    snap_put_int32(&w, (gint32)g_slist_length(seen_filenames));
+    for (iter = seen_filenames; iter != NULL; iter = iter->next) {
+	struct stat sbuf;
+
+	snap_put_str(&w, iter->data);
+	if (stat(iter->data, &sbuf) == 0) {
+	    /* a file changed while we were parsing it can't be trusted */
+	    if (sbuf.st_mtime >= parse_start)
+		w.ok = FALSE;
+	    snap_put_int64(&w, sbuf.st_mtime);
+	    snap_put_int64(&w, sbuf.st_size);
+	} else {
+	    snap_put_int64(&w, -1);
+	    snap_put_int64(&w, -1);
+	}
+    }
+
+    snap_put_values(&w, conf_data, CNF_CNF);
+
+    snap_put_int32(&w, (gint32)g_slist_length(holdinglist));
+    for (hp = holdinglist; hp != NULL; hp = hp->next) {
+	hd = hp->data;
+	snap_put_str(&w, hd->name);
+	snap_put_seen(&w, &hd->seen);
+	snap_put_values(&w, hd->value, HOLDING_HOLDING);
+    }
+
+#define SNAP_PUT_LIST(list, type, nvalues) do {				\
+	gint32 count = 0;						\
+	type *el;							\
+	for (el = (list); el != NULL; el = el->next)			\
+	    count++;							\
+	snap_put_int32(&w, count);					\
+	for (el = (list); el != NULL; el = el->next) {			\
+	    snap_put_str(&w, el->name);					\
+	    snap_put_seen(&w, &el->seen);				\
+	    snap_put_values(&w, el->value, (nvalues));			\
+	}								\
+    } while (0)
+
+    SNAP_PUT_LIST(tapelist, tapetype_t, TAPETYPE_TAPETYPE);
+    SNAP_PUT_LIST(dumplist, dumptype_t, DUMPTYPE_DUMPTYPE);
+    SNAP_PUT_LIST(interface_list, interface_t, INTER_INTER);
+    SNAP_PUT_LIST(application_list, application_t, APPLICATION_APPLICATION);
+    SNAP_PUT_LIST(pp_script_list, pp_script_t, PP_SCRIPT_PP_SCRIPT);
+    SNAP_PUT_LIST(device_config_list, device_config_t, DEVICE_CONFIG_DEVICE_CONFIG);
+    SNAP_PUT_LIST(interactivity_list, interactivity_t, INTERACTIVITY_INTERACTIVITY);
+    SNAP_PUT_LIST(taperscan_list, taperscan_t, TAPERSCAN_TAPERSCAN);
+#undef SNAP_PUT_LIST
+
+    /* changer configs only record a line number */
+    {
+	gint32 count = 0;
+	for (cc = changer_config_list; cc != NULL; cc = cc->next)
+	    count++;
+	snap_put_int32(&w, count);
+	for (cc = changer_config_list; cc != NULL; cc = cc->next) {
+	    snap_put_str(&w, cc->name);
+	    snap_put_int32(&w, cc->seen);
+	    snap_put_values(&w, cc->value, CHANGER_CONFIG_CHANGER_CONFIG);
+	}
+    }
+
+    if (!w.ok) {
+	g_debug("not writing a config snapshot: configuration is still changing");
+	g_string_free(w.buf, TRUE);
+	return;
+    }
+
+    /* write to a temporary file and rename it into place, so that readers
+     * never see a partial snapshot */
+    filename = config_snapshot_filename();
+    tmp_filename = g_strdup_printf("%s.%ld.tmp", filename, (long)getpid());
+    fd = open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+	g_debug("could not create config snapshot '%s': %s", tmp_filename,
+		strerror(errno));
+    } else if (full_write(fd, w.buf->str, w.buf->len) < w.buf->len) {
+	g_debug("could not write config snapshot '%s': %s", tmp_filename,
+		strerror(errno));
+	close(fd);
+	unlink(tmp_filename);
+    } else if (close(fd) != 0 || rename(tmp_filename, filename) != 0) {
+	g_debug("could not install config snapshot '%s': %s", filename,
+		strerror(errno));
+	unlink(tmp_filename);
+    } else {
+	g_debug("wrote config snapshot '%s'", filename);
+    }
+
+    g_free(tmp_filename);
+    g_free(filename);
+    g_string_free(w.buf, TRUE);
+}
+
+static gboolean
+snap_get_bytes(
+    snap_reader_t *r,
+    void *dst,
+    size_t len)
+{
+    if (!r->ok || (size_t)(r->end - r->p) < len) {
+	r->ok = FALSE;
+	memset(dst, 0, len);
+	return FALSE;
+    }
+    memcpy(dst, r->p, len);
+    r->p += len;
+    return TRUE;
+}
+
+static gint32
+snap_get_int32(
+    snap_reader_t *r)
+{
+    gint32 i;
+
+    snap_get_bytes(r, &i, sizeof(i));
+    return i;
+}
+
+static gint64
+snap_get_int64(
+    snap_reader_t *r)
+{
+    gint64 i;
+
+    snap_get_bytes(r, &i, sizeof(i));
+    return i;
+}
+
+static double
+snap_get_double(
+    snap_reader_t *r)
+{
+    double d;
+
+    snap_get_bytes(r, &d, sizeof(d));
+    return d;
+}
+
+/* returns a newly allocated string, or NULL */
+static char *
+snap_get_str(
+    snap_reader_t *r)
+{
+    gint32 len = snap_get_int32(r);
+    char *s;
+
+    if (!r->ok || len < 0)
+	return NULL;
+    if (r->end - r->p < len) {
+	r->ok = FALSE;
+	return NULL;
+    }
+    s = g_strndup(r->p, len);
+    r->p += len;
+    return s;
+}
+
+/* Read a count and make sure it is at least plausible for the remaining data */
+static gint32
+snap_get_count(
+    snap_reader_t *r)
+{
+    gint32 count = snap_get_int32(r);
+
+    if (count > r->end - r->p)
+	r->ok = FALSE;
+    return r->ok? count : -1;
+}
+
+static GSList *
+snap_get_strlist(
+    snap_reader_t *r)
+{
+    GSList *list = NULL;
+    gint32 count = snap_get_count(r);
+
+    while (count-- > 0 && r->ok)
+	list = g_slist_prepend(list, snap_get_str(r));
+    return g_slist_reverse(list);
+}
+
+static sl_t *
+snap_get_sl(
+    snap_reader_t *r)
+{
+    gint32 count = snap_get_count(r);
+    sl_t *sl;
+
+    if (count < 0)
+	return NULL;
+
+    sl = new_sl();
+    while (count-- > 0 && r->ok) {
+	char *name = snap_get_str(r);
+	if (name)
+	    append_sl(sl, name);
+	g_free(name);
+    }
+    return sl;
+}
+
+static void
+snap_get_seen(
+    snap_reader_t *r,
+    seen_t *seen)
+{
+    gint32 idx = snap_get_int32(r);
+
+    seen->linenum = snap_get_int32(r);
+    seen->filename = NULL;
+    if (idx >= 0) {
+	if ((guint)idx < r->files->len)
+	    seen->filename = g_ptr_array_index(r->files, idx);
+	else
+	    r->ok = FALSE;
+    }
+}
+
+static void
+snap_get_val(
+    snap_reader_t *r,
+    val_t *val,
+    conftype_t expected_type)
+{
+    gint32 count;
+
+    /* start from a value free_val_t() can always handle */
+    memset(val, 0, sizeof(*val));
+
+    if (snap_get_int32(r) != (gint32)expected_type) {
+	r->ok = FALSE;
+	return;
+    }
+    val->type = expected_type;
+    snap_get_seen(r, &val->seen);
+
+    switch (val->type) {
+	case CONFTYPE_INT:
+	case CONFTYPE_BOOLEAN:
+	case CONFTYPE_NO_YES_ALL:
+	case CONFTYPE_COMPRESS:
+	case CONFTYPE_ENCRYPT:
+	case CONFTYPE_HOLDING:
+	case CONFTYPE_EXECUTE_ON:
+	case CONFTYPE_EXECUTE_WHERE:
+	case CONFTYPE_SEND_AMREPORT_ON:
+	case CONFTYPE_DATA_PATH:
+	case CONFTYPE_STRATEGY:
+	case CONFTYPE_TAPERALGO:
+	case CONFTYPE_PRIORITY:
+	case CONFTYPE_PART_CACHE_TYPE:
+	    val->v.i = snap_get_int32(r);
+	    break;
+
+	case CONFTYPE_SIZE:
+	    val->v.size = snap_get_int64(r);
+	    break;
+
+	case CONFTYPE_INT64:
+	    val->v.int64 = snap_get_int64(r);
+	    break;
+
+	case CONFTYPE_TIME:
+	    val->v.t = snap_get_int64(r);
+	    break;
+
+	case CONFTYPE_REAL:
+	    val->v.r = snap_get_double(r);
+	    break;
+
+	case CONFTYPE_RATE:
+	    val->v.rate[0] = snap_get_double(r);
+	    val->v.rate[1] = snap_get_double(r);
+	    break;
+
+	case CONFTYPE_INTRANGE:
+	    val->v.intrange[0] = snap_get_int32(r);
+	    val->v.intrange[1] = snap_get_int32(r);
+	    break;
+
+	case CONFTYPE_IDENT:
+	case CONFTYPE_STR:
+	case CONFTYPE_APPLICATION:
+	    val->v.s = snap_get_str(r);
+	    break;
+
+	case CONFTYPE_IDENTLIST:
+	    val->v.identlist = snap_get_strlist(r);
+	    break;
+
+	case CONFTYPE_HOST_LIMIT:
+	    val->v.host_limit.server = snap_get_int32(r);
+	    val->v.host_limit.same_host = snap_get_int32(r);
+	    val->v.host_limit.match_pats = snap_get_strlist(r);
+	    break;
+
+	case CONFTYPE_ESTIMATELIST:
+	    count = snap_get_count(r);
+	    while (count-- > 0 && r->ok)
+		val->v.estimatelist = g_slist_append(val->v.estimatelist,
+				GINT_TO_POINTER(snap_get_int32(r)));
+	    break;
+
+	case CONFTYPE_EXINCLUDE:
+	    val->v.exinclude.optional = snap_get_int32(r);
+	    val->v.exinclude.sl_list = snap_get_sl(r);
+	    val->v.exinclude.sl_file = snap_get_sl(r);
+	    break;
+
+	case CONFTYPE_PROPLIST:
+	    count = snap_get_count(r);
+	    if (count < 0)
+		break;
+	    val->v.proplist = g_hash_table_new_full(g_str_amanda_hash,
+						    g_str_amanda_equal,
+						    &g_free, &free_property_t);
+	    while (count-- > 0 && r->ok) {
+		char *key = snap_get_str(r);
+		property_t *property = g_malloc(sizeof(property_t));
+
+		property->append = snap_get_int32(r);
+		property->priority = snap_get_int32(r);
+		property->values = snap_get_strlist(r);
+		if (key) {
+		    g_hash_table_insert(val->v.proplist, key, property);
+		} else {
+		    r->ok = FALSE;
+		    free_property_t(property);
+		}
+	    }
+	    break;
+
+	case CONFTYPE_AUTOLABEL:
+	    val->v.autolabel.template = snap_get_str(r);
+	    val->v.autolabel.autolabel = snap_get_int32(r);
+	    break;
+
+	default:
+	    r->ok = FALSE;
+	    break;
+    }
+}
+
+/* Read N values, checking each type against the freshly-initialized TEMPLATE */
+static void
+snap_get_values(
+    snap_reader_t *r,
+    val_t *values,
+    val_t *template,
+    int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+	if (!r->ok) {
+	    memset(&values[i], 0, sizeof(values[i]));
+	    continue;
+	}
+	snap_get_val(r, &values[i], template[i].type);
+    }
+}
+
+static gboolean
+snap_check_header(
+    snap_reader_t *r)
+{
+    char magic[sizeof(CONFIG_SNAPSHOT_MAGIC)];
+    char *version, *filename;
+    gboolean ok;
+
+    snap_get_bytes(r, magic, sizeof(magic));
+    if (!r->ok || memcmp(magic, CONFIG_SNAPSHOT_MAGIC, sizeof(magic)) != 0)
+	return FALSE;
+    if (snap_get_int32(r) != CONFIG_SNAPSHOT_BOM ||
+	snap_get_int32(r) != CONFIG_SNAPSHOT_FORMAT)
+	return FALSE;
+
+    version = snap_get_str(r);
+    ok = version && g_str_equal(version, VERSION);
+    g_free(version);
+
+    ok = ok && snap_get_int32(r) == CNF_CNF
+	    && snap_get_int32(r) == TAPETYPE_TAPETYPE
+	    && snap_get_int32(r) == DUMPTYPE_DUMPTYPE
+	    && snap_get_int32(r) == INTER_INTER
+	    && snap_get_int32(r) == HOLDING_HOLDING
+	    && snap_get_int32(r) == APPLICATION_APPLICATION
+	    && snap_get_int32(r) == PP_SCRIPT_PP_SCRIPT
+	    && snap_get_int32(r) == DEVICE_CONFIG_DEVICE_CONFIG
+	    && snap_get_int32(r) == CHANGER_CONFIG_CHANGER_CONFIG
+	    && snap_get_int32(r) == INTERACTIVITY_INTERACTIVITY
+	    && snap_get_int32(r) == TAPERSCAN_TAPERSCAN;
+    if (!ok)
+	return FALSE;
+
+    filename = snap_get_str(r);
+    ok = filename && g_str_equal(filename, config_filename);
+    g_free(filename);
+
+    return ok && r->ok;
+}
+
+/* Read the file list, checking that every file is unchanged */
+static gboolean
+snap_check_files(
+    snap_reader_t *r)
+{
+    gint32 count = snap_get_count(r);
+
+    while (count-- > 0 && r->ok) {
+	char *filename = snap_get_str(r);
+	gint64 mtime = snap_get_int64(r);
+	gint64 size = snap_get_int64(r);
+	struct stat sbuf;
+	gboolean unchanged;
+
+	if (!filename || !r->ok) {
+	    g_free(filename);
+	    return FALSE;
+	}
+
+	if (stat(filename, &sbuf) == 0) {
+	    unchanged = (gint64)sbuf.st_mtime == mtime &&
+			(gint64)sbuf.st_size == size;
+	} else {
+	    unchanged = (mtime == -1);
+	}
+
+	if (!unchanged) {
+	    g_debug("config snapshot is out of date: '%s' changed", filename);
+	    g_free(filename);
+	    return FALSE;
+	}
+
+	g_ptr_array_add(r->files, get_seen_filename(filename));
+	g_free(filename);
+    }
+
+    return r->ok;
+}
+
+static gboolean
+read_config_snapshot(
+    gboolean *stale)
+{
+    snap_reader_t r;
+    char *filename;
+    char *data = NULL;
+    gsize len = 0;
+#ifdef HAVE_SYS_MMAN_H
+    gboolean mapped = FALSE;
+#endif
+    val_t defaults[CNF_CNF];
+    tapetype_t tp_template;
+    dumptype_t dp_template;
+    interface_t ip_template;
+    holdingdisk_t hd_template;
+    application_t ap_template;
+    pp_script_t pp_template;
+    device_config_t dc_template;
+    changer_config_t cc_template;
+    interactivity_t iv_template;
+    taperscan_t ts_template;
+    gint32 count;
+    int i;
+
+    *stale = FALSE;
+    filename = config_snapshot_filename();
+
+#ifdef HAVE_SYS_MMAN_H
+    {
+	int fd = open(filename, O_RDONLY);
+	struct stat sbuf;
+
+	if (fd >= 0) {
+	    if (fstat(fd, &sbuf) == 0 && sbuf.st_size > 0) {
+		data = mmap(NULL, sbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED) {
+		    data = NULL;
+		} else {
+		    len = sbuf.st_size;
+		    mapped = TRUE;
+		}
+	    }
+	    close(fd);
+	}
+    }
+#endif
+    if (!data && !g_file_get_contents(filename, &data, &len, NULL))
+	data = NULL;
+
+    if (!data) {
+	g_free(filename);
+	return FALSE;
+    }
+
+    r.p = data;
+    r.end = data + len;
+    r.files = g_ptr_array_new();
+    r.ok = TRUE;
+
+    if (!snap_check_header(&r) || !snap_check_files(&r))
+	goto fail;
+
+    /* Capture the types of every value from the defaults, so that a snapshot
+     * can never put a value of the wrong type where the accessors expect
+     * another. */
+    memcpy(defaults, conf_data, sizeof(defaults));
+    init_tapetype_defaults();
+    tp_template = tpcur;
+    init_dumptype_defaults();
+    dp_template = dpcur;
+    init_interface_defaults();
+    ip_template = ifcur;
+    init_holdingdisk_defaults();
+    hd_template = hdcur;
+    init_application_defaults();
+    ap_template = apcur;
+    init_pp_script_defaults();
+    pp_template = pscur;
+    init_device_config_defaults();
+    dc_template = dccur;
+    init_changer_config_defaults();
+    cc_template = cccur;
+    init_interactivity_defaults();
+    iv_template = ivcur;
+    init_taperscan_defaults();
+    ts_template = tscur;
+
+    /* the templates are only used for their types; free what they hold */
+    for (i = 0; i < TAPETYPE_TAPETYPE; i++) free_val_t(&tp_template.value[i]);
+    for (i = 0; i < DUMPTYPE_DUMPTYPE; i++) free_val_t(&dp_template.value[i]);
+    for (i = 0; i < INTER_INTER; i++) free_val_t(&ip_template.value[i]);
+    for (i = 0; i < HOLDING_HOLDING; i++) free_val_t(&hd_template.value[i]);
+    for (i = 0; i < APPLICATION_APPLICATION; i++) free_val_t(&ap_template.value[i]);
+    for (i = 0; i < PP_SCRIPT_PP_SCRIPT; i++) free_val_t(&pp_template.value[i]);
+    for (i = 0; i < DEVICE_CONFIG_DEVICE_CONFIG; i++) free_val_t(&dc_template.value[i]);
+    for (i = 0; i < CHANGER_CONFIG_CHANGER_CONFIG; i++) free_val_t(&cc_template.value[i]);
+    for (i = 0; i < INTERACTIVITY_INTERACTIVITY; i++) free_val_t(&iv_template.value[i]);
+    for (i = 0; i < TAPERSCAN_TAPERSCAN; i++) free_val_t(&ts_template.value[i]);
+
+    /* From here on, the current configuration is replaced; on failure it is
+     * freed and the caller falls back to parsing. */
+    free_config_values();
+    snap_get_values(&r, conf_data, defaults, CNF_CNF);
+
+    count = snap_get_count(&r);
+    while (count-- > 0 && r.ok) {
+	holdingdisk_t *hd = g_new0(holdingdisk_t, 1);
+
+	holdinglist = g_slist_append(holdinglist, hd);
+	hd->name = snap_get_str(&r);
+	snap_get_seen(&r, &hd->seen);
+	snap_get_values(&r, hd->value, hd_template.value, HOLDING_HOLDING);
+    }
+
+#define SNAP_GET_LIST(list, type, template, nvalues) do {		\
+	type *tail = NULL;						\
+	count = snap_get_count(&r);					\
+	while (count-- > 0 && r.ok) {					\
+	    type *el = g_new0(type, 1);					\
+	    if (tail)							\
+		tail->next = el;					\
+	    else							\
+		(list) = el;						\
+	    tail = el;							\
+	    el->name = snap_get_str(&r);				\
+	    snap_get_seen(&r, &el->seen);				\
+	    snap_get_values(&r, el->value, (template).value, (nvalues)); \
+	}								\
+    } while (0)
+
+    SNAP_GET_LIST(tapelist, tapetype_t, tp_template, TAPETYPE_TAPETYPE);
+    SNAP_GET_LIST(dumplist, dumptype_t, dp_template, DUMPTYPE_DUMPTYPE);
+    SNAP_GET_LIST(interface_list, interface_t, ip_template, INTER_INTER);
+    SNAP_GET_LIST(application_list, application_t, ap_template, APPLICATION_APPLICATION);
+    SNAP_GET_LIST(pp_script_list, pp_script_t, pp_template, PP_SCRIPT_PP_SCRIPT);
+    SNAP_GET_LIST(device_config_list, device_config_t, dc_template, DEVICE_CONFIG_DEVICE_CONFIG);
+    SNAP_GET_LIST(interactivity_list, interactivity_t, iv_template, INTERACTIVITY_INTERACTIVITY);
+    SNAP_GET_LIST(taperscan_list, taperscan_t, ts_template, TAPERSCAN_TAPERSCAN);
+#undef SNAP_GET_LIST
+
+    {
+	changer_config_t *tail = NULL;
+
+	count = snap_get_count(&r);
+	while (count-- > 0 && r.ok) {
+	    changer_config_t *cc = g_new0(changer_config_t, 1);
+
+	    if (tail)
+		tail->next = cc;
+	    else
+		changer_config_list = cc;
+	    tail = cc;
+	    cc->name = snap_get_str(&r);
+	    cc->seen = snap_get_int32(&r);
+	    snap_get_values(&r, cc->value, cc_template.value,
+			    CHANGER_CONFIG_CHANGER_CONFIG);
+	}
+    }
+
+    /* the whole file must have been consumed */
+    if (!r.ok || r.p != r.end) {
+	free_config_values();
+	memset(conf_data, 0, sizeof(conf_data));
+	goto fail_reset;
+    }
+
+    g_debug("loaded config snapshot '%s'", filename);
+    g_ptr_array_free(r.files, TRUE);
+#ifdef HAVE_SYS_MMAN_H
+    if (mapped) {
+	munmap(data, len);
+	data = NULL;
+    }
+#endif
+    g_free(data);
+    g_free(filename);
+    return TRUE;
+
+fail_reset:
+    /* the configuration was replaced; start over from the defaults */
+    config_initialized = FALSE;
+    init_defaults();
+
+fail:
+    g_debug("not using config snapshot '%s'", filename);
+    *stale = TRUE;
+    g_ptr_array_free(r.files, TRUE);
+#ifdef HAVE_SYS_MMAN_H
+    if (mapped) {
+	munmap(data, len);
+	data = NULL;
+    }
+#endif
+    g_free(data);
+    g_free(filename);
+    return FALSE;
+}
+
 /*
  * Initialization Implementation
  */
@@ -5266,9 +6246,33 @@ config_init(
 	    config_filename = g_strconcat(config_dir, "/amanda.conf", NULL);
 	}
 
-	read_conffile(config_filename,
-		flags & CONFIG_INIT_CLIENT,
-		flags & CONFIG_INIT_CLIENT);
+	/* server configurations without overrides may come from a snapshot;
+	 * overrides also change the defaults that the parse starts from, so
+	 * a snapshot can't represent them */
+	if (!(flags & (CONFIG_INIT_CLIENT | CONFIG_INIT_OVERLAY)) &&
+	    (!config_overrides || config_overrides->n_used == 0)) {
+	    gboolean stale;
+
+	    if (!read_config_snapshot(&stale)) {
+		time_t parse_start = time(NULL);
+
+		read_conffile(config_filename, FALSE, FALSE);
+		if (getconf_boolean(CNF_CONFIG_CACHE)) {
+		    if (cfgerr_level == CFGERR_OK)
+			write_config_snapshot(parse_start);
+		} else if (stale) {
+		    /* config-cache was turned off; don't leave the old
+		     * snapshot to be checked by every later invocation */
+		    char *snapshot = config_snapshot_filename();
+		    unlink(snapshot);
+		    g_free(snapshot);
+		}
+	    }
+	} else {
+	    read_conffile(config_filename,
+		    flags & CONFIG_INIT_CLIENT,
+		    flags & CONFIG_INIT_CLIENT);
+	}
     } else {
 	amfree(config_filename);
     }
@@ -5291,8 +6295,10 @@ config_init(
     return cfgerr_level;
 }
 
-void
-config_uninit(void)
+/* Free the global parameters and all of the subsection lists, leaving the
+ * config name, directory, overrides and errors alone. */
+static void
+free_config_values(void)
 {
     GSList           *hp;
     holdingdisk_t    *hd;
@@ -5307,8 +6313,6 @@ config_uninit(void)
     taperscan_t      *ts, *tsnext;
     int               i;
 
-    if (!config_initialized) return;
-
     for(hp=holdinglist; hp != NULL; hp = hp->next) {
 	hd = hp->data;
 	amfree(hd->name);
@@ -5411,6 +6415,14 @@ config_uninit(void)
 
     for(i=0; i<CNF_CNF; i++)
 	free_val_t(&conf_data[i]);
+}
+
+void
+config_uninit(void)
+{
+    if (!config_initialized) return;
+
+    free_config_values();
 
     if (config_overrides) {
 	free_config_overrides(config_overrides);
@@ -5469,6 +6481,7 @@ init_defaults(
     conf_init_int      (&conf_data[CNF_TAPECYCLE]            , 15);
     conf_init_int      (&conf_data[CNF_NETUSAGE]             , 80000);
     conf_init_int      (&conf_data[CNF_INPARALLEL]           , 10);
+    conf_init_int      (&conf_data[CNF_DUMPER_PARALLEL_DUMPS], 1);
     conf_init_str   (&conf_data[CNF_DUMPORDER]            , "ttt");
     conf_init_int      (&conf_data[CNF_BUMPPERCENT]          , 0);
     conf_init_int64    (&conf_data[CNF_BUMPSIZE]             , (gint64)10*1024);
@@ -5482,6 +6495,8 @@ init_defaults(
     conf_init_int      (&conf_data[CNF_DTIMEOUT]             , 1800);
     conf_init_int      (&conf_data[CNF_CTIMEOUT]             , 30);
     conf_init_size     (&conf_data[CNF_DEVICE_OUTPUT_BUFFER_SIZE], 40*32768);
+    conf_init_int      (&conf_data[CNF_DEVICE_OUTPUT_BUFFER_WATERMARK], 0);
+    conf_init_size     (&conf_data[CNF_DEVICE_READ_BUFFER_SIZE], 40*32768);
     conf_init_str   (&conf_data[CNF_PRINTER]              , "");
     conf_init_str   (&conf_data[CNF_MAILER]               , DEFAULT_MAILER);
     conf_init_no_yes_all(&conf_data[CNF_AUTOFLUSH]            , 0);
@@ -5501,6 +6516,7 @@ init_defaults(
     conf_init_str   (&conf_data[CNF_KRB5PRINCIPAL]        , "service/amanda");
     conf_init_str   (&conf_data[CNF_LABEL_NEW_TAPES]      , "");
     conf_init_bool     (&conf_data[CNF_EJECT_VOLUME]         , 0);
+    conf_init_bool     (&conf_data[CNF_CONFIG_CACHE]         , 0);
     conf_init_bool     (&conf_data[CNF_USETIMESTAMPS]        , 1);
     conf_init_int      (&conf_data[CNF_CONNECT_TRIES]        , 3);
     conf_init_int      (&conf_data[CNF_REP_TRIES]            , 5);
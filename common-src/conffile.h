@@ -488,6 +488,10 @@ typedef enum {
     CNF_TAPERSCAN,
     CNF_MAX_DLE_BY_VOLUME,
     CNF_EJECT_VOLUME,
+    CNF_CONFIG_CACHE,
+    CNF_DUMPER_PARALLEL_DUMPS,
+    CNF_DEVICE_OUTPUT_BUFFER_WATERMARK,
+    CNF_DEVICE_READ_BUFFER_SIZE,
     CNF_CNF /* sentinel */
 } confparm_key;
 
@@ -607,6 +611,8 @@ typedef enum {
     TAPETYPE_PART_CACHE_TYPE,
     TAPETYPE_PART_CACHE_DIR,
     TAPETYPE_PART_CACHE_MAX_SIZE,
+    TAPETYPE_PART_SIZE_MIN,
+    TAPETYPE_PART_SIZE_MAX,
     TAPETYPE_TAPETYPE /* sentinel */
 } tapetype_key;
 
@@ -661,6 +667,8 @@ char *tapetype_name(tapetype_t *ttyp);
 #define tapetype_get_part_cache_type(ttyp)     (val_t_to_part_cache_type(tapetype_getconf((ttyp), TAPETYPE_PART_CACHE_TYPE)))
 #define tapetype_get_part_cache_dir(ttyp)      (val_t_to_str(tapetype_getconf((ttyp), TAPETYPE_PART_CACHE_DIR)))
 #define tapetype_get_part_cache_max_size(ttyp) (val_t_to_int64(tapetype_getconf((ttyp), TAPETYPE_PART_CACHE_MAX_SIZE)))
+#define tapetype_get_part_size_min(ttyp)       (val_t_to_int64(tapetype_getconf((ttyp), TAPETYPE_PART_SIZE_MIN)))
+#define tapetype_get_part_size_max(ttyp)       (val_t_to_int64(tapetype_getconf((ttyp), TAPETYPE_PART_SIZE_MAX)))
 
 /*
  * Dumptype parameter access
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA.
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
+ */
+
+#include "amanda.h"
+#include "crc32c.h"
+#include "testutils.h"
+#include "simpleprng.h"
+
+static gboolean
+test_vectors(void)
+{
+    static const struct { char *in; guint32 crc; } vecs[] = {
+	{ "", 0x00000000 },
+	{ "a", 0xc1d04330 },
+	{ "123456789", 0xe3069283 },
+    };
+    crc32c_t crc;
+    guint i;
+    gboolean ret = TRUE;
+
+    for (i = 0; i < G_N_ELEMENTS(vecs); i++) {
+	crc32c_init(&crc);
+	crc32c_add(&crc, vecs[i].in, strlen(vecs[i].in));
+	if (crc32c_finish(&crc) != vecs[i].crc) {
+	    tu_dbg("crc32c(\"%s\") = %08x; expected %08x\n", vecs[i].in,
+		   crc32c_finish(&crc), vecs[i].crc);
+	    ret = FALSE;
+	}
+    }
+    return ret;
+}
+
+/* adding the data in pieces of any size and alignment gives the same
+ * result as adding it at once */
+static gboolean
+test_pieces(void)
+{
+    simpleprng_state_t prng;
+    gsize size = 65536 + 17;
+    guint8 *buf = g_malloc(size);
+    crc32c_t whole, pieces;
+    gsize pos, n;
+    gboolean ret = TRUE;
+
+    simpleprng_seed(&prng, 0xcafe);
+    simpleprng_fill_buffer(&prng, buf, size);
+
+    crc32c_init(&whole);
+    crc32c_add(&whole, buf + 1, size - 1);
+
+    crc32c_init(&pieces);
+    for (pos = 1; pos < size; pos += n) {
+	n = MIN(simpleprng_rand_byte(&prng) + 1, size - pos);
+	crc32c_add(&pieces, buf + pos, n);
+    }
+
+    if (crc32c_finish(&whole) != crc32c_finish(&pieces) ||
+	whole.size != pieces.size) {
+	tu_dbg("whole: %08x, pieces: %08x\n", crc32c_finish(&whole),
+	       crc32c_finish(&pieces));
+	ret = FALSE;
+    }
+
+    g_free(buf);
+    return ret;
+}
+
+/* trailing zeros, even spread over several buffers, do not change a part
+ * checksum, but zeros followed by data do */
+static gboolean
+test_part(void)
+{
+    static guint8 zeros[10000];
+    guint8 data[5004];
+    crc32c_part_t part;
+    crc32c_t crc;
+    gboolean ret = TRUE;
+
+    memset(data, 0, sizeof(data));
+    memcpy(data, "abc", 3);
+    data[5003] = 'd';
+
+    crc32c_part_init(&part);
+    crc32c_part_add(&part, "abc", 3);
+    crc32c_part_add(&part, zeros, 5000);
+    crc32c_part_add(&part, "d", 1);
+    crc32c_part_add(&part, zeros, 4000);
+    crc32c_part_add(&part, zeros, 10000);
+
+    crc32c_init(&crc);
+    crc32c_add(&crc, data, sizeof(data));
+
+    if (crc32c_part_finish(&part) != crc32c_finish(&crc)) {
+	tu_dbg("part: %08x, expected %08x\n", crc32c_part_finish(&part),
+	       crc32c_finish(&crc));
+	ret = FALSE;
+    }
+
+    return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+    static TestUtilsTest tests[] = {
+	TU_TEST(test_vectors, 90),
+	TU_TEST(test_pieces, 90),
+	TU_TEST(test_part, 90),
+	TU_END()
+    };
+    return testutils_run_tests(argc, argv, tests);
+}
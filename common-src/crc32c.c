@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA.
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
+ */
+
+#include "amanda.h"
+#include "crc32c.h"
+
+/* reversed Castagnoli polynomial */
+#define CRC32C_POLY 0x82F63B78
+
+/* gcc can emit the SSE 4.2 crc32 instruction for a single function, and
+ * tell at run time whether the processor has it */
+#if defined(__GNUC__) && defined(__x86_64__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8))
+#define CRC32C_SSE42 1
+#endif
+
+/* tables for the "slicing-by-8" software implementation */
+static guint32 crc32c_table[8][256];
+
+static guint32 (*crc32c_update)(guint32 crc, const guint8 *p, size_t len);
+static volatile gboolean crc32c_initialized = FALSE;
+G_LOCK_DEFINE_STATIC(crc32c_setup);
+
+static guint32
+crc32c_update_sw(
+    guint32 crc,
+    const guint8 *p,
+    size_t len)
+{
+    guint32 lo, hi;
+
+    while (len && ((gsize)p & 7)) {
+	crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	len--;
+    }
+
+    while (len >= 8) {
+	lo = crc ^ ((guint32)p[0] | (guint32)p[1] << 8 |
+		    (guint32)p[2] << 16 | (guint32)p[3] << 24);
+	hi = (guint32)p[4] | (guint32)p[5] << 8 |
+	     (guint32)p[6] << 16 | (guint32)p[7] << 24;
+	crc = crc32c_table[7][lo & 0xff] ^
+	      crc32c_table[6][(lo >> 8) & 0xff] ^
+	      crc32c_table[5][(lo >> 16) & 0xff] ^
+	      crc32c_table[4][lo >> 24] ^
+	      crc32c_table[3][hi & 0xff] ^
+	      crc32c_table[2][(hi >> 8) & 0xff] ^
+	      crc32c_table[1][(hi >> 16) & 0xff] ^
+	      crc32c_table[0][hi >> 24];
+	p += 8;
+	len -= 8;
+    }
+
+    while (len--)
+	crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+    return crc;
+}
+
+#ifdef CRC32C_SSE42
+__attribute__((target("sse4.2")))
+static guint32
+crc32c_update_sse42(
+    guint32 crc,
+    const guint8 *p,
+    size_t len)
+{
+    guint64 crc64;
+
+    while (len && ((gsize)p & 7)) {
+	crc = __builtin_ia32_crc32qi(crc, *p++);
+	len--;
+    }
+
+    crc64 = crc;
+    while (len >= 8) {
+	crc64 = __builtin_ia32_crc32di(crc64, *(const guint64 *)p);
+	p += 8;
+	len -= 8;
+    }
+    crc = (guint32)crc64;
+
+    while (len--)
+	crc = __builtin_ia32_crc32qi(crc, *p++);
+
+    return crc;
+}
+#endif
+
+static void
+crc32c_setup(void)
+{
+    guint32 i, k, crc;
+
+    if (crc32c_initialized)
+	return;
+
+    G_LOCK(crc32c_setup);
+    if (!crc32c_initialized) {
+	for (i = 0; i < 256; i++) {
+	    crc = i;
+	    for (k = 0; k < 8; k++)
+		crc = (crc >> 1) ^ ((crc & 1)? CRC32C_POLY : 0);
+	    crc32c_table[0][i] = crc;
+	}
+	for (i = 0; i < 256; i++) {
+	    for (k = 1; k < 8; k++) {
+		crc = crc32c_table[k-1][i];
+		crc32c_table[k][i] = (crc >> 8) ^ crc32c_table[0][crc & 0xff];
+	    }
+	}
+
+	crc32c_update = crc32c_update_sw;
+#ifdef CRC32C_SSE42
+	if (__builtin_cpu_supports("sse4.2"))
+	    crc32c_update = crc32c_update_sse42;
+#endif
+	crc32c_initialized = TRUE;
+    }
+    G_UNLOCK(crc32c_setup);
+}
+
+void
+crc32c_init(
+    crc32c_t *crc)
+{
+    crc32c_setup();
+    crc->crc = 0xffffffff;
+    crc->size = 0;
+}
+
+void
+crc32c_add(
+    crc32c_t *crc,
+    gconstpointer buf,
+    size_t len)
+{
+    crc->crc = crc32c_update(crc->crc, buf, len);
+    crc->size += len;
+}
+
+guint32
+crc32c_finish(
+    crc32c_t *crc)
+{
+    return crc->crc ^ 0xffffffff;
+}
+
+void
+crc32c_part_init(
+    crc32c_part_t *part)
+{
+    crc32c_init(&part->crc);
+    part->zeros = 0;
+}
+
+void
+crc32c_part_add(
+    crc32c_part_t *part,
+    gconstpointer buf,
+    size_t len)
+{
+    static const guint8 zeros[4096];
+    const guint8 *p = buf;
+    size_t last = len;
+    size_t n;
+
+    /* find the last non-zero byte; usually the last byte */
+    while (last > 0 && p[last-1] == 0)
+	last--;
+
+    if (last == 0) {
+	part->zeros += len;
+	return;
+    }
+
+    /* the zeros held back are not trailing after all */
+    while (part->zeros > 0) {
+	n = (size_t)MIN(part->zeros, sizeof(zeros));
+	crc32c_add(&part->crc, zeros, n);
+	part->zeros -= n;
+    }
+
+    crc32c_add(&part->crc, p, last);
+    part->zeros = len - last;
+}
+
+guint32
+crc32c_part_finish(
+    crc32c_part_t *part)
+{
+    return crc32c_finish(&part->crc);
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA.
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
+ */
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include "amanda.h"
+
+/* CRC32C (Castagnoli) checksums.  The SSE 4.2 crc32 instruction is used
+ * when the processor has it. */
+
+typedef struct {
+    guint32 crc;	/* running value; use crc32c_finish to get the checksum */
+    guint64 size;	/* bytes added so far */
+} crc32c_t;
+
+/* Start a new checksum
+ *
+ * @param crc: the checksum state
+ */
+void crc32c_init(crc32c_t *crc);
+
+/* Add data to a checksum
+ *
+ * @param crc: the checksum state
+ * @param buf: the data
+ * @param len: its length
+ */
+void crc32c_add(crc32c_t *crc, gconstpointer buf, size_t len);
+
+/* Get the checksum of the data added so far; more may be added afterward
+ *
+ * @param crc: the checksum state
+ * @returns: the checksum
+ */
+guint32 crc32c_finish(crc32c_t *crc);
+
+/* The checksum recorded for each part written to a volume.  It is the CRC32C
+ * of the part's data without any trailing zero bytes, so that it does not
+ * depend on whether the device pads the last block of a file. */
+
+typedef struct {
+    crc32c_t crc;	/* the data up to the last non-zero byte */
+    guint64 zeros;	/* zero bytes seen since then */
+} crc32c_part_t;
+
+void crc32c_part_init(crc32c_part_t *part);
+void crc32c_part_add(crc32c_part_t *part, gconstpointer buf, size_t len);
+guint32 crc32c_part_finish(crc32c_part_t *part);
+
+#endif /* CRC32C_H */
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA.
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
+ */
+
+#include "amanda.h"
+#include "testutils.h"
+
+#define NB_THREADS 4
+#define NB_MESSAGES 2000
+
+/*
+ * Utils
+ */
+
+/* open a new debug file, which starts asynchronous logging in this process,
+ * and return its name */
+static char *
+open_debug_file(void)
+{
+    debug_init();
+    return g_strdup(debug_fn());
+}
+
+static char *
+read_debug_file(
+    char *filename)
+{
+    char *contents = NULL;
+
+    if (!g_file_get_contents(filename, &contents, NULL, NULL))
+	tu_dbg("could not read '%s'\n", filename);
+    return contents;
+}
+
+static GMutex *order_mutex;
+static int order_next;
+
+/* add messages numbered in the order they are added, across the threads; some
+ * are too large to be formatted on the stack, and together they overflow the
+ * thread's ring */
+static gpointer
+order_thread(
+    gpointer data G_GNUC_UNUSED)
+{
+    char *padding = g_strnfill(2000, 'x');
+    int i;
+
+    for (i = 0; i < NB_MESSAGES; i++) {
+	g_mutex_lock(order_mutex);
+	if (order_next % 100 == 0)
+	    dbprintf("order %d %s\n", order_next, padding);
+	else
+	    dbprintf("order %d\n", order_next);
+	order_next++;
+	g_mutex_unlock(order_mutex);
+    }
+
+    g_free(padding);
+    return NULL;
+}
+
+/* in a new process, add a message and then fail with g_critical or g_error;
+ * returns the name of the debug file it used */
+static char *
+fatal_child(
+    gboolean use_error)
+{
+    char filename[STR_SIZE];
+    int fds[2];
+    pid_t pid;
+    ssize_t len;
+
+    if (pipe(fds) < 0)
+	return NULL;
+
+    if ((pid = fork()) == 0) {
+	struct rlimit no_core = { 0, 0 };
+	char *name;
+	int devnull;
+
+	close(fds[0]);
+	setrlimit(RLIMIT_CORE, &no_core);
+	/* keep the message amanda_log_stderr prints out of the test output */
+	if ((devnull = open("/dev/null", O_WRONLY)) >= 0)
+	    dup2(devnull, STDERR_FILENO);
+
+	name = open_debug_file();
+	full_write(fds[1], name, strlen(name));
+	close(fds[1]);
+
+	dbprintf("before the fatal message\n");
+	if (use_error)
+	    g_error("the fatal message");
+	else
+	    g_critical("the fatal message");
+	exit(0);
+    }
+
+    close(fds[1]);
+    len = full_read(fds[0], filename, sizeof(filename) - 1);
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+    if (len <= 0)
+	return NULL;
+    filename[len] = '\0';
+    return g_strdup(filename);
+}
+
+static gboolean
+check_fatal_flush(
+    gboolean use_error)
+{
+    char *filename = fatal_child(use_error);
+    char *contents, *before, *fatal;
+    gboolean ok;
+
+    if (!filename) {
+	tu_dbg("the child did not open a debug file\n");
+	return FALSE;
+    }
+    contents = read_debug_file(filename);
+    unlink(filename);
+    g_free(filename);
+    if (!contents)
+	return FALSE;
+
+    before = strstr(contents, "before the fatal message");
+    fatal = strstr(contents, "(fatal): the fatal message");
+    ok = before && fatal && before < fatal;
+    if (!ok)
+	tu_dbg("debug file is:\n%s\n", contents);
+    g_free(contents);
+    return ok;
+}
+
+/*
+ * Tests
+ */
+
+/* Messages added by different threads are written in the order they were
+ * added */
+static gboolean
+test_thread_order(void)
+{
+    GThread *threads[NB_THREADS];
+    char *filename, *contents, *p;
+    int i, expected;
+    gboolean ok = TRUE;
+
+    filename = open_debug_file();
+    order_mutex = g_mutex_new();
+    order_next = 0;
+    for (i = 0; i < NB_THREADS; i++)
+	threads[i] = g_thread_create(order_thread, NULL, TRUE, NULL);
+    for (i = 0; i < NB_THREADS; i++)
+	g_thread_join(threads[i]);
+    debug_flush();
+
+    contents = read_debug_file(filename);
+    unlink(filename);
+    g_free(filename);
+    if (!contents)
+	return FALSE;
+
+    expected = 0;
+    for (p = strstr(contents, ": order "); p; p = strstr(p + 1, ": order ")) {
+	int n = atoi(p + 8);
+	if (n != expected) {
+	    tu_dbg("message %d is written where message %d should be\n",
+		   n, expected);
+	    ok = FALSE;
+	    break;
+	}
+	expected++;
+    }
+    if (ok && expected != NB_THREADS * NB_MESSAGES) {
+	tu_dbg("%d messages were written; expected %d\n",
+	       expected, NB_THREADS * NB_MESSAGES);
+	ok = FALSE;
+    }
+
+    g_free(contents);
+    return ok;
+}
+
+/* The messages waiting to be written are written before a g_critical, which
+ * exits */
+static gboolean
+test_flush_before_critical(void)
+{
+    return check_fatal_flush(FALSE);
+}
+
+/* .. and before a g_error, which aborts and so runs no atexit handler */
+static gboolean
+test_flush_before_error(void)
+{
+    return check_fatal_flush(TRUE);
+}
+
+/*
+ * Main driver
+ */
+
+int
+main(int argc, char **argv)
+{
+    static TestUtilsTest tests[] = {
+	TU_TEST(test_thread_order, 90),
+	TU_TEST(test_flush_before_critical, 90),
+	TU_TEST(test_flush_before_error, 90),
+	TU_END()
+    };
+
+    glib_init();
+    set_pname("debug-test");
+
+    return testutils_run_tests(argc, argv, tests);
+}
@@ -58,6 +58,51 @@ static char *dbgdir = NULL;
 /* time debug log was opened (timestamp of the file) */
 static time_t open_time;
 
+/*
+ * Asynchronous logging.  Once the debug file is open, each thread adds its
+ * messages to a ring buffer of its own, and a flusher thread writes them to
+ * the file, in the order they were added, every DEBUG_FLUSH_MSEC or when a
+ * ring is half full.  A thread adding a message only formats it and copies it
+ * into its ring; the time is formatted by the flusher.  A thread whose ring is
+ * full flushes the rings itself.  Fatal messages, messages too large for a
+ * ring, and messages from a forked child are written directly, after the
+ * rings are flushed.
+ */
+
+/* bytes in each ring; a power of 2 */
+#define DEBUG_RING_SIZE (64*1024)
+#define DEBUG_FLUSH_MSEC 100
+
+typedef struct debug_record_s {
+    gsize len;		/* of the text following this header */
+    guint32 seq;	/* order in which the messages were added */
+    time_t time;
+    gpointer thread;
+} debug_record_t;
+
+typedef struct debug_ring_s {
+    char buf[DEBUG_RING_SIZE];
+    /* bytes ever added, changed only by the owning thread; and bytes ever
+     * removed, changed only with debug_rings_mutex held */
+    gint head;
+    gint tail;
+    /* the owning thread has exited; the ring can be given to another */
+    gint released;
+    /* the flusher's position in the ring, with debug_rings_mutex held */
+    guint cursor, end;
+} debug_ring_t;
+
+static gboolean debug_async = FALSE;
+static pid_t debug_async_pid;		/* the process the rings belong to */
+static gint debug_fatal = 0;		/* write everything directly now */
+static gint debug_seq = 0;
+static GPrivate *debug_ring_key = NULL;
+static GSList *debug_rings = NULL;
+static GMutex *debug_rings_mutex = NULL;
+static GMutex *debug_file_mutex = NULL;	/* for writes to db_file */
+static GMutex *debug_flush_mutex = NULL;
+static GCond *debug_flush_cond = NULL;
+
 /* storage for global variables */
 int error_exit_status = 1;
 
@@ -68,6 +113,10 @@ static void debug_setup_1(char *config, char *subdir);
 static void debug_setup_2(char *s, int fd, char *annotation);
 static char *msg_timestamp(void);
 static char *msg_thread(void);
+static void debug_async_start(void);
+static gboolean debug_write_rings(void);
+static gboolean debug_flush_rings(void);
+static int debug_swap_file(FILE *file, gboolean close_old);
 
 static void debug_logging_handler(const gchar *log_domain,
 	GLogLevelFlags log_level,
@@ -162,6 +211,13 @@ debug_logging_handler(const gchar *log_domain G_GNUC_UNUSED,
 	levprefix = ""; /* no level displayed for debugging */
     }
 
+    /* a fatal message, and everything after it, is written directly, once
+     * the messages already in the rings are written */
+    if (log_level & (G_LOG_LEVEL_ERROR|G_LOG_LEVEL_CRITICAL)) {
+	g_atomic_int_set(&debug_fatal, 1);
+	debug_flush_rings();
+    }
+
     /* scriptutil context doesn't do any logging except for critical
      * and error levels */
     if (context != CONTEXT_SCRIPTUTIL) {
@@ -465,7 +521,9 @@ debug_setup_2(
 	while(--i >= 0) {
 	    close(fd_close[i]);
 	}
-	db_file = fdopen(db_fd, "a");
+	/* what is waiting goes to the old file, if there is one */
+	debug_swap_file(fdopen(db_fd, "a"), FALSE);
+	debug_async_start();
     }
 
     if (annotation) {
@@ -519,6 +577,297 @@ msg_thread(void)
     return thread;
 }
 
+/*
+ * ---- asynchronous logging
+ */
+
+/* Copy LEN bytes between BUF and position POS of RING */
+static void
+ring_copy_in(
+    debug_ring_t *ring,
+    guint pos,
+    const void *buf,
+    gsize len)
+{
+    gsize off = pos & (DEBUG_RING_SIZE - 1);
+    gsize first = MIN(len, DEBUG_RING_SIZE - off);
+
+    memcpy(ring->buf + off, buf, first);
+    memcpy(ring->buf, (const char *)buf + first, len - first);
+}
+
+static void
+ring_copy_out(
+    debug_ring_t *ring,
+    guint pos,
+    void *buf,
+    gsize len)
+{
+    gsize off = pos & (DEBUG_RING_SIZE - 1);
+    gsize first = MIN(len, DEBUG_RING_SIZE - off);
+
+    memcpy(buf, ring->buf + off, first);
+    memcpy((char *)buf + first, ring->buf, len - first);
+}
+
+static void
+debug_ring_release(
+    gpointer data)
+{
+    debug_ring_t *ring = data;
+
+    g_atomic_int_set(&ring->released, 1);
+}
+
+/* Get the calling thread's ring, reusing an empty one left by a thread that
+ * has exited, if there is one */
+static debug_ring_t *
+debug_ring_get(void)
+{
+    debug_ring_t *ring = g_private_get(debug_ring_key);
+    GSList *iter;
+
+    if (ring)
+	return ring;
+
+    g_mutex_lock(debug_rings_mutex);
+    for (iter = debug_rings; iter; iter = iter->next) {
+	debug_ring_t *r = iter->data;
+	if (g_atomic_int_get(&r->released) && r->head == r->tail) {
+	    r->released = 0;
+	    ring = r;
+	    break;
+	}
+    }
+    if (!ring) {
+	ring = g_new0(debug_ring_t, 1);
+	debug_rings = g_slist_prepend(debug_rings, ring);
+    }
+    g_mutex_unlock(debug_rings_mutex);
+
+    g_private_set(debug_ring_key, ring);
+    return ring;
+}
+
+/* Write what is in the rings to the debug file, in the order it was added.
+ * Call with debug_rings_mutex and debug_file_mutex held.  With no debug file,
+ * the messages stay in the rings until there is one.
+ *
+ * @returns: FALSE if there is no debug file
+ */
+static gboolean
+debug_write_rings(void)
+{
+    static char text[DEBUG_RING_SIZE];
+    debug_record_t rec, best_rec;
+    debug_ring_t *best;
+    char timestamp[128], *r;
+    GSList *iter;
+
+    if (!db_file)
+	return FALSE;
+
+    for (iter = debug_rings; iter; iter = iter->next) {
+	debug_ring_t *ring = iter->data;
+	ring->end = (guint)g_atomic_int_get(&ring->head);
+	ring->cursor = (guint)ring->tail;
+    }
+
+    while (1) {
+	/* the next message is the earliest at the front of any ring */
+	best = NULL;
+	for (iter = debug_rings; iter; iter = iter->next) {
+	    debug_ring_t *ring = iter->data;
+	    if (ring->cursor == ring->end)
+		continue;
+	    ring_copy_out(ring, ring->cursor, &rec, sizeof(rec));
+	    if (!best || (gint32)(rec.seq - best_rec.seq) < 0) {
+		best = ring;
+		best_rec = rec;
+	    }
+	}
+	if (!best)
+	    break;
+
+	ring_copy_out(best, best->cursor + sizeof(best_rec), text, best_rec.len);
+	best->cursor += sizeof(best_rec) + best_rec.len;
+
+	ctime_r(&best_rec.time, timestamp);
+	if ((r = strchr(timestamp, '\n')) != NULL)
+	    *r = '\0';
+	fprintf(db_file, "%s: thd-%p: %s: ", timestamp, best_rec.thread,
+		get_pname());
+	fwrite(text, 1, best_rec.len, db_file);
+    }
+
+    for (iter = debug_rings; iter; iter = iter->next) {
+	debug_ring_t *ring = iter->data;
+	g_atomic_int_set(&ring->tail, (gint)ring->cursor);
+    }
+
+    fflush(db_file);
+    return TRUE;
+}
+
+/* @returns: FALSE if the rings could not be written, for want of a debug file
+ */
+static gboolean
+debug_flush_rings(void)
+{
+    gboolean written;
+
+    if (!debug_async || getpid() != debug_async_pid)
+	return TRUE;
+
+    g_mutex_lock(debug_rings_mutex);
+    g_mutex_lock(debug_file_mutex);
+    written = debug_write_rings();
+    g_mutex_unlock(debug_file_mutex);
+    g_mutex_unlock(debug_rings_mutex);
+
+    return written;
+}
+
+/* Write what is in the rings to the current debug file, then make FILE (which
+ * may be NULL) the debug file, closing the old one if CLOSE_OLD; the flusher
+ * can't use db_file in between.
+ *
+ * @returns: the result of fclose, or 0
+ */
+static int
+debug_swap_file(
+    FILE *	file,
+    gboolean	close_old)
+{
+    gboolean locked = debug_async && getpid() == debug_async_pid;
+    int rv = 0;
+
+    if (locked) {
+	g_mutex_lock(debug_rings_mutex);
+	g_mutex_lock(debug_file_mutex);
+	debug_write_rings();
+    }
+    if (close_old && db_file)
+	rv = fclose(db_file);
+    db_file = file;
+    if (locked) {
+	g_mutex_unlock(debug_file_mutex);
+	g_mutex_unlock(debug_rings_mutex);
+    }
+
+    return rv;
+}
+
+static gpointer
+debug_flush_thread(
+    gpointer data G_GNUC_UNUSED)
+{
+    GTimeVal tv;
+
+    g_mutex_lock(debug_flush_mutex);
+    while (1) {
+	g_get_current_time(&tv);
+	g_time_val_add(&tv, DEBUG_FLUSH_MSEC * 1000);
+	g_cond_timed_wait(debug_flush_cond, debug_flush_mutex, &tv);
+
+	g_mutex_unlock(debug_flush_mutex);
+	debug_flush_rings();
+	g_mutex_lock(debug_flush_mutex);
+    }
+
+    return NULL;
+}
+
+static void
+debug_flush_atexit(void)
+{
+    debug_flush_rings();
+}
+
+static void
+debug_async_start(void)
+{
+    if (debug_async || !g_thread_supported())
+	return;
+
+    debug_ring_key = g_private_new(debug_ring_release);
+    debug_rings_mutex = g_mutex_new();
+    debug_file_mutex = g_mutex_new();
+    debug_flush_mutex = g_mutex_new();
+    debug_flush_cond = g_cond_new();
+    debug_async_pid = getpid();
+
+    if (!g_thread_create(debug_flush_thread, NULL, FALSE, NULL))
+	return;
+
+    atexit(debug_flush_atexit);
+    debug_async = TRUE;
+}
+
+/* Add a formatted message to the calling thread's ring.  If the ring is full
+ * and there is no debug file to flush it to (the file is being closed or
+ * renamed by another thread), the message is not added.
+ *
+ * @returns: FALSE if the message must be written directly
+ */
+static gboolean
+debug_ring_add(
+    const char *format,
+    va_list argp)
+{
+    debug_ring_t *ring;
+    debug_record_t rec;
+    char buf[1024];
+    char *text = buf;
+    gint len;
+    guint head, used;
+    gsize size;
+    va_list argp2;
+
+    if (!debug_async || g_atomic_int_get(&debug_fatal) ||
+	getpid() != debug_async_pid)
+	return FALSE;
+
+    G_VA_COPY(argp2, argp);
+    len = g_vsnprintf(buf, sizeof(buf), format, argp2);
+    va_end(argp2);
+    if (len < 0)
+	return FALSE;
+    if ((gsize)len >= sizeof(buf)) {
+	if ((gsize)len + sizeof(rec) > DEBUG_RING_SIZE / 2)
+	    return FALSE;
+	text = g_strdup_vprintf(format, argp);
+    }
+
+    rec.len = len;
+    rec.seq = (guint32)g_atomic_int_exchange_and_add(&debug_seq, 1);
+    rec.time = time(NULL);
+    rec.thread = g_thread_self();
+    size = sizeof(rec) + rec.len;
+
+    ring = debug_ring_get();
+    head = (guint)ring->head;
+    while (head - (guint)g_atomic_int_get(&ring->tail) + size > DEBUG_RING_SIZE) {
+	if (!debug_flush_rings()) {
+	    if (text != buf)
+		g_free(text);
+	    return FALSE;
+	}
+    }
+
+    ring_copy_in(ring, head, &rec, sizeof(rec));
+    ring_copy_in(ring, head + sizeof(rec), text, rec.len);
+    g_atomic_int_set(&ring->head, (gint)(head + size));
+
+    used = head + size - (guint)g_atomic_int_get(&ring->tail);
+    if (used > DEBUG_RING_SIZE / 2)
+	g_cond_signal(debug_flush_cond);
+
+    if (text != buf)
+	g_free(text);
+    return TRUE;
+}
+
 /*
  * ---- public functions
  */
@@ -704,9 +1053,8 @@ debug_rename(
 	     * We can safely close the the original log file
 	     * since we now have a new working handle.
 	     */
+	    debug_swap_file(NULL, TRUE);
 	    db_fd = 2;
-	    fclose(db_file);
-	    db_file = NULL;
 	}
     }
 #else
@@ -764,15 +1112,11 @@ debug_close(void)
     time(&curtime);
     debug_printf(_("pid %ld finish time %s"), (long)getpid(), ctime(&curtime));
 
-    if(db_file && fclose(db_file) == EOF) {
-	int save_errno = errno;
-
-	db_file = NULL;				/* prevent recursion */
-	g_fprintf(stderr, _("close debug file: %s"), strerror(save_errno));
+    if (debug_swap_file(NULL, TRUE) == EOF) {
+	g_fprintf(stderr, _("close debug file: %s"), strerror(errno));
 	/*NOTREACHED*/
     }
     db_fd = 2;
-    db_file = NULL;
     amfree(db_filename);
     amfree(db_name);
 }
@@ -801,6 +1145,19 @@ void debug_printf(const char *format, ...)
     if(db_file != NULL) {
 	char *prefix;
 	char *text;
+	gboolean added;
+
+	if (db_file != stderr) {
+	    arglist_start(argp, format);
+	    added = debug_ring_add(format, argp);
+	    arglist_end(argp);
+	    if (added) {
+		errno = save_errno;
+		return;
+	    }
+	    /* keep the order of what is already in the rings */
+	    debug_flush_rings();
+	}
 
 	if (db_file != stderr)
 	    prefix = g_strdup_printf("%s: %s: %s:", msg_timestamp(), msg_thread(), get_pname());
@@ -809,23 +1166,37 @@ void debug_printf(const char *format, ...)
 	arglist_start(argp, format);
 	text = g_strdup_vprintf(format, argp);
 	arglist_end(argp);
-	fprintf(db_file, "%s %s", prefix, text);
+	if (debug_file_mutex && getpid() == debug_async_pid)
+	    g_mutex_lock(debug_file_mutex);
+	if (db_file)
+	    fprintf(db_file, "%s %s", prefix, text);
 	amfree(prefix);
 	amfree(text);
-	fflush(db_file);
+	if (db_file)
+	    fflush(db_file);
+	if (debug_file_mutex && getpid() == debug_async_pid)
+	    g_mutex_unlock(debug_file_mutex);
     }
     errno = save_errno;
 }
 
+void
+debug_flush(void)
+{
+    debug_flush_rings();
+}
+
 int
 debug_fd(void)
 {
+    debug_flush_rings();
     return db_fd;
 }
 
 FILE *
 debug_fp(void)
 {
+    debug_flush_rings();
     return db_file;
 }
 
@@ -134,6 +134,7 @@ extern int error_exit_status;
 #define dbfd()		debug_fd()
 #define dbfp()		debug_fp()
 #define dbfn()		debug_fn()
+#define dbflush()	debug_flush()
 
 /* constants for db(re)open */
 #define DBG_SUBDIR_SERVER  "server"
@@ -177,17 +178,30 @@ void	debug_close(void);
 /* Add a message to the debugging logfile.  A newline is not automatically 
  * added.
  *
+ * Once the logfile is open, the message is formatted and copied into a buffer
+ * of the calling thread's, and written to the file by a background thread,
+ * within DEBUG_FLUSH_MSEC (see debug.c), in the order the messages were
+ * added.  Fatal messages (g_error, g_critical) are written at once, after
+ * everything before them.
+ *
  * This function is deprecated in favor of glib's g_debug().
  */
 void	debug_printf(const char *format, ...) G_GNUC_PRINTF(1,2);
 
-/* Get the file descriptor for the debug file
+/* Write the messages waiting to be written to the debug file now.  A process
+ * that execs without forking must call this first, since it never exits.
+ */
+void	debug_flush(void);
+
+/* Get the file descriptor for the debug file; messages waiting to be written
+ * are written first.
  *
  * @returns: the file descriptor
  */
 int	debug_fd(void);
 
-/* Get the stdio file handle for the debug file.
+/* Get the stdio file handle for the debug file; messages waiting to be
+ * written are written first.
  *
  * @returns: the file handle
  */
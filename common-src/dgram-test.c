@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA.
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
+ */
+
+#include "amanda.h"
+#include "testutils.h"
+#include "dgram.h"
+#include "event.h"
+#include "sockaddr-util.h"
+#include "security-util.h"
+
+/* more than fit in one batch */
+#define NB_DGRAMS (DGRAM_BATCH_MAX + 4)
+
+/*
+ * Utils
+ */
+
+/* open a UDP socket on the loopback address; returns the socket, or -1, and
+ * its address in ADDR */
+static int
+open_socket(
+    sockaddr_union *addr)
+{
+    socklen_t_equiv len = (socklen_t_equiv)sizeof(*addr);
+    int sock;
+
+    SU_INIT(addr, AF_INET);
+    addr->sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+	tu_dbg("socket: %s\n", strerror(errno));
+	return -1;
+    }
+    if (bind(sock, (struct sockaddr *)addr, SS_LEN(addr)) < 0 ||
+	getsockname(sock, (struct sockaddr *)addr, &len) < 0) {
+	tu_dbg("bind: %s\n", strerror(errno));
+	close(sock);
+	return -1;
+    }
+    return sock;
+}
+
+static gboolean
+send_string(
+    int sock,
+    sockaddr_union *to,
+    const char *str)
+{
+    if (sendto(sock, str, strlen(str), 0, (struct sockaddr *)to,
+	       SS_LEN(to)) < 0) {
+	tu_dbg("sendto: %s\n", strerror(errno));
+	return FALSE;
+    }
+    return TRUE;
+}
+
+/* receive the next datagram waiting on SOCK into BUF, without waiting */
+static gboolean
+recv_string(
+    int sock,
+    char *buf,
+    size_t size)
+{
+    ssize_t len = recv(sock, buf, size - 1, MSG_DONTWAIT);
+
+    if (len < 0) {
+	tu_dbg("recv: %s\n", strerror(errno));
+	return FALSE;
+    }
+    buf[len] = '\0';
+    return TRUE;
+}
+
+/* receive a batch from SOCK, and check that it is the COUNT datagrams
+ * "dgram FIRST" and on, from FROM */
+static gboolean
+check_recv_batch(
+    int sock,
+    sockaddr_union *from,
+    int first,
+    int count)
+{
+    dgram_t *dgrams = g_new(dgram_t, DGRAM_BATCH_MAX);
+    sockaddr_union fromaddrs[DGRAM_BATCH_MAX];
+    gboolean ok = TRUE;
+    int i, n;
+
+    n = dgram_recv_batch(sock, dgrams, fromaddrs, DGRAM_BATCH_MAX);
+    if (n != count) {
+	tu_dbg("received %d datagrams; expected %d\n", n, count);
+	ok = FALSE;
+	n = MIN(n, count);
+    }
+
+    for (i = 0; i < n; i++) {
+	char *expected = g_strdup_printf("dgram %d", first + i);
+
+	if (!g_str_equal(dgrams[i].data, expected) ||
+	    dgrams[i].len != strlen(expected) ||
+	    dgrams[i].cur != dgrams[i].data ||
+	    dgrams[i].socket != sock) {
+	    tu_dbg("got '%s' (len %zu); expected '%s'\n",
+		   dgrams[i].data, dgrams[i].len, expected);
+	    ok = FALSE;
+	}
+	if (cmp_sockaddr(&fromaddrs[i], from, 0) != 0) {
+	    tu_dbg("'%s' is from the wrong address\n", expected);
+	    ok = FALSE;
+	}
+	g_free(expected);
+    }
+
+    g_free(dgrams);
+    return ok;
+}
+
+/* Send more than a batch of datagrams and receive them in batches: a full
+ * one, the rest, and then none */
+static gboolean
+check_recv(void)
+{
+    sockaddr_union from_addr, to_addr;
+    int from, to;
+    gboolean ok = TRUE;
+    int i;
+
+    if ((from = open_socket(&from_addr)) < 0 ||
+	(to = open_socket(&to_addr)) < 0)
+	return FALSE;
+
+    for (i = 0; i < NB_DGRAMS; i++) {
+	char *str = g_strdup_printf("dgram %d", i);
+	ok = send_string(from, &to_addr, str) && ok;
+	g_free(str);
+    }
+    if (!ok)
+	return FALSE;
+
+    ok = check_recv_batch(to, &from_addr, 0, DGRAM_BATCH_MAX) && ok;
+    ok = check_recv_batch(to, &from_addr, DGRAM_BATCH_MAX,
+			  NB_DGRAMS - DGRAM_BATCH_MAX) && ok;
+    ok = check_recv_batch(to, &from_addr, 0, 0) && ok;
+
+    close(from);
+    close(to);
+    return ok;
+}
+
+/* Send more than a batch of datagrams at once, one of which cannot be sent;
+ * that one gets an error, and the rest arrive in order */
+static gboolean
+check_send(void)
+{
+    dgram_out_t out[NB_DGRAMS];
+    sockaddr_union from_addr, to_addr;
+    char buf[64];
+    int from, to;
+    int bad = 5;
+    gboolean ok = TRUE;
+    int i, failed;
+
+    if ((from = open_socket(&from_addr)) < 0 ||
+	(to = open_socket(&to_addr)) < 0)
+	return FALSE;
+
+    for (i = 0; i < NB_DGRAMS; i++) {
+	copy_sockaddr(&out[i].addr, &to_addr);
+	out[i].data = g_strdup_printf("dgram %d", i);
+	out[i].len = strlen(out[i].data);
+	out[i].error = -1;
+	out[i].cookie = NULL;
+    }
+    /* no datagram can be sent to port 0 */
+    SU_SET_PORT(&out[bad].addr, 0);
+
+    failed = dgram_send_batch(from, out, NB_DGRAMS);
+    if (failed != 1) {
+	tu_dbg("%d datagrams were not sent; expected 1\n", failed);
+	ok = FALSE;
+    }
+
+    for (i = 0; i < NB_DGRAMS; i++) {
+	if (i == bad) {
+	    if (out[i].error == 0) {
+		tu_dbg("the datagram to port 0 has no error\n");
+		ok = FALSE;
+	    }
+	    continue;
+	}
+
+	if (out[i].error != 0) {
+	    tu_dbg("datagram %d has error %s\n", i, strerror(out[i].error));
+	    ok = FALSE;
+	} else if (!recv_string(to, buf, sizeof(buf))) {
+	    ok = FALSE;
+	} else if (!g_str_equal(buf, out[i].data)) {
+	    tu_dbg("got '%s'; expected '%s'\n", buf, out[i].data);
+	    ok = FALSE;
+	}
+    }
+
+    for (i = 0; i < NB_DGRAMS; i++)
+	g_free(out[i].data);
+    close(from);
+    close(to);
+    return ok;
+}
+
+/* the packets the handles of test_pending got */
+static GPtrArray *got_packets;
+
+/* the recvpkt callback of test_pending: note what came, and acknowledge it */
+static void
+got_packet(
+    void *arg,
+    pkt_t *pkt,
+    security_status_t status)
+{
+    struct sec_handle *rh = arg;
+    pkt_t ack;
+
+    if (status != S_OK || !pkt) {
+	g_ptr_array_add(got_packets, g_strdup_printf("%s: status %d",
+				rh->proto_handle, (int)status));
+	return;
+    }
+
+    g_ptr_array_add(got_packets, g_strdup_printf("%s: %s",
+				rh->proto_handle, pkt->body));
+    pkt_init_empty(&ack, P_ACK);
+    udpbsd_sendpkt(rh, &ack);
+    amfree(ack.body);
+}
+
+static gboolean
+check_got_packets(
+    const char *expected)
+{
+    GString *got = g_string_new("");
+    gboolean ok;
+    guint i;
+
+    for (i = 0; i < got_packets->len; i++)
+	g_string_append_printf(got, "[%s]", (char *)g_ptr_array_index(got_packets, i));
+    ok = g_str_equal(got->str, expected);
+    if (!ok)
+	tu_dbg("the handles got %s; expected %s\n", got->str, expected);
+    g_string_free(got, TRUE);
+    return ok;
+}
+
+/*
+ * Tests
+ */
+
+static gboolean
+test_recv_batch(void)
+{
+    return check_recv();
+}
+
+static gboolean
+test_send_batch(void)
+{
+    return check_send();
+}
+
+/* .. and the same without recvmmsg and sendmmsg */
+static gboolean
+test_recv_one_at_a_time(void)
+{
+    dgram_use_mmsg(FALSE);
+    return check_recv();
+}
+
+static gboolean
+test_send_one_at_a_time(void)
+{
+    dgram_use_mmsg(FALSE);
+    return check_send();
+}
+
+/* Two packets arrive together, for two handles, but only the first handle
+ * waits.  Its reply, sent while the batch is handled, is sent afterward.  The
+ * second packet is kept, and handled as soon as the second handle waits,
+ * although the socket is not readable again. */
+static gboolean
+test_pending(void)
+{
+    udp_handle_t *udp = g_new0(udp_handle_t, 1);
+    struct sec_handle *h1 = g_new0(struct sec_handle, 1);
+    struct sec_handle *h2 = g_new0(struct sec_handle, 1);
+    sockaddr_union client_addr, server_addr;
+    char buf[256];
+    int client, server;
+    gboolean ok = TRUE;
+
+    if ((client = open_socket(&client_addr)) < 0 ||
+	(server = open_socket(&server_addr)) < 0)
+	return FALSE;
+    dgram_socket(&udp->dgram, server);
+    udp_inithandle(udp, h1, "localhost", &client_addr,
+		   SU_GET_PORT(&client_addr), "h1", 1);
+    udp_inithandle(udp, h2, "localhost", &client_addr,
+		   SU_GET_PORT(&client_addr), "h2", 1);
+    got_packets = g_ptr_array_new();
+
+    udp_recvpkt(h1, got_packet, h1, 10);
+    if (!send_string(client, &server_addr, "Amanda 2.6 REP HANDLE h1 SEQ 1\nfirst\n") ||
+	!send_string(client, &server_addr, "Amanda 2.6 REP HANDLE h2 SEQ 1\nsecond\n"))
+	return FALSE;
+
+    /* this returns once h1 has its packet, since nothing else waits */
+    event_loop(0);
+    ok = check_got_packets("[h1: first\n]") && ok;
+    if (udp->in_count != 2 || udp->in_next != 1) {
+	tu_dbg("%d of %d packets were handled; expected 1 of 2\n",
+	       udp->in_next, udp->in_count);
+	ok = FALSE;
+    }
+    if (!recv_string(client, buf, sizeof(buf))) {
+	ok = FALSE;
+    } else if (!strstr(buf, " ACK HANDLE h1 SEQ 1\n")) {
+	tu_dbg("h1 replied '%s'\n", buf);
+	ok = FALSE;
+    }
+
+    udp_recvpkt(h2, got_packet, h2, 10);
+    if (udp->ev_pending == NULL) {
+	tu_dbg("the second packet is not scheduled\n");
+	ok = FALSE;
+    }
+    event_loop(0);
+    ok = check_got_packets("[h1: first\n][h2: second\n]") && ok;
+    if (udp->in_next != 2 || udp->ev_pending != NULL) {
+	tu_dbg("%d of %d packets were handled, and the event is %s\n",
+	       udp->in_next, udp->in_count,
+	       udp->ev_pending? "still registered" : "released");
+	ok = FALSE;
+    }
+    if (!recv_string(client, buf, sizeof(buf))) {
+	ok = FALSE;
+    } else if (!strstr(buf, " ACK HANDLE h2 SEQ 1\n")) {
+	tu_dbg("h2 replied '%s'\n", buf);
+	ok = FALSE;
+    }
+
+    close(client);
+    close(server);
+    return ok;
+}
+
+/*
+ * Main driver
+ */
+
+int
+main(int argc, char **argv)
+{
+    static TestUtilsTest tests[] = {
+	TU_TEST(test_recv_batch, 90),
+	TU_TEST(test_send_batch, 90),
+	TU_TEST(test_recv_one_at_a_time, 90),
+	TU_TEST(test_send_one_at_a_time, 90),
+	TU_TEST(test_pending, 90),
+	TU_END()
+    };
+
+    glib_init();
+
+    return testutils_run_tests(argc, argv, tests);
+}
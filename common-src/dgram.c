@@ -322,6 +322,178 @@ dgram_recv(
 }
 
 
+#ifdef HAVE_RECVMMSG
+static gboolean use_recvmmsg = TRUE;
+#endif
+#ifdef HAVE_SENDMMSG
+static gboolean use_sendmmsg = TRUE;
+#endif
+
+void
+dgram_use_mmsg(
+    gboolean	use)
+{
+#ifdef HAVE_RECVMMSG
+    use_recvmmsg = use;
+#endif
+#ifdef HAVE_SENDMMSG
+    use_sendmmsg = use;
+#endif
+    (void)use;	/* Quiet unused parameter warning */
+}
+
+int
+dgram_recv_batch(
+    int			sock,
+    dgram_t *		dgrams,
+    sockaddr_union *	fromaddrs,
+    int			count)
+{
+    socklen_t_equiv addrlen;
+    ssize_t size;
+    int save_errno;
+    int n = 0;
+    int flags = 0;
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr msgs[DGRAM_BATCH_MAX];
+    struct iovec iov[DGRAM_BATCH_MAX];
+    int i;
+#endif
+
+#ifdef MSG_DONTWAIT
+    flags = MSG_DONTWAIT;
+#else
+    /* without it, only the datagram select() saw is sure not to block */
+    count = 1;
+#endif
+
+#ifdef HAVE_RECVMMSG
+    if (!use_recvmmsg)
+	goto one_at_a_time;
+
+    count = MIN(count, DGRAM_BATCH_MAX);
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < count; i++) {
+	iov[i].iov_base = dgrams[i].data;
+	iov[i].iov_len = MAX_DGRAM;
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+	msgs[i].msg_hdr.msg_name = &fromaddrs[i];
+	msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_union);
+    }
+
+    n = recvmmsg(sock, msgs, (unsigned int)count, flags, NULL);
+    if (n >= 0) {
+	for (i = 0; i < n; i++) {
+	    dgrams[i].socket = sock;
+	    dgrams[i].len = (size_t)msgs[i].msg_len;
+	    dgrams[i].data[dgrams[i].len] = '\0';
+	    dgrams[i].cur = dgrams[i].data;
+	}
+	dbprintf(_("dgram_recv_batch: received %d datagrams\n"), n);
+	return n;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+	return 0;
+    if (errno != ENOSYS) {
+	save_errno = errno;
+	dbprintf(_("dgram_recv_batch: recvmmsg() failed: %s\n"),
+		 strerror(save_errno));
+	errno = save_errno;
+	return -1;
+    }
+    /* the kernel lacks recvmmsg; receive them one at a time */
+    use_recvmmsg = FALSE;
+
+one_at_a_time:
+#endif
+
+    for (n = 0; n < count; n++) {
+	addrlen = (socklen_t_equiv)sizeof(sockaddr_union);
+	size = recvfrom(sock, dgrams[n].data, (size_t)MAX_DGRAM, flags,
+			(struct sockaddr *)&fromaddrs[n], &addrlen);
+	if (size == -1) {
+	    if (n > 0 || errno == EAGAIN || errno == EWOULDBLOCK)
+		break;
+	    save_errno = errno;
+	    dbprintf(_("dgram_recv_batch: recvfrom() failed: %s\n"),
+		     strerror(save_errno));
+	    errno = save_errno;
+	    return -1;
+	}
+	dgrams[n].socket = sock;
+	dgrams[n].len = (size_t)size;
+	dgrams[n].data[size] = '\0';
+	dgrams[n].cur = dgrams[n].data;
+    }
+
+    dbprintf(_("dgram_recv_batch: received %d datagrams\n"), n);
+    return n;
+}
+
+int
+dgram_send_batch(
+    int			sock,
+    dgram_out_t *	out,
+    int			count)
+{
+    dgram_t *dgram;
+    int sent = 0;
+    int failed = 0;
+    int i;
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[DGRAM_BATCH_MAX];
+    struct iovec iov[DGRAM_BATCH_MAX];
+    int n, r;
+#endif
+
+    for (i = 0; i < count; i++)
+	out[i].error = 0;
+
+#ifdef HAVE_SENDMMSG
+    while (use_sendmmsg && sent < count) {
+	n = MIN(count - sent, DGRAM_BATCH_MAX);
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < n; i++) {
+	    iov[i].iov_base = out[sent + i].data;
+	    iov[i].iov_len = out[sent + i].len;
+	    msgs[i].msg_hdr.msg_iov = &iov[i];
+	    msgs[i].msg_hdr.msg_iovlen = 1;
+	    msgs[i].msg_hdr.msg_name = &out[sent + i].addr;
+	    msgs[i].msg_hdr.msg_namelen = SS_LEN(&out[sent + i].addr);
+	}
+	r = sendmmsg(sock, msgs, (unsigned int)n, 0);
+	if (r < 0 && errno == ENOSYS)
+	    use_sendmmsg = FALSE;
+	if (r <= 0)
+	    break;
+	sent += r;
+    }
+    if (sent > 0)
+	dbprintf(_("dgram_send_batch: sent %d datagrams\n"), sent);
+#endif
+
+    if (sent == count)
+	return 0;
+
+    /* send the rest one at a time, with dgram_send_addr's retries */
+    dgram = g_new(dgram_t, 1);
+    dgram->socket = sock;
+    for (; sent < count; sent++) {
+	memcpy(dgram->data, out[sent].data, out[sent].len);
+	dgram->len = out[sent].len;
+	dgram->data[dgram->len] = '\0';
+	dgram->cur = dgram->data + dgram->len;
+	if (dgram_send_addr(&out[sent].addr, dgram) != 0) {
+	    out[sent].error = errno? errno : EIO;
+	    failed++;
+	}
+    }
+    g_free(dgram);
+
+    return failed;
+}
+
 void
 dgram_zero(
     dgram_t *	dgram)
@@ -53,6 +53,43 @@ void	dgram_socket(dgram_t *dgram, int sock);
 int	dgram_send_addr(sockaddr_union *addr, dgram_t *dgram);
 ssize_t	dgram_recv(dgram_t *dgram, int timeout,
 		   sockaddr_union *fromaddr);
+
+/* the most datagrams dgram_recv_batch and dgram_send_batch handle in one
+ * system call */
+#define DGRAM_BATCH_MAX 16
+
+/* Receive up to COUNT of the datagrams waiting on SOCK, without waiting for
+ * more, into DGRAMS[i] from FROMADDRS[i].  Where recvmmsg(2) is available,
+ * they are received in a single call.
+ *
+ * @returns: the number received (0 if none were waiting), or -1 on error
+ */
+int	dgram_recv_batch(int sock, dgram_t *dgrams, sockaddr_union *fromaddrs,
+			 int count);
+
+/* A datagram queued for dgram_send_batch */
+typedef struct dgram_out_s {
+    sockaddr_union addr;
+    size_t len;
+    char *data;
+    int error;			/* set by dgram_send_batch: errno, or 0 */
+    void *cookie;		/* the caller's; not used by dgram_send_batch */
+} dgram_out_t;
+
+/* Send the COUNT datagrams in OUT from SOCK.  Where sendmmsg(2) is
+ * available, they are sent DGRAM_BATCH_MAX at a time; any it does not send
+ * are sent as dgram_send_addr sends them.  The error of each is set.
+ *
+ * @returns: the number that could not be sent
+ */
+int	dgram_send_batch(int sock, dgram_out_t *out, int count);
+
+/* Whether dgram_recv_batch and dgram_send_batch use recvmmsg(2) and
+ * sendmmsg(2), where they are available.  They stop using them for good once
+ * the kernel turns out to lack them; otherwise this is for testing the
+ * one-at-a-time fallback.
+ */
+void	dgram_use_mmsg(gboolean use);
 void	dgram_zero(dgram_t *dgram);
 int	dgram_cat(dgram_t *dgram, const char *fmt, ...)
     G_GNUC_PRINTF(2, 3);
@@ -78,7 +78,8 @@ const security_driver_t local_security_driver = {
     tcpm_stream_read_cancel,
     tcpm_close_connection,
     NULL,
-    NULL
+    NULL,
+    tcpm_stream_write_from_fd
 };
 
 static int newhandle = 1;
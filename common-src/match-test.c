@@ -966,6 +966,86 @@ test_match_level(void)
 }
 
 
+static gboolean
+test_match_set(void)
+{
+    gboolean ok = TRUE;
+    struct {
+	match_set_type_t type;
+	int (*match_fn)(const char *, const char *);
+	char *exprs[8];
+	char *strs[12];
+    } tests[] = {
+	{ MATCH_SET_GLOB, match_glob,
+	  { "abc", "*.txt", "/usr/bin/*", "foo.[tT][!yY][tT]", "(){}+.^$|", NULL },
+	  { "abc", "abcd", "foo.txt", "/usr/bin/tar", "/usr/bin/local/tar",
+	    "foo.TXT", "foo.TyT", "(){}+.^$|", "x\nabc", NULL } },
+	{ MATCH_SET_TAR, match_tar,
+	  { "temp-files", "./temp-files/", "generated-*", "*.iso",
+	    "proxy/local/cache", "core", NULL },
+	  { "./my/temp-files", "./her-temp-files", "./temp-files/",
+	    "./temp-files/foo", "./my/generated-xyz/bar", "./her/old-generated-xyz",
+	    "./my/amanda.iso", "./proxy/local/cache/7a", "./src/core",
+	    "./src/core.c", NULL } },
+	{ MATCH_SET_HOST, match_host,
+	  { "mail", "^www.example.com$", "*.org", ".", "^a?c", NULL },
+	  { "mail.example.com", "Mail", "www.example.com", "www.example.com.au",
+	    "foo.ORG", "host.org.au", "abc.com", "abbc.com", NULL } },
+	{ MATCH_SET_DISK, match_disk,
+	  { "/usr", "^/var/log$", "sda*", "\\\\windows\\share", "/", NULL },
+	  { "/usr", "/usr/local", "/var/log", "/var/log/old", "/dev/sda1",
+	    "/dev/sdb1", "\\\\windows\\share", "\\\\windows\\other",
+	    "/opt", NULL } },
+	{ 0, NULL, { NULL }, { NULL } },
+    }, *t;
+
+    for (t = tests; t->match_fn; t++) {
+	match_set_t *set = match_set_new(t->type);
+	char **expr, **str;
+	char *errmsg;
+
+	for (expr = t->exprs; *expr; expr++) {
+	    if ((errmsg = match_set_add(set, *expr)) != NULL) {
+		g_fprintf(stderr, "adding '%s' to a pattern set failed: %s\n",
+			*expr, errmsg);
+		ok = FALSE;
+	    }
+	}
+
+	if ((errmsg = match_set_compile(set)) != NULL) {
+	    g_fprintf(stderr, "compiling a pattern set failed: %s\n", errmsg);
+	    match_set_free(set);
+	    ok = FALSE;
+	    continue;
+	}
+
+	/* the set must agree with matching each expression in turn */
+	for (str = t->strs; *str; str++) {
+	    gboolean expected = FALSE;
+	    gboolean matched = match_set_match(set, *str);
+
+	    for (expr = t->exprs; *expr; expr++) {
+		if (t->match_fn(*expr, *str)) {
+		    expected = TRUE;
+		    break;
+		}
+	    }
+
+	    if (!!matched != !!expected) {
+		ok = FALSE;
+		g_fprintf(stderr, "%s %s pattern set %d\n", *str,
+			expected? "should have matched" : "unexpectedly matched",
+			(int)t->type);
+	    }
+	}
+
+	match_set_free(set);
+    }
+
+    return ok;
+}
+
+
 /*
  * Main driver
  */
@@ -986,6 +1066,7 @@ main(int argc, char **argv)
 	TU_TEST(test_match_disk, 90),
 	TU_TEST(test_match_datestamp, 90),
 	TU_TEST(test_match_level, 90),
+	TU_TEST(test_match_set, 90),
 	TU_END()
     };
 
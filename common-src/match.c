@@ -706,10 +706,10 @@ static gboolean glob_is_separator_only(const char *glob, char sep) {
  * caller to free it. Note also that the first argument MUST NOT BE NULL.
  */
 
-static char *wrap_word(const char *word, const char separator, const char *glob)
+static char *wrap_word(const char *word, const char separator,
+    gboolean anchor_begin, gboolean anchor_end)
 {
     size_t len = strlen(word);
-    size_t len_glob = strlen(glob);
     char *result, *p;
 
     /*
@@ -744,12 +744,12 @@ static char *wrap_word(const char *word, const char separator, const char *glob)
      * needed.
      */
 
-    if (word[0] != separator && glob[0] != '^')
+    if (word[0] != separator && !anchor_begin)
         *p++ = separator;
 
     p = g_stpcpy(p, word);
 
-    if (word[len - 1] != separator && glob[len_glob-1] != '$')
+    if (word[len - 1] != separator && !anchor_end)
         *p++ = separator;
 
 out:
@@ -757,13 +757,32 @@ out:
     return result;
 }
 
-static int match_word(const char *glob, const char *word, const char separator)
+/*
+ * Tell whether a word glob is anchored at its beginning and/or its end; this
+ * decides how wrap_word() wraps the word it is matched against.
+ */
+
+static gboolean glob_anchored_begin(const char *glob)
+{
+    return glob[0] == '^';
+}
+
+static gboolean glob_anchored_end(const char *glob)
+{
+    size_t len = strlen(glob);
+    return len > 0 && glob[len - 1] == '$';
+}
+
+/*
+ * Turn a glob passed to match_word() into the regex that the wrapped word is
+ * matched against. The result is dynamically allocated.
+ */
+
+static char *word_glob_to_regex(const char *glob, const char separator)
 {
-    char *wrapped_word = wrap_word(word, separator, glob);
     struct mword_regexes *regexes = &mword_slash_regexes;
     struct subst_table *table = &mword_slash_subst_table;
     gboolean not_slash = (separator != '/');
-    int ret;
 
     /*
      * We only expect two separators: '/' or '.'. If it's not '/', it has to be
@@ -775,8 +794,7 @@ static int match_word(const char *glob, const char *word, const char separator)
     }
 
     if(glob_is_separator_only(glob, separator)) {
-        ret = do_match(regexes->re_double_sep, wrapped_word, TRUE);
-        goto out;
+        return g_strdup(regexes->re_double_sep);
     } else {
         /*
          * Unlike what happens for tar and disk expressions, we need to
@@ -842,13 +860,22 @@ static int match_word(const char *glob, const char *word, const char separator)
         }
 
         regex = amglob_to_regex(g, begin, end, table);
-        ret = do_match(regex, wrapped_word, TRUE);
 
         g_free(glob_copy);
-        g_free(regex);
+        return regex;
     }
+}
 
-out:
+static int match_word(const char *glob, const char *word, const char separator)
+{
+    char *wrapped_word = wrap_word(word, separator, glob_anchored_begin(glob),
+        glob_anchored_end(glob));
+    char *regex = word_glob_to_regex(glob, separator);
+    int ret;
+
+    ret = do_match(regex, wrapped_word, TRUE);
+
+    g_free(regex);
     g_free(wrapped_word);
     return ret;
 }
@@ -912,6 +939,16 @@ static char *convert_winglob_to_unix(const char *glob)
     return result;
 }
 
+/*
+ * Check whether a disk potentially refers to a Windows share: the first two
+ * characters are '\' and there is no / in the word at all.
+ */
+
+static gboolean is_windows_share(const char *disk)
+{
+    return !(strncmp(disk, "\\\\", 2) || strchr(disk, '/'));
+}
+
 /*
  * Match a disk expression
  */
@@ -928,7 +965,7 @@ int match_disk(const char *glob, const char *disk)
      * build Unix paths instead and pass those as arguments to match_word()
      */
 
-    gboolean windows_share = !(strncmp(disk, "\\\\", 2) || strchr(disk, '/'));
+    gboolean windows_share = is_windows_share(disk);
 
     if (windows_share) {
         glob2 = convert_winglob_to_unix(glob);
@@ -1112,3 +1149,317 @@ illegal:
     error("Illegal level expression %s", levelexp);
     /*NOTREACHED*/
 }
+
+/*
+ * PATTERN SETS
+ */
+
+/*
+ * Host and disk expressions are matched against a word wrapped according to
+ * the anchors of the expression (see wrap_word()), so sets of those keep one
+ * combined regex per wrapping variant: bit 0 of the variant is set if the
+ * expression is anchored at its beginning, bit 1 if it is anchored at its
+ * end. Disk sets keep a second series of regexes for Windows shares, built
+ * from the expressions converted by convert_winglob_to_unix().
+ */
+
+#define MATCH_SET_VARIANTS 4
+#define MATCH_SET_SERIES 2
+
+struct match_set_s {
+    match_set_type_t type;
+    gboolean compiled;
+    guint size;
+
+    /* expressions without metacharacters (glob and tar sets only) */
+    GHashTable *literals;
+
+    /* combined regexes, as a string until compiled; NULL when empty */
+    GString *pending[MATCH_SET_SERIES][MATCH_SET_VARIANTS];
+    regex_t *regex[MATCH_SET_SERIES][MATCH_SET_VARIANTS];
+};
+
+match_set_t *
+match_set_new(
+    match_set_type_t type)
+{
+    match_set_t *set = g_new0(match_set_t, 1);
+
+    set->type = type;
+    if (type == MATCH_SET_GLOB || type == MATCH_SET_TAR)
+        set->literals = g_hash_table_new_full(g_str_hash, g_str_equal,
+            g_free, NULL);
+
+    return set;
+}
+
+/*
+ * Tell whether an expression can go in the literals table: it must not
+ * contain any glob metacharacter nor a newline, and for tar expressions it
+ * must be a single path component.
+ */
+
+static gboolean match_set_is_literal(match_set_t *set, const char *expr)
+{
+    const char *specials = (set->type == MATCH_SET_TAR)? "*?[]\\\n/" : "*?[]\\\n";
+
+    return *expr && !strpbrk(expr, specials);
+}
+
+/*
+ * Validate a regex and append it to the combined regex for the given series
+ * and variant.
+ */
+
+static gboolean match_set_append(match_set_t *set, int series, int variant,
+    const char *regex, regex_errbuf *errbuf)
+{
+    regex_t regc;
+    GString *pending;
+
+    if (!do_regex_compile(regex, &regc, errbuf, TRUE))
+        return FALSE;
+    regfree(&regc);
+
+    pending = set->pending[series][variant];
+    if (!pending) {
+        pending = set->pending[series][variant] = g_string_new("");
+    } else {
+        g_string_append_c(pending, '|');
+    }
+
+    g_string_append_printf(pending, "(%s)", regex);
+    return TRUE;
+}
+
+static int word_glob_variant(const char *glob)
+{
+    return (glob_anchored_begin(glob)? 1 : 0) | (glob_anchored_end(glob)? 2 : 0);
+}
+
+char *
+match_set_add(
+    match_set_t *set,
+    const char *expr)
+{
+    static regex_errbuf errmsg;
+    char *regex, *lexpr, *wexpr;
+    gboolean ok = TRUE;
+
+    g_assert(!set->compiled);
+
+    if (set->literals && match_set_is_literal(set, expr)) {
+        g_hash_table_insert(set->literals, g_strdup(expr), GINT_TO_POINTER(1));
+        set->size++;
+        return NULL;
+    }
+
+    switch (set->type) {
+        case MATCH_SET_GLOB:
+            regex = glob_to_regex(expr);
+            ok = match_set_append(set, 0, 0, regex, &errmsg);
+            g_free(regex);
+            break;
+
+        case MATCH_SET_TAR:
+            regex = tar_to_regex(expr);
+            ok = match_set_append(set, 0, 0, regex, &errmsg);
+            g_free(regex);
+            break;
+
+        case MATCH_SET_HOST:
+            lexpr = g_ascii_strdown(expr, -1);
+            regex = word_glob_to_regex(lexpr, '.');
+            ok = match_set_append(set, 0, word_glob_variant(lexpr), regex,
+                &errmsg);
+            g_free(regex);
+            g_free(lexpr);
+            break;
+
+        case MATCH_SET_DISK:
+            regex = word_glob_to_regex(expr, '/');
+            ok = match_set_append(set, 0, word_glob_variant(expr), regex,
+                &errmsg);
+            g_free(regex);
+            if (!ok)
+                break;
+
+            wexpr = convert_winglob_to_unix(expr);
+            regex = word_glob_to_regex(wexpr, '/');
+            ok = match_set_append(set, 1, word_glob_variant(wexpr), regex,
+                &errmsg);
+            g_free(regex);
+            g_free(wexpr);
+            break;
+    }
+
+    if (!ok)
+        return errmsg;
+
+    set->size++;
+    return NULL;
+}
+
+char *
+match_set_compile(
+    match_set_t *set)
+{
+    static regex_errbuf errmsg;
+    int series, variant;
+
+    g_assert(!set->compiled);
+
+    for (series = 0; series < MATCH_SET_SERIES; series++) {
+        for (variant = 0; variant < MATCH_SET_VARIANTS; variant++) {
+            GString *pending = set->pending[series][variant];
+            regex_t *re;
+
+            if (!pending)
+                continue;
+
+            re = g_new(regex_t, 1);
+            if (!do_regex_compile(pending->str, re, &errmsg, TRUE)) {
+                g_free(re);
+                return errmsg;
+            }
+
+            set->regex[series][variant] = re;
+            g_string_free(pending, TRUE);
+            set->pending[series][variant] = NULL;
+        }
+    }
+
+    set->compiled = TRUE;
+    return NULL;
+}
+
+/*
+ * Look up a string in the literals table. A literal glob must match one of
+ * the lines of the string (the regexes are compiled with REG_NEWLINE), and a
+ * literal tar expression must match one of the path components of a line.
+ */
+
+static gboolean match_set_literal(match_set_t *set, const char *str)
+{
+    const char *seps = (set->type == MATCH_SET_TAR)? "/\n" : "\n";
+    char *copy, *tok, *next;
+    gboolean found = FALSE;
+
+    if (g_hash_table_size(set->literals) == 0)
+        return FALSE;
+
+    if (!strpbrk(str, seps))
+        return g_hash_table_lookup(set->literals, str) != NULL;
+
+    copy = g_strdup(str);
+    for (tok = copy; tok; tok = next) {
+        next = strpbrk(tok, seps);
+        if (next)
+            *next++ = '\0';
+        if (g_hash_table_lookup(set->literals, tok)) {
+            found = TRUE;
+            break;
+        }
+    }
+
+    g_free(copy);
+    return found;
+}
+
+static int match_set_try(regex_t *re, const char *str)
+{
+    regex_errbuf errmsg;
+    int result = try_match(re, str, &errmsg);
+
+    if (result == MATCH_ERROR)
+        error("pattern set: %s", errmsg);
+        /*NOTREACHED*/
+
+    return result;
+}
+
+int
+match_set_match(
+    match_set_t *set,
+    const char *str)
+{
+    char *lstr = NULL, *wrapped;
+    char separator = '/';
+    int series = 0, variant;
+    int result = MATCH_NONE;
+
+    g_assert(set->compiled);
+
+    switch (set->type) {
+        case MATCH_SET_GLOB:
+        case MATCH_SET_TAR:
+            if (match_set_literal(set, str))
+                return MATCH_OK;
+            if (!set->regex[0][0])
+                return MATCH_NONE;
+            return match_set_try(set->regex[0][0], str);
+
+        case MATCH_SET_HOST:
+            lstr = g_ascii_strdown(str, -1);
+            str = lstr;
+            separator = '.';
+            break;
+
+        case MATCH_SET_DISK:
+            if (is_windows_share(str)) {
+                lstr = convert_unc_to_unix(str);
+                str = lstr;
+                series = 1;
+            }
+            break;
+    }
+
+    for (variant = 0; variant < MATCH_SET_VARIANTS; variant++) {
+        regex_t *re = set->regex[series][variant];
+
+        if (!re)
+            continue;
+
+        wrapped = wrap_word(str, separator, variant & 1, (variant & 2) != 0);
+        result = match_set_try(re, wrapped);
+        g_free(wrapped);
+
+        if (result == MATCH_OK)
+            break;
+    }
+
+    g_free(lstr);
+    return result;
+}
+
+guint
+match_set_size(
+    match_set_t *set)
+{
+    return set->size;
+}
+
+void
+match_set_free(
+    match_set_t *set)
+{
+    int series, variant;
+
+    if (!set)
+        return;
+
+    for (series = 0; series < MATCH_SET_SERIES; series++) {
+        for (variant = 0; variant < MATCH_SET_VARIANTS; variant++) {
+            if (set->pending[series][variant])
+                g_string_free(set->pending[series][variant], TRUE);
+            if (set->regex[series][variant]) {
+                regfree(set->regex[series][variant]);
+                g_free(set->regex[series][variant]);
+            }
+        }
+    }
+
+    if (set->literals)
+        g_hash_table_destroy(set->literals);
+    g_free(set);
+}
@@ -143,5 +143,54 @@ int	match_datestamp(const char *dateexp, const char *datestamp);
 /* Like match(), but using a level expression */
 int	match_level(const char *levelexp, const char *level);
 
+/*
+ * Pattern sets
+ */
+
+/* A pattern set compiles a whole list of glob, tar, host or disk expressions
+ * once, and then matches a string against all of them in a single pass.  A
+ * string matches the set if it matches any one of its expressions, with the
+ * same semantics as match_glob(), match_tar(), match_host() or match_disk()
+ * respectively.
+ *
+ * Patterns without metacharacters are looked up in a hash table; all others
+ * are combined into a single regular expression (one per anchoring variant
+ * for host and disk expressions), so the cost of a lookup grows with the
+ * length of the string rather than with the number of patterns.
+ *
+ * Once match_set_compile() has been called, the set is read-only and may be
+ * used from several threads at once without taking the regex cache lock.
+ */
+
+typedef enum {
+    MATCH_SET_GLOB,
+    MATCH_SET_TAR,
+    MATCH_SET_HOST,
+    MATCH_SET_DISK,
+} match_set_type_t;
+
+typedef struct match_set_s match_set_t;
+
+/* Create a new, empty pattern set of the given type */
+match_set_t *match_set_new(match_set_type_t type);
+
+/* Add an expression to the set.  Returns a statically allocated error message
+ * if the expression is not valid, or NULL on success.  Expressions cannot be
+ * added after the set is compiled. */
+char *	match_set_add(match_set_t *set, const char *expr);
+
+/* Compile the set.  Returns a statically allocated error message on failure
+ * or NULL on success. */
+char *	match_set_compile(match_set_t *set);
+
+/* Match STR against a compiled set; returns 1 if any expression matches */
+int	match_set_match(match_set_t *set, const char *str);
+
+/* Return the number of expressions in the set */
+guint	match_set_size(match_set_t *set);
+
+/* Free a set and everything it contains */
+void	match_set_free(match_set_t *set);
+
 #endif /* MATCH_H */
 
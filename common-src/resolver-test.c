@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA.
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
+ */
+
+#include "amanda.h"
+#include "testutils.h"
+#include "event.h"
+#include "sockaddr-util.h"
+#include "resolver.h"
+
+/* each fake lookup takes this long */
+#define DELAY_MS 100
+
+/*
+ * Utils
+ */
+
+static guint lookups_before, hits_before;
+
+static void
+start_counting(void)
+{
+    resolver_get_stats(&lookups_before, &hits_before);
+}
+
+static gboolean
+check_counts(
+    guint lookups,
+    guint hits)
+{
+    guint l, h;
+
+    resolver_get_stats(&l, &h);
+    l -= lookups_before;
+    h -= hits_before;
+    if (l != lookups || h != hits) {
+	tu_dbg("got %u lookups and %u hits; expected %u and %u\n",
+	       l, h, lookups, hits);
+	return FALSE;
+    }
+    return TRUE;
+}
+
+static int nb_answers;
+static int nb_bad_answers;
+
+static void
+count_answer(
+    gpointer	     data,
+    int		     result,
+    struct addrinfo *res,
+    char	    *canonname)
+{
+    const char *hostname = data;
+
+    nb_answers++;
+    if (result != 0 || !canonname || !g_str_equal(canonname, hostname) || !res
+	|| ((sockaddr_union *)res->ai_addr)->sin.sin_addr.s_addr != htonl(INADDR_LOOPBACK)) {
+	tu_dbg("bad answer for '%s'\n", hostname);
+	nb_bad_answers++;
+    }
+    resolver_free_addrinfo(res);
+    g_free(canonname);
+}
+
+/*
+ * Tests
+ */
+
+/* A name is looked up once, and then found in the cache */
+static gboolean
+test_cache(void)
+{
+    struct addrinfo *res;
+    char *canonname;
+    int i;
+
+    resolver_set_fake(0);
+    start_counting();
+    for (i = 0; i < 3; i++) {
+	if (resolver_resolve("host1.example.com", SOCK_STREAM, &res, &canonname) != 0
+	    || !canonname || !g_str_equal(canonname, "host1.example.com") || !res) {
+	    tu_dbg("lookup failed\n");
+	    return FALSE;
+	}
+	resolver_free_addrinfo(res);
+	g_free(canonname);
+    }
+
+    /* case does not matter, but the socket type does */
+    if (resolver_resolve("HOST1.example.com", SOCK_STREAM, NULL, NULL) != 0)
+	return FALSE;
+    if (resolver_resolve("host1.example.com", SOCK_DGRAM, NULL, NULL) != 0)
+	return FALSE;
+
+    return check_counts(2, 3);
+}
+
+/* A name which does not exist is looked up once, too */
+static gboolean
+test_negative(void)
+{
+    char *canonname;
+    int i;
+
+    resolver_set_fake(0);
+    start_counting();
+    for (i = 0; i < 3; i++) {
+	if (resolver_resolve("nohost.invalid", 0, NULL, &canonname) != EAI_NONAME
+	    || canonname != NULL) {
+	    tu_dbg("lookup of a missing name did not fail\n");
+	    return FALSE;
+	}
+    }
+
+    return check_counts(1, 2);
+}
+
+/* Lookups in the background run concurrently, and each name is looked up
+ * once however many ask for it */
+static gboolean
+test_async(void)
+{
+    static char *names[] = { "a.example.com", "b.example.com",
+			     "c.example.com", "d.example.com" };
+    const int nb_names = G_N_ELEMENTS(names);
+    const int nb_asks = 40;
+    GTimer *timer;
+    gdouble elapsed;
+    int i;
+
+    resolver_set_fake(DELAY_MS);
+    start_counting();
+    nb_answers = nb_bad_answers = 0;
+
+    timer = g_timer_new();
+    for (i = 0; i < nb_asks; i++)
+	resolver_resolve_async(names[i % nb_names], 0, count_answer,
+			       names[i % nb_names]);
+    if (nb_answers != 0) {
+	tu_dbg("answered before the lookups were done\n");
+	return FALSE;
+    }
+    event_loop(0);
+    elapsed = g_timer_elapsed(timer, NULL);
+    g_timer_destroy(timer);
+
+    tu_dbg("%d lookups of %d names in %.3f s; one at a time would take %.3f s\n",
+	   nb_asks, nb_names, elapsed, nb_asks * DELAY_MS / 1000.0);
+    if (nb_answers != nb_asks || nb_bad_answers != 0)
+	return FALSE;
+    if (elapsed > (nb_names * DELAY_MS) / 1000.0) {
+	tu_dbg("the lookups were not made concurrently\n");
+	return FALSE;
+    }
+    if (!check_counts(nb_names, 0))
+	return FALSE;
+
+    /* now they are all in the cache, and answered right away */
+    resolver_resolve_async(names[0], 0, count_answer, names[0]);
+    return nb_answers == nb_asks + 1 && check_counts(nb_names, 1);
+}
+
+/* Reverse lookups are kept, too */
+static gboolean
+test_name_info(void)
+{
+    sockaddr_union addr;
+    char *hostname;
+    int i;
+
+    resolver_set_fake(0);
+    start_counting();
+
+    SU_INIT(&addr, AF_INET);
+    addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (i = 0; i < 3; i++) {
+	if (resolver_name_info(&addr, &hostname) != 0 || !hostname) {
+	    tu_dbg("no name for the address\n");
+	    return FALSE;
+	}
+	g_free(hostname);
+    }
+
+    return check_counts(1, 2);
+}
+
+/*
+ * Main driver
+ */
+
+int
+main(int argc, char **argv)
+{
+    static TestUtilsTest tests[] = {
+	TU_TEST(test_cache, 90),
+	TU_TEST(test_negative, 90),
+	TU_TEST(test_async, 90),
+	TU_TEST(test_name_info, 90),
+	TU_END()
+    };
+
+    glib_init();
+
+    return testutils_run_tests(argc, argv, tests);
+}
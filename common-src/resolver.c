@@ -0,0 +1,569 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94085, USA, or: http://www.zmanda.com
+ */
+
+#include "amanda.h"
+#include "util.h"
+#include "event.h"
+#include "sockaddr-util.h"
+#include "resolver.h"
+
+/* most worker threads to look names up in */
+#define RESOLVER_THREADS 4
+
+/* One address found by a forward lookup */
+typedef struct resolver_addr_s {
+    int family;
+    int socktype;
+    int protocol;
+    socklen_t_equiv addrlen;
+    sockaddr_union addr;
+} resolver_addr_t;
+
+/* The outcome of a lookup */
+typedef struct resolver_entry_s {
+    int result;			/* getaddrinfo or getnameinfo result */
+    char *name;			/* canonical name, or the name of the address */
+    GArray *addrs;		/* of resolver_addr_t, for forward lookups */
+    time_t expires;		/* 0 if it is not to be kept */
+} resolver_entry_t;
+
+/* Someone waiting for a lookup */
+typedef struct resolver_waiter_s {
+    resolver_fn fn;
+    gpointer data;
+    int result;
+    struct addrinfo *res;
+    char *canonname;
+} resolver_waiter_t;
+
+/* A lookup for the worker threads */
+typedef struct resolver_query_s {
+    char *key;
+    char *hostname;
+    int socktype;
+    GSList *waiters;		/* of resolver_waiter_t, latest first */
+    resolver_entry_t *entry;	/* filled in by the worker */
+} resolver_query_t;
+
+static GHashTable *cache = NULL;	/* key -> resolver_entry_t */
+static GHashTable *pending = NULL;	/* key -> resolver_query_t */
+static GAsyncQueue *todo = NULL;
+static GAsyncQueue *done = NULL;
+static int wake_pipe[2] = { -1, -1 };
+static event_handle_t *done_ev = NULL;
+static guint nb_threads = 0;
+static pid_t resolver_pid = 0;
+
+static gint fake_delay = -1;
+static gint nb_lookups = 0;
+static gint nb_hits = 0;
+
+static void resolver_done_callback(void *cookie);
+
+static void
+resolver_entry_free(
+    gpointer	data)
+{
+    resolver_entry_t *entry = data;
+
+    g_free(entry->name);
+    if (entry->addrs)
+	g_array_free(entry->addrs, TRUE);
+    g_free(entry);
+}
+
+/* Set up the cache, or, in a child forked since it was set up, forget
+ * the lookups in progress; they belong to the parent's worker threads. */
+static void
+resolver_init(void)
+{
+    if (resolver_pid == getpid())
+	return;
+
+    if (resolver_pid != 0) {
+	if (done_ev)
+	    event_release(done_ev);
+	done_ev = NULL;
+	if (wake_pipe[0] != -1) {
+	    close(wake_pipe[0]);
+	    close(wake_pipe[1]);
+	}
+	wake_pipe[0] = wake_pipe[1] = -1;
+	pending = NULL;
+	todo = done = NULL;
+	nb_threads = 0;
+    } else {
+	cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+				      g_free, resolver_entry_free);
+    }
+    resolver_pid = getpid();
+}
+
+static char *
+forward_key(
+    const char *hostname,
+    int		socktype)
+{
+    char *lower = g_ascii_strdown(hostname, -1);
+    char *key = g_strdup_printf("%d %s", socktype, lower);
+
+    g_free(lower);
+    return key;
+}
+
+static char *
+reverse_key(
+    sockaddr_union *addr)
+{
+    return g_strconcat("@", str_sockaddr_no_port(addr), NULL);
+}
+
+/* Is RESULT a definite answer that the name or address does not exist? */
+static gboolean
+is_negative(
+    int result)
+{
+    if (result == EAI_NONAME)
+	return TRUE;
+#if defined(EAI_NODATA) && EAI_NODATA != EAI_NONAME
+    if (result == EAI_NODATA)
+	return TRUE;
+#endif
+    return FALSE;
+}
+
+static void
+set_expiry(
+    resolver_entry_t *entry)
+{
+    if (entry->result == 0)
+	entry->expires = time(NULL) + RESOLVER_TTL;
+    else if (is_negative(entry->result))
+	entry->expires = time(NULL) + RESOLVER_NEGATIVE_TTL;
+    else
+	entry->expires = 0;
+}
+
+/*
+ * The lookups themselves; these run in the worker threads
+ */
+
+static resolver_entry_t *
+lookup_forward(
+    const char *hostname,
+    int		socktype)
+{
+    resolver_entry_t *entry = g_new0(resolver_entry_t, 1);
+    resolver_addr_t ra;
+    struct addrinfo *res, *ai;
+    int delay = g_atomic_int_get(&fake_delay);
+
+    g_atomic_int_inc(&nb_lookups);
+    entry->addrs = g_array_new(FALSE, TRUE, sizeof(resolver_addr_t));
+
+    if (delay >= 0) {
+	if (delay > 0)
+	    g_usleep(delay * 1000);
+	if (g_str_has_suffix(hostname, ".invalid")) {
+	    entry->result = EAI_NONAME;
+	} else {
+	    memset(&ra, 0, sizeof(ra));
+	    SU_INIT(&ra.addr, AF_INET);
+	    ra.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	    ra.family = AF_INET;
+	    ra.socktype = socktype;
+	    ra.addrlen = SS_LEN(&ra.addr);
+	    g_array_append_val(entry->addrs, ra);
+	    entry->name = g_strdup(hostname);
+	}
+    } else {
+	entry->result = resolve_hostname(hostname, socktype, &res, &entry->name);
+	if (entry->result == 0) {
+	    for (ai = res; ai != NULL; ai = ai->ai_next) {
+		if (ai->ai_addrlen > sizeof(ra.addr))
+		    continue;
+		memset(&ra, 0, sizeof(ra));
+		ra.family = ai->ai_family;
+		ra.socktype = ai->ai_socktype;
+		ra.protocol = ai->ai_protocol;
+		ra.addrlen = ai->ai_addrlen;
+		memcpy(&ra.addr, ai->ai_addr, ai->ai_addrlen);
+		g_array_append_val(entry->addrs, ra);
+	    }
+	    if (res)
+		freeaddrinfo(res);
+	}
+    }
+
+    set_expiry(entry);
+    return entry;
+}
+
+static resolver_entry_t *
+lookup_reverse(
+    sockaddr_union *addr)
+{
+    resolver_entry_t *entry = g_new0(resolver_entry_t, 1);
+    char hostname[NI_MAXHOST];
+    int delay = g_atomic_int_get(&fake_delay);
+    int flags = 0;
+
+    g_atomic_int_inc(&nb_lookups);
+
+    if (delay >= 0) {
+	if (delay > 0)
+	    g_usleep(delay * 1000);
+	flags = NI_NUMERICHOST;
+    }
+    entry->result = getnameinfo((struct sockaddr *)addr, SS_LEN(addr),
+				hostname, sizeof(hostname), NULL, 0, flags);
+    if (entry->result == 0)
+	entry->name = g_strdup(hostname);
+
+    set_expiry(entry);
+    return entry;
+}
+
+static gpointer
+resolver_thread(
+    gpointer	data)
+{
+    resolver_query_t *q;
+
+    (void)data;	/* Quiet unused parameter warning */
+
+    while ((q = g_async_queue_pop(todo)) != NULL) {
+	q->entry = lookup_forward(q->hostname, q->socktype);
+	g_async_queue_push(done, q);
+	/* if the pipe is full, the main thread is due to wake up anyway */
+	if (write(wake_pipe[1], "", 1) < 0) {
+	    /* ignore */
+	}
+    }
+
+    return NULL;
+}
+
+/*
+ * The cache
+ */
+
+/* Find the unexpired entry for KEY, counting a hit */
+static resolver_entry_t *
+cache_lookup(
+    const char *key)
+{
+    resolver_entry_t *entry = g_hash_table_lookup(cache, key);
+
+    if (entry && entry->expires <= time(NULL)) {
+	g_hash_table_remove(cache, key);
+	entry = NULL;
+    }
+    if (entry)
+	g_atomic_int_inc(&nb_hits);
+
+    return entry;
+}
+
+/* Keep ENTRY under KEY if it is to be kept, or free it; KEY is taken */
+static void
+cache_add(
+    char	     *key,
+    resolver_entry_t *entry)
+{
+    if (entry->expires > time(NULL)) {
+	g_hash_table_replace(cache, key, entry);
+    } else {
+	g_free(key);
+	resolver_entry_free(entry);
+    }
+}
+
+/* Give the outcome of a forward lookup as resolve_hostname does */
+static int
+answer_forward(
+    resolver_entry_t *entry,
+    struct addrinfo **res,
+    char **	      canonname)
+{
+    struct addrinfo *ai, **tail;
+    resolver_addr_t *ra;
+    guint i;
+
+    if (res) *res = NULL;
+    if (canonname) *canonname = NULL;
+    if (entry->result != 0)
+	return entry->result;
+
+    if (canonname)
+	*canonname = g_strdup(entry->name);
+    if (res) {
+	tail = res;
+	for (i = 0; i < entry->addrs->len; i++) {
+	    ra = &g_array_index(entry->addrs, resolver_addr_t, i);
+	    ai = g_new0(struct addrinfo, 1);
+	    ai->ai_family = ra->family;
+	    ai->ai_socktype = ra->socktype;
+	    ai->ai_protocol = ra->protocol;
+	    ai->ai_addrlen = ra->addrlen;
+	    ai->ai_addr = g_memdup(&ra->addr, sizeof(ra->addr));
+	    *tail = ai;
+	    tail = &ai->ai_next;
+	}
+    }
+
+    return 0;
+}
+
+void
+resolver_free_addrinfo(
+    struct addrinfo *res)
+{
+    struct addrinfo *next;
+
+    for (; res != NULL; res = next) {
+	next = res->ai_next;
+	g_free(res->ai_addr);
+	g_free(res->ai_canonname);
+	g_free(res);
+    }
+}
+
+int
+resolver_resolve(
+    const char *	hostname,
+    int			socktype,
+    struct addrinfo **	res,
+    char **		canonname)
+{
+    char *key;
+    resolver_entry_t *entry;
+    int result;
+
+    resolver_init();
+    key = forward_key(hostname, socktype);
+    if ((entry = cache_lookup(key)) != NULL) {
+	g_free(key);
+	return answer_forward(entry, res, canonname);
+    }
+
+    entry = lookup_forward(hostname, socktype);
+    result = answer_forward(entry, res, canonname);
+    cache_add(key, entry);
+
+    return result;
+}
+
+int
+resolver_name_info(
+    sockaddr_union *	addr,
+    char **		hostname)
+{
+    char *key;
+    resolver_entry_t *entry;
+    int result;
+
+    *hostname = NULL;
+    resolver_init();
+    key = reverse_key(addr);
+    if ((entry = cache_lookup(key)) == NULL) {
+	entry = lookup_reverse(addr);
+	result = entry->result;
+	if (result == 0)
+	    *hostname = g_strdup(entry->name);
+	cache_add(key, entry);
+	return result;
+    }
+
+    g_free(key);
+    if (entry->result == 0)
+	*hostname = g_strdup(entry->name);
+    return entry->result;
+}
+
+/*
+ * Lookups in the background
+ */
+
+/* Hand Q to the worker threads, starting one if there are more lookups
+ * in progress than threads.  Without threads, do the lookup now, but
+ * still call back from the event loop. */
+static void
+resolver_queue(
+    resolver_query_t *q)
+{
+    int i;
+
+    if (wake_pipe[0] == -1) {
+	if (pipe(wake_pipe) < 0)
+	    error("resolver: pipe: %s", strerror(errno));
+	for (i = 0; i < 2; i++) {
+	    fcntl(wake_pipe[i], F_SETFL, fcntl(wake_pipe[i], F_GETFL) | O_NONBLOCK);
+	    fcntl(wake_pipe[i], F_SETFD, FD_CLOEXEC);
+	}
+	todo = g_async_queue_new();
+	done = g_async_queue_new();
+	pending = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+
+    g_hash_table_insert(pending, q->key, q);
+    if (!done_ev)
+	done_ev = event_register((event_id_t)wake_pipe[0], EV_READFD,
+				 resolver_done_callback, NULL);
+
+    if (g_thread_supported() && nb_threads < RESOLVER_THREADS &&
+	nb_threads < g_hash_table_size(pending)) {
+	if (g_thread_create(resolver_thread, NULL, FALSE, NULL) != NULL)
+	    nb_threads++;
+    }
+
+    if (nb_threads > 0) {
+	g_async_queue_push(todo, q);
+    } else {
+	q->entry = lookup_forward(q->hostname, q->socktype);
+	g_async_queue_push(done, q);
+	if (write(wake_pipe[1], "", 1) < 0) {
+	    /* ignore */
+	}
+    }
+}
+
+static void
+resolver_done_callback(
+    void *	cookie)
+{
+    char buf[64];
+    resolver_query_t *q;
+    resolver_waiter_t *w;
+    GSList *waiters, *iter;
+
+    (void)cookie;	/* Quiet unused parameter warning */
+
+    while (read(wake_pipe[0], buf, sizeof(buf)) > 0)
+	continue;
+
+    while ((q = g_async_queue_try_pop(done)) != NULL) {
+	g_hash_table_remove(pending, q->key);
+
+	/* answer everyone before a callback can change the cache */
+	waiters = g_slist_reverse(q->waiters);
+	for (iter = waiters; iter != NULL; iter = iter->next) {
+	    w = iter->data;
+	    w->result = answer_forward(q->entry, &w->res, &w->canonname);
+	}
+
+	cache_add(q->key, q->entry);
+	g_free(q->hostname);
+	g_free(q);
+
+	for (iter = waiters; iter != NULL; iter = iter->next) {
+	    w = iter->data;
+	    w->fn(w->data, w->result, w->res, w->canonname);
+	    g_free(w);
+	}
+	g_slist_free(waiters);
+    }
+
+    if (done_ev && g_hash_table_size(pending) == 0) {
+	event_release(done_ev);
+	done_ev = NULL;
+    }
+}
+
+void
+resolver_resolve_async(
+    const char *hostname,
+    int		socktype,
+    resolver_fn fn,
+    gpointer	data)
+{
+    char *key;
+    resolver_entry_t *entry;
+    resolver_query_t *q;
+    resolver_waiter_t *w;
+    struct addrinfo *res;
+    char *canonname;
+    int result;
+
+    resolver_init();
+    key = forward_key(hostname, socktype);
+    if ((entry = cache_lookup(key)) != NULL) {
+	g_free(key);
+	result = answer_forward(entry, &res, &canonname);
+	fn(data, result, res, canonname);
+	return;
+    }
+
+    w = g_new0(resolver_waiter_t, 1);
+    w->fn = fn;
+    w->data = data;
+
+    q = pending? g_hash_table_lookup(pending, key) : NULL;
+    if (q) {
+	g_free(key);
+	q->waiters = g_slist_prepend(q->waiters, w);
+	return;
+    }
+
+    q = g_new0(resolver_query_t, 1);
+    q->key = key;
+    q->hostname = g_strdup(hostname);
+    q->socktype = socktype;
+    q->waiters = g_slist_prepend(NULL, w);
+    resolver_queue(q);
+}
+
+void
+resolver_set_fake(
+    int delay_ms)
+{
+    resolver_init();
+    g_atomic_int_set(&fake_delay, delay_ms < 0? -1 : delay_ms);
+    resolver_clear();
+}
+
+static gboolean
+remove_any(
+    gpointer key,
+    gpointer value,
+    gpointer user_data)
+{
+    (void)key;		/* Quiet unused parameter warning */
+    (void)value;	/* Quiet unused parameter warning */
+    (void)user_data;	/* Quiet unused parameter warning */
+
+    return TRUE;
+}
+
+void
+resolver_clear(void)
+{
+    resolver_init();
+    g_hash_table_foreach_remove(cache, remove_any, NULL);
+}
+
+void
+resolver_get_stats(
+    guint *lookups,
+    guint *hits)
+{
+    *lookups = g_atomic_int_get(&nb_lookups);
+    *hits = g_atomic_int_get(&nb_hits);
+}
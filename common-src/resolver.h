@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94085, USA, or: http://www.zmanda.com
+ */
+
+/*
+ * A process-wide cache of host name lookups, for the security drivers.
+ *
+ * Forward lookups (as resolve_hostname does them) and reverse lookups (as
+ * getnameinfo does them) are kept for RESOLVER_TTL seconds; lookups which
+ * found that the name or address does not exist are kept for
+ * RESOLVER_NEGATIVE_TTL seconds.  Temporary failures are not kept.
+ *
+ * resolver_resolve_async does the lookup in a worker thread, and calls
+ * back from the event loop, so that a slow name server does not hold up
+ * the other connections.  Concurrent lookups of the same name are made
+ * only once.  A lookup found in the cache calls back before the function
+ * returns.
+ *
+ * All of these functions must be called from the thread running the event
+ * loop.
+ *
+ * For testing, a fake resolver answers every name with 127.0.0.1, and the
+ * name itself as its canonical name, except names in the '.invalid' domain,
+ * which do not exist.  It answers every address with the address itself.
+ * It takes a given number of milliseconds for every lookup; set it with
+ * resolver_set_fake.
+ */
+
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "amanda.h"
+
+/* seconds to keep the outcome of a lookup */
+#define RESOLVER_TTL 300
+#define RESOLVER_NEGATIVE_TTL 30
+
+/* Look up HOSTNAME as resolve_hostname does, using the cache.  The results
+ * belong to the caller; free RES with resolver_free_addrinfo, not
+ * freeaddrinfo.
+ *
+ * @returns: 0 on success, otherwise a getaddrinfo result
+ */
+int resolver_resolve(const char *hostname, int socktype,
+		     struct addrinfo **res, char **canonname);
+
+/* The callback for resolver_resolve_async.  RES and CANONNAME belong to the
+ * callback, as for resolver_resolve.
+ */
+typedef void (*resolver_fn)(gpointer data, int result,
+			    struct addrinfo *res, char *canonname);
+
+/* Look up HOSTNAME without blocking, calling FN with the result */
+void resolver_resolve_async(const char *hostname, int socktype,
+			    resolver_fn fn, gpointer data);
+
+/* Free the results of resolver_resolve */
+void resolver_free_addrinfo(struct addrinfo *res);
+
+/* Find the name of ADDR as getnameinfo does, using the cache.  The name
+ * belongs to the caller.
+ *
+ * @returns: 0 on success, otherwise a getnameinfo result
+ */
+int resolver_name_info(sockaddr_union *addr, char **hostname);
+
+/* Use the fake resolver, taking DELAY_MS milliseconds for each lookup, or
+ * the system's resolver if DELAY_MS is negative.  The cache is emptied.
+ */
+void resolver_set_fake(int delay_ms);
+
+/* Empty the cache */
+void resolver_clear(void);
+
+/* The number of lookups made, and the number answered from the cache */
+void resolver_get_stats(guint *lookups, guint *hits);
+
+#endif /* RESOLVER_H */
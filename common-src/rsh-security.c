@@ -93,6 +93,7 @@ const security_driver_t rsh_security_driver = {
     tcpm_stream_read_cancel,
     tcpm_close_connection,
     NULL,
+    NULL,
     NULL
 };
 
@@ -0,0 +1,503 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA.
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
+ */
+
+#include "amanda.h"
+#include "testutils.h"
+#include "security-util.h"
+#include "sockaddr-util.h"
+#include <utime.h>
+
+#define STREAM_HANDLE 42
+
+/*
+ * Utils
+ */
+
+/* drivers with only what tcpm_stream_write_from_fd looks at */
+static security_driver_t plain_driver;
+static security_driver_t encrypting_driver;
+
+static int nb_encrypts;
+
+static int
+identity_encrypt(
+    void    *rc G_GNUC_UNUSED,
+    void    *buf,
+    ssize_t  len G_GNUC_UNUSED,
+    void   **encbuf,
+    ssize_t *enclen)
+{
+    nb_encrypts++;
+    *encbuf = buf;
+    *enclen = len;
+    return 0;
+}
+
+static struct tcp_conn rc;
+static struct sec_stream rs;
+
+static void
+setup_stream(
+    const security_driver_t *driver,
+    int write_fd)
+{
+    memset(&rc, 0, sizeof(rc));
+    memset(&rs, 0, sizeof(rs));
+    rc.driver = driver;
+    rc.read = -1;
+    rc.write = write_fd;
+    strcpy(rc.hostname, "localhost");
+    rs.secstr.driver = driver;
+    rs.rc = &rc;
+    rs.handle = STREAM_HANDLE;
+}
+
+static void
+fill_pattern(
+    char *buf,
+    size_t len,
+    int seed)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+	buf[i] = (char)(i * 7 + seed);
+}
+
+/* read one token from fd and check that it carries LEN bytes of the given
+ * pattern */
+static gboolean
+check_token(
+    int fd,
+    size_t len,
+    int seed)
+{
+    guint32 header[2];
+    char *got, *want;
+    gboolean ok;
+
+    if (full_read(fd, header, sizeof(header)) < sizeof(header)) {
+	tu_dbg("short token header\n");
+	return FALSE;
+    }
+    if (ntohl(header[0]) != len || ntohl(header[1]) != STREAM_HANDLE) {
+	tu_dbg("token header says %u bytes for handle %u; expected %zu for %d\n",
+	       ntohl(header[0]), ntohl(header[1]), len, STREAM_HANDLE);
+	return FALSE;
+    }
+
+    got = g_malloc(len);
+    want = g_malloc(len);
+    fill_pattern(want, len, seed);
+    ok = full_read(fd, got, len) == len && memcmp(got, want, len) == 0;
+    if (!ok)
+	tu_dbg("token data differs\n");
+    g_free(got);
+    g_free(want);
+    return ok;
+}
+
+/* write LEN bytes of pattern to IN, move them with tcpm_stream_write_from_fd
+ * in tokens of at most MAX bytes, and check the tokens read from OUT */
+static gboolean
+move_tokens(
+    int in[2],
+    int out[2],
+    size_t len,
+    size_t max)
+{
+    char *buf = g_malloc(len);
+    size_t moved;
+    ssize_t n;
+
+    fill_pattern(buf, len, 3);
+    if (full_write(in[1], buf, len) < len) {
+	g_free(buf);
+	return FALSE;
+    }
+    g_free(buf);
+
+    for (moved = 0; moved < len; moved += n) {
+	size_t expect = MIN(len - moved, max);
+
+	n = tcpm_stream_write_from_fd(&rs, in[0], max);
+	if (n != (ssize_t)expect) {
+	    tu_dbg("moved %zd bytes; expected %zu (%s)\n", n, expect,
+		   rs.secstr.error ? rs.secstr.error : "no error");
+	    return FALSE;
+	}
+	if (!check_token(out[0], expect, (int)(3 + moved * 7)))
+	    return FALSE;
+    }
+    return TRUE;
+}
+
+#define AMANDAHOSTS_DIR "./amandahosts-test"
+#define AMANDAHOSTS_FILE AMANDAHOSTS_DIR "/.amandahosts"
+
+/* write the .amandahosts in AMANDAHOSTS_DIR, either in place or as a new
+ * file renamed over the old one */
+static gboolean
+write_amandahosts(
+    const char *contents,
+    gboolean replace)
+{
+    const char *filename = replace? AMANDAHOSTS_FILE ".new" : AMANDAHOSTS_FILE;
+    int fd;
+
+    if (mkdir(AMANDAHOSTS_DIR, 0700) < 0 && errno != EEXIST)
+	return FALSE;
+    if ((fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0) {
+	tu_dbg("could not open '%s': %s\n", filename, strerror(errno));
+	return FALSE;
+    }
+    if (full_write(fd, contents, strlen(contents)) < strlen(contents)) {
+	close(fd);
+	return FALSE;
+    }
+    close(fd);
+    if (replace && rename(filename, AMANDAHOSTS_FILE) < 0)
+	return FALSE;
+    return TRUE;
+}
+
+static void
+remove_amandahosts(void)
+{
+    unlink(AMANDAHOSTS_FILE);
+    rmdir(AMANDAHOSTS_DIR);
+}
+
+/* is REMOTEUSER on HOST, connecting from IP, allowed SERVICE by the
+ * .amandahosts in AMANDAHOSTS_DIR? */
+static gboolean
+amandahosts_allows(
+    const char *host,
+    const char *ip,
+    const char *remoteuser,
+    const char *service)
+{
+    struct passwd pwd;
+    sockaddr_union addr;
+    char *errmsg;
+
+    memset(&pwd, 0, sizeof(pwd));
+    pwd.pw_name = "amandabackup";
+    pwd.pw_dir = AMANDAHOSTS_DIR;
+    pwd.pw_uid = getuid();
+
+#ifdef WORKING_IPV6
+    if (strchr(ip, ':')) {
+	SU_INIT(&addr, AF_INET6);
+	inet_pton(AF_INET6, ip, &addr.sin6.sin6_addr);
+    } else
+#endif
+    {
+	SU_INIT(&addr, AF_INET);
+	inet_pton(AF_INET, ip, &addr.sin.sin_addr);
+    }
+
+    errmsg = check_user_amandahosts(host, &addr, &pwd, remoteuser, service);
+    if (errmsg)
+	tu_dbg("%s %s@%s (%s): %s\n", service, remoteuser, host, ip, errmsg);
+    g_free(errmsg);
+    return errmsg == NULL;
+}
+
+/*
+ * Tests
+ */
+
+/* Data waiting in a pipe is sent as tokens with the usual header, no larger
+ * than asked for, and EOF sends nothing */
+static gboolean
+test_pipe_tokens(void)
+{
+    int in[2], out[2];
+    gboolean ok;
+
+    if (pipe(in) < 0 || pipe(out) < 0)
+	return FALSE;
+    setup_stream(&plain_driver, out[1]);
+
+    ok = move_tokens(in, out, 5000, 65536) && move_tokens(in, out, 5000, 1000);
+
+    if (ok) {
+	close(in[1]);
+	ok = tcpm_stream_write_from_fd(&rs, in[0], 65536) == 0;
+	if (!ok)
+	    tu_dbg("EOF did not return 0\n");
+    } else {
+	close(in[1]);
+    }
+
+    close(in[0]);
+    close(out[0]);
+    close(out[1]);
+    return ok;
+}
+
+/* A driver that encrypts sees every byte, so the data is read and sent
+ * through tcpm_send_token */
+static gboolean
+test_encrypting_driver(void)
+{
+    int in[2], out[2];
+    gboolean ok;
+
+    if (pipe(in) < 0 || pipe(out) < 0)
+	return FALSE;
+    encrypting_driver.data_encrypt = identity_encrypt;
+    setup_stream(&encrypting_driver, out[1]);
+    nb_encrypts = 0;
+
+    ok = move_tokens(in, out, 3000, 65536) && move_tokens(in, out, 3000, 1024);
+    if (ok && nb_encrypts != 4) {
+	tu_dbg("%d tokens were encrypted; expected 4\n", nb_encrypts);
+	ok = FALSE;
+    }
+
+    close(in[0]);
+    close(in[1]);
+    close(out[0]);
+    close(out[1]);
+    return ok;
+}
+
+/* Between two sockets splice() fails with EINVAL once the header is out;
+ * the rest of the token is copied, and the framing is unchanged */
+static gboolean
+test_no_splice(void)
+{
+    int in[2], out[2];
+    gboolean ok;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, in) < 0 ||
+	socketpair(AF_UNIX, SOCK_STREAM, 0, out) < 0)
+	return FALSE;
+    setup_stream(&plain_driver, out[1]);
+
+    ok = move_tokens(in, out, 5000, 65536) && move_tokens(in, out, 5000, 1000);
+
+    close(in[0]);
+    close(in[1]);
+    close(out[0]);
+    close(out[1]);
+    return ok;
+}
+
+/* A connection whose hostname is set after sec_tcp_conn_get, as ssh_accept
+ * does, is found under the new name once reindexed, and no longer under the
+ * old one */
+static gboolean
+test_conn_reindex(void)
+{
+    struct tcp_conn *conn, *found;
+    gboolean ok = TRUE;
+
+    conn = sec_tcp_conn_get("", 0);
+    strcpy(conn->hostname, "Client.Example.COM");
+    sec_tcp_conn_reindex(conn, "");
+
+    found = sec_tcp_conn_get("client.example.com", 0);
+    if (found != conn) {
+	tu_dbg("the connection is not found under its new hostname\n");
+	ok = FALSE;
+    }
+    sec_tcp_conn_put(found);
+
+    found = sec_tcp_conn_get("", 0);
+    if (found == conn) {
+	tu_dbg("the connection is still found under its old hostname\n");
+	ok = FALSE;
+    }
+    sec_tcp_conn_put(found);
+
+    /* and it is removed from the index under the new name */
+    sec_tcp_conn_put(conn);
+    found = sec_tcp_conn_get("client.example.com", 0);
+    if (found == conn) {
+	tu_dbg("a closed connection is still found\n");
+	ok = FALSE;
+    }
+    sec_tcp_conn_put(found);
+
+    return ok;
+}
+
+/* The first line for the host and user decides, in the order of the file,
+ * whatever the case of the host name; a line without services allows only
+ * the amdump services */
+static gboolean
+test_amandahosts_first_match(void)
+{
+    gboolean ok = TRUE;
+
+    if (!write_amandahosts(
+	    "client.example.com backup amindexd\n"
+	    "Client.Example.COM backup\n"
+	    "client.example.com backup amidxtaped\n"
+	    "client.example.com other amdump\n", FALSE))
+	return FALSE;
+
+    if (!amandahosts_allows("client.example.com", "192.0.2.1", "backup", "amindexd") ||
+	!amandahosts_allows("CLIENT.example.com", "192.0.2.1", "backup", "sendbackup") ||
+	!amandahosts_allows("client.example.com", "192.0.2.1", "other", "selfcheck")) {
+	tu_dbg("a listed user was refused\n");
+	ok = FALSE;
+    }
+    if (amandahosts_allows("client.example.com", "192.0.2.1", "backup", "amidxtaped")) {
+	tu_dbg("a line after the first match was used\n");
+	ok = FALSE;
+    }
+    if (amandahosts_allows("client.example.com", "192.0.2.1", "other", "amindexd") ||
+	amandahosts_allows("server.example.com", "192.0.2.1", "backup", "sendbackup")) {
+	tu_dbg("an unlisted user was allowed\n");
+	ok = FALSE;
+    }
+
+    remove_amandahosts();
+    return ok;
+}
+
+/* localhost lines match their own name, and any host name connecting from a
+ * loopback address, in their place among the host's lines */
+static gboolean
+test_amandahosts_localhost(void)
+{
+    gboolean ok = TRUE;
+
+    if (!write_amandahosts(
+	    "localhost backup amdump\n"
+	    "localhost.localdomain backup\n"
+	    "client.example.com backup amindexd\n", FALSE))
+	return FALSE;
+
+    if (!amandahosts_allows("client.example.com", "127.0.0.1", "backup", "sendsize") ||
+	!amandahosts_allows("localhost", "192.0.2.1", "backup", "sendsize")) {
+	tu_dbg("a localhost line did not match\n");
+	ok = FALSE;
+    }
+#ifdef WORKING_IPV6
+    if (!amandahosts_allows("client.example.com", "::1", "backup", "sendsize")) {
+	tu_dbg("a localhost line did not match ::1\n");
+	ok = FALSE;
+    }
+#endif
+    if (amandahosts_allows("server.example.com", "192.0.2.1", "backup", "sendsize")) {
+	tu_dbg("a localhost line matched a remote host\n");
+	ok = FALSE;
+    }
+
+    /* the localhost lines come first, and refuse amindexd */
+    if (amandahosts_allows("client.example.com", "127.0.0.1", "backup", "amindexd")) {
+	tu_dbg("a later line was used from the loopback address\n");
+	ok = FALSE;
+    }
+    if (!amandahosts_allows("client.example.com", "192.0.2.1", "backup", "amindexd")) {
+	tu_dbg("the host's own line was not used from a remote address\n");
+	ok = FALSE;
+    }
+
+    remove_amandahosts();
+    return ok;
+}
+
+/* The parsed file is replaced when the file's size, times or inode change */
+static gboolean
+test_amandahosts_changed(void)
+{
+    struct stat sbuf;
+    struct utimbuf times;
+    gboolean ok = TRUE;
+
+    if (!write_amandahosts("client.example.com backup amdump\n", FALSE))
+	return FALSE;
+    if (!amandahosts_allows("client.example.com", "192.0.2.1", "backup", "sendsize")) {
+	tu_dbg("the first file was not used\n");
+	ok = FALSE;
+    }
+
+    /* a different size */
+    if (!write_amandahosts("client.example.com other amdump\n", FALSE))
+	return FALSE;
+    if (amandahosts_allows("client.example.com", "192.0.2.1", "backup", "sendsize") ||
+	!amandahosts_allows("client.example.com", "192.0.2.1", "other", "sendsize")) {
+	tu_dbg("a file of a new size was not read again\n");
+	ok = FALSE;
+    }
+
+    /* the same size, in place, within the same second; set the mtime back
+     * so that it differs */
+    if (!write_amandahosts("client.example.com third amdump\n", FALSE) ||
+	stat(AMANDAHOSTS_FILE, &sbuf) < 0)
+	return FALSE;
+    times.actime = sbuf.st_atime;
+    times.modtime = sbuf.st_mtime - 100;
+    if (utime(AMANDAHOSTS_FILE, &times) < 0)
+	return FALSE;
+    if (amandahosts_allows("client.example.com", "192.0.2.1", "other", "sendsize") ||
+	!amandahosts_allows("client.example.com", "192.0.2.1", "third", "sendsize")) {
+	tu_dbg("a file with a new mtime was not read again\n");
+	ok = FALSE;
+    }
+
+    /* the same size, renamed over the old file */
+    if (!write_amandahosts("client.example.com forth amdump\n", TRUE))
+	return FALSE;
+    if (amandahosts_allows("client.example.com", "192.0.2.1", "third", "sendsize") ||
+	!amandahosts_allows("client.example.com", "192.0.2.1", "forth", "sendsize")) {
+	tu_dbg("a new file with the same name was not read\n");
+	ok = FALSE;
+    }
+
+    /* and a file that is not private is still refused */
+    chmod(AMANDAHOSTS_FILE, 0644);
+    if (amandahosts_allows("client.example.com", "192.0.2.1", "forth", "sendsize")) {
+	tu_dbg("a file others can read was used\n");
+	ok = FALSE;
+    }
+
+    remove_amandahosts();
+    return ok;
+}
+
+/*
+ * Main driver
+ */
+
+int
+main(int argc, char **argv)
+{
+    static TestUtilsTest tests[] = {
+	TU_TEST(test_pipe_tokens, 90),
+	TU_TEST(test_encrypting_driver, 90),
+	TU_TEST(test_no_splice, 90),
+	TU_TEST(test_conn_reindex, 90),
+	TU_TEST(test_amandahosts_first_match, 90),
+	TU_TEST(test_amandahosts_localhost, 90),
+	TU_TEST(test_amandahosts_changed, 90),
+	TU_END()
+    };
+
+    glib_init();
+
+    return testutils_run_tests(argc, argv, tests);
+}
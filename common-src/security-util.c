@@ -41,11 +41,15 @@
 #include "security-util.h"
 #include "stream.h"
 #include "sockaddr-util.h"
+#include "resolver.h"
 
 /*
  * This is a queue of open connections
  */
 GSList *connq = NULL;
+
+/* the connections in connq to each host, oldest first, by lowercased name */
+static GHashTable *connq_by_host = NULL;
 static int newhandle = 1;
 static int newevent = 1;
 
@@ -58,6 +62,8 @@ static void stream_read_sync_callback(void *);
 
 static void sec_tcp_conn_read_cancel(struct tcp_conn *);
 static void sec_tcp_conn_read_callback(void *);
+static void sec_tcp_conn_index(struct tcp_conn *, const char *);
+static void sec_tcp_conn_unindex(struct tcp_conn *, const char *);
 
 
 /*
@@ -326,6 +332,108 @@ tcpm_stream_write(
     return (0);
 }
 
+/*
+ * Send the data waiting on fd to a stream.  Where splice(2) is available,
+ * only the token header is written from here; the data itself goes from
+ * the pipe to the connection without being copied into user space.
+ */
+ssize_t
+tcpm_stream_write_from_fd(
+    void *	s,
+    int		fd,
+    size_t	max)
+{
+    struct sec_stream *rs = s;
+    struct tcp_conn *rc;
+    ssize_t n;
+
+    assert(rs != NULL);
+    assert(rs->rc != NULL);
+    rc = rs->rc;
+
+#if defined(HAVE_SPLICE) && defined(FIONREAD)
+    {
+	int avail = 0;
+	guint32 header[2];
+	size_t left;
+	ssize_t r;
+	gboolean copy = FALSE;
+
+	/* we are the only reader of fd, so everything it reports as
+	 * available can be announced in the token header; data that must be
+	 * encrypted goes through tcpm_send_token below */
+	if (rc->driver->data_encrypt == NULL &&
+	    ioctl(fd, FIONREAD, &avail) == 0 && avail > 0) {
+	    n = (ssize_t)MIN((size_t)avail, max);
+	    auth_debug(1, _("sec: stream_write_from_fd: splicing %zd bytes to %s:%d %d\n"),
+			   n, rc->hostname, rs->handle, rc->write);
+
+	    header[0] = htonl((guint32)n);
+	    header[1] = htonl((guint32)rs->handle);
+	    if (full_write(rc->write, header, sizeof(header)) < sizeof(header))
+		goto write_error;
+
+	    for (left = (size_t)n; left > 0; left -= (size_t)r) {
+		if (copy) {
+		    r = read(fd, rs->databuf, MIN(left, sizeof(rs->databuf)));
+		    if (r > 0 && full_write(rc->write, rs->databuf, (size_t)r)
+				    < (size_t)r)
+			goto write_error;
+		} else {
+		    r = splice(fd, NULL, rc->write, NULL, left,
+			       SPLICE_F_MOVE | SPLICE_F_MORE);
+		    if (r < 0 && (errno == EINVAL || errno == ENOSYS)) {
+			/* the kernel can't splice between these descriptors;
+			 * the header is out, so copy the rest of the token */
+			copy = TRUE;
+			r = 0;
+			continue;
+		    }
+		}
+		if (r < 0 && (errno == EINTR || errno == EAGAIN)) {
+		    r = 0;
+		    continue;
+		}
+		if (r <= 0) {
+		    /* the token is cut short; the connection is unusable */
+		    if (r == 0)
+			errno = EPIPE;
+		    goto write_error;
+		}
+	    }
+	    return n;
+	}
+	/* nothing buffered: fd is at EOF or broken, and read() will say
+	 * which */
+    }
+#endif
+
+    do {
+	n = read(fd, rs->databuf, MIN(max, sizeof(rs->databuf)));
+    } while ((n < 0) && ((errno == EINTR) || (errno == EAGAIN)));
+    if (n < 0) {
+	security_stream_seterror(&rs->secstr, _("read error: %s"),
+				 strerror(errno));
+	return (-1);
+    }
+    if (n == 0)
+	return (0);
+
+    if (tcpm_send_token(rc, rc->write, rs->handle, &rc->errmsg,
+			     rs->databuf, (size_t)n)) {
+	security_stream_seterror(&rs->secstr, "%s", rc->errmsg);
+	return (-1);
+    }
+    return (n);
+
+#if defined(HAVE_SPLICE) && defined(FIONREAD)
+write_error:
+    security_stream_seterror(&rs->secstr, _("write error to: %s"),
+			     strerror(errno));
+    return (-1);
+#endif
+}
+
 /*
  * Submit a request to read some data.  Calls back with the given
  * function and arg when completed.
@@ -1150,6 +1258,22 @@ udpbsd_sendpkt(
      _("sec: udpbsd_sendpkt: %s (%d) pkt_t (len %zu) contains:\n\n\"%s\"\n\n"),
       pkt_type2str(pkt->type), pkt->type, strlen(pkt->body), pkt->body);
 
+    /* while handling a batch of received datagrams, the replies are sent
+     * together once it has been handled */
+    if (rh->udp->in_batch) {
+	dgram_out_t out;
+
+	copy_sockaddr(&out.addr, &rh->peer);
+	out.len = rh->udp->dgram.len;
+	out.data = g_memdup(rh->udp->dgram.data, (guint)out.len);
+	out.error = 0;
+	out.cookie = rh;
+	if (!rh->udp->out)
+	    rh->udp->out = g_array_new(FALSE, FALSE, sizeof(dgram_out_t));
+	g_array_append_val(rh->udp->out, out);
+	return (0);
+    }
+
     if (dgram_send_addr(&rh->peer, &rh->udp->dgram) != 0) {
 	security_seterror(&rh->sech,
 	    _("send %s to %s failed: %s"), pkt_type2str(pkt->type),
@@ -1164,6 +1288,8 @@ udp_close(
     void *	cookie)
 {
     struct sec_handle *rh = cookie;
+    dgram_out_t *out;
+    guint i;
 
     if (rh->proto_handle == NULL) {
 	return;
@@ -1171,20 +1297,18 @@ udp_close(
 
     auth_debug(1, _("udp: close handle '%s'\n"), rh->proto_handle);
 
-    udp_recvpkt_cancel(rh);
-    if (rh->next) {
-	rh->next->prev = rh->prev;
-    }
-    else {
-	rh->udp->bh_last = rh->prev;
-    }
-    if (rh->prev) {
-	rh->prev->next = rh->next;
-    }
-    else {
-	rh->udp->bh_first = rh->next;
+    /* its replies still go out, but their failure is no one's to hear */
+    if (rh->udp->out) {
+	out = (dgram_out_t *)rh->udp->out->data;
+	for (i = 0; i < rh->udp->out->len; i++) {
+	    if (out[i].cookie == rh)
+		out[i].cookie = NULL;
+	}
     }
 
+    udp_recvpkt_cancel(rh);
+    udp_removehandle(rh);
+
     amfree(rh->proto_handle);
     amfree(rh->hostname);
     amfree(rh);
@@ -1321,6 +1445,41 @@ udp_recvpkt_timeout(
     (*fn)(arg, NULL, S_TIMEOUT);
 }
 
+/*
+ * Remove a handle from its udp_handle's list, and from the index of the
+ * list by protocol handle
+ */
+void
+udp_removehandle(
+    struct sec_handle *	rh)
+{
+    udp_handle_t *udp = rh->udp;
+    GSList *same;
+
+    if (rh->next) {
+	rh->next->prev = rh->prev;
+    }
+    else {
+	udp->bh_last = rh->prev;
+    }
+    if (rh->prev) {
+	rh->prev->next = rh->next;
+    }
+    else {
+	udp->bh_first = rh->next;
+    }
+    rh->prev = rh->next = NULL;
+
+    if (udp->bh_hash && rh->proto_handle) {
+	same = g_hash_table_lookup(udp->bh_hash, rh->proto_handle);
+	same = g_slist_remove(same, rh);
+	if (same)
+	    g_hash_table_insert(udp->bh_hash, g_strdup(rh->proto_handle), same);
+	else
+	    g_hash_table_remove(udp->bh_hash, rh->proto_handle);
+    }
+}
+
 /*
  * Given a hostname and a port, setup a udp_handle
  */
@@ -1334,6 +1493,8 @@ udp_inithandle(
     char *		handle,
     int			sequence)
 {
+    GSList *same;
+
     /*
      * Save the hostname and port info
      */
@@ -1360,6 +1521,17 @@ udp_inithandle(
     rh->event_id = (event_id_t)newevent++;
     amfree(rh->proto_handle);
     rh->proto_handle = g_strdup(handle);
+
+    /* index it, so that the handle a packet is for is found quickly */
+    if (!udp->bh_hash)
+	udp->bh_hash = g_hash_table_new_full(g_str_hash, g_str_equal,
+					     g_free, NULL);
+    same = g_hash_table_lookup(udp->bh_hash, handle);
+    if (same)
+	same = g_slist_append(same, rh);
+    else
+	g_hash_table_insert(udp->bh_hash, g_strdup(handle),
+			    g_slist_append(NULL, rh));
     rh->fn.connect = NULL;
     rh->arg = NULL;
     rh->ev_read = NULL;
@@ -1372,33 +1544,51 @@ udp_inithandle(
 
 
 /*
- * Callback for received packets.  This is the function bsd_recvpkt
- * registers with the event handler.  It is called when the event handler
- * realizes that data is waiting to be read on the network socket.
+ * Find the name of PEER, and check that it resolves back to PEER.  Both
+ * lookups are answered from the resolver's cache after the first packet,
+ * since a server sends a packet for every request, and retransmits them,
+ * from one address.
+ *
+ * @returns: the name, or NULL with *errmsg set to a new string; the name
+ * belongs to the caller
  */
-void
-udp_netfd_read_callback(
-    void *	cookie)
+static char *
+udp_peer_name(
+    sockaddr_union *	peer,
+    char **		errmsg)
+{
+    char *hostname;
+    int result;
+
+    result = resolver_name_info(peer, &hostname);
+    if (result != 0) {
+	dbprintf("getnameinfo failed: %s\n",
+		  gai_strerror(result));
+	*errmsg = g_strdup_printf("getnameinfo failed: %s",
+				  gai_strerror(result));
+	return NULL;
+    }
+    if (check_name_give_sockaddr(hostname, (struct sockaddr *)peer,
+				 errmsg) < 0) {
+	amfree(hostname);
+	return NULL;
+    }
+    return hostname;
+}
+
+/*
+ * Handle the packet in udp->dgram, from udp->peer
+ */
+static void
+udp_handle_packet(
+    udp_handle_t *	udp)
 {
-    struct udp_handle *udp = cookie;
     struct sec_handle *rh;
+    GSList *iter;
     int a;
-    char hostname[NI_MAXHOST];
+    char *hostname;
     in_port_t port;
     char *errmsg = NULL;
-    int result;
-
-    auth_debug(1, _("udp_netfd_read_callback(cookie=%p)\n"), cookie);
-    assert(udp != NULL);
-    
-#ifndef TEST							/* { */
-    /*
-     * Receive the packet.
-     */
-    dgram_zero(&udp->dgram);
-    if (dgram_recv(&udp->dgram, 0, &udp->peer) < 0)
-	return;
-#endif /* !TEST */						/* } */
 
     /*
      * Parse the packet.
@@ -1409,11 +1599,17 @@ udp_netfd_read_callback(
     /*
      * If there are events waiting on this handle, we're done
      */
-    rh = udp->bh_first;
-    while(rh != NULL && (!g_str_equal(rh->proto_handle, udp->handle) ||
-			 rh->sequence != udp->sequence ||
-			 cmp_sockaddr(&rh->peer, &udp->peer, 0) != 0)) {
-	rh = rh->next;
+    rh = NULL;
+    if (udp->bh_hash) {
+	for (iter = g_hash_table_lookup(udp->bh_hash, udp->handle);
+	     iter != NULL; iter = iter->next) {
+	    struct sec_handle *h = iter->data;
+	    if (h->sequence == udp->sequence &&
+		cmp_sockaddr(&h->peer, &udp->peer, 0) == 0) {
+		rh = h;
+		break;
+	    }
+	}
     }
     if (rh && event_wakeup(rh->event_id) > 0)
 	return;
@@ -1433,18 +1629,9 @@ udp_netfd_read_callback(
     rh->rc = NULL;
     security_handleinit(&rh->sech, udp->driver);
 
-    result = getnameinfo((struct sockaddr *)&udp->peer, SS_LEN(&udp->peer),
-			 hostname, sizeof(hostname), NULL, 0, 0);
-    if (result != 0) {
-	dbprintf("getnameinfo failed: %s\n",
-		  gai_strerror(result));
-	security_seterror(&rh->sech, "getnameinfo failed: %s",
-			  gai_strerror(result));
-	return;
-    }
-    if (check_name_give_sockaddr(hostname,
-				 (struct sockaddr *)&udp->peer, &errmsg) < 0) {
-	security_seterror(&rh->sech, "%s",errmsg);
+    hostname = udp_peer_name(&udp->peer, &errmsg);
+    if (!hostname) {
+	security_seterror(&rh->sech, "%s", errmsg);
 	amfree(errmsg);
 	amfree(rh);
 	return;
@@ -1457,6 +1644,7 @@ udp_netfd_read_callback(
 		   port,
 		   udp->handle,
 		   udp->sequence);
+    amfree(hostname);
     if (a < 0) {
 	auth_debug(1, _("bsd: closeX handle '%s'\n"), rh->proto_handle);
 
@@ -1473,6 +1661,134 @@ udp_netfd_read_callback(
 	(*udp->accept_fn)(&rh->sech, &udp->pkt);
 }
 
+/*
+ * A reply RH sent while handling a batch of packets could not be sent, with
+ * errno ERR.  If RH waits for a packet, it gets an error instead.
+ */
+static void
+udp_sendpkt_failed(
+    struct sec_handle *	rh,
+    int			err)
+{
+    void (*fn)(void *, pkt_t *, security_status_t);
+    void *arg;
+
+    security_seterror(&rh->sech, _("send to %s failed: %s"), rh->hostname,
+		      strerror(err));
+    if (rh->ev_read == NULL)
+	return;
+
+    fn = rh->fn.recvpkt;
+    arg = rh->arg;
+    udp_recvpkt_cancel(rh);
+    (*fn)(arg, NULL, S_ERROR);
+}
+
+/*
+ * The socket is always writable, so this is called as soon as the event
+ * loop goes around, to handle the packets left when the last waiting handle
+ * went away.
+ */
+static void
+udp_pending_callback(
+    void *	cookie)
+{
+    udp_handle_t *udp = cookie;
+
+    event_release(udp->ev_pending);
+    udp->ev_pending = NULL;
+    if (udp->ev_read != NULL && udp->in_next < udp->in_count)
+	udp_netfd_read_callback(udp);
+}
+
+/*
+ * Called by udp_addref when a handle waits again; handle the packets left
+ * over from the last batch, which the socket will not signal again.
+ */
+void
+udp_schedule_pending(
+    udp_handle_t *	udp)
+{
+    if (udp->in_next < udp->in_count && udp->ev_pending == NULL)
+	udp->ev_pending = event_register((event_id_t)udp->dgram.socket,
+					 EV_WRITEFD, udp_pending_callback, udp);
+}
+
+/*
+ * Callback for received packets.  This is the function bsd_recvpkt
+ * registers with the event handler.  It is called when the event handler
+ * realizes that data is waiting to be read on the network socket.
+ *
+ * All the packets waiting are received at once, and handled in turn; the
+ * packets sent meanwhile are sent together afterward, and a handle whose
+ * packet could not be sent is told so.  Should the last waiting handle go
+ * away, the rest of the packets are kept until a handle waits again.
+ */
+void
+udp_netfd_read_callback(
+    void *	cookie)
+{
+    struct udp_handle *udp = cookie;
+    dgram_out_t *out;
+    guint i;
+    int n;
+
+    auth_debug(1, _("udp_netfd_read_callback(cookie=%p)\n"), cookie);
+    assert(udp != NULL);
+    
+#ifndef TEST							/* { */
+    /*
+     * Receive the packets.
+     */
+    if (udp->in_next >= udp->in_count) {
+	if (!udp->in) {
+	    udp->in = g_new(dgram_t, DGRAM_BATCH_MAX);
+	    udp->in_peer = g_new(sockaddr_union, DGRAM_BATCH_MAX);
+	}
+	n = dgram_recv_batch(udp->dgram.socket, udp->in, udp->in_peer,
+			     DGRAM_BATCH_MAX);
+	if (n <= 0)
+	    return;
+	udp->in_count = n;
+	udp->in_next = 0;
+    }
+
+    udp->in_batch = TRUE;
+    while (udp->in_next < udp->in_count && udp->ev_read != NULL) {
+	dgram_t *in = &udp->in[udp->in_next];
+
+	dgram_zero(&udp->dgram);
+	memcpy(udp->dgram.data, in->data, in->len + 1);
+	udp->dgram.len = in->len;
+	copy_sockaddr(&udp->peer, &udp->in_peer[udp->in_next]);
+	udp->in_next++;
+
+	udp_handle_packet(udp);
+    }
+    udp->in_batch = FALSE;
+
+    /*
+     * Send the replies.
+     */
+    if (udp->out && udp->out->len > 0) {
+	out = (dgram_out_t *)udp->out->data;
+	if (dgram_send_batch(udp->dgram.socket, out, (int)udp->out->len) > 0) {
+	    dbprintf(_("udp_netfd_read_callback: some replies were not sent\n"));
+	    /* a callback may close a handle, which clears its cookies */
+	    for (i = 0; i < udp->out->len; i++) {
+		if (out[i].error != 0 && out[i].cookie != NULL)
+		    udp_sendpkt_failed(out[i].cookie, out[i].error);
+	    }
+	}
+	for (i = 0; i < udp->out->len; i++)
+	    g_free(out[i].data);
+	g_array_set_size(udp->out, 0);
+    }
+#else								/* } { */
+    udp_handle_packet(udp);
+#endif /* !TEST */						/* } */
+}
+
 /*
  * Locate an existing connection to the given host, or create a new,
  * unconnected entry if none exists.  The caller is expected to check
@@ -1483,19 +1799,22 @@ sec_tcp_conn_get(
     const char *hostname,
     int		want_new)
 {
-    GSList *iter;
+    GSList *same;
     struct tcp_conn *rc = NULL;
+    char *key;
 
     auth_debug(1, _("sec_tcp_conn_get: %s\n"), hostname);
 
-    if (want_new == 0) {
-	for (iter = connq; iter != NULL; iter = iter->next) {
-	    rc = (struct tcp_conn *)iter->data;
-	    if (strcasecmp(hostname, rc->hostname) == 0)
-		break;
-	}
+    if (!connq_by_host)
+	connq_by_host = g_hash_table_new_full(g_str_hash, g_str_equal,
+					      g_free, NULL);
+    key = g_ascii_strdown(hostname, -1);
+    same = g_hash_table_lookup(connq_by_host, key);
 
-	if (iter != NULL) {
+    if (want_new == 0) {
+	if (same != NULL) {
+	    g_free(key);
+	    rc = (struct tcp_conn *)same->data;
 	    rc->refcnt++;
 	    auth_debug(1,
 		      _("sec_tcp_conn_get: exists, refcnt to %s is now %d\n"),
@@ -1529,9 +1848,66 @@ sec_tcp_conn_get(
     rc->datap = NULL;
     rc->event_id = newevent++;
     connq = g_slist_append(connq, rc);
+
+    /* index it under its name as stored, which sec_tcp_conn_unindex uses */
+    g_free(key);
+    sec_tcp_conn_index(rc, rc->hostname);
     return (rc);
 }
 
+/*
+ * Add a connection to connq_by_host, under the given hostname
+ */
+static void
+sec_tcp_conn_index(
+    struct tcp_conn *	rc,
+    const char *	hostname)
+{
+    char *key;
+    GSList *same;
+
+    key = g_ascii_strdown(hostname, -1);
+    same = g_hash_table_lookup(connq_by_host, key);
+    g_hash_table_replace(connq_by_host, key, g_slist_append(same, rc));
+}
+
+/*
+ * Remove a connection from connq_by_host, where it is under the given
+ * hostname
+ */
+static void
+sec_tcp_conn_unindex(
+    struct tcp_conn *	rc,
+    const char *	hostname)
+{
+    char *key;
+    GSList *same;
+
+    if (!connq_by_host)
+	return;
+    key = g_ascii_strdown(hostname, -1);
+    same = g_slist_remove(g_hash_table_lookup(connq_by_host, key), rc);
+    if (same) {
+	g_hash_table_replace(connq_by_host, key, same);
+    } else {
+	g_hash_table_remove(connq_by_host, key);
+	g_free(key);
+    }
+}
+
+/*
+ * Move a connection in connq_by_host from OLD_HOSTNAME to rc->hostname.  Call
+ * this whenever rc->hostname is changed after sec_tcp_conn_get.
+ */
+void
+sec_tcp_conn_reindex(
+    struct tcp_conn *	rc,
+    const char *	old_hostname)
+{
+    sec_tcp_conn_unindex(rc, old_hostname);
+    sec_tcp_conn_index(rc, rc->hostname);
+}
+
 /*
  * Delete a reference to a connection, and close it if it is the last
  * reference.
@@ -1562,6 +1938,7 @@ sec_tcp_conn_put(
     if (rc->errmsg != NULL)
 	amfree(rc->errmsg);
     connq = g_slist_remove(connq, rc);
+    sec_tcp_conn_unindex(rc, rc->hostname);
     amfree(rc->pkt);
     if(!rc->donotclose) {
 	/* amfree(rc) */
@@ -2153,7 +2530,140 @@ check_user_ruserok(
 }
 
 /*
- * Check to see if a user is allowed in.  This version uses .amandahosts
+ * A parsed .amandahosts, kept until the file changes.  Each line is kept
+ * under its host name, in the order of the file; the lines naming localhost,
+ * which also match any connection from the loopback address, are kept apart.
+ */
+typedef struct amandahosts_line_s {
+    guint lineno;
+    char *host;			/* lowercased */
+    char *user;			/* NULL for the local user */
+    char **services;		/* NULL if none are given */
+} amandahosts_line_t;
+
+typedef struct amandahosts_s {
+    char *filename;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    time_t ctime;
+    GHashTable *by_host;	/* host -> GSList of amandahosts_line_t */
+    GSList *localhost;		/* of amandahosts_line_t */
+    GSList *lines;		/* all of them, to free */
+} amandahosts_t;
+
+static amandahosts_t *amandahosts = NULL;
+
+static void
+amandahosts_free(
+    amandahosts_t *ah)
+{
+    GSList *iter;
+    amandahosts_line_t *ahl;
+
+    for (iter = ah->lines; iter != NULL; iter = iter->next) {
+	ahl = iter->data;
+	g_free(ahl->host);
+	g_free(ahl->user);
+	g_strfreev(ahl->services);
+	g_free(ahl);
+    }
+    g_slist_free(ah->lines);
+    g_slist_free(ah->localhost);
+    g_hash_table_destroy(ah->by_host);
+    g_free(ah->filename);
+    g_free(ah);
+}
+
+static void
+amandahosts_free_list(
+    gpointer	data)
+{
+    g_slist_free((GSList *)data);
+}
+
+/*
+ * Parse the .amandahosts FILENAME, open as FP, whose status is SBUF
+ */
+static amandahosts_t *
+amandahosts_read(
+    const char *	filename,
+    FILE *		fp,
+    struct stat *	sbuf)
+{
+    amandahosts_t *ah = g_new0(amandahosts_t, 1);
+    amandahosts_line_t *ahl;
+    char *line;
+    char *filehost, *fileuser, *aservice;
+    GPtrArray *services;
+    GSList *same;
+    guint lineno = 0;
+
+    ah->filename = g_strdup(filename);
+    ah->dev = sbuf->st_dev;
+    ah->ino = sbuf->st_ino;
+    ah->size = sbuf->st_size;
+    ah->mtime = sbuf->st_mtime;
+    ah->ctime = sbuf->st_ctime;
+    ah->by_host = g_hash_table_new_full(g_str_hash, g_str_equal,
+					g_free, amandahosts_free_list);
+
+    while ((line = agets(fp)) != NULL) {
+	lineno++;
+	auth_debug(9, _("bsd: processing line: <%s>\n"), line);
+	/* get the host out of the file */
+	if ((filehost = strtok(line, " \t")) == NULL) {
+	    amfree(line);
+	    continue;
+	}
+
+	ahl = g_new0(amandahosts_line_t, 1);
+	ahl->lineno = lineno;
+	ahl->host = g_ascii_strdown(filehost, -1);
+	/* get the username.  If no user specified, then use the local user */
+	if ((fileuser = strtok(NULL, " \t")) != NULL) {
+	    ahl->user = g_strdup(fileuser);
+	    if ((aservice = strtok(NULL, " \t,")) != NULL) {
+		services = g_ptr_array_new();
+		do {
+		    g_ptr_array_add(services, g_strdup(aservice));
+		} while ((aservice = strtok(NULL, " \t,")) != NULL);
+		g_ptr_array_add(services, NULL);
+		ahl->services = (char **)g_ptr_array_free(services, FALSE);
+	    }
+	}
+	amfree(line);
+
+	ah->lines = g_slist_prepend(ah->lines, ahl);
+	if (g_str_equal(ahl->host, "localhost") ||
+	    g_str_equal(ahl->host, "localhost.localdomain")) {
+	    ah->localhost = g_slist_append(ah->localhost, ahl);
+	} else if ((same = g_hash_table_lookup(ah->by_host, ahl->host)) != NULL) {
+	    g_slist_append(same, ahl);
+	} else {
+	    g_hash_table_insert(ah->by_host, g_strdup(ahl->host),
+				g_slist_append(NULL, ahl));
+	}
+    }
+
+    return ah;
+}
+
+/* Is SERVICE one of those that "amdump" allows? */
+static gboolean
+is_amdump_service(
+    const char *service)
+{
+    return g_str_equal(service, "noop") ||
+	   g_str_equal(service, "selfcheck") ||
+	   g_str_equal(service, "sendsize") ||
+	   g_str_equal(service, "sendbackup");
+}
+
+/*
+ * Check to see if a user is allowed in.  This version uses .amandahosts,
+ * which is parsed again only when it changes.
  * Returns an error message on failure, or NULL on success.
  */
 char *
@@ -2164,17 +2674,18 @@ check_user_amandahosts(
     const char *	remoteuser,
     const char *	service)
 {
-    char *line = NULL;
-    char *filehost;
-    const char *fileuser;
     char *ptmp = NULL;
     char *result = NULL;
     FILE *fp = NULL;
     int found;
     struct stat sbuf;
-    int hostmatch;
+    char *lhost;
+    gboolean loopback;
+    GSList *byhost, *local;
+    amandahosts_line_t *ahl;
+    const char *fileuser;
+    char **aservice;
     int usermatch;
-    char *aservice = NULL;
 #ifdef WORKING_IPV6
     char ipstr[INET6_ADDRSTRLEN];
 #else
@@ -2189,20 +2700,36 @@ check_user_amandahosts(
     if (debug_auth >= 9) {
 	show_stat_info(ptmp, "");;
     }
-    if ((fp = fopen(ptmp, "r")) == NULL) {
+    if (stat(ptmp, &sbuf) != 0) {
 	result = g_strdup_printf(_("cannot open %s: %s"), ptmp, strerror(errno));
 	amfree(ptmp);
 	return result;
     }
 
+    if (!amandahosts || !g_str_equal(amandahosts->filename, ptmp) ||
+	amandahosts->dev != sbuf.st_dev || amandahosts->ino != sbuf.st_ino ||
+	amandahosts->size != sbuf.st_size ||
+	amandahosts->mtime != sbuf.st_mtime ||
+	amandahosts->ctime != sbuf.st_ctime) {
+	if ((fp = fopen(ptmp, "r")) == NULL) {
+	    result = g_strdup_printf(_("cannot open %s: %s"), ptmp, strerror(errno));
+	    amfree(ptmp);
+	    return result;
+	}
+	if (fstat(fileno(fp), &sbuf) != 0) {
+	    result = g_strdup_printf(_("cannot fstat %s: %s"), ptmp, strerror(errno));
+	    goto common_exit;
+	}
+	auth_debug(1, _("reading %s\n"), ptmp);
+	if (amandahosts)
+	    amandahosts_free(amandahosts);
+	amandahosts = amandahosts_read(ptmp, fp, &sbuf);
+    }
+
     /*
      * Make sure the file is owned by the Amanda user and does not
      * have any group/other access allowed.
      */
-    if (fstat(fileno(fp), &sbuf) != 0) {
-	result = g_strdup_printf(_("cannot fstat %s: %s"), ptmp, strerror(errno));
-	goto common_exit;
-    }
     if (sbuf.st_uid != pwd->pw_uid) {
 	result = g_strdup_printf(_("%s: owned by id %ld, should be %ld"),
 			ptmp, (long)sbuf.st_uid, (long)pwd->pw_uid);
@@ -2213,118 +2740,86 @@ check_user_amandahosts(
 	goto common_exit;
     }
 
+    /*  localhost and localhost.localdomain match any connection from
+     *  127.0.0.1 or ::1 */
+#ifdef WORKING_IPV6
+    if (SU_GET_FAMILY(addr) == (sa_family_t)AF_INET6)
+	inet_ntop(AF_INET6, &addr->sin6.sin6_addr,
+		  ipstr, sizeof(ipstr));
+    else
+#endif
+	inet_ntop(AF_INET, &addr->sin.sin_addr,
+		  ipstr, sizeof(ipstr));
+    loopback = g_str_equal(ipstr, "127.0.0.1") || g_str_equal(ipstr, "::1");
+
     /*
-     * Now, scan the file for the host/user/service.
+     * Now, look at the lines for the host, in the order of the file, for
+     * the user/service.
      */
+    lhost = g_ascii_strdown(host, -1);
+    byhost = g_hash_table_lookup(amandahosts->by_host, lhost);
+    local = amandahosts->localhost;
     found = 0;
-    while ((line = agets(fp)) != NULL) {
-	if (*line == 0) {
-	    amfree(line);
-	    continue;
-	}
-
-	auth_debug(9, _("bsd: processing line: <%s>\n"), line);
-	/* get the host out of the file */
-	if ((filehost = strtok(line, " \t")) == NULL) {
-	    amfree(line);
-	    continue;
-	}
-
-	/* get the username.  If no user specified, then use the local user */
-	if ((fileuser = strtok(NULL, " \t")) == NULL) {
-	    fileuser = pwd->pw_name;
+    while (byhost || local) {
+	if (local && (!byhost ||
+		      ((amandahosts_line_t *)local->data)->lineno <
+		      ((amandahosts_line_t *)byhost->data)->lineno)) {
+	    ahl = local->data;
+	    local = local->next;
+	    if (!loopback && !g_str_equal(ahl->host, lhost))
+		continue;
+	} else {
+	    ahl = byhost->data;
+	    byhost = byhost->next;
 	}
 
-	hostmatch = (strcasecmp(filehost, host) == 0);
-	/*  ok if addr=127.0.0.1 and
-	 *  either localhost or localhost.domain is in .amandahost */
-	if (!hostmatch  &&
-	    (strcasecmp(filehost, "localhost")== 0 ||
-	     strcasecmp(filehost, "localhost.localdomain")== 0)) {
-#ifdef WORKING_IPV6
-	    if (SU_GET_FAMILY(addr) == (sa_family_t)AF_INET6)
-		inet_ntop(AF_INET6, &addr->sin6.sin6_addr,
-			  ipstr, sizeof(ipstr));
-	    else
-#endif
-		inet_ntop(AF_INET, &addr->sin.sin_addr,
-			  ipstr, sizeof(ipstr));
-	    if (g_str_equal(ipstr, "127.0.0.1") ||
-		g_str_equal(ipstr, "::1"))
-		hostmatch = 1;
-	}
+	fileuser = ahl->user? ahl->user : pwd->pw_name;
 	usermatch = (strcasecmp(fileuser, remoteuser) == 0);
-	auth_debug(9, _("bsd: comparing \"%s\" with\n"), filehost);
-	auth_debug(9, _("bsd:           \"%s\" (%s)\n"), host,
-		       hostmatch ? _("match") : _("no match"));
+	auth_debug(9, _("bsd: line %u: \"%s\" matches \"%s\"\n"),
+		       ahl->lineno, ahl->host, host);
 	auth_debug(9, _("bsd:       and \"%s\" with\n"), fileuser);
 	auth_debug(9, _("bsd:           \"%s\" (%s)\n"), remoteuser,
 		       usermatch ? _("match") : _("no match"));
-	/* compare */
-	if (!hostmatch || !usermatch) {
-	    amfree(line);
+	if (!usermatch)
 	    continue;
-	}
 
-        if (!service) {
+	if (!service) {
 	    /* success */
-	    amfree(line);
 	    found = 1;
 	    break;
 	}
 
-	/* get the services.  If no service specified, then use
+	/* If no service is specified, then allow
 	 * noop/selfcheck/sendsize/sendbackup
-         */
-	aservice = strtok(NULL, " \t,");
-	if (!aservice) {
-	    if (g_str_equal(service, "noop") ||
-	       g_str_equal(service, "selfcheck") ||
-	       g_str_equal(service, "sendsize") ||
-	       g_str_equal(service, "sendbackup")) {
+	 */
+	if (!ahl->services) {
+	    if (is_amdump_service(service)) {
 		/* success */
 		found = 1;
-		amfree(line);
-		break;
-	    }
-	    else {
-		amfree(line);
-		break;
 	    }
+	    break;
 	}
 
-	do {
-	    if (g_str_equal(aservice, service)) {
-		found = 1;
-		break;
-	    }
-	    if (g_str_equal(aservice, "amdump") && 
-	       (g_str_equal(service, "noop") ||
-		g_str_equal(service, "selfcheck") ||
-		g_str_equal(service, "sendsize") ||
-		g_str_equal(service, "sendbackup"))) {
+	for (aservice = ahl->services; *aservice != NULL; aservice++) {
+	    if (g_str_equal(*aservice, service) ||
+		(g_str_equal(*aservice, "amdump") &&
+		 is_amdump_service(service))) {
+		/* success */
 		found = 1;
 		break;
 	    }
-	} while((aservice = strtok(NULL, " \t,")) != NULL);
-
-	if (aservice && g_str_equal(aservice, service)) {
-	    /* success */
-	    found = 1;
-	    amfree(line);
-	    break;
 	}
-	amfree(line);
+	if (found)
+	    break;
     }
+    g_free(lhost);
+
     if (! found) {
 	if (g_str_equal(service, "amindexd") ||
 	    g_str_equal(service, "amidxtaped")) {
 	    result = g_strdup_printf(_("Please add the line \"%s %s amindexd amidxtaped\" to %s on the server"), host, remoteuser, ptmp);
 	} else if (g_str_equal(service, "amdump") ||
-		   g_str_equal(service, "noop") ||
-		   g_str_equal(service, "selfcheck") ||
-		   g_str_equal(service, "sendsize") ||
-		   g_str_equal(service, "sendbackup")) {
+		   is_amdump_service(service)) {
 	    result = g_strdup_printf(_("Please add the line \"%s %s amdump\" to %s on the client"), host, remoteuser, ptmp);
 	} else {
 	    result = g_strdup_printf(_("%s: invalid service %s"), ptmp, service);
@@ -2354,7 +2849,6 @@ check_security(
     char *		s;
     char *		fp;
     int			ch;
-    char		hostname[NI_MAXHOST];
     in_port_t		port;
     int			result;
 
@@ -2368,8 +2862,7 @@ check_security(
     *errstr = NULL;
 
     /* what host is making the request? */
-    if ((result = getnameinfo((struct sockaddr *)addr, SS_LEN(addr),
-			      hostname, NI_MAXHOST, NULL, 0, 0)) != 0) {
+    if ((result = resolver_name_info(addr, &remotehost)) != 0) {
 	dbprintf(_("getnameinfo failed: %s\n"),
 		  gai_strerror(result));
 	*errstr = g_strjoin(NULL, "[", "addr ", str_sockaddr(addr), ": ",
@@ -2377,8 +2870,7 @@ check_security(
 			    "]", NULL);
 	return 0;
     }
-    remotehost = g_strdup(hostname);
-    if( check_name_give_sockaddr(hostname,
+    if( check_name_give_sockaddr(remotehost,
 				 (struct sockaddr *)addr, errstr) < 0) {
 	amfree(remotehost);
 	return 0;
@@ -2600,7 +3092,7 @@ check_name_give_sockaddr(
     struct addrinfo *res = NULL, *res1;
     char *canonname;
 
-    result = resolve_hostname(hostname, 0, &res, &canonname);
+    result = resolver_resolve(hostname, 0, &res, &canonname);
     if (result != 0) {
 	dbprintf(_("check_name_give_sockaddr: resolve_hostname('%s'): %s\n"), hostname, gai_strerror(result));
         g_free(*errstr);
@@ -2627,7 +3119,7 @@ check_name_give_sockaddr(
 
     for(res1=res; res1 != NULL; res1 = res1->ai_next) {
 	if (cmp_sockaddr((sockaddr_union *)res1->ai_addr, (sockaddr_union *)addr, 1) == 0) {
-	    freeaddrinfo(res);
+	    resolver_free_addrinfo(res);
 	    amfree(canonname);
 	    return 0;
 	}
@@ -2639,7 +3131,7 @@ check_name_give_sockaddr(
 			   *errstr = g_strdup_printf("%s doesn't resolve to %s",
                                                      hostname, str_sockaddr((sockaddr_union *)addr));
 error:
-    if (res) freeaddrinfo(res);
+    if (res) resolver_free_addrinfo(res);
     amfree(canonname);
     return -1;
 }
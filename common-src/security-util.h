@@ -129,6 +129,8 @@ struct sec_handle {
     struct udp_handle *	udp;
     void		(*accept_fn)(security_handle_t *, pkt_t *);
     int			(*recv_security_ok)(struct sec_handle *, pkt_t *);
+    char *		(*conf_fn)(char *, void *);	/* for a connect while */
+    void *		datap;				/* the host is looked up */
 };
 
 /*
@@ -164,6 +166,17 @@ typedef struct udp_handle {
     event_handle_t *ev_read;	/* read event handle from dgram */
     int refcnt;			/* number of handles blocked for reading */
     struct sec_handle *bh_first, *bh_last;
+    GHashTable *bh_hash;	/* proto_handle -> GSList of those handles */
+    /* datagrams received together, and how many have been handled */
+    dgram_t *in;
+    sockaddr_union *in_peer;
+    int in_count, in_next;
+    event_handle_t *ev_pending;	/* handles the rest of them, once there is
+				 * a handle to read them again */
+    /* while handling them, datagrams to send together afterward; the
+     * cookie of each is the sec_handle that sent it */
+    gboolean in_batch;
+    GArray *out;		/* of dgram_out_t */
     void (*accept_fn)(security_handle_t *, pkt_t *);
     int (*recv_security_ok)(struct sec_handle *, pkt_t *);
     char *(*prefix_packet)(void *, pkt_t *);
@@ -180,6 +193,7 @@ typedef struct udp_handle {
 	assert((udp)->ev_read == NULL);					\
 	(udp)->ev_read = event_register((event_id_t)(udp)->dgram.socket,\
 	    EV_READFD, netfd_read_callback, (udp));			\
+	udp_schedule_pending(udp);					\
     }									\
     assert((udp)->refcnt > 0);						\
 } while (0)
@@ -218,6 +232,7 @@ void	stream_recvpkt_timeout(void *);
 void	stream_recvpkt_cancel(void *);
 
 int	tcpm_stream_write(void *, const void *, size_t);
+ssize_t	tcpm_stream_write_from_fd(void *, int, size_t);
 void	tcpm_stream_read(void *, void (*)(void *, void *, ssize_t), void *);
 ssize_t	tcpm_stream_read_sync(void *, void **);
 void	tcpm_stream_read_cancel(void *);
@@ -247,11 +262,14 @@ void	udp_recvpkt(void *, void (*)(void *, pkt_t *, security_status_t),
 void	udp_recvpkt_cancel(void *);
 void	udp_recvpkt_callback(void *);
 void	udp_recvpkt_timeout(void *);
+void	udp_removehandle(struct sec_handle *);
 int	udp_inithandle(udp_handle_t *, struct sec_handle *, char *hostname,
 		       sockaddr_union *, in_port_t, char *, int);
 void	udp_netfd_read_callback(void *);
+void	udp_schedule_pending(udp_handle_t *);
 
 struct tcp_conn *sec_tcp_conn_get(const char *, int);
+void	sec_tcp_conn_reindex(struct tcp_conn *, const char *);
 void	sec_tcp_conn_put(struct tcp_conn *);
 void	sec_tcp_conn_read(struct tcp_conn *);
 void	parse_pkt(pkt_t *, const void *, size_t);
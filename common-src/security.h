@@ -200,6 +200,13 @@ typedef struct security_driver {
 
     int (*data_encrypt)(void *, void *, ssize_t, void **, ssize_t *);
     int (*data_decrypt)(void *, void *, ssize_t, void **, ssize_t *);
+
+    /*
+     * Move data from a file descriptor to a stream without passing it
+     * through a user buffer.  Optional; NULL if the driver must see the
+     * data to send it.
+     */
+    ssize_t (*stream_write_from_fd)(void *, int, size_t);
 } security_driver_t;
 
 /* Given a security type ("KRB4", "BSD", "SSH", etc), returns a pointer to that
@@ -420,6 +427,19 @@ void security_stream_close(security_stream_t *);
 #define	security_stream_write(stream, buf, size)	\
     (*(stream)->driver->stream_write)(stream, buf, size)
 
+/* ssize_t security_stream_write_from_fd(security_stream_t *, int fd, size_t max);
+ *
+ * Sends the data that is ready to be read on fd, up to max bytes, to the
+ * security stream, letting the kernel move it where it can.  fd must be a
+ * pipe that only the caller reads.  Returns the number of bytes sent, 0 at
+ * the end of fd, or negative on error.  Only available when
+ * security_stream_can_write_from_fd() is true.
+ */
+#define	security_stream_can_write_from_fd(stream)	\
+    ((stream)->driver->stream_write_from_fd != NULL)
+#define	security_stream_write_from_fd(stream, fd, max)	\
+    (*(stream)->driver->stream_write_from_fd)(stream, fd, max)
+
 /* void security_stream_read(
  *  security_stream_t *stream,
  *  void (*fn)(void *, void *, size_t),
@@ -88,6 +88,7 @@ const security_driver_t ssh_security_driver = {
     tcpm_stream_read_cancel,
     tcpm_close_connection,
     NULL,
+    NULL,
     NULL
 };
 
@@ -248,6 +249,7 @@ ssh_accept(
     result = getnameinfo((struct sockaddr *)&addr, SS_LEN(&addr),
 		 rc->hostname, sizeof(rc->hostname), NULL, 0, 0);
     if (result != 0) {
+	rc->hostname[0] = '\0';
 	g_warning("Could not get hostname for SSH client %s: %s", ssh_connection,
 		gai_strerror(result));
 	goto done;
@@ -265,6 +267,9 @@ ssh_accept(
 done:
     g_free(ssh_connection);
 
+    /* rc was indexed under "" by sec_tcp_conn_get */
+    sec_tcp_conn_reindex(rc, "");
+
     rc->read = in;
     rc->write = out;
     rc->accept_fn = fn;
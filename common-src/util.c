@@ -1620,6 +1620,9 @@ debug_executing(
 
     g_debug("Executing: %s\n", cmdline);
     g_free(cmdline);
+
+    /* the caller may exec without forking */
+    dbflush();
 }
 
 char *
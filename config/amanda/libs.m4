@@ -64,6 +64,27 @@ AC_DEFUN([AMANDA_CHECK_HMAC], [
     fi
 ])
 
+# SYNOPSIS
+#
+#   AMANDA_CHECK_ZLIB
+#
+# OVERVIEW
+#
+#   Check for zlib, which is used to uncompress gzip'd dumps during recovery,
+#   and to compress and uncompress the index files, without running gzip.  If
+#   found, HAVE_ZLIB is defined and -lz is added to LIBS.
+#
+AC_DEFUN([AMANDA_CHECK_ZLIB], [
+    HAVE_ZLIB=yes
+    AC_CHECK_HEADERS([zlib.h], [], [HAVE_ZLIB=no])
+    if test x"$HAVE_ZLIB" = x"yes"; then
+	AC_CHECK_LIB([z], [inflateInit2_], [], [HAVE_ZLIB=no])
+    fi
+    if test x"$HAVE_ZLIB" = x"yes"; then
+	AC_DEFINE([HAVE_ZLIB], 1, [Define if zlib is available.])
+    fi
+])
+
 # SYNOPSIS
 #
 #   AMANDA_CHECK_NET_LIBS
@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94085, USA, or: http://www.zmanda.com
+ */
+
+/* Measure how long small S3 requests take when made one at a time, and when
+ * made concurrently over pooled connections (see s3_use_connection_pool).
+ *
+ * Unless -H is given, the requests go to a minimal S3 emulator run in this
+ * process, which answers every request after a delay given with -d, to stand
+ * in for the round trip to a distant service.  The emulator does not check
+ * signatures.  It counts the connections made to it, to show how many were
+ * reused.
+ */
+
+#include "amanda.h"
+#include "util.h"
+#include "glib-util.h"
+#include "full-write.h"
+#include "sockaddr-util.h"
+#include "s3.h"
+
+#include <getopt.h>
+
+static int delay_ms = 50;
+
+static int nb_connections = 0;
+G_LOCK_DEFINE_STATIC(nb_connections);
+
+static void
+usage(void)
+{
+    g_fprintf(stderr,
+"USAGE: s3-bench [-n requests] [-c concurrent] [-d delay-ms] [-H host:port]\n"
+"  Time small S3 requests made one at a time and made concurrently.\n"
+"  Without -H, they go to an emulator in this process which delays each\n"
+"  response by delay-ms milliseconds (default 50).\n");
+
+    exit(EXIT_FAILURE);
+}
+
+/*
+ * The emulator
+ */
+
+/* Write all of BUF, or fail */
+static gboolean
+emulator_write(int fd, const char *buf, size_t len)
+{
+    return full_write(fd, buf, len) == len;
+}
+
+/* Answer the requests on one connection until the client closes it */
+static gpointer
+emulator_connection_thread(gpointer data)
+{
+    int fd = GPOINTER_TO_INT(data);
+    char buf[65536];
+    size_t len = 0;
+    ssize_t n;
+    char *end, *line, *p;
+    guint64 body_len, skip;
+    char *response;
+    static const char *list_body =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<ListBucketResult><IsTruncated>false</IsTruncated></ListBucketResult>\n";
+
+    while (1) {
+	/* read the request line and headers */
+	buf[len] = '\0';
+	while (!(end = strstr(buf, "\r\n\r\n"))) {
+	    if (len >= sizeof(buf) - 1)
+		goto done;
+	    n = read(fd, buf + len, sizeof(buf) - 1 - len);
+	    if (n <= 0)
+		goto done;
+	    len += n;
+	    buf[len] = '\0';
+	}
+	end += 4;
+
+	body_len = 0;
+	for (line = strstr(buf, "\r\n"); line && line < end; line = strstr(line + 2, "\r\n")) {
+	    if (g_ascii_strncasecmp(line + 2, "Content-Length:", 15) == 0)
+		body_len = g_ascii_strtoull(line + 2 + 15, NULL, 10);
+	}
+
+	if (g_str_has_prefix(buf, "GET ")) {
+	    response = g_strdup_printf("HTTP/1.1 200 OK\r\n"
+				       "Content-Type: application/xml\r\n"
+				       "Content-Length: %zu\r\n\r\n%s",
+				       strlen(list_body), list_body);
+	} else if (g_str_has_prefix(buf, "DELETE ")) {
+	    response = g_strdup("HTTP/1.1 204 No Content\r\n\r\n");
+	} else {
+	    response = g_strdup("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+	}
+
+	/* drop this request, and its body, from the buffer */
+	p = end;
+	skip = MIN(body_len, (guint64)(buf + len - p));
+	p += skip;
+	body_len -= skip;
+	len -= p - buf;
+	memmove(buf, p, len);
+	while (body_len > 0) {
+	    n = read(fd, buf, MIN(body_len, sizeof(buf) - 1));
+	    if (n <= 0) {
+		g_free(response);
+		goto done;
+	    }
+	    body_len -= n;
+	}
+
+	if (delay_ms)
+	    g_usleep(delay_ms * 1000);
+
+	if (!emulator_write(fd, response, strlen(response))) {
+	    g_free(response);
+	    goto done;
+	}
+	g_free(response);
+    }
+
+done:
+    close(fd);
+    return NULL;
+}
+
+static gpointer
+emulator_accept_thread(gpointer data)
+{
+    int listen_fd = GPOINTER_TO_INT(data);
+    int fd;
+
+    while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+	G_LOCK(nb_connections);
+	nb_connections++;
+	G_UNLOCK(nb_connections);
+	g_thread_create(emulator_connection_thread, GINT_TO_POINTER(fd),
+			FALSE, NULL);
+    }
+
+    return NULL;
+}
+
+/* Start the emulator, returning the "host:port" to reach it at */
+static char *
+start_emulator(void)
+{
+    int fd;
+    sockaddr_union addr;
+    socklen_t_equiv len;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+	g_critical("socket: %s", strerror(errno));
+
+    SU_INIT(&addr, AF_INET);
+    addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    SU_SET_PORT(&addr, 0);
+    if (bind(fd, (struct sockaddr *)&addr, SS_LEN(&addr)) < 0)
+	g_critical("bind: %s", strerror(errno));
+    if (listen(fd, 64) < 0)
+	g_critical("listen: %s", strerror(errno));
+
+    len = sizeof(addr);
+    if (getsockname(fd, (struct sockaddr *)&addr, &len) < 0)
+	g_critical("getsockname: %s", strerror(errno));
+
+    g_thread_create(emulator_accept_thread, GINT_TO_POINTER(fd), FALSE, NULL);
+
+    return g_strdup_printf("127.0.0.1:%d", SU_GET_PORT(&addr));
+}
+
+/*
+ * The benchmark
+ */
+
+static int
+get_nb_connections(void)
+{
+    int n;
+
+    G_LOCK(nb_connections);
+    n = nb_connections;
+    G_UNLOCK(nb_connections);
+
+    return n;
+}
+
+static S3Handle *
+open_handle(const char *host)
+{
+    S3Handle *hdl;
+
+    hdl = s3_open("bench-access-key", "bench-secret-key", host, NULL, FALSE,
+		  NULL, NULL, NULL, NULL, NULL);
+    if (!hdl)
+	g_critical("could not create an S3Handle");
+    s3_use_ssl(hdl, FALSE);
+
+    return hdl;
+}
+
+static void
+report(const char *name, int nb_requests, GTimer *timer, int connections)
+{
+    gdouble elapsed = g_timer_elapsed(timer, NULL);
+
+    g_printf("%-34s %6d requests %8.3f s %8.2f ms/request %8.1f requests/s",
+	     name, nb_requests, elapsed, elapsed * 1000 / nb_requests,
+	     nb_requests / elapsed);
+    if (connections >= 0)
+	g_printf(" %4d new connections", connections);
+    g_printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    int nb_requests = 200;
+    guint concurrent = 16;
+    char *host = NULL;
+    gboolean emulated;
+    S3Handle *serial, *pooled, *pooled2;
+    const char **keys;
+    char *name;
+    GTimer *timer;
+    int i, c, connections;
+
+    glib_init();
+    set_pname("s3-bench");
+
+    while ((c = getopt(argc, argv, "n:c:d:H:")) != -1) {
+	switch (c) {
+	case 'n': nb_requests = atoi(optarg); break;
+	case 'c': concurrent = atoi(optarg); break;
+	case 'd': delay_ms = atoi(optarg); break;
+	case 'H': host = g_strdup(optarg); break;
+	default: usage();
+	}
+    }
+    if (optind != argc || nb_requests <= 0 || concurrent == 0)
+	usage();
+
+    if (!s3_init())
+	g_critical("could not initialize S3 operations");
+
+    emulated = (host == NULL);
+    if (emulated)
+	host = start_emulator();
+
+    keys = g_new0(const char *, nb_requests + 1);
+    for (i = 0; i < nb_requests; i++)
+	keys[i] = g_strdup_printf("bench-%08d", i);
+
+    g_printf("S3 service at %s%s; %d requests%s\n", host,
+	     emulated? "" : " (not emulated)", nb_requests,
+	     emulated? "" : "; connection counts not available");
+    if (emulated)
+	g_printf("emulated round trip: %d ms\n", delay_ms);
+
+    timer = g_timer_new();
+
+    /* one request at a time, on the handle's own connection */
+    serial = open_handle(host);
+    connections = get_nb_connections();
+    g_timer_start(timer);
+    for (i = 0; i < nb_requests; i++) {
+	if (!s3_delete(serial, "bench", keys[i]))
+	    g_critical("DELETE failed: %s", s3_strerror(serial));
+    }
+    g_timer_stop(timer);
+    report("DELETE, one at a time", nb_requests, timer,
+	   emulated? get_nb_connections() - connections : -1);
+
+    /* concurrently, over pooled connections */
+    pooled = open_handle(host);
+    if (!s3_use_connection_pool(pooled, concurrent))
+	g_critical("could not create the connection pool");
+    connections = get_nb_connections();
+    g_timer_start(timer);
+    if (!s3_delete_keys(pooled, "bench", keys))
+	g_critical("DELETE failed: %s", s3_strerror(pooled));
+    g_timer_stop(timer);
+    name = g_strdup_printf("DELETE, %u at a time", concurrent);
+    report(name, nb_requests, timer,
+	   emulated? get_nb_connections() - connections : -1);
+    g_free(name);
+
+    /* again, from another handle: the pooled connections are reused */
+    pooled2 = open_handle(host);
+    if (!s3_use_connection_pool(pooled2, concurrent))
+	g_critical("could not create the connection pool");
+    connections = get_nb_connections();
+    g_timer_start(timer);
+    if (!s3_delete_keys(pooled2, "bench", keys))
+	g_critical("DELETE failed: %s", s3_strerror(pooled2));
+    g_timer_stop(timer);
+    name = g_strdup_printf("DELETE, %u at a time, new handle", concurrent);
+    report(name, nb_requests, timer,
+	   emulated? get_nb_connections() - connections : -1);
+    g_free(name);
+
+    s3_free(serial);
+    s3_free(pooled);
+    s3_free(pooled2);
+    g_timer_destroy(timer);
+
+    return 0;
+}
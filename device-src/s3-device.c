@@ -66,6 +66,15 @@ static GType	s3_device_get_type	(void);
  */
 typedef struct _S3MetadataFile S3MetadataFile;
 
+/* What the volume manifest records about one file */
+typedef struct _S3ManifestFile S3ManifestFile;
+struct _S3ManifestFile {
+    int      file;
+    gboolean done;	/* finish_file was called; blocks and bytes are final */
+    guint64  blocks;
+    guint64  bytes;	/* including the filestart header */
+};
+
 typedef struct _S3_by_thread S3_by_thread;
 struct _S3_by_thread {
     S3Handle * volatile          s3;
@@ -130,6 +139,7 @@ struct _S3Device {
     int          nb_threads;
     int          nb_threads_backup;
     int          nb_threads_recovery;
+    guint64      concurrent_requests;
     GThreadPool *thread_pool_delete;
     GThreadPool *thread_pool_write;
     GThreadPool *thread_pool_read;
@@ -137,6 +147,13 @@ struct _S3Device {
     GMutex      *thread_idle_mutex;
     int          next_block_to_read;
     GSList      *keys;
+    gboolean     use_s3_multi_delete;
+
+    /* The files on the volume, as recorded in its manifest object, or NULL
+     * if the volume has no manifest (it was written before manifests
+     * existed) or it could not be read; the keys must then be listed. */
+    GArray      *manifest;
+    guint64      file_bytes;	/* bytes written to the current file */
 };
 
 /*
@@ -162,11 +179,15 @@ struct _S3DeviceClass {
 #define S3_DEVICE_MIN_BLOCK_SIZE 1024
 #define S3_DEVICE_MAX_BLOCK_SIZE (3*1024*1024*1024ULL)
 #define S3_DEVICE_DEFAULT_BLOCK_SIZE (10*1024*1024)
+#define S3_DEVICE_MAX_CONCURRENT_REQUESTS 1000
 #define EOM_EARLY_WARNING_ZONE_BLOCKS 4
 
 /* This goes in lieu of file number for metadata. */
 #define SPECIAL_INFIX "special-"
 
+/* first line of the manifest object */
+#define MANIFEST_MAGIC "AMANDA S3 MANIFEST 1"
+
 /* pointer to the class of our parent */
 static DeviceClass *parent_class = NULL;
 
@@ -226,6 +247,10 @@ static DevicePropertyBase device_property_nb_threads_backup;
 static DevicePropertyBase device_property_nb_threads_recovery;
 #define PROPERTY_NB_THREADS_RECOVERY (device_property_nb_threads_recovery.ID)
 
+/* Independent requests to make at once over pooled connections */
+static DevicePropertyBase device_property_s3_concurrent_requests;
+#define PROPERTY_S3_CONCURRENT_REQUESTS (device_property_s3_concurrent_requests.ID)
+
 /*
  * prototypes
  */
@@ -303,6 +328,32 @@ delete_file(S3Device *self,
 static gboolean
 delete_all_files(S3Device *self);
 
+/* Read the volume manifest into self->manifest.  A volume without a
+ * manifest is not an error; self->manifest is left NULL.
+ *
+ * @param self: the S3Device object
+ */
+static void
+load_manifest(S3Device *self);
+
+/* Write self->manifest to the volume.  If that fails, the manifest object
+ * is removed so that it can never describe the volume wrongly.
+ *
+ * @param self: the S3Device object
+ */
+static void
+write_manifest(S3Device *self);
+
+/* Find a file in self->manifest.
+ *
+ * @param self: the S3Device object
+ * @param file: the file number
+ * @returns: the entry, or NULL if the file is not recorded
+ */
+static S3ManifestFile *
+manifest_find(S3Device *self,
+              int file);
+
 /* Set up self->s3t as best as possible.
  *
  * The return value is TRUE iff self->s3t is useable.
@@ -383,6 +434,10 @@ static gboolean s3_device_set_nb_threads_recovery(Device *self,
     DevicePropertyBase *base, GValue *val,
     PropertySurety surety, PropertySource source);
 
+static gboolean s3_device_set_concurrent_requests_fn(Device *self,
+    DevicePropertyBase *base, GValue *val,
+    PropertySurety surety, PropertySource source);
+
 static gboolean s3_device_set_max_volume_usage_fn(Device *p_self,
     DevicePropertyBase *base, GValue *val,
     PropertySurety surety, PropertySource source);
@@ -565,13 +620,22 @@ write_amanda_header(S3Device *self,
 
 static gboolean
 seek_to_end(S3Device *self) {
-    int last_file;
+    int last_file = 0;
+    guint i;
 
     Device *pself = DEVICE(self);
 
-    last_file = find_last_file(self);
-    if (last_file < 0)
-        return FALSE;
+    if (self->manifest) {
+        for (i = 0; i < self->manifest->len; i++) {
+            S3ManifestFile *mf = &g_array_index(self->manifest, S3ManifestFile, i);
+            if (mf->file > last_file)
+                last_file = mf->file;
+        }
+    } else {
+        last_file = find_last_file(self);
+        if (last_file < 0)
+            return FALSE;
+    }
 
     pself->file = last_file;
 
@@ -699,18 +763,32 @@ delete_file(S3Device *self,
     int thread = -1;
 
     gboolean result;
-    GSList *keys;
+    GSList *keys = NULL;
     guint64 total_size = 0;
-    char *my_prefix = g_strdup_printf("%sf%08x-", self->prefix, file);
+    char *my_prefix;
     Device *d_self = DEVICE(self);
-
-    result = s3_list_keys(self->s3t[0].s3, self->bucket, my_prefix, NULL, &keys,
-			  &total_size);
-    if (!result) {
-	device_set_error(d_self,
-	    g_strdup_printf(_("While listing S3 keys: %s"), s3_strerror(self->s3t[0].s3)),
-	    DEVICE_STATUS_DEVICE_ERROR | DEVICE_STATUS_VOLUME_ERROR);
-        return FALSE;
+    S3ManifestFile *mf = manifest_find(self, file);
+    guint64 block;
+
+    if (mf && mf->done) {
+        /* the manifest says which keys the file has; no need to list them */
+        for (block = mf->blocks; block > 0; block--)
+            keys = g_slist_prepend(keys,
+                        file_and_block_to_key(self, file, block - 1));
+        keys = g_slist_prepend(keys,
+                        special_file_to_key(self, "filestart", file));
+        total_size = mf->bytes;
+    } else {
+        my_prefix = g_strdup_printf("%sf%08x-", self->prefix, file);
+        result = s3_list_keys(self->s3t[0].s3, self->bucket, my_prefix, NULL,
+                              &keys, &total_size);
+        g_free(my_prefix);
+        if (!result) {
+	    device_set_error(d_self,
+	        g_strdup_printf(_("While listing S3 keys: %s"), s3_strerror(self->s3t[0].s3)),
+	        DEVICE_STATUS_DEVICE_ERROR | DEVICE_STATUS_VOLUME_ERROR);
+            return FALSE;
+        }
     }
 
     g_mutex_lock(self->thread_idle_mutex);
@@ -758,8 +836,65 @@ s3_thread_delete_block(
     S3Device *self = S3_DEVICE(pself);
     gboolean result = 1;
     char *filename;
+    const char *batch[S3_MULTI_DELETE_MAX_KEYS+1];
+    int n, i;
 
     g_mutex_lock(self->thread_idle_mutex);
+    while (result && self->keys && self->use_s3_multi_delete) {
+	/* take up to S3_MULTI_DELETE_MAX_KEYS keys for one request */
+	for (n = 0; n < S3_MULTI_DELETE_MAX_KEYS && self->keys; n++) {
+	    batch[n] = self->keys->data;
+	    self->keys = g_slist_delete_link(self->keys, self->keys);
+	}
+	batch[n] = NULL;
+	count += n;
+	if (count >= 1000) {
+	    g_debug("Deleting %s ...", batch[n-1]);
+	    count = 0;
+	}
+	g_mutex_unlock(self->thread_idle_mutex);
+	i = s3_multi_delete(s3t->s3, (const char *)self->bucket, batch);
+	if (i == 2) {
+	    /* delete them one at a time, here and from now on */
+	    g_debug("multi-object delete is not supported; deleting keys one at a time");
+	    g_mutex_lock(self->thread_idle_mutex);
+	    self->use_s3_multi_delete = FALSE;
+	    for (i = 0; i < n; i++)
+		self->keys = g_slist_prepend(self->keys, (char *)batch[i]);
+	    continue;
+	} else if (i == 0) {
+	    result = FALSE;
+	    s3t->errflags = DEVICE_STATUS_DEVICE_ERROR | DEVICE_STATUS_VOLUME_ERROR;
+	    s3t->errmsg = g_strdup_printf(_("While deleting keys '%s' to '%s': %s"),
+					  batch[0], batch[n-1], s3_strerror(s3t->s3));
+	}
+	for (i = 0; i < n; i++)
+	    g_free((char *)batch[i]);
+	g_mutex_lock(self->thread_idle_mutex);
+    }
+    while (result && self->keys && self->concurrent_requests) {
+	/* s3_delete_keys has up to concurrent_requests of these going at once */
+	for (n = 0; n < S3_MULTI_DELETE_MAX_KEYS && self->keys; n++) {
+	    batch[n] = self->keys->data;
+	    self->keys = g_slist_delete_link(self->keys, self->keys);
+	}
+	batch[n] = NULL;
+	count += n;
+	if (count >= 1000) {
+	    g_debug("Deleting %s ...", batch[n-1]);
+	    count = 0;
+	}
+	g_mutex_unlock(self->thread_idle_mutex);
+	result = s3_delete_keys(s3t->s3, (const char *)self->bucket, batch);
+	if (!result) {
+	    s3t->errflags = DEVICE_STATUS_DEVICE_ERROR | DEVICE_STATUS_VOLUME_ERROR;
+	    s3t->errmsg = g_strdup_printf(_("While deleting keys '%s' to '%s': %s"),
+					  batch[0], batch[n-1], s3_strerror(s3t->s3));
+	}
+	for (i = 0; i < n; i++)
+	    g_free((char *)batch[i]);
+	g_mutex_lock(self->thread_idle_mutex);
+    }
     while (result && self->keys) {
 	filename = self->keys->data;
 	self->keys = g_slist_remove(self->keys, self->keys->data);
@@ -870,6 +1005,8 @@ delete_all_files(S3Device *self)
 	g_debug("Deleting all files on unlabelled volume");
     }
     reset_thread(self);
+    /* files in the manifest are deleted without listing their blocks */
+    load_manifest(self);
     for (file = 1; file <= last_file; file++) {
         if (!delete_file(self, file))
             /* delete_file already set our error message */
@@ -878,7 +1015,133 @@ delete_all_files(S3Device *self)
     }
     s3_wait_thread_delete(self);
 
-    return !device_in_error(self);
+    if (device_in_error(self))
+	return FALSE;
+
+    /* the manifest goes last, so that it is still there if we fail */
+    if (self->manifest) {
+	char *key = special_file_to_key(self, "manifest", -1);
+	if (!s3_delete(self->s3t[0].s3, self->bucket, key)) {
+	    device_set_error(pself,
+		g_strdup_printf(_("While deleting the volume manifest: %s"),
+				s3_strerror(self->s3t[0].s3)),
+		DEVICE_STATUS_DEVICE_ERROR | DEVICE_STATUS_VOLUME_ERROR);
+	    g_free(key);
+	    return FALSE;
+	}
+	g_free(key);
+	g_array_free(self->manifest, TRUE);
+	self->manifest = NULL;
+    }
+    self->volume_bytes = 0;
+
+    return TRUE;
+}
+
+static void
+load_manifest(S3Device *self)
+{
+    CurlBuffer buf = {NULL, 0, 0, S3_DEVICE_MAX_BLOCK_SIZE};
+    char *key;
+    char **lines = NULL, **line;
+    S3ManifestFile mf;
+    int done;
+
+    if (self->manifest) {
+	g_array_free(self->manifest, TRUE);
+	self->manifest = NULL;
+    }
+
+    key = special_file_to_key(self, "manifest", -1);
+    if (!s3_read(self->s3t[0].s3, self->bucket, key, S3_BUFFER_WRITE_FUNCS,
+		 &buf, NULL, NULL)) {
+	/* not fatal: without a manifest, the keys are listed instead */
+	g_debug("No S3 volume manifest: %s", s3_strerror(self->s3t[0].s3));
+	goto cleanup;
+    }
+
+    lines = g_strsplit(buf.buffer? buf.buffer : "", "\n", 0);
+    if (!lines[0] || !g_str_equal(lines[0], MANIFEST_MAGIC)) {
+	g_debug("Ignoring S3 volume manifest with an unknown format");
+	goto cleanup;
+    }
+
+    self->manifest = g_array_new(FALSE, FALSE, sizeof(S3ManifestFile));
+    for (line = lines + 1; *line; line++) {
+	if (**line == '\0')
+	    continue;
+	if (sscanf(*line, "%d %d %llu %llu", &mf.file, &done,
+		   (unsigned long long *)&mf.blocks,
+		   (unsigned long long *)&mf.bytes) != 4) {
+	    g_debug("Ignoring S3 volume manifest with a bad line '%s'", *line);
+	    g_array_free(self->manifest, TRUE);
+	    self->manifest = NULL;
+	    goto cleanup;
+	}
+	mf.done = (done != 0);
+	g_array_append_val(self->manifest, mf);
+    }
+
+cleanup:
+    g_strfreev(lines);
+    g_free(buf.buffer);
+    g_free(key);
+}
+
+static void
+write_manifest(S3Device *self)
+{
+    CurlBuffer buf = {NULL, 0, 0, 0};
+    GString *text;
+    char *key;
+    guint i;
+
+    if (!self->manifest)
+	return;
+
+    text = g_string_new(MANIFEST_MAGIC "\n");
+    for (i = 0; i < self->manifest->len; i++) {
+	S3ManifestFile *mf = &g_array_index(self->manifest, S3ManifestFile, i);
+	g_string_append_printf(text, "%d %d %llu %llu\n", mf->file,
+			       mf->done? 1 : 0,
+			       (unsigned long long)mf->blocks,
+			       (unsigned long long)mf->bytes);
+    }
+    buf.buffer = text->str;
+    buf.buffer_len = (guint)text->len;
+
+    key = special_file_to_key(self, "manifest", -1);
+    if (!s3_upload(self->s3t[0].s3, self->bucket, key, S3_BUFFER_READ_FUNCS,
+		   &buf, NULL, NULL)) {
+	/* a stale manifest would hide keys from delete_all_files; without
+	 * one, the keys are listed as before */
+	g_debug("While writing the S3 volume manifest: %s; removing it",
+		s3_strerror(self->s3t[0].s3));
+	if (!s3_delete(self->s3t[0].s3, self->bucket, key))
+	    g_warning("Could not remove the S3 volume manifest: %s",
+		      s3_strerror(self->s3t[0].s3));
+	g_array_free(self->manifest, TRUE);
+	self->manifest = NULL;
+    }
+    g_free(key);
+    g_string_free(text, TRUE);
+}
+
+static S3ManifestFile *
+manifest_find(S3Device *self,
+              int file)
+{
+    guint i;
+
+    if (!self->manifest)
+	return NULL;
+
+    for (i = 0; i < self->manifest->len; i++) {
+	S3ManifestFile *mf = &g_array_index(self->manifest, S3ManifestFile, i);
+	if (mf->file == file)
+	    return mf;
+    }
+    return NULL;
 }
 
 /*
@@ -937,6 +1200,9 @@ s3_device_register(void)
     device_property_fill_and_register(&device_property_nb_threads_recovery,
                                       G_TYPE_UINT64, "nb_threads_recovery",
        "Number of reader thread");
+    device_property_fill_and_register(&device_property_s3_concurrent_requests,
+                                      G_TYPE_UINT64, "s3_concurrent_requests",
+       "Number of independent requests to make at once over pooled connections");
 
     /* register the device itself */
     register_device(s3_device_factory, device_prefix_list);
@@ -982,11 +1248,15 @@ s3_device_init(S3Device * self)
     self->nb_threads = 1;
     self->nb_threads_backup = 1;
     self->nb_threads_recovery = 1;
+    self->concurrent_requests = 0;
     self->thread_pool_delete = NULL;
     self->thread_pool_write = NULL;
     self->thread_pool_read = NULL;
     self->thread_idle_cond = NULL;
     self->thread_idle_mutex = NULL;
+    self->use_s3_multi_delete = TRUE;
+    self->manifest = NULL;
+    self->file_bytes = 0;
 
     /* Register property values
      * Note: Some aren't added until s3_device_open_device()
@@ -1156,6 +1426,11 @@ s3_device_class_init(S3DeviceClass * c G_GNUC_UNUSED)
 	    device_simple_property_get_fn,
 	    s3_device_set_nb_threads_recovery);
 
+    device_class_register_property(device_class, PROPERTY_S3_CONCURRENT_REQUESTS,
+	    PROPERTY_ACCESS_GET_MASK | PROPERTY_ACCESS_SET_BEFORE_START,
+	    device_simple_property_get_fn,
+	    s3_device_set_concurrent_requests_fn);
+
     device_class_register_property(device_class, PROPERTY_COMPRESSION,
 	    PROPERTY_ACCESS_GET_MASK,
 	    device_simple_property_get_fn,
@@ -1459,6 +1734,40 @@ s3_device_set_nb_threads_recovery(Device *p_self,
     return device_simple_property_set_fn(p_self, base, val, surety, source);
 }
 
+static gboolean
+s3_device_set_concurrent_requests_fn(Device *p_self,
+    DevicePropertyBase *base, GValue *val,
+    PropertySurety surety, PropertySource source)
+{
+    S3Device *self = S3_DEVICE(p_self);
+    guint64 new_val;
+    int     thread;
+
+    new_val = g_value_get_uint64(val);
+    if (new_val > S3_DEVICE_MAX_CONCURRENT_REQUESTS) {
+	device_set_error(p_self,
+	    g_strdup_printf("Error setting S3-CONCURRENT-REQUESTS property to '%ju', it must be between 0 and %d",
+			    (uintmax_t)new_val, S3_DEVICE_MAX_CONCURRENT_REQUESTS),
+	    DEVICE_STATUS_DEVICE_ERROR);
+	return FALSE;
+    }
+
+    if (self->s3t) {
+	for (thread = 0; thread < self->nb_threads; thread++) {
+	    if (self->s3t[thread].s3 &&
+		!s3_use_connection_pool(self->s3t[thread].s3, (guint)new_val)) {
+		device_set_error(p_self,
+			g_strdup("Could not create the S3 connection pool"),
+			DEVICE_STATUS_DEVICE_ERROR);
+	        return FALSE;
+	    }
+	}
+    }
+    self->concurrent_requests = new_val;
+
+    return device_simple_property_set_fn(p_self, base, val, surety, source);
+}
+
 static gboolean
 s3_device_set_max_volume_usage_fn(Device *p_self,
     DevicePropertyBase *base, GValue *val,
@@ -1617,6 +1926,7 @@ static void s3_device_finalize(GObject * obj_self) {
     if(self->storage_class) g_free(self->storage_class);
     if(self->server_side_encryption) g_free(self->server_side_encryption);
     if(self->ca_info) g_free(self->ca_info);
+    if(self->manifest) g_array_free(self->manifest, TRUE);
 }
 
 static gboolean setup_handle(S3Device * self) {
@@ -1710,6 +2020,14 @@ static gboolean setup_handle(S3Device * self) {
 		DEVICE_STATUS_DEVICE_ERROR);
             return FALSE;
 	}
+
+	if (self->concurrent_requests &&
+	    !s3_use_connection_pool(self->s3t[thread].s3, (guint)self->concurrent_requests)) {
+	    device_set_error(d_self,
+		g_strdup("Could not create the S3 connection pool"),
+		DEVICE_STATUS_DEVICE_ERROR);
+            return FALSE;
+	}
     }
 
     return TRUE;
@@ -1757,6 +2075,10 @@ s3_device_read_label(Device *pself) {
     amfree(pself->volume_time);
     dumpfile_free(pself->volume_header);
     pself->volume_header = NULL;
+    if (self->manifest) {
+	g_array_free(self->manifest, TRUE);
+	self->manifest = NULL;
+    }
 
     if (device_in_error(self)) return pself->status;
 
@@ -1868,6 +2190,12 @@ s3_device_start (Device * pself, DeviceAccessMode mode,
                 return FALSE;
             }
 
+            /* and start an empty manifest */
+            if (self->manifest)
+                g_array_free(self->manifest, TRUE);
+            self->manifest = g_array_new(FALSE, FALSE, sizeof(S3ManifestFile));
+            write_manifest(self);
+
 	    g_free(pself->volume_label);
 	    pself->volume_label = g_strdup(label);
 	    g_free(pself->volume_time);
@@ -1881,6 +2209,15 @@ s3_device_start (Device * pself, DeviceAccessMode mode,
 	    if (pself->volume_label == NULL && s3_device_read_label(pself) != DEVICE_STATUS_SUCCESS) {
 		/* s3_device_read_label already set our error message */
 		return FALSE;
+	    }
+
+	    load_manifest(self);
+	    if (self->manifest) {
+		guint i;
+		self->volume_bytes = pself->header_block_size;
+		for (i = 0; i < self->manifest->len; i++)
+		    self->volume_bytes += g_array_index(self->manifest,
+						S3ManifestFile, i).bytes;
 	    } else {
                 result = s3_list_keys(self->s3t[0].s3, self->bucket, NULL, NULL, &keys, &total_size);
                 if(!result) {
@@ -1980,10 +2317,23 @@ s3_device_start_file (Device *pself, dumpfile_t *jobInfo) {
     }
 
     self->volume_bytes += header_size;
+    self->file_bytes = header_size;
     for (thread = 0; thread < self->nb_threads; thread++)  {
 	self->s3t[thread].idle = 1;
     }
 
+    /* record the file as started, so that it is listed if it is never
+     * finished */
+    if (self->manifest) {
+	S3ManifestFile mf;
+	mf.file = pself->file;
+	mf.done = FALSE;
+	mf.blocks = 0;
+	mf.bytes = header_size;
+	g_array_append_val(self->manifest, mf);
+	write_manifest(self);
+    }
+
     return TRUE;
 }
 
@@ -2063,6 +2413,7 @@ s3_device_write_block (Device * pself, guint size, gpointer data) {
 
     pself->block++;
     self->volume_bytes += size;
+    self->file_bytes += size;
     return TRUE;
 }
 
@@ -2095,6 +2446,7 @@ s3_thread_write_block(
 static gboolean
 s3_device_finish_file (Device * pself) {
     S3Device *self = S3_DEVICE(pself);
+    S3ManifestFile *mf;
 
     /* Check all threads are done */
     int idle_thread = 0;
@@ -2126,6 +2478,14 @@ s3_device_finish_file (Device * pself) {
     /* we're not in a file anymore */
     pself->in_file = FALSE;
 
+    mf = manifest_find(self, pself->file);
+    if (mf) {
+	mf->done = TRUE;
+	mf->blocks = pself->block;
+	mf->bytes = self->file_bytes;
+	write_manifest(self);
+    }
+
     return TRUE;
 }
 
@@ -2135,10 +2495,25 @@ s3_device_recycle_file(Device *pself, guint file) {
     if (device_in_error(self)) return FALSE;
 
     reset_thread(self);
+    if (!self->manifest)
+	load_manifest(self);
     delete_file(self, file);
     s3_wait_thread_delete(self);
-    return !device_in_error(self);
-    /* delete_file already set our error message if necessary */
+    if (device_in_error(self))
+	/* delete_file already set our error message if necessary */
+	return FALSE;
+
+    if (manifest_find(self, file)) {
+	guint i;
+	for (i = 0; i < self->manifest->len; i++) {
+	    if (g_array_index(self->manifest, S3ManifestFile, i).file == (int)file) {
+		g_array_remove_index(self->manifest, i);
+		break;
+	    }
+	}
+	write_manifest(self);
+    }
+    return TRUE;
 }
 
 static gboolean
@@ -149,6 +149,11 @@ struct S3Handle {
 
     CURL *curl;
 
+    /* for requests made concurrently (see s3_use_connection_pool) */
+    guint max_concurrent;
+    CURLM *multi;
+    CURL **multi_curl;		/* max_concurrent easy handles */
+
     gboolean verbose;
     gboolean use_ssl;
 
@@ -243,7 +248,8 @@ s3_error_name_from_code(s3_error_code_t s3_error_code);
 typedef enum {
     S3_RESULT_RETRY = -1,
     S3_RESULT_FAIL = 0,
-    S3_RESULT_OK = 1
+    S3_RESULT_OK = 1,
+    S3_RESULT_NOTIMPL = 2
 } s3_result_t;
 
 typedef struct result_handling {
@@ -272,6 +278,12 @@ lookup_result(const result_handling_t *result_handling,
 static regex_t etag_regex, error_name_regex, message_regex, subdomain_regex,
     location_con_regex, date_sync_regex;
 
+/*
+ * The connection pool shared by all handles which use one (see
+ * s3_use_connection_pool), and the locks libcurl takes to use it */
+static CURLSH *s3_share = NULL;
+static GStaticMutex s3_share_mutex[CURL_LOCK_DATA_LAST];
+
 
 /*
  * Utility functions
@@ -344,6 +356,7 @@ authenticate_request(S3Handle *hdl,
  * successfully.  This function fills in the relevant C{hdl->last*} members.
  *
  * @param hdl: The S3Handle object
+ * @param curl: the easy handle which made the request
  * @param body: the response body
  * @param body_len: the length of the response body
  * @param etag: The response's ETag header
@@ -355,6 +368,7 @@ authenticate_request(S3Handle *hdl,
  */
 static gboolean
 interpret_response(S3Handle *hdl,
+                   CURL *curl,
                    CURLcode curl_code,
                    char *curl_error_buffer,
                    gchar *body,
@@ -414,6 +428,71 @@ perform_request(S3Handle *hdl,
                 gpointer progress_data,
                 const result_handling_t *result_handling);
 
+/* Set the options common to every request on an easy handle: the URL,
+ * headers, and the callbacks which fill in C{int_writedata}.
+ *
+ * @param hdl: the S3Handle object
+ * @param curl: the easy handle
+ * @param url: the URL to request
+ * @param headers: the request headers
+ * @param curl_error_buffer: buffer of CURL_ERROR_SIZE bytes for curl's messages
+ * @param int_writedata: where the response goes
+ * @returns: CURLE_OK, or the error from curl_easy_setopt
+ */
+static CURLcode
+setup_curl(S3Handle *hdl,
+           CURL *curl,
+           const char *url,
+           struct curl_slist *headers,
+           char *curl_error_buffer,
+           S3InternalData *int_writedata);
+
+/* One of the requests made at once by perform_requests.  The caller fills
+ * in the request; perform_requests fills in the rest. */
+typedef struct {
+    /* the request, as for perform_request; no request body is sent */
+    const char *verb;
+    const char *bucket;
+    const char *key;
+    const char *subresource;
+    const char *query;
+
+    /* its result, and the details otherwise found in C{hdl->last*} */
+    s3_result_t result;
+    char *message;
+    guint response_code;
+    s3_error_code_t s3_error_code;
+    CURLcode curl_code;
+    guint num_retries;
+
+    /* private to perform_requests */
+    char *url;
+    struct curl_slist *headers;
+    S3InternalData int_writedata;
+    char curl_error_buffer[CURL_ERROR_SIZE];
+    gulong backoff;
+    GTimeVal retry_at;
+} S3ConcurrentRequest;
+
+/* Perform several independent requests, with up to C{hdl->max_concurrent}
+ * of them in progress at once, all from the calling thread.  Each is retried
+ * as perform_request would.  Response bodies are discarded.
+ *
+ * If any request fails, the details of the first failure are left in
+ * C{hdl->last*}.
+ *
+ * @param hdl: the S3Handle object
+ * @param requests: the requests
+ * @param nb_requests: the number of requests
+ * @param result_handling: instructions for handling the results of each
+ * @returns: S3_RESULT_OK if every request succeeded
+ */
+static s3_result_t
+perform_requests(S3Handle *hdl,
+                 S3ConcurrentRequest *requests,
+                 guint nb_requests,
+                 const result_handling_t *result_handling);
+
 /*
  * a CURLOPT_WRITEFUNCTION to save part of the response in memory and
  * call an external function if one was provided.
@@ -795,6 +874,7 @@ cleanup:
 
 static gboolean
 interpret_response(S3Handle *hdl,
+                   CURL *curl,
                    CURLcode curl_code,
                    char *curl_error_buffer,
                    gchar *body,
@@ -821,7 +901,7 @@ interpret_response(S3Handle *hdl,
     }
 
     /* CURL seems to think things were OK, so get its response code */
-    curl_easy_getinfo(hdl->curl, CURLINFO_RESPONSE_CODE, &response_code);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
     hdl->last_response_code = response_code;
 
     /* check ETag, if present */
@@ -1105,6 +1185,87 @@ curl_debug_message(CURL *curl G_GNUC_UNUSED,
     return 0;
 }
 
+static void
+s3_share_lock(CURL *curl G_GNUC_UNUSED,
+              curl_lock_data data,
+              curl_lock_access access G_GNUC_UNUSED,
+              void *userptr G_GNUC_UNUSED)
+{
+    g_static_mutex_lock(&s3_share_mutex[data]);
+}
+
+static void
+s3_share_unlock(CURL *curl G_GNUC_UNUSED,
+                curl_lock_data data,
+                void *userptr G_GNUC_UNUSED)
+{
+    g_static_mutex_unlock(&s3_share_mutex[data]);
+}
+
+static CURLcode
+setup_curl(S3Handle *hdl,
+           CURL *curl,
+           const char *url,
+           struct curl_slist *headers,
+           char *curl_error_buffer,
+           S3InternalData *int_writedata)
+{
+    CURLcode curl_code;
+
+    if (hdl->use_ssl && hdl->ca_info) {
+        if ((curl_code = curl_easy_setopt(curl, CURLOPT_CAINFO, hdl->ca_info)))
+            return curl_code;
+    }
+
+    if ((curl_code = curl_easy_setopt(curl, CURLOPT_SHARE,
+                                      hdl->max_concurrent? s3_share : NULL)))
+        return curl_code;
+    if ((curl_code = curl_easy_setopt(curl, CURLOPT_VERBOSE, hdl->verbose)))
+        return curl_code;
+    if (hdl->verbose) {
+        if ((curl_code = curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION,
+                          curl_debug_message)))
+            return curl_code;
+    }
+    if ((curl_code = curl_easy_setopt(curl, CURLOPT_ERRORBUFFER,
+                                      curl_error_buffer)))
+        return curl_code;
+    if ((curl_code = curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1)))
+        return curl_code;
+    if ((curl_code = curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1)))
+        return curl_code;
+    if ((curl_code = curl_easy_setopt(curl, CURLOPT_URL, url)))
+        return curl_code;
+    if ((curl_code = curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+                                      headers)))
+        return curl_code;
+    if ((curl_code = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, s3_internal_write_func)))
+        return curl_code;
+    if ((curl_code = curl_easy_setopt(curl, CURLOPT_WRITEDATA, int_writedata)))
+        return curl_code;
+    /* Note: we always have to set this apparently, for consistent "end of header" detection */
+    if ((curl_code = curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, s3_internal_header_func)))
+        return curl_code;
+    /* Note: if set, CURLOPT_HEADERDATA seems to also be used for CURLOPT_WRITEDATA ? */
+    if ((curl_code = curl_easy_setopt(curl, CURLOPT_HEADERDATA, int_writedata)))
+        return curl_code;
+
+/* CURLOPT_MAX_{RECV,SEND}_SPEED_LARGE added in 7.15.5 */
+#if LIBCURL_VERSION_NUM >= 0x070f05
+    if (s3_curl_throttling_compat()) {
+        if (hdl->max_send_speed)
+            if ((curl_code = curl_easy_setopt(curl, CURLOPT_MAX_SEND_SPEED_LARGE, (curl_off_t)hdl->max_send_speed)))
+                return curl_code;
+
+        if (hdl->max_recv_speed)
+            if ((curl_code = curl_easy_setopt(curl, CURLOPT_MAX_RECV_SPEED_LARGE, (curl_off_t)hdl->max_recv_speed)))
+                return curl_code;
+    }
+#endif
+
+    return CURLE_OK;
+}
+
 static s3_result_t
 perform_request(S3Handle *hdl,
                 const char *verb,
@@ -1207,40 +1368,13 @@ perform_request(S3Handle *hdl,
         /* set up the request */
         headers = authenticate_request(hdl, verb, bucket, key, subresource,
             md5_hash_b64);
-
-        if (hdl->use_ssl && hdl->ca_info) {
-            if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_CAINFO, hdl->ca_info)))
-                goto curl_error;
+        if (curlopt_post) {
+            /* curl would add a form Content-Type, which is not signed */
+            headers = curl_slist_append(headers, "Content-Type:");
         }
 
-        if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_VERBOSE, hdl->verbose)))
-            goto curl_error;
-        if (hdl->verbose) {
-            if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_DEBUGFUNCTION,
-                              curl_debug_message)))
-                goto curl_error;
-        }
-        if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_ERRORBUFFER,
-                                          curl_error_buffer)))
-            goto curl_error;
-        if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_NOPROGRESS, 1)))
-            goto curl_error;
-        if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_FOLLOWLOCATION, 1)))
-            goto curl_error;
-        if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_URL, url)))
-            goto curl_error;
-        if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_HTTPHEADER,
-                                          headers)))
-            goto curl_error;
-        if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_WRITEFUNCTION, s3_internal_write_func)))
-            goto curl_error;
-        if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_WRITEDATA, &int_writedata)))
-            goto curl_error;
-        /* Note: we always have to set this apparently, for consistent "end of header" detection */
-        if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_HEADERFUNCTION, s3_internal_header_func)))
-            goto curl_error;
-        /* Note: if set, CURLOPT_HEADERDATA seems to also be used for CURLOPT_WRITEDATA ? */
-        if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_HEADERDATA, &int_writedata)))
+        if ((curl_code = setup_curl(hdl, hdl->curl, url, headers,
+                                    curl_error_buffer, &int_writedata)))
             goto curl_error;
         if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_PROGRESSFUNCTION, progress_func)))
             goto curl_error;
@@ -1255,18 +1389,6 @@ perform_request(S3Handle *hdl,
         if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_INFILESIZE, (long)request_body_size)))
             goto curl_error;
 #endif
-/* CURLOPT_MAX_{RECV,SEND}_SPEED_LARGE added in 7.15.5 */
-#if LIBCURL_VERSION_NUM >= 0x070f05
-	if (s3_curl_throttling_compat()) {
-	    if (hdl->max_send_speed)
-		if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_MAX_SEND_SPEED_LARGE, (curl_off_t)hdl->max_send_speed)))
-		    goto curl_error;
-
-	    if (hdl->max_recv_speed)
-		if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_MAX_RECV_SPEED_LARGE, (curl_off_t)hdl->max_recv_speed)))
-		    goto curl_error;
-	}
-#endif
 
         if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_HTTPGET, curlopt_httpget)))
             goto curl_error;
@@ -1274,6 +1396,19 @@ perform_request(S3Handle *hdl,
             goto curl_error;
         if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_POST, curlopt_post)))
             goto curl_error;
+        if (curlopt_post) {
+            /* the body comes from read_func, not from CURLOPT_POSTFIELDS */
+            if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_POSTFIELDS, NULL)))
+                goto curl_error;
+/* CURLOPT_POSTFIELDSIZE_LARGE added in 7.11.1 */
+#if LIBCURL_VERSION_NUM >= 0x070b01
+            if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)request_body_size)))
+                goto curl_error;
+#else
+            if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_POSTFIELDSIZE, (long)request_body_size)))
+                goto curl_error;
+#endif
+        }
         if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_NOBODY, curlopt_nobody)))
             goto curl_error;
         if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_CUSTOMREQUEST,
@@ -1281,7 +1416,7 @@ perform_request(S3Handle *hdl,
             goto curl_error;
 
 
-        if (curlopt_upload) {
+        if (curlopt_upload || curlopt_post) {
             if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_READFUNCTION, read_func)))
                 goto curl_error;
             if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_READDATA, read_data)))
@@ -1302,7 +1437,7 @@ perform_request(S3Handle *hdl,
 
         /* interpret the response into hdl->last* */
     curl_error: /* (label for short-circuiting the curl_easy_perform call) */
-        should_retry = interpret_response(hdl, curl_code, curl_error_buffer,
+        should_retry = interpret_response(hdl, hdl->curl, curl_code, curl_error_buffer,
             int_writedata.resp_buf.buffer, int_writedata.resp_buf.buffer_pos, int_writedata.etag, md5_hash_hex);
 
         /* and, unless we know we need to retry, see what we're to do now */
@@ -1350,6 +1485,325 @@ cleanup:
     return result;
 }
 
+/* Microseconds from now until TV; negative if TV has passed */
+static gint64
+usec_until(GTimeVal *tv)
+{
+    GTimeVal now;
+
+    g_get_current_time(&now);
+    return ((gint64)tv->tv_sec - now.tv_sec) * G_USEC_PER_SEC +
+           (tv->tv_usec - now.tv_usec);
+}
+
+static gint
+compare_retry_at(gconstpointer a, gconstpointer b)
+{
+    const S3ConcurrentRequest *ra = a, *rb = b;
+
+    if (ra->retry_at.tv_sec != rb->retry_at.tv_sec)
+        return ra->retry_at.tv_sec < rb->retry_at.tv_sec? -1 : 1;
+    if (ra->retry_at.tv_usec != rb->retry_at.tv_usec)
+        return ra->retry_at.tv_usec < rb->retry_at.tv_usec? -1 : 1;
+    return 0;
+}
+
+/* Start an attempt at REQ on the easy handle CURL */
+static CURLcode
+start_concurrent_request(S3Handle *hdl,
+                         S3ConcurrentRequest *req,
+                         CURL *curl)
+{
+    CURLcode curl_code;
+    gboolean is_get = g_str_equal(req->verb, "GET");
+    gboolean is_head = g_str_equal(req->verb, "HEAD");
+
+    if (req->headers)
+        curl_slist_free_all(req->headers);
+    req->curl_error_buffer[0] = '\0';
+    g_free(req->int_writedata.etag);
+    s3_internal_reset_func(&req->int_writedata);
+
+    req->headers = authenticate_request(hdl, req->verb, req->bucket, req->key,
+                                        req->subresource, NULL);
+
+    if ((curl_code = setup_curl(hdl, curl, req->url, req->headers,
+                                req->curl_error_buffer, &req->int_writedata)))
+        return curl_code;
+
+    /* the easy handles are used for any verb, so set all of these */
+    if ((curl_code = curl_easy_setopt(curl, CURLOPT_HTTPGET, is_get)))
+        return curl_code;
+    if ((curl_code = curl_easy_setopt(curl, CURLOPT_NOBODY, is_head)))
+        return curl_code;
+    if ((curl_code = curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST,
+                                      (is_get || is_head)? NULL : req->verb)))
+        return curl_code;
+
+    if (curl_multi_add_handle(hdl->multi, curl) != CURLM_OK)
+        return CURLE_FAILED_INIT;
+
+    return CURLE_OK;
+}
+
+/* Look at the outcome of an attempt at REQ as perform_request would, and
+ * record it in REQ.
+ *
+ * @returns: TRUE if the request is to be retried at C{req->retry_at}
+ */
+static gboolean
+finish_concurrent_request(S3Handle *hdl,
+                          S3ConcurrentRequest *req,
+                          CURL *curl,
+                          CURLcode curl_code,
+                          const result_handling_t *result_handling)
+{
+    gboolean should_retry;
+
+    s3_reset(hdl);
+    should_retry = interpret_response(hdl, curl, curl_code,
+        req->curl_error_buffer, req->int_writedata.resp_buf.buffer,
+        req->int_writedata.resp_buf.buffer_pos, req->int_writedata.etag, NULL);
+
+    if (should_retry) {
+        req->result = S3_RESULT_RETRY;
+    } else {
+        req->result = lookup_result(result_handling, hdl->last_response_code,
+                                    hdl->last_s3_error_code, hdl->last_curl_code);
+    }
+
+    if (req->result == S3_RESULT_RETRY &&
+        req->num_retries >= EXPONENTIAL_BACKOFF_MAX_RETRIES) {
+        char *m = g_strdup_printf("Too many retries; last message was '%s'", hdl->last_message);
+        if (hdl->last_message) g_free(hdl->last_message);
+        hdl->last_message = m;
+        req->result = S3_RESULT_FAIL;
+    }
+
+    /* take the details out of hdl, which the next response will use */
+    g_free(req->message);
+    req->message = hdl->last_message;
+    hdl->last_message = NULL;
+    req->response_code = hdl->last_response_code;
+    req->s3_error_code = hdl->last_s3_error_code;
+    req->curl_code = hdl->last_curl_code;
+
+    if (req->result == S3_RESULT_RETRY) {
+        g_get_current_time(&req->retry_at);
+        g_time_val_add(&req->retry_at, req->backoff);
+        req->num_retries++;
+        req->backoff *= EXPONENTIAL_BACKOFF_BASE;
+        return TRUE;
+    }
+
+    if (req->result != S3_RESULT_OK) {
+        g_debug(_("%s %s failed with %d/%s"), req->verb, req->url,
+                req->response_code,
+                s3_error_name_from_code(req->s3_error_code));
+    }
+
+    return FALSE;
+}
+
+/* Wait until one of the requests in progress can make progress, or until
+ * the first of the WAITING requests is due to be retried */
+static void
+wait_for_requests(S3Handle *hdl,
+                  GSList *waiting)
+{
+    fd_set readfds, writefds, excfds;
+    int maxfd = -1;
+    long timeout_ms = 100;
+    gint64 retry_usec;
+    struct timeval tv;
+
+/* curl_multi_timeout added in 7.15.4 */
+#if LIBCURL_VERSION_NUM >= 0x070f04
+    if (curl_multi_timeout(hdl->multi, &timeout_ms) != CURLM_OK || timeout_ms < 0)
+        timeout_ms = 100;
+#endif
+    if (waiting) {
+        retry_usec = usec_until(&((S3ConcurrentRequest *)waiting->data)->retry_at);
+        timeout_ms = MIN(timeout_ms, MAX(retry_usec / 1000, 0));
+    }
+
+    FD_ZERO(&readfds);
+    FD_ZERO(&writefds);
+    FD_ZERO(&excfds);
+    curl_multi_fdset(hdl->multi, &readfds, &writefds, &excfds, &maxfd);
+    if (maxfd < 0) {
+        /* curl has nothing to wait on yet (e.g., it is resolving a name) */
+        g_usleep(MIN(timeout_ms, 100) * 1000);
+        return;
+    }
+
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    select(maxfd + 1, &readfds, &writefds, &excfds, &tv);
+}
+
+static s3_result_t
+perform_requests(S3Handle *hdl,
+                 S3ConcurrentRequest *requests,
+                 guint nb_requests,
+                 const result_handling_t *result_handling)
+{
+    S3ConcurrentRequest **running;	/* the request on each easy handle */
+    S3ConcurrentRequest *req, *failed = NULL;
+    GSList *waiting = NULL;		/* requests to retry, soonest first */
+    guint next = 0, nb_running = 0, nb_done, nb_easy, i;
+    CURLcode curl_code;
+    CURLMsg *msg;
+    CURL *curl;
+    int still_running, msgs_left;
+    gint64 retry_usec;
+
+    g_assert(hdl != NULL && hdl->max_concurrent > 0);
+
+    s3_reset(hdl);
+    if (nb_requests == 0)
+        return S3_RESULT_OK;
+
+    if (!hdl->multi) {
+        hdl->multi = curl_multi_init();
+        if (!hdl->multi) {
+            hdl->last_message = g_strdup("Could not create a curl multi handle");
+            return S3_RESULT_FAIL;
+        }
+/* CURLPIPE_MULTIPLEX added in 7.43.0 */
+#if LIBCURL_VERSION_NUM >= 0x072b00
+        /* requests share a connection if the service speaks HTTP/2 */
+        curl_multi_setopt(hdl->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+        hdl->multi_curl = g_new0(CURL *, hdl->max_concurrent);
+    }
+
+    for (i = 0; i < nb_requests; i++) {
+        req = &requests[i];
+        req->result = S3_RESULT_FAIL;
+        req->message = NULL;
+        req->response_code = 0;
+        req->s3_error_code = S3_ERROR_None;
+        req->curl_code = CURLE_OK;
+        req->num_retries = 0;
+        req->url = build_url(hdl->curl, hdl->host, hdl->service_path,
+                             req->bucket, req->key, req->subresource,
+                             req->query, hdl->use_subdomain, hdl->use_ssl);
+        req->headers = NULL;
+        memset(&req->int_writedata, 0, sizeof(req->int_writedata));
+        req->int_writedata.resp_buf.max_buffer_size = MAX_ERROR_RESPONSE_LEN;
+        req->int_writedata.write_func = s3_counter_write_func;
+        req->int_writedata.reset_func = s3_counter_reset_func;
+        req->int_writedata.hdl = hdl;
+        req->backoff = EXPONENTIAL_BACKOFF_START_USEC;
+    }
+
+    nb_easy = MIN(hdl->max_concurrent, nb_requests);
+    running = g_new0(S3ConcurrentRequest *, nb_easy);
+
+    while (next < nb_requests || waiting || nb_running > 0) {
+        /* start a request on each idle easy handle; retries first */
+        for (i = 0; i < nb_easy; i++) {
+            if (running[i])
+                continue;
+            if (waiting && usec_until(&((S3ConcurrentRequest *)waiting->data)->retry_at) <= 0) {
+                req = waiting->data;
+                waiting = g_slist_delete_link(waiting, waiting);
+            } else if (next < nb_requests) {
+                req = &requests[next++];
+            } else {
+                break;
+            }
+
+            if (!hdl->multi_curl[i])
+                hdl->multi_curl[i] = curl_easy_init();
+            if (!req->url || !hdl->multi_curl[i]) {
+                req->result = S3_RESULT_FAIL;
+                req->message = g_strdup(req->url? "Could not create a curl handle"
+                                                : "Could not build the request URL");
+                continue;
+            }
+
+            curl_code = start_concurrent_request(hdl, req, hdl->multi_curl[i]);
+            if (curl_code == CURLE_OK) {
+                running[i] = req;
+                nb_running++;
+            } else if (finish_concurrent_request(hdl, req, hdl->multi_curl[i],
+                                                 curl_code, result_handling)) {
+                waiting = g_slist_insert_sorted(waiting, req, compare_retry_at);
+            }
+        }
+
+        if (nb_running == 0) {
+            /* only retries are left; sleep until the first is due */
+            if (waiting) {
+                retry_usec = usec_until(&((S3ConcurrentRequest *)waiting->data)->retry_at);
+                if (retry_usec > 0)
+                    g_usleep((gulong)retry_usec);
+            }
+            continue;
+        }
+
+        while (curl_multi_perform(hdl->multi, &still_running) == CURLM_CALL_MULTI_PERFORM)
+            ;
+
+        nb_done = 0;
+        while ((msg = curl_multi_info_read(hdl->multi, &msgs_left))) {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            nb_done++;
+
+            /* msg does not survive curl_multi_remove_handle */
+            curl = msg->easy_handle;
+            curl_code = msg->data.result;
+            for (i = 0; i < nb_easy; i++) {
+                if (hdl->multi_curl[i] == curl)
+                    break;
+            }
+            g_assert(i < nb_easy && running[i] != NULL);
+
+            curl_multi_remove_handle(hdl->multi, curl);
+            req = running[i];
+            running[i] = NULL;
+            nb_running--;
+
+            if (finish_concurrent_request(hdl, req, curl, curl_code, result_handling))
+                waiting = g_slist_insert_sorted(waiting, req, compare_retry_at);
+        }
+
+        /* start the next requests on the freed handles right away */
+        if (nb_running > 0 && nb_done == 0)
+            wait_for_requests(hdl, waiting);
+    }
+
+    /* leave the details of the first failure in hdl->last* */
+    s3_reset(hdl);
+    for (i = 0; i < nb_requests; i++) {
+        req = &requests[i];
+        if (req->result != S3_RESULT_OK && !failed) {
+            failed = req;
+            hdl->last_message = req->message;
+            req->message = NULL;
+            hdl->last_response_code = req->response_code;
+            hdl->last_s3_error_code = req->s3_error_code;
+            hdl->last_curl_code = req->curl_code;
+            hdl->last_num_retries = req->num_retries;
+        }
+        g_free(req->message);
+        req->message = NULL;
+        g_free(req->url);
+        req->url = NULL;
+        if (req->headers)
+            curl_slist_free_all(req->headers);
+        req->headers = NULL;
+        g_free(req->int_writedata.etag);
+        g_free(req->int_writedata.resp_buf.buffer);
+    }
+    g_free(running);
+
+    return failed? failed->result : S3_RESULT_OK;
+}
+
 
 static size_t
 s3_internal_write_func(void *ptr, size_t size, size_t nmemb, void * stream)
@@ -1622,6 +2076,13 @@ s3_free(S3Handle *hdl)
         if (hdl->host) g_free(hdl->host);
         if (hdl->service_path) g_free(hdl->service_path);
         if (hdl->curl) curl_easy_cleanup(hdl->curl);
+        if (hdl->multi) curl_multi_cleanup(hdl->multi);
+        if (hdl->multi_curl) {
+            guint i;
+            for (i = 0; i < hdl->max_concurrent; i++)
+                if (hdl->multi_curl[i]) curl_easy_cleanup(hdl->multi_curl[i]);
+            g_free(hdl->multi_curl);
+        }
 
         g_free(hdl);
     }
@@ -1720,6 +2181,52 @@ s3_use_ssl(S3Handle *hdl, gboolean use_ssl)
     return ret;
 }
 
+gboolean
+s3_use_connection_pool(S3Handle *hdl, guint max_concurrent)
+{
+    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+    guint i;
+
+    g_static_mutex_lock(&mutex);
+    if (!s3_share && max_concurrent > 0) {
+        s3_share = curl_share_init();
+        if (s3_share) {
+            for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+                g_static_mutex_init(&s3_share_mutex[i]);
+            curl_share_setopt(s3_share, CURLSHOPT_LOCKFUNC, s3_share_lock);
+            curl_share_setopt(s3_share, CURLSHOPT_UNLOCKFUNC, s3_share_unlock);
+            curl_share_setopt(s3_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+/* SSL sessions can be shared from 7.23.0, and connections from 7.57.0 */
+#if LIBCURL_VERSION_NUM >= 0x071700
+            curl_share_setopt(s3_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073900
+            curl_share_setopt(s3_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+        }
+    }
+    g_static_mutex_unlock(&mutex);
+
+    if (max_concurrent > 0 && !s3_share)
+        return FALSE;
+
+    /* the easy handles for concurrent requests are sized for the old value */
+    if (hdl->multi) {
+        curl_multi_cleanup(hdl->multi);
+        hdl->multi = NULL;
+    }
+    if (hdl->multi_curl) {
+        for (i = 0; i < hdl->max_concurrent; i++)
+            if (hdl->multi_curl[i]) curl_easy_cleanup(hdl->multi_curl[i]);
+        g_free(hdl->multi_curl);
+        hdl->multi_curl = NULL;
+    }
+
+    hdl->max_concurrent = max_concurrent;
+
+    return TRUE;
+}
+
 char *
 s3_strerror(S3Handle *hdl)
 {
@@ -2080,6 +2587,216 @@ s3_delete(S3Handle *hdl,
     return result == S3_RESULT_OK;
 }
 
+gboolean
+s3_delete_keys(S3Handle *hdl,
+               const char *bucket,
+               const char **keys)
+{
+    s3_result_t result = S3_RESULT_FAIL;
+    static result_handling_t result_handling[] = {
+        { 204,  0,                     0, S3_RESULT_OK },
+        { 404,  S3_ERROR_NoSuchBucket, 0, S3_RESULT_OK },
+        RESULT_HANDLING_ALWAYS_RETRY,
+        { 0,    0,                     0, /* default: */ S3_RESULT_FAIL  }
+        };
+    S3ConcurrentRequest *requests;
+    guint nb_keys, i;
+
+    g_assert(hdl != NULL);
+    g_assert(keys != NULL);
+
+    if (hdl->max_concurrent == 0) {
+        for (i = 0; keys[i]; i++) {
+            if (!s3_delete(hdl, bucket, keys[i]))
+                return FALSE;
+        }
+        return TRUE;
+    }
+
+    nb_keys = g_strv_length((char **)keys);
+    requests = g_new0(S3ConcurrentRequest, nb_keys);
+    for (i = 0; i < nb_keys; i++) {
+        requests[i].verb = "DELETE";
+        requests[i].bucket = bucket;
+        requests[i].key = keys[i];
+    }
+
+    result = perform_requests(hdl, requests, nb_keys, result_handling);
+    g_free(requests);
+
+    return result == S3_RESULT_OK;
+}
+
+/* Private structure for our "thunk", which collects the errors reported
+ * in the response to a multi-object delete. */
+struct multi_delete_thunk {
+    gboolean in_error;
+    gboolean want_text;
+    gchar *text;
+
+    guint nb_errors;
+    gchar *key;		/* of the first error */
+    gchar *code;
+    gchar *message;
+};
+
+static void
+multi_delete_start_element(GMarkupParseContext *context G_GNUC_UNUSED,
+                           const gchar *element_name,
+                           const gchar **attribute_names G_GNUC_UNUSED,
+                           const gchar **attribute_values G_GNUC_UNUSED,
+                           gpointer user_data,
+                           GError **error G_GNUC_UNUSED)
+{
+    struct multi_delete_thunk *thunk = (struct multi_delete_thunk *)user_data;
+
+    thunk->want_text = 0;
+    if (g_ascii_strcasecmp(element_name, "error") == 0) {
+        thunk->in_error = 1;
+        thunk->nb_errors++;
+    } else if (thunk->in_error && thunk->nb_errors == 1 &&
+               (g_ascii_strcasecmp(element_name, "key") == 0 ||
+                g_ascii_strcasecmp(element_name, "code") == 0 ||
+                g_ascii_strcasecmp(element_name, "message") == 0)) {
+        thunk->want_text = 1;
+    }
+}
+
+static void
+multi_delete_end_element(GMarkupParseContext *context G_GNUC_UNUSED,
+                         const gchar *element_name,
+                         gpointer user_data,
+                         GError **error G_GNUC_UNUSED)
+{
+    struct multi_delete_thunk *thunk = (struct multi_delete_thunk *)user_data;
+
+    thunk->want_text = 0;
+    if (g_ascii_strcasecmp(element_name, "error") == 0) {
+        thunk->in_error = 0;
+    } else if (!thunk->in_error || !thunk->text) {
+        return;
+    } else if (g_ascii_strcasecmp(element_name, "key") == 0) {
+        g_free(thunk->key);
+        thunk->key = thunk->text;
+        thunk->text = NULL;
+    } else if (g_ascii_strcasecmp(element_name, "code") == 0) {
+        g_free(thunk->code);
+        thunk->code = thunk->text;
+        thunk->text = NULL;
+    } else if (g_ascii_strcasecmp(element_name, "message") == 0) {
+        g_free(thunk->message);
+        thunk->message = thunk->text;
+        thunk->text = NULL;
+    }
+}
+
+static void
+multi_delete_text(GMarkupParseContext *context G_GNUC_UNUSED,
+                  const gchar *text,
+                  gsize text_len,
+                  gpointer user_data,
+                  GError **error G_GNUC_UNUSED)
+{
+    struct multi_delete_thunk *thunk = (struct multi_delete_thunk *)user_data;
+
+    if (thunk->want_text) {
+        if (thunk->text) g_free(thunk->text);
+        thunk->text = g_strndup(text, text_len);
+    }
+}
+
+int
+s3_multi_delete(S3Handle *hdl,
+                const char *bucket,
+                const char **keys)
+{
+    static const guint MAX_RESPONSE_LEN = 1000*2000;
+    s3_result_t result = S3_RESULT_FAIL;
+    static result_handling_t result_handling[] = {
+        { 200,  0,                     0, S3_RESULT_OK },
+        { 404,  S3_ERROR_NoSuchBucket, 0, S3_RESULT_OK },
+        { 501,  0,                     0, S3_RESULT_NOTIMPL },
+        RESULT_HANDLING_ALWAYS_RETRY,
+        { 400,  0,                     0, S3_RESULT_NOTIMPL },
+        { 405,  0,                     0, S3_RESULT_NOTIMPL },
+        { 0,    0,                     0, /* default: */ S3_RESULT_FAIL  }
+        };
+    static GMarkupParser parser = { multi_delete_start_element,
+        multi_delete_end_element, multi_delete_text, NULL, NULL };
+    struct multi_delete_thunk thunk;
+    GMarkupParseContext *ctxt = NULL;
+    GError *err = NULL;
+    GString *body;
+    CurlBuffer req;
+    CurlBuffer resp = {NULL, 0, 0, MAX_RESPONSE_LEN};
+    const char **key;
+    char *esc_key;
+
+    g_assert(hdl != NULL);
+    g_assert(keys != NULL);
+
+    /* in quiet mode, only the keys which could not be deleted are listed
+     * in the response */
+    body = g_string_new("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                        "<Delete>\n  <Quiet>true</Quiet>\n");
+    for (key = keys; *key; key++) {
+        esc_key = g_markup_escape_text(*key, -1);
+        g_string_append_printf(body, "  <Object><Key>%s</Key></Object>\n",
+                               esc_key);
+        g_free(esc_key);
+    }
+    g_string_append(body, "</Delete>\n");
+
+    req.buffer = body->str;
+    req.buffer_len = (guint)body->len;
+    req.buffer_pos = 0;
+    req.max_buffer_size = req.buffer_len;
+
+    result = perform_request(hdl, "POST", bucket, NULL, "delete", NULL,
+                 S3_BUFFER_READ_FUNCS, &req,
+                 S3_BUFFER_WRITE_FUNCS, &resp, NULL, NULL,
+                 result_handling);
+    g_string_free(body, TRUE);
+
+    if (result == S3_RESULT_NOTIMPL) {
+        g_free(resp.buffer);
+        return 2;
+    }
+    if (result != S3_RESULT_OK || hdl->last_response_code != 200 ||
+        resp.buffer_pos == 0) {
+        g_free(resp.buffer);
+        return result == S3_RESULT_OK;
+    }
+
+    /* a 200 response can still report keys that were not deleted */
+    memset(&thunk, 0, sizeof(thunk));
+    ctxt = g_markup_parse_context_new(&parser, 0, (gpointer)&thunk, NULL);
+    if (!g_markup_parse_context_parse(ctxt, resp.buffer, resp.buffer_pos, &err) ||
+        !g_markup_parse_context_end_parse(ctxt, &err)) {
+        if (hdl->last_message) g_free(hdl->last_message);
+        hdl->last_message = g_strdup(err->message);
+        result = S3_RESULT_FAIL;
+    } else if (thunk.nb_errors > 0) {
+        if (hdl->last_message) g_free(hdl->last_message);
+        hdl->last_message = g_strdup_printf(
+            _("%u keys not deleted; first was '%s': %s (%s)"),
+            thunk.nb_errors, thunk.key ? thunk.key : "?",
+            thunk.message ? thunk.message : "",
+            thunk.code ? thunk.code : "?");
+        result = S3_RESULT_FAIL;
+    }
+
+    if (err) g_error_free(err);
+    g_markup_parse_context_free(ctxt);
+    g_free(thunk.text);
+    g_free(thunk.key);
+    g_free(thunk.code);
+    g_free(thunk.message);
+    g_free(resp.buffer);
+
+    return result == S3_RESULT_OK;
+}
+
 gboolean
 s3_make_bucket(S3Handle *hdl,
                const char *bucket)
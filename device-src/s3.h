@@ -318,6 +318,21 @@ s3_set_max_send_speed(S3Handle *hdl, guint64 max_send_speed);
 gboolean
 s3_set_max_recv_speed(S3Handle *hdl, guint64 max_recv_speed);
 
+/* Use the connection pool shared by all handles in this process, and let
+ * functions which make several independent requests (s3_delete_keys) have up
+ * to MAX_CONCURRENT of them in progress at once.  A MAX_CONCURRENT of 0 stops
+ * using the pool.
+ *
+ * Connections are kept across handles only with curl 7.57.0 or later; older
+ * versions share DNS lookups and SSL sessions.
+ *
+ * @param hdl: the S3Handle object
+ * @param max_concurrent: most requests in progress at once, or 0
+ * @returns: false if the pool could not be created
+ */
+gboolean
+s3_use_connection_pool(S3Handle *hdl, guint max_concurrent);
+
 /* Get the error information from the last operation on this handle,
  * formatted as a string.
  *
@@ -415,6 +430,37 @@ s3_delete(S3Handle *hdl,
           const char *bucket,
           const char *key);
 
+/* Delete several files, with as many requests in progress at once as
+ * s3_use_connection_pool allows, or one at a time if it was not called.
+ *
+ * @param hdl: the S3Handle object
+ * @param bucket: the bucket to delete from
+ * @param keys: NULL-terminated array of keys
+ * @returns: FALSE if any key could not be deleted; the details of the first
+ * failure are then available from s3_error.  Non-existent files are I{not}
+ * considered an error.
+ */
+gboolean
+s3_delete_keys(S3Handle *hdl,
+               const char *bucket,
+               const char **keys);
+
+/* Most keys a single s3_multi_delete request may name */
+#define S3_MULTI_DELETE_MAX_KEYS 1000
+
+/* Delete several files with one multi-object delete request.
+ * @param hdl: the S3Handle object
+ * @param bucket: the bucket to delete from
+ * @param keys: NULL-terminated array of at most S3_MULTI_DELETE_MAX_KEYS keys
+ * @returns: 1 if all keys were deleted, 2 if the service does not implement
+ * multi-object delete (use s3_delete instead), or 0 if an error occurs;
+ * non-existent files are I{not} considered an error.
+ */
+int
+s3_multi_delete(S3Handle *hdl,
+                const char *bucket,
+                const char **keys);
+
 /* Create a bucket.
  *
  * @param hdl: the S3Handle object
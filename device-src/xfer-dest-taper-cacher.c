@@ -23,6 +23,7 @@
 #include "amxfer.h"
 #include "xfer-device.h"
 #include "conffile.h"
+#include "crc32c.h"
 
 /* A transfer destination that writes an entire dumpfile to one or more files
  * on one or more devices, caching each part so that it can be rewritten on a
@@ -171,6 +172,9 @@ typedef struct XferDestTaperCacher {
     /* bytes written to the device in the current slab */
     guint64 slab_bytes_written;
 
+    /* checksum of the data written to the device in this part */
+    crc32c_part_t part_crc;
+
     /* element state
      *
      * "state" includes all of the variables below (including device
@@ -578,14 +582,16 @@ typedef struct slab_source_state {
     guint64 next_serial;
 } slab_source_state;
 
-/* Called with the slab_mutex held, this function pre-buffers enough data into the slab
- * train to meet the device's streaming needs. */
+/* Called with the slab_mutex held, this function pre-buffers BYTES of data (or
+ * at least one slab) into the slab train to meet the device's streaming
+ * needs. */
 static gboolean
 slab_source_prebuffer(
-    XferDestTaperCacher *self)
+    XferDestTaperCacher *self,
+    gsize bytes)
 {
     XferElement *elt = XFER_ELEMENT(self);
-    guint64 prebuffer_slabs = (self->max_memory + self->slab_size - 1) / self->slab_size;
+    guint64 prebuffer_slabs = (bytes + self->slab_size - 1) / self->slab_size;
     guint64 i;
     Slab *slab;
 
@@ -717,7 +723,7 @@ slab_source_setup(
 	gboolean prebuffer_ok;
 
 	g_mutex_lock(self->slab_mutex);
-	prebuffer_ok = slab_source_prebuffer(self);
+	prebuffer_ok = slab_source_prebuffer(self, self->max_memory);
 	g_mutex_unlock(self->slab_mutex);
 	if (!prebuffer_ok)
 	    return FALSE;
@@ -776,13 +782,23 @@ slab_source_get(
     guint64 serial)
 {
     XferElement *elt = (XferElement *)self;
+    gsize watermark = MIN(XFER_DEST_TAPER(self)->watermark, self->max_memory);
 
     /* device_slab is only NULL if we're following the slab train, so wait for
-     * a new slab */
+     * a new slab; in the middle of a part, the device is idle until it
+     * arrives */
     if (!self->device_slab) {
-	/* if the streaming mode requires it, pre-buffer */
-	if (self->streaming == STREAMING_REQUIREMENT_DESIRED) {
-	    if (!slab_source_prebuffer(self))
+	gboolean stalled = (self->bytes_written > 0);
+
+	if (stalled)
+	    xfer_dest_taper_stats_wait(XFER_DEST_TAPER(self), TRUE);
+
+	/* if the streaming mode requires it, or a watermark is set, pre-buffer */
+	if (stalled && watermark) {
+	    if (!slab_source_prebuffer(self, watermark))
+		return NULL;
+	} else if (self->streaming == STREAMING_REQUIREMENT_DESIRED) {
+	    if (!slab_source_prebuffer(self, self->max_memory))
 		return NULL;
 
 	    /* fall through to make sure we have a device_slab;
@@ -795,6 +811,9 @@ slab_source_get(
 	}
 	DBG(9, "done waiting");
 
+	if (stalled)
+	    xfer_dest_taper_stats_wait(XFER_DEST_TAPER(self), FALSE);
+
 	if (elt->cancelled)
 	    goto fatal_error;
     }
@@ -844,7 +863,9 @@ write_slab_to_device(
     while (remaining && !elt->cancelled) {
 	gsize write_size = MIN(self->block_size, remaining);
 	gboolean ok;
+	xfer_dest_taper_stats_write(XFER_DEST_TAPER(self), TRUE);
 	ok = device_write_block(self->device, write_size, buf);
+	xfer_dest_taper_stats_write(XFER_DEST_TAPER(self), FALSE);
 	if (!ok) {
             self->bytes_written += slab->size - remaining;
 
@@ -855,6 +876,7 @@ write_slab_to_device(
 	    return FALSE;
 	}
 
+	crc32c_part_add(&self->part_crc, buf, write_size);
 	buf += write_size;
 	self->slab_bytes_written += write_size;
 	remaining -= write_size;
@@ -886,6 +908,8 @@ device_thread_write_part(
 
     self->last_part_successful = FALSE;
     self->bytes_written = 0;
+    crc32c_part_init(&self->part_crc);
+    xfer_dest_taper_stats_start_part(XFER_DEST_TAPER(self));
 
     if (!device_start_file(self->device, self->part_header)) {
 	failed = 1;
@@ -957,7 +981,13 @@ part_done:
     msg->fileno = fileno;
     msg->successful = self->last_part_successful;
     msg->eom = !self->last_part_successful;
+    if (self->last_part_successful)
+	msg->crc = g_strdup_printf("crc32c:%08x",
+				   crc32c_part_finish(&self->part_crc));
     msg->eof = self->no_more_parts;
+    xfer_dest_taper_stats_to_msg(XFER_DEST_TAPER(self), msg);
+    DBG(2, "device ran out of data %ju times, for %.3f seconds; %ju slow writes",
+	(uintmax_t)msg->stalls, msg->stall_duration, (uintmax_t)msg->slow_writes);
 
     /* time runs backward on some test boxes, so make sure this is positive */
     if (msg->duration < 0) msg->duration = 0;
@@ -23,6 +23,7 @@
 #include "amxfer.h"
 #include "xfer-device.h"
 #include "conffile.h"
+#include "crc32c.h"
 
 /* A transfer destination that writes an entire dumpfile to one or more files
  * on one or more devices, without any caching.  This destination supports both
@@ -83,6 +84,10 @@ typedef struct XferDestTaperSplitter {
     /* block size expected by the target device */
     gsize block_size;
 
+    /* bytes to buffer before writing again once the device has run out of
+     * data in the middle of a part, or 0; see xfer_dest_taper_set_watermark */
+    gsize resume_bytes;
+
     /* TRUE if this element is expecting slices via cache_inform */
     gboolean expect_cache_inform;
 
@@ -364,6 +369,7 @@ device_thread_wait_for_block(
     XferElement *elt = XFER_ELEMENT(self);
     gsize bytes_needed = self->device->block_size;
     gsize usable;
+    gboolean stalled = FALSE;
 
     /* for any kind of streaming, we need to fill the entire buffer before the
      * first byte */
@@ -381,15 +387,26 @@ device_thread_wait_for_block(
 	if (self->ring_head_at_eof)
 	    break;
 
-	/* nope - so wait */
+	/* nope - so wait; in the middle of a part, the device is idle until
+	 * the data arrives */
+	if (!stalled && self->part_bytes_written > 0) {
+	    stalled = TRUE;
+	    xfer_dest_taper_stats_wait(XFER_DEST_TAPER(self), TRUE);
+	}
 	g_cond_wait(self->ring_add_cond, self->ring_mutex);
 
-	/* in STREAMING_REQUIREMENT_REQUIRED, once we decide to wait for more bytes,
-	 * we need to wait for the entire buffer to fill */
-	if (self->streaming == STREAMING_REQUIREMENT_REQUIRED)
+	/* once we decide to wait for more bytes in the middle of a part, wait
+	 * for the watermark, if one is set; and in
+	 * STREAMING_REQUIREMENT_REQUIRED, for the entire buffer to fill */
+	if (stalled && self->resume_bytes)
+	    bytes_needed = self->resume_bytes;
+	else if (self->streaming == STREAMING_REQUIREMENT_REQUIRED)
 	    bytes_needed = self->ring_length;
     }
 
+    if (stalled)
+	xfer_dest_taper_stats_wait(XFER_DEST_TAPER(self), FALSE);
+
     usable = MIN(self->ring_count, bytes_needed);
     if (self->part_size)
        usable = MIN(usable, self->part_size - self->part_bytes_written);
@@ -422,10 +439,18 @@ device_thread_write_part(
     enum { PART_EOF, PART_LEOM, PART_EOP, PART_FAILED } part_status = PART_FAILED;
     int fileno = 0;
     XMsg *msg;
+    crc32c_part_t crc;
 
     self->part_bytes_written = 0;
+    crc32c_part_init(&crc);
+
+    /* never wait for more than the buffer holds, nor for less than a block */
+    self->resume_bytes = MIN(XFER_DEST_TAPER(self)->watermark, self->ring_length);
+    if (self->resume_bytes)
+	self->resume_bytes = MAX(self->resume_bytes, self->block_size);
 
     g_timer_start(timer);
+    xfer_dest_taper_stats_start_part(XFER_DEST_TAPER(self));
 
     /* write the header; if this fails or hits LEOM, we consider this a
      * successful 0-byte part */
@@ -464,7 +489,9 @@ device_thread_write_part(
 
 	    /* note that it's OK to reference these ring_* vars here, as they
 	     * are static at this point */
+	    xfer_dest_taper_stats_write(XFER_DEST_TAPER(self), TRUE);
 	    ok = device_write_block(self->device, (guint)to_write, buf);
+	    xfer_dest_taper_stats_write(XFER_DEST_TAPER(self), FALSE);
 
 	    if (!ok) {
 		part_status = PART_FAILED;
@@ -472,6 +499,7 @@ device_thread_write_part(
 		break;
 	    }
 
+	    crc32c_part_add(&crc, buf, to_write);
 	    self->part_bytes_written += to_write;
 	    bytes_from_slices -= to_write;
 
@@ -515,8 +543,12 @@ device_thread_write_part(
 
 	/* note that it's OK to reference these ring_* vars here, as they
 	 * are static at this point */
+	xfer_dest_taper_stats_write(XFER_DEST_TAPER(self), TRUE);
 	ok = device_write_block(self->device, (guint)to_write,
 		self->ring_buffer + self->ring_tail);
+	xfer_dest_taper_stats_write(XFER_DEST_TAPER(self), FALSE);
+	if (ok)
+	    crc32c_part_add(&crc, self->ring_buffer + self->ring_tail, to_write);
 	g_mutex_lock(self->ring_mutex);
 
 	if (!ok) {
@@ -559,6 +591,11 @@ part_done:
     msg->successful = self->last_part_successful = part_status != PART_FAILED;
     msg->eom = self->last_part_eom = part_status == PART_LEOM || self->device->is_eom;
     msg->eof = self->last_part_eof = part_status == PART_EOF;
+    if (msg->successful)
+	msg->crc = g_strdup_printf("crc32c:%08x", crc32c_part_finish(&crc));
+    xfer_dest_taper_stats_to_msg(XFER_DEST_TAPER(self), msg);
+    DBG(2, "device ran out of data %ju times, for %.3f seconds; %ju slow writes",
+	(uintmax_t)msg->stalls, msg->stall_duration, (uintmax_t)msg->slow_writes);
 
     /* time runs backward on some test boxes, so make sure this is positive */
     if (msg->duration < 0) msg->duration = 0;
@@ -24,6 +24,13 @@
 
 static GObjectClass *parent_class = NULL;
 
+/* writes of at least SLOW_WRITE_MIN seconds, and SLOW_WRITE_FACTOR times the
+ * average, are counted slow, once SLOW_WRITE_WARMUP writes are averaged.  A
+ * tape drive that repositions takes seconds to accept the next block. */
+#define SLOW_WRITE_MIN 0.1
+#define SLOW_WRITE_FACTOR 8
+#define SLOW_WRITE_WARMUP 16
+
 /*
  * Method implementation
  */
@@ -42,7 +49,24 @@ static void
 instance_init(
     XferElement *elt)
 {
+    XferDestTaper *self = XFER_DEST_TAPER(elt);
+
     elt->can_generate_eof = FALSE;
+    self->watermark = 0;
+    self->stats.timer = g_timer_new();
+    self->stats.wait_start = -1;
+}
+
+static void
+finalize_impl(
+    GObject * obj_self)
+{
+    XferDestTaper *self = XFER_DEST_TAPER(obj_self);
+
+    g_timer_destroy(self->stats.timer);
+
+    /* chain up */
+    G_OBJECT_CLASS(parent_class)->finalize(obj_self);
 }
 
 static void
@@ -50,8 +74,10 @@ class_init(
     XferDestTaperClass * selfc)
 {
     XferElementClass *klass = XFER_ELEMENT_CLASS(selfc);
+    GObjectClass *goc = G_OBJECT_CLASS(selfc);
 
     selfc->cache_inform = cache_inform_impl;
+    goc->finalize = finalize_impl;
 
     klass->perl_class = "Amanda::Xfer::Dest::Taper";
 
@@ -139,3 +165,88 @@ xfer_dest_taper_get_part_bytes_written(
     else
 	return 0;
 }
+
+void
+xfer_dest_taper_set_watermark(
+    XferElement *elt,
+    gsize watermark)
+{
+    g_assert(IS_XFER_DEST_TAPER(elt));
+
+    XFER_DEST_TAPER(elt)->watermark = watermark;
+}
+
+/*
+ * Streaming statistics
+ */
+
+void
+xfer_dest_taper_stats_start_part(
+    XferDestTaper *self)
+{
+    XferDestTaperStats *stats = &self->stats;
+
+    g_timer_start(stats->timer);
+    stats->wait_start = -1;
+    stats->writes = 0;
+    stats->mean_write = 0;
+    stats->stalls = 0;
+    stats->stall_duration = 0;
+    stats->slow_writes = 0;
+}
+
+void
+xfer_dest_taper_stats_wait(
+    XferDestTaper *self,
+    gboolean waiting)
+{
+    XferDestTaperStats *stats = &self->stats;
+    gdouble now = g_timer_elapsed(stats->timer, NULL);
+
+    if (waiting) {
+	stats->wait_start = now;
+    } else if (stats->wait_start >= 0) {
+	stats->stalls++;
+	stats->stall_duration += MAX(now - stats->wait_start, 0);
+	stats->wait_start = -1;
+    }
+}
+
+void
+xfer_dest_taper_stats_write(
+    XferDestTaper *self,
+    gboolean writing)
+{
+    XferDestTaperStats *stats = &self->stats;
+    gdouble now = g_timer_elapsed(stats->timer, NULL);
+    gdouble elapsed;
+
+    if (writing) {
+	stats->write_start = now;
+	return;
+    }
+
+    elapsed = MAX(now - stats->write_start, 0);
+    if (stats->writes >= SLOW_WRITE_WARMUP && elapsed >= SLOW_WRITE_MIN
+	    && elapsed >= SLOW_WRITE_FACTOR * stats->mean_write) {
+	/* leave it out of the average, which is that of a streaming drive */
+	stats->slow_writes++;
+	return;
+    }
+
+    stats->writes++;
+    stats->mean_write += (elapsed - stats->mean_write)
+		       / MIN(stats->writes, SLOW_WRITE_WARMUP);
+}
+
+void
+xfer_dest_taper_stats_to_msg(
+    XferDestTaper *self,
+    XMsg *msg)
+{
+    XferDestTaperStats *stats = &self->stats;
+
+    msg->stalls = stats->stalls;
+    msg->stall_duration = stats->stall_duration;
+    msg->slow_writes = stats->slow_writes;
+}
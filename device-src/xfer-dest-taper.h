@@ -37,8 +37,29 @@ GType xfer_dest_taper_get_type(void);
 #define IS_XFER_DEST_TAPER(obj) G_TYPE_CHECK_INSTANCE_TYPE((obj), xfer_dest_taper_get_type ())
 #define XFER_DEST_TAPER_GET_CLASS(obj) G_TYPE_INSTANCE_GET_CLASS((obj), xfer_dest_taper_get_type(), XferDestTaperClass)
 
+/* How well the device kept streaming during a part; see
+ * xfer_dest_taper_stats_* below */
+typedef struct XferDestTaperStats_ {
+    GTimer *timer;
+    gdouble wait_start;		/* start of the current wait for data, or -1 */
+    gdouble write_start;	/* start of the current write */
+    gdouble mean_write;		/* average time of the writes not counted slow */
+    guint64 writes;
+    guint64 stalls;
+    gdouble stall_duration;
+    guint64 slow_writes;
+} XferDestTaperStats;
+
 typedef struct XferDestTaper_ {
     XferElement __parent__;
+
+    /* once the device has run out of data, bytes to buffer before writing
+     * again; 0 to follow the device's streaming requirement.  Only read by
+     * subclasses when they start a part. */
+    gsize watermark;
+
+    /* for the part being written; only touched by the thread writing it */
+    XferDestTaperStats stats;
 } XferDestTaper;
 
 typedef struct {
@@ -102,4 +123,41 @@ void xfer_dest_taper_cache_inform(
 guint64 xfer_dest_taper_get_part_bytes_written(
     XferElement *self);
 
+/* Once the device has run out of data in the middle of a part, wait until
+ * WATERMARK bytes are buffered before writing again, so that a tape drive
+ * stops for a while rather than repositioning every few blocks.  Zero follows
+ * the device's streaming requirement.  Takes effect at the next part.
+ *
+ * @param self: the XferDestTaper object
+ * @param watermark: bytes to buffer, limited to the element's buffer size
+ */
+void xfer_dest_taper_set_watermark(
+    XferElement *self,
+    gsize watermark);
+
+/*
+ * Streaming statistics, for use by subclasses from the thread that writes
+ * to the device.  They are sent with each XMSG_PART_DONE.
+ */
+
+/* Start counting for a new part */
+void xfer_dest_taper_stats_start_part(
+    XferDestTaper *self);
+
+/* The device has run out of data in the middle of the part, and waits for
+ * more (WAITING), or the wait is over (!WAITING) */
+void xfer_dest_taper_stats_wait(
+    XferDestTaper *self,
+    gboolean waiting);
+
+/* A block is about to be written (WRITING), or has been written (!WRITING) */
+void xfer_dest_taper_stats_write(
+    XferDestTaper *self,
+    gboolean writing);
+
+/* Copy the statistics for the part into its XMSG_PART_DONE */
+void xfer_dest_taper_stats_to_msg(
+    XferDestTaper *self,
+    XMsg *msg);
+
 #endif
@@ -132,6 +132,20 @@ xfer_source_recovery_start_part(
     XferElement *elt,
     Device *device);
 
+/* Discard the first BYTES bytes of the next part.  Together with
+ * device_seek_block, this lets a recovery begin at an arbitrary offset within
+ * a part: seek to the block containing the offset, then skip the rest.  Call
+ * this before xfer_source_recovery_start_part; it applies to that part only,
+ * and is not supported with DirectTCP.
+ *
+ * @param self: XferSourceRecovery object
+ * @param bytes: number of bytes to discard
+ */
+void
+xfer_source_recovery_skip(
+    XferElement *elt,
+    guint64 bytes);
+
 /* Prepare to read subsequent parts from the given device.  The device must
  * not be started yet.  It is not necessary to call this method for the first
  * device used in a transfer.
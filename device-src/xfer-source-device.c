@@ -24,6 +24,7 @@
 #include "device.h"
 #include "property.h"
 #include "xfer-device.h"
+#include "conffile.h"
 
 /*
  * Class declaration
@@ -52,6 +53,32 @@ typedef struct XferSourceDevice {
     Device *device;
     size_t block_size;
     gboolean cancelled;
+
+    /* thread reading blocks from the device ahead of pull_buffer; it sends
+     * XMSG_DONE once it has stopped using the device */
+    GThread *reader_thread;
+
+    /* this mutex governs all variables below; ready_cond is signalled when a
+     * block is queued or the reader finishes, and room_cond when a block is
+     * taken from the queue */
+    GMutex *ring_mutex;
+    GCond *ready_cond;
+    GCond *room_cond;
+
+    /* blocks read but not yet pulled, in a ring of ring_len slots */
+    struct {
+	gpointer buf;
+	size_t size;
+    } *ring;
+    guint ring_len, ring_head, ring_count;
+
+    /* set by the reader when it hits EOF or an error; errmsg is NULL at EOF */
+    gboolean reader_done;
+    char *errmsg;
+
+    /* a buffer the reader did not hand on, kept for its next read */
+    gpointer spare;
+    size_t spare_size;
 } XferSourceDevice;
 
 /*
@@ -66,6 +93,118 @@ typedef struct {
  * Implementation
  */
 
+/* allocate a buffer of the current block size, reusing the spare if it fits */
+static gpointer
+get_buffer(
+    XferSourceDevice *self)
+{
+    gpointer buf = self->spare;
+
+    if (buf && self->spare_size == self->block_size) {
+	self->spare = NULL;
+	return buf;
+    }
+
+    amfree(self->spare);
+    return g_malloc(self->block_size);
+}
+
+static gpointer
+reader_thread(
+    gpointer data)
+{
+    XferSourceDevice *self = (XferSourceDevice *)data;
+    XferElement *elt = XFER_ELEMENT(self);
+    gpointer buf;
+    int result;
+    int devsize;
+    guint slot;
+
+    g_mutex_lock(self->ring_mutex);
+    while (!elt->cancelled) {
+	/* wait for room in the ring */
+	while (self->ring_count == self->ring_len && !elt->cancelled)
+	    g_cond_wait(self->room_cond, self->ring_mutex);
+	if (elt->cancelled)
+	    break;
+
+	/* read without the lock, so the consumer can take the blocks already
+	 * read in the meantime */
+	g_mutex_unlock(self->ring_mutex);
+	do {
+	    buf = get_buffer(self);
+	    devsize = (int)self->block_size;
+	    result = device_read_block(self->device, buf, &devsize);
+
+	    /* if the buffer was too small, loop around again */
+	    if (result == 0) {
+		g_assert((size_t)devsize > self->block_size);
+		self->block_size = devsize;
+		amfree(buf);
+	    }
+	} while (result == 0);
+	g_mutex_lock(self->ring_mutex);
+
+	if (result < 0) {
+	    self->spare = buf;
+	    self->spare_size = self->block_size;
+
+	    /* if we're not at EOF, it's an error */
+	    if (!self->device->is_eof) {
+		self->errmsg = g_strdup_printf(_("error reading from %s: %s"),
+		    self->device->device_name,
+		    device_error_or_status(self->device));
+	    }
+	    break;
+	}
+
+	slot = (self->ring_head + self->ring_count) % self->ring_len;
+	self->ring[slot].buf = buf;
+	self->ring[slot].size = devsize;
+	self->ring_count++;
+	g_cond_signal(self->ready_cond);
+    }
+
+    self->reader_done = TRUE;
+    g_cond_broadcast(self->ready_cond);
+    g_mutex_unlock(self->ring_mutex);
+
+    /* the device is not read from here on, so the caller may use it once
+     * the xfer is done */
+    xfer_queue_message(elt->xfer, xmsg_new(elt, XMSG_DONE, 0));
+
+    return NULL;
+}
+
+static gboolean
+start_impl(
+    XferElement *elt)
+{
+    XferSourceDevice *self = (XferSourceDevice *)elt;
+    GError *error = NULL;
+
+    /* get the device block size */
+    if (self->block_size == 0) {
+	self->block_size = self->device->block_size;
+    }
+
+    /* read ahead as many blocks as fit in device-read-buffer-size, but
+     * always at least two, so that one can be read while the other is
+     * consumed */
+    self->ring_len = getconf_size(CNF_DEVICE_READ_BUFFER_SIZE) / self->block_size;
+    if (self->ring_len < 2)
+	self->ring_len = 2;
+    self->ring = g_malloc0(self->ring_len * sizeof(*self->ring));
+
+    self->reader_thread = g_thread_create(reader_thread, (gpointer)self, TRUE, &error);
+    if (!self->reader_thread) {
+	g_critical(_("Error creating new thread: %s (%s)"),
+	    error->message, errno? strerror(errno) : _("no error code"));
+    }
+
+    return TRUE; /* the reader will send XMSG_DONE */
+}
+
 static gpointer
 pull_buffer_impl(
     XferElement *elt,
@@ -73,58 +212,108 @@ pull_buffer_impl(
 {
     XferSourceDevice *self = (XferSourceDevice *)elt;
     gpointer buf = NULL;
-    int result;
-    int devsize;
+    char *errmsg;
+
+    g_mutex_lock(self->ring_mutex);
+    while (self->ring_count == 0 && !self->reader_done && !elt->cancelled)
+	g_cond_wait(self->ready_cond, self->ring_mutex);
 
     /* indicate EOF on an cancel */
     if (elt->cancelled) {
+	g_mutex_unlock(self->ring_mutex);
 	*size = 0;
 	return NULL;
     }
 
-    /* get the device block size */
-    if (self->block_size == 0) {
-	self->block_size = self->device->block_size;
+    if (self->ring_count > 0) {
+	buf = self->ring[self->ring_head].buf;
+	*size = self->ring[self->ring_head].size;
+	self->ring[self->ring_head].buf = NULL;
+	self->ring_head = (self->ring_head + 1) % self->ring_len;
+	self->ring_count--;
+	g_cond_signal(self->room_cond);
+	g_mutex_unlock(self->ring_mutex);
+	return buf;
     }
 
-    do {
-	buf = g_malloc(self->block_size);
-	devsize = (int)self->block_size;
-	result = device_read_block(self->device, buf, &devsize);
-	*size = devsize;
-
-	/* if the buffer was too small, loop around again */
-	if (result == 0) {
-	    g_assert(*size > self->block_size);
-	    self->block_size = devsize;
-	    amfree(buf);
-	}
-    } while (result == 0);
-
-    if (result < 0) {
-	amfree(buf);
-
-	/* if we're not at EOF, it's an error */
-	if (!self->device->is_eof) {
-	    xfer_cancel_with_error(elt,
-		_("error reading from %s: %s"),
-		self->device->device_name,
-		device_error_or_status(self->device));
-	    wait_until_xfer_cancelled(elt->xfer);
-	}
+    /* the reader is done and everything it read has been pulled */
+    errmsg = self->errmsg;
+    self->errmsg = NULL;
+    g_mutex_unlock(self->ring_mutex);
 
-	*size = 0;
-	return NULL;
+    if (errmsg) {
+	xfer_cancel_with_error(elt, "%s", errmsg);
+	g_free(errmsg);
+	wait_until_xfer_cancelled(elt->xfer);
     }
 
-    return buf;
+    *size = 0;
+    return NULL;
+}
+
+static gboolean
+cancel_impl(
+    XferElement *elt,
+    gboolean expect_eof)
+{
+    XferSourceDevice *self = (XferSourceDevice *)elt;
+    gboolean rv;
+
+    rv = XFER_ELEMENT_CLASS(parent_class)->cancel(elt, expect_eof);
+
+    /* wake up the reader and the consumer, in case they are waiting; the
+     * reader stops after the block it is reading, and only then sends
+     * XMSG_DONE */
+    g_mutex_lock(self->ring_mutex);
+    g_cond_broadcast(self->ready_cond);
+    g_cond_broadcast(self->room_cond);
+    g_mutex_unlock(self->ring_mutex);
+
+    return rv;
+}
+
+static void
+finalize_impl(
+    GObject * obj_self)
+{
+    XferSourceDevice *self = (XferSourceDevice *)obj_self;
+    XferElement *elt = XFER_ELEMENT(self);
+
+    /* the consumer may have stopped pulling before EOF; stop the reader */
+    if (self->reader_thread) {
+	g_mutex_lock(self->ring_mutex);
+	elt->cancelled = TRUE;
+	g_cond_broadcast(self->room_cond);
+	g_mutex_unlock(self->ring_mutex);
+	g_thread_join(self->reader_thread);
+    }
+
+    while (self->ring_count > 0) {
+	g_free(self->ring[self->ring_head].buf);
+	self->ring_head = (self->ring_head + 1) % self->ring_len;
+	self->ring_count--;
+    }
+    amfree(self->ring);
+    amfree(self->spare);
+    amfree(self->errmsg);
+
+    g_cond_free(self->ready_cond);
+    g_cond_free(self->room_cond);
+    g_mutex_free(self->ring_mutex);
+
+    G_OBJECT_CLASS(parent_class)->finalize(obj_self);
 }
 
 static void
 instance_init(
     XferElement *elt)
 {
+    XferSourceDevice *self = (XferSourceDevice *)elt;
+
     elt->can_generate_eof = TRUE;
+    self->ring_mutex = g_mutex_new();
+    self->ready_cond = g_cond_new();
+    self->room_cond = g_cond_new();
 }
 
 static void
@@ -132,16 +321,21 @@ class_init(
     XferSourceDeviceClass * selfc)
 {
     XferElementClass *klass = XFER_ELEMENT_CLASS(selfc);
+    GObjectClass *goc = G_OBJECT_CLASS(selfc);
     static xfer_element_mech_pair_t mech_pairs[] = {
 	{ XFER_MECH_NONE, XFER_MECH_PULL_BUFFER, 0, 1},
 	{ XFER_MECH_NONE, XFER_MECH_NONE, 0, 0},
     };
 
+    klass->start = start_impl;
     klass->pull_buffer = pull_buffer_impl;
+    klass->cancel = cancel_impl;
 
     klass->perl_class = "Amanda::Xfer::Source::Device";
     klass->mech_pairs = mech_pairs;
 
+    goc->finalize = finalize_impl;
+
     parent_class = g_type_class_peek_parent(selfc);
 }
 
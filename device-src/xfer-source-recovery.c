@@ -25,6 +25,7 @@
 #include "property.h"
 #include "xfer-device.h"
 #include "conffile.h"
+#include "crc32c.h"
 
 /*
  * Class declaration
@@ -82,6 +83,45 @@ typedef struct XferSourceRecovery {
     /* timer for the duration; NULL while paused or cancelled */
     GTimer *part_timer;
 
+    /* bytes to discard from the beginning of the next part, once the device
+     * has been positioned at the block containing the desired offset */
+    guint64 skip_bytes;
+
+    /* checksum of the part's data, as read from the device */
+    crc32c_part_t part_crc;
+
+    /* thread reading blocks from the device ahead of pull_buffer, part after
+     * part, when not using DirectTCP.  It sends XMSG_PART_DONE as soon as it
+     * reaches the end of a part, so the next part is positioned while the
+     * blocks already read are still being pulled.  It sends XMSG_DONE once
+     * it has stopped using the device. */
+    GThread *reader_thread;
+
+    /* ready_cond is signalled when a block is queued or the reader finishes,
+     * and room_cond when a block is taken from the queue */
+    GCond *ready_cond;
+    GCond *room_cond;
+
+    /* blocks read but not yet pulled, in a ring of ring_len slots */
+    struct {
+	gpointer buf;
+	size_t size;
+    } *ring;
+    guint ring_len, ring_head, ring_count;
+
+    /* set by the reader when there are no more parts or on an error; errmsg
+     * is NULL if there was no error */
+    gboolean reader_done;
+    char *errmsg;
+
+    /* tells the reader to stop, once pull_buffer has returned all it will */
+    gboolean stop_reader;
+
+    /* a buffer the reader did not hand on (a skipped block, or the read that
+     * hit the end of a part), kept for its next read */
+    gpointer spare;
+    size_t spare_size;
+
     gint64   size;
 } XferSourceRecovery;
 
@@ -156,6 +196,14 @@ directtcp_common_thread(
 	if (!self->device)
 	    break;
 
+	/* the device sends whole blocks to the connection */
+	if (self->skip_bytes) {
+	    xfer_cancel_with_error(elt,
+		_("cannot start reading in the middle of a block with DirectTCP"));
+	    g_mutex_unlock(self->start_part_mutex);
+	    goto close_conn_and_send_done;
+	}
+
 	/* read the part */
 	self->part_timer = g_timer_new();
 
@@ -295,6 +343,181 @@ send_done:
     return NULL;
 }
 
+/* allocate a buffer of the current block size, reusing the spare if it
+ * fits; called with start_part_mutex held */
+static gpointer
+get_buffer(
+    XferSourceRecovery *self)
+{
+    gpointer buf = self->spare;
+
+    if (buf && self->spare_size == self->block_size) {
+	self->spare = NULL;
+	return buf;
+    }
+
+    amfree(self->spare);
+    return g_malloc(self->block_size);
+}
+
+static void
+keep_spare(
+    XferSourceRecovery *self,
+    gpointer buf,
+    size_t size)
+{
+    g_free(self->spare);
+    self->spare = buf;
+    self->spare_size = size;
+}
+
+static gpointer
+reader_thread(
+    gpointer data)
+{
+    XferSourceRecovery *self = XFER_SOURCE_RECOVERY(data);
+    XferElement *elt = XFER_ELEMENT(self);
+    gpointer buf;
+    size_t buf_size;
+    int result;
+    int devsize;
+    guint slot;
+    XMsg *msg;
+
+    DBG(1, "(this is reader_thread)");
+
+    g_mutex_lock(self->start_part_mutex);
+
+    while (1) {
+	/* make sure we have a device */
+	while (self->paused && !elt->cancelled && !self->stop_reader)
+	    g_cond_wait(self->start_part_cond, self->start_part_mutex);
+
+	/* stop on an cancel or when there are no more parts */
+	if (elt->cancelled || self->stop_reader || !self->device)
+	    break;
+
+	/* start the timer if this is the first read of this part */
+	if (!self->part_timer) {
+	    DBG(2, "first read of new part");
+	    self->part_timer = g_timer_new();
+	    crc32c_part_init(&self->part_crc);
+	}
+
+	/* wait for room in the ring */
+	while (self->ring_count == self->ring_len
+	       && !elt->cancelled && !self->stop_reader)
+	    g_cond_wait(self->room_cond, self->start_part_mutex);
+	if (elt->cancelled || self->stop_reader)
+	    break;
+
+	/* loop until we read a full block, in case the blocks are larger than
+	 * expected */
+	if (self->block_size == 0)
+	    self->block_size = (size_t)self->device->block_size;
+
+	/* the device is ours until the part is done, so read without the
+	 * lock, letting the consumer take the blocks already read */
+	do {
+	    buf = get_buffer(self);
+	    buf_size = self->block_size;
+	    g_mutex_unlock(self->start_part_mutex);
+	    devsize = (int)buf_size;
+	    result = device_read_block(self->device, buf, &devsize);
+	    g_mutex_lock(self->start_part_mutex);
+
+	    if (result == 0) {
+		g_assert((size_t)devsize > self->block_size);
+		self->block_size = devsize;
+		amfree(buf);
+	    }
+	} while (result == 0);
+
+	/* if this block was successful, queue it, less any bytes we were
+	 * asked to skip */
+	if (result > 0) {
+	    self->part_size += devsize;
+	    crc32c_part_add(&self->part_crc, buf, devsize);
+
+	    if (self->skip_bytes >= (guint64)devsize) {
+		self->skip_bytes -= devsize;
+		keep_spare(self, buf, buf_size);
+		continue;
+	    } else if (self->skip_bytes > 0) {
+		devsize -= self->skip_bytes;
+		memmove(buf, (char *)buf + self->skip_bytes, devsize);
+		self->skip_bytes = 0;
+	    }
+
+	    slot = (self->ring_head + self->ring_count) % self->ring_len;
+	    self->ring[slot].buf = buf;
+	    self->ring[slot].size = devsize;
+	    self->ring_count++;
+	    g_cond_signal(self->ready_cond);
+	    continue;
+	}
+
+	keep_spare(self, buf, buf_size);
+
+	/* if we're not at EOF, it's an error */
+	if (!self->device->is_eof) {
+	    self->errmsg = g_strdup_printf(_("error reading from %s: %s"),
+		self->device->device_name,
+		device_error_or_status(self->device));
+	    break;
+	}
+
+	/* the device has signalled EOF (really end-of-part), so clean up instance
+	 * variables and report the EOP to the caller in the form of an xmsg */
+	DBG(2, "reader hit EOF; sending XMSG_PART_DONE");
+	msg = xmsg_new(XFER_ELEMENT(self), XMSG_PART_DONE, 0);
+	msg->size = self->part_size;
+	msg->duration = g_timer_elapsed(self->part_timer, NULL);
+	msg->partnum = 0;
+	msg->fileno = self->device->file;
+	msg->successful = TRUE;
+	msg->eof = FALSE;
+	msg->crc = g_strdup_printf("crc32c:%08x",
+				   crc32c_part_finish(&self->part_crc));
+
+	self->paused = TRUE;
+	g_object_unref(self->device);
+	self->device = NULL;
+	self->part_size = 0;
+	self->block_size = 0;
+	self->skip_bytes = 0;
+	if (self->part_timer) {
+	    g_timer_destroy(self->part_timer);
+	    self->part_timer = NULL;
+	}
+
+	/* don't queue the XMSG_PART_DONE until we've adjusted all of our
+	 * instance variables appropriately */
+	xfer_queue_message(elt->xfer, msg);
+    }
+
+    self->reader_done = TRUE;
+    g_cond_broadcast(self->ready_cond);
+    g_mutex_unlock(self->start_part_mutex);
+
+    /* the device is not read from here on, so the caller may use it once
+     * the xfer is done */
+    DBG(2, "reader done; sending XMSG_DONE");
+    xfer_queue_message(elt->xfer, xmsg_new(elt, XMSG_DONE, 0));
+
+    return NULL;
+}
+
+/* stop the reader early; called with start_part_mutex held */
+static void
+stop_reader(
+    XferSourceRecovery *self)
+{
+    self->stop_reader = TRUE;
+    g_cond_broadcast(self->start_part_cond);
+    g_cond_broadcast(self->room_cond);
+}
+
 static gboolean
 setup_impl(
     XferElement *elt)
@@ -335,11 +558,29 @@ start_impl(
 	self->thread = g_thread_create(directtcp_listen_thread, (gpointer)self, FALSE, NULL);
 	return TRUE; /* we'll send XMSG_DONE */
     } else {
+	GError *error = NULL;
+
+	/* read ahead as many blocks as fit in device-read-buffer-size, but
+	 * always at least two, so that one can be read while the other is
+	 * consumed */
+	self->ring_len = getconf_size(CNF_DEVICE_READ_BUFFER_SIZE)
+			 / self->device->block_size;
+	if (self->ring_len < 2)
+	    self->ring_len = 2;
+	self->ring = g_malloc0(self->ring_len * sizeof(*self->ring));
+	DBG(2, "reading ahead up to %u blocks", self->ring_len);
+
+	self->reader_thread = g_thread_create(reader_thread, (gpointer)self, TRUE, &error);
+	if (!self->reader_thread) {
+	    g_critical(_("Error creating new thread: %s (%s)"),
+		error->message, errno? strerror(errno) : _("no error code"));
+	}
+
 	/* nothing to prepare for - we're ready already! */
 	DBG(2, "not using DirectTCP: sending XMSG_READY immediately");
 	xfer_queue_message(elt->xfer, xmsg_new(elt, XMSG_READY, 0));
 
-	return FALSE; /* we won't send XMSG_DONE */
+	return TRUE; /* the reader will send XMSG_DONE */
     }
 }
 
@@ -350,94 +591,39 @@ pull_buffer_impl(
 {
     XferSourceRecovery *self = XFER_SOURCE_RECOVERY(elt);
     gpointer buf = NULL;
-    int result;
-    int devsize;
-    XMsg *msg;
+    char *errmsg;
 
     g_assert(elt->output_mech == XFER_MECH_PULL_BUFFER);
     g_mutex_lock(self->start_part_mutex);
 
-    while (1) {
-	/* make sure we have a device */
-	while (self->paused && !elt->cancelled)
-	    g_cond_wait(self->start_part_cond, self->start_part_mutex);
-
-	/* indicate EOF on an cancel or when there are no more parts */
-	if (elt->cancelled || !self->device) {
-            goto error;
-	}
-
-	/* start the timer if this is the first pull_buffer of this part */
-	if (!self->part_timer) {
-	    DBG(2, "first pull_buffer of new part");
-	    self->part_timer = g_timer_new();
-	}
-
-	/* loop until we read a full block, in case the blocks are larger than
-	 * expected */
-	if (self->block_size == 0)
-	    self->block_size = (size_t)self->device->block_size;
-
-	do {
-	    buf = g_malloc(self->block_size);
-	    devsize = (int)self->block_size;
-	    result = device_read_block(self->device, buf, &devsize);
-	    *size = devsize;
+    while (self->ring_count == 0 && !self->reader_done && !elt->cancelled)
+	g_cond_wait(self->ready_cond, self->start_part_mutex);
 
-	    if (result == 0) {
-		g_assert(*size > self->block_size);
-		self->block_size = devsize;
-		amfree(buf);
-	    }
-	} while (result == 0);
-
-	/* if this block was successful, return it */
-	if (result > 0) {
-	    self->part_size += *size;
-	    break;
-	}
-
-	if (result < 0) {
-	    amfree(buf);
-
-	    /* if we're not at EOF, it's an error */
-	    if (!self->device->is_eof) {
-		xfer_cancel_with_error(elt,
-		    _("error reading from %s: %s"),
-		    self->device->device_name,
-		    device_error_or_status(self->device));
-		g_mutex_unlock(self->start_part_mutex);
-		wait_until_xfer_cancelled(elt->xfer);
-                goto error_unlocked;
-	    }
-
-	    /* the device has signalled EOF (really end-of-part), so clean up instance
-	     * variables and report the EOP to the caller in the form of an xmsg */
-	    DBG(2, "pull_buffer hit EOF; sending XMSG_PART_DONE");
-	    msg = xmsg_new(XFER_ELEMENT(self), XMSG_PART_DONE, 0);
-	    msg->size = self->part_size;
-	    msg->duration = g_timer_elapsed(self->part_timer, NULL);
-	    msg->partnum = 0;
-	    msg->fileno = self->device->file;
-	    msg->successful = TRUE;
-	    msg->eof = FALSE;
-
-	    self->paused = TRUE;
-	    g_object_unref(self->device);
-	    self->device = NULL;
-	    self->part_size = 0;
-	    self->block_size = 0;
-	    if (self->part_timer) {
-		g_timer_destroy(self->part_timer);
-		self->part_timer = NULL;
-	    }
+    /* indicate EOF on an cancel */
+    if (elt->cancelled) {
+	goto error;
+    }
 
-	    /* don't queue the XMSG_PART_DONE until we've adjusted all of our
-	     * instance variables appropriately */
-	    xfer_queue_message(elt->xfer, msg);
+    /* indicate EOF when there are no more parts, or an error */
+    if (self->ring_count == 0) {
+	errmsg = self->errmsg;
+	self->errmsg = NULL;
+	g_mutex_unlock(self->start_part_mutex);
+	if (errmsg) {
+	    xfer_cancel_with_error(elt, "%s", errmsg);
+	    g_free(errmsg);
+	    wait_until_xfer_cancelled(elt->xfer);
 	}
+	goto error_unlocked;
     }
 
+    buf = self->ring[self->ring_head].buf;
+    *size = self->ring[self->ring_head].size;
+    self->ring[self->ring_head].buf = NULL;
+    self->ring_head = (self->ring_head + 1) % self->ring_len;
+    self->ring_count--;
+    g_cond_signal(self->room_cond);
+
     g_mutex_unlock(self->start_part_mutex);
 
     if (elt->size > 0) {
@@ -455,6 +641,11 @@ pull_buffer_impl(
 	    /* return only self->size bytes */
 	    *size = self->size;
 	    self->size = -1;
+
+	    /* nothing more will be pulled */
+	    g_mutex_lock(self->start_part_mutex);
+	    stop_reader(self);
+	    g_mutex_unlock(self->start_part_mutex);
 	} else {
 	    self->size -= *size;
 	}
@@ -476,9 +667,11 @@ cancel_impl(
     XferSourceRecovery *self = XFER_SOURCE_RECOVERY(elt);
     elt->cancelled = TRUE;
 
-    /* trigger the condition variable, in case the thread is waiting on it */
+    /* trigger the condition variables, in case a thread is waiting on them */
     g_mutex_lock(self->start_part_mutex);
     g_cond_broadcast(self->start_part_cond);
+    g_cond_broadcast(self->ready_cond);
+    g_cond_broadcast(self->room_cond);
     g_mutex_unlock(self->start_part_mutex);
 
     return TRUE;
@@ -589,11 +782,30 @@ finalize_impl(
 {
     XferSourceRecovery *self = XFER_SOURCE_RECOVERY(obj_self);
 
+    /* the consumer may have stopped pulling before the last part */
+    if (self->reader_thread) {
+	g_mutex_lock(self->start_part_mutex);
+	stop_reader(self);
+	g_mutex_unlock(self->start_part_mutex);
+	g_thread_join(self->reader_thread);
+    }
+
+    while (self->ring_count > 0) {
+	g_free(self->ring[self->ring_head].buf);
+	self->ring_head = (self->ring_head + 1) % self->ring_len;
+	self->ring_count--;
+    }
+    amfree(self->ring);
+    amfree(self->spare);
+    amfree(self->errmsg);
+
     if (self->conn)
 	g_object_unref(self->conn);
     if (self->device)
 	g_object_unref(self->device);
 
+    g_cond_free(self->ready_cond);
+    g_cond_free(self->room_cond);
     g_cond_free(self->start_part_cond);
     g_mutex_free(self->start_part_mutex);
 }
@@ -607,6 +819,8 @@ instance_init(
     self->paused = TRUE;
     self->start_part_cond = g_cond_new();
     self->start_part_mutex = g_mutex_new();
+    self->ready_cond = g_cond_new();
+    self->room_cond = g_cond_new();
 }
 
 static void
@@ -674,6 +888,21 @@ xfer_source_recovery_start_part(
     klass->start_part(XFER_SOURCE_RECOVERY(elt), device);
 }
 
+void
+xfer_source_recovery_skip(
+    XferElement *elt,
+    guint64 bytes)
+{
+    XferSourceRecovery *self;
+    g_assert(IS_XFER_SOURCE_RECOVERY(elt));
+
+    self = XFER_SOURCE_RECOVERY(elt);
+    g_mutex_lock(self->start_part_mutex);
+    g_assert(self->paused);
+    self->skip_bytes = bytes;
+    g_mutex_unlock(self->start_part_mutex);
+}
+
 /* create an element of this class; prototype is in xfer-device.h */
 XferElement *
 xfer_source_recovery(Device *first_device)
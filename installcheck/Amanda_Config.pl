@@ -16,13 +16,14 @@
 # Contact information: Zmanda Inc, 465 S. Mathilda Ave., Suite 300
 # Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
 
-use Test::More tests => 278;
+use Test::More tests => 283;
 use strict;
 use warnings;
 use Data::Dumper;
 
 use lib "@amperldir@";
 use Installcheck::Config;
+use Installcheck::Run qw(run_get);
 use Amanda::Paths;
 use Amanda::Tests;
 use Amanda::Config qw( :init :getconf string_to_boolean amandaify_property_name );
@@ -1237,3 +1238,110 @@ foreach my $exp_ok_columnspec (
     }
 }
 
+
+##
+# Configuration snapshots
+
+{
+    my $conf_file = "$CONFIG_DIR/TESTCONF/amanda.conf";
+    my $snapshot = "$CONFIG_DIR/TESTCONF/amanda.conf.snapshot";
+
+    # a non-default value of every CONFTYPE
+    $testconf = Installcheck::Config->new();
+    $testconf->add_param('config_cache', 'yes');		# BOOLEAN
+    $testconf->add_param('org', '"AAAA"');			# STR
+    $testconf->add_param('reserve', '75');			# INT
+    $testconf->add_param('bumpsize', $int64_num);		# INT64
+    $testconf->add_param('bumpmult', '1.4');			# REAL
+    $testconf->add_param('tapetype', '"snap-tape"');		# IDENT
+    $testconf->add_param('device_output_buffer_size', '640k');	# SIZE
+    $testconf->add_param('taperalgo', 'largestfit');		# TAPERALGO
+    $testconf->add_param('reserved_udp-port', '100,200');	# INTRANGE
+    $testconf->add_param('device_property', '"foo" "bar"');	# PROPLIST
+    $testconf->add_param('send_amreport_on', 'error');		# SEND_AMREPORT_ON
+    $testconf->add_param('autolabel', '"snap-%%%" empty');	# AUTOLABEL
+    $testconf->add_param('autoflush', 'all');			# NO_YES_ALL
+    $testconf->add_tapetype('snap-tape', [
+	'length' => '128 M',
+	'part_cache_type' => 'memory',				# PART_CACHE_TYPE
+    ]);
+    $testconf->add_holdingdisk('snap-hd', [			# IDENTLIST
+	'directory' => '"/mnt/snap-hd"',
+	'chunksize' => '1024k',
+    ]);
+    $testconf->add_application('snap-app', [
+	'plugin' => '"amgtar"',
+	'property' => '"ONE-FILE-SYSTEM" "yes"',
+    ]);
+    $testconf->add_script('snap-script', [
+	'plugin' => '"script-email"',
+	'execute-on' => 'pre-dle-backup, post-dle-backup',	# EXECUTE_ON
+	'execute-where' => 'server',				# EXECUTE_WHERE
+    ]);
+    $testconf->add_dumptype('snap-dump', [
+	'program' => '"APPLICATION"',
+	'application' => '"snap-app"',				# APPLICATION
+	'script' => '"snap-script"',
+	'starttime' => '1829',					# TIME
+	'holdingdisk' => 'required',				# HOLDING
+	'compress' => 'client best',				# COMPRESS
+	'encrypt' => 'server',					# ENCRYPT
+	'strategy' => 'incronly',				# STRATEGY
+	'priority' => 'high',					# PRIORITY
+	'comprate' => '0.25,0.75',				# RATE
+	'estimate' => 'server calcsize client',			# ESTIMATELIST
+	'exclude list' => '"foo" "bar"',			# EXINCLUDE
+	'data-path' => 'directtcp',				# DATA_PATH
+	'recovery-limit' => '"left" same-host',			# HOST_LIMIT
+    ]);
+    $testconf->add_dumptype('snap-dump-child', [
+	'' => 'snap-dump',
+	'comment' => '"inherits from snap-dump"',
+    ]);
+    $testconf->add_interface('snap-nic', [ 'use' => '100' ]);
+    $testconf->add_device('snap-device', [
+	'tapedev' => '"tape:/dev/nst0"',
+	'device_property' => '"BLOCK_SIZE" "128k"',
+    ]);
+    $testconf->add_changer('snap-changer', [
+	'tpchanger' => '"chg-disk:/tmp"',
+	'property' => '"testprop" "testval"',
+    ]);
+    $testconf->add_interactivity('snap-interactivity', [ 'plugin' => '"email"' ]);
+    $testconf->add_taperscan('snap-taperscan', [ 'plugin' => '"traditional"' ]);
+    $testconf->add_dle("localhost /etc snap-dump");
+    $testconf->write();
+
+    # a configuration modified in the second it is parsed is never
+    # snapshotted, so backdate it
+    my $then = time() - 100;
+    utime($then, $then, $conf_file);
+
+    my $parsed = run_get('amadmin', 'TESTCONF', 'config');
+    ok(-f $snapshot, "config-cache writes a configuration snapshot");
+    is(run_get('amadmin', 'TESTCONF', 'config'), $parsed,
+	"configuration loaded from the snapshot is the one parsed");
+
+    # an edit that keeps amanda.conf's size and mtime goes unnoticed, which
+    # shows that the previous load really came from the snapshot
+    my $text = do { local $/; open(my $fh, "<", $conf_file); <$fh> };
+    $text =~ s/"AAAA"/"BBBB"/;
+    open(my $fh, ">", $conf_file);
+    print $fh $text;
+    close($fh);
+    utime($then, $then, $conf_file);
+    is(run_get('amadmin', 'TESTCONF', 'config'), $parsed,
+	"snapshot is used while amanda.conf's mtime is unchanged");
+
+    utime($then + 10, $then + 10, $conf_file);
+    like(run_get('amadmin', 'TESTCONF', 'config'), qr/ORG\s+"BBBB"/,
+	"a new mtime on amanda.conf invalidates the snapshot");
+
+    $text =~ s/config_cache yes/config_cache no/;
+    open($fh, ">", $conf_file);
+    print $fh $text;
+    close($fh);
+    utime($then + 20, $then + 20, $conf_file);
+    run_get('amadmin', 'TESTCONF', 'config');
+    ok(!-e $snapshot, "turning config-cache off removes the stale snapshot");
+}
@@ -16,20 +16,23 @@
 # Contact information: Zmanda Inc, 465 S. Mathilda Ave., Suite 300
 # Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
 
-use Test::More tests => 16;
+use Test::More tests => 24;
 use strict;
 use warnings;
 use File::Path;
 use Data::Dumper;
+use Time::HiRes;
 
 use lib "@amperldir@";
 use Installcheck;
 use Installcheck::Config;
+use Installcheck::Run qw(run run_get $diskname amdump_diag);
 use Amanda::Holding;
 use Amanda::Header;
 use Amanda::Debug;
 use Amanda::Config qw( :init );
 use Amanda::Disklist;
+use Amanda::Logfile;
 
 # put the debug messages somewhere
 Amanda::Debug::dbopen("installcheck");
@@ -186,6 +189,66 @@ ok(!-f "$holding2/20070306123456/audio._var", "..first chunk gone");
 ok(!-f "$holding2/20070306123456/audio._var.1", "..second chunk gone");
 ok(!-f "$holding2/20070306123456/audio._var.2", "..third chunk gone");
 
+# the C side keeps a manifest on each holding disk
+sub holding_labels {
+    return [ sort map { $_->{'label'} } Amanda::Logfile::search_holding_disk() ];
+}
+
+my @remaining = sort(
+	"$holding1/20070303000000/videoserver._video_a",
+	"$holding1/20070306123456/videoserver._video_a",
+	"$holding1/20070306123456/videoserver._video_b",
+	"$holding2/20070306123456/audio._usr",
+    );
+is_deeply(holding_labels(), [ @remaining ],
+    "search_holding_disk finds the remaining files");
+ok(-f "$holding1/.holding-manifest", "..and leaves a manifest behind");
+is_deeply([ sort(+Amanda::Holding::files()) ], [ @remaining ],
+    "the manifest is not mistaken for a holding directory");
+
+make_holding_file($holding1, '20070306123456', 'videoserver', '/video/c', 2);
+is_deeply(holding_labels(),
+    [ sort(@remaining, "$holding1/20070306123456/videoserver._video_c") ],
+    "a file added behind the manifest's back is found");
+
 rmtree($holding1);
 rmtree($holding2);
 rmtree($holding3);
+
+# a holding directory changed only by Amanda stays current in the manifest,
+# so listing it after a dump, or after a deletion, reads no headers
+Installcheck::Run::cleanup();
+$testconf = Installcheck::Run::setup();
+$testconf->add_dle("localhost $diskname installcheck-test");
+$testconf->add_dle("localhost $diskname/dir installcheck-test");
+$testconf->write();
+
+ok(run('amdump', 'TESTCONF', '--no-taper'),
+    "amdump --no-taper leaves two dumps on the holding disk")
+    or amdump_diag("amdump --no-taper failed");
+my @listed = split(/\n/, run_get('amadmin', 'TESTCONF', 'holding', 'list'));
+is(scalar @listed, 2, "..and both are listed");
+
+ok(run('amadmin', 'TESTCONF', 'holding', 'delete', 'localhost', "$diskname/dir"),
+    "one of them is deleted");
+
+SKIP: {
+    my ($hdir) = glob("$Installcheck::Run::holdingdir/*");
+    my $mtime = (Time::HiRes::stat($hdir))[9];
+    skip "the filesystem does not keep sub-second mtimes", 1
+	unless $mtime != int($mtime);
+
+    # damage every chunk header in place, which leaves the directory's mtime
+    # alone; a listing that read the headers would find no dump at all
+    for my $chunk (glob("$hdir/*")) {
+	open(my $fh, "+<", $chunk) or die("opening '$chunk': $!");
+	print $fh "X" x 64;
+	close($fh);
+    }
+    @listed = split(/\n/, run_get('amadmin', 'TESTCONF', 'holding', 'list'));
+    ok(@listed == 1 && $listed[0] =~ /\Q$diskname\E / && $listed[0] !~ /dir/,
+	"the remaining dump is listed from the manifest, without reading headers")
+	or diag(join("\n", @listed));
+}
+
+Installcheck::Run::cleanup();
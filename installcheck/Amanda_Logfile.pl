@@ -16,7 +16,7 @@
 # Contact information: Zmanda Inc, 465 S. Mathilda Ave., Suite 300
 # Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
 
-use Test::More tests => 39;
+use Test::More tests => 51;
 use File::Path;
 use strict;
 use warnings;
@@ -153,6 +153,57 @@ is_deeply([ get_logline($logfile) ],
 ok(!get_logline($logfile), "no next line");
 close_logfile($logfile);
 
+##
+# Test indexed logfiles
+
+$logdata = <<'END';
+START planner date 20071026183200
+DISK planner host1 /usr
+DISK planner host2 "/my disk"
+
+SUCCESS dumper host1 /usr 20071026183200 0 [sec 1.0 kb 10 kps 10.0 orig-kb 10]
+STRANGE dumper host2 "/my disk" 20071026183200 1 [sec 1.0 kb 10 kps 10.0 orig-kb 10]
+  | something strange
+PART taper TAPE-1 1 host1 /usr 20071026183200 1/-1 0 [sec 1.0 bytes 10240 kps 10.0]
+DONE taper host1 /usr 20071026183200 1 0 [sec 1.0 bytes 10240 kps 10.0 orig-kb 10]
+INFO taper an escaped \
+newline
+FAIL taper host2 "/my disk" 20071026183200 1 [error "split
+in quotes"]
+END
+
+my $logidx = Amanda::Logfile::index_logfile(write_logfile($logdata));
+ok($logidx, "can index a logfile");
+is($logidx->nlines(), 10, "..and it has the right number of lines");
+is_deeply([ $logidx->get_line(0) ],
+	  [ $L_START, $P_PLANNER, "date 20071026183200" ],
+	  "..gets a line as get_logline does");
+is_deeply([ $logidx->get_line(5) ],
+	  [ $L_CONT, $P_DUMPER, "| something strange" ],
+	  "..and a continuation line");
+is_deeply([ $logidx->get_line(8) ],
+	  [ $L_INFO, $P_TAPER, "an escaped newline" ],
+	  "..and a line with an escaped newline");
+ok(!$logidx->get_line(10), "..and nothing past the end");
+is_deeply([ $logidx->get_dle_line(6) ],
+	  [ "host1", "/usr", "20071026183200", "1/-1 0 [sec 1.0 bytes 10240 kps 10.0]" ],
+	  "..splits a PART line");
+is_deeply([ $logidx->get_dle_line(9) ],
+	  [ "host2", "/my disk", "20071026183200", "1 [error \"split\nin quotes\"]" ],
+	  "..and a FAIL line with a quoted disk and a newline in quotes");
+is_deeply([ $logidx->lookup("host1", "/usr", "20071026183200") ], [ 3, 6, 7 ],
+	  "..finds the lines about a dump");
+is_deeply([ $logidx->lookup("host2", undef, undef) ], [ 2, 4, 9 ],
+	  "..and about a host");
+is_deeply([ $logidx->dles() ],
+	  [ [ "host1", "/usr", undef ], [ "host2", "/my disk", undef ],
+	    [ "host1", "/usr", "20071026183200" ],
+	    [ "host2", "/my disk", "20071026183200" ] ],
+	  "..and lists the dles");
+eval { Amanda::Logfile::LogIndex->new(); };
+like($@, qr/made by index_logfile/,
+     "a LogIndex cannot be made but by index_logfile");
+
 ## HIGHER-LEVEL FUNCTIONS
 
 # a utility function for is_deeply checks, below.  Converts a hash to
@@ -16,7 +16,7 @@
 # Contact information: Zmanda Inc, 465 S. Mathilda Ave., Suite 300
 # Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
 
-use Test::More tests => 21;
+use Test::More tests => 23;
 use File::Path;
 use Data::Dumper;
 use strict;
@@ -330,6 +330,7 @@ sub try_recovery {
     my $clerk = $params{'clerk'};
     my $result;
     my $running_xfers = 0;
+    my $buffer_dest;
 
     my $finished_cb = \&Amanda::MainLoop::quit;
     my $steps = define_steps
@@ -338,6 +339,7 @@ sub try_recovery {
     step start => sub {
 	$clerk->get_xfer_src(
 	    dump => $params{'dump'},
+	    offset => $params{'offset'},
 	    xfer_src_cb => $steps->{'xfer_src_cb'});
     };
 
@@ -365,6 +367,8 @@ sub try_recovery {
 	my $xfer_dest;
 	if ($params{'directtcp'}) {
 	    $xfer_dest = Amanda::Xfer::Dest::DirectTCPListen->new();
+	} elsif (defined $params{'expect_data'}) {
+	    $xfer_dest = $buffer_dest = Amanda::Xfer::Dest::Buffer->new(0);
 	} else {
 	    $xfer_dest = Amanda::Xfer::Dest::Null->new($params{'seed'});
 	}
@@ -430,6 +434,8 @@ sub try_recovery {
 	    if ($result->{'result'} ne 'DONE') {
 		diag("XXX no errors but result is " . $result->{'result'});
 		fail($msg);
+	    } elsif ($buffer_dest) {
+		ok($buffer_dest->get() eq $params{'expect_data'}, $msg);
 	    } else {
 		pass($msg);
 	    }
@@ -441,6 +447,29 @@ sub try_recovery {
     Amanda::MainLoop::run();
 }
 
+# return the first LENGTH bytes generated by Source::Random with SEED
+sub random_bytes {
+    my ($length, $seed) = @_;
+    my $dest = Amanda::Xfer::Dest::Buffer->new(0);
+    my $xfer = Amanda::Xfer->new([
+	Amanda::Xfer::Source::Random->new($length, $seed),
+	$dest,
+    ]);
+
+    $xfer->start(sub {
+	my ($src, $msg, $xfer) = @_;
+	if ($msg->{type} == $XMSG_ERROR) {
+	    die $msg->{elt} . " failed: " . $msg->{message};
+	} elsif ($msg->{'type'} == $XMSG_DONE) {
+	    $src->remove();
+	    Amanda::MainLoop::quit();
+	}
+    });
+    Amanda::MainLoop::run();
+
+    return $dest->get();
+}
+
 sub quit_clerk {
     my ($clerk) = @_;
 
@@ -552,6 +581,28 @@ try_recovery(
     directtcp => 1,
     msg => "holding-disk recovery, with directtcp");
 
+# recover starting partway into a dump
+
+try_recovery(
+    clerk => $clerk,
+    dump => fake_dump("usr", "/usr", $datestamp, 0,
+	{ label => 'TESTCONF01', filenum => 2, bytes => 512*1024 },
+	{ label => 'TESTCONF01', filenum => 3, bytes => 512*1024 },
+	{ label => 'TESTCONF02', filenum => 1, bytes => 64*1024 },
+    ),
+    offset => 600*1024+100,
+    expect_data => substr(random_bytes(1024*1088, 0xF001), 600*1024+100),
+    msg => "recovery from an offset within the second part");
+
+try_recovery(
+    clerk => $clerk,
+    dump => fake_dump("heldhost", "/to/holding", '21001010101010', 1,
+	{ holding_file => $holding_file },
+    ),
+    offset => 10000,
+    expect_data => substr(random_bytes(1024*$holding_kb, $holding_key), 10000),
+    msg => "holding-disk recovery from an offset");
+
 # try some expected failures
 
 try_recovery(
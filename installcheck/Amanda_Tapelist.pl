@@ -16,7 +16,7 @@
 # Contact information: Zmanda Inc, 465 S. Mathilda Ave., Suite 300
 # Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
 
-use Test::More tests => 26;
+use Test::More tests => 35;
 use strict;
 use warnings;
 
@@ -242,3 +242,77 @@ is_deeply($tl, {
     'barcode' => undef, 'meta' => undef, 'comment' => undef },
 ] }, "reload works");
 
+# a relabel rewrites the tapelist file, which the C side reads back
+mktapelist($tapelist,
+    "20071111010002 TESTCONF004 reuse\n",
+    "20071110010002 TESTCONF003 reuse\n",
+);
+$tl = Amanda::Tapelist->new($tapelist);
+$tl->remove_tapelabel("TESTCONF003");
+$tl->add_tapelabel("0", "TESTCONF005", undef, 1);
+$tl->write();
+is_deeply([ readtapelist($tapelist) ],
+    [ "20071111010002 TESTCONF004 reuse\n",
+      "0 TESTCONF005 reuse\n" ],
+    "write rewrites the tapelist file");
+is(Amanda::Tapelist::list_new_tapes(1),
+    "The next new tape already labelled is: TESTCONF005.",
+    ".. and the C tapelist reads it");
+
+# a relabel appends a line to the tapelist file, which replaces the earlier
+# line for that label for both Perl and C
+@lines = (
+    "20071111010002 TESTCONF004 reuse\n",
+    "20071110010002 TESTCONF003 reuse\n",
+);
+mktapelist($tapelist, @lines);
+$tl = Amanda::Tapelist->new($tapelist);
+$tl->remove_tapelabel("TESTCONF003");
+$tl->add_tapelabel("20071112010002", "TESTCONF003", undef, 1);
+$tl->write();
+push @lines, "20071112010002 TESTCONF003 reuse\n";
+is_deeply([ readtapelist($tapelist) ], \@lines,
+    "write appends a relabeled volume to the tapelist file");
+
+$tl = Amanda::Tapelist->new($tapelist);
+is_deeply([ map { "$_->{'position'} $_->{'label'} $_->{'datestamp'}" } @{$tl->{'tles'}} ],
+    [ "1 TESTCONF003 20071112010002", "2 TESTCONF004 20071111010002" ],
+    ".. and the later line replaces the earlier one");
+is(Amanda::Tapelist::get_last_reusable_tape_label(0), 'TESTCONF004',
+    ".. for the C tapelist too");
+
+# a new volume is appended, unless another has its datestamp: the line would
+# read back after that volume rather than before it
+$tl->add_tapelabel("0", "TESTCONF005", undef, 1);
+$tl->write();
+push @lines, "0 TESTCONF005 reuse\n";
+is_deeply([ readtapelist($tapelist) ], \@lines,
+    "write appends a new volume");
+
+$tl->add_tapelabel("0", "TESTCONF006", undef, 1);
+$tl->write();
+is_deeply([ readtapelist($tapelist) ],
+    [ "20071112010002 TESTCONF003 reuse\n",
+      "20071111010002 TESTCONF004 reuse\n",
+      "0 TESTCONF006 reuse\n",
+      "0 TESTCONF005 reuse\n" ],
+    ".. but rewrites the file for a new volume with the datestamp of another");
+
+# a last line without a newline, left by a crash while appending, is ignored,
+# and the next write rewrites the file without it
+open(my $fh, ">>", $tapelist) or die("Could not append to '$tapelist'");
+print $fh "20071113010002 TESTCONF007 re";
+close($fh);
+$tl = Amanda::Tapelist->new($tapelist);
+is_deeply([ map { $_->{'label'} } @{$tl->{'tles'}} ],
+    [ "TESTCONF003", "TESTCONF004", "TESTCONF006", "TESTCONF005" ],
+    "a last line without a newline is ignored");
+$tl->add_tapelabel("20071114010002", "TESTCONF008", undef, 1);
+$tl->write();
+is_deeply([ readtapelist($tapelist) ],
+    [ "20071114010002 TESTCONF008 reuse\n",
+      "20071112010002 TESTCONF003 reuse\n",
+      "20071111010002 TESTCONF004 reuse\n",
+      "0 TESTCONF006 reuse\n",
+      "0 TESTCONF005 reuse\n" ],
+    ".. and the next write rewrites the file without it");
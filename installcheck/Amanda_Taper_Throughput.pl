@@ -0,0 +1,88 @@
+# Copyright (c) Zmanda Inc.  All Rights Reserved.
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 as published
+# by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+# or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program; if not, write to the Free Software Foundation, Inc.,
+# 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+#
+# Contact information: Zmanda Inc, 465 S. Mathilda Ave., Suite 300
+# Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
+
+use Test::More tests => 10;
+use strict;
+use warnings;
+
+use lib "@amperldir@";
+use Installcheck;
+use Amanda::Debug;
+use Amanda::Taper::Throughput;
+
+# set up debugging so debug output doesn't interfere with test results
+Amanda::Debug::dbopen("installcheck");
+Installcheck::log_test_output();
+
+# and disable Debug's die() and warn() overrides
+Amanda::Debug::disable_die_override();
+
+my $filename = "$Installcheck::TMP/taper-throughput";
+unlink($filename);
+
+my $MB = 1024*1024;
+my %dev = (device => "file/TEST-TAPE", block_size => 32768);
+my %bounds = (%dev, part_size => 4*$MB, min => 1*$MB, max => 8*$MB);
+
+my $tput = Amanda::Taper::Throughput->new(filename => $filename);
+my ($size, $why);
+
+# write N full parts of SIZE at RATE MB/s
+sub parts {
+    my ($t, $n, $size, $rate) = @_;
+    $t->add_part(%dev, part_size => $size, size => $size,
+		 duration => $size / ($rate * $MB))
+	for (1 .. $n);
+}
+
+($size, $why) = $tput->choose_part_size(%bounds);
+is($size, 4*$MB, "the configured part size is measured first");
+like($why, qr/^measuring, 1 of 3/, "..and the reason says so");
+
+parts($tput, 3, 4*$MB, 50);
+($size, $why) = $tput->choose_part_size(%bounds);
+is($size, 8*$MB, "then the largest size");
+
+parts($tput, 3, 8*$MB, 80);
+parts($tput, 3, 2*$MB, 40);
+parts($tput, 3, 1*$MB, 20);
+($size, $why) = $tput->choose_part_size(%bounds);
+is($size, 8*$MB, "once all are measured, the fastest is chosen");
+is($why, "best measured, 80.0 MB/s", "..and the reason gives its throughput");
+
+($size, $why) = $tput->choose_part_size(%bounds, dump_size => 5*$MB);
+is($size, 4*$MB, "sizes larger than the dump are not chosen");
+
+($size, $why) = $tput->choose_part_size(%bounds, dump_size => $MB/2);
+is_deeply([$size, $why], [4*$MB, "dump fits in one part"],
+	  "a dump smaller than the smallest part keeps the configured size");
+
+# the device slows down with big parts; the average follows it
+parts($tput, 8, 8*$MB, 30);
+($size, $why) = $tput->choose_part_size(%bounds);
+is($size, 4*$MB, "recent parts outweigh old ones");
+
+$tput->save();
+my $tput2 = Amanda::Taper::Throughput->new(filename => $filename);
+is_deeply([$tput2->choose_part_size(%bounds)], [$tput->choose_part_size(%bounds)],
+	  "the history is saved and reloaded");
+
+($size, $why) = $tput2->choose_part_size(%bounds, block_size => 65536);
+is($size, 4*$MB, "another block size has its own history");
+
+unlink($filename);
@@ -16,7 +16,7 @@
 # Contact information: Zmanda Inc, 465 S. Mathilda Ave., Suite 300
 # Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
 
-use Test::More tests => 46;
+use Test::More tests => 47;
 use File::Path;
 use Data::Dumper;
 use strict;
@@ -376,7 +376,7 @@ pass("Two simultaneous transfers run to completion");
 }
 
 SKIP: {
-    skip "not built with server", 25 unless Amanda::Util::built_with_component("server");
+    skip "not built with server", 26 unless Amanda::Util::built_with_component("server");
 
     my $disk_cache_dir = "$Installcheck::TMP";
     my $RANDOM_SEED = 0xFACADE;
@@ -994,6 +994,27 @@ SKIP: {
 	. "acts as a source and supplies cache_inform",
 	disable_leom => 1);
 
+    # an offset past the end of the holding chunks is an error
+    {
+	my $src = Amanda::Xfer::Source::Holding->new($holding_file);
+	my $xfer = Amanda::Xfer->new([ $src, Amanda::Xfer::Dest::Null->new(0) ]);
+	my $got_err = 0;
+
+	$src->skip(3 * 64 * 32768 + 1);
+	$xfer->start(sub {
+	    my ($src, $msg, $xfer) = @_;
+	    if ($msg->{'type'} == $XMSG_ERROR) {
+		$got_err = 1;
+	    } elsif ($msg->{'type'} == $XMSG_DONE) {
+		$src->remove();
+		Amanda::MainLoop::quit();
+	    }
+	});
+	Amanda::MainLoop::run();
+
+	ok($got_err, "Amanda::Xfer::Source::Holding reports an offset past the end of the dump");
+    }
+
     ##
     # test the cache_inform method
 
@@ -16,7 +16,7 @@
 # Contact information: Zmanda Inc, 465 S. Mathilda Ave., Suite 300
 # Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
 
-use Test::More tests => 4;
+use Test::More tests => 6;
 use strict;
 use warnings;
 
@@ -86,4 +86,31 @@ open(my $logfile, "<", "$CONFIG_DIR/TESTCONF/log/log")
 my $logline = grep(/^\S+ planner localhost diskname2 \d* 0 \[client custom compression with no compression program specified\]/, <$logfile>);
 ok($logline, "planner fail without 'client custom compression with no compression program specified'");
 
+# Two dumps with server compression, run at the same time by one dumper
+# process, each reaping its own compress process
+$testconf = Installcheck::Run::setup();
+$testconf->add_param('autolabel', '"TESTCONF%%" empty volume_error');
+$testconf->add_param('inparallel', '2');
+$testconf->add_param('dumper-parallel-dumps', '2');
+for my $dle ('diskname1', 'diskname2') {
+    $testconf->add_dle(<<EODLE);
+localhost $dle $diskname {
+    installcheck-test
+    program "GNUTAR"
+    compress server fast
+    maxdumps 2
+}
+EODLE
+}
+$testconf->write();
+
+ok(run('amdump', 'TESTCONF'), "amdump runs two compressed dumps in one dumper")
+    or amdump_diag();
+open($logfile, "<", "$CONFIG_DIR/TESTCONF/log/log")
+	or die("opening log: $!");
+my @successes = grep(/^SUCCESS dumper localhost diskname[12] /, <$logfile>);
+close($logfile);
+is(scalar @successes, 2, "..both dumps succeed")
+    or diag(@successes);
+
 Installcheck::Run::cleanup();
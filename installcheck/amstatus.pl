@@ -16,7 +16,7 @@
 # Contact information: Zmanda Inc, 465 S. Mathilda Ave., Suite 300
 # Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
 
-use Test::More tests => 10;
+use Test::More tests => 24;
 use strict;
 use warnings;
 
@@ -24,6 +24,7 @@ use lib "@amperldir@";
 use Installcheck;
 use Installcheck::Run qw( run run_get );
 use Installcheck::Catalogs;
+use Installcheck::Dumpcache;
 use Amanda::Paths;
 use Amanda::Constants;
 
@@ -75,3 +76,114 @@ is($Installcheck::Run::exit_code, 4,
 like($Installcheck::Run::stdout,
     qr{localhost:/etc 0 backup failed: dumper: \[/usr/sbin/tar returned error\] \(7:49:23\)},
     "output is correct");
+
+## the driver's live status snapshot, as a finished amdump leaves it
+
+Installcheck::Dumpcache::load('basic');
+my $logdir = "$CONFIG_DIR/TESTCONF/log";
+my $timestamp = $Installcheck::Dumpcache::timestamps[0];
+my %status;
+my @dles;
+my @bad;
+open(my $status_fh, "<", "$logdir/driver.status")
+    or die("opening driver.status: $!");
+while (my $line = <$status_fh>) {
+    chomp $line;
+    if ($line =~ /^dle /) {
+	push @dles, $line;
+    } elsif ($line =~ /^(qlen \w+) (\d+)$/
+	  || $line =~ /^(pid|updated|finished|free-kps|free-space|idle-dumpers) (\d+)$/
+	  || $line =~ /^(datestamp|time|taper|driver-idle) (\S+)$/) {
+	$status{$1} = $2;
+    } else {
+	push @bad, $line;
+    }
+}
+close($status_fh);
+
+is_deeply([ @bad ], [],
+    "every line of driver.status is in the documented format");
+is_deeply([ map { $status{$_} } qw(datestamp finished) ], [ $timestamp, 1 ],
+    "..it is the snapshot of the finished run");
+is_deeply([ map { exists $status{"qlen $_"} } qw(waitq runq directq roomq tapeq) ],
+    [ 1, 1, 1, 1, 1 ],
+    "..with the length of each queue");
+is(scalar @dles, 1,
+    "..and a line for the dle");
+like($dles[0],
+    qr{^dle localhost \Q$Installcheck::Run::diskname\E $timestamp 0 done - \d+ \d+$},
+    "..which is done");
+
+# amdump has been renamed, so the snapshot is from an earlier run
+run('amstatus', 'TESTCONF', '--live');
+like($Installcheck::Run::stdout, qr{^No running driver}m,
+    "amstatus --live does not show a finished run's snapshot");
+
+## and a snapshot of a running driver, with this process standing in for it
+
+my $pid = $$;
+
+open(my $amdump_fh, ">", "$logdir/amdump") or die("writing amdump: $!");
+print $amdump_fh "amdump: starttime 20100722000000\n";
+close($amdump_fh);
+
+sub write_live_status {
+    my ($datestamp) = @_;
+    my $now = time;
+
+    open(my $fh, ">", "$logdir/driver.status")
+	or die("writing driver.status: $!");
+    print $fh <<EOF;
+pid $pid
+datestamp $datestamp
+time 12.345
+updated $now
+finished 0
+free-kps 600
+free-space 10240
+taper writing
+idle-dumpers 1
+driver-idle no-dumpers
+qlen waitq 0
+qlen runq 1
+qlen directq 0
+qlen roomq 0
+qlen tapeq 0
+dle clienthost /some/dir 20100722000000 0 dumping dumper0 2048 1024
+dle clienthost "C:\\\\Some Dir\\\\" 20100722000000 1 writing taper0 100 100
+dle clienthost /waiting 20100722000000 0 wait-dump - 300 0
+dle clienthost /broken 20100722000000 0 failed - 10 0
+EOF
+    close($fh);
+}
+
+write_live_status('20100722000000');
+ok(!run('amstatus', 'TESTCONF', '--live'),
+    "amstatus --live reads a running driver's snapshot");
+is($Installcheck::Run::exit_code, 4,
+    "..and its exit status shows the failed dle");
+like($Installcheck::Run::stdout, qr{^From driver $pid, datestamp 20100722000000, running$}m,
+    "..from this driver");
+like($Installcheck::Run::stdout,
+    qr{^clienthost:/some/dir\s+0\s+1024k\s+2048k dumping \(dumper0\)$}m,
+    "..shows a dle being dumped");
+like($Installcheck::Run::stdout,
+    # note that amstatus' output is quoted, so backslashes are doubled
+    qr{^clienthost:"C:\\\\Some Dir\\\\"\s+1\s+100k\s+100k writing \(taper0\)$}m,
+    "..and a quoted diskname being written");
+like($Installcheck::Run::stdout,
+    qr{^clienthost:/broken\s+0\s+0k\s+10k failed$}m,
+    "..and a failed dle");
+
+run('amstatus', 'TESTCONF', '--live', '--summary');
+like($Installcheck::Run::stdout,
+    qr{^partition       :   4$.*^dumping         :   1      1024k$.*^free kps        : 600$}ms,
+    "amstatus --live --summary counts the dles");
+
+# a snapshot whose datestamp is not that of the amdump file is stale
+write_live_status('20100721000000');
+run('amstatus', 'TESTCONF', '--live');
+like($Installcheck::Run::stdout, qr{^No running driver}m,
+    "amstatus --live ignores a snapshot from another run");
+
+Installcheck::Run::cleanup();
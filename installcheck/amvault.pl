@@ -16,7 +16,7 @@
 # Contact information: Zmanda Inc, 465 S. Mathilda Ave., Suite 300
 # Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
 
-use Test::More tests => 11;
+use Test::More tests => 14;
 use strict;
 use warnings;
 
@@ -38,8 +38,9 @@ Amanda::Debug::dbopen("installcheck");
 
 my $vtape_root = "$Installcheck::TMP/tertiary";
 sub setup_chg_disk {
+    my ($nslots) = @_;
     rmtree $vtape_root if -d $vtape_root;
-    mkpath "$vtape_root/slot1";
+    mkpath "$vtape_root/slot$_" for 1 .. ($nslots || 1);
     return "chg-disk:$vtape_root";
 }
 
@@ -171,6 +172,39 @@ is_deeply([ get_dry_run("$sbindir/amvault",
     [ "TESTCONF02", "1", "localhost", "$diskname/dir",     "1" ]
     ], "amvault with a disk expression dumps only that disk");
 
+# vault the fulls with two lanes.  They are on two source volumes, so each lane
+# reads one of them, through the scan the lanes share, and writes its own
+# tertiary volume
+$tertiary_chg = setup_chg_disk(2);
+ok(run("$sbindir/amvault",
+		'--parallel-dumps', '2',
+		'--autolabel=any',
+		'--label-template', "TESTCONF%%",
+		'--fulls-only',
+		'--dst-changer', $tertiary_chg,
+		'TESTCONF'),
+    "amvault runs with two lanes")
+    or diag($Installcheck::Run::stderr);
+
+my $vault_ts = Amanda::DB::Catalog::get_latest_write_timestamp(type => 'amvault');
+my @vaulted = Amanda::DB::Catalog::sort_dumps([ 'diskname', 'dump_timestamp' ],
+	Amanda::DB::Catalog::get_dumps(write_timestamp => $vault_ts));
+is_deeply([ map { [ $_->{'diskname'}, $_->{'level'}, $_->{'status'} ] } @vaulted ], [
+    [ "$diskname",     0, "OK" ],
+    [ "$diskname",     0, "OK" ],
+    [ "$diskname/dir", 0, "OK" ],
+    ], "..and every full is vaulted")
+    or diag(Dumper(@vaulted));
+
+my %tert_labels = map { $_->{'label'} => 1 }
+		  grep { defined }
+		  map { @{$_->{'parts'}} } @vaulted;
+is(scalar keys %tert_labels, 2,
+    "..onto two tertiary volumes, one for each lane")
+    or diag(Dumper(\%tert_labels));
+
+rmtree $vtape_root;
+
 # Test NDMP-to-NDMP vaulting.  This will test all manner of goodness:
 #  - specifying a named changer on the amvault command line
 #  - exporting
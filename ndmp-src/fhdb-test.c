@@ -0,0 +1,380 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
+ */
+
+#include "ndmlib.h"
+#include "testutils.h"
+
+/*
+ * Utils
+ */
+
+/* an index, in the order the lines were added */
+static GPtrArray *index_lines;
+
+static void
+index_add(
+    char *line)
+{
+    g_ptr_array_add(index_lines, line);
+}
+
+static void
+index_add_dir(
+    unsigned long long dir_node,
+    char *raw_name,
+    unsigned long long node)
+{
+    char namebuf[NDMOS_CONST_PATH_MAX];
+
+    ndmcstr_from_str(raw_name, namebuf, sizeof namebuf);
+    index_add(g_strdup_printf("DHd %llu %s UNIX %llu", dir_node, namebuf, node));
+}
+
+static void
+index_add_node(
+    unsigned long long node,
+    char *stat)
+{
+    index_add(g_strdup_printf("DHn %llu UNIX %s", node, stat));
+}
+
+static void
+index_add_file(
+    char *raw_name,
+    char *stat)
+{
+    char namebuf[NDMOS_CONST_PATH_MAX];
+
+    ndmcstr_from_str(raw_name, namebuf, sizeof namebuf);
+    index_add(g_strdup_printf("DHf %s UNIX %s", namebuf, stat));
+}
+
+static void
+index_free(void)
+{
+    guint i;
+
+    for (i = 0; i < index_lines->len; i++)
+	g_free(g_ptr_array_index(index_lines, i));
+    g_ptr_array_free(index_lines, TRUE);
+    index_lines = NULL;
+}
+
+static int
+cmp_lines(
+    const void *a,
+    const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* write the index to a new temporary file, sorted as the text lookups need
+ * it, or not, as ndmfhdb_compile accepts it */
+static FILE *
+index_write(
+    gboolean sorted)
+{
+    FILE *fp = tmpfile();
+    char **lines;
+    guint i;
+
+    if (!fp)
+	return NULL;
+
+    lines = g_memdup(index_lines->pdata, index_lines->len * sizeof(char *));
+    if (sorted)
+	qsort(lines, index_lines->len, sizeof(char *), cmp_lines);
+    for (i = 0; i < index_lines->len; i++)
+	g_fprintf(fp, "%s\n", lines[i]);
+    g_free(lines);
+
+    fflush(fp);
+    return fp;
+}
+
+/* compile the unsorted index, and open both it and the sorted text index */
+static gboolean
+open_both(
+    struct ndmfhdb *text,
+    struct ndmfhdb *bin)
+{
+    FILE *text_fp = index_write(TRUE);
+    FILE *raw_fp = index_write(FALSE);
+    FILE *bin_fp = tmpfile();
+    int n_entries = 0;
+    guint i;
+    int rc;
+
+    if (!text_fp || !raw_fp || !bin_fp)
+	return FALSE;
+
+    /* every file history line but the root is an entry */
+    for (i = 0; i < index_lines->len; i++) {
+	char *line = g_ptr_array_index(index_lines, i);
+	if (g_str_has_prefix(line, "DH") && line[2] != 'r')
+	    n_entries++;
+    }
+
+    rc = ndmfhdb_compile(raw_fp, bin_fp);
+    fclose(raw_fp);
+    if (rc != n_entries) {
+	tu_dbg("ndmfhdb_compile returned %d; expected %d\n", rc, n_entries);
+	return FALSE;
+    }
+
+    if (ndmfhdb_open(text_fp, text) != 0) {
+	tu_dbg("could not open the text index\n");
+	return FALSE;
+    }
+    if (ndmfhdb_open(bin_fp, bin) != 0) {
+	tu_dbg("could not open the compiled index\n");
+	return FALSE;
+    }
+    if (!bin->bin_base) {
+	tu_dbg("the compiled index was read as text\n");
+	return FALSE;
+    }
+    if (bin->use_dir_node != text->use_dir_node ||
+	bin->root_node != text->root_node) {
+	tu_dbg("the indexes disagree on the root: %d/%llu and %d/%llu\n",
+	       text->use_dir_node, text->root_node,
+	       bin->use_dir_node, bin->root_node);
+	return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+close_both(
+    struct ndmfhdb *text,
+    struct ndmfhdb *bin)
+{
+    fclose(text->fp);
+    ndmfhdb_close(text);
+    fclose(bin->fp);
+    ndmfhdb_close(bin);
+}
+
+/* look PATH up in both indexes; EXPECTED is its stat, or NULL if it is not
+ * in the index */
+static gboolean
+check_lookup(
+    struct ndmfhdb *text,
+    struct ndmfhdb *bin,
+    char *path,
+    char *expected)
+{
+    ndmp9_file_stat fstat;
+    char text_stat[100], bin_stat[100];
+    int text_rc, bin_rc;
+
+    text_rc = ndmfhdb_lookup(text, path, &fstat);
+    if (text_rc > 0)
+	ndm_fstat_to_str(&fstat, text_stat);
+    bin_rc = ndmfhdb_lookup(bin, path, &fstat);
+    if (bin_rc > 0)
+	ndm_fstat_to_str(&fstat, bin_stat);
+
+    if (text_rc != bin_rc) {
+	tu_dbg("'%s': text lookup returned %d, compiled lookup %d\n",
+	       path, text_rc, bin_rc);
+	return FALSE;
+    }
+    if (!expected) {
+	if (bin_rc > 0) {
+	    tu_dbg("'%s' was found\n", path);
+	    return FALSE;
+	}
+	return TRUE;
+    }
+    if (bin_rc <= 0) {
+	tu_dbg("'%s' was not found (%d)\n", path, bin_rc);
+	return FALSE;
+    }
+    if (!g_str_equal(text_stat, expected) || !g_str_equal(bin_stat, expected)) {
+	tu_dbg("'%s': expected '%s'; text gives '%s', compiled '%s'\n",
+	       path, expected, text_stat, bin_stat);
+	return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Tests
+ */
+
+/* A dir/node index, added in the order a dump formatter sends it, is found
+ * the same way once compiled as when sorted as text */
+static gboolean
+test_dirnode_round_trip(void)
+{
+    struct ndmfhdb text, bin;
+    gboolean ok = TRUE;
+
+    index_lines = g_ptr_array_new();
+    index_add(g_strdup("CM 00 an unrelated line"));
+    index_add(g_strdup("DHr 2"));
+    index_add_dir(2, ".", 2);
+    index_add_dir(2, "usr", 20);
+    index_add_dir(2, "etc", 10);
+    index_add_dir(10, "passwd", 11);
+    index_add_dir(20, "lib", 21);
+    index_add_dir(21, "libc.so", 22);
+    index_add_dir(2, "a b", 30);
+    index_add_dir(30, "100%", 31);
+    index_add_node(31, "f- m0600 u0 g0 s12 tm1300000004 @5120");
+    index_add_node(22, "fl m0777 u0 g0 s7 tm1300000003 @4096");
+    index_add_node(11, "f- m0644 u0 g0 s1024 tm1300000002 @2048");
+    index_add_node(2, "fd m0755 u0 g0 tm1300000000 @0");
+    index_add_node(10, "fd m0755 u0 g0 tm1300000001 @1024");
+    index_add_node(20, "fd m0755 u0 g0 tm1300000001 @3072");
+    index_add_node(21, "fd m0755 u0 g0 tm1300000001 @3584");
+    index_add_node(30, "fd m0700 u1 g1 tm1300000001 @4608");
+
+    if (!open_both(&text, &bin)) {
+	index_free();
+	return FALSE;
+    }
+    if (!bin.use_dir_node || bin.root_node != 2) {
+	tu_dbg("the compiled index has no dir/node root\n");
+	ok = FALSE;
+    }
+
+    ok = check_lookup(&text, &bin, "/", "fd m0755 u0 g0 tm1300000000 @0") && ok;
+    ok = check_lookup(&text, &bin, "etc", "fd m0755 u0 g0 tm1300000001 @1024") && ok;
+    ok = check_lookup(&text, &bin, "/etc/passwd", "f- m0644 u0 g0 s1024 tm1300000002 @2048") && ok;
+    ok = check_lookup(&text, &bin, "usr//lib/libc.so/", "fl m0777 u0 g0 s7 tm1300000003 @4096") && ok;
+    ok = check_lookup(&text, &bin, "a b/100%", "f- m0600 u0 g0 s12 tm1300000004 @5120") && ok;
+    ok = check_lookup(&text, &bin, "etc/shadow", NULL) && ok;
+    ok = check_lookup(&text, &bin, "et", NULL) && ok;
+    ok = check_lookup(&text, &bin, "var/log", NULL) && ok;
+
+    close_both(&text, &bin);
+    index_free();
+    return ok;
+}
+
+/* .. and so is an index of whole path names */
+static gboolean
+test_file_round_trip(void)
+{
+    struct ndmfhdb text, bin;
+    gboolean ok = TRUE;
+
+    index_lines = g_ptr_array_new();
+    index_add_file("/usr/lib", "fd m0755 u0 g0 tm1300000001 @3584");
+    index_add_file("/etc/passwd", "f- m0644 u0 g0 s1024 tm1300000002 @2048");
+    index_add_file("/", "fd m0755 u0 g0 tm1300000000 @0");
+    index_add_file("/etc", "fd m0755 u0 g0 tm1300000001 @1024");
+    index_add_file("/a b/c\td", "f- m0600 u0 g0 s12 tm1300000004 @5120");
+    index_add_file("/etc/passwd-", "f- m0644 u0 g0 s1000 tm1300000002 @2560");
+
+    if (!open_both(&text, &bin)) {
+	index_free();
+	return FALSE;
+    }
+    if (bin.use_dir_node) {
+	tu_dbg("the compiled index claims a dir/node root\n");
+	ok = FALSE;
+    }
+
+    ok = check_lookup(&text, &bin, "/", "fd m0755 u0 g0 tm1300000000 @0") && ok;
+    ok = check_lookup(&text, &bin, "/etc/passwd", "f- m0644 u0 g0 s1024 tm1300000002 @2048") && ok;
+    ok = check_lookup(&text, &bin, "/etc/passwd-", "f- m0644 u0 g0 s1000 tm1300000002 @2560") && ok;
+    ok = check_lookup(&text, &bin, "/a b/c\td", "f- m0600 u0 g0 s12 tm1300000004 @5120") && ok;
+    ok = check_lookup(&text, &bin, "/etc/pass", NULL) && ok;
+    ok = check_lookup(&text, &bin, "/usr", NULL) && ok;
+
+    close_both(&text, &bin);
+    index_free();
+    return ok;
+}
+
+/* Bad lines make ndmfhdb_compile fail, rather than write a partial index */
+static gboolean
+test_compile_errors(void)
+{
+    static char *bad[] = {
+	"DHd 2 etc 10\n",			/* no UNIX */
+	"DHd x etc UNIX 10\n",			/* no dir node */
+	"DHn 10 UNIX fd m0755 zz\n",		/* bad stat */
+	"DHr 2 3\n",				/* trailing junk */
+	NULL
+    };
+    char **line;
+    char *longline;
+    FILE *fp, *out_fp;
+    gboolean ok = TRUE;
+    int rc;
+
+    for (line = bad; *line; line++) {
+	fp = tmpfile();
+	out_fp = tmpfile();
+	if (!fp || !out_fp)
+	    return FALSE;
+	fputs("DHr 2\n", fp);
+	fputs(*line, fp);
+	fflush(fp);
+	rc = ndmfhdb_compile(fp, out_fp);
+	if (rc >= 0 || ftello(out_fp) != 0) {
+	    tu_dbg("%d for the bad line %s", rc, *line);
+	    ok = FALSE;
+	}
+	fclose(fp);
+	fclose(out_fp);
+    }
+
+    /* a line longer than ndmfhdb_compile's buffer */
+    fp = tmpfile();
+    out_fp = tmpfile();
+    if (!fp || !out_fp)
+	return FALSE;
+    longline = g_strnfill(8192, 'x');
+    g_fprintf(fp, "DHf /%s UNIX f- s1\n", longline);
+    g_free(longline);
+    fflush(fp);
+    if ((rc = ndmfhdb_compile(fp, out_fp)) != -2) {
+	tu_dbg("a too-long line returned %d\n", rc);
+	ok = FALSE;
+    }
+    fclose(fp);
+    fclose(out_fp);
+
+    return ok;
+}
+
+/*
+ * Main driver
+ */
+
+int
+main(int argc, char **argv)
+{
+    static TestUtilsTest tests[] = {
+	TU_TEST(test_dirnode_round_trip, 90),
+	TU_TEST(test_file_round_trip, 90),
+	TU_TEST(test_compile_errors, 90),
+	TU_END()
+    };
+
+    glib_init();
+
+    return testutils_run_tests(argc, argv, tests);
+}
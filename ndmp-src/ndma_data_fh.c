@@ -40,6 +40,13 @@
 #ifndef NDMOS_OPTION_NO_DATA_AGENT
 
 
+static struct ndmfhheap *ndmda_fh_heap (struct ndm_data_agent *da, int msg);
+static void	ndmda_fh_commission_heap (struct ndm_data_agent *da,
+			struct ndmfhheap *fhh);
+static void	ndmda_fh_flush_heap (struct ndm_session *sess,
+			struct ndmfhheap *fhh);
+
+
 /*
  * Initialization and Cleanup
  ****************************************************************
@@ -50,9 +57,9 @@ int
 ndmda_fh_initialize (struct ndm_session *sess)
 {
 	struct ndm_data_agent *	da = &sess->data_acb;
-	struct ndmfhheap *	fhh = &da->fhh;
 
-	ndmfhh_initialize (fhh);
+	ndmfhh_initialize (&da->fhh);
+	ndmfhh_initialize (&da->fhh_node);
 
 	return 0;
 }
@@ -61,11 +68,7 @@ ndmda_fh_initialize (struct ndm_session *sess)
 int
 ndmda_fh_commission (struct ndm_session *sess)
 {
-	struct ndm_data_agent *	da = &sess->data_acb;
-	struct ndmfhheap *	fhh = &da->fhh;
-
-	ndmfhh_commission (fhh, &da->fhh_buf, sizeof da->fhh_buf);
-
+	/* the heaps get their buffers in ndmda_fh_prepare() */
 	return 0;
 }
 
@@ -73,6 +76,19 @@ ndmda_fh_commission (struct ndm_session *sess)
 int
 ndmda_fh_decommission (struct ndm_session *sess)
 {
+	struct ndm_data_agent *	da = &sess->data_acb;
+
+	if (da->fhh_buf) {
+		NDMOS_API_FREE (da->fhh_buf);
+		da->fhh_buf = 0;
+	}
+	if (da->fhh_node_buf) {
+		NDMOS_API_FREE (da->fhh_node_buf);
+		da->fhh_node_buf = 0;
+	}
+	ndmfhh_initialize (&da->fhh);
+	ndmfhh_initialize (&da->fhh_node);
+
 	return 0;
 }
 
@@ -145,7 +161,7 @@ ndmda_fh_add_node (struct ndm_session *sess, ndmp9_file_stat *filestat)
 	if (rc != NDMFHH_RET_OK)
 		return;
 
-	node9 = ndmfhh_add_entry (&da->fhh);
+	node9 = ndmfhh_add_entry (&da->fhh_node);
 	node9->fstat = *filestat;
 }
 
@@ -163,17 +179,25 @@ ndmda_fh_prepare (struct ndm_session *sess,
   unsigned n_item, unsigned total_size_of_items)
 {
 	struct ndm_data_agent *	da = &sess->data_acb;
-	struct ndmfhheap *	fhh = &da->fhh;
+	struct ndmfhheap *	fhh = ndmda_fh_heap (da, msg);
 	int			fhtype = (vers<<16) + msg;
 	int			rc;
 
+	if (fhh->heap_base == 0)
+		ndmda_fh_commission_heap (da, fhh);
+
 	rc = ndmfhh_prepare (fhh, fhtype, entry_size,
 				n_item, total_size_of_items);
 
 	if (rc == NDMFHH_RET_OK)
 		return NDMFHH_RET_OK;
 
-	ndmda_fh_flush (sess);
+	if (fhh == &da->fhh_node) {
+		/* pending ADD_DIRs may name these nodes, send them first */
+		ndmda_fh_flush (sess);
+	} else {
+		ndmda_fh_flush_heap (sess, fhh);
+	}
 
 	rc = ndmfhh_prepare (fhh, fhtype, entry_size,
 				n_item, total_size_of_items);
@@ -185,7 +209,45 @@ void
 ndmda_fh_flush (struct ndm_session *sess)
 {
 	struct ndm_data_agent *	da = &sess->data_acb;
-	struct ndmfhheap *	fhh = &da->fhh;
+
+	/* directory entries go ahead of the nodes they name */
+	ndmda_fh_flush_heap (sess, &da->fhh);
+	ndmda_fh_flush_heap (sess, &da->fhh_node);
+}
+
+static struct ndmfhheap *
+ndmda_fh_heap (struct ndm_data_agent *da, int msg)
+{
+	if (msg == NDMP9_FH_ADD_NODE)
+		return &da->fhh_node;
+
+	return &da->fhh;
+}
+
+static void
+ndmda_fh_commission_heap (struct ndm_data_agent *da, struct ndmfhheap *fhh)
+{
+	unsigned long **	bufp;
+	unsigned		size;
+
+	if (fhh == &da->fhh_node) {
+		bufp = &da->fhh_node_buf;
+		size = NDMDA_N_FHH_NODE_BUF * sizeof (unsigned long);
+	} else {
+		bufp = &da->fhh_buf;
+		size = NDMDA_N_FHH_BUF * sizeof (unsigned long);
+	}
+
+	*bufp = NDMOS_API_MALLOC (size);
+	if (!*bufp)
+		return;		/* ndmfhh_prepare() says NO_HEAP */
+
+	ndmfhh_commission (fhh, *bufp, size);
+}
+
+static void
+ndmda_fh_flush_heap (struct ndm_session *sess, struct ndmfhheap *fhh)
+{
 	int			rc;
 	int			fhtype;
 	void *			table;
@@ -574,7 +574,10 @@ extern void	ndmca_test_fill_data (char *buf, int bufsize,
 #define NDMDA_N_FMT_IMAGE_BUF	(8*1024)
 #endif
 #ifndef NDMDA_N_FHH_BUF
-#define NDMDA_N_FHH_BUF		(8*1024)
+#define NDMDA_N_FHH_BUF		(64*1024)
+#endif
+#ifndef NDMDA_N_FHH_NODE_BUF
+#define NDMDA_N_FHH_NODE_BUF	(64*1024)
 #endif
 #ifndef NDMDA_N_FMT_ERROR_BUF
 #define NDMDA_N_FMT_ERROR_BUF	(8*1024)
@@ -668,8 +671,15 @@ struct ndm_data_agent {
 	char			fmt_error_buf[NDMDA_N_FMT_ERROR_BUF];
 	char			fmt_wrap_buf[NDMDA_N_FMT_WRAP_BUF];
 
+	/* file history is batched in two heaps, so that the ADD_DIR
+	 * and ADD_NODE entries formatters interleave don't flush each
+	 * other's batch (ADD_FILE shares the first heap).  Each buffer
+	 * holds a few thousand entries, and is only allocated by the
+	 * first entry of an operation that sends file history */
 	struct ndmfhheap	fhh;
-	unsigned long		fhh_buf[NDMDA_N_FHH_BUF];
+	unsigned long *		fhh_buf;	/* NDMDA_N_FHH_BUF */
+	struct ndmfhheap	fhh_node;
+	unsigned long *		fhh_node_buf;	/* NDMDA_N_FHH_NODE_BUF */
 
 #ifdef NDMOS_MACRO_DATA_AGENT_ADDITIONS
 	NDMOS_MACRO_DATA_AGENT_ADDITIONS
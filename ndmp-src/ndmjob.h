@@ -57,6 +57,7 @@ GLOBAL int		o_no_time_stamps;
 GLOBAL char *		o_config_file;
 GLOBAL char *		o_tape_tcp;
 GLOBAL char *		o_load_files_file;
+GLOBAL char *		o_fhdb_file;
 
 extern void		error_byebye (char *fmt, ...);
 
@@ -152,6 +153,7 @@ extern void		ndmjob_ixlog_deliver(struct ndmlog *log, char *tag,
 #ifndef NDMOS_OPTION_NO_CONTROL_AGENT
 extern int		start_index_file (void);
 extern int		sort_index_file (void);
+extern int		compile_fhdb_file (void);
 extern int		build_job (void);
 extern int		args_to_job (void);
 extern int		args_to_job_backup_env (void);
@@ -106,6 +106,8 @@ char *help_text[] = {
 
 	"  -I FILE  -- set output index file, enable FILEHIST (default to log)",
 	"  -J FILE  -- set input index file (default none)",
+	"  -o fhdb=PATHNAME",
+	"           -- binary file history, compiled from -I, searched for -J",
 	"  -U USER  -- user rights to use on data agent",
 	"  -o rules=RULES -- apply RULES to job (see RULES below)",
 	"CONTROL of TAPE agent parameters",
@@ -651,6 +653,8 @@ handle_long_option (char *str)
 		o_rules = value;
 	} else if (strcmp (name, "load-files") == 0 && value) {
 		o_load_files_file = value;
+	} else if (strcmp (name, "fhdb") == 0 && value) {
+		o_fhdb_file = value;
 #endif /* !NDMOS_OPTION_NO_CONTROL_AGENT */
 	} else if (strcmp (name, "no-time-stamps") == 0) {
 		/* value part ignored */
@@ -372,10 +372,27 @@ jndex_doit (void)
 	ndmjob_log (1, "Processing input index (-J%s)", J_index_file);
 
 	if (n_file_arg > 0) {
-		rc = ndmfhdb_add_fh_info_to_nlist (fp, nlist, n_file_arg);
+		FILE *		fhfp = fp;
+
+		if (o_fhdb_file) {
+			fhfp = fopen (o_fhdb_file, "r");
+			if (!fhfp) {
+				perror (o_fhdb_file);
+				error_byebye ("Can not open -ofhdb=%s",
+					o_fhdb_file);
+				/* no return */
+			}
+			ndmjob_log (1, "Searching file history (-ofhdb=%s)",
+				o_fhdb_file);
+		}
+
+		rc = ndmfhdb_add_fh_info_to_nlist (fhfp, nlist, n_file_arg);
 		if (rc < 0) {
 			/* toast one way or another */
 		}
+
+		if (fhfp != fp)
+			fclose (fhfp);
 	}
 
 	jndex_fetch_post_backup_data_env(fp);
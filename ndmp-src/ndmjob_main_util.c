@@ -79,7 +79,41 @@ sort_index_file (void)
 		if (system (cmd) < 0)
 		    error_byebye ("sort index failed");
 		ndmjob_log (1, "sort index done");
+
+		if (o_fhdb_file)
+			compile_fhdb_file ();
+	}
+
+	return 0;
+}
+
+int
+compile_fhdb_file (void)
+{
+	FILE *		ifp;
+	FILE *		ofp;
+	int		rc;
+
+	ifp = fopen (I_index_file, "r");
+	if (!ifp) {
+		error_byebye ("can't reopen -I%s", I_index_file);
+	}
+	ofp = fopen (o_fhdb_file, "w");
+	if (!ofp) {
+		fclose (ifp);
+		error_byebye ("can't open -ofhdb=%s", o_fhdb_file);
+	}
+
+	ndmjob_log (1, "compiling file history (-ofhdb=%s)", o_fhdb_file);
+	rc = ndmfhdb_compile (ifp, ofp);
+	fclose (ifp);
+	if (fclose (ofp) != 0 && rc >= 0)
+		rc = -4;
+	if (rc < 0) {
+		unlink (o_fhdb_file);
+		error_byebye ("compile file history failed (%d)", rc);
 	}
+	ndmjob_log (1, "compile file history done, %d entries", rc);
 
 	return 0;
 }
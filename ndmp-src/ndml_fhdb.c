@@ -37,6 +37,22 @@
 
 #include "ndmlib.h"
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+
+static int	ndmfhdb_bin_open (struct ndmfhdb *fhcb);
+static int	ndmfhdb_bin_file_lookup (struct ndmfhdb *fhcb,
+			char *name, unsigned name_len,
+			ndmp9_file_stat *fstat);
+static int	ndmfhdb_bin_dir_lookup (struct ndmfhdb *fhcb,
+			unsigned long long dir_node,
+			char *name, unsigned name_len,
+			unsigned long long *node_p);
+static int	ndmfhdb_bin_node_lookup (struct ndmfhdb *fhcb,
+			unsigned long long node,
+			ndmp9_file_stat *fstat);
 
 
 int
@@ -135,6 +151,8 @@ ndmfhdb_add_fh_info_to_nlist (FILE *fp, ndmp9_name *nlist, int n_nlist)
 		}
 	}
 
+	ndmfhdb_close (fhcb);
+
 	return n_found;
 }
 
@@ -147,9 +165,18 @@ ndmfhdb_open (FILE *fp, struct ndmfhdb *fhcb)
 
 	fhcb->fp = fp;
 
-	rc = ndmfhdb_dirnode_root (fhcb);
-	if (rc > 0) {
-		fhcb->use_dir_node = 1;
+	rc = ndmfhdb_bin_open (fhcb);
+	if (rc < 0) {
+		return -1;
+	}
+
+	if (rc == 0) {
+		rc = ndmfhdb_dirnode_root (fhcb);
+		if (rc > 0) {
+			fhcb->use_dir_node = 1;
+			return 0;
+		}
+	} else if (fhcb->use_dir_node) {
 		return 0;
 	}
 
@@ -159,9 +186,33 @@ ndmfhdb_open (FILE *fp, struct ndmfhdb *fhcb)
 		return 0;
 	}
 
+	ndmfhdb_close (fhcb);
+
 	return -1;
 }
 
+void
+ndmfhdb_close (struct ndmfhdb *fhcb)
+{
+	if (!fhcb->bin_base)
+		return;
+
+#ifdef HAVE_SYS_MMAN_H
+	if (fhcb->bin_mapped)
+		munmap (fhcb->bin_base, fhcb->bin_len);
+	else
+#endif
+		NDMOS_API_FREE (fhcb->bin_base);
+
+	fhcb->bin_base = 0;
+	fhcb->bin_len = 0;
+	fhcb->bin_mapped = 0;
+	fhcb->bin_file = fhcb->bin_dir = fhcb->bin_node = 0;
+	fhcb->bin_n_file = fhcb->bin_n_dir = fhcb->bin_n_node = 0;
+	fhcb->bin_names = 0;
+	fhcb->bin_names_len = 0;
+}
+
 int
 ndmfhdb_lookup (struct ndmfhdb *fhcb, char *path, ndmp9_file_stat *fstat)
 {
@@ -253,6 +304,11 @@ ndmfhdb_dir_lookup (struct ndmfhdb *fhcb, unsigned long long dir_node,
 
 	ndmcstr_from_str (name, p, sizeof key - (p-key) - 10);
 
+	if (fhcb->bin_base) {
+		return ndmfhdb_bin_dir_lookup (fhcb, dir_node,
+						p, strlen (p), node_p);
+	}
+
 	strcat (p, " UNIX ");
 
 	p = NDMOS_API_STREND(key);
@@ -282,6 +338,10 @@ ndmfhdb_node_lookup (struct ndmfhdb *fhcb, unsigned long long node,
 	char		key[128];
 	char		linebuf[2048];
 
+	if (fhcb->bin_base) {
+		return ndmfhdb_bin_node_lookup (fhcb, node, fstat);
+	}
+
 	sprintf (key, "DHn %llu UNIX ", node);
 
 	p = NDMOS_API_STREND(key);
@@ -332,6 +392,10 @@ ndmfhdb_file_lookup (struct ndmfhdb *fhcb, char *path,
 
 	ndmcstr_from_str (path, p, sizeof key - (p-key) - 10);
 
+	if (fhcb->bin_base) {
+		return ndmfhdb_bin_file_lookup (fhcb, p, strlen (p), fstat);
+	}
+
 	strcat (p, " UNIX ");
 
 	p = NDMOS_API_STREND(key);
@@ -354,6 +418,623 @@ ndmfhdb_file_lookup (struct ndmfhdb *fhcb, char *path,
 
 
 
+/*
+ * Binary File History Database
+ ****************************************************************
+ *
+ * Produced by ndmfhdb_compile() from a (sorted or not) text index.
+ * All numbers are in the byte order of the host that wrote it; a
+ * database from a host of the other byte order is refused rather
+ * than converted. The file is laid out as:
+ *
+ *	header
+ *	file table	n_file fixed-size records, sorted by name
+ *	dir table	n_dir records, sorted by (dir_node, name)
+ *	node table	n_node records, sorted by node
+ *	names		names_len bytes of names, as in the text
+ *			index (ndmcstr encoded), not NUL terminated
+ *
+ * Every section is a multiple of eight bytes long except the names,
+ * which come last, so the tables can be used in place once mapped.
+ */
+
+#define NDMFHDB_BIN_MAGIC	"NDMFHDB\n"
+#define NDMFHDB_BIN_BOM		0x01020304
+#define NDMFHDB_BIN_VERSION	1
+
+#define NDMFHDB_BIN_HAVE_ROOT	0x0001	/* header root_node is valid */
+
+struct ndmfhdb_bin_header {
+	char			magic[8];
+	unsigned int		bom;
+	unsigned int		version;
+	unsigned int		flags;
+	unsigned int		reserved;
+	unsigned long long	root_node;
+	unsigned long long	n_file;
+	unsigned long long	n_dir;
+	unsigned long long	n_node;
+	unsigned long long	names_len;
+};
+
+/*
+ * The attributes of an object. Only those ndm_fstat_to_str() records in
+ * the text index are kept: atime, ctime, links and node never make it
+ * there, so there is no point in making room for them here.
+ */
+
+/* bits in ndmfhdb_bin_stat.valid */
+#define NDMFHDB_BIN_V_MTIME	0x0001
+#define NDMFHDB_BIN_V_UID	0x0002
+#define NDMFHDB_BIN_V_GID	0x0004
+#define NDMFHDB_BIN_V_MODE	0x0008
+#define NDMFHDB_BIN_V_SIZE	0x0010
+#define NDMFHDB_BIN_V_FH_INFO	0x0020
+
+struct ndmfhdb_bin_stat {
+	unsigned long long	size;
+	unsigned long long	fh_info;
+	unsigned long long	mtime;
+	unsigned int		uid;
+	unsigned int		gid;
+	unsigned int		mode;
+	unsigned short		ftype;
+	unsigned short		valid;
+};
+
+struct ndmfhdb_bin_file {
+	unsigned long long	name_off;
+	unsigned int		name_len;
+	unsigned int		reserved;
+	struct ndmfhdb_bin_stat	fstat;
+};
+
+struct ndmfhdb_bin_dir {
+	unsigned long long	dir_node;
+	unsigned long long	node;
+	unsigned long long	name_off;
+	unsigned int		name_len;
+	unsigned int		reserved;
+};
+
+struct ndmfhdb_bin_node {
+	unsigned long long	node;
+	struct ndmfhdb_bin_stat	fstat;
+};
+
+#define NDMFHDB_BIN_STAT_FIELD(F,BIT) \
+	if (fstat->F.valid) { \
+		bstat->F = fstat->F.value; \
+		bstat->valid |= (BIT); \
+	}
+
+static void
+ndmfhdb_bin_stat_from_fstat (struct ndmfhdb_bin_stat *bstat,
+  ndmp9_file_stat *fstat)
+{
+	NDMOS_MACRO_ZEROFILL (bstat);
+
+	bstat->ftype = fstat->ftype;
+	NDMFHDB_BIN_STAT_FIELD(mtime, NDMFHDB_BIN_V_MTIME)
+	NDMFHDB_BIN_STAT_FIELD(uid, NDMFHDB_BIN_V_UID)
+	NDMFHDB_BIN_STAT_FIELD(gid, NDMFHDB_BIN_V_GID)
+	NDMFHDB_BIN_STAT_FIELD(mode, NDMFHDB_BIN_V_MODE)
+	NDMFHDB_BIN_STAT_FIELD(size, NDMFHDB_BIN_V_SIZE)
+	NDMFHDB_BIN_STAT_FIELD(fh_info, NDMFHDB_BIN_V_FH_INFO)
+}
+
+#undef NDMFHDB_BIN_STAT_FIELD
+
+#define NDMFHDB_BIN_STAT_FIELD(F,BIT) \
+	if (bstat->valid & (BIT)) { \
+		fstat->F.value = bstat->F; \
+		fstat->F.valid = NDMP9_VALIDITY_VALID; \
+	}
+
+static void
+ndmfhdb_bin_stat_to_fstat (struct ndmfhdb_bin_stat *bstat,
+  ndmp9_file_stat *fstat)
+{
+	NDMOS_MACRO_ZEROFILL (fstat);
+
+	fstat->ftype = bstat->ftype;
+	NDMFHDB_BIN_STAT_FIELD(mtime, NDMFHDB_BIN_V_MTIME)
+	NDMFHDB_BIN_STAT_FIELD(uid, NDMFHDB_BIN_V_UID)
+	NDMFHDB_BIN_STAT_FIELD(gid, NDMFHDB_BIN_V_GID)
+	NDMFHDB_BIN_STAT_FIELD(mode, NDMFHDB_BIN_V_MODE)
+	NDMFHDB_BIN_STAT_FIELD(size, NDMFHDB_BIN_V_SIZE)
+	NDMFHDB_BIN_STAT_FIELD(fh_info, NDMFHDB_BIN_V_FH_INFO)
+}
+
+#undef NDMFHDB_BIN_STAT_FIELD
+
+static int
+ndmfhdb_bin_name_cmp (char *a, unsigned a_len, char *b, unsigned b_len)
+{
+	int		rc;
+
+	rc = memcmp (a, b, a_len < b_len ? a_len : b_len);
+	if (rc != 0)
+		return rc;
+
+	return (a_len > b_len) - (a_len < b_len);
+}
+
+/* the name of a record, or 0 if the record points outside the names */
+static char *
+ndmfhdb_bin_name (struct ndmfhdb *fhcb,
+  unsigned long long name_off, unsigned name_len)
+{
+	if (name_off > fhcb->bin_names_len
+	 || name_len > fhcb->bin_names_len - name_off)
+		return 0;
+
+	return fhcb->bin_names + name_off;
+}
+
+/*
+ * Recognize a binary database and map it.
+ *	Returns
+ *	  >0	binary database, ready to use
+ *	   0	not a binary database (presumably a text index)
+ *	  <0	a binary database that can't be used
+ */
+static int
+ndmfhdb_bin_open (struct ndmfhdb *fhcb)
+{
+	FILE *				fp = fhcb->fp;
+	struct ndmfhdb_bin_header	hdr;
+	struct stat			st;
+	unsigned long long		len;
+	char *				base = 0;
+
+	if (fseeko (fp, 0, SEEK_SET) < 0)
+		return 0;
+
+	if (fread (&hdr, sizeof hdr, 1, fp) != 1
+	 || memcmp (hdr.magic, NDMFHDB_BIN_MAGIC, sizeof hdr.magic) != 0) {
+		fseeko (fp, 0, SEEK_SET);
+		return 0;
+	}
+
+	if (hdr.bom != NDMFHDB_BIN_BOM || hdr.version != NDMFHDB_BIN_VERSION)
+		return -20;
+
+	if (fstat (fileno (fp), &st) < 0)
+		return -21;
+
+	len = st.st_size;
+	if (hdr.n_file > len / sizeof (struct ndmfhdb_bin_file)
+	 || hdr.n_dir > len / sizeof (struct ndmfhdb_bin_dir)
+	 || hdr.n_node > len / sizeof (struct ndmfhdb_bin_node)
+	 || hdr.names_len > len
+	 || len != sizeof hdr
+		+ hdr.n_file * sizeof (struct ndmfhdb_bin_file)
+		+ hdr.n_dir * sizeof (struct ndmfhdb_bin_dir)
+		+ hdr.n_node * sizeof (struct ndmfhdb_bin_node)
+		+ hdr.names_len)
+		return -22;
+
+#ifdef HAVE_SYS_MMAN_H
+	base = mmap (0, len, PROT_READ, MAP_SHARED, fileno (fp), 0);
+	if (base == MAP_FAILED) {
+		base = 0;
+	} else {
+		fhcb->bin_mapped = 1;
+	}
+#endif
+
+	if (!base) {
+		base = NDMOS_API_MALLOC (len);
+		if (!base)
+			return -23;
+		if (fseeko (fp, 0, SEEK_SET) < 0
+		 || fread (base, 1, len, fp) != len) {
+			NDMOS_API_FREE (base);
+			return -24;
+		}
+	}
+
+	fhcb->bin_base = base;
+	fhcb->bin_len = len;
+
+	base += sizeof hdr;
+	fhcb->bin_file = base;
+	fhcb->bin_n_file = hdr.n_file;
+	base += hdr.n_file * sizeof (struct ndmfhdb_bin_file);
+	fhcb->bin_dir = base;
+	fhcb->bin_n_dir = hdr.n_dir;
+	base += hdr.n_dir * sizeof (struct ndmfhdb_bin_dir);
+	fhcb->bin_node = base;
+	fhcb->bin_n_node = hdr.n_node;
+	base += hdr.n_node * sizeof (struct ndmfhdb_bin_node);
+	fhcb->bin_names = base;
+	fhcb->bin_names_len = hdr.names_len;
+
+	if (hdr.flags & NDMFHDB_BIN_HAVE_ROOT) {
+		fhcb->use_dir_node = 1;
+		fhcb->root_node = hdr.root_node;
+	}
+
+	return 1;
+}
+
+static int
+ndmfhdb_bin_file_lookup (struct ndmfhdb *fhcb,
+  char *name, unsigned name_len, ndmp9_file_stat *fstat)
+{
+	struct ndmfhdb_bin_file *	tab = fhcb->bin_file;
+	unsigned long long		lo = 0, hi = fhcb->bin_n_file, mid;
+	char *				p;
+	int				rc;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		p = ndmfhdb_bin_name (fhcb, tab[mid].name_off,
+						tab[mid].name_len);
+		if (!p)
+			return -10;
+
+		rc = ndmfhdb_bin_name_cmp (name, name_len,
+						p, tab[mid].name_len);
+		if (rc == 0) {
+			ndmfhdb_bin_stat_to_fstat (&tab[mid].fstat, fstat);
+			return 1;
+		}
+		if (rc < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return 0;	/* not found */
+}
+
+static int
+ndmfhdb_bin_dir_lookup (struct ndmfhdb *fhcb, unsigned long long dir_node,
+  char *name, unsigned name_len, unsigned long long *node_p)
+{
+	struct ndmfhdb_bin_dir *	tab = fhcb->bin_dir;
+	unsigned long long		lo = 0, hi = fhcb->bin_n_dir, mid;
+	char *				p;
+	int				rc;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (dir_node != tab[mid].dir_node) {
+			rc = dir_node < tab[mid].dir_node ? -1 : 1;
+		} else {
+			p = ndmfhdb_bin_name (fhcb, tab[mid].name_off,
+							tab[mid].name_len);
+			if (!p)
+				return -10;
+
+			rc = ndmfhdb_bin_name_cmp (name, name_len,
+						p, tab[mid].name_len);
+		}
+		if (rc == 0) {
+			*node_p = tab[mid].node;
+			return 1;
+		}
+		if (rc < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return 0;	/* not found */
+}
+
+static int
+ndmfhdb_bin_node_lookup (struct ndmfhdb *fhcb, unsigned long long node,
+  ndmp9_file_stat *fstat)
+{
+	struct ndmfhdb_bin_node *	tab = fhcb->bin_node;
+	unsigned long long		lo = 0, hi = fhcb->bin_n_node, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (node == tab[mid].node) {
+			ndmfhdb_bin_stat_to_fstat (&tab[mid].fstat, fstat);
+			return 1;
+		}
+		if (node < tab[mid].node)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return 0;	/* not found */
+}
+
+
+/*
+ * Compiling the binary database
+ *
+ * The text index is read in one pass into growable tables, which are
+ * then sorted in memory and written out. The input need not be sorted.
+ */
+
+struct ndmfhdb_bin_vec {
+	char *			base;
+	unsigned long long	n;
+	unsigned long long	n_alloc;
+	unsigned		size;
+};
+
+/* append N zero-filled elements, returning the first, or 0 if no memory */
+static void *
+ndmfhdb_bin_vec_add (struct ndmfhdb_bin_vec *vec, unsigned long long n)
+{
+	void *			p;
+
+	if (vec->n + n > vec->n_alloc) {
+		unsigned long long	n_alloc = vec->n_alloc ? vec->n_alloc : 1024;
+
+		while (n_alloc < vec->n + n)
+			n_alloc *= 2;
+
+		p = NDMOS_API_REALLOC (vec->base, n_alloc * vec->size);
+		if (!p)
+			return 0;
+
+		vec->base = p;
+		vec->n_alloc = n_alloc;
+	}
+
+	p = vec->base + vec->n * vec->size;
+	NDMOS_API_BZERO (p, n * vec->size);
+	vec->n += n;
+
+	return p;
+}
+
+/* qsort() has no context argument */
+static char *	ndmfhdb_bin_sort_names;
+
+static int
+ndmfhdb_bin_file_sort_cmp (const void *a, const void *b)
+{
+	const struct ndmfhdb_bin_file *	fa = a;
+	const struct ndmfhdb_bin_file *	fb = b;
+
+	return ndmfhdb_bin_name_cmp (
+			ndmfhdb_bin_sort_names + fa->name_off, fa->name_len,
+			ndmfhdb_bin_sort_names + fb->name_off, fb->name_len);
+}
+
+static int
+ndmfhdb_bin_dir_sort_cmp (const void *a, const void *b)
+{
+	const struct ndmfhdb_bin_dir *	da = a;
+	const struct ndmfhdb_bin_dir *	db = b;
+
+	if (da->dir_node != db->dir_node)
+		return da->dir_node < db->dir_node ? -1 : 1;
+
+	return ndmfhdb_bin_name_cmp (
+			ndmfhdb_bin_sort_names + da->name_off, da->name_len,
+			ndmfhdb_bin_sort_names + db->name_off, db->name_len);
+}
+
+static int
+ndmfhdb_bin_node_sort_cmp (const void *a, const void *b)
+{
+	const struct ndmfhdb_bin_node *	na = a;
+	const struct ndmfhdb_bin_node *	nb = b;
+
+	if (na->node != nb->node)
+		return na->node < nb->node ? -1 : 1;
+
+	return 0;
+}
+
+/* save a name, returning its offset in *off_p */
+static int
+ndmfhdb_bin_save_name (struct ndmfhdb_bin_vec *names,
+  char *name, unsigned name_len, unsigned long long *off_p)
+{
+	char *			p;
+
+	*off_p = names->n;
+	p = ndmfhdb_bin_vec_add (names, name_len);
+	if (!p && name_len > 0)
+		return -1;
+
+	NDMOS_API_BCOPY (name, p, name_len);
+
+	return 0;
+}
+
+/*
+ * Compile the file history entries of the text index FP into the
+ * binary database OUT_FP. Other index lines are ignored.
+ *	Returns
+ *	  >=0	number of entries written
+ *	  <0	error
+ */
+int
+ndmfhdb_compile (FILE *fp, FILE *out_fp)
+{
+	struct ndmfhdb_bin_header	hdr;
+	struct ndmfhdb_bin_vec		files, dirs, nodes, names;
+	char				linebuf[4096];
+	char *				p;
+	char *				q;
+	char *				end;
+	ndmp9_file_stat			fstat;
+	int				rc = 0;
+
+	NDMOS_MACRO_ZEROFILL (&hdr);
+	NDMOS_MACRO_ZEROFILL (&files);
+	NDMOS_MACRO_ZEROFILL (&dirs);
+	NDMOS_MACRO_ZEROFILL (&nodes);
+	NDMOS_MACRO_ZEROFILL (&names);
+	files.size = sizeof (struct ndmfhdb_bin_file);
+	dirs.size = sizeof (struct ndmfhdb_bin_dir);
+	nodes.size = sizeof (struct ndmfhdb_bin_node);
+	names.size = 1;
+
+	if (fseeko (fp, 0, SEEK_SET) < 0)
+		return -1;
+
+	while (fgets (linebuf, sizeof linebuf, fp)) {
+		end = NDMOS_API_STREND(linebuf);
+		if (end == linebuf || end[-1] != '\n') {
+			rc = -2;	/* line too long */
+			goto out;
+		}
+		*--end = 0;
+
+		if (strncmp (linebuf, "DH", 2) != 0 || linebuf[3] != ' ')
+			continue;
+		p = linebuf + 4;
+
+		switch (linebuf[2]) {
+		case 'r':	/* DHr ROOT */
+			hdr.root_node = NDMOS_API_STRTOLL (p, &q, 0);
+			if (*q != 0) {
+				rc = -10;
+				goto out;
+			}
+			hdr.flags |= NDMFHDB_BIN_HAVE_ROOT;
+			break;
+
+		case 'f': {	/* DHf NAME UNIX STAT */
+			struct ndmfhdb_bin_file *	file;
+
+			q = strstr (p, " UNIX ");
+			if (!q) {
+				rc = -10;
+				goto out;
+			}
+			rc = ndm_fstat_from_str (&fstat, q + 6);
+			if (rc < 0)
+				goto out;
+
+			file = ndmfhdb_bin_vec_add (&files, 1);
+			if (!file
+			 || ndmfhdb_bin_save_name (&names, p, q - p,
+						&file->name_off) < 0) {
+				rc = -3;
+				goto out;
+			}
+			file->name_len = q - p;
+			ndmfhdb_bin_stat_from_fstat (&file->fstat, &fstat);
+			break;
+		}
+
+		case 'd': {	/* DHd DIR_NODE NAME UNIX NODE */
+			struct ndmfhdb_bin_dir *	dir;
+			unsigned long long		dir_node;
+
+			dir_node = NDMOS_API_STRTOLL (p, &p, 0);
+			if (*p != ' ') {
+				rc = -10;
+				goto out;
+			}
+			p++;
+
+			q = strstr (p, " UNIX ");
+			if (!q) {
+				rc = -10;
+				goto out;
+			}
+
+			dir = ndmfhdb_bin_vec_add (&dirs, 1);
+			if (!dir
+			 || ndmfhdb_bin_save_name (&names, p, q - p,
+						&dir->name_off) < 0) {
+				rc = -3;
+				goto out;
+			}
+			dir->dir_node = dir_node;
+			dir->name_len = q - p;
+			dir->node = NDMOS_API_STRTOLL (q + 6, &p, 0);
+			if (*p != 0) {
+				rc = -10;
+				goto out;
+			}
+			break;
+		}
+
+		case 'n': {	/* DHn NODE UNIX STAT */
+			struct ndmfhdb_bin_node *	node;
+			unsigned long long		node_val;
+
+			node_val = NDMOS_API_STRTOLL (p, &p, 0);
+			if (strncmp (p, " UNIX ", 6) != 0) {
+				rc = -10;
+				goto out;
+			}
+			rc = ndm_fstat_from_str (&fstat, p + 6);
+			if (rc < 0)
+				goto out;
+
+			node = ndmfhdb_bin_vec_add (&nodes, 1);
+			if (!node) {
+				rc = -3;
+				goto out;
+			}
+			node->node = node_val;
+			ndmfhdb_bin_stat_from_fstat (&node->fstat, &fstat);
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+
+	if (ferror (fp)) {
+		rc = -1;
+		goto out;
+	}
+
+	ndmfhdb_bin_sort_names = names.base;
+	if (files.n > 0)
+		qsort (files.base, files.n, files.size,
+					ndmfhdb_bin_file_sort_cmp);
+	if (dirs.n > 0)
+		qsort (dirs.base, dirs.n, dirs.size,
+					ndmfhdb_bin_dir_sort_cmp);
+	if (nodes.n > 0)
+		qsort (nodes.base, nodes.n, nodes.size,
+					ndmfhdb_bin_node_sort_cmp);
+	ndmfhdb_bin_sort_names = 0;
+
+	NDMOS_API_BCOPY (NDMFHDB_BIN_MAGIC, hdr.magic, sizeof hdr.magic);
+	hdr.bom = NDMFHDB_BIN_BOM;
+	hdr.version = NDMFHDB_BIN_VERSION;
+	hdr.n_file = files.n;
+	hdr.n_dir = dirs.n;
+	hdr.n_node = nodes.n;
+	hdr.names_len = names.n;
+
+	if (fwrite (&hdr, sizeof hdr, 1, out_fp) != 1
+	 || fwrite (files.base, files.size, files.n, out_fp) != files.n
+	 || fwrite (dirs.base, dirs.size, dirs.n, out_fp) != dirs.n
+	 || fwrite (nodes.base, nodes.size, nodes.n, out_fp) != nodes.n
+	 || fwrite (names.base, names.size, names.n, out_fp) != names.n
+	 || fflush (out_fp) != 0) {
+		rc = -4;
+		goto out;
+	}
+
+	rc = files.n + dirs.n + nodes.n;
+
+  out:
+	if (files.base) NDMOS_API_FREE (files.base);
+	if (dirs.base) NDMOS_API_FREE (dirs.base);
+	if (nodes.base) NDMOS_API_FREE (nodes.base);
+	if (names.base) NDMOS_API_FREE (names.base);
+
+	return rc;
+}
+
+
+
+
 /*
  * Same codes as wraplib.[ch] wrap_parse_fstat_subr()
  * and wrap_send_fstat_subr().
@@ -762,12 +762,31 @@ extern int	ndmcfg_loadfp (FILE *fp, ndmp9_config_info *config_info);
  * using binary search (see NDMBSTF above). The fh_info, a 64-bit
  * cookie used by DATA to identify the region of the backup image
  * containing the corresponding object, is retreived from the index.
+ *
+ * For very large file systems the text index can instead be compiled
+ * (ndmfhdb_compile()) into a binary database of fixed-size, sorted
+ * records. It needs no sort(1), and ndmfhdb_open() recognizes it and
+ * maps it into memory, so lookups are binary searches in memory rather
+ * than fseek()s over the text file.
  */
 
 struct ndmfhdb {
 	FILE *			fp;
 	int			use_dir_node;
 	unsigned long long	root_node;
+
+	/* binary database, if fp is one */
+	char *			bin_base;
+	unsigned long long	bin_len;
+	int			bin_mapped;
+	void *			bin_file;
+	unsigned long long	bin_n_file;
+	void *			bin_dir;
+	unsigned long long	bin_n_dir;
+	void *			bin_node;
+	unsigned long long	bin_n_node;
+	char *			bin_names;
+	unsigned long long	bin_names_len;
 };
 
 extern int	ndmfhdb_add_file (struct ndmlog *ixlog, int tagc,
@@ -783,6 +802,8 @@ extern int	ndmfhdb_add_dirnode_root (struct ndmlog *ixlog, int tagc,
 extern int	ndmfhdb_add_fh_info_to_nlist (FILE *fp,
 			ndmp9_name *nlist, int n_nlist);
 extern int	ndmfhdb_open (FILE *fp, struct ndmfhdb *fhcb);
+extern void	ndmfhdb_close (struct ndmfhdb *fhcb);
+extern int	ndmfhdb_compile (FILE *fp, FILE *out_fp);
 extern int	ndmfhdb_lookup (struct ndmfhdb *fhcb, char *path,
 			ndmp9_file_stat *fstat);
 extern int	ndmfhdb_dirnode_root (struct ndmfhdb *fhcb);
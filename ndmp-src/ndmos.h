@@ -117,6 +117,7 @@
  * NDMOS_API_BCOPY		-- memory copy
  * NDMOS_API_BZERO		-- zero-fill memory
  * NDMOS_API_MALLOC		-- memory allocator, no initialization
+ * NDMOS_API_REALLOC		-- resize memory from NDMOS_API_MALLOC()
  * NDMOS_API_FREE		-- memory deallocator
  * NDMOS_API_STRTOLL		-- convert strings to long long
  * NDMOS_API_STRDUP		-- malloc() and strcpy()
@@ -286,6 +287,10 @@
 #define NDMOS_API_MALLOC(N)	malloc(N)
 #endif /* !NDMOS_API_MALLOC */
 
+#ifndef NDMOS_API_REALLOC
+#define NDMOS_API_REALLOC(P,N)	realloc((void*)(P),(N))
+#endif /* !NDMOS_API_REALLOC */
+
 #ifndef NDMOS_API_FREE
 #define NDMOS_API_FREE(P)	free((void*)(P))
 #endif /* !NDMOS_API_FREE */
@@ -65,6 +65,7 @@
 #define NDMOS_API_BCOPY(S,D,N) g_memmove((void*)(D), (void*)(S), (N))
 /* default: NDMOS_API_BZERO */
 #define NDMOS_API_MALLOC(N) g_malloc((N))
+#define NDMOS_API_REALLOC(P,N) g_realloc((void*)(P), (N))
 #define NDMOS_API_FREE(P) g_free((void*)(P))
 #define NDMOS_API_STRTOLL(P,PP,BASE) strtoll((P),(PP),(BASE))
 #define NDMOS_API_STRDUP(S) g_strdup((S))
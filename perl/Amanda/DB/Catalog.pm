@@ -168,10 +168,21 @@ on-media dumps)
 
 (integer) -- size (in kb) of this part
 
+=item bytes
+
+(integer) -- size (in bytes) of this part; zero if the log only recorded the
+size in kb
+
 =item sec
 
 (integer) -- time (in seconds) spent writing this part
 
+=item crc
+
+(string) -- checksum of this part's data, in the form C<crc32c:xxxxxxxx>;
+absent if the taper did not record one.  See L<amcheckdump(8)> for the data
+it covers.
+
 =back
 
 A part is represented as a hashref with these keys.  The C<label> and
@@ -667,9 +678,12 @@ sub get_parts_and_dumps {
 		    status => $find_result->{'status'} || 'FAILED',
 		    sec => $find_result->{'sec'},
 		    kb => $find_result->{'kb'},
+		    bytes => $find_result->{'bytes'},
 		    orig_kb => $find_result->{'orig_kb'},
 		    partnum => $find_result->{'partnum'},
 		);
+		$part{'crc'} = $find_result->{'crc'}
+		    if defined $find_result->{'crc'};
 	    } else {
 		# holding disk
 		%part = (
@@ -678,6 +692,7 @@ sub get_parts_and_dumps {
 		    status => $find_result->{'status'} || 'FAILED',
 		    sec => 0.0,
 		    kb => $find_result->{'kb'},
+		    bytes => $find_result->{'bytes'},
 		    orig_kb => $find_result->{'orig_kb'},
 		    partnum => 1,
 		);
@@ -708,10 +723,19 @@ sub get_parts_and_dumps {
 	next if $logfile eq 'holding';
 
 	# re-read the logfile to extract dump-level info that's not captured by
-	# search_logfile
-	my $logh = Amanda::Logfile::open_logfile("$logfile_dir/$logfile");
-	die "logfile '$logfile' not found" unless $logh;
-	while (my ($type, $prog, $str) = Amanda::Logfile::get_logline($logh)) {
+	# search_logfile.  Only the lines about dumps matter, and only those
+	# about the requested hosts, if any.
+	my $logidx = Amanda::Logfile::index_logfile("$logfile_dir/$logfile");
+	die "logfile '$logfile' not found" unless $logidx;
+	my @linenos;
+	if (%hostnames_hash) {
+	    @linenos = sort { $a <=> $b }
+		       map { $logidx->lookup($_, undef, undef) } keys %hostnames_hash;
+	} else {
+	    @linenos = $logidx->lookup(undef, undef, undef);
+	}
+	for my $lineno (@linenos) {
+	    my ($type, $prog, $str) = $logidx->get_line($lineno);
 	    next unless $prog == $P_TAPER;
 	    my $status;
 	    if ($type == $L_DONE) {
@@ -729,9 +753,7 @@ sub get_parts_and_dumps {
 	    # now extract the appropriate info; luckily these log lines have the same
 	    # format, more or less
 	    my ($hostname, $diskname, $dump_timestamp, $nparts, $level, $secs, $kb, $bytes, $message);
-	    ($hostname, $str) = Amanda::Util::skip_quoted_string($str);
-	    ($diskname, $str) = Amanda::Util::skip_quoted_string($str);
-	    ($dump_timestamp, $str) = Amanda::Util::skip_quoted_string($str);
+	    ($hostname, $diskname, $dump_timestamp, $str) = $logidx->get_dle_line($lineno);
 	    if ($status ne 'FAIL' and $type != $L_SUCCESS) { # nparts is not in SUCCESS lines
 		($nparts, my $str1) = Amanda::Util::skip_quoted_string($str);
 		if (substr($str1, 0,1) ne '[') {
@@ -763,8 +785,6 @@ sub get_parts_and_dumps {
 		$message = '';
 	    }
 
-	    $hostname = Amanda::Util::unquote_string($hostname);
-	    $diskname = Amanda::Util::unquote_string($diskname);
 	    $message = Amanda::Util::unquote_string($message) if $message;
 
 	    # filter against dump criteria
@@ -839,7 +859,6 @@ sub get_parts_and_dumps {
 		$dump->{'sec'} = $secs+0.0;
 	    }
 	}
-	Amanda::Logfile::close_logfile($logh);
     }
 
     return [ values %dumps], \@parts;
@@ -209,6 +209,8 @@ sub _walk {
 
 	while (defined(my $datestr = $diskh->read())) {
 	    next if $datestr eq '.' or $datestr eq '..';
+	    # the manifest kept by the C holding code, and its lock
+	    next if $datestr =~ /^\.holding-manifest/;
 
 	    my $dirfn = File::Spec->catfile($disk, $datestr);
 
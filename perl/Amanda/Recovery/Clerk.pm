@@ -130,6 +130,23 @@ the restore is done supports directtcp.
     $xfer_src_cb->(undef, $header, $xfer_src, $dtcp_supp); # OK
     $xfer_src_cb->([ $err, $err2 ], undef, undef, undef); # errors
 
+To begin the recovery partway into the dump, add an C<offset> parameter giving
+the number of bytes to skip:
+
+  $clerk->get_xfer_src(
+	dump => $dump,
+	offset => $offset,
+	xfer_src_cb => $xfer_src_cb);
+
+The offset is into the bytestream as it was written to the volume or holding
+disk, so it is only meaningful for dumps that are neither compressed nor
+encrypted on the server, or for offsets recorded against that bytestream.  The
+Clerk uses the C<bytes> of each part to find the part containing the offset,
+seeks the device to the block containing it, and skips only the remainder, so
+parts before the offset are never read.  In this case the header passed to
+C<$xfer_src_cb> is that of the part containing the offset.  Recovery from an
+offset is not supported over DirectTCP.
+
 Once C<$xfer_src_cb> has been called, build the transfer element into a
 transfer, and start the transfer.  Send all transfer messages to the clerk:
 
@@ -251,9 +268,16 @@ sub get_xfer_src {
 
 	writing_part => 0,
 
+	# bytes to skip at the beginning of the next part read
+	part_offset => 0,
+
 	errors => [],
     };
 
+    if ($params{'offset'}) {
+	return unless $self->_seek_to_offset($params{'offset'});
+    }
+
     $self->_maybe_start_part();
 }
 
@@ -377,6 +401,38 @@ sub _xmsg_done {
     );
 }
 
+# Position the xfer_state so that recovery starts OFFSET bytes into the dump:
+# find the part containing that offset, and note how far into that part to
+# begin.  On error, invokes the xfer_src_cb and returns false.
+sub _seek_to_offset {
+    my $self = shift;
+    my ($offset) = @_;
+    my $xfer_state = $self->{'xfer_state'};
+    my $parts = $xfer_state->{'dump'}->{'parts'};
+    my $idx = 1;
+
+    if (!$xfer_state->{'is_holding'}) {
+	# walk the parts, stopping at the last one regardless of its size
+	while (exists $parts->[$idx+1]) {
+	    my $bytes = $parts->[$idx]->{'bytes'};
+	    if (!$bytes or $bytes < 0) {
+		my $err = "size of part $idx is not known; cannot start recovery at offset $offset";
+		$self->{'xfer_state'} = undef;
+		$xfer_state->{'xfer_src_cb'}->([ $err ], undef, undef, undef);
+		return 0;
+	    }
+	    last if $offset < $bytes;
+	    $offset -= $bytes;
+	    $idx++;
+	}
+    }
+
+    $self->dbg("starting recovery at byte $offset of part $idx");
+    $xfer_state->{'next_part_idx'} = $idx;
+    $xfer_state->{'part_offset'} = $offset;
+    return 1;
+}
+
 sub _maybe_start_part {
     my $self = shift;
     my ($finished_cb) = @_;
@@ -542,6 +598,14 @@ sub _maybe_start_part {
 	    return $steps->{'handle_error'}->();
 	}
 
+	# DirectTCP transfers always move whole parts
+	if ($xfer_state->{'part_offset'} and $dev->directtcp_supported()) {
+	    push @{$xfer_state->{'errors'}},
+		"recovery from an offset is not supported on device '"
+		. $dev->device_name . "'";
+	    return $steps->{'handle_error'}->();
+	}
+
 	# now, either start the part, or invoke the xfer_src_cb.
 	if ($xfer_state->{'xfer_src_cb'}) {
 	    my $cb = $xfer_state->{'xfer_src_cb'};
@@ -560,6 +624,21 @@ sub _maybe_start_part {
 	    # notify caller of the part
 	    $self->{'feedback'}->clerk_notif_part($next_label, $next_filenum, $on_vol_hdr);
 
+	    # if starting partway into the part, seek to the block containing
+	    # the offset and have the source discard the rest
+	    if ($xfer_state->{'part_offset'}) {
+		my $offset = $xfer_state->{'part_offset'};
+		my $block_size = $dev->block_size();
+		$xfer_state->{'part_offset'} = 0;
+
+		$self->dbg("seeking to byte $offset of file $next_filenum");
+		if (!$dev->seek_block(int($offset / $block_size))) {
+		    push @{$xfer_state->{'errors'}}, $dev->error_or_status();
+		    return $steps->{'handle_error'}->();
+		}
+		$xfer_state->{'xfer_src'}->skip($offset % $block_size);
+	    }
+
 	    # start the part
 	    $self->dbg("reading file $next_filenum on '$next_label'");
 	    $xfer_state->{'xfer_src'}->start_part($dev);
@@ -595,7 +674,9 @@ sub _maybe_start_part {
 	    $xfer_state->{'xfer_src_cb'} = undef;
 
 	    $xfer_state->{'xfer_src'} = Amanda::Xfer::Source::Holding->new(
-			$xfer_state->{'dump'}->{'parts'}[1]{'holding_file'}),
+			$xfer_state->{'dump'}->{'parts'}[1]{'holding_file'});
+	    $xfer_state->{'xfer_src'}->skip($xfer_state->{'part_offset'})
+		if $xfer_state->{'part_offset'};
 
 	    # Amanda::Xfer::Source::Holding was *born* ready.
 	    $xfer_state->{'xfer_src_ready'} = 1;
@@ -453,7 +453,7 @@ sub read_file
     $self->{flags}    = {};
     $self->{run_timestamp} = '00000000000000';
 
-    my $logfh = Amanda::Logfile::open_logfile($logfname)
+    my $logidx = Amanda::Logfile::index_logfile($logfname)
       or die "cannot open '$logfname': $!";
 
     $self->{flags}{exit_status} = 0;
@@ -461,8 +461,9 @@ sub read_file
     $self->{flags}{dump_failed} = 0;
     $self->{flags}{dump_strange} = 0;
 
-    while ( my ( $type, $prog, $str ) = Amanda::Logfile::get_logline($logfh) ) {
-        $self->read_line( $type, $prog, $str );
+    my $nlines = $logidx->nlines();
+    for ( my $i = 0 ; $i < $nlines ; $i++ ) {
+        $self->read_line( $logidx->get_line($i) );
     }
 
     ## set post-run flags
@@ -938,7 +939,7 @@ sub _handle_taper_line
     } elsif ( $type == $L_PART || $type == $L_PARTPARTIAL ) {
 
 # format is:
-# <label> <tapefile> <hostname> <disk> <timestamp> <currpart>/<predparts> <level> [sec <sec> kb <kb> kps <kps>]
+# <label> <tapefile> <hostname> <disk> <timestamp> <currpart>/<predparts> <level> [sec <sec> kb <kb> kps <kps> [orig-kb <kb>] [crc <crc>]]
 #
 # format for $L_PARTPARTIAL is the same as $L_PART, plus <err> at the end
         my @info = Amanda::Util::split_quoted_strings($str);
@@ -947,10 +948,22 @@ sub _handle_taper_line
         $info[5] =~ m{^(\d+)\/(-?\d+)$};
         my ( $currpart, $predparts ) = ( $1, $2 );
 
-        my ($level, $sec, $kb, $kps, $orig_kb) = @info[ 6, 8, 10, 12, 14 ];
+        my ($level, $sec, $kb, $kps) = @info[ 6, 8, 10, 12 ];
+	my ($orig_kb, $crc);
 	$kb = int($kb/1024) if $info[9] eq 'bytes';
+	if ($kps !~ /\]$/) {
+	    my $i = 13;
+	    if (defined $info[$i] and $info[$i] eq 'orig-kb') {
+		$orig_kb = $info[$i+1];
+		$i += 2;
+	    }
+	    if (defined $info[$i] and $info[$i] eq 'crc') {
+		$crc = $info[$i+1];
+	    }
+	}
         $kps =~ s{\]$}{};
         $orig_kb =~ s{\]$}{} if defined($orig_kb);
+        $crc =~ s{\]$}{} if defined($crc);
 
         my $dle   = $disklist->{$hostname}{$disk};
         my $try   = $self->_get_try($dle, "taper", $timestamp);
@@ -966,6 +979,7 @@ sub _handle_taper_line
             kps   => $kps,
             partnum  => $currpart,
         };
+	$part->{crc} = $crc if defined $crc;
 
 	$taper->{orig_kb} = $orig_kb;
 
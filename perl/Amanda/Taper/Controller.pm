@@ -50,6 +50,7 @@ use Amanda::MainLoop;
 use Amanda::Taper::Protocol;
 use Amanda::Taper::Scan;
 use Amanda::Taper::Worker;
+use Amanda::Taper::Throughput;
 use Amanda::Interactivity;
 use Amanda::Logfile qw( :logtype_t log_add );
 use Amanda::Xfer qw( :constants );
@@ -67,6 +68,10 @@ sub new {
 	proto => undef,
 	tapelist => $params{'tapelist'},
 
+	# part sizes chosen from measured throughput
+	throughput => Amanda::Taper::Throughput->new(
+	    filename => config_dir_relative(getconf($CNF_LOGDIR)) . "/taper-throughput"),
+
 	worker => {},
     }, $class;
     return $self;
@@ -38,6 +38,7 @@ package Amanda::Taper::Protocol;
 
 use Amanda::IPC::LineProtocol;
 use base "Amanda::IPC::LineProtocol";
+use Amanda::Logfile qw( log_flush );
 
 use constant START_TAPER => message("START-TAPER",
     format => [ qw( worker_name timestamp ) ],
@@ -133,4 +134,13 @@ use constant CLOSE_VOLUME => message("CLOSE-VOLUME",
     format => [ qw( worker_name ) ],
 );
 
+# the driver may act on a message at once; write what the taper has logged
+# first, in case the log is batched
+sub send {
+    my $self = shift;
+
+    log_flush();
+    return $self->SUPER::send(@_);
+}
+
 1;
@@ -201,6 +201,12 @@ the maximum part size to use when caching
 true if the transfer source can call the destination's C<cache_inform> method
 (e.g., C<Amanda::Xfer::Source::Holding>).
 
+=item C<watermark>
+
+when the device runs out of data in the middle of a part, the number of bytes
+to buffer before writing to it again (see C<set_watermark> in
+L<Amanda::Xfer>); omit it to follow the device's C<STREAMING> property
+
 =back
 
 The first four of these parameters correspond exactly to the eponymous tapetype
@@ -392,13 +398,22 @@ later than expected, e.g., during a C<quit> invocation.
         fileno => $fileno,
         successful => $successful,
         size => $size,
-        duration => $duration);
+        duration => $duration,
+        crc => $crc,
+        stalls => $stalls,
+        stall_duration => $stall_duration,
+        slow_writes => $slow_writes);
 
 The Scribe calls C<scribe_notif_part_done> for each part written to the volume,
 including partial parts.  If the part was not written successfully, then
 C<successful> is false.  The C<size> is in bytes, and the C<duration> is
 a floating-point number of seconds.  If a part fails before a new device
-file is created, then C<fileno> may be zero.
+file is created, then C<fileno> may be zero.  The C<crc> is the part's
+checksum, in the form C<crc32c:xxxxxxxx>, or undef if the transfer
+destination did not compute one.  C<stalls> is the number of times the device
+ran out of data while writing the part, C<stall_duration> the seconds it spent
+waiting for data, and C<slow_writes> the number of writes that took much longer
+than usual, as when a tape drive repositions.
 
 Finally, the Scribe sends a few historically significant trace log messages
 via C<scribe_notif_log_info>:
@@ -737,6 +752,8 @@ sub get_xfer_dest {
 	    $use_mem_cache, $disk_cache_dirname);
 	$self->{'xdt_ready'} = 1; # xdt is ready immediately
     }
+    $xdt->set_watermark($params{'watermark'})
+	if $params{'watermark'} and $dest_type ne 'directtcp';
     $self->{'start_part_on_xdt_ready'} = 0;
     $self->{'xdt'} = $xdt;
 
@@ -895,7 +912,11 @@ sub _xmsg_part_done {
 	    fileno => $msg->{'fileno'},
 	    successful => $msg->{'successful'},
 	    size => $msg->{'size'},
-	    duration => $msg->{'duration'});
+	    duration => $msg->{'duration'},
+	    crc => $msg->{'crc'},
+	    stalls => $msg->{'stalls'},
+	    stall_duration => $msg->{'stall_duration'},
+	    slow_writes => $msg->{'slow_writes'});
 
 	# increment nparts here, so empty parts are not counted
 	$self->{'nparts'} = $msg->{'partnum'};
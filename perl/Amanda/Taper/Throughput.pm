@@ -0,0 +1,216 @@
+# Copyright (c) Zmanda, Inc.  All Rights Reserved.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License version 2.1 as
+# published by the Free Software Foundation.
+#
+# This library is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+# or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+# License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library; if not, write to the Free Software Foundation,
+# Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA.
+#
+# Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+# Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
+
+package Amanda::Taper::Throughput;
+
+=head1 NAME
+
+Amanda::Taper::Throughput - choose part sizes from measured throughput
+
+=head1 SYNOPSIS
+
+  my $tput = Amanda::Taper::Throughput->new(
+	filename => "$logdir/taper-throughput");
+
+  my ($part_size, $why) = $tput->choose_part_size(
+	device => "tape/LTO4",
+	block_size => 262144,
+	part_size => 10*1024**3,	# as configured
+	min => 1024**3,
+	max => 64*1024**3,
+	dump_size => $size);		# if known
+
+  # for each full part written
+  $tput->add_part(
+	device => "tape/LTO4",
+	block_size => 262144,
+	part_size => $part_size,
+	size => $bytes,
+	duration => $seconds);
+
+  $tput->save();
+
+=head1 DESCRIPTION
+
+This package keeps the throughput the taper has achieved writing parts of each
+size, and uses it to choose the part size for the next dump.  The history is
+kept per device, block size and part size.  The device is named by the caller;
+the taper uses the device type and the tapetype, e.g., C<s3/S3TYPE>, so that
+every slot of a changer shares one history.
+
+Only full parts are measured, since the last part of a dump is usually short,
+and the average is weighted towards recent parts, so that the choice follows
+changes in the devices.
+
+C<choose_part_size> considers the part sizes from C<min> (by default, a
+sixteenth of C<max>) to C<max>, doubling from C<min>, as well as the
+configured part size.  Sizes larger than the dump are left out, since they
+would write it in one part anyway.  Each size is tried until it has been
+measured C<$MIN_SAMPLES> times; after that, the size with the best throughput
+is chosen.  It returns the chosen size and a short description of why it was
+chosen, for the logs.
+
+C<save> writes the history back to its file; it is safe to call it after
+every dump.
+
+=cut
+
+use strict;
+use warnings;
+use Amanda::Debug qw( :logging );
+
+# parts of a size to measure before trusting its throughput
+our $MIN_SAMPLES = 3;
+
+# weight of the latest part in the average
+our $WEIGHT = 0.25;
+
+# never consider more part sizes than this
+our $MAX_CANDIDATES = 12;
+
+sub new {
+    my $class = shift;
+    my %params = @_;
+
+    my $self = bless {
+	filename => $params{'filename'},
+	history => {},
+    }, $class;
+
+    $self->_load();
+    return $self;
+}
+
+sub _key {
+    my ($device, $block_size, $part_size) = @_;
+
+    # the device name must be a single word in the file
+    $device =~ s/\s/_/g;
+    return "$device $block_size $part_size";
+}
+
+sub _load {
+    my $self = shift;
+    my $fh;
+
+    return if !defined $self->{'filename'} or !-f $self->{'filename'};
+    if (!open($fh, "<", $self->{'filename'})) {
+	warning("could not open '$self->{filename}': $!");
+	return;
+    }
+    while (my $line = <$fh>) {
+	chomp $line;
+	my ($device, $block_size, $part_size, $count, $rate) = split ' ', $line;
+	next if !defined $rate or $rate !~ /^[\d.]+$/;
+	$self->{'history'}->{_key($device, $block_size, $part_size)} =
+	    { count => $count, rate => $rate };
+    }
+    close($fh);
+}
+
+sub save {
+    my $self = shift;
+    my $fh;
+
+    return if !defined $self->{'filename'};
+    my $tmp = "$self->{filename}.tmp";
+    if (!open($fh, ">", $tmp)) {
+	warning("could not write '$tmp': $!");
+	return;
+    }
+    for my $key (sort keys %{$self->{'history'}}) {
+	my $h = $self->{'history'}->{$key};
+	printf $fh "%s %d %.0f\n", $key, $h->{'count'}, $h->{'rate'};
+    }
+    if (!close($fh) or !rename($tmp, $self->{'filename'})) {
+	warning("could not write '$self->{filename}': $!");
+	unlink($tmp);
+    }
+}
+
+sub add_part {
+    my $self = shift;
+    my %params = @_;
+
+    return if $params{'duration'} <= 0;
+
+    my $key = _key(@params{'device', 'block_size', 'part_size'});
+    my $rate = $params{'size'} / $params{'duration'};
+    my $h = $self->{'history'}->{$key};
+
+    if (!$h) {
+	$self->{'history'}->{$key} = { count => 1, rate => $rate };
+    } else {
+	$h->{'count'}++;
+	# until there are enough samples, use the plain mean
+	my $weight = $h->{'count'} > $MIN_SAMPLES? $WEIGHT : 1 / $h->{'count'};
+	$h->{'rate'} += $weight * ($rate - $h->{'rate'});
+    }
+}
+
+sub choose_part_size {
+    my $self = shift;
+    my %params = @_;
+    my ($min, $max) = ($params{'min'}, $params{'max'});
+
+    $min = int($max / 16) if $min <= 0;
+    $min = $max if $min > $max;
+
+    # a dump no bigger than the smallest part is written in one part
+    if (defined $params{'dump_size'} and $params{'dump_size'} <= $min) {
+	return ($params{'part_size'}, "dump fits in one part");
+    }
+
+    my %sizes;
+    for (my $size = $min; $size <= $max; $size *= 2) {
+	$sizes{$size} = 1;
+	last if keys %sizes >= $MAX_CANDIDATES;
+    }
+    $sizes{$max} = 1;
+    $sizes{$params{'part_size'}} = 1
+	if ($params{'part_size'} >= $min and $params{'part_size'} <= $max);
+    my @sizes = grep {
+	$_ > 0 and (!defined $params{'dump_size'} or $_ <= $params{'dump_size'})
+    } keys %sizes;
+    @sizes = ($min || $params{'part_size'}) if !@sizes;
+
+    my %hist = map {
+	($_, $self->{'history'}->{_key($params{'device'}, $params{'block_size'}, $_)}
+	     || { count => 0, rate => 0 })
+    } @sizes;
+
+    # measure the configured size first, then the largest
+    my @unmeasured = sort {
+	($b == $params{'part_size'}) <=> ($a == $params{'part_size'})
+	    or $hist{$a}->{'count'} <=> $hist{$b}->{'count'}
+	    or $b <=> $a
+    } grep { $hist{$_}->{'count'} < $MIN_SAMPLES } @sizes;
+    if (@unmeasured) {
+	my $size = $unmeasured[0];
+	return ($size, sprintf("measuring, %d of %d parts",
+			       $hist{$size}->{'count'} + 1, $MIN_SAMPLES));
+    }
+
+    my ($best) = sort {
+	$hist{$b}->{'rate'} <=> $hist{$a}->{'rate'} or $b <=> $a
+    } @sizes;
+    return ($best, sprintf("best measured, %.1f MB/s",
+			   $hist{$best}->{'rate'} / (1024*1024)));
+}
+
+1;
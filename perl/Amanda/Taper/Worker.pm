@@ -294,6 +294,17 @@ sub result_cb {
     push @all_messages, $params{'config_denial_message'} if $params{'config_denial_message'};
     my $msg = quote_string(join("; ", @all_messages));
 
+    # note when the device could not stream, so the buffer can be tuned
+    my $streaming = $self->{'streaming'};
+    if ($streaming and $streaming->{'stalls'} > 0) {
+	log_add($L_INFO, sprintf("%s:%s: device ran out of data %d times, idle %.1f seconds; %d slow writes%s",
+		$self->{'hostname'}, $self->{'diskname'},
+		$streaming->{'stalls'}, $streaming->{'stall_duration'},
+		$streaming->{'slow_writes'},
+		$streaming->{'slow_writes'} > 0?
+		    " (drive repositioning; consider a larger device-output-buffer-size or device-output-buffer-watermark)" : ""));
+    }
+
     # write a DONE/PARTIAL/FAIL log line
     if ($logtype == $L_FAIL) {
 	log_add($L_FAIL, sprintf("%s %s %s %s %s %s",
@@ -344,6 +355,11 @@ sub result_cb {
 	$msg_params{'stats'} = $stats;
     }
 
+    if ($self->{'part_size_tuning'}) {
+	$self->{'controller'}->{'throughput'}->save();
+	delete $self->{'part_size_tuning'};
+    }
+
     # reset things to 'idle' before sending the message
     $self->{'xfer'} = undef;
     $self->{'xfer_source'} = undef;
@@ -415,7 +431,8 @@ sub scribe_notif_part_done {
 
     $self->_assert_in_state("writing") or return;
 
-    my $stats = make_stats($params{'size'}, $params{'duration'}, $self->{'orig_kb'});
+    my $stats = make_stats($params{'size'}, $params{'duration'}, $self->{'orig_kb'},
+			   $params{'crc'});
 
     # log the part, using PART or PARTPARTIAL
     my $logbase = sprintf("%s %s %s %s %s %s/%s %s %s",
@@ -429,10 +446,24 @@ sub scribe_notif_part_done {
 	$stats);
     if ($params{'successful'}) {
 	log_add($L_PART, $logbase);
+
+	# measure the throughput of full parts of a tuned size
+	my $tuning = $self->{'part_size_tuning'};
+	if ($tuning and $params{'size'} == $tuning->{'part_size'}) {
+	    $self->{'controller'}->{'throughput'}->add_part(
+		%$tuning,
+		size => $params{'size'},
+		duration => $params{'duration'});
+	}
     } else {
 	log_add($L_PARTPARTIAL, "$logbase \"No space left on device\"");
     }
 
+    # tally how well the device streamed, for result_cb
+    for my $key (qw(stalls stall_duration slow_writes)) {
+	$self->{'streaming'}->{$key} += $params{$key} || 0;
+    }
+
     # only send a PARTDONE if it was successful
     if ($params{'successful'}) {
 	$self->{'controller'}->{'proto'}->send(Amanda::Taper::Protocol::PARTDONE,
@@ -631,6 +662,13 @@ sub setup_and_start_dump {
 		$get_xfer_dest_args{'max_memory'} = $block_size4;
 	    }
 	}
+	my $watermark = getconf($CNF_DEVICE_OUTPUT_BUFFER_WATERMARK);
+	if ($watermark > 0) {
+	    $get_xfer_dest_args{'watermark'} =
+		int($get_xfer_dest_args{'max_memory'} * $watermark / 100);
+	}
+	$self->{'streaming'} = { stalls => 0, stall_duration => 0, slow_writes => 0 };
+	$self->_tune_part_size($device, $msgtype, \%params, \%get_xfer_dest_args);
 	$device = undef;
 	$get_xfer_dest_args{'can_cache_inform'} = ($msgtype eq Amanda::Taper::Protocol::FILE_WRITE and $get_xfer_dest_args{'allow_split'});
 
@@ -738,6 +776,56 @@ sub setup_and_start_dump {
     };
 }
 
+# If the tapetype sets part-size-max, choose the part size for this dump from
+# the throughput measured with each size on this kind of device, and log the
+# choice for amreport.
+sub _tune_part_size {
+    my $self = shift;
+    my ($device, $msgtype, $params, $xfer_dest_args) = @_;
+
+    delete $self->{'part_size_tuning'};
+
+    my $tt = lookup_tapetype(getconf($CNF_TAPETYPE));
+    return if !$tt;
+    my $max = tapetype_getconf($tt, $TAPETYPE_PART_SIZE_MAX) * 1024;
+    my $min = tapetype_getconf($tt, $TAPETYPE_PART_SIZE_MIN) * 1024;
+    return if !$max or !$xfer_dest_args->{'allow_split'}
+	   or !$xfer_dest_args->{'part_size'};
+
+    # parts must still fit in the cache
+    my $cache_type = $xfer_dest_args->{'part_cache_type'} || 'none';
+    my $cache_max = $xfer_dest_args->{'part_cache_max_size'};
+    if ($cache_type ne 'none' and $cache_max) {
+	$max = Math::BigInt->new($cache_max)->numify() if $cache_max < $max;
+    }
+
+    my $dump_size;
+    if ($msgtype eq Amanda::Taper::Protocol::FILE_WRITE) {
+	$dump_size = Amanda::Holding::file_size($params->{'filename'}, 1) * 1024;
+    }
+
+    my ($devtype) = split /:/, $device->device_name;
+    my $tuning = {
+	device => $devtype . "/" . tapetype_name($tt),
+	block_size => $device->block_size,
+    };
+    my ($part_size, $why) = $self->{'controller'}->{'throughput'}->choose_part_size(
+	%$tuning,
+	part_size => Math::BigInt->new($xfer_dest_args->{'part_size'})->numify(),
+	min => $min,
+	max => $max,
+	dump_size => defined $dump_size? $dump_size->numify() : undef);
+    $tuning->{'part_size'} = $part_size;
+
+    $xfer_dest_args->{'part_size'} = Math::BigInt->new($part_size);
+    $self->{'part_size_tuning'} = $tuning;
+
+    log_add($L_INFO, sprintf("%s:%s: part size %d kb, block size %d kb on %s (%s)",
+	    $params->{'hostname'}, $params->{'diskname'},
+	    $part_size / 1024, $tuning->{'block_size'} / 1024,
+	    $tuning->{'device'}, $why));
+}
+
 sub dump_cb {
     my $self = shift;
     my %params = @_;
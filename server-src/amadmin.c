@@ -1322,7 +1322,7 @@ remove_holding_file_from_catalog(
     history_t matching_hist; /* will be a copy */
     int i;
 
-    if (!holding_file_get_dumpfile(filename, &file)) {
+    if (!holding_file_get_summary(filename, &file)) {
         g_printf(_("Could not read holding file %s\n"), filename);
         return 0;
     }
@@ -1484,7 +1484,7 @@ holding(
                 char *dumpstr;
 		int is_outdated;
 
-                if (!holding_file_get_dumpfile((char *)li->data, &file)) {
+                if (!holding_file_get_summary((char *)li->data, &file)) {
                     g_fprintf(stderr, _("Error reading %s\n"), (char *)li->data);
                     continue;
                 }
@@ -44,7 +44,7 @@ use Amanda::Xfer qw( :constants );
 
 sub usage {
     print <<EOF;
-USAGE:	amcheckdump [ --timestamp|-t timestamp ] [-o configoption]* <conf>
+USAGE:	amcheckdump [ --timestamp|-t timestamp ] [ --checksum ] [-o configoption]* <conf>
     amcheckdump validates Amanda dump images by reading them from storage
 volume(s), and verifying archive integrity if the proper tool is locally
 available. amcheckdump does not actually compare the data located in the image
@@ -55,6 +55,9 @@ to anything; it just validates that the archive stream is valid.
 			the most recent dump; if this parameter is specified,
 			check the most recent dump matching the given
 			date- or timestamp.
+	--checksum   - Compare the checksum of each part read with the one
+			recorded when it was written, instead of running the
+			archive's validation tool.
 	-o configoption	- see the CONFIGURATION OVERRIDE section of amanda(8)
 EOF
     exit(1);
@@ -67,6 +70,7 @@ Amanda::Util::setup_application("amcheckdump", "server", $CONTEXT_CMDLINE);
 my $exit_code = 0;
 
 my $opt_timestamp;
+my $opt_checksum = 0;
 my $opt_verbose = 0;
 my $config_overrides = new_config_overrides($#ARGV+1);
 
@@ -75,6 +79,7 @@ Getopt::Long::Configure(qw(bundling));
 GetOptions(
     'version' => \&Amanda::Util::version_opt,
     'timestamp|t=s' => \$opt_timestamp,
+    'checksum'      => \$opt_checksum,
     'verbose|v'     => \$opt_verbose,
     'help|usage|?'  => \&usage,
     'o=s' => sub { add_config_override_opt($config_overrides, $_[1]); },
@@ -262,6 +267,9 @@ sub main {
     my @xfer_errs;
     my %all_filter;
     my $check_done;
+    my @parts_to_check;
+    my $nchecked = 0;
+    my $nunchecked = 0;
 
     my $steps = define_steps
 	cb_ref => \$finished_cb,
@@ -350,6 +358,7 @@ sub main {
 	print "\n";
 
 	@xfer_errs = ();
+	@parts_to_check = grep { defined } @{$dump->{'parts'}};
 	$clerk->get_xfer_src(
 	    dump => $dump,
 	    xfer_src_cb => $steps->{'xfer_src_cb'});
@@ -359,6 +368,16 @@ sub main {
 	my ($errs, $hdr, $xfer_src, $directtcp_supported) = @_;
 	return $steps->{'quit'}->(join("; ", @$errs)) if $errs;
 
+	# when checking checksums, the data is read as it was written
+	if ($opt_checksum) {
+	    my $xfer = Amanda::Xfer->new([ $xfer_src,
+					   Amanda::Xfer::Dest::Null->new(0) ]);
+	    $xfer->start($steps->{'handle_xmsg'});
+	    return $clerk->start_recovery(
+		xfer => $xfer,
+		recovery_cb => $steps->{'recovery_cb'});
+	}
+
 	# set up any filters that need to be applied; decryption first
 	my @filters;
 	if ($hdr->{'encrypted'}) {
@@ -397,7 +416,11 @@ sub main {
 		    Amanda::Xfer::Filter::Process->new(
 			[ $hdr->{'clntcompprog'}, "-d" ], 0);
 	    } else {
-		push @filters,
+		# gzip data can be uncompressed in-process, if zlib is available
+		my $gunzip;
+		$gunzip = Amanda::Xfer::Filter::Gunzip->new()
+		    if (defined $hdr->{'comp_suffix'} and $hdr->{'comp_suffix'} eq '.gz');
+		push @filters, $gunzip ||
 		    Amanda::Xfer::Filter::Process->new(
 			[ $Amanda::Constants::UNCOMPRESS_PATH,
 			  $Amanda::Constants::UNCOMPRESS_OPT ], 0);
@@ -420,6 +443,7 @@ sub main {
 
 	# start reading all filter stderr
 	foreach my $filter (@filters) {
+	    next unless $filter->can('get_stderr_fd');
 	    my $fd = $filter->get_stderr_fd();
 	    $fd.="";
 	    $fd = int($fd);
@@ -467,6 +491,16 @@ sub main {
 	    Amanda::Debug::info($msg->{'message'});
 	} elsif ($msg->{'type'} == $XMSG_ERROR) {
 	    push @xfer_errs, $msg->{'message'};
+	} elsif ($msg->{'type'} == $XMSG_PART_DONE and $opt_checksum) {
+	    my $part = shift @parts_to_check;
+	    if (!$part or !defined $part->{'crc'} or !defined $msg->{'crc'}) {
+		$nunchecked++;
+	    } elsif ($part->{'crc'} ne $msg->{'crc'}) {
+		push @xfer_errs, "volume '$part->{label}' file $part->{filenum}: " .
+				 "checksum is $msg->{crc}, expected $part->{crc}";
+	    } else {
+		$nchecked++;
+	    }
 	}
     };
 
@@ -504,6 +538,12 @@ sub main {
 	    return $steps->{'quit1'}->();
 	}
 
+	if ($opt_checksum) {
+	    print "$nchecked parts matched their checksum";
+	    print "; $nunchecked parts had no checksum to compare" if $nunchecked;
+	    print "\n";
+	}
+
 	if ($all_success) {
 	    print "All images successfully validated\n";
 	} else {
@@ -113,7 +113,8 @@ sub usage {
     my ($msg) = @_;
     print STDERR <<EOF;
 Usage: amfetchdump [-c|-C|-l] [-p|-n] [-a] [-O directory] [-d device]
-    [-h] [--header-file file] [--header-fd fd] [-o configoption]* config
+    [-h] [--header-file file] [--header-fd fd] [--offset bytes]
+    [-o configoption]* config
     hostname [diskname [datestamp [hostname [diskname [datestamp ... ]]]]]
 EOF
     print STDERR "ERROR: $msg\n" if $msg;
@@ -129,7 +130,7 @@ my $config_overrides = new_config_overrides($#ARGV+1);
 
 my ($opt_config, $opt_no_reassembly, $opt_compress, $opt_compress_best, $opt_pipe,
     $opt_assume, $opt_leave, $opt_blocksize, $opt_device, $opt_chdir, $opt_header,
-    $opt_header_file, $opt_header_fd, @opt_dumpspecs);
+    $opt_header_file, $opt_header_fd, $opt_offset, @opt_dumpspecs);
 
 debug("Arguments: " . join(' ', @ARGV));
 Getopt::Long::Configure(qw(bundling));
@@ -145,6 +146,7 @@ GetOptions(
     'h' => \$opt_header,
     'header-file=s' => \$opt_header_file,
     'header-fd=i' => \$opt_header_fd,
+    'offset=s' => \$opt_offset,
     'b=s' => \$opt_blocksize,
     'd=s' => \$opt_device,
     'O=s' => \$opt_chdir,
@@ -166,6 +168,10 @@ usage("-l is not compatible with -c or -C")
     if ($opt_leave and $opt_compress);
 usage("-p is not compatible with -n")
     if ($opt_leave and $opt_no_reassembly);
+usage("--offset is not compatible with -n")
+    if ($opt_offset and $opt_no_reassembly);
+usage("--offset must be a number of bytes")
+    if (defined $opt_offset and $opt_offset !~ /^\d+$/);
 usage("-h, --header-file, and --header-fd are mutually incompatible")
     if (($opt_header and $opt_header_file or $opt_header_fd)
 	    or ($opt_header_file and $opt_header_fd));
@@ -327,6 +333,7 @@ sub main {
 
 	$clerk->get_xfer_src(
 	    dump => $current_dump,
+	    offset => $opt_offset,
 	    xfer_src_cb => $steps->{'xfer_src_cb'});
     };
 
@@ -334,6 +341,13 @@ sub main {
 	my ($errs, $hdr, $xfer_src, $directtcp_supported) = @_;
 	return failure(join("; ", @$errs), $finished_cb) if $errs;
 
+	# an offset is into the stored bytestream, so that is all we can produce
+	if ($opt_offset and ($hdr->{'compressed'} or $hdr->{'encrypted'})
+		and not $opt_leave) {
+	    return failure("--offset requires -l for a compressed or encrypted dump",
+			$finished_cb);
+	}
+
 	# and set up the destination..
 	my $dest_fh;
 	if ($opt_pipe) {
@@ -399,7 +413,11 @@ sub main {
 		    Amanda::Xfer::Filter::Process->new(
 			[ $hdr->{'clntcompprog'}, "-d" ], 0);
 	    } else {
-		push @filters,
+		# gzip data can be uncompressed in-process, if zlib is available
+		my $gunzip;
+		$gunzip = Amanda::Xfer::Filter::Gunzip->new()
+		    if (defined $hdr->{'comp_suffix'} and $hdr->{'comp_suffix'} eq '.gz');
+		push @filters, $gunzip ||
 		    Amanda::Xfer::Filter::Process->new(
 			[ $Amanda::Constants::UNCOMPRESS_PATH,
 			  $Amanda::Constants::UNCOMPRESS_OPT ], 0);
@@ -442,6 +460,7 @@ sub main {
 
 	# start reading all filter stderr
 	foreach my $filter (@filters) {
+	    next unless $filter->can('get_stderr_fd');
 	    my $fd = $filter->get_stderr_fd();
 	    $fd.="";
 	    $fd = int($fd);
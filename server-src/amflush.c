@@ -356,7 +356,7 @@ main(
     for(holding_file=holding_list; holding_file != NULL;
 				   holding_file = holding_file->next) {
 	dumpfile_t file;
-	holding_file_get_dumpfile((char *)holding_file->data, &file);
+	holding_file_get_summary((char *)holding_file->data, &file);
 
 	if (holding_file_size((char *)holding_file->data, 1) <= 0) {
 	    g_debug("%s is empty - ignoring", (char *)holding_file->data);
@@ -517,6 +517,7 @@ main(
     config_options = get_config_options(2);
     config_options[0] = "amlogroll";
     config_options[1] = get_config_name();
+    dbflush();
     safe_fd(-1, 0);
     execve(logroll_program, config_options, safe_env());
     error(_("cannot exec %s: %s"), logroll_program, strerror(errno));
@@ -572,7 +572,11 @@ sub xfer_src_cb {
 	    if (!$self->{'their_features'}->has($Amanda::Feature::fe_amrecover_receive_unfiltered) ||
 		$dle->{'compress'} == $Amanda::Config::COMP_SERVER_FAST ||
 		$dle->{'compress'} == $Amanda::Config::COMP_SERVER_BEST) {
-		push @filters,
+		# gzip data can be uncompressed in-process, if zlib is available
+		my $gunzip;
+		$gunzip = Amanda::Xfer::Filter::Gunzip->new()
+		    if (defined $header->{'comp_suffix'} and $header->{'comp_suffix'} eq '.gz');
+		push @filters, $gunzip ||
 		    Amanda::Xfer::Filter::Process->new(
 			[ $Amanda::Constants::UNCOMPRESS_PATH,
 			  $Amanda::Constants::UNCOMPRESS_OPT ], 0);
@@ -677,6 +681,7 @@ sub start_xfer {
 
     # start reading all filter stderr
     foreach my $filter (@{$self->{'xfer_filters'}}) {
+	next unless $filter->can('get_stderr_fd');
 	my $fd = $filter->get_stderr_fd();
 	$fd.="";
 	$fd = int($fd);
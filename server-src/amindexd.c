@@ -59,6 +59,10 @@
 
 #include <grp.h>
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #define DBG(i, ...) do {		\
 	if ((i) <= debug_amindexd) {	\
 	    g_debug(__VA_ARGS__);	\
@@ -181,6 +185,128 @@ remove_files(
     return remove;
 }
 
+#ifdef HAVE_ZLIB
+/*
+ * Uncompress the gzip'd index FILENAME_GZ to FILENAME without running
+ * UNCOMPRESS_PATH, keeping only the lines with a '/'.  The dumper writes most
+ * indexes sorted, so SORT_PATH is only run if a line is found out of order.
+ * Returns FALSE, with the reason added to EMSG, on failure.
+ */
+static gboolean
+gunzip_index(
+    char       *filename_gz,
+    char       *filename,
+    GPtrArray **emsg)
+{
+    gzFile gz;
+    FILE *out;
+    int indexfd;
+    int nullfd;
+    int sort_errfd;
+    pid_t pid_sort;
+    FILE *sort_err_stream;
+    char line[STR_SIZE];
+    char prev[STR_SIZE];
+    size_t len;
+    gboolean sorted = TRUE;
+    gboolean first = TRUE;
+    int zerr = Z_OK;
+    char *msg;
+
+    gz = gzopen(filename_gz, "rb");
+    if (gz == NULL) {
+	msg = g_strdup_printf(_("Can't open '%s': %s"), filename_gz,
+			      errno? strerror(errno) : _("out of memory"));
+	dbprintf("%s\n", msg);
+	g_ptr_array_add(*emsg, msg);
+	return FALSE;
+    }
+#if ZLIB_VERNUM >= 0x1240
+    gzbuffer(gz, 256*1024);
+#endif
+
+    indexfd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+    if (indexfd == -1 || (out = fdopen(indexfd, "w")) == NULL) {
+	msg = g_strdup_printf(_("Can't open '%s' for writting: %s"),
+			      filename, strerror(errno));
+	dbprintf("%s\n", msg);
+	g_ptr_array_add(*emsg, msg);
+	if (indexfd != -1)
+	    close(indexfd);
+	gzclose(gz);
+	return FALSE;
+    }
+
+    while (gzgets(gz, line, sizeof(line)) != NULL) {
+	if (line[0] == '\0' || !strchr(line, '/'))
+	    continue;
+	fputs(line, out);
+
+	/* compare lines as 'LC_ALL=C sort' does; leave a line too long for
+	 * the buffer to sort */
+	len = strlen(line);
+	if (line[len-1] == '\n')
+	    line[len-1] = '\0';
+	else if (!gzeof(gz))
+	    sorted = FALSE;
+	if (sorted && !first && strcmp(prev, line) > 0)
+	    sorted = FALSE;
+	strcpy(prev, line);
+	first = FALSE;
+    }
+    gzerror(gz, &zerr);
+    if (zerr == Z_OK || zerr == Z_STREAM_END) {
+	zerr = gzclose(gz);
+    } else {
+	gzclose(gz);
+    }
+    if (zerr != Z_OK && zerr != Z_STREAM_END) {
+	msg = g_strdup_printf(_("Can't uncompress '%s': %s"), filename_gz,
+			      zerr == Z_ERRNO? strerror(errno) : _("corrupt data"));
+	dbprintf("%s\n", msg);
+	g_ptr_array_add(*emsg, msg);
+	fclose(out);
+	return FALSE;
+    }
+    if (fclose(out) != 0) {
+	msg = g_strdup_printf(_("Can't write '%s': %s"), filename,
+			      strerror(errno));
+	dbprintf("%s\n", msg);
+	g_ptr_array_add(*emsg, msg);
+	return FALSE;
+    }
+
+    if (sorted)
+	return TRUE;
+
+    /* sort the file in place */
+    dbprintf("'%s' is not sorted, running %s\n", filename_gz, SORT_PATH);
+    nullfd = open("/dev/null", O_RDWR);
+    putenv(g_strdup("LC_ALL=C"));
+    pid_sort = pipespawn(SORT_PATH, STDERR_PIPE, 0,
+			 &nullfd, &nullfd, &sort_errfd,
+			 SORT_PATH, "-o", filename, filename, NULL);
+    aclose(nullfd);
+
+    sort_err_stream = fdopen(sort_errfd, "r");
+    if (!sort_err_stream) {
+	g_ptr_array_add(*emsg,
+		g_strdup_printf("Can't fdopen sort_err_stream: %s\n",
+				strerror(errno)));
+    } else {
+	while (fgets(line, sizeof(line), sort_err_stream) != NULL) {
+	    if (strlen(line) > 0 && line[strlen(line)-1] == '\n')
+		line[strlen(line)-1] = '\0';
+	    g_ptr_array_add(*emsg, g_strdup_printf("  %s", line));
+	    dbprintf("Sort: %s\n", line);
+	}
+	fclose(sort_err_stream);
+    }
+
+    return get_pid_status(pid_sort, SORT_PATH, emsg) != 0;
+}
+#endif /* HAVE_ZLIB */
+
 static char *
 uncompress_file(
     char       *filename_gz,
@@ -237,6 +363,21 @@ uncompress_file(
 	    return NULL;
  	}
 
+#ifdef HAVE_ZLIB
+	if (g_str_has_suffix(filename_gz, ".gz")) {
+	    if (!gunzip_index(filename_gz, filename, emsg)) {
+		unlink(filename);
+		amfree(filename);
+		return NULL;
+	    }
+	    remove_file = (REMOVE_ITEM *)g_malloc(sizeof(REMOVE_ITEM));
+	    remove_file->filename = g_strdup(filename);
+	    remove_file->next = uncompress_remove;
+	    uncompress_remove = remove_file;
+	    return filename;
+	}
+#endif
+
 #ifdef UNCOMPRESS_OPT
 #  define PARAM_UNCOMPRESS_OPT UNCOMPRESS_OPT
 #else
@@ -322,7 +322,11 @@ sub main {
 		    Amanda::Xfer::Filter::Process->new(
 			[ $hdr->{'clntcompprog'}, "-d" ], 0);
 	    } else {
-		push @filters,
+		# gzip data can be uncompressed in-process, if zlib is available
+		my $gunzip;
+		$gunzip = Amanda::Xfer::Filter::Gunzip->new()
+		    if (defined $hdr->{'comp_suffix'} and $hdr->{'comp_suffix'} eq '.gz');
+		push @filters, $gunzip ||
 		    Amanda::Xfer::Filter::Process->new(
 			[ $Amanda::Constants::UNCOMPRESS_PATH,
 			  $Amanda::Constants::UNCOMPRESS_OPT ], 0);
@@ -358,6 +362,7 @@ sub main {
 
 	# start reading all filter stderr
 	foreach my $filter (@filters) {
+	    next unless $filter->can('get_stderr_fd');
 	    my $fd = $filter->get_stderr_fd();
 	    $fd.="";
 	    $fd = int($fd);
@@ -48,13 +48,14 @@ my $opt_date;
 my $opt_config;
 my $opt_file;
 my $opt_locale_independent_date_format;
+my $opt_live;
 
 sub usage() {
 	print "amstatus [--file amdump_file]\n";
 	print "         [--summary] [--dumping] [--waitdumping] [--waittaper]\n";
 	print "         [--dumpingtape] [--writingtape] [--finished] [--failed]\n";
 	print "         [--estimate] [--gestimate] [--stats] [--date]\n";
-	print "         [--locale-independent-date-format]\n";
+	print "         [--locale-independent-date-format] [--live]\n";
 	print "         [--config] <config>\n";
 	exit 0;
 }
@@ -76,6 +77,7 @@ GetOptions(
     'config|c:s'                     => \$opt_config,
     'file:s'                         => \$opt_file,
     'locale-independent-date-format' => \$opt_locale_independent_date_format,
+    'live'                           => \$opt_live,
     ) or usage();
 
 
@@ -165,6 +167,12 @@ else {
   $unitdivisor = 1;
 }
 
+# a running driver keeps the state of each dle in driver.status; reading it
+# is much faster than reading the whole amdump file
+if (defined $opt_live && !defined $opt_file) {
+	exit $exit_status if &print_live_status();
+	print "No running driver, reading the amdump file\n";
+}
 
 my $dead_run = 0;
 if( defined $opt_file) {
@@ -1412,6 +1420,112 @@ if(defined $opt_stats) {
 
 exit $exit_status;
 
+# Print the state of each dle from $logdir/driver.status, as selected by the
+# options.  Returns 0 if there is no snapshot from a running driver.
+sub print_live_status() {
+	my $statusfile = "$logdir/driver.status";
+	my %head;
+	my @dles;
+	my %count;
+	my %size;
+
+	open(STATUS, "<$statusfile") || return 0;
+	while (my $line = <STATUS>) {
+		chomp $line;
+		my @field = &quotewords('\s+', 0, $line);
+		next if !defined $field[0];
+		if ($field[0] eq "dle") {
+			push @dles, [ @field[1..8] ];
+		} elsif ($field[0] eq "qlen") {
+			$head{"qlen $field[1]"} = $field[2];
+		} else {
+			$head{$field[0]} = $field[1];
+		}
+	}
+	close(STATUS);
+	return 0 if !defined $head{'pid'};
+	return 0 if !$head{'finished'} && !kill(0, $head{'pid'}) && !$!{EPERM};
+	# a finished snapshot may be from an earlier run
+	return 0 if !&is_current_run($head{'datestamp'});
+
+	my %show = (
+		'wait-schedule'   => $opt_gestimate || $opt_estimate,
+		'wait-dump'       => $opt_waitdumping,
+		'wait-direct'     => $opt_waitdumping,
+		'wait-room'       => $opt_waitdumping,
+		'dumping'         => $opt_dumping,
+		'dumping-to-tape' => $opt_dumpingtape,
+		'dumped'          => $opt_waittaper,
+		'writing'         => $opt_writingtape,
+		'done'            => $opt_finished,
+		'dumped-to-holding' => $opt_finished,
+		'failed'          => $opt_failed,
+	);
+
+	print "Using $statusfile\n";
+	print "From driver $head{'pid'}, datestamp $head{'datestamp'}, ",
+	      $head{'finished'} ? "finished" : "running", "\n\n";
+
+	my $maxnamelength = 10;
+	foreach my $dle (@dles) {
+		my $len = length("$dle->[0]:" . Amanda::Util::quote_string($dle->[1]));
+		$maxnamelength = $len if $len > $maxnamelength;
+	}
+	foreach my $dle (sort { $a->[0] cmp $b->[0] or $a->[1] cmp $b->[1] } @dles) {
+		my ($host, $disk, $datestamp, $level, $state, $worker, $esize, $dsize) = @$dle;
+		$count{$state}++;
+		$size{$state} += $dsize;
+		$exit_status |= $STATUS_FAILED if $state eq "failed";
+		next if !$show{$state};
+		printf "%8s ", $datestamp if defined $opt_date;
+		printf "%-${maxnamelength}s", "$host:" . Amanda::Util::quote_string($disk);
+		if ($level >= 0) {
+			printf "%2d ", $level;
+		} else {
+			print "   ";
+		}
+		printf "%9d$unit %9d$unit %s", $dsize / $unitdivisor,
+		       $esize / $unitdivisor, $state;
+		print " ($worker)" if $worker ne "-";
+		print "\n";
+	}
+
+	if (defined $opt_summary) {
+		print "\nSUMMARY          part      real\n";
+		print "                           size\n";
+		printf "partition       : %3d\n", scalar @dles;
+		foreach my $state (sort keys %count) {
+			printf "%-16s: %3d %9d$unit\n", $state, $count{$state},
+			       $size{$state} / $unitdivisor;
+		}
+		print "\n";
+		printf "%d dumpers idle  : %s\n", $head{'idle-dumpers'},
+		       $head{'driver-idle'};
+		printf "taper status    : %s\n", $head{'taper'};
+		printf "free kps        : %d\n", $head{'free-kps'};
+		printf "holding space   : %d$unit\n", $head{'free-space'} / $unitdivisor;
+	}
+	return 1;
+}
+
+# is DATESTAMP that of the run in the amdump file amstatus would read?
+sub is_current_run() {
+	my ($datestamp) = @_;
+	my $amdumpfile = "$logdir/amdump";
+
+	return 0 if !defined $datestamp;
+	$amdumpfile = "$logdir/amflush" if !-f $amdumpfile;
+	open(CURRENT, "<$amdumpfile") || return 0;
+	while (my $line = <CURRENT>) {
+		if ($line =~ /^(?:amdump: starttime|amflush: datestamp|planner: timestamp) (\d+)/) {
+			close(CURRENT);
+			return $1 eq $datestamp;
+		}
+	}
+	close(CURRENT);
+	return 0;
+}
+
 sub make_hostpart() {
 	local($host,$partition,$datestamp) = @_;
 
@@ -90,6 +90,75 @@ sub user_request {
     return;
 };
 
+package Amvault::Lane;
+
+# A lane is a source clerk and a destination scribe, which together vault one
+# dump at a time.  Several lanes may run at once; the feedback methods for the
+# clerk and scribe are passed on to the Amvault object, along with the lane.
+
+use base qw(
+    Amanda::Recovery::Clerk::Feedback
+    Amanda::Taper::Scribe::Feedback
+);
+
+sub new {
+    my $class = shift;
+    my ($vault, $id) = @_;
+
+    return bless {
+	vault => $vault,
+	id => $id,
+
+	clerk => undef,
+	scribe => undef,
+	scribe_started => 0,
+
+	label => undef,	    # destination volume label
+	dumps => undef,	    # dumps left on the current source volume
+	current => undef,   # state of the dump being vaulted
+    }, $class;
+}
+
+for my $method (qw( request_volume_permission scribe_notif_new_tape
+		    scribe_notif_part_done scribe_notif_log_info
+		    scribe_notif_tape_done clerk_notif_part
+		    clerk_notif_holding )) {
+    no strict 'refs';
+    *{$method} = sub {
+	my $self = shift;
+	$self->{'vault'}->$method($self, @_);
+    };
+}
+
+package Amvault::SharedScan;
+
+# The lanes' clerks share one Recovery::Scan of the source changer.  Each
+# clerk quits its scan when it is done; only the last quit is passed on, since
+# it also quits the changer.
+
+sub new {
+    my $class = shift;
+    my ($scan, $nclerks) = @_;
+
+    return bless {
+	scan => $scan,
+	nclerks => $nclerks,
+    }, $class;
+}
+
+sub find_volume {
+    my $self = shift;
+
+    $self->{'scan'}->find_volume(@_);
+}
+
+sub quit {
+    my $self = shift;
+
+    return if --$self->{'nclerks'} > 0;
+    $self->{'scan'}->quit();
+}
+
 package Amvault;
 
 use Amanda::Config qw( :getconf config_dir_relative );
@@ -111,11 +180,6 @@ use Amanda::Logfile qw( :logtype_t log_add log_add_full
 			log_rename $amanda_log_trace_log make_stats );
 use Amanda::Util qw ( match_datestamp match_level );
 
-use base qw(
-    Amanda::Recovery::Clerk::Feedback
-    Amanda::Taper::Scribe::Feedback
-);
-
 sub new {
     my $class = shift;
     my %params = @_;
@@ -127,6 +191,7 @@ sub new {
 	opt_dumpspecs => $params{'opt_dumpspecs'},
 	opt_dry_run => $params{'opt_dry_run'},
 	config_name => $params{'config_name'},
+	parallel_dumps => $params{'parallel_dumps'} || 1,
 
 	src_write_timestamp => $params{'src_write_timestamp'},
 
@@ -136,6 +201,7 @@ sub new {
 
 	src => undef,
 	dst => undef,
+	lanes => [],
 	cleanup => {},
 
 	exporting => 0, # is an export in progress?
@@ -188,14 +254,23 @@ sub setup_src {
 
     $src->{'interactivity'} = main::Interactivity->new();
 
-    $src->{'scan'} = Amanda::Recovery::Scan->new(
+    # each lane gets its own clerk, so that several source volumes can be
+    # read at once, but they share a scan, as they share the changer
+    my $scan = Amanda::Recovery::Scan->new(
 	    chg => $src->{'chg'},
 	    interactivity => $src->{'interactivity'});
+    $src->{'scan'} = Amvault::SharedScan->new($scan, $self->{'parallel_dumps'});
 
-    $src->{'clerk'} = Amanda::Recovery::Clerk->new(
-	    changer => $src->{'chg'},
-	    feedback => $self,
-	    scan => $src->{'scan'});
+    for my $id (1 .. $self->{'parallel_dumps'}) {
+	my $lane = Amvault::Lane->new($self, $id);
+
+	$lane->{'clerk'} = Amanda::Recovery::Clerk->new(
+		changer => $src->{'chg'},
+		feedback => $lane,
+		scan => $src->{'scan'});
+
+	push @{$self->{'lanes'}}, $lane;
+    }
     $self->{'cleanup'}{'quit_clerk'} = 1;
 
     # translate "latest" into the most recent timestamp that wasn't created by amvault
@@ -335,16 +410,61 @@ sub plan_cb {
 	return $self->failure("No dumps to vault");
     }
 
+    $src->{'volumes'} = $self->group_dumps_by_volume($plan);
+
     $self->setup_dst();
 }
 
+# Divide the dumps in the plan into lists that can be vaulted independently of
+# one another.  All of the dumps with a part on the same source volume end up
+# in the same list, in the order given by the plan (which is file order), so
+# that only one lane reads each volume and it does not need to seek backward.
+# Each dump from holding disk gets a list of its own.
+sub group_dumps_by_volume {
+    my $self = shift;
+    my ($plan) = @_;
+    my @lists;
+    my %list_for_label;
+
+    while (my $dump = $plan->shift_dump()) {
+	my @labels = grep { defined }
+		     map { $_->{'label'} }
+		     grep { defined } @{$dump->{'parts'}};
+
+	# find the list(s) already holding any of these volumes, merging them if
+	# this dump spans more than one
+	my $list;
+	for my $label (@labels) {
+	    my $other = $list_for_label{$label};
+	    next if !$other or ($list and $other == $list);
+	    if (!$list) {
+		$list = $other;
+		next;
+	    }
+	    push @$list, @$other;
+	    @$other = ();
+	    for (values %list_for_label) {
+		$_ = $list if $_ == $other;
+	    }
+	}
+	if (!$list) {
+	    $list = [];
+	    push @lists, $list;
+	}
+
+	push @$list, $dump;
+	$list_for_label{$_} = $list for @labels;
+    }
+
+    return [ grep { @$_ } @lists ];
+}
+
 sub setup_dst {
     my $self = shift;
     my $dst = $self->{'dst'} = {};
     my $tlf = Amanda::Config::config_dir_relative(getconf($CNF_TAPELIST));
     my $tl = Amanda::Tapelist->new($tlf);
 
-    $dst->{'label'} = undef;
     $dst->{'tape_num'} = 0;
 
     my $chg = Amanda::Changer->new($self->{'dst_changer'},
@@ -366,47 +486,105 @@ sub setup_dst {
 	labelstr => getconf($CNF_LABELSTR),
 	autolabel => $self->{'dst_autolabel'});
 
-    $dst->{'scribe'} = Amanda::Taper::Scribe->new(
-	taperscan => $dst->{'scan'},
-	feedback => $self);
+    # the lanes share the taperscan, as the taper's workers do; start their
+    # scribes one at a time
+    my @lanes = @{$self->{'lanes'}};
+    my $start_scribe;
+    $start_scribe = sub {
+	my $lane = shift @lanes;
+	if (!$lane) {
+	    $start_scribe = undef;
+	    return $self->scribes_started();
+	}
 
-    $dst->{'scribe'}->start(
-	write_timestamp => $self->{'dst_write_timestamp'},
-	finished_cb => sub { $self->scribe_started(@_); })
+	$lane->{'scribe'} = Amanda::Taper::Scribe->new(
+	    taperscan => $dst->{'scan'},
+	    feedback => $lane);
+
+	$lane->{'scribe'}->start(
+	    write_timestamp => $self->{'dst_write_timestamp'},
+	    finished_cb => sub {
+		my ($err) = @_;
+		if ($err) {
+		    $start_scribe = undef;
+		    return $self->failure($err);
+		}
+
+		$lane->{'scribe_started'} = 1;
+		$self->{'cleanup'}{'quit_scribe'} = 1;
+		$start_scribe->();
+	    });
+    };
+    $start_scribe->();
 }
 
-sub scribe_started {
+sub scribes_started {
     my $self = shift;
-    my ($err) = @_;
-
-    return $self->failure($err) if $err;
-
-    $self->{'cleanup'}{'quit_scribe'} = 1;
 
     my $xfers_finished = sub {
 	my ($err) = @_;
-	$self->failure($err) if $err;
+	return $self->failure($err) if $err;
 	$self->quit(0);
     };
 
     $self->xfer_dumps($xfers_finished);
 }
 
+# Vault all of the dumps in the plan, using every lane.  A lane takes the next
+# dump from the source volume it is already reading, if there is one, so each
+# volume is read by one lane from start to finish.  After a failure, the lanes
+# finish the dumps they are working on but do not start any more.
 sub xfer_dumps {
     my $self = shift;
     my ($finished_cb) = @_;
 
     my $src = $self->{'src'};
-    my $dst = $self->{'dst'};
-    my ($xfer_src, $xfer_dst, $xfer, $n_threads, $last_partnum);
+    my $n_running = @{$self->{'lanes'}};
+    my @errors;
+
+    my $next_dump;
+    $next_dump = sub {
+	my ($lane) = @_;
+	my $dump;
+
+	if (!@errors) {
+	    if (!$lane->{'dumps'} or !@{$lane->{'dumps'}}) {
+		$lane->{'dumps'} = shift @{$src->{'volumes'}};
+	    }
+	    $dump = shift @{$lane->{'dumps'}} if $lane->{'dumps'};
+	}
+
+	if (!$dump) {
+	    return if --$n_running;
+
+	    $next_dump = undef;
+	    return $finished_cb->(@errors? join("\n", @errors) : undef);
+	}
+
+	$self->xfer_dump($lane, $dump, sub {
+	    my ($err) = @_;
+	    push @errors, $err if $err;
+	    $next_dump->($lane);
+	});
+    };
+
+    $next_dump->($_) for @{$self->{'lanes'}};
+}
+
+# Vault one dump using the given lane
+sub xfer_dump {
+    my $self = shift;
+    my ($lane, $dump, $finished_cb) = @_;
+
+    my ($xfer_src, $xfer_dst, $xfer, $n_threads);
     my $current;
 
     my $steps = define_steps
 	    cb_ref => \$finished_cb;
 
     step get_dump => sub {
-	# reset tracking for teh current dump
-	$self->{'current'} = $current = {
+	# reset tracking for the current dump
+	$lane->{'current'} = $current = {
 	    src_result => undef,
 	    src_errors => undef,
 
@@ -418,21 +596,14 @@ sub xfer_dumps {
 	    total_duration => 0.0,
 	    nparts => 0,
 	    header => undef,
-	    dump => undef,
+	    dump => $dump,
 	};
 
-	my $dump = $src->{'plan'}->shift_dump();
-	if (!$dump) {
-	    return $finished_cb->();
-	}
-
-	$current->{'dump'} = $dump;
-
 	$steps->{'get_xfer_src'}->();
     };
 
     step get_xfer_src => sub {
-	$src->{'clerk'}->get_xfer_src(
+	$lane->{'clerk'}->get_xfer_src(
 	    dump => $current->{'dump'},
 	    xfer_src_cb => $steps->{'got_xfer_src'})
     };
@@ -464,7 +635,7 @@ sub xfer_dumps {
 	}
 	# (else leave %xfer_dest_args empty, for no splitting)
 
-	$xfer_dst = $dst->{'scribe'}->get_xfer_dest(
+	$xfer_dst = $lane->{'scribe'}->get_xfer_dest(
 	    max_memory => getconf($CNF_DEVICE_OUTPUT_BUFFER_SIZE),
 	    can_cache_inform => 0,
 	    %xfer_dest_args,
@@ -480,18 +651,18 @@ sub xfer_dumps {
 	$n_threads = 2;
 
 	# and let both the scribe and the clerk know that data is in motion
-	$src->{'clerk'}->start_recovery(
+	$lane->{'clerk'}->start_recovery(
 	    xfer => $xfer,
 	    recovery_cb => $steps->{'recovery_cb'});
-	$dst->{'scribe'}->start_dump(
+	$lane->{'scribe'}->start_dump(
 	    xfer => $xfer,
 	    dump_header => $header,
 	    dump_cb => $steps->{'dump_cb'});
     };
 
     step handle_xmsg => sub {
-	$src->{'clerk'}->handle_xmsg(@_);
-	$dst->{'scribe'}->handle_xmsg(@_);
+	$lane->{'clerk'}->handle_xmsg(@_);
+	$lane->{'scribe'}->handle_xmsg(@_);
     };
 
     step recovery_cb => sub {
@@ -535,7 +706,6 @@ sub xfer_dumps {
 	    }
 	}
 
-	my $dump = $current->{'dump'};
 	my $stats = make_stats($current->{'size'}, $current->{'total_duration'},
 				$dump->{'orig_kb'});
 	my $msg = quote_string(join("; ", @errors));
@@ -560,11 +730,11 @@ sub xfer_dumps {
 		($logtype == $L_PARTIAL and @errors)? " $msg" : ""));
 	}
 
+	$lane->{'current'} = undef;
 	if (@errors) {
 	    return $finished_cb->("transfer failed: " .  join("; ", @errors));
 	} else {
-	    # rinse, wash, and repeat
-	    return $steps->{'get_dump'}->();
+	    return $finished_cb->();
 	}
     };
 }
@@ -588,31 +758,45 @@ sub quit {
     };
 
     # we may have several resources to clean up..
+    my @scribe_lanes;
+    my @clerk_lanes;
     step quit_scribe => sub {
 	if ($self->{'cleanup'}{'quit_scribe'}) {
-	    debug("quitting scribe..");
-	    $self->{'dst'}{'scribe'}->quit(
+	    @scribe_lanes = grep { $_->{'scribe_started'} } @{$self->{'lanes'}};
+	    $self->{'cleanup'}{'quit_scribe'} = 0;
+	}
+
+	my $lane = shift @scribe_lanes;
+	if ($lane) {
+	    debug("quitting scribe $lane->{id}..");
+	    $lane->{'scribe'}->quit(
 		finished_cb => $steps->{'quit_scribe_finished'});
 	} else {
+	    $self->{'dst'}{'scan'}->quit() if $self->{'dst'}{'scan'};
 	    $steps->{'quit_clerk'}->();
 	}
     };
 
     step quit_scribe_finished => sub {
-	$self->{'dst'}{'scan'}->quit();
 	my ($err) = @_;
 	if ($err) {
 	    print STDERR "$err\n";
 	    $exit_status = 1;
 	}
 
-	$steps->{'quit_clerk'}->();
+	$steps->{'quit_scribe'}->();
     };
 
     step quit_clerk => sub {
 	if ($self->{'cleanup'}{'quit_clerk'}) {
-	    debug("quitting clerk..");
-	    $self->{'src'}{'clerk'}->quit(
+	    @clerk_lanes = @{$self->{'lanes'}};
+	    $self->{'cleanup'}{'quit_clerk'} = 0;
+	}
+
+	my $lane = shift @clerk_lanes;
+	if ($lane) {
+	    debug("quitting clerk $lane->{id}..");
+	    $lane->{'clerk'}->quit(
 		finished_cb => $steps->{'quit_clerk_finished'});
 	} else {
 	    $steps->{'roll_log'}->();
@@ -626,7 +810,7 @@ sub quit {
 	    $exit_status = 1;
 	}
 
-	$steps->{'roll_log'}->();
+	$steps->{'quit_clerk'}->();
     };
 
     step roll_log => sub {
@@ -686,28 +870,30 @@ sub vlog {
 
 sub request_volume_permission {
     my $self = shift;
+    my $lane = shift;
     my %params = @_;
 
     # sure, use all the volumes you want, no problem!
     # TODO: limit to a vaulting-specific value of runtapes
-    $self->{'dst'}->{'scribe'}->start_scan();
+    $lane->{'scribe'}->start_scan();
     $params{'perm_cb'}->(allow => 1);
 }
 
 sub scribe_notif_new_tape {
     my $self = shift;
+    my $lane = shift;
     my %params = @_;
 
     if ($params{'volume_label'}) {
-	$self->{'dst'}->{'label'} = $params{'volume_label'};
+	$lane->{'label'} = $params{'volume_label'};
 
 	# add to the trace log
 	log_add_full($L_START, "taper", sprintf("datestamp %s label %s tape %s",
 		$self->{'dst_write_timestamp'},
-		quote_string($self->{'dst'}->{'label'}),
+		quote_string($lane->{'label'}),
 		++$self->{'dst'}->{'tape_num'}));
     } else {
-	$self->{'dst'}->{'label'} = undef;
+	$lane->{'label'} = undef;
 
 	print STDERR "Could not start new destination volume: $params{error}";
     }
@@ -715,16 +901,16 @@ sub scribe_notif_new_tape {
 
 sub scribe_notif_part_done {
     my $self = shift;
+    my $lane = shift;
     my %params = @_;
 
-    $self->{'last_partnum'} = $params{'partnum'};
-
-    my $stats = make_stats($params{'size'}, $params{'duration'}, $self->{'orig_kb'});
+    my $stats = make_stats($params{'size'}, $params{'duration'}, $self->{'orig_kb'},
+			   $params{'crc'});
 
     # log the part, using PART or PARTPARTIAL
-    my $hdr = $self->{'current'}->{'header'};
+    my $hdr = $lane->{'current'}->{'header'};
     my $logbase = sprintf("%s %s %s %s %s %s/%s %s %s",
-	quote_string($self->{'dst'}->{'label'}),
+	quote_string($lane->{'label'}),
 	$params{'fileno'},
 	quote_string($hdr->{'name'}.""), # " is required for SWIG..
 	quote_string($hdr->{'disk'}.""),
@@ -740,12 +926,13 @@ sub scribe_notif_part_done {
     }
 
     if ($params{'successful'}) {
-	$self->vlog("Wrote $self->{dst}->{label}:$params{'fileno'}: " . $hdr->summary());
+	$self->vlog("Wrote $lane->{label}:$params{'fileno'}: " . $hdr->summary());
     }
 }
 
 sub scribe_notif_log_info {
     my $self = shift;
+    my $lane = shift;
     my %params = @_;
 
     debug("$params{'message'}");
@@ -754,6 +941,7 @@ sub scribe_notif_log_info {
 
 sub scribe_notif_tape_done {
     my $self = shift;
+    my $lane = shift;
     my %params = @_;
 
     # immediately flag that we are busy exporting, to prevent amvault from
@@ -847,6 +1035,7 @@ sub scribe_notif_tape_done {
 
 sub clerk_notif_part {
     my $self = shift;
+    my $lane = shift;
     my ($label, $fileno, $header) = @_;
 
     # see if this is a new label
@@ -860,6 +1049,7 @@ sub clerk_notif_part {
 
 sub clerk_notif_holding {
     my $self = shift;
+    my $lane = shift;
     my ($filename, $header) = @_;
 
     # this used to give the fd from which the holding file was being read.. why??
@@ -883,6 +1073,7 @@ sub usage {
 
 Usage: amvault [-o configoption...] [-q] [--quiet] [-n] [--dry-run]
 	   [--fulls-only] [--export] [--src-timestamp src-timestamp]
+	   [--parallel-dumps n]
 	   --label-template label-template --dst-changer dst-changer
 	   [--autolabel autolabel-arg...]
 	   config
@@ -896,6 +1087,8 @@ Usage: amvault [-o configoption...] [-q] [--quiet] [-n] [--dry-run]
     --label-template: the template to use for new volume labels
     --dst-changer: the changer to which dumps should be written
     --autolabel: similar to the amanda.conf parameter; may be repeated (default: empty)
+    --parallel-dumps: the number of dumps to copy at once, each from its own
+	source volume to its own destination volume (default: 1)
 
 Copies data from the run with timestamp <src-timestamp> onto volumes using
 the changer <dst-changer>, labeling new volumes with <label-template>.  If
@@ -923,6 +1116,7 @@ my $opt_autolabel = {};
 my $opt_autolabel_seen = 0;
 my $opt_src_write_timestamp;
 my $opt_dst_changer;
+my $opt_parallel_dumps = 1;
 
 sub set_label_template {
     usage("only one --label-template allowed") if $opt_autolabel->{'template'};
@@ -966,6 +1160,7 @@ GetOptions(
     'autolabel=s' => \&add_autolabel,
     'src-timestamp=s' => \$opt_src_write_timestamp,
     'dst-changer=s' => \$opt_dst_changer,
+    'parallel-dumps=i' => \$opt_parallel_dumps,
     'version' => \&Amanda::Util::version_opt,
     'help' => \&usage,
 ) or usage("usage error");
@@ -979,6 +1174,7 @@ my @opt_dumpspecs = parse_dumpspecs(\@ARGV, $CMDLINE_PARSE_DATESTAMP|$CMDLINE_PA
 
 usage("no --label-template given") unless $opt_autolabel->{'template'};
 usage("no --dst-changer given") unless $opt_dst_changer;
+usage("--parallel-dumps must be at least 1") unless $opt_parallel_dumps >= 1;
 usage("specify something to select the source dumps") unless
     $opt_src_write_timestamp or $opt_fulls_only or @opt_dumpspecs;
 
@@ -1003,6 +1199,7 @@ my $exit_cb = sub {
 
 my $vault = Amvault->new(
     config_name => $config_name,
+    parallel_dumps => $opt_parallel_dumps,
     src_write_timestamp => $opt_src_write_timestamp,
     dst_changer => $opt_dst_changer,
     dst_autolabel => $opt_autolabel,
@@ -241,7 +241,7 @@ cmdline_match_holding(
 
     for (hi = holding_files; hi != NULL; hi = hi->next) {
 	/* TODO add level */
-	if (!holding_file_get_dumpfile((char *)hi->data, &file)) continue;
+	if (!holding_file_get_summary((char *)hi->data, &file)) continue;
         if (file.type != F_DUMPFILE) {
 	    dumpfile_free_data(&file);
 	    continue;
@@ -106,6 +106,27 @@ static int nb_sent_new_tape = 0;
 static int taper_started = 0;
 static taper_t *last_started_taper;
 
+/* The live status snapshot, for amstatus and other monitors */
+#define DRIVER_STATUS_INTERVAL 1	/* seconds between two snapshots */
+
+typedef struct status_dle_s {
+    disk_t *dp;
+    char   *datestamp;
+    int     level;
+    off_t   est_size;
+    off_t   size;
+    int     taped;			/* written to tape */
+    int     dumped;			/* dumped to a holding disk */
+    int     gen;			/* last snapshot it was written in */
+} status_dle_t;
+
+static GHashTable *status_dles = NULL;	/* disk_t * -> status_dle_t * */
+static char *status_filename = NULL;
+static int status_gen = 0;
+static time_t status_time = 0;
+static event_handle_t *status_ev = NULL;
+static int driver_finished = 0;
+
 static int wait_children(int count);
 static void wait_for_children(void);
 static void allocate_bandwidth(netif_t *ip, unsigned long kps);
@@ -124,6 +145,12 @@ static void dumper_chunker_result(disk_t *dp);
 static void dumper_taper_result(disk_t *dp);
 static void file_taper_result(disk_t *dp);
 static void handle_dumper_result(void *);
+static void dumper_result(dumper_t *dumper, cmd_t cmd, int result_argc,
+			  char **result_argv);
+static void show_dumper_result(dumper_t *dumper, int result_argc,
+			       char **result_argv);
+static void dumper_wait_result(dumper_t *dumper);
+static void dumper_done_waiting(dumper_t *dumper);
 static void handle_chunker_result(void *);
 static void handle_dumpers_time(void *);
 static void handle_taper_result(void *);
@@ -136,6 +163,10 @@ static int queue_length(disklist_t q);
 static void read_flush(void *cookie);
 static void read_schedule(void *cookie);
 static void short_dump_state(void);
+static void status_add_dle(disk_t *dp, off_t est_size);
+static void status_dle_taped(disk_t *dp, off_t size);
+static void status_dle_dumped(disk_t *dp, off_t size);
+static void write_driver_status(int force);
 static void startaflush(void);
 static void start_degraded_mode(disklist_t *queuep);
 static void start_some_dumps(disklist_t *rq);
@@ -311,6 +342,9 @@ main(
     amfree(line);
     log_add(L_START,_("date %s"), driver_timestamp);
 
+    /* the driver logs a great deal; write it a batch at a time */
+    log_start_batch();
+
     gethostname(hostname, sizeof(hostname));
     log_add(L_STATS,_("hostname %s"), hostname);
 
@@ -580,6 +614,11 @@ main(
     check_unfree_serial();
     g_printf(_("driver: FINISHED time %s\n"), walltime_str(curclock()));
     fflush(stdout);
+    driver_finished = 1;
+    write_driver_status(1);
+    if (status_dles)
+	g_hash_table_destroy(status_dles);
+    amfree(status_filename);
     log_add(L_FINISH,_("date %s time %s"), driver_timestamp, walltime_str(curclock()));
     log_add(L_INFO, "pid-done %ld", (long)getpid());
     amfree(driver_timestamp);
@@ -669,11 +708,14 @@ kill_children(int signal)
     if(!nodump) {
         for(dumper = dmptable; dumper < dmptable + inparallel; dumper++) {
 	    if (!dumper->down && dumper->pid > 1) {
-		g_printf(_("driver: sending signal %d to %s pid %u\n"), signal,
-		       dumper->name, (unsigned)dumper->pid);
-		if (kill(dumper->pid, signal) == -1 && errno == ESRCH) {
-		    if (dumper->chunker)
-			dumper->chunker->pid = 0;
+		/* a dumper process is signalled once, through its first slot */
+		if (dumper->proc == dumper) {
+		    g_printf(_("driver: sending signal %d to %s pid %u\n"),
+			   signal, dumper->name, (unsigned)dumper->pid);
+		    if (kill(dumper->pid, signal) == -1 && errno == ESRCH) {
+			if (dumper->chunker)
+			    dumper->chunker->pid = 0;
+		    }
 		}
 		if (dumper->chunker && dumper->chunker->pid > 1) {
 		    g_printf(_("driver: sending signal %d to %s pid %u\n"), signal,
@@ -702,12 +744,15 @@ wait_for_children(void)
 
     if(!nodump) {
 	for(dumper = dmptable; dumper < dmptable + inparallel; dumper++) {
-	    if (dumper->pid > 1 && dumper->fd >= 0) {
+	    if (dumper->proc->pid > 1 && dumper->proc->fd >= 0 &&
+		dumper->chunker && dumper->chunker->pid > 1 &&
+		dumper->chunker->fd >= 0)
+		chunker_cmd(dumper->chunker, QUIT, NULL, NULL);
+	}
+	/* only the first slot of each dumper process has its fd */
+	for(dumper = dmptable; dumper < dmptable + inparallel; dumper++) {
+	    if (dumper->pid > 1 && dumper->fd >= 0)
 		dumper_cmd(dumper, QUIT, NULL, NULL);
-		if (dumper->chunker && dumper->chunker->pid > 1 &&
-		    dumper->chunker->fd >= 0)
-		    chunker_cmd(dumper->chunker, QUIT, NULL, NULL);
-	    }
 	}
     }
 
@@ -1151,10 +1196,7 @@ start_some_dumps(
 	    continue;
 	}
 
-	if (dumper->ev_read != NULL) {
-	    event_release(dumper->ev_read);
-	    dumper->ev_read = NULL;
-	}
+	dumper_done_waiting(dumper);
 
 	/*
 	 * A potential problem with starting from the bottom of the dump time
@@ -1330,8 +1372,7 @@ start_some_dumps(
 		    enqueue_disk(rq, diskp);
 	    }
 	    else {
-		dumper->ev_read = event_register((event_id_t)dumper->fd, EV_READFD,
-						 handle_dumper_result, dumper);
+		dumper_wait_result(dumper);
 		chunker->ev_read = event_register((event_id_t)chunker->fd, EV_READFD,
 						   handle_chunker_result, chunker);
 		dumper->output_port = atoi(result_argv[2]);
@@ -1555,7 +1596,7 @@ continue_port_dumps(void)
 	 */
 	remove_disk( &roomq, dp );
 	chunker_cmd(sched(dp)->dumper->chunker, ABORT, NULL, _("Not enough holding disk space"));
-	dumper_cmd( sched(dp)->dumper, ABORT, NULL, _("Not enough holding disk space"));
+	dumper_cmd( sched(dp)->dumper, ABORT, dp, _("Not enough holding disk space"));
 	pending_aborts++;
     }
 }
@@ -1931,8 +1972,7 @@ handle_taper_result(
 
 	    taper->state |= TAPER_STATE_DUMP_TO_TAPE;
 
-	    dumper->ev_read = event_register(dumper->fd, EV_READFD,
-					     handle_dumper_result, dumper);
+	    dumper_wait_result(dumper);
 	    break;
 
         case BOGUS:
@@ -2021,6 +2061,7 @@ file_taper_result(
     if (taper->result == DONE) {
 	update_info_taper(dp, taper->first_label, taper->first_fileno,
 			  sched(dp)->level);
+	status_dle_taped(dp, taper->written);
     }
 
     sched(dp)->taper_attempted += 1;
@@ -2138,6 +2179,7 @@ dumper_taper_result(
 			   sched(dp)->dumpsize, sched(dp)->dumptime);
 	update_info_taper(dp, taper->first_label, taper->first_fileno,
 			  sched(dp)->level);
+	status_dle_taped(dp, taper->written);
 	qname = quote_string(dp->name); /*quote to take care of spaces*/
 
 	log_add(L_STATS, _("estimate %s %s %s %d [sec %ld nkb %lld ckb %lld kps %lu]"),
@@ -2160,10 +2202,7 @@ dumper_taper_result(
 	enqueue_disk(&directq, dp);
     }
 
-    if(dumper->ev_read != NULL) {
-	event_release(dumper->ev_read);
-	dumper->ev_read = NULL;
-    }
+    dumper_done_waiting(dumper);
     taper_nb_wait_reply--;
     if (taper_nb_wait_reply == 0 && taper_ev_read != NULL) {
 	event_release(taper_ev_read);
@@ -2290,6 +2329,8 @@ dumper_chunker_result(
 	}
     }
     else if(size > (off_t)DISK_BLOCK_KB) {
+	if (!is_partial)
+	    status_dle_dumped(dp, size);
 	enqueue_disk(&tapeq, dp);
     }
     else {
@@ -2318,183 +2359,297 @@ dumper_chunker_result(
 }
 
 
+/*
+ * Results from a dumper process.  The process may be running the dumps of
+ * several slots of dmptable (see dumper-parallel-dumps); each result is
+ * handed to the slot dumping the disk named by its handle.
+ */
 static void
 handle_dumper_result(
 	void * cookie)
 {
-    /* uses global pending_aborts */
-    dumper_t *dumper = cookie;
-    taper_t  *taper;
-    disk_t *dp, *sdp, *dp1;
+    dumper_t *proc = cookie;
+    dumper_t *dumper;
+    disk_t *sdp;
     cmd_t cmd;
     int result_argc;
-    char *qname;
     char **result_argv;
 
-    assert(dumper != NULL);
-    dp = dumper->dp;
-    assert(dp != NULL);
-    assert(sched(dp) != NULL);
+    assert(proc != NULL);
+    assert(proc->proc == proc);
     do {
 
 	short_dump_state();
 
-	cmd = getresult(dumper->fd, 1, &result_argc, &result_argv);
+	cmd = getresult(proc->fd, 0, &result_argc, &result_argv);
 
-	if(cmd != BOGUS) {
-	    /* result_argv[1] always contains the serial number */
-	    sdp = serial2disk(result_argv[1]);
-	    if (sdp != dp) {
-		error(_("Invalid serial number %s"), result_argv[1]);
-                g_assert_not_reached();
+	if (cmd == BOGUS) {
+	    /* either EOF or garbage from dumper.  Turn it off, and fail all
+	     * the dumps it was running */
+	    show_dumper_result(proc, result_argc, result_argv);
+	    log_add(L_WARNING, _("%s pid %ld is messed up, ignoring it.\n"),
+		    proc->name, (long)proc->pid);
+	    if (proc->ev_read) {
+		event_release(proc->ev_read);
+		proc->ev_read = NULL;
+	    }
+	    aclose(proc->fd);
+	    proc->nb_wait_reply = 0;
+	    for (dumper = dmptable; dumper < dmptable + inparallel; dumper++) {
+		if (dumper->proc != proc)
+		    continue;
+		dumper->wait_reply = 0;
+		if (dumper->busy) {
+		    dumper_result(dumper, cmd, result_argc, result_argv);
+		} else {
+		    dumper->down = 1;
+		}
 	    }
+	    g_strfreev(result_argv);
+	    return;
 	}
 
-	qname = quote_string(dp->name);
-	switch(cmd) {
+	/* result_argv[1] always contains the serial number */
+	sdp = serial2disk(result_argv[1]);
+	for (dumper = dmptable; dumper < dmptable + inparallel; dumper++) {
+	    if (dumper->proc == proc && dumper->busy && dumper->dp == sdp)
+		break;
+	}
+	if (sdp == NULL || dumper == dmptable + inparallel) {
+	    error(_("Invalid serial number %s"), result_argv[1]);
+	    g_assert_not_reached();
+	}
 
-	case DONE: /* DONE <handle> <origsize> <dumpsize> <dumptime> <errstr> */
-	    if(result_argc != 6) {
-		error(_("error [dumper DONE result_argc != 6: %d]"), result_argc);
-		/*NOTREACHED*/
-	    }
+	show_dumper_result(dumper, result_argc, result_argv);
+	dumper_result(dumper, cmd, result_argc, result_argv);
+	g_strfreev(result_argv);
+    } while(proc->fd >= 0 && areads_dataready(proc->fd));
+}
+
+/*
+ * Print a dumper result as getresult() would, but under the name of the
+ * slot it is for, so amstatus can follow each slot.
+ */
+static void
+show_dumper_result(
+    dumper_t *dumper,
+    int result_argc,
+    char **result_argv)
+{
+    int i;
+    char *q;
+
+    g_printf(_("driver: result time %s from %s:"),
+	   walltime_str(curclock()), dumper->name);
+    if (result_argc > 0) {
+	for (i = 0; i < result_argc; i++) {
+	    q = quote_string(result_argv[i]);
+	    g_printf(" %s", q);
+	    g_free(q);
+	}
+	putchar('\n');
+    } else {
+	g_printf(" (eof)\n");
+    }
+    fflush(stdout);
+}
 
-	    sched(dp)->origsize = OFF_T_ATOI(result_argv[2]);
-	    sched(dp)->dumptime = TIME_T_ATOI(result_argv[4]);
+/*
+ * Handle the result of the dump run by the DUMPER slot.
+ */
+static void
+dumper_result(
+    dumper_t *dumper,
+    cmd_t cmd,
+    int result_argc,
+    char **result_argv)
+{
+    /* uses global pending_aborts */
+    taper_t  *taper;
+    disk_t *dp, *dp1;
+    char *qname;
 
-	    g_printf(_("driver: finished-cmd time %s %s dumped %s:%s\n"),
-		   walltime_str(curclock()), dumper->name,
-		   dp->host->hostname, qname);
-	    fflush(stdout);
+    dp = dumper->dp;
+    assert(dp != NULL);
+    assert(sched(dp) != NULL);
 
-	    dumper->result = cmd;
+    qname = quote_string(dp->name);
+    switch(cmd) {
 
-	    break;
+    case DONE: /* DONE <handle> <origsize> <dumpsize> <dumptime> <errstr> */
+	if(result_argc != 6) {
+	    error(_("error [dumper DONE result_argc != 6: %d]"), result_argc);
+	    /*NOTREACHED*/
+	}
 
-	case TRYAGAIN: /* TRY-AGAIN <handle> <errstr> */
-	    /*
-	     * Requeue this disk, and fall through to the FAILED
-	     * case for cleanup.
-	     */
-	    if(sched(dp)->dump_attempted) {
-		char *qname = quote_string(dp->name);
-		char *qerr = quote_string(result_argv[2]);
-		log_add(L_FAIL, _("%s %s %s %d [too many dumper retry: %s]"),
-	    	    dp->host->hostname, qname, sched(dp)->datestamp,
-		    sched(dp)->level, qerr);
-		g_printf(_("driver: dump failed %s %s %s, too many dumper retry: %s\n"),
-		        result_argv[1], dp->host->hostname, qname, qerr);
-		amfree(qname);
-		amfree(qerr);
-	    }
-	    /* FALLTHROUGH */
-	case FAILED: /* FAILED <handle> <errstr> */
-	    /*free_serial(result_argv[1]);*/
-	    dumper->result = cmd;
-	    break;
+	sched(dp)->origsize = OFF_T_ATOI(result_argv[2]);
+	sched(dp)->dumptime = TIME_T_ATOI(result_argv[4]);
 
-	case ABORT_FINISHED: /* ABORT-FINISHED <handle> */
-	    /*
-	     * We sent an ABORT from the NO-ROOM case because this dump
-	     * wasn't going to fit onto the holding disk.  We now need to
-	     * clean up the remains of this image, and try to finish
-	     * other dumps that are waiting on disk space.
-	     */
-	    assert(pending_aborts);
-	    /*free_serial(result_argv[1]);*/
-	    dumper->result = cmd;
-	    break;
+	g_printf(_("driver: finished-cmd time %s %s dumped %s:%s\n"),
+	       walltime_str(curclock()), dumper->name,
+	       dp->host->hostname, qname);
+	fflush(stdout);
 
-	case BOGUS:
-	    /* either EOF or garbage from dumper.  Turn it off */
-	    log_add(L_WARNING, _("%s pid %ld is messed up, ignoring it.\n"),
-		    dumper->name, (long)dumper->pid);
-	    if (dumper->ev_read) {
-		event_release(dumper->ev_read);
-		dumper->ev_read = NULL;
-	    }
-	    aclose(dumper->fd);
-	    dumper->busy = 0;
-	    dumper->down = 1;	/* mark it down so it isn't used again */
+	dumper->result = cmd;
 
-            /* if it was dumping something, zap it and try again */
-            if(sched(dp)->dump_attempted) {
-	    	log_add(L_FAIL, _("%s %s %s %d [%s died]"),
-	    		dp->host->hostname, qname, sched(dp)->datestamp,
-	    		sched(dp)->level, dumper->name);
-            } else {
-	    	log_add(L_WARNING, _("%s died while dumping %s:%s lev %d."),
-	    		dumper->name, dp->host->hostname, qname,
-	    		sched(dp)->level);
-            }
-	    dumper->result = cmd;
-	    break;
+	break;
 
-	default:
-	    assert(0);
+    case TRYAGAIN: /* TRY-AGAIN <handle> <errstr> */
+	/*
+	 * Requeue this disk, and fall through to the FAILED
+	 * case for cleanup.
+	 */
+	if(sched(dp)->dump_attempted) {
+	    char *qname = quote_string(dp->name);
+	    char *qerr = quote_string(result_argv[2]);
+	    log_add(L_FAIL, _("%s %s %s %d [too many dumper retry: %s]"),
+		dp->host->hostname, qname, sched(dp)->datestamp,
+		sched(dp)->level, qerr);
+	    g_printf(_("driver: dump failed %s %s %s, too many dumper retry: %s\n"),
+		    result_argv[1], dp->host->hostname, qname, qerr);
+	    amfree(qname);
+	    amfree(qerr);
 	}
-        amfree(qname);
-	g_strfreev(result_argv);
+	/* FALLTHROUGH */
+    case FAILED: /* FAILED <handle> <errstr> */
+	/*free_serial(result_argv[1]);*/
+	dumper->result = cmd;
+	break;
 
-	if (cmd != BOGUS) {
-	    int last_dump = 1;
-	    dumper_t *dumper;
+    case ABORT_FINISHED: /* ABORT-FINISHED <handle> */
+	/*
+	 * We sent an ABORT from the NO-ROOM case because this dump
+	 * wasn't going to fit onto the holding disk.  We now need to
+	 * clean up the remains of this image, and try to finish
+	 * other dumps that are waiting on disk space.
+	 */
+	assert(pending_aborts);
+	/*free_serial(result_argv[1]);*/
+	dumper->result = cmd;
+	break;
+
+    case BOGUS:
+	/* the dumper process is gone; handle_dumper_result has already
+	 * stopped reading from it */
+	dumper->busy = 0;
+	dumper->down = 1;	/* mark it down so it isn't used again */
+
+	/* if it was dumping something, zap it and try again */
+	if(sched(dp)->dump_attempted) {
+	    log_add(L_FAIL, _("%s %s %s %d [%s died]"),
+		    dp->host->hostname, qname, sched(dp)->datestamp,
+		    sched(dp)->level, dumper->name);
+	} else {
+	    log_add(L_WARNING, _("%s died while dumping %s:%s lev %d."),
+		    dumper->name, dp->host->hostname, qname,
+		    sched(dp)->level);
+	}
+	dumper->result = cmd;
+	break;
 
-	    run_server_dle_scripts(EXECUTE_ON_POST_DLE_BACKUP,
-			       get_config_name(), dp, sched(dp)->level);
-	    /* check dump not yet started */
-	    for (dp1=runq.head; dp1 != NULL; dp1 = dp1->next) {
-		if (dp1->host == dp->host)
-		    last_dump = 0;
-	    }
-	    /* check direct to tape dump */
-	    for (dp1=directq.head; dp1 != NULL; dp1 = dp1->next) {
-		if (dp1->host == dp->host)
-		    last_dump = 0;
-	    }
-	    /* check dumping dle */
-	    for (dumper = dmptable; dumper < dmptable + inparallel; dumper++) {
-		if (dumper->busy && dumper->dp != dp &&
-		    dumper->dp->host == dp->host)
-		 last_dump = 0;
-	    }
-	    if (last_dump && dp->host->post_script == 0) {
-		if (dp->host->post_script == 0) {
-		    run_server_host_scripts(EXECUTE_ON_POST_HOST_BACKUP,
-					    get_config_name(), dp->host);
-		    dp->host->post_script = 1;
-		}
+    default:
+	assert(0);
+    }
+    amfree(qname);
+
+    if (cmd != BOGUS) {
+	int last_dump = 1;
+	dumper_t *other;
+
+	run_server_dle_scripts(EXECUTE_ON_POST_DLE_BACKUP,
+			   get_config_name(), dp, sched(dp)->level);
+	/* check dump not yet started */
+	for (dp1=runq.head; dp1 != NULL; dp1 = dp1->next) {
+	    if (dp1->host == dp->host)
+		last_dump = 0;
+	}
+	/* check direct to tape dump */
+	for (dp1=directq.head; dp1 != NULL; dp1 = dp1->next) {
+	    if (dp1->host == dp->host)
+		last_dump = 0;
+	}
+	/* check dumping dle */
+	for (other = dmptable; other < dmptable + inparallel; other++) {
+	    if (other->busy && other->dp != dp &&
+		other->dp->host == dp->host)
+	     last_dump = 0;
+	}
+	if (last_dump && dp->host->post_script == 0) {
+	    if (dp->host->post_script == 0) {
+		run_server_host_scripts(EXECUTE_ON_POST_HOST_BACKUP,
+					get_config_name(), dp->host);
+		dp->host->post_script = 1;
 	    }
 	}
+    }
 
-	taper = sched(dp)->taper;
-	/* send the dumper result to the chunker */
-	if (dumper->chunker) {
-	    if (dumper->chunker->sendresult) {
-		if (cmd == DONE) {
-		    chunker_cmd(dumper->chunker, DONE, dp, NULL);
-		} else {
-		    chunker_cmd(dumper->chunker, FAILED, dp, NULL);
-		}
-		dumper->chunker->sendresult = 0;
-	    }
-	    if( dumper->result != LAST_TOK &&
-	 	dumper->chunker->result != LAST_TOK)
-		dumper_chunker_result(dp);
-	} else { /* send the dumper result to the taper */
-	    if (taper->sendresult) {
-		if (cmd == DONE) {
-		    taper_cmd(DONE, dp, NULL, 0, NULL);
-		} else {
-		    taper_cmd(FAILED, dp, NULL, 0, NULL);
-		}
-		taper->sendresult = 0;
+    taper = sched(dp)->taper;
+    /* send the dumper result to the chunker */
+    if (dumper->chunker) {
+	if (dumper->chunker->sendresult) {
+	    if (cmd == DONE) {
+		chunker_cmd(dumper->chunker, DONE, dp, NULL);
+	    } else {
+		chunker_cmd(dumper->chunker, FAILED, dp, NULL);
 	    }
-	    if (taper->dumper && taper->result != LAST_TOK) {
-		dumper_taper_result(dp);
+	    dumper->chunker->sendresult = 0;
+	}
+	if( dumper->result != LAST_TOK &&
+	    dumper->chunker->result != LAST_TOK)
+	    dumper_chunker_result(dp);
+    } else { /* send the dumper result to the taper */
+	if (taper->sendresult) {
+	    if (cmd == DONE) {
+		taper_cmd(DONE, dp, NULL, 0, NULL);
+	    } else {
+		taper_cmd(FAILED, dp, NULL, 0, NULL);
 	    }
+	    taper->sendresult = 0;
 	}
-    } while(areads_dataready(dumper->fd));
+	if (taper->dumper && taper->result != LAST_TOK) {
+	    dumper_taper_result(dp);
+	}
+    }
+}
+
+/*
+ * Start reading results for the dump run by DUMPER.  All the slots run by
+ * one dumper process share its read event.
+ */
+static void
+dumper_wait_result(
+    dumper_t *dumper)
+{
+    dumper_t *proc = dumper->proc;
+
+    if (dumper->wait_reply)
+	return;
+    dumper->wait_reply = 1;
+    proc->nb_wait_reply++;
+    if (proc->ev_read == NULL) {
+	proc->ev_read = event_register((event_id_t)proc->fd, EV_READFD,
+				       handle_dumper_result, proc);
+    }
+}
+
+/*
+ * No more results are expected for DUMPER; stop reading from its process
+ * if no other slot is waiting for one.
+ */
+static void
+dumper_done_waiting(
+    dumper_t *dumper)
+{
+    dumper_t *proc = dumper->proc;
+
+    if (!dumper->wait_reply)
+	return;
+    dumper->wait_reply = 0;
+    proc->nb_wait_reply--;
+    if (proc->nb_wait_reply == 0 && proc->ev_read != NULL) {
+	event_release(proc->ev_read);
+	proc->ev_read = NULL;
+    }
 }
 
 
@@ -2808,7 +2963,7 @@ read_flush(
 	s[-1] = '\0';
 	destname = unquote_string(qdestname);
 
-	holding_file_get_dumpfile(destname, &file);
+	holding_file_get_summary(destname, &file);
 	if( file.type != F_DUMPFILE) {
 	    if( file.type != F_CONT_DUMPFILE )
 		log_add(L_INFO, _("%s: ignoring cruft file."), destname);
@@ -2901,6 +3056,7 @@ read_flush(
 	dp1->up = (char *)sp;
 
 	enqueue_disk(&tapeq, dp1);
+	status_add_dle(dp1, sp->act_size);
 	dumpfile_free_data(&file);
     }
     amfree(inpline);
@@ -3194,6 +3350,7 @@ read_schedule(
 	    }
 	}
 	remove_disk(&waitq, dp);
+	status_add_dle(dp, sp->est_size);
 
 	errors = validate_optionstr(dp);
 
@@ -3715,10 +3872,35 @@ queue_length(
     return len;
 }
 
+static const char *
+taper_summary(void)
+{
+    taper_t *taper;
+
+    if (degraded_mode)
+	return T_("DOWN");
+    for(taper = tapetable; taper < tapetable+conf_taper_parallel_write;
+			   taper++) {
+	if (taper->state & TAPER_STATE_DUMP_TO_TAPE ||
+	    taper->state & TAPER_STATE_FILE_TO_TAPE)
+	    return T_("writing");
+    }
+    return T_("idle");
+}
+
+static int
+idle_dumpers(void)
+{
+    int i, nidle;
+
+    nidle = 0;
+    for(i = 0; i < inparallel; i++) if(!dmptable[i].busy) nidle++;
+    return nidle;
+}
+
 static void
 short_dump_state(void)
 {
-    int i, nidle;
     char *wall_time;
 
     wall_time = walltime_str(curclock());
@@ -3727,24 +3909,8 @@ short_dump_state(void)
     g_printf(_("free kps: %lu space: %lld taper: "),
 	   free_kps(NULL),
 	   (long long)free_space());
-    if(degraded_mode) g_printf(_("DOWN"));
-    else {
-	taper_t *taper;
-	int writing = 0;
-	for(taper = tapetable; taper < tapetable+conf_taper_parallel_write;
-			       taper++) {
-	    if (taper->state & TAPER_STATE_DUMP_TO_TAPE ||
-		taper->state & TAPER_STATE_FILE_TO_TAPE)
-		writing = 1;
-	}
-	if(writing)
-	    g_printf(_("writing"));
-	else
-	    g_printf(_("idle"));
-    }
-    nidle = 0;
-    for(i = 0; i < inparallel; i++) if(!dmptable[i].busy) nidle++;
-    g_printf(_(" idle-dumpers: %d"), nidle);
+    g_printf("%s", _(taper_summary()));
+    g_printf(_(" idle-dumpers: %d"), idle_dumpers());
     g_printf(_(" qlen tapeq: %d"), queue_length(tapeq));
     g_printf(_(" runq: %d"), queue_length(runq));
     g_printf(_(" roomq: %d"), queue_length(roomq));
@@ -3753,6 +3919,265 @@ short_dump_state(void)
     interface_state(wall_time);
     holdingdisk_state(wall_time);
     fflush(stdout);
+    write_driver_status(0);
+}
+
+/*
+ * The live status snapshot.
+ *
+ * amstatus finds the state of each dle by reading the whole amdump file,
+ * which gets slow on a large run.  Instead, the driver keeps the current
+ * state of every dle it was given in $logdir/driver.status, rewritten
+ * (through a temporary file and a rename) whenever its state changes, but
+ * not more than once every DRIVER_STATUS_INTERVAL seconds.  The file has a
+ * line per value:
+ *
+ *   pid <driver pid>
+ *   datestamp <run datestamp>
+ *   time <seconds since the start>
+ *   updated <time_t of this snapshot>
+ *   finished <1 once the driver is done>
+ *   free-kps <kps> / free-space <kb> / taper <DOWN|writing|idle>
+ *   idle-dumpers <n> / driver-idle <reason>
+ *   qlen <queue> <n>, for each queue
+ *
+ * followed by a line per dle:
+ *
+ *   dle <host> <disk> <datestamp> <level> <state> <worker> <est kb> <kb>
+ *
+ * where the state is one of wait-schedule, wait-dump, wait-direct,
+ * wait-room, dumping, dumping-to-tape, dumped (on holding disk, waiting
+ * for the taper), writing, done, dumped-to-holding (on holding disk, not
+ * written to tape by this run) and failed.  The worker is the dumper or
+ * taper working on it, or '-'.  The disk is quoted as in the log file.
+ */
+
+static void
+free_status_dle(
+    gpointer data)
+{
+    status_dle_t *sd = data;
+
+    g_free(sd->datestamp);
+    g_free(sd);
+}
+
+static void
+status_add_dle(
+    disk_t *dp,
+    off_t   est_size)
+{
+    status_dle_t *sd;
+
+    if (!status_dles)
+	status_dles = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+					    NULL, free_status_dle);
+    sd = g_new0(status_dle_t, 1);
+    sd->dp = dp;
+    sd->datestamp = g_strdup(sched(dp)->datestamp);
+    sd->level = sched(dp)->level;
+    sd->est_size = est_size;
+    g_hash_table_insert(status_dles, dp, sd);
+}
+
+static void
+status_dle_taped(
+    disk_t *dp,
+    off_t   size)
+{
+    status_dle_t *sd;
+
+    if (status_dles && (sd = g_hash_table_lookup(status_dles, dp)) != NULL) {
+	sd->taped = 1;
+	sd->size = size;
+    }
+}
+
+static void
+status_dle_dumped(
+    disk_t *dp,
+    off_t   size)
+{
+    status_dle_t *sd;
+
+    if (status_dles && (sd = g_hash_table_lookup(status_dles, dp)) != NULL) {
+	sd->dumped = 1;
+	sd->size = size;
+    }
+}
+
+static void
+write_status_line(
+    FILE       *f,
+    disk_t     *dp,
+    status_dle_t *sd,
+    const char *state,
+    const char *worker,
+    off_t       size)
+{
+    char *qhost = quote_string(dp->host->hostname);
+    char *qdisk = quote_string(dp->name);
+
+    g_fprintf(f, "dle %s %s %s %d %s %s %lld %lld\n", qhost, qdisk,
+	      sd ? sd->datestamp : "-", sd ? sd->level : -1, state,
+	      worker ? worker : "-", sd ? (long long)sd->est_size : 0LL,
+	      (long long)size);
+    amfree(qhost);
+    amfree(qdisk);
+}
+
+/* write a dle the driver is working on, unless it was already written */
+static void
+write_status_dle(
+    FILE       *f,
+    disk_t     *dp,
+    const char *state,
+    const char *worker,
+    off_t       size)
+{
+    status_dle_t *sd = NULL;
+
+    if (status_dles && (sd = g_hash_table_lookup(status_dles, dp)) != NULL) {
+	if (sd->gen == status_gen)
+	    return;
+	sd->gen = status_gen;
+	/* degraded mode may have changed them */
+	sd->level = sched(dp)->level;
+    }
+    write_status_line(f, dp, sd, state, worker, size);
+}
+
+static void
+write_status_queue(
+    FILE       *f,
+    disklist_t *q,
+    const char *state)
+{
+    disk_t *dp;
+
+    for (dp = q->head; dp != NULL; dp = dp->next)
+	write_status_dle(f, dp, state, NULL, sched(dp)->act_size);
+}
+
+/* write a dle the driver is done with */
+static void
+write_status_outcome(
+    gpointer key G_GNUC_UNUSED,
+    gpointer value,
+    gpointer user_data)
+{
+    status_dle_t *sd = value;
+    FILE *f = user_data;
+    const char *state;
+
+    if (sd->gen == status_gen)
+	return;
+    if (sd->taped)
+	state = "done";
+    else if (sd->dumped)
+	state = "dumped-to-holding";
+    else
+	state = "failed";
+    write_status_line(f, sd->dp, sd, state, NULL, sd->size);
+}
+
+static void
+handle_status_time(
+    void *cookie G_GNUC_UNUSED)
+{
+    event_release(status_ev);
+    status_ev = NULL;
+    write_driver_status(1);
+}
+
+static void
+write_driver_status(
+    int force)
+{
+    FILE *f;
+    char *tmpname;
+    time_t now = time(NULL);
+    dumper_t *dumper;
+    taper_t *taper;
+    disk_t *dp;
+
+    /* the next change is soon enough for a run which is not changing */
+    if (!force && now < status_time + DRIVER_STATUS_INTERVAL) {
+	if (!status_ev)
+	    status_ev = event_register((event_id_t)DRIVER_STATUS_INTERVAL,
+				       EV_TIME, handle_status_time, NULL);
+	return;
+    }
+    if (status_ev) {
+	event_release(status_ev);
+	status_ev = NULL;
+    }
+    status_time = now;
+
+    if (!status_filename)
+	status_filename = g_strconcat(getconf_str(CNF_LOGDIR),
+				      "/driver.status", NULL);
+    tmpname = g_strconcat(status_filename, ".tmp", NULL);
+    if ((f = fopen(tmpname, "w")) == NULL) {
+	dbprintf(_("could not write %s: %s\n"), tmpname, strerror(errno));
+	g_free(tmpname);
+	return;
+    }
+
+    g_fprintf(f, "pid %ld\n", (long)getpid());
+    g_fprintf(f, "datestamp %s\n", driver_timestamp);
+    g_fprintf(f, "time %s\n", walltime_str(curclock()));
+    g_fprintf(f, "updated %ld\n", (long)now);
+    g_fprintf(f, "finished %d\n", driver_finished);
+    g_fprintf(f, "free-kps %lu\n", free_kps(NULL));
+    g_fprintf(f, "free-space %lld\n", (long long)free_space());
+    g_fprintf(f, "taper %s\n", taper_summary());
+    g_fprintf(f, "idle-dumpers %d\n", idle_dumpers());
+    g_fprintf(f, "driver-idle %s\n", idle_strings[idle_reason]);
+    g_fprintf(f, "qlen waitq %d\n", queue_length(waitq));
+    g_fprintf(f, "qlen runq %d\n", queue_length(runq));
+    g_fprintf(f, "qlen directq %d\n", queue_length(directq));
+    g_fprintf(f, "qlen roomq %d\n", queue_length(roomq));
+    g_fprintf(f, "qlen tapeq %d\n", queue_length(tapeq));
+
+    /* the dles at work first, then those in a queue, then the others */
+    status_gen++;
+    for (dumper = dmptable; dumper < dmptable + inparallel; dumper++) {
+	if (!dumper->busy || !dumper->dp)
+	    continue;
+	dp = dumper->dp;
+	taper = sched(dp)->taper;
+	if (taper)
+	    write_status_dle(f, dp, "dumping-to-tape", dumper->name,
+			     taper->written);
+	else
+	    write_status_dle(f, dp, "dumping", dumper->name,
+			     sched(dp)->act_size);
+    }
+    for (taper = tapetable; taper < tapetable + conf_taper_parallel_write;
+	 taper++) {
+	if (taper->disk && (taper->state & TAPER_STATE_FILE_TO_TAPE))
+	    write_status_dle(f, taper->disk, "writing", taper->name,
+			     taper->written);
+    }
+    write_status_queue(f, &runq, "wait-dump");
+    write_status_queue(f, &directq, "wait-direct");
+    write_status_queue(f, &roomq, "wait-room");
+    write_status_queue(f, &tapeq, "dumped");
+    /* not scheduled yet, so there is no sched_t */
+    if (!schedule_done) {
+	for (dp = waitq.head; dp != NULL; dp = dp->next)
+	    write_status_line(f, dp, NULL, "wait-schedule", NULL, 0);
+    }
+    if (status_dles)
+	g_hash_table_foreach(status_dles, write_status_outcome, f);
+
+    if (fclose(f) != 0 || rename(tmpname, status_filename) != 0) {
+	dbprintf(_("could not write %s: %s\n"), status_filename,
+		 strerror(errno));
+	unlink(tmpname);
+    }
+    g_free(tmpname);
 }
 
 static TapeAction
@@ -55,6 +55,7 @@ init_driverio(void)
 
     for(dumper = dmptable; dumper < dmptable + MAX_DUMPERS; dumper++) {
 	dumper->fd = -1;
+	dumper->proc = dumper;
     }
 }
 
@@ -212,9 +213,15 @@ startup_dump_processes(
     char *timestamp)
 {
     int i;
+    int per_process;
     dumper_t *dumper;
     char number[NUM_STR_SIZE];
 
+    /* each dumper process runs the dumps of this many consecutive slots */
+    per_process = getconf_int(CNF_DUMPER_PARALLEL_DUMPS);
+    if (per_process < 1)
+	per_process = 1;
+
     for(dumper = dmptable, i = 0; i < inparallel; dumper++, i++) {
 	g_snprintf(number, sizeof(number), "%d", i);
 	dumper->name = g_strconcat("dumper", number, NULL);
@@ -222,9 +229,21 @@ startup_dump_processes(
 	chktable[i].name = g_strconcat("chunker", number, NULL);
 	chktable[i].dumper = dumper;
 	chktable[i].fd = -1;
+	dumper->wait_reply = 0;
+	dumper->nb_wait_reply = 0;
 
-	startup_dump_process(dumper, dumper_program);
-	dumper_cmd(dumper, START, NULL, (void *)timestamp);
+	if (i % per_process == 0) {
+	    dumper->proc = dumper;
+	    startup_dump_process(dumper, dumper_program);
+	    dumper_cmd(dumper, START, NULL, (void *)timestamp);
+	} else {
+	    dumper->proc = dumper - (i % per_process);
+	    dumper->pid = dumper->proc->pid;
+	    dumper->fd = -1;
+	    dumper->ev_read = NULL;
+	    dumper->busy = dumper->down = 0;
+	    dumper->dp = NULL;
+	}
     }
 }
 
@@ -678,8 +697,16 @@ dumper_cmd(
 
 	break;
     }
-    case QUIT:
     case ABORT:
+	if (dp) {
+	    qmesg = quote_string(mesg);
+	    cmdline = g_strdup_printf("%s %s %s\n", cmdstr[cmd],
+				      disk2serial(dp), qmesg);
+	    amfree(qmesg);
+	    break;
+	}
+	/* FALLTHROUGH */
+    case QUIT:
 	qmesg = quote_string(mesg);
         cmdline = g_strdup_printf("%s %s\n", cmdstr[cmd], qmesg);
 	amfree(qmesg);
@@ -699,13 +726,13 @@ dumper_cmd(
 	g_printf(_("driver: send-cmd time %s to %s: %s"),
 	       walltime_str(curclock()), dumper->name, cmdline);
 	fflush(stdout);
-	if (full_write(dumper->fd, cmdline, strlen(cmdline)) < strlen(cmdline)) {
+	if (full_write(dumper->proc->fd, cmdline, strlen(cmdline)) < strlen(cmdline)) {
 	    g_printf(_("writing %s command: %s\n"), dumper->name, strerror(errno));
 	    fflush(stdout);
 	    g_free(cmdline);
 	    return 0;
 	}
-	if (cmd == QUIT) aclose(dumper->fd);
+	if (cmd == QUIT) aclose(dumper->proc->fd);
     }
     g_free(cmdline);
     return 1;
@@ -83,6 +83,10 @@ typedef struct dumper_s {
     event_handle_t *ev_read;	/* read event handle */
     disk_t *dp;			/* disk currently being dumped */
     chunker_t *chunker;
+    struct dumper_s *proc;	/* slot owning the process, fd and ev_read;
+				 * itself unless dumper-parallel-dumps > 1 */
+    int wait_reply;		/* waiting for a result from the process */
+    int nb_wait_reply;		/* slots waiting, for the owning slot */
 } dumper_t;
 
 typedef struct taper_s {
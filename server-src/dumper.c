@@ -43,6 +43,11 @@
 #include "util.h"
 #include "timestamp.h"
 #include "amxml.h"
+#include "glib-util.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #define dumper_debug(i,x) do {		\
 	if ((i) <= debug_dumper) {	\
@@ -62,6 +67,54 @@
 
 #define STARTUP_TIMEOUT 60
 
+/* most data a dump may have queued for its writer thread before reads from
+ * the client pause; they resume once the queue is down to half that */
+#define DATABUF_MAX_PENDING (8*1024*1024)
+#define DATABUF_RESUME_PENDING (DATABUF_MAX_PENDING / 2)
+
+/* most index data held in memory to be sorted before it is compressed;
+ * the index of a larger dump is compressed in the order it arrives */
+#define INDEX_SORT_MAX (64*1024*1024)
+
+/* buffer size for the compressed index file */
+#define INDEX_WRITE_SIZE (256*1024)
+
+/* most index data queued for the index writer thread before reads from the
+ * client pause; they resume once the queue is down to half that */
+#define INDEX_MAX_PENDING (8*1024*1024)
+#define INDEX_RESUME_PENDING (INDEX_MAX_PENDING / 2)
+
+typedef struct databuf_chunk_s {
+    size_t size;
+    char data[1];
+} databuf_chunk_t;
+
+/*
+ * Writes the index of a dump to its file, compressed.  With zlib, this is
+ * done by a thread of its own, so that neither compressing the index nor
+ * sorting it holds up the data; otherwise, the index is piped to a compress
+ * process.
+ */
+typedef struct index_writer_s {
+    int fd;
+    gboolean eof;		/* index_writer_eof has been called */
+    pid_t pid;			/* compress process, without a thread */
+
+    /* with a thread */
+    GThread *thread;
+    GAsyncQueue *queue;		/* databuf_chunk_t's; an empty one at EOF */
+    gint queued;		/* bytes queued and not yet processed */
+    gint paused;		/* reads wait for the queue to go down; the
+				 * thread clears this and wakes the loop */
+    gint discard;		/* drop the rest of the data */
+    gint failed;		/* a write failed */
+    gint done;			/* the thread is about to exit, and wakes the
+				 * loop; joining it will not block */
+    int write_errno;		/* errno of the failed write */
+    guint64 nlines;		/* set by the thread before it exits */
+    gboolean sorted;		/* ditto: the file is sorted */
+} index_writer_t;
+
 struct databuf {
     int fd;			/* file to flush to */
     char *buf;
@@ -70,8 +123,33 @@ struct databuf {
     char *datalimit;
     pid_t compresspid;		/* valid if fd is pipe to compress */
     pid_t encryptpid;		/* valid if fd is pipe to encrypt */
+
+    /* maybe_finish_dump waits for compress and encrypt to exit with a child
+     * watch, so that one dump's filters do not block the others */
+    GSource *compress_watch;
+    GSource *encrypt_watch;
+    gboolean compress_exited;
+    gboolean encrypt_exited;
+    amwait_t compress_status;	/* valid if compress_exited */
+    amwait_t encrypt_status;	/* valid if encrypt_exited */
+
+    /* when writer_pool is in use, data is queued here and written by a
+     * thread from the pool; at most one thread works on a databuf at once,
+     * so the data stays in order */
+    GMutex *mutex;
+    GQueue *pending;		/* databuf_chunk_t's not yet written */
+    size_t pending_bytes;
+    gboolean writer_queued;	/* a pool thread is (or will be) writing */
+    int write_errno;		/* errno of a failed write, or 0 */
+    gboolean paused;		/* reads wait for the queue to go down; the
+				 * writer clears this and wakes the loop */
+    gboolean waiting;		/* wake the loop once the writer is done */
+    gboolean close_pending;	/* close fd once the writer is done (the
+				 * event loop's; not under the mutex) */
 };
 
+struct dump_state_s;
+
 typedef struct filter_s {
     int             fd;
     char           *name;
@@ -80,110 +158,178 @@ typedef struct filter_s {
     gint64          size;            /* number of byte use in the buffer */
     gint64          allocated_size ; /* allocated size of the buffer     */
     event_handle_t *event;
+    struct dump_state_s *ds;
 } filter_t;
 
-static char *handle = NULL;
-
-static char *errstr = NULL;
-static off_t dumpbytes;
-static off_t dumpsize, headersize, origsize;
-
-static comp_t srvcompress = COMP_NONE;
-char *srvcompprog = NULL;
-char *clntcompprog = NULL;
-
-static encrypt_t srvencrypt = ENCRYPT_NONE;
-char *srv_encrypt = NULL;
-char *clnt_encrypt = NULL;
-char *srv_decrypt_opt = NULL;
-char *clnt_decrypt_opt = NULL;
-static kencrypt_type dumper_kencrypt;
-
-static FILE *errf = NULL;
-static char *hostname = NULL;
-am_feature_t *their_features = NULL;
-static char *diskname = NULL;
-static char *qdiskname = NULL, *b64disk;
-static char *device = NULL, *b64device;
-static char *options = NULL;
-static char *progname = NULL;
-static char *amandad_path=NULL;
-static char *client_username=NULL;
-static char *client_port=NULL;
-static char *ssh_keys=NULL;
-static char *auth=NULL;
-static data_path_t data_path=DATA_PATH_AMANDA;
-static char *dataport_list = NULL;
-static int level;
-static char *dumpdate = NULL;
-static char *dumper_timestamp = NULL;
-static time_t conf_dtimeout;
-static int indexfderror;
-static int set_datafd;
-static char *dle_str = NULL;
-static char *errfname = NULL;
-static int   errf_lines = 0;
-
-static dumpfile_t file;
-
-static struct {
-    const char *name;
-    security_stream_t *fd;
-} streams[] = {
+static const char *stream_names[] = {
 #define	DATAFD	0
-    { "DATA", NULL },
+    "DATA",
 #define	MESGFD	1
-    { "MESG", NULL },
+    "MESG",
 #define	INDEXFD	2
-    { "INDEX", NULL },
+    "INDEX",
 };
-#define NSTREAMS G_N_ELEMENTS(streams)
+#define NSTREAMS G_N_ELEMENTS(stream_names)
+
+/*
+ * Everything about one dump.  A dumper process runs one dump at a time unless
+ * dumper-parallel-dumps is set, in which case the driver may start several,
+ * and they all run from the same event loop.
+ */
+typedef struct dump_state_s {
+    char *handle;
+
+    char *errstr;
+    char *abort_msg;		/* message from an ABORT, used as errstr */
+    off_t dumpbytes;
+    off_t dumpsize, headersize, origsize;
+
+    comp_t srvcompress;
+    char *srvcompprog;
+    char *clntcompprog;
+
+    encrypt_t srvencrypt;
+    char *srv_encrypt;
+    char *clnt_encrypt;
+    char *srv_decrypt_opt;
+    char *clnt_decrypt_opt;
+    kencrypt_type dumper_kencrypt;
+
+    FILE *errf;
+    char *hostname;
+    am_feature_t *their_features;
+    char *diskname;
+    char *qdiskname, *b64disk;
+    char *device, *b64device;
+    char *options;
+    char *progname;
+    char *amandad_path;
+    char *client_username;
+    char *client_port;
+    char *ssh_keys;
+    char *auth;
+    data_path_t data_path;
+    char *dataport_list;
+    int level;
+    char *dumpdate;
+    int indexfderror;
+    int set_datafd;
+    char *dle_str;
+    char *errfname;
+    int   errf_lines;
+
+    dumpfile_t file;
+    security_stream_t *streams[NSTREAMS];
+    struct databuf db;
+
+    /* buffer to keep partial line from the MESG stream */
+    struct {
+	char *buf;		/* buffer holding msg data */
+	size_t size;		/* size of alloced buffer */
+    } msg;
+
+    int dump_result;
+    int status;
+
+    index_writer_t *index;
+    char *indexfile_tmp;
+    char *indexfile_real;
+
+    GTimeVal start_time;
+    event_handle_t *ev_timeout;
+    int nfilters;		/* filters whose stderr is still open */
+    gboolean running;		/* do_dump has started reading the streams */
+    gboolean stopped;		/* stop_dump has been called */
+    gboolean data_eof;		/* the data stream reached its end */
+    int paused;			/* PAUSE_* reasons the reads are paused */
+} dump_state_t;
+
+/* why the reads from a client are paused */
+#define PAUSE_DATA	(1 << 0)	/* too much data queued for the writer */
+#define PAUSE_INDEX	(1 << 1)	/* too much index queued for its writer */
+
+static char *dumper_timestamp = NULL;
+static time_t conf_dtimeout;
 
 static am_feature_t *our_features = NULL;
 static char *our_feature_string = NULL;
 
-/* buffer to keep partial line from the MESG stream */
-static struct {
-    char *buf;		/* buffer holding msg data */
-    size_t size;	/* size of alloced buffer */
-} msg = { NULL, 0 };
+/* dumps in progress */
+static GSList *active_dumps = NULL;
 
+/* read event for commands from the driver; NULL once QUIT is received */
+static event_handle_t *cmd_ev = NULL;
+
+/* threads writing dump data, when dumper-parallel-dumps > 1 */
+static GThreadPool *writer_pool = NULL;
+
+/* the writer threads wake the event loop by writing to this pipe; wake_ev
+ * is registered while there are dumps in progress */
+static int wake_pipe[2] = { -1, -1 };
+static event_handle_t *wake_ev = NULL;
 
 /* local functions */
 int		main(int, char **);
-static int	do_dump(struct databuf *);
-static void	check_options(char *);
-static void     xml_check_options(char *optionstr);
-static void	finish_tapeheader(dumpfile_t *);
+static void	read_cmd(void *);
+static void	port_dump(struct cmdargs *);
+static void	abort_dump(struct cmdargs *);
+static dump_state_t *dump_state_new(void);
+static void	dump_state_free(dump_state_t *);
+static void	do_dump(dump_state_t *);
+static void	maybe_finish_dump(dump_state_t *);
+static gboolean	filter_processes_exited(dump_state_t *);
+static GSource *watch_filter_process(dump_state_t *, pid_t);
+static void	filter_process_exited(pid_t, gint, gpointer);
+static void	read_pending_cmds(void);
+static void	finish_dump(dump_state_t *);
+static void	dump_failed(dump_state_t *);
+static void	check_options(dump_state_t *, char *);
+static void     xml_check_options(dump_state_t *, char *optionstr);
+static void	finish_tapeheader(dump_state_t *, dumpfile_t *);
 static ssize_t	write_tapeheader(int, dumpfile_t *);
 static void	databuf_init(struct databuf *, int);
-static int	databuf_write(struct databuf *, const void *, size_t);
-static int	databuf_flush(struct databuf *);
-static void	process_dumpeof(void);
-static void	process_dumpline(const char *);
-static void	add_msg_data(const char *, size_t);
-static void	parse_info_line(char *);
-static int	log_msgout(logtype_t);
+static int	databuf_write(dump_state_t *, const void *, size_t);
+static int	databuf_flush(dump_state_t *);
+static gboolean	databuf_idle(dump_state_t *);
+static int	databuf_error(dump_state_t *);
+static void	databuf_close(dump_state_t *, gboolean);
+static void	databuf_writer(gpointer, gpointer);
+static void	dumper_wakeup(void);
+static void	wakeup_callback(void *);
+static void	pause_reads(dump_state_t *, int);
+static void	resume_reads(dump_state_t *, int);
+static index_writer_t *index_writer_new(dump_state_t *, int);
+static gboolean	index_writer_write(index_writer_t *, const void *, size_t);
+static gboolean	index_writer_full(index_writer_t *);
+static gboolean	index_writer_resumed(index_writer_t *);
+static void	index_writer_eof(index_writer_t *);
+static void	index_writer_discard(index_writer_t *);
+static gboolean	index_writer_done(index_writer_t *);
+static gboolean	index_writer_finish(index_writer_t *, gboolean);
+static void	process_dumpeof(dump_state_t *);
+static void	process_dumpline(dump_state_t *, const char *);
+static void	add_msg_data(dump_state_t *, const char *, size_t);
+static void	parse_info_line(dump_state_t *, char *);
+static int	log_msgout(dump_state_t *, logtype_t);
 static char *	dumper_get_security_conf (char *, void *);
 
-static int	runcompress(int, pid_t *, comp_t, char *);
-static int	runencrypt(int, pid_t *,  encrypt_t);
+static int	runcompress(dump_state_t *, int, pid_t *, comp_t, char *);
+static int	runencrypt(dump_state_t *, int, pid_t *,  encrypt_t);
 
 static void	sendbackup_response(void *, pkt_t *, security_handle_t *);
-static int	startup_dump(const char *, const char *, const char *, int,
-			const char *, const char *, const char *,
-			const char *, const char *, const char *,
-			const char *, const char *);
-static void	stop_dump(void);
+static int	startup_dump(dump_state_t *);
+static void	startup_done(dump_state_t *, int);
+static void	stop_dump(dump_state_t *);
 
 static void	read_indexfd(void *, void *, ssize_t);
 static void	read_datafd(void *, void *, ssize_t);
 static void	read_mesgfd(void *, void *, ssize_t);
-static void	timeout(time_t);
+static void	timeout(dump_state_t *, time_t);
 static void	timeout_callback(void *);
 
 static void
 check_options(
+    dump_state_t *ds,
     char *options)
 {
   char *compmode = NULL;
@@ -194,79 +340,80 @@ check_options(
   char *decryptend = NULL;
 
     /* parse the compression option */
-    if (strstr(options, "srvcomp-best;") != NULL) 
-      srvcompress = COMP_BEST;
+    if (strstr(options, "srvcomp-best;") != NULL)
+      ds->srvcompress = COMP_BEST;
     else if (strstr(options, "srvcomp-fast;") != NULL)
-      srvcompress = COMP_FAST;
+      ds->srvcompress = COMP_FAST;
     else if ((compmode = strstr(options, "srvcomp-cust=")) != NULL) {
 	compend = strchr(compmode, ';');
 	if (compend ) {
-	    srvcompress = COMP_SERVER_CUST;
+	    ds->srvcompress = COMP_SERVER_CUST;
 	    *compend = '\0';
-	    srvcompprog = g_strdup(compmode + strlen("srvcomp-cust="));
+	    ds->srvcompprog = g_strdup(compmode + strlen("srvcomp-cust="));
 	    *compend = ';';
 	}
     } else if ((compmode = strstr(options, "comp-cust=")) != NULL) {
 	compend = strchr(compmode, ';');
 	if (compend) {
-	    srvcompress = COMP_CUST;
+	    ds->srvcompress = COMP_CUST;
 	    *compend = '\0';
-	    clntcompprog = g_strdup(compmode + strlen("comp-cust="));
+	    ds->clntcompprog = g_strdup(compmode + strlen("comp-cust="));
 	    *compend = ';';
 	}
     }
     else {
-      srvcompress = COMP_NONE;
+      ds->srvcompress = COMP_NONE;
     }
-    
+
 
     /* now parse the encryption option */
     if ((encryptmode = strstr(options, "encrypt-serv-cust=")) != NULL) {
       encryptend = strchr(encryptmode, ';');
       if (encryptend) {
-	    srvencrypt = ENCRYPT_SERV_CUST;
+	    ds->srvencrypt = ENCRYPT_SERV_CUST;
 	    *encryptend = '\0';
-	    srv_encrypt = g_strdup(encryptmode + strlen("encrypt-serv-cust="));
+	    ds->srv_encrypt = g_strdup(encryptmode + strlen("encrypt-serv-cust="));
 	    *encryptend = ';';
       }
     } else if ((encryptmode = strstr(options, "encrypt-cust=")) != NULL) {
       encryptend = strchr(encryptmode, ';');
       if (encryptend) {
-	    srvencrypt = ENCRYPT_CUST;
+	    ds->srvencrypt = ENCRYPT_CUST;
 	    *encryptend = '\0';
-	    clnt_encrypt = g_strdup(encryptmode + strlen("encrypt-cust="));
+	    ds->clnt_encrypt = g_strdup(encryptmode + strlen("encrypt-cust="));
 	    *encryptend = ';';
       }
     } else {
-      srvencrypt = ENCRYPT_NONE;
+      ds->srvencrypt = ENCRYPT_NONE;
     }
     /* get the decryption option parameter */
     if ((decryptmode = strstr(options, "server-decrypt-option=")) != NULL) {
       decryptend = strchr(decryptmode, ';');
       if (decryptend) {
 	*decryptend = '\0';
-	srv_decrypt_opt = g_strdup(decryptmode + strlen("server-decrypt-option="));
+	ds->srv_decrypt_opt = g_strdup(decryptmode + strlen("server-decrypt-option="));
 	*decryptend = ';';
       }
     } else if ((decryptmode = strstr(options, "client-decrypt-option=")) != NULL) {
       decryptend = strchr(decryptmode, ';');
       if (decryptend) {
 	*decryptend = '\0';
-	clnt_decrypt_opt = g_strdup(decryptmode + strlen("client-decrypt-option="));
+	ds->clnt_decrypt_opt = g_strdup(decryptmode + strlen("client-decrypt-option="));
 	*decryptend = ';';
       }
     }
 
     if (strstr(options, "kencrypt;") != NULL) {
-	dumper_kencrypt = KENCRYPT_WILL_DO;
+	ds->dumper_kencrypt = KENCRYPT_WILL_DO;
     } else {
-	dumper_kencrypt = KENCRYPT_NONE;
+	ds->dumper_kencrypt = KENCRYPT_NONE;
     }
 }
 
 
 static void
 xml_check_options(
+    dump_state_t *ds,
     char *optionstr)
 {
     char *o, *oo;
@@ -281,29 +428,29 @@ xml_check_options(
     }
 
     if (dle->compress == COMP_SERVER_FAST) {
-	srvcompress = COMP_FAST;
+	ds->srvcompress = COMP_FAST;
     } else if (dle->compress == COMP_SERVER_BEST) {
-	srvcompress = COMP_BEST;
+	ds->srvcompress = COMP_BEST;
     } else if (dle->compress == COMP_SERVER_CUST) {
-	srvcompress = COMP_SERVER_CUST;
-	srvcompprog = g_strdup(dle->compprog);
+	ds->srvcompress = COMP_SERVER_CUST;
+	ds->srvcompprog = g_strdup(dle->compprog);
     } else if (dle->compress == COMP_CUST) {
-	srvcompress = COMP_CUST;
-	clntcompprog = g_strdup(dle->compprog);
+	ds->srvcompress = COMP_CUST;
+	ds->clntcompprog = g_strdup(dle->compprog);
     } else {
-	srvcompress = COMP_NONE;
+	ds->srvcompress = COMP_NONE;
     }
 
     if (dle->encrypt == ENCRYPT_CUST) {
-	srvencrypt = ENCRYPT_CUST;
-	clnt_encrypt = g_strdup(dle->clnt_encrypt);
-	clnt_decrypt_opt = g_strdup(dle->clnt_decrypt_opt);
+	ds->srvencrypt = ENCRYPT_CUST;
+	ds->clnt_encrypt = g_strdup(dle->clnt_encrypt);
+	ds->clnt_decrypt_opt = g_strdup(dle->clnt_decrypt_opt);
     } else if (dle->encrypt == ENCRYPT_SERV_CUST) {
-	srvencrypt = ENCRYPT_SERV_CUST;
-	srv_encrypt = g_strdup(dle->srv_encrypt);
-	srv_decrypt_opt = g_strdup(dle->srv_decrypt_opt);
+	ds->srvencrypt = ENCRYPT_SERV_CUST;
+	ds->srv_encrypt = g_strdup(dle->srv_encrypt);
+	ds->srv_decrypt_opt = g_strdup(dle->srv_decrypt_opt);
     } else {
-	srvencrypt = ENCRYPT_NONE;
+	ds->srvencrypt = ENCRYPT_NONE;
     }
     free_dle(dle);
     amfree(o);
@@ -315,17 +462,11 @@ main(
     int		argc,
     char **	argv)
 {
-    static struct databuf db;
-    struct cmdargs *cmdargs = NULL;
-    int outfd = -1;
-    int rc;
-    in_port_t header_port;
-    char *q = NULL;
-    int a;
-    int res;
     config_overrides_t *cfg_ovr = NULL;
     char *cfg_opt = NULL;
     int dumper_setuid;
+    int parallel_dumps;
+    int i;
 
     if (argc > 1 && argv && argv[1] && g_str_equal(argv[1], "--version")) {
 	printf("dumper-%s\n", VERSION);
@@ -337,9 +478,11 @@ main(
      *   1) Only set the message locale for now.
      *   2) Set textdomain for all amanda related programs to "amanda"
      *      We don't want to be forced to support dozens of message catalogs.
-     */  
+     */
     setlocale(LC_MESSAGES, "C");
-    textdomain("amanda"); 
+    textdomain("amanda");
+
+    glib_init();
 
     /* drop root privileges */
     dumper_setuid = set_root_privs(0);
@@ -394,12 +537,62 @@ main(
 
     protocol_init();
 
+    /*
+     * With several dumps sharing this process, the data of each one is
+     * written to its chunker or taper by a thread from this pool, so a slow
+     * consumer only holds up its own dump.
+     */
+    parallel_dumps = getconf_int(CNF_DUMPER_PARALLEL_DUMPS);
+    if (parallel_dumps > 1) {
+	writer_pool = g_thread_pool_new(databuf_writer, NULL, parallel_dumps,
+					FALSE, NULL);
+    }
+
+    if (pipe(wake_pipe) < 0)
+	error(_("pipe: %s"), strerror(errno));
+    for (i = 0; i < 2; i++) {
+	fcntl(wake_pipe[i], F_SETFL, fcntl(wake_pipe[i], F_GETFL) | O_NONBLOCK);
+	fcntl(wake_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    /*
+     * Commands are read from the event loop, along with the streams of the
+     * dumps in progress.  The loop exits once QUIT has been read and the
+     * last dump is done.
+     */
+    log_start_batch();
+    cmd_ev = event_register((event_id_t)0, EV_READFD, read_cmd, NULL);
+    event_loop(0);
+
+    if (writer_pool)
+	g_thread_pool_free(writer_pool, FALSE, TRUE);
+
+    log_add(L_INFO, "pid-done %ld", (long)getpid());
+
+    am_release_feature_set(our_features);
+    amfree(our_feature_string);
+    amfree(dumper_timestamp);
+
+    dbclose();
+    return (0); /* exit */
+}
+
+/*
+ * Callback for commands from the driver on stdin.  A PORT-DUMP only starts
+ * the dump; the rest of it runs from the event loop.
+ */
+static void
+read_cmd(
+    void *	cookie)
+{
+    struct cmdargs *cmdargs;
+    char *q;
+
+    (void)cookie;	/* Quiet unused parameter warning */
+
     do {
-	if (cmdargs)
-	    free_cmdargs(cmdargs);
-	cmdargs = getcmd();
+	cmdargs = getcmd_fd(0);
 
-	amfree(errstr);
 	switch(cmdargs->cmd) {
 	case START:
 	    if(cmdargs->argc <  2)
@@ -409,387 +602,1084 @@ main(
 	    break;
 
 	case ABORT:
+	    abort_dump(cmdargs);
 	    break;
 
 	case QUIT:
-	    break;
+	    if (cmd_ev) {
+		event_release(cmd_ev);
+		cmd_ev = NULL;
+	    }
+	    free_cmdargs(cmdargs);
+	    return;
 
 	case PORT_DUMP:
-	    /*
-	     * PORT-DUMP
-	     *   handle
-	     *   port
-	     *   host
-	     *   features
-	     *   disk
-	     *   device
-	     *   level
-	     *   dumpdate
-	     *   progname
-	     *   amandad_path
-	     *   client_username
-	     *   client_port
-	     *   ssh_keys
-	     *   security_driver
-	     *   data_path
-	     *   dataport_list
-	     *   options
-	     */
-	    a = 1; /* skip "PORT-DUMP" */
+	    port_dump(cmdargs);
+	    break;
 
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: handle]"));
-		/*NOTREACHED*/
+	default:
+	    if(cmdargs->argc >= 1) {
+		q = quote_string(cmdargs->argv[0]);
+	    } else {
+		q = g_strdup(_("(no input?)"));
 	    }
-	    g_free(handle);
-	    handle = g_strdup(cmdargs->argv[a++]);
+	    putresult(BAD_COMMAND, "%s\n", q);
+	    amfree(q);
+	    break;
+	}
+	free_cmdargs(cmdargs);
+    } while (areads_dataready(0) > 0);
+}
 
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: port]"));
-		/*NOTREACHED*/
-	    }
-	    header_port = (in_port_t)atoi(cmdargs->argv[a++]);
+/*
+ * Run any command the driver has already sent, without waiting for one.
+ */
+static void
+read_pending_cmds(void)
+{
+    SELECT_ARG_TYPE ready;
+    struct timeval  to;
 
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: hostname]"));
-		/*NOTREACHED*/
-	    }
-	    g_free(hostname);
-	    hostname = g_strdup(cmdargs->argv[a++]);
+    if (cmd_ev == NULL)
+	return;
 
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: features]"));
-		/*NOTREACHED*/
-	    }
-	    am_release_feature_set(their_features);
-	    their_features = am_string_to_feature(cmdargs->argv[a++]);
+    if (areads_dataready(0) == 0) {
+	FD_ZERO(&ready);
+	FD_SET(0, &ready);
+	to.tv_sec = 0;
+	to.tv_usec = 0;
+	if (select(1, &ready, NULL, NULL, &to) <= 0 || !FD_ISSET(0, &ready))
+	    return;
+    }
+    read_cmd(NULL);
+}
 
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: diskname]"));
-		/*NOTREACHED*/
-	    }
-	    g_free(diskname);
-	    diskname = g_strdup(cmdargs->argv[a++]);
-	    if (qdiskname != NULL)
-		amfree(qdiskname);
-	    qdiskname = quote_string(diskname);
-	    b64disk = amxml_format_tag("disk", diskname);
-
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: device]"));
-		/*NOTREACHED*/
-	    }
-	    g_free(device);
-	    device = g_strdup(cmdargs->argv[a++]);
-	    b64device = amxml_format_tag("diskdevice", device);
-	    if(g_str_equal(device, "NODEVICE"))
-		amfree(device);
-
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: level]"));
-		/*NOTREACHED*/
-	    }
-	    level = atoi(cmdargs->argv[a++]);
+static void
+port_dump(
+    struct cmdargs *cmdargs)
+{
+    dump_state_t *ds;
+    int outfd = -1;
+    int rc;
+    in_port_t header_port;
+    char *q = NULL;
+    int a;
+    int res;
 
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: dumpdate]"));
-		/*NOTREACHED*/
-	    }
-	    g_free(dumpdate);
-	    dumpdate = g_strdup(cmdargs->argv[a++]);
+    /*
+     * PORT-DUMP
+     *   handle
+     *   port
+     *   host
+     *   features
+     *   disk
+     *   device
+     *   level
+     *   dumpdate
+     *   progname
+     *   amandad_path
+     *   client_username
+     *   client_port
+     *   ssh_keys
+     *   security_driver
+     *   data_path
+     *   dataport_list
+     *   options
+     */
+    ds = dump_state_new();
+    a = 1; /* skip "PORT-DUMP" */
 
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: program]"));
-		/*NOTREACHED*/
-	    }
-	    g_free(progname);
-	    progname = g_strdup(cmdargs->argv[a++]);
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: handle]"));
+	/*NOTREACHED*/
+    }
+    ds->handle = g_strdup(cmdargs->argv[a++]);
 
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: amandad_path]"));
-		/*NOTREACHED*/
-	    }
-	    g_free(amandad_path);
-	    amandad_path = g_strdup(cmdargs->argv[a++]);
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: port]"));
+	/*NOTREACHED*/
+    }
+    header_port = (in_port_t)atoi(cmdargs->argv[a++]);
 
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: client_username]"));
-	    }
-	    g_free(client_username);
-	    client_username = g_strdup(cmdargs->argv[a++]);
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: hostname]"));
+	/*NOTREACHED*/
+    }
+    ds->hostname = g_strdup(cmdargs->argv[a++]);
 
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: client_port]"));
-	    }
-	    g_free(client_port);
-	    client_port = g_strdup(cmdargs->argv[a++]);
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: features]"));
+	/*NOTREACHED*/
+    }
+    ds->their_features = am_string_to_feature(cmdargs->argv[a++]);
 
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: ssh_keys]"));
-	    }
-	    g_free(ssh_keys);
-	    ssh_keys = g_strdup(cmdargs->argv[a++]);
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: diskname]"));
+	/*NOTREACHED*/
+    }
+    ds->diskname = g_strdup(cmdargs->argv[a++]);
+    ds->qdiskname = quote_string(ds->diskname);
+    ds->b64disk = amxml_format_tag("disk", ds->diskname);
+
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: device]"));
+	/*NOTREACHED*/
+    }
+    ds->device = g_strdup(cmdargs->argv[a++]);
+    ds->b64device = amxml_format_tag("diskdevice", ds->device);
+    if(g_str_equal(ds->device, "NODEVICE"))
+	amfree(ds->device);
+
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: level]"));
+	/*NOTREACHED*/
+    }
+    ds->level = atoi(cmdargs->argv[a++]);
+
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: dumpdate]"));
+	/*NOTREACHED*/
+    }
+    ds->dumpdate = g_strdup(cmdargs->argv[a++]);
+
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: program]"));
+	/*NOTREACHED*/
+    }
+    ds->progname = g_strdup(cmdargs->argv[a++]);
+
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: amandad_path]"));
+	/*NOTREACHED*/
+    }
+    ds->amandad_path = g_strdup(cmdargs->argv[a++]);
+
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: client_username]"));
+    }
+    ds->client_username = g_strdup(cmdargs->argv[a++]);
+
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: client_port]"));
+    }
+    ds->client_port = g_strdup(cmdargs->argv[a++]);
 
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: auth]"));
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: ssh_keys]"));
+    }
+    ds->ssh_keys = g_strdup(cmdargs->argv[a++]);
+
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: auth]"));
+    }
+    ds->auth = g_strdup(cmdargs->argv[a++]);
+
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: data_path]"));
+    }
+    ds->data_path = data_path_from_string(cmdargs->argv[a++]);
+
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: dataport_list]"));
+    }
+    ds->dataport_list = g_strdup(cmdargs->argv[a++]);
+
+    if(a >= cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: not enough args: options]"));
+    }
+    ds->options = g_strdup(cmdargs->argv[a++]);
+
+    if(a != cmdargs->argc) {
+	error(_("error [dumper PORT-DUMP: too many args: %d != %d]"),
+	      cmdargs->argc, a);
+	/*NOTREACHED*/
+    }
+
+    /* Double-check that 'localhost' resolves properly */
+    if ((res = resolve_hostname("localhost", 0, NULL, NULL) != 0)) {
+	g_free(ds->errstr);
+	ds->errstr = g_strdup_printf(_("could not resolve localhost: %s"),
+				     gai_strerror(res));
+	q = quote_string(ds->errstr);
+	putresult(FAILED, "%s %s\n", ds->handle, q);
+	log_add(L_FAIL, "%s %s %s %d [%s]", ds->hostname, ds->qdiskname,
+		dumper_timestamp, ds->level, ds->errstr);
+	amfree(q);
+	dump_state_free(ds);
+	return;
+    }
+
+    /* connect outf to chunker/taper port */
+
+    g_debug(_("Sending header to localhost:%d\n"), header_port);
+    outfd = stream_client("localhost", header_port,
+			  STREAM_BUFSIZE, 0, NULL, 0);
+    if (outfd == -1) {
+
+	g_free(ds->errstr);
+	ds->errstr = g_strdup_printf(_("port open: %s"), strerror(errno));
+	q = quote_string(ds->errstr);
+	putresult(FAILED, "%s %s\n", ds->handle, q);
+	log_add(L_FAIL, "%s %s %s %d [%s]", ds->hostname, ds->qdiskname,
+		dumper_timestamp, ds->level, ds->errstr);
+	amfree(q);
+	dump_state_free(ds);
+	return;
+    }
+    databuf_init(&ds->db, outfd);
+
+    if (am_has_feature(ds->their_features, fe_req_xml))
+	xml_check_options(ds, ds->options); /* note: modifies ds */
+    else
+	check_options(ds, ds->options); /* note: modifies ds */
+
+    /* the reply to the request is handled by sendbackup_response */
+    rc = startup_dump(ds);
+    if (rc != 0)
+	startup_done(ds, rc);
+}
+
+/*
+ * ABORT handle message
+ *
+ * Record why the driver wants the dump to stop; the message is reported
+ * when it does.  The older form without a handle applies to every dump in
+ * progress.
+ */
+static void
+abort_dump(
+    struct cmdargs *cmdargs)
+{
+    GSList *iter;
+    char *handle = NULL;
+    char *msg;
+
+    if (cmdargs->argc >= 3) {
+	handle = cmdargs->argv[1];
+	msg = cmdargs->argv[2];
+    } else if (cmdargs->argc == 2) {
+	msg = cmdargs->argv[1];
+    } else {
+	return;
+    }
+
+    for (iter = active_dumps; iter != NULL; iter = iter->next) {
+	dump_state_t *ds = iter->data;
+
+	if (handle && !g_str_equal(handle, ds->handle))
+	    continue;
+	g_free(ds->abort_msg);
+	ds->abort_msg = g_strdup(msg);
+    }
+}
+
+static dump_state_t *
+dump_state_new(void)
+{
+    dump_state_t *ds = g_new0(dump_state_t, 1);
+
+    ds->srvcompress = COMP_NONE;
+    ds->srvencrypt = ENCRYPT_NONE;
+    ds->data_path = DATA_PATH_AMANDA;
+    ds->db.fd = -1;
+    ds->db.compresspid = -1;
+    ds->db.encryptpid = -1;
+
+    active_dumps = g_slist_prepend(active_dumps, ds);
+    if (!wake_ev)
+	wake_ev = event_register((event_id_t)wake_pipe[0], EV_READFD,
+				 wakeup_callback, NULL);
+    return ds;
+}
+
+static void
+dump_state_free(
+    dump_state_t *ds)
+{
+    active_dumps = g_slist_remove(active_dumps, ds);
+    if (active_dumps == NULL && wake_ev) {
+	/* so that the event loop can end */
+	event_release(wake_ev);
+	wake_ev = NULL;
+    }
+
+    /* the watches' callbacks must not see a freed ds */
+    if (ds->db.compress_watch)
+	g_source_destroy(ds->db.compress_watch);
+    if (ds->db.encrypt_watch)
+	g_source_destroy(ds->db.encrypt_watch);
+    if (ds->db.mutex) {
+	g_mutex_free(ds->db.mutex);
+	g_queue_free(ds->db.pending);
+    }
+    am_release_feature_set(ds->their_features);
+    amfree(ds->handle);
+    amfree(ds->errstr);
+    amfree(ds->abort_msg);
+    amfree(ds->srvcompprog);
+    amfree(ds->clntcompprog);
+    amfree(ds->srv_encrypt);
+    amfree(ds->clnt_encrypt);
+    amfree(ds->srv_decrypt_opt);
+    amfree(ds->clnt_decrypt_opt);
+    amfree(ds->hostname);
+    amfree(ds->diskname);
+    amfree(ds->qdiskname);
+    amfree(ds->b64disk);
+    amfree(ds->device);
+    amfree(ds->b64device);
+    amfree(ds->options);
+    amfree(ds->progname);
+    amfree(ds->amandad_path);
+    amfree(ds->client_username);
+    amfree(ds->client_port);
+    amfree(ds->ssh_keys);
+    amfree(ds->auth);
+    amfree(ds->dataport_list);
+    amfree(ds->dumpdate);
+    amfree(ds->dle_str);
+    amfree(ds->errfname);
+    amfree(ds->indexfile_tmp);
+    amfree(ds->indexfile_real);
+    amfree(ds->msg.buf);
+    g_free(ds);
+
+    /* try to clean up any defunct processes, since Amanda doesn't wait()
+     * for them explicitly; not while other dumps may still wait for their
+     * own children */
+    if (active_dumps == NULL)
+	while(waitpid(-1, NULL, WNOHANG)> 0);
+}
+
+
+/*
+ * Initialize a databuf.  Takes a writeable file descriptor.
+ */
+static void
+databuf_init(
+    struct databuf *	db,
+    int			fd)
+{
+
+    db->fd = fd;
+    db->datain = db->dataout = db->datalimit = NULL;
+    db->compresspid = -1;
+    db->encryptpid = -1;
+    db->compress_watch = NULL;
+    db->encrypt_watch = NULL;
+    db->compress_exited = FALSE;
+    db->encrypt_exited = FALSE;
+    if (writer_pool) {
+	db->mutex = g_mutex_new();
+	db->pending = g_queue_new();
+    }
+    db->pending_bytes = 0;
+    db->writer_queued = FALSE;
+    db->write_errno = 0;
+    db->paused = FALSE;
+    db->waiting = FALSE;
+    db->close_pending = FALSE;
+}
+
+
+/*
+ * Updates the buffer pointer for the input data buffer.  The buffer is
+ * written regardless of how much data is present, since we know we
+ * are writing to a socket (to chunker) and there is no need to maintain
+ * any boundaries.
+ *
+ * With a writer pool, the data is copied and queued for a writer thread
+ * instead.  Returns 1 if so much is queued that the reads should pause until
+ * the writer wakes the event loop, and -1, with errno set, if a write failed.
+ */
+static int
+databuf_write(
+    dump_state_t *	ds,
+    const void *	buf,
+    size_t		size)
+{
+    struct databuf *db = &ds->db;
+    databuf_chunk_t *chunk;
+    int rval = 0;
+
+    if (!db->mutex) {
+	db->buf = (char *)buf;
+	db->datain = db->datalimit = db->buf + size;
+	db->dataout = db->buf;
+	return databuf_flush(ds);
+    }
+
+    g_mutex_lock(db->mutex);
+    if (db->write_errno != 0) {
+	int save_errno = db->write_errno;
+	g_mutex_unlock(db->mutex);
+	errno = save_errno;
+	return -1;
+    }
+
+    chunk = g_malloc(sizeof(databuf_chunk_t) + size);
+    chunk->size = size;
+    memcpy(chunk->data, buf, size);
+    g_queue_push_tail(db->pending, chunk);
+    db->pending_bytes += size;
+
+    if (!db->writer_queued) {
+	db->writer_queued = TRUE;
+	g_thread_pool_push(writer_pool, ds, NULL);
+    }
+    if (db->pending_bytes > DATABUF_MAX_PENDING) {
+	db->paused = TRUE;
+	rval = 1;
+    }
+    g_mutex_unlock(db->mutex);
+    return rval;
+}
+
+/*
+ * Write out the buffer to chunker.
+ */
+static int
+databuf_flush(
+    dump_state_t *	ds)
+{
+    struct databuf *db = &ds->db;
+    size_t written;
+    char *m;
+
+    /*
+     * If there's no data, do nothing.
+     */
+    if (db->dataout >= db->datain) {
+	return 0;
+    }
+
+    /*
+     * Write out the buffer
+     */
+    written = full_write(db->fd, db->dataout,
+			(size_t)(db->datain - db->dataout));
+    if (written > 0) {
+	db->dataout += written;
+        ds->dumpbytes += (off_t)written;
+    }
+    if (ds->dumpbytes >= (off_t)1024) {
+	ds->dumpsize += (ds->dumpbytes / (off_t)1024);
+	ds->dumpbytes %= (off_t)1024;
+    }
+    if (written == 0) {
+	int save_errno = errno;
+	m = g_strdup_printf(_("data write: %s"), strerror(save_errno));
+	amfree(ds->errstr);
+	ds->errstr = quote_string(m);
+	amfree(m);
+	errno = save_errno;
+	return -1;
+    }
+    db->datain = db->dataout = db->buf;
+    return 0;
+}
+
+/*
+ * Thread pool function: write everything queued on a databuf.  Only one
+ * thread at a time works on a given databuf, so the data stays in order.
+ */
+static void
+databuf_writer(
+    gpointer	data,
+    gpointer	user_data)
+{
+    dump_state_t *ds = data;
+    struct databuf *db = &ds->db;
+    databuf_chunk_t *chunk;
+
+    (void)user_data;	/* Quiet unused parameter warning */
+
+    g_mutex_lock(db->mutex);
+    while ((chunk = g_queue_pop_head(db->pending)) != NULL) {
+	gboolean failed = (db->write_errno != 0);
+	size_t written = 0;
+	int save_errno = 0;
+
+	g_mutex_unlock(db->mutex);
+	if (!failed) {
+	    written = full_write(db->fd, chunk->data, chunk->size);
+	    save_errno = errno;
+	}
+	g_mutex_lock(db->mutex);
+
+	db->pending_bytes -= chunk->size;
+	if (!failed) {
+	    ds->dumpbytes += (off_t)written;
+	    if (ds->dumpbytes >= (off_t)1024) {
+		ds->dumpsize += (ds->dumpbytes / (off_t)1024);
+		ds->dumpbytes %= (off_t)1024;
 	    }
-	    g_free(auth);
-	    auth = g_strdup(cmdargs->argv[a++]);
+	    if (written < chunk->size)
+		db->write_errno = save_errno? save_errno : EIO;
+	}
+	g_free(chunk);
+
+	if (db->paused && (db->pending_bytes <= DATABUF_RESUME_PENDING ||
+			   db->write_errno != 0)) {
+	    db->paused = FALSE;
+	    dumper_wakeup();
+	}
+    }
+    db->writer_queued = FALSE;
+    if (db->waiting) {
+	db->waiting = FALSE;
+	dumper_wakeup();
+    }
+    g_mutex_unlock(db->mutex);
+}
+
+/*
+ * Returns TRUE if nothing is queued on the databuf or being written.  If
+ * something is, the writer wakes the event loop once it is done.
+ */
+static gboolean
+databuf_idle(
+    dump_state_t *	ds)
+{
+    struct databuf *db = &ds->db;
+    gboolean idle;
+
+    if (!db->mutex)
+	return TRUE;
+
+    g_mutex_lock(db->mutex);
+    idle = !db->writer_queued;
+    if (!idle)
+	db->waiting = TRUE;
+    g_mutex_unlock(db->mutex);
+    return idle;
+}
 
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: data_path]"));
+/*
+ * Returns the errno of a failed write by the writer thread, or 0.
+ */
+static int
+databuf_error(
+    dump_state_t *	ds)
+{
+    struct databuf *db = &ds->db;
+    int save_errno;
+
+    if (!db->mutex)
+	return 0;
+
+    g_mutex_lock(db->mutex);
+    save_errno = db->write_errno;
+    g_mutex_unlock(db->mutex);
+    return save_errno;
+}
+
+/*
+ * Close the databuf's file descriptor, or have it closed from the event loop
+ * once the writer is done with it.  If DISCARD, data not yet written is
+ * dropped.
+ */
+static void
+databuf_close(
+    dump_state_t *	ds,
+    gboolean		discard)
+{
+    struct databuf *db = &ds->db;
+    databuf_chunk_t *chunk;
+
+    if (db->mutex) {
+	if (discard) {
+	    g_mutex_lock(db->mutex);
+	    while ((chunk = g_queue_pop_head(db->pending)) != NULL) {
+		db->pending_bytes -= chunk->size;
+		g_free(chunk);
 	    }
-	    data_path = data_path_from_string(cmdargs->argv[a++]);
+	    g_mutex_unlock(db->mutex);
+	}
+	if (!databuf_idle(ds)) {
+	    db->close_pending = TRUE;
+	    return;
+	}
+    }
+    db->close_pending = FALSE;
+    aclose(db->fd);
+}
+
+/*
+ * Wake the event loop from another thread; wakeup_callback then looks at
+ * every dump in progress.
+ */
+static void
+dumper_wakeup(void)
+{
+    /* if the pipe is full, the event loop is due to wake up anyway */
+    if (write(wake_pipe[1], "", 1) < 0) {
+	/* ignore */
+    }
+}
+
+static void
+wakeup_callback(
+    void *	cookie)
+{
+    char buf[64];
+    GSList *dumps, *iter;
+
+    (void)cookie;	/* Quiet unused parameter warning */
+
+    while (read(wake_pipe[0], buf, sizeof(buf)) > 0)
+	continue;
+
+    /* finishing a dump frees it, so walk a copy of the list */
+    dumps = g_slist_copy(active_dumps);
+    for (iter = dumps; iter != NULL; iter = iter->next) {
+	dump_state_t *ds = iter->data;
+	gboolean resume;
+
+	if (!g_slist_find(active_dumps, ds))
+	    continue;
+
+	if (ds->db.close_pending && databuf_idle(ds))
+	    databuf_close(ds, FALSE);
+
+	if (ds->paused & PAUSE_DATA) {
+	    g_mutex_lock(ds->db.mutex);
+	    resume = !ds->db.paused;
+	    g_mutex_unlock(ds->db.mutex);
+	    if (resume)
+		resume_reads(ds, PAUSE_DATA);
+	}
+	if ((ds->paused & PAUSE_INDEX) && index_writer_resumed(ds->index))
+	    resume_reads(ds, PAUSE_INDEX);
+
+	maybe_finish_dump(ds);
+    }
+    g_slist_free(dumps);
+}
+
+/*
+ * Stop reading from the client until resume_reads is called with the same
+ * REASON.  All the streams are paused, since they may share a connection.
+ */
+static void
+pause_reads(
+    dump_state_t *	ds,
+    int			reason)
+{
+    guint i;
+
+    if (ds->paused == 0) {
+	for (i = 0; i < NSTREAMS; i++) {
+	    if (ds->streams[i] != NULL)
+		security_stream_read_cancel(ds->streams[i]);
+	}
+	/* the client is not the one holding things up */
+	timeout(ds, 0);
+    }
+    ds->paused |= reason;
+}
+
+static void
+resume_reads(
+    dump_state_t *	ds,
+    int			reason)
+{
+    ds->paused &= ~reason;
+    if (ds->paused != 0 || ds->stopped)
+	return;
+
+    if (ds->streams[MESGFD] != NULL)
+	security_stream_read(ds->streams[MESGFD], read_mesgfd, ds);
+    if (ds->streams[INDEXFD] != NULL)
+	security_stream_read(ds->streams[INDEXFD], read_indexfd, ds);
+    if (ds->set_datafd && ds->streams[DATAFD] != NULL)
+	security_stream_read(ds->streams[DATAFD], read_datafd, ds);
+    timeout(ds, conf_dtimeout);
+}
+
+#ifdef HAVE_ZLIB
+
+/* compare two lines as 'LC_ALL=C sort' does */
+static gint
+index_line_compare(
+    gconstpointer	a,
+    gconstpointer	b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* Write one line to the compressed index */
+static void
+index_writer_put(
+    index_writer_t *	iw,
+    gzFile		gz,
+    const char *	line,
+    size_t		len)
+{
+    if (iw->failed)
+	return;
+    if ((len > 0 && gzwrite(gz, line, (unsigned)len) == 0) ||
+	gzputc(gz, '\n') == -1) {
+	int zerr;
+
+	gzerror(gz, &zerr);
+	iw->write_errno = (zerr == Z_ERRNO && errno)? errno : EIO;
+	g_atomic_int_set(&iw->failed, 1);
+    }
+}
+
+/*
+ * Thread function: compress the index as it arrives.  Lines are held until
+ * INDEX_SORT_MAX bytes of them have arrived, so that a small index can be
+ * sorted before it is written.  A larger index is written as it arrives,
+ * which is sorted if the client sent it sorted.
+ */
+static gpointer
+index_writer_thread(
+    gpointer	data)
+{
+    index_writer_t *iw = data;
+    databuf_chunk_t *chunk;
+    GString *line = g_string_sized_new(1024);
+    GString *prev = g_string_sized_new(1024);
+    GStringChunk *held_strings = g_string_chunk_new(1024*1024);
+    GPtrArray *held = g_ptr_array_new();
+    size_t held_bytes = 0;
+    gboolean sorted = TRUE;
+    gboolean at_eof = FALSE;
+    gzFile gz;
+    char *p, *end, *nl;
+    guint i;
+
+    gz = gzdopen(iw->fd, "wb9");
+    if (gz == NULL) {
+	iw->write_errno = errno? errno : ENOMEM;
+	g_atomic_int_set(&iw->failed, 1);
+	close(iw->fd);
+    }
+#if ZLIB_VERNUM >= 0x1240
+    else {
+	gzbuffer(gz, INDEX_WRITE_SIZE);
+    }
+#endif
 
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: dataport_list]"));
+    while (!at_eof) {
+	chunk = g_async_queue_pop(iw->queue);
+	if (chunk->size == 0) {
+	    /* the last line may lack its newline */
+	    at_eof = TRUE;
+	    p = end = NULL;
+	    if (line->len == 0) {
+		g_free(chunk);
+		break;
 	    }
-	    g_free(dataport_list);
-	    dataport_list = g_strdup(cmdargs->argv[a++]);
+	} else {
+	    p = chunk->data;
+	    end = chunk->data + chunk->size;
+	}
 
-	    if(a >= cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: not enough args: options]"));
+	while (at_eof || p < end) {
+	    if (!at_eof) {
+		nl = memchr(p, '\n', end - p);
+		if (!nl) {
+		    g_string_append_len(line, p, end - p);
+		    break;
+		}
+		g_string_append_len(line, p, nl - p);
+		p = nl + 1;
 	    }
-	    g_free(options);
-	    options = g_strdup(cmdargs->argv[a++]);
 
-	    if(a != cmdargs->argc) {
-		error(_("error [dumper PORT-DUMP: too many args: %d != %d]"),
-		      cmdargs->argc, a);
-	        /*NOTREACHED*/
+	    if (!iw->failed && !g_atomic_int_get(&iw->discard)) {
+		iw->nlines++;
+		if (sorted && iw->nlines > 1 && strcmp(prev->str, line->str) > 0)
+		    sorted = FALSE;
+		g_string_assign(prev, line->str);
+
+		if (held) {
+		    g_ptr_array_add(held,
+			g_string_chunk_insert_len(held_strings, line->str, line->len));
+		    held_bytes += line->len + 1 + sizeof(gpointer);
+		    if (held_bytes > INDEX_SORT_MAX) {
+			/* too big to sort; write it as it came */
+			for (i = 0; i < held->len; i++) {
+			    char *l = g_ptr_array_index(held, i);
+			    index_writer_put(iw, gz, l, strlen(l));
+			}
+			g_ptr_array_free(held, TRUE);
+			held = NULL;
+			g_string_chunk_free(held_strings);
+			held_strings = NULL;
+		    }
+		} else {
+		    index_writer_put(iw, gz, line->str, line->len);
+		}
 	    }
-
-	    /* Double-check that 'localhost' resolves properly */
-	    if ((res = resolve_hostname("localhost", 0, NULL, NULL) != 0)) {
-                g_free(errstr);
-                errstr = g_strdup_printf(_("could not resolve localhost: %s"),
-                                         gai_strerror(res));
-		q = quote_string(errstr);
-		putresult(FAILED, "%s %s\n", handle, q);
-		log_add(L_FAIL, "%s %s %s %d [%s]", hostname, qdiskname,
-			dumper_timestamp, level, errstr);
-		amfree(q);
+	    g_string_truncate(line, 0);
+	    if (at_eof)
 		break;
+	}
+	if (g_atomic_int_exchange_and_add(&iw->queued, -(gint)chunk->size)
+		- (gint)chunk->size <= INDEX_RESUME_PENDING &&
+	    g_atomic_int_compare_and_exchange(&iw->paused, 1, 0))
+	    dumper_wakeup();
+	g_free(chunk);
+    }
+
+    if (held) {
+	if (!g_atomic_int_get(&iw->discard)) {
+	    if (!sorted) {
+		g_ptr_array_sort(held, index_line_compare);
+		sorted = TRUE;
 	    }
-
-	    /* connect outf to chunker/taper port */
-
-	    g_debug(_("Sending header to localhost:%d\n"), header_port);
-	    outfd = stream_client("localhost", header_port,
-				  STREAM_BUFSIZE, 0, NULL, 0);
-	    if (outfd == -1) {
-		
-		g_free(errstr);
-		errstr = g_strdup_printf(_("port open: %s"), strerror(errno));
-		q = quote_string(errstr);
-		putresult(FAILED, "%s %s\n", handle, q);
-		log_add(L_FAIL, "%s %s %s %d [%s]", hostname, qdiskname,
-			dumper_timestamp, level, errstr);
-		amfree(amandad_path);
-		amfree(client_username);
-		amfree(client_port);
-		amfree(device);
-		amfree(b64device);
-		amfree(qdiskname);
-		amfree(b64disk);
-		amfree(q);
-		break;
+	    for (i = 0; i < held->len; i++) {
+		char *l = g_ptr_array_index(held, i);
+		index_writer_put(iw, gz, l, strlen(l));
 	    }
-	    databuf_init(&db, outfd);
+	}
+	g_ptr_array_free(held, TRUE);
+	g_string_chunk_free(held_strings);
+    }
+    iw->sorted = sorted;
 
-	    if (am_has_feature(their_features, fe_req_xml))
-		xml_check_options(options); /* note: modifies globals */
-	    else
-		check_options(options); /* note: modifies globals */
-
-	    rc = startup_dump(hostname,
-			      diskname,
-			      device,
-			      level,
-			      dumpdate,
-			      progname,
-			      amandad_path,
-			      client_username,
-			      client_port,
-			      ssh_keys,
-			      auth,
-			      options);
-	    if (rc != 0) {
-		q = quote_string(errstr);
-		putresult(rc == 2? FAILED : TRYAGAIN, "%s %s\n",
-		    handle, q);
-		if (rc == 2)
-		    log_add(L_FAIL, "%s %s %s %d [%s]", hostname, qdiskname,
-			dumper_timestamp, level, errstr);
-		amfree(q);
-	    } else {
-		do_dump(&db);
-		/* try to clean up any defunct processes, since Amanda doesn't
-		   wait() for them explicitly */
-		while(waitpid(-1, NULL, WNOHANG)> 0);
-	    }
+    if (gz != NULL) {
+	int zerr = gzclose(gz);
+	if (zerr != Z_OK && !iw->failed) {
+	    iw->write_errno = (zerr == Z_ERRNO && errno)? errno : EIO;
+	    g_atomic_int_set(&iw->failed, 1);
+	}
+    }
 
-	    amfree(amandad_path);
-	    amfree(client_username);
-	    amfree(client_port);
-	    amfree(device);
-	    amfree(b64device);
-	    amfree(qdiskname);
-	    amfree(b64disk);
+    g_string_free(line, TRUE);
+    g_string_free(prev, TRUE);
 
-	    break;
+    g_atomic_int_set(&iw->done, 1);
+    dumper_wakeup();
+    return NULL;
+}
 
-	default:
-	    if(cmdargs->argc >= 1) {
-		q = quote_string(cmdargs->argv[0]);
-	    } else {
-		q = g_strdup(_("(no input?)"));
-	    }
-	    putresult(BAD_COMMAND, "%s\n", q);
-	    amfree(q);
-	    break;
-	}
+#endif /* HAVE_ZLIB */
 
-	if (outfd != -1)
-	    aclose(outfd);
-    } while(cmdargs->cmd != QUIT);
-    free_cmdargs(cmdargs);
+/*
+ * Start writing an index to FD, which is taken over by the index writer.
+ * Returns NULL, with ds->errstr set, on failure.
+ */
+static index_writer_t *
+index_writer_new(
+    dump_state_t *	ds,
+    int			fd)
+{
+    index_writer_t *iw = g_new0(index_writer_t, 1);
+
+    iw->fd = fd;
+    iw->pid = -1;
+
+#ifdef HAVE_ZLIB
+    /* amindexd uncompresses the index with UNCOMPRESS_PATH, so zlib can only
+     * stand in for gzip */
+    if (g_str_equal(COMPRESS_SUFFIX, ".gz")) {
+	iw->queue = g_async_queue_new();
+	iw->thread = g_thread_create(index_writer_thread, iw, TRUE, NULL);
+	if (!iw->thread) {
+	    g_free(ds->errstr);
+	    ds->errstr = g_strdup(_("could not start the index writer thread"));
+	    g_async_queue_unref(iw->queue);
+	    close(fd);
+	    g_free(iw);
+	    return NULL;
+	}
+	return iw;
+    }
+#endif
 
-    log_add(L_INFO, "pid-done %ld", (long)getpid());
+    if (runcompress(ds, fd, &iw->pid, COMP_BEST, "index compress") < 0) {
+	aclose(iw->fd);
+	g_free(iw);
+	return NULL;
+    }
+    return iw;
+}
 
-    am_release_feature_set(our_features);
-    amfree(our_feature_string);
-    amfree(errstr);
-    amfree(dumper_timestamp);
-    amfree(handle);
-    amfree(hostname);
-    amfree(qdiskname);
-    amfree(diskname);
-    amfree(device);
-    amfree(dumpdate);
-    amfree(progname);
-    amfree(srvcompprog);
-    amfree(clntcompprog);
-    amfree(srv_encrypt);
-    amfree(clnt_encrypt);
-    amfree(srv_decrypt_opt);
-    amfree(clnt_decrypt_opt);
-    amfree(options);
+/*
+ * Write SIZE bytes of the index.  Returns FALSE once a write has failed.
+ */
+static gboolean
+index_writer_write(
+    index_writer_t *	iw,
+    const void *	buf,
+    size_t		size)
+{
+    databuf_chunk_t *chunk;
+
+    if (iw->eof)
+	return FALSE;
+
+    if (!iw->thread)
+	return full_write(iw->fd, buf, size) == size;
+
+    if (g_atomic_int_get(&iw->failed))
+	return FALSE;
+    if (size == 0)
+	return TRUE;
+    chunk = g_malloc(sizeof(databuf_chunk_t) + size);
+    chunk->size = size;
+    memcpy(chunk->data, buf, size);
+    g_atomic_int_exchange_and_add(&iw->queued, (gint)size);
+    g_async_queue_push(iw->queue, chunk);
+    return TRUE;
+}
 
-    dbclose();
-    return (0); /* exit */
+/*
+ * Returns TRUE if so much index is queued that the reads should pause; the
+ * thread then wakes the event loop once index_writer_resumed is TRUE.
+ */
+static gboolean
+index_writer_full(
+    index_writer_t *	iw)
+{
+    if (!iw->thread || g_atomic_int_get(&iw->queued) <= INDEX_MAX_PENDING)
+	return FALSE;
+
+    g_atomic_int_set(&iw->paused, 1);
+    /* the thread may have caught up before it could see the flag */
+    if (g_atomic_int_get(&iw->queued) <= INDEX_RESUME_PENDING &&
+	g_atomic_int_compare_and_exchange(&iw->paused, 1, 0))
+	return FALSE;
+    return TRUE;
 }
 
+static gboolean
+index_writer_resumed(
+    index_writer_t *	iw)
+{
+    return !g_atomic_int_get(&iw->paused);
+}
 
 /*
- * Initialize a databuf.  Takes a writeable file descriptor.
+ * There is no more index data.
  */
 static void
-databuf_init(
-    struct databuf *	db,
-    int			fd)
+index_writer_eof(
+    index_writer_t *	iw)
 {
+    if (iw->eof)
+	return;
+    iw->eof = TRUE;
 
-    db->fd = fd;
-    db->datain = db->dataout = db->datalimit = NULL;
-    db->compresspid = -1;
-    db->encryptpid = -1;
+    if (iw->thread)
+	g_async_queue_push(iw->queue, g_new0(databuf_chunk_t, 1));
+    else
+	aclose(iw->fd);
 }
 
-
 /*
- * Updates the buffer pointer for the input data buffer.  The buffer is
- * written regardless of how much data is present, since we know we
- * are writing to a socket (to chunker) and there is no need to maintain
- * any boundaries.
+ * The index is not wanted; the thread drops the data it has not written.
  */
-static int
-databuf_write(
-    struct databuf *	db,
-    const void *	buf,
-    size_t		size)
+static void
+index_writer_discard(
+    index_writer_t *	iw)
 {
-    db->buf = (char *)buf;
-    db->datain = db->datalimit = db->buf + size;
-    db->dataout = db->buf;
-    return databuf_flush(db);
+    if (iw->thread)
+	g_atomic_int_set(&iw->discard, 1);
+    index_writer_eof(iw);
 }
 
 /*
- * Write out the buffer to chunker.
+ * Returns TRUE if index_writer_finish will not wait for the thread.  If it
+ * would, the thread wakes the event loop once it is done.
  */
-static int
-databuf_flush(
-    struct databuf *	db)
+static gboolean
+index_writer_done(
+    index_writer_t *	iw)
 {
-    size_t written;
-    char *m;
+    return !iw->thread || g_atomic_int_get(&iw->done);
+}
 
-    /*
-     * If there's no data, do nothing.
-     */
-    if (db->dataout >= db->datain) {
-	return 0;
+/*
+ * Free the writer once the index is written; with a thread, call this only
+ * once index_writer_done is TRUE.  If DISCARD, the index is not wanted, and
+ * the data not yet written is dropped.  Returns FALSE if the index could not
+ * be written.
+ */
+static gboolean
+index_writer_finish(
+    index_writer_t *	iw,
+    gboolean		discard)
+{
+    amwait_t index_status;
+    gboolean ok = TRUE;
+
+    if (iw->thread) {
+	if (discard)
+	    index_writer_discard(iw);
+	else
+	    index_writer_eof(iw);
+	g_thread_join(iw->thread);
+	g_async_queue_unref(iw->queue);
+
+	if (iw->failed) {
+	    g_debug("index write: %s", strerror(iw->write_errno));
+	    ok = FALSE;
+	} else if (!discard) {
+	    g_debug("index of %ju lines written, %s", (uintmax_t)iw->nlines,
+		    iw->sorted? "sorted" : "unsorted");
+	}
+	g_free(iw);
+	return ok;
     }
 
-    /*
-     * Write out the buffer
-     */
-    written = full_write(db->fd, db->dataout,
-			(size_t)(db->datain - db->dataout));
-    if (written > 0) {
-	db->dataout += written;
-        dumpbytes += (off_t)written;
-    }
-    if (dumpbytes >= (off_t)1024) {
-	dumpsize += (dumpbytes / (off_t)1024);
-	dumpbytes %= (off_t)1024;
+    index_writer_eof(iw);
+    if (discard) {
+	g_fprintf(stderr,_("%s: kill index command\n"),get_pname());
+	if (kill(iw->pid, SIGTERM) < 0) {
+	    if (errno != ESRCH) {
+		g_fprintf(stderr,_("%s: can't kill index command: %s\n"),
+		    get_pname(),strerror(errno));
+	    } else {
+		log_add(L_INFO, "pid-done %ld", (long)iw->pid);
+	    }
+	    iw->pid = -1;
+	}
     }
-    if (written == 0) {
-	int save_errno = errno;
-	m = g_strdup_printf(_("data write: %s"), strerror(save_errno));
-	amfree(errstr);
-	errstr = quote_string(m);
-	amfree(m);
-	errno = save_errno;
-	return -1;
+    if (iw->pid != -1) {
+	waitpid(iw->pid, &index_status, 0);
+	log_add(L_INFO, "pid-done %ld", (long)iw->pid);
+	if (!discard && (!WIFEXITED(index_status) || WEXITSTATUS(index_status) != 0))
+	    ok = FALSE;
     }
-    db->datain = db->dataout = db->buf;
-    return 0;
+    g_free(iw);
+    return ok;
 }
 
-static int dump_result;
-static int status;
 #define	GOT_INFO_ENDLINE	(1 << 0)
 #define	GOT_SIZELINE		(1 << 1)
 #define	GOT_ENDLINE		(1 << 2)
 #define	HEADER_DONE		(1 << 3)
 
-
 static void
-process_dumpeof(void)
+process_dumpeof(
+    dump_state_t *ds)
 {
     /* process any partial line in msgbuf? !!! */
-    add_msg_data(NULL, 0);
-    if(!ISSET(status, GOT_SIZELINE) && dump_result < 2) {
+    add_msg_data(ds, NULL, 0);
+    if(!ISSET(ds->status, GOT_SIZELINE) && ds->dump_result < 2) {
 	/* make a note if there isn't already a failure */
-	g_fprintf(errf,
+	g_fprintf(ds->errf,
 		_("? %s: strange [missing size line from sendbackup]\n"),
 		get_pname());
-	if(errstr == NULL) {
-	    errstr = g_strdup(_("missing size line from sendbackup"));
+	if(ds->errstr == NULL) {
+	    ds->errstr = g_strdup(_("missing size line from sendbackup"));
 	}
-	dump_result = max(dump_result, 2);
+	ds->dump_result = max(ds->dump_result, 2);
     }
 
-    if(!ISSET(status, GOT_ENDLINE) && dump_result < 2) {
-	g_fprintf(errf,
+    if(!ISSET(ds->status, GOT_ENDLINE) && ds->dump_result < 2) {
+	g_fprintf(ds->errf,
 		_("? %s: strange [missing end line from sendbackup]\n"),
 		get_pname());
-	if(errstr == NULL) {
-	    errstr = g_strdup(_("missing end line from sendbackup"));
+	if(ds->errstr == NULL) {
+	    ds->errstr = g_strdup(_("missing end line from sendbackup"));
 	}
-	dump_result = max(dump_result, 2);
+	ds->dump_result = max(ds->dump_result, 2);
     }
 }
 
@@ -800,29 +1690,30 @@ process_dumpeof(void)
  */
 static void
 parse_info_line(
+    dump_state_t *ds,
     char *str)
 {
-    static const struct {
+    const struct {
 	const char *name;
 	char *value;
 	size_t len;
     } fields[] = {
-	{ "BACKUP", file.program, sizeof(file.program) },
-	{ "APPLICATION", file.application, sizeof(file.application) },
-	{ "RECOVER_CMD", file.recover_cmd, sizeof(file.recover_cmd) },
-	{ "COMPRESS_SUFFIX", file.comp_suffix, sizeof(file.comp_suffix) },
-	{ "SERVER_CUSTOM_COMPRESS", file.srvcompprog, sizeof(file.srvcompprog) },
-	{ "CLIENT_CUSTOM_COMPRESS", file.clntcompprog, sizeof(file.clntcompprog) },
-	{ "SERVER_ENCRYPT", file.srv_encrypt, sizeof(file.srv_encrypt) },
-	{ "CLIENT_ENCRYPT", file.clnt_encrypt, sizeof(file.clnt_encrypt) },
-	{ "SERVER_DECRYPT_OPTION", file.srv_decrypt_opt, sizeof(file.srv_decrypt_opt) },
-	{ "CLIENT_DECRYPT_OPTION", file.clnt_decrypt_opt, sizeof(file.clnt_decrypt_opt) }
+	{ "BACKUP", ds->file.program, sizeof(ds->file.program) },
+	{ "APPLICATION", ds->file.application, sizeof(ds->file.application) },
+	{ "RECOVER_CMD", ds->file.recover_cmd, sizeof(ds->file.recover_cmd) },
+	{ "COMPRESS_SUFFIX", ds->file.comp_suffix, sizeof(ds->file.comp_suffix) },
+	{ "SERVER_CUSTOM_COMPRESS", ds->file.srvcompprog, sizeof(ds->file.srvcompprog) },
+	{ "CLIENT_CUSTOM_COMPRESS", ds->file.clntcompprog, sizeof(ds->file.clntcompprog) },
+	{ "SERVER_ENCRYPT", ds->file.srv_encrypt, sizeof(ds->file.srv_encrypt) },
+	{ "CLIENT_ENCRYPT", ds->file.clnt_encrypt, sizeof(ds->file.clnt_encrypt) },
+	{ "SERVER_DECRYPT_OPTION", ds->file.srv_decrypt_opt, sizeof(ds->file.srv_decrypt_opt) },
+	{ "CLIENT_DECRYPT_OPTION", ds->file.clnt_decrypt_opt, sizeof(ds->file.clnt_decrypt_opt) }
     };
     char *name, *value;
     size_t i;
 
     if (g_str_equal(str, "end")) {
-	SET(status, GOT_INFO_ENDLINE);
+	SET(ds->status, GOT_INFO_ENDLINE);
 	return;
     }
 
@@ -844,6 +1735,7 @@ parse_info_line(
 
 static void
 process_dumpline(
+    dump_state_t *	ds,
     const char *	str)
 {
     char *buf, *tok;
@@ -856,7 +1748,7 @@ process_dumpline(
 	break;
     case '?':
 	/* sendbackup detected something strange */
-	dump_result = max(dump_result, 1);
+	ds->dump_result = max(ds->dump_result, 1);
 	break;
     case 's':
 	/* a sendbackup line, just check them all since there are only 5 */
@@ -875,8 +1767,8 @@ process_dumpline(
 	if (g_str_equal(tok, "size")) {
 	    tok = strtok(NULL, "");
 	    if (tok != NULL) {
-		origsize = OFF_T_ATOI(tok);
-		SET(status, GOT_SIZELINE);
+		ds->origsize = OFF_T_ATOI(tok);
+		SET(ds->status, GOT_SIZELINE);
 	    }
 	    break;
 	}
@@ -887,32 +1779,32 @@ process_dumpline(
 	}
 
 	if (g_str_equal(tok, "end")) {
-	    SET(status, GOT_ENDLINE);
+	    SET(ds->status, GOT_ENDLINE);
 	    break;
 	}
 
 	if (g_str_equal(tok, "warning")) {
-	    dump_result = max(dump_result, 1);
+	    ds->dump_result = max(ds->dump_result, 1);
 	    break;
 	}
 
 	if (g_str_equal(tok, "error")) {
-	    SET(status, GOT_ENDLINE);
-	    dump_result = max(dump_result, 2);
+	    SET(ds->status, GOT_ENDLINE);
+	    ds->dump_result = max(ds->dump_result, 2);
 
 	    tok = strtok(NULL, "");
-	    if (!errstr) { /* report first error line */
+	    if (!ds->errstr) { /* report first error line */
 		if (tok == NULL || *tok != '[') {
-		    g_free(errstr);
-		    errstr = g_strdup_printf(_("bad remote error: %s"), str);
+		    g_free(ds->errstr);
+		    ds->errstr = g_strdup_printf(_("bad remote error: %s"), str);
 		} else {
 		    char *enderr;
 
 		    tok++;	/* skip over '[' */
 		    if ((enderr = strchr(tok, ']')) != NULL)
 			*enderr = '\0';
-		    g_free(errstr);
-		    errstr = g_strdup(tok);
+		    g_free(ds->errstr);
+		    ds->errstr = g_strdup(tok);
 		}
 	    }
 	    break;
@@ -921,32 +1813,33 @@ process_dumpline(
 	if (g_str_equal(tok, "info")) {
 	    tok = strtok(NULL, "");
 	    if (tok != NULL)
-		parse_info_line(tok);
+		parse_info_line(ds, tok);
 	    break;
 	}
 	/* else we fall through to bad line */
     default:
 bad_line:
 	/* prefix with ?? */
-	g_fprintf(errf, "??");
-	dump_result = max(dump_result, 1);
+	g_fprintf(ds->errf, "??");
+	ds->dump_result = max(ds->dump_result, 1);
 	break;
     }
-    g_fprintf(errf, "%s\n", str);
-    errf_lines++;
+    g_fprintf(ds->errf, "%s\n", str);
+    ds->errf_lines++;
     amfree(buf);
 }
 
 static void
 add_msg_data(
+    dump_state_t *	ds,
     const char *	str,
     size_t		len)
 {
     char *line, *ch;
     size_t buflen;
 
-    if (msg.buf != NULL)
-	buflen = strlen(msg.buf);
+    if (ds->msg.buf != NULL)
+	buflen = strlen(ds->msg.buf);
     else
 	buflen = 0;
 
@@ -957,18 +1850,18 @@ add_msg_data(
     if (str == NULL) {
 	if (buflen == 0)
 	    return;
-	g_fprintf(errf,_("? %s: error [partial line in msgbuf: %zu bytes]\n"),
+	g_fprintf(ds->errf,_("? %s: error [partial line in msgbuf: %zu bytes]\n"),
 	    get_pname(), buflen);
-	g_fprintf(errf,_("? %s: error [partial line in msgbuf: \"%s\"]\n"),
-	    get_pname(), msg.buf);
-	msg.buf[0] = '\0';
+	g_fprintf(ds->errf,_("? %s: error [partial line in msgbuf: \"%s\"]\n"),
+	    get_pname(), ds->msg.buf);
+	ds->msg.buf[0] = '\0';
 	return;
     }
 
     /*
      * Expand the buffer if it can't hold the new contents.
      */
-    if ((buflen + len + 1) > msg.size) {
+    if ((buflen + len + 1) > ds->msg.size) {
 	char *newbuf;
 	size_t newsize;
 
@@ -978,32 +1871,32 @@ add_msg_data(
 	newsize = ROUND(buflen + (ssize_t)len + 1, 256);
 	newbuf = g_malloc(newsize);
 
-	if (msg.buf != NULL) {
-	    strncpy(newbuf, msg.buf, newsize);
-	    amfree(msg.buf);
+	if (ds->msg.buf != NULL) {
+	    strncpy(newbuf, ds->msg.buf, newsize);
+	    amfree(ds->msg.buf);
 	} else
 	    newbuf[0] = '\0';
-	msg.buf = newbuf;
-	msg.size = newsize;
+	ds->msg.buf = newbuf;
+	ds->msg.size = newsize;
     }
 
     /*
      * If there was a partial line from the last call, then
      * append the new data to the end.
      */
-    strncat(msg.buf, str, len);
+    strncat(ds->msg.buf, str, len);
 
     /*
      * Process all lines in the buffer
      * scanning line for unqouted newline.
      */
-    for (ch = line = msg.buf; *ch != '\0'; ch++) {
+    for (ch = line = ds->msg.buf; *ch != '\0'; ch++) {
 	if (*ch == '\n') {
 	    /*
 	     * Found a newline.  Terminate and process line.
 	     */
 	    *ch = '\0';
-	    process_dumpline(line);
+	    process_dumpline(ds, line);
 	    line = ch + 1;
 	}
     }
@@ -1014,26 +1907,27 @@ add_msg_data(
      */
     if (*line != '\0') {
 	buflen = strlen(line);
-	memmove(msg.buf, line, (size_t)buflen + 1);
+	memmove(ds->msg.buf, line, (size_t)buflen + 1);
     } else {
-	msg.buf[0] = '\0';
+	ds->msg.buf[0] = '\0';
     }
 }
 
 
 static int
 log_msgout(
+    dump_state_t *ds,
     logtype_t	typ)
 {
     char *line;
     int   count = 0;
 
-    fflush(errf);
-    if (fseeko(errf, 0L, SEEK_SET) < 0) {
+    fflush(ds->errf);
+    if (fseeko(ds->errf, 0L, SEEK_SET) < 0) {
 	dbprintf(_("log_msgout: warning - seek failed: %s\n"), strerror(errno));
     }
-    while ((line = agets(errf)) != NULL) {
-	if (errf_lines >= 100 && count >= 20)
+    while ((line = agets(ds->errf)) != NULL) {
+	if (ds->errf_lines >= 100 && count >= 20)
 	    break;
 	if (line[0] != '\0') {
 		log_add(typ, "%s", line);
@@ -1043,13 +1937,14 @@ log_msgout(
     }
     amfree(line);
 
-    if (errf_lines >= 100) {
-	log_add(typ, "Look in the '%s' file for full error messages", errfname);
+    if (ds->errf_lines >= 100) {
+	log_add(typ, "Look in the '%s' file for full error messages", ds->errfname);
     }
 
-    return errf_lines < 100;
+    return ds->errf_lines < 100;
 }
 
+
 /* ------------- */
 
 /*
@@ -1057,40 +1952,41 @@ log_msgout(
  */
 static void
 finish_tapeheader(
+    dump_state_t *ds,
     dumpfile_t *file)
 {
 
-    assert(ISSET(status, HEADER_DONE));
+    assert(ISSET(ds->status, HEADER_DONE));
 
     file->type = F_DUMPFILE;
     strncpy(file->datestamp, dumper_timestamp, sizeof(file->datestamp) - 1);
-    strncpy(file->name, hostname, sizeof(file->name) - 1);
-    strncpy(file->disk, diskname, sizeof(file->disk) - 1);
-    file->dumplevel = level;
+    strncpy(file->name, ds->hostname, sizeof(file->name) - 1);
+    strncpy(file->disk, ds->diskname, sizeof(file->disk) - 1);
+    file->dumplevel = ds->level;
     file->blocksize = DISK_BLOCK_BYTES;
 
     /*
      * If we're doing the compression here, we need to override what
      * sendbackup told us the compression was.
      */
-    if (srvcompress != COMP_NONE) {
+    if (ds->srvcompress != COMP_NONE) {
 	file->compressed = 1;
 #ifndef UNCOMPRESS_OPT
 #define	UNCOMPRESS_OPT	""
 #endif
-	if (srvcompress == COMP_SERVER_CUST) {
+	if (ds->srvcompress == COMP_SERVER_CUST) {
 	    g_snprintf(file->uncompress_cmd, sizeof(file->uncompress_cmd),
-		     " %s %s |", srvcompprog, "-d");
+		     " %s %s |", ds->srvcompprog, "-d");
 	    strncpy(file->comp_suffix, "cust", sizeof(file->comp_suffix) - 1);
 	    file->comp_suffix[sizeof(file->comp_suffix) - 1] = '\0';
-	    strncpy(file->srvcompprog, srvcompprog, sizeof(file->srvcompprog) - 1);
+	    strncpy(file->srvcompprog, ds->srvcompprog, sizeof(file->srvcompprog) - 1);
 	    file->srvcompprog[sizeof(file->srvcompprog) - 1] = '\0';
-	} else if ( srvcompress == COMP_CUST ) {
+	} else if ( ds->srvcompress == COMP_CUST ) {
 	    g_snprintf(file->uncompress_cmd, sizeof(file->uncompress_cmd),
-		     " %s %s |", clntcompprog, "-d");
+		     " %s %s |", ds->clntcompprog, "-d");
 	    strncpy(file->comp_suffix, "cust", sizeof(file->comp_suffix) - 1);
 	    file->comp_suffix[sizeof(file->comp_suffix) - 1] = '\0';
-	    strncpy(file->clntcompprog, clntcompprog, sizeof(file->clntcompprog));
+	    strncpy(file->clntcompprog, ds->clntcompprog, sizeof(file->clntcompprog));
 	    file->clntcompprog[sizeof(file->clntcompprog) - 1] = '\0';
 	} else {
 	    g_snprintf(file->uncompress_cmd, sizeof(file->uncompress_cmd),
@@ -1109,40 +2005,40 @@ finish_tapeheader(
 	}
     }
     /* take care of the encryption header here */
-    if (srvencrypt != ENCRYPT_NONE) {
+    if (ds->srvencrypt != ENCRYPT_NONE) {
       file->encrypted= 1;
-      if (srvencrypt == ENCRYPT_SERV_CUST) {
-	if (srv_decrypt_opt) {
+      if (ds->srvencrypt == ENCRYPT_SERV_CUST) {
+	if (ds->srv_decrypt_opt) {
 	  g_snprintf(file->decrypt_cmd, sizeof(file->decrypt_cmd),
-		   " %s %s |", srv_encrypt, srv_decrypt_opt); 
-	  strncpy(file->srv_decrypt_opt, srv_decrypt_opt, sizeof(file->srv_decrypt_opt) - 1);
+		   " %s %s |", ds->srv_encrypt, ds->srv_decrypt_opt); 
+	  strncpy(file->srv_decrypt_opt, ds->srv_decrypt_opt, sizeof(file->srv_decrypt_opt) - 1);
 	  file->srv_decrypt_opt[sizeof(file->srv_decrypt_opt) - 1] = '\0';
 	} else {
 	  g_snprintf(file->decrypt_cmd, sizeof(file->decrypt_cmd),
-		   " %s |", srv_encrypt); 
+		   " %s |", ds->srv_encrypt); 
 	  file->srv_decrypt_opt[0] = '\0';
 	}
 	strncpy(file->encrypt_suffix, "enc", sizeof(file->encrypt_suffix) - 1);
 	file->encrypt_suffix[sizeof(file->encrypt_suffix) - 1] = '\0';
-	strncpy(file->srv_encrypt, srv_encrypt, sizeof(file->srv_encrypt) - 1);
+	strncpy(file->srv_encrypt, ds->srv_encrypt, sizeof(file->srv_encrypt) - 1);
 	file->srv_encrypt[sizeof(file->srv_encrypt) - 1] = '\0';
-      } else if ( srvencrypt == ENCRYPT_CUST ) {
-	if (clnt_decrypt_opt) {
+      } else if ( ds->srvencrypt == ENCRYPT_CUST ) {
+	if (ds->clnt_decrypt_opt) {
 	  g_snprintf(file->decrypt_cmd, sizeof(file->decrypt_cmd),
-		   " %s %s |", clnt_encrypt, clnt_decrypt_opt);
-	  strncpy(file->clnt_decrypt_opt, clnt_decrypt_opt,
+		   " %s %s |", ds->clnt_encrypt, ds->clnt_decrypt_opt);
+	  strncpy(file->clnt_decrypt_opt, ds->clnt_decrypt_opt,
 		  sizeof(file->clnt_decrypt_opt));
 	  file->clnt_decrypt_opt[sizeof(file->clnt_decrypt_opt) - 1] = '\0';
 	} else {
 	  g_snprintf(file->decrypt_cmd, sizeof(file->decrypt_cmd),
-		   " %s |", clnt_encrypt);
+		   " %s |", ds->clnt_encrypt);
 	  file->clnt_decrypt_opt[0] = '\0';
  	}
 	g_snprintf(file->decrypt_cmd, sizeof(file->decrypt_cmd),
-		 " %s %s |", clnt_encrypt, clnt_decrypt_opt);
+		 " %s %s |", ds->clnt_encrypt, ds->clnt_decrypt_opt);
 	strncpy(file->encrypt_suffix, "enc", sizeof(file->encrypt_suffix) - 1);
 	file->encrypt_suffix[sizeof(file->encrypt_suffix) - 1] = '\0';
-	strncpy(file->clnt_encrypt, clnt_encrypt, sizeof(file->clnt_encrypt) - 1);
+	strncpy(file->clnt_encrypt, ds->clnt_encrypt, sizeof(file->clnt_encrypt) - 1);
 	file->clnt_encrypt[sizeof(file->clnt_encrypt) - 1] = '\0';
       }
     } else {
@@ -1155,8 +2051,8 @@ finish_tapeheader(
 	file->encrypted= 1;
       }
     }
-    if (dle_str)
-	file->dle_str = g_strdup(dle_str);
+    if (ds->dle_str)
+	file->dle_str = g_strdup(ds->dle_str);
     else
 	file->dle_str = NULL;
 }
@@ -1186,153 +2082,166 @@ write_tapeheader(
     return -1;
 }
 
-int indexout = -1;
-
-static int
+/*
+ * Start reading the streams of a dump whose request was accepted.  The rest
+ * happens in the stream callbacks, and then in finish_dump.
+ */
+static void
 do_dump(
-    struct databuf *db)
+    dump_state_t *ds)
 {
-    char *indexfile_tmp = NULL;
-    char *indexfile_real = NULL;
     char level_str[NUM_STR_SIZE];
     char *time_str;
     char *fn;
-    char *q;
-    times_t runtime;
-    double dumptime;	/* Time dump took in secs */
-    pid_t indexpid = -1;
-    char *m;
-    int to_unlink = 1;
+    int indexfd;
 
-    startclock();
+    g_get_current_time(&ds->start_time);
 
-    if (msg.buf) msg.buf[0] = '\0';	/* reset msg buffer */
-    status = 0;
-    dump_result = 0;
-    dumpbytes = dumpsize = headersize = origsize = (off_t)0;
-    fh_init(&file);
+    ds->status = 0;
+    ds->dump_result = 0;
+    ds->dumpbytes = ds->dumpsize = ds->headersize = ds->origsize = (off_t)0;
+    fh_init(&ds->file);
 
-    g_snprintf(level_str, sizeof(level_str), "%d", level);
+    g_snprintf(level_str, sizeof(level_str), "%d", ds->level);
     time_str = get_timestamp_from_time(0);
-    fn = sanitise_filename(diskname);
-    errf_lines = 0;
+    fn = sanitise_filename(ds->diskname);
+    ds->errf_lines = 0;
 
-    g_free(errfname);
-    errfname = g_strconcat(AMANDA_DBGDIR, "/log.error", NULL);
+    g_free(ds->errfname);
+    ds->errfname = g_strconcat(AMANDA_DBGDIR, "/log.error", NULL);
 
-    mkdir(errfname, 0700);
+    mkdir(ds->errfname, 0700);
 
-    g_free(errfname);
-    errfname = g_strconcat(AMANDA_DBGDIR, "/log.error/", hostname, ".", fn, ".",
+    g_free(ds->errfname);
+    ds->errfname = g_strconcat(AMANDA_DBGDIR, "/log.error/", ds->hostname, ".", fn, ".",
         level_str, ".", time_str, ".errout", NULL);
 
     amfree(fn);
     amfree(time_str);
-    if((errf = fopen(errfname, "w+")) == NULL) {
-	g_free(errstr);
-	errstr = g_strdup_printf("errfile open \"%s\": %s",
-                                 errfname, strerror(errno));
-	amfree(errfname);
-	goto failed;
-    }
-
-    if (streams[INDEXFD].fd != NULL) {
-	indexfile_real = getindexfname(hostname, diskname, dumper_timestamp, level);
-	indexfile_tmp = g_strconcat(indexfile_real, ".tmp", NULL);
-
-	if (mkpdir(indexfile_tmp, 0755, (uid_t)-1, (gid_t)-1) == -1) {
-            g_free(errstr);
-            errstr = g_strdup_printf(_("err create %s: %s"),
-                                     indexfile_tmp, strerror(errno));
-            amfree(indexfile_real);
-            amfree(indexfile_tmp);
-            goto failed;
-	}
-	indexout = open(indexfile_tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
-	if (indexout == -1) {
-	    g_free(errstr);
-	    errstr = g_strdup_printf(_("err open %s: %s"),
-                                     indexfile_tmp, strerror(errno));
-	    goto failed;
-	} else {
-	    if (runcompress(indexout, &indexpid, COMP_BEST, "index compress") < 0) {
-		aclose(indexout);
-		goto failed;
-	    }
+    if((ds->errf = fopen(ds->errfname, "w+")) == NULL) {
+	g_free(ds->errstr);
+	ds->errstr = g_strdup_printf("errfile open \"%s\": %s",
+                                 ds->errfname, strerror(errno));
+	amfree(ds->errfname);
+	stop_dump(ds);
+	return;
+    }
+
+    if (ds->streams[INDEXFD] != NULL) {
+	ds->indexfile_real = getindexfname(ds->hostname, ds->diskname, dumper_timestamp, ds->level);
+	ds->indexfile_tmp = g_strconcat(ds->indexfile_real, ".tmp", NULL);
+
+	if (mkpdir(ds->indexfile_tmp, 0755, (uid_t)-1, (gid_t)-1) == -1) {
+            g_free(ds->errstr);
+            ds->errstr = g_strdup_printf(_("err create %s: %s"),
+                                     ds->indexfile_tmp, strerror(errno));
+            amfree(ds->indexfile_real);
+            amfree(ds->indexfile_tmp);
+	    stop_dump(ds);
+	    return;
+	}
+	indexfd = open(ds->indexfile_tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (indexfd == -1) {
+	    g_free(ds->errstr);
+	    ds->errstr = g_strdup_printf(_("err open %s: %s"),
+                                     ds->indexfile_tmp, strerror(errno));
+	    stop_dump(ds);
+	    return;
+	}
+	ds->index = index_writer_new(ds, indexfd);
+	if (ds->index == NULL) {
+	    stop_dump(ds);
+	    return;
 	}
-	indexfderror = 0;
+	ds->indexfderror = 0;
 	/*
 	 * Schedule the indexfd for relaying to the index file
 	 */
-	security_stream_read(streams[INDEXFD].fd, read_indexfd, &indexout);
+	security_stream_read(ds->streams[INDEXFD], read_indexfd, ds);
     }
 
     /*
      * We only need to process messages initially.  Once we have done
      * the header, we will start processing data too.
      */
-    security_stream_read(streams[MESGFD].fd, read_mesgfd, db);
-    set_datafd = 0;
+    security_stream_read(ds->streams[MESGFD], read_mesgfd, ds);
+    ds->set_datafd = 0;
+    ds->running = TRUE;
 
     /*
      * Setup a read timeout
      */
-    timeout(conf_dtimeout);
+    timeout(ds, conf_dtimeout);
+}
 
-    /*
-     * Start the event loop.  This will exit when all three events
-     * (read the mesgfd, read the datafd, and timeout) are removed.
-     */
-    event_loop(0);
+/*
+ * Report the result of a dump once all its streams (read the mesgfd, read
+ * the datafd, and timeout) and filters are done, then free it.
+ */
+static void
+finish_dump(
+    dump_state_t *ds)
+{
+    struct databuf *db = &ds->db;
+    char *q;
+    times_t runtime;
+    GTimeVal now;
+    double dumptime;	/* Time dump took in secs */
+    char *m;
+    int to_unlink = 1;
+    int save_errno;
 
-    if (!ISSET(status, HEADER_DONE)) {
-	dump_result = max(dump_result, 2);
-	if (!errstr) errstr = g_strdup(_("got no header information"));
+    /* maybe_finish_dump waited for the writer thread, so the sizes are
+     * final */
+    if ((save_errno = databuf_error(ds)) != 0) {
+	ds->dump_result = max(ds->dump_result, 2);
+	if (!ds->errstr)
+	    ds->errstr = g_strdup_printf(_("data write: %s"), strerror(save_errno));
     }
-
-    dumpsize -= headersize;		/* don't count the header */
-    if (dumpsize <= (off_t)0 && data_path == DATA_PATH_AMANDA) {
-	dumpsize = (off_t)0;
-	dump_result = max(dump_result, 2);
-	if (!errstr) errstr = g_strdup(_("got no data"));
+    if (ds->data_eof && ds->dumpbytes != (off_t)0) {
+	ds->dumpsize += (off_t)1;
     }
 
-    if (data_path == DATA_PATH_DIRECTTCP) {
-	dumpsize = origsize;
+    if (!ISSET(ds->status, HEADER_DONE)) {
+	ds->dump_result = max(ds->dump_result, 2);
+	if (!ds->errstr) ds->errstr = g_strdup(_("got no header information"));
     }
 
-    if (!ISSET(status, HEADER_DONE)) {
-	dump_result = max(dump_result, 2);
-	if (!errstr) errstr = g_strdup(_("got no header information"));
+    ds->dumpsize -= ds->headersize;		/* don't count the header */
+    if (ds->dumpsize <= (off_t)0 && ds->data_path == DATA_PATH_AMANDA) {
+	ds->dumpsize = (off_t)0;
+	ds->dump_result = max(ds->dump_result, 2);
+	if (!ds->errstr) ds->errstr = g_strdup(_("got no data"));
     }
 
-    if (dumpsize == 0 && data_path == DATA_PATH_AMANDA) {
-	dump_result = max(dump_result, 2);
-	if (!errstr) errstr = g_strdup(_("got no data"));
+    if (ds->data_path == DATA_PATH_DIRECTTCP) {
+	ds->dumpsize = ds->origsize;
     }
 
-    if (indexfile_tmp) {
-	amwait_t index_status;
-
-	/*@i@*/ aclose(indexout);
-	waitpid(indexpid,&index_status,0);
-	log_add(L_INFO, "pid-done %ld", (long)indexpid);
-	if (rename(indexfile_tmp, indexfile_real) != 0) {
+    if (ds->indexfile_tmp) {
+	if (ds->index) {
+	    if (!index_writer_finish(ds->index, FALSE) && ds->indexfderror == 0) {
+		ds->indexfderror = 1;
+		log_add(L_INFO, _("Index corrupted for %s:%s"), ds->hostname, ds->qdiskname);
+	    }
+	    ds->index = NULL;
+	}
+	if (rename(ds->indexfile_tmp, ds->indexfile_real) != 0) {
 	    log_add(L_WARNING, _("could not rename \"%s\" to \"%s\": %s"),
-		    indexfile_tmp, indexfile_real, strerror(errno));
+		    ds->indexfile_tmp, ds->indexfile_real, strerror(errno));
 	}
-	amfree(indexfile_tmp);
-	amfree(indexfile_real);
+	amfree(ds->indexfile_tmp);
+	amfree(ds->indexfile_real);
     }
 
     /* copy the header in a file on the index dir */
     {
 	FILE *a;
 	char *s;
-	char *f = getheaderfname(hostname, diskname, dumper_timestamp, level);
+	char *f = getheaderfname(ds->hostname, ds->diskname, dumper_timestamp, ds->level);
 	a = fopen(f,"w");
 	if (a) {
-	    s = build_header(&file, NULL, DISK_BLOCK_BYTES);
+	    s = build_header(&ds->file, NULL, DISK_BLOCK_BYTES);
 	    fprintf(a,"%s", s);
 	    g_free(s);
 	    fclose(a);
@@ -1340,11 +2249,12 @@ do_dump(
 	g_free(f);
     }
 
-    if (db->compresspid != -1 && dump_result < 2) {
+    if (db->compresspid != -1 && ds->dump_result < 2) {
 	amwait_t  wait_status;
 	char *errmsg = NULL;
 
-	waitpid(db->compresspid, &wait_status, 0);
+	/* maybe_finish_dump waited for it */
+	wait_status = db->compress_status;
 	if (WIFSIGNALED(wait_status)) {
 	    errmsg = g_strdup_printf(_("%s terminated with signal %d"),
 				     "compress", WTERMSIG(wait_status));
@@ -1358,11 +2268,11 @@ do_dump(
 				     "compress");
 	}
 	if (errmsg) {
-	    g_fprintf(errf, _("? %s\n"), errmsg);
+	    g_fprintf(ds->errf, _("? %s\n"), errmsg);
 	    g_debug("%s", errmsg);
-	    dump_result = max(dump_result, 2);
-	    if (!errstr)
-		errstr = errmsg;
+	    ds->dump_result = max(ds->dump_result, 2);
+	    if (!ds->errstr)
+		ds->errstr = errmsg;
 	    else
 		g_free(errmsg);
 	}
@@ -1370,11 +2280,11 @@ do_dump(
 	db->compresspid = -1;
     }
 
-    if (db->encryptpid != -1 && dump_result < 2) {
+    if (db->encryptpid != -1 && ds->dump_result < 2) {
 	amwait_t  wait_status;
 	char *errmsg = NULL;
 
-	waitpid(db->encryptpid, &wait_status, 0);
+	wait_status = db->encrypt_status;
 	if (WIFSIGNALED(wait_status)) {
 	    errmsg = g_strdup_printf(_("%s terminated with signal %d"),
 				     "encrypt", WTERMSIG(wait_status));
@@ -1388,11 +2298,11 @@ do_dump(
 				     "encrypt");
 	}
 	if (errmsg) {
-	    g_fprintf(errf, _("? %s\n"), errmsg);
+	    g_fprintf(ds->errf, _("? %s\n"), errmsg);
 	    g_debug("%s", errmsg);
-	    dump_result = max(dump_result, 2);
-	    if (!errstr)
-		errstr = errmsg;
+	    ds->dump_result = max(ds->dump_result, 2);
+	    if (!ds->errstr)
+		ds->errstr = errmsg;
 	    else
 		g_free(errmsg);
 	}
@@ -1400,73 +2310,97 @@ do_dump(
 	db->encryptpid  = -1;
     }
 
-    if (dump_result > 1)
-	goto failed;
+    if (ds->dump_result > 1) {
+	dump_failed(ds);
+	dump_state_free(ds);
+	return;
+    }
 
-    runtime = stopclock();
+    g_get_current_time(&now);
+    runtime = timesub(now, ds->start_time);
     dumptime = g_timeval_to_double(runtime);
 
-    amfree(errstr);
-    errstr = g_malloc(128);
-    g_snprintf(errstr, 128, _("sec %s kb %lld kps %3.1lf orig-kb %lld"),
+    amfree(ds->errstr);
+    ds->errstr = g_malloc(128);
+    g_snprintf(ds->errstr, 128, _("sec %s kb %lld kps %3.1lf orig-kb %lld"),
 	walltime_str(runtime),
-	(long long)dumpsize,
-	(isnormal(dumptime) ? ((double)dumpsize / (double)dumptime) : 0.0),
-	(long long)origsize);
-    m = g_strdup_printf("[%s]", errstr);
+	(long long)ds->dumpsize,
+	(isnormal(dumptime) ? ((double)ds->dumpsize / (double)dumptime) : 0.0),
+	(long long)ds->origsize);
+    m = g_strdup_printf("[%s]", ds->errstr);
     q = quote_string(m);
     amfree(m);
-    putresult(DONE, _("%s %lld %lld %lu %s\n"), handle,
-		(long long)origsize,
-		(long long)dumpsize,
+    putresult(DONE, _("%s %lld %lld %lu %s\n"), ds->handle,
+		(long long)ds->origsize,
+		(long long)ds->dumpsize,
 	        (unsigned long)((double)dumptime+0.5), q);
     amfree(q);
 
-    switch(dump_result) {
+    switch(ds->dump_result) {
     case 0:
-	log_add(L_SUCCESS, "%s %s %s %d [%s]", hostname, qdiskname, dumper_timestamp, level, errstr);
+	log_add(L_SUCCESS, "%s %s %s %d [%s]", ds->hostname, ds->qdiskname, dumper_timestamp, ds->level, ds->errstr);
 
 	break;
 
     case 1:
 	log_start_multiline();
-	log_add(L_STRANGE, "%s %s %d [%s]", hostname, qdiskname, level, errstr);
-	to_unlink = log_msgout(L_STRANGE);
+	log_add(L_STRANGE, "%s %s %d [%s]", ds->hostname, ds->qdiskname, ds->level, ds->errstr);
+	to_unlink = log_msgout(ds, L_STRANGE);
 	log_end_multiline();
 
 	break;
     }
 
-    if (errf)
-	afclose(errf);
-    if (errfname) {
+    if (ds->errf)
+	afclose(ds->errf);
+    if (ds->errfname) {
 	if (to_unlink)
-	    unlink(errfname);
-	amfree(errfname);
+	    unlink(ds->errfname);
+	amfree(ds->errfname);
     }
 
-    if (data_path == DATA_PATH_AMANDA)
-	aclose(db->fd);
+    if (ds->data_path == DATA_PATH_AMANDA)
+	databuf_close(ds, FALSE);
 
-    amfree(errstr);
-    dumpfile_free_data(&file);
+    dumpfile_free_data(&ds->file);
+    dump_state_free(ds);
+}
 
-    return 1;
+/*
+ * Report a failed dump and clean up after it; the caller frees DS.
+ */
+static void
+dump_failed(
+    dump_state_t *ds)
+{
+    struct databuf *db = &ds->db;
+    char *q;
+    char *m;
+    int to_unlink = 1;
 
-failed:
-    m = g_strdup_printf("[%s]", errstr);
+    m = g_strdup_printf("[%s]", ds->errstr);
     q = quote_string(m);
-    putresult(FAILED, "%s %s\n", handle, q);
+    putresult(FAILED, "%s %s\n", ds->handle, q);
     amfree(q);
     amfree(m);
 
-    aclose(db->fd);
-    /* kill all child process */
-    if (db->compresspid != -1) {
+    databuf_close(ds, TRUE);
+    /* kill all child process, unless a child watch has reaped them */
+    if (db->compress_watch) {
+	g_source_destroy(db->compress_watch);
+	db->compress_watch = NULL;
+    }
+    if (db->encrypt_watch) {
+	g_source_destroy(db->encrypt_watch);
+	db->encrypt_watch = NULL;
+    }
+    if (db->compresspid != -1 && db->compress_exited) {
+	log_add(L_INFO, "pid-done %ld", (long)db->compresspid);
+    } else if (db->compresspid != -1) {
 	g_fprintf(stderr,_("%s: kill compress command\n"),get_pname());
 	if (kill(db->compresspid, SIGTERM) < 0) {
 	    if (errno != ESRCH) {
-		g_fprintf(stderr,_("%s: can't kill compress command: %s\n"), 
+		g_fprintf(stderr,_("%s: can't kill compress command: %s\n"),
 		    get_pname(), strerror(errno));
 	    } else {
 		log_add(L_INFO, "pid-done %ld", (long)db->compresspid);
@@ -1478,11 +2412,13 @@ failed:
 	}
     }
 
-    if (db->encryptpid != -1) {
+    if (db->encryptpid != -1 && db->encrypt_exited) {
+	log_add(L_INFO, "pid-done %ld", (long)db->encryptpid);
+    } else if (db->encryptpid != -1) {
 	g_fprintf(stderr,_("%s: kill encrypt command\n"),get_pname());
 	if (kill(db->encryptpid, SIGTERM) < 0) {
 	    if (errno != ESRCH) {
-		g_fprintf(stderr,_("%s: can't kill encrypt command: %s\n"), 
+		g_fprintf(stderr,_("%s: can't kill encrypt command: %s\n"),
 		    get_pname(), strerror(errno));
 	    } else {
 		log_add(L_INFO, "pid-done %ld", (long)db->encryptpid);
@@ -1494,48 +2430,34 @@ failed:
 	}
     }
 
-    if (indexpid != -1) {
-	g_fprintf(stderr,_("%s: kill index command\n"),get_pname());
-	if (kill(indexpid, SIGTERM) < 0) {
-	    if (errno != ESRCH) {
-		g_fprintf(stderr,_("%s: can't kill index command: %s\n"), 
-		    get_pname(),strerror(errno));
-	    } else {
-		log_add(L_INFO, "pid-done %ld", (long)indexpid);
-	    }
-	}
-	else {
-	    waitpid(indexpid,NULL,0);
-	    log_add(L_INFO, "pid-done %ld", (long)indexpid);
-	}
+    if (ds->index) {
+	index_writer_finish(ds->index, TRUE);
+	ds->index = NULL;
     }
 
     log_start_multiline();
-    log_add(L_FAIL, _("%s %s %s %d [%s]"), hostname, qdiskname, dumper_timestamp,
-	    level, errstr);
-    if (errf) {
-	to_unlink = log_msgout(L_FAIL);
+    log_add(L_FAIL, _("%s %s %s %d [%s]"), ds->hostname, ds->qdiskname, dumper_timestamp,
+	    ds->level, ds->errstr);
+    if (ds->errf) {
+	to_unlink = log_msgout(ds, L_FAIL);
     }
     log_end_multiline();
 
-    if (errf)
-	afclose(errf);
-    if (errfname) {
+    if (ds->errf)
+	afclose(ds->errf);
+    if (ds->errfname) {
 	if (to_unlink)
-	    unlink(errfname);
-	amfree(errfname);
+	    unlink(ds->errfname);
+	amfree(ds->errfname);
     }
 
-    if (indexfile_tmp) {
-	unlink(indexfile_tmp);
-	amfree(indexfile_tmp);
-	amfree(indexfile_real);
+    if (ds->indexfile_tmp) {
+	unlink(ds->indexfile_tmp);
+	amfree(ds->indexfile_tmp);
+	amfree(ds->indexfile_real);
     }
 
-    amfree(errstr);
-    dumpfile_free_data(&file);
-
-    return 0;
+    dumpfile_free_data(&ds->file);
 }
 
 /*
@@ -1547,95 +2469,98 @@ read_mesgfd(
     void *	buf,
     ssize_t	size)
 {
-    struct databuf *db = cookie;
+    dump_state_t *ds = cookie;
+    struct databuf *db;
 
-    assert(db != NULL);
+    assert(ds != NULL);
+    db = &ds->db;
 
     switch (size) {
     case -1:
-	g_free(errstr);
-	errstr = g_strdup_printf(_("mesg read: %s"),
-                                 security_stream_geterror(streams[MESGFD].fd));
-	dump_result = 2;
-	stop_dump();
+	g_free(ds->errstr);
+	ds->errstr = g_strdup_printf(_("mesg read: %s"),
+                                 security_stream_geterror(ds->streams[MESGFD]));
+	ds->dump_result = 2;
+	stop_dump(ds);
 	return;
 
     case 0:
 	/*
 	 * EOF.  Just shut down the mesg stream.
 	 */
-	process_dumpeof();
-	security_stream_close(streams[MESGFD].fd);
-	streams[MESGFD].fd = NULL;
+	process_dumpeof(ds);
+	security_stream_close(ds->streams[MESGFD]);
+	ds->streams[MESGFD] = NULL;
 	/*
 	 * If the data fd and index fd has also shut down, then we're done.
 	 */
-	if ((set_datafd == 0 || streams[DATAFD].fd == NULL) && 
-	    streams[INDEXFD].fd == NULL)
-	    stop_dump();
+	if ((ds->set_datafd == 0 || ds->streams[DATAFD] == NULL) && 
+	    ds->streams[INDEXFD] == NULL)
+	    stop_dump(ds);
 	return;
 
     default:
 	assert(buf != NULL);
-	add_msg_data(buf, (size_t)size);
-	security_stream_read(streams[MESGFD].fd, read_mesgfd, cookie);
+	add_msg_data(ds, buf, (size_t)size);
+	if (!ds->paused)
+	    security_stream_read(ds->streams[MESGFD], read_mesgfd, cookie);
 	break;
     }
 
-    if (ISSET(status, GOT_INFO_ENDLINE) && !ISSET(status, HEADER_DONE)) {
+    if (ISSET(ds->status, GOT_INFO_ENDLINE) && !ISSET(ds->status, HEADER_DONE)) {
 	/* Use the first in the dataport_list */
 	in_port_t data_port;
-	char *data_host = dataport_list;
+	char *data_host = ds->dataport_list;
 	char *s;
 
-	s = strchr(dataport_list, ',');
+	s = strchr(ds->dataport_list, ',');
 	if (s) *s = '\0';  /* use first data_port */
-	s = strrchr(dataport_list, ':');
+	s = strrchr(ds->dataport_list, ':');
 	if (!s) {
-	    g_free(errstr);
-	    errstr = g_strdup("write_tapeheader: no dataport_list");
-	    dump_result = 2;
-	    stop_dump();
+	    g_free(ds->errstr);
+	    ds->errstr = g_strdup("write_tapeheader: no dataport_list");
+	    ds->dump_result = 2;
+	    stop_dump(ds);
 	    return;
 	}
 	*s = '\0';
 	s++;
 	data_port = atoi(s);
 
-	SET(status, HEADER_DONE);
+	SET(ds->status, HEADER_DONE);
 	/* time to do the header */
-	finish_tapeheader(&file);
-	if (write_tapeheader(db->fd, &file)) {
-	    g_free(errstr);
-	    errstr = g_strdup_printf(_("write_tapeheader: %s"),
+	finish_tapeheader(ds, &ds->file);
+	if (write_tapeheader(db->fd, &ds->file)) {
+	    g_free(ds->errstr);
+	    ds->errstr = g_strdup_printf(_("write_tapeheader: %s"),
                                      strerror(errno));
-	    dump_result = 2;
-	    stop_dump();
+	    ds->dump_result = 2;
+	    stop_dump(ds);
 	    return;
 	}
 	aclose(db->fd);
-	if (data_path == DATA_PATH_AMANDA) {
+	if (ds->data_path == DATA_PATH_AMANDA) {
 	    g_debug(_("Sending data to %s:%d\n"), data_host, data_port);
 	    db->fd = stream_client(data_host, data_port,
 				   STREAM_BUFSIZE, 0, NULL, 0);
 	    if (db->fd == -1) {
-                g_free(errstr);
-                errstr = g_strdup_printf(_("Can't open data output stream: %s"),
+                g_free(ds->errstr);
+                ds->errstr = g_strdup_printf(_("Can't open data output stream: %s"),
                                          strerror(errno));
-		dump_result = 2;
-		stop_dump();
+		ds->dump_result = 2;
+		stop_dump(ds);
 		return;
 	    }
 	}
 
-	dumpsize += (off_t)DISK_BLOCK_KB;
-	headersize += (off_t)DISK_BLOCK_KB;
+	ds->dumpsize += (off_t)DISK_BLOCK_KB;
+	ds->headersize += (off_t)DISK_BLOCK_KB;
 
-	if (srvencrypt == ENCRYPT_SERV_CUST) {
-	    if (runencrypt(db->fd, &db->encryptpid, srvencrypt) < 0) {
-		dump_result = 2;
+	if (ds->srvencrypt == ENCRYPT_SERV_CUST) {
+	    if (runencrypt(ds, db->fd, &db->encryptpid, ds->srvencrypt) < 0) {
+		ds->dump_result = 2;
 		aclose(db->fd);
-		stop_dump();
+		stop_dump(ds);
 		return;
 	    }
 	}
@@ -1643,22 +2568,23 @@ read_mesgfd(
 	 * Now, setup the compress for the data output, and start
 	 * reading the datafd.
 	 */
-	if ((srvcompress != COMP_NONE) && (srvcompress != COMP_CUST)) {
-	    if (runcompress(db->fd, &db->compresspid, srvcompress, "data compress") < 0) {
-		dump_result = 2;
+	if ((ds->srvcompress != COMP_NONE) && (ds->srvcompress != COMP_CUST)) {
+	    if (runcompress(ds, db->fd, &db->compresspid, ds->srvcompress, "data compress") < 0) {
+		ds->dump_result = 2;
 		aclose(db->fd);
-		stop_dump();
+		stop_dump(ds);
 		return;
 	    }
 	}
-	security_stream_read(streams[DATAFD].fd, read_datafd, db);
-	set_datafd = 1;
+	if (!ds->paused)
+	    security_stream_read(ds->streams[DATAFD], read_datafd, ds);
+	ds->set_datafd = 1;
     }
 
     /*
      * Reset the timeout for future reads
      */
-    timeout(conf_dtimeout);
+    timeout(ds, conf_dtimeout);
 }
 
 /*
@@ -1670,42 +2596,42 @@ read_datafd(
     void *	buf,
     ssize_t	size)
 {
-    struct databuf *db = cookie;
+    dump_state_t *ds = cookie;
+    int rval;
 
-    assert(db != NULL);
+    assert(ds != NULL);
 
     /*
      * The read failed.  Error out
      */
     if (size < 0) {
-	g_free(errstr);
-	errstr = g_strdup_printf(_("data read: %s"),
-                                 security_stream_geterror(streams[DATAFD].fd));
-	dump_result = 2;
-	aclose(db->fd);
-	stop_dump();
+	g_free(ds->errstr);
+	ds->errstr = g_strdup_printf(_("data read: %s"),
+                                 security_stream_geterror(ds->streams[DATAFD]));
+	ds->dump_result = 2;
+	databuf_close(ds, TRUE);
+	stop_dump(ds);
 	return;
     }
 
     /* The header had better be written at this point */
-    assert(ISSET(status, HEADER_DONE));
+    assert(ISSET(ds->status, HEADER_DONE));
 
     /*
      * EOF.  Stop and return.
      */
     if (size == 0) {
-	databuf_flush(db);
-	if (dumpbytes != (off_t)0) {
-	    dumpsize += (off_t)1;
-	}
-	security_stream_close(streams[DATAFD].fd);
-	streams[DATAFD].fd = NULL;
-	aclose(db->fd);
+	/* finish_dump counts the last partial kilobyte, once the writer
+	 * thread is done with the data */
+	ds->data_eof = TRUE;
+	security_stream_close(ds->streams[DATAFD]);
+	ds->streams[DATAFD] = NULL;
+	databuf_close(ds, FALSE);
 	/*
 	 * If the mesg fd and index fd has also shut down, then we're done.
 	 */
-	if (streams[MESGFD].fd == NULL && streams[INDEXFD].fd == NULL)
-	    stop_dump();
+	if (ds->streams[MESGFD] == NULL && ds->streams[INDEXFD] == NULL)
+	    stop_dump(ds);
 	return;
     }
 
@@ -1714,21 +2640,29 @@ read_datafd(
      * more data.
      */
     assert(buf != NULL);
-    if (databuf_write(db, buf, (size_t)size) < 0) {
+    rval = databuf_write(ds, buf, (size_t)size);
+    if (rval < 0) {
 	int save_errno = errno;
-	g_free(errstr);
-	errstr = g_strdup_printf(_("data write: %s"), strerror(save_errno));
-	dump_result = 2;
-	stop_dump();
+	g_free(ds->errstr);
+	ds->errstr = g_strdup_printf(_("data write: %s"), strerror(save_errno));
+	ds->dump_result = 2;
+	stop_dump(ds);
 	return;
     }
 
     /*
      * Reset the timeout for future reads
      */
-    timeout(conf_dtimeout);
+    timeout(ds, conf_dtimeout);
+
+    /* with too much queued for the writer thread, wait for it to catch up;
+     * the other dumps go on */
+    if (rval > 0) {
+	pause_reads(ds, PAUSE_DATA);
+	return;
+    }
 
-    security_stream_read(streams[DATAFD].fd, read_datafd, cookie);
+    security_stream_read(ds->streams[DATAFD], read_datafd, cookie);
 }
 
 /*
@@ -1740,17 +2674,16 @@ read_indexfd(
     void *	buf,
     ssize_t	size)
 {
-    int fd;
+    dump_state_t *ds = cookie;
 
-    assert(cookie != NULL);
-    fd = *(int *)cookie;
+    assert(ds != NULL);
 
     if (size < 0) {
-	g_free(errstr);
-	errstr = g_strdup_printf(_("index read: %s"),
-                                 security_stream_geterror(streams[INDEXFD].fd));
-	dump_result = 2;
-	stop_dump();
+	g_free(ds->errstr);
+	ds->errstr = g_strdup_printf(_("index read: %s"),
+                                 security_stream_geterror(ds->streams[INDEXFD]));
+	ds->dump_result = 2;
+	stop_dump(ds);
 	return;
     }
 
@@ -1758,15 +2691,15 @@ read_indexfd(
      * EOF.  Stop and return.
      */
     if (size == 0) {
-	security_stream_close(streams[INDEXFD].fd);
-	streams[INDEXFD].fd = NULL;
+	security_stream_close(ds->streams[INDEXFD]);
+	ds->streams[INDEXFD] = NULL;
+	index_writer_eof(ds->index);
 	/*
 	 * If the mesg fd has also shut down, then we're done.
 	 */
-	if ((set_datafd == 0 || streams[DATAFD].fd == NULL) &&
-	     streams[MESGFD].fd == NULL)
-	    stop_dump();
-	aclose(indexout);
+	if ((ds->set_datafd == 0 || ds->streams[DATAFD] == NULL) &&
+	     ds->streams[MESGFD] == NULL)
+	    stop_dump(ds);
 	return;
     }
 
@@ -1775,14 +2708,22 @@ read_indexfd(
     /*
      * We ignore error while writing to the index file.
      */
-    if (full_write(fd, buf, (size_t)size) < (size_t)size) {
+    if (!index_writer_write(ds->index, buf, (size_t)size)) {
 	/* Ignore error, but schedule another read. */
-	if(indexfderror == 0) {
-	    indexfderror = 1;
-	    log_add(L_INFO, _("Index corrupted for %s:%s"), hostname, qdiskname);
+	if(ds->indexfderror == 0) {
+	    ds->indexfderror = 1;
+	    log_add(L_INFO, _("Index corrupted for %s:%s"), ds->hostname, ds->qdiskname);
 	}
     }
-    security_stream_read(streams[INDEXFD].fd, read_indexfd, cookie);
+
+    /* with too much queued for the index writer thread, wait for it to
+     * catch up */
+    if (index_writer_full(ds->index)) {
+	pause_reads(ds, PAUSE_INDEX);
+	return;
+    }
+    if (!ds->paused)
+	security_stream_read(ds->streams[INDEXFD], read_indexfd, cookie);
 }
 
 static void
@@ -1790,6 +2731,7 @@ handle_filter_stderr(
     void *cookie)
 {
     filter_t *filter = cookie;
+    dump_state_t *ds = filter->ds;
     ssize_t   nread;
     char     *b, *p;
     gint64    len;
@@ -1834,20 +2776,22 @@ handle_filter_stderr(
     while (b < filter->buffer + filter->first + filter->size &&
 	   (p = strchr(b, '\n')) != NULL) {
 	*p = '\0';
-	g_fprintf(errf, _("? %s: %s\n"), filter->name, b);
-	if (errstr == NULL) {
-	    errstr = g_strdup(b);
+	g_fprintf(ds->errf, _("? %s: %s\n"), filter->name, b);
+	if (ds->errstr == NULL) {
+	    ds->errstr = g_strdup(b);
 	}
 	len = p - b + 1;
 	filter->first += len;
 	filter->size -= len;
 	b = p + 1;
-	dump_result = max(dump_result, 1);
+	ds->dump_result = max(ds->dump_result, 1);
     }
 
     if (nread <= 0) {
 	g_free(filter->buffer);
 	g_free(filter);
+	ds->nfilters--;
+	maybe_finish_dump(ds);
     } else {
 	filter->event = event_register((event_id_t)filter->fd, EV_READFD,
 				       handle_filter_stderr, filter);
@@ -1860,23 +2804,22 @@ handle_filter_stderr(
  */
 static void
 timeout(
+    dump_state_t *ds,
     time_t seconds)
 {
-    static event_handle_t *ev_timeout = NULL;
-
     /*
      * First, remove a timeout if one is active.
      */
-    if (ev_timeout != NULL) {
-	event_release(ev_timeout);
-	ev_timeout = NULL;
+    if (ds->ev_timeout != NULL) {
+	event_release(ds->ev_timeout);
+	ds->ev_timeout = NULL;
     }
 
     /*
      * Now, schedule a new one if 'seconds' is greater than 0
      */
     if (seconds > 0)
-	ev_timeout = event_register((event_id_t)seconds, EV_TIME, timeout_callback, NULL);
+	ds->ev_timeout = event_register((event_id_t)seconds, EV_TIME, timeout_callback, ds);
 }
 
 /*
@@ -1885,46 +2828,148 @@ timeout(
  */
 static void
 timeout_callback(
-    void *	unused)
+    void *	cookie)
 {
-    (void)unused;	/* Quiet unused parameter warning */
+    dump_state_t *ds = cookie;
 
-    assert(unused == NULL);
-    g_free(errstr);
-    errstr = g_strdup(_("data timeout"));
-    dump_result = 2;
-    stop_dump();
+    assert(ds != NULL);
+    g_free(ds->errstr);
+    ds->errstr = g_strdup(_("data timeout"));
+    ds->dump_result = 2;
+    stop_dump(ds);
 }
 
 /*
- * This is called when everything needs to shut down so event_loop()
- * will exit.
+ * This is called when everything needs to shut down for this dump.  The
+ * dump is finished, and DS freed, once its filters are done too, so the
+ * caller must not use DS afterward.
  */
 static void
-stop_dump(void)
+stop_dump(
+    dump_state_t *ds)
 {
     guint i;
-    struct cmdargs *cmdargs = NULL;
+
+    if (ds->stopped)
+	return;
+    ds->stopped = TRUE;
 
     /* Check if I have a pending ABORT command */
-    cmdargs = get_pending_cmd();
-    if (cmdargs) {
-	if (cmdargs->cmd != ABORT) {
-	    error(_("beurk %d"), cmdargs->cmd);
-	}
-	amfree(errstr);
-	errstr = g_strdup(cmdargs->argv[1]);
-	free_cmdargs(cmdargs);
+    read_pending_cmds();
+    if (ds->abort_msg) {
+	amfree(ds->errstr);
+	ds->errstr = g_strdup(ds->abort_msg);
     }
 
     for (i = 0; i < NSTREAMS; i++) {
-	if (streams[i].fd != NULL) {
-	    security_stream_close(streams[i].fd);
-	    streams[i].fd = NULL;
+	if (ds->streams[i] != NULL) {
+	    security_stream_close(ds->streams[i]);
+	    ds->streams[i] = NULL;
 	}
     }
-    aclose(indexout);
-    timeout(0);
+    if (ds->index)
+	index_writer_eof(ds->index);
+    timeout(ds, 0);
+
+    maybe_finish_dump(ds);
+}
+
+/*
+ * Finish the dump if it is stopped, the stderr of all its filters has been
+ * read, and the writer threads are done with its data and index.  Called
+ * again from wakeup_callback when they are done.
+ */
+static void
+maybe_finish_dump(
+    dump_state_t *ds)
+{
+    if (!ds->stopped || ds->nfilters > 0)
+	return;
+
+    /* the data and index of a failed dump are not wanted */
+    if (!ds->running || ds->dump_result > 1) {
+	databuf_close(ds, TRUE);
+	if (ds->index)
+	    index_writer_discard(ds->index);
+    }
+    if (!databuf_idle(ds))
+	return;
+    if (ds->index && !index_writer_done(ds->index))
+	return;
+
+    if (ds->running) {
+	if (!filter_processes_exited(ds))
+	    return;
+	finish_dump(ds);
+    } else {
+	dump_failed(ds);
+	dump_state_free(ds);
+    }
+}
+
+/*
+ * Check whether the compress and encrypt processes whose exit status
+ * finish_dump reports have exited, starting a child watch for each one that
+ * has not; filter_process_exited calls maybe_finish_dump again.
+ */
+static gboolean
+filter_processes_exited(
+    dump_state_t *ds)
+{
+    struct databuf *db = &ds->db;
+    gboolean exited = TRUE;
+
+    /* finish_dump kills them instead */
+    if (ds->dump_result > 1)
+	return TRUE;
+
+    if (db->compresspid != -1 && !db->compress_exited) {
+	if (!db->compress_watch)
+	    db->compress_watch = watch_filter_process(ds, db->compresspid);
+	exited = FALSE;
+    }
+    if (db->encryptpid != -1 && !db->encrypt_exited) {
+	if (!db->encrypt_watch)
+	    db->encrypt_watch = watch_filter_process(ds, db->encryptpid);
+	exited = FALSE;
+    }
+    return exited;
+}
+
+static GSource *
+watch_filter_process(
+    dump_state_t *ds,
+    pid_t	  pid)
+{
+    GSource *src = new_child_watch_source(pid);
+
+    g_source_set_callback(src, (GSourceFunc)filter_process_exited, ds, NULL);
+    g_source_attach(src, NULL);
+    g_source_unref(src);
+    return src;
+}
+
+static void
+filter_process_exited(
+    pid_t	pid,
+    gint	status,
+    gpointer	data)
+{
+    dump_state_t *ds = data;
+    struct databuf *db = &ds->db;
+
+    /* the source is removed once this returns */
+    if (pid == db->compresspid) {
+	db->compress_watch = NULL;
+	db->compress_exited = TRUE;
+	db->compress_status = status;
+    } else if (pid == db->encryptpid) {
+	db->encrypt_watch = NULL;
+	db->encrypt_exited = TRUE;
+	db->encrypt_status = status;
+    }
+
+    maybe_finish_dump(ds);
 }
 
 
@@ -1936,6 +2981,7 @@ stop_dump(void)
  */
 static int
 runcompress(
+    dump_state_t *ds,
     int		outfd,
     pid_t *	pid,
     comp_t	comptype,
@@ -1950,22 +2996,22 @@ runcompress(
 
     /* outpipe[0] is pipe's stdin, outpipe[1] is stdout. */
     if (pipe(outpipe) < 0) {
-	g_free(errstr);
-	errstr = g_strdup_printf(_("pipe: %s"), strerror(errno));
+	g_free(ds->errstr);
+	ds->errstr = g_strdup_printf(_("pipe: %s"), strerror(errno));
 	return (-1);
     }
 
     /* errpipe[0] is pipe's output, outpipe[1] is input. */
     if (pipe(errpipe) < 0) {
-	g_free(errstr);
-	errstr = g_strdup_printf(_("pipe: %s"), strerror(errno));
+	g_free(ds->errstr);
+	ds->errstr = g_strdup_printf(_("pipe: %s"), strerror(errno));
 	return (-1);
     }
 
     switch (*pid = fork()) {
     case -1:
-	g_free(errstr);
-	errstr = g_strdup_printf(_("couldn't fork: %s"), strerror(errno));
+	g_free(ds->errstr);
+	ds->errstr = g_strdup_printf(_("couldn't fork: %s"), strerror(errno));
 	aclose(outpipe[0]);
 	aclose(outpipe[1]);
 	aclose(errpipe[0]);
@@ -1974,8 +3020,8 @@ runcompress(
     default:
 	rval = dup2(outpipe[1], outfd);
 	if (rval < 0) {
-	    g_free(errstr);
-	    errstr = g_strdup_printf(_("couldn't dup2: %s"), strerror(errno));
+	    g_free(ds->errstr);
+	    ds->errstr = g_strdup_printf(_("couldn't dup2: %s"), strerror(errno));
 	}
 	aclose(outpipe[1]);
 	aclose(outpipe[0]);
@@ -1986,6 +3032,8 @@ runcompress(
 	filter->buffer = NULL;
 	filter->size = 0;
 	filter->allocated_size = 0;
+	filter->ds = ds;
+	ds->nfilters++;
 	filter->event = event_register((event_id_t)filter->fd, EV_READFD,
 				       handle_filter_stderr, filter);
 g_debug("event register %s %d", name, filter->fd);
@@ -2015,14 +3063,14 @@ g_debug("event register %s %d", name, filter->fd);
 		COMPRESS_BEST_OPT : COMPRESS_FAST_OPT), (char *)NULL);
 	    error(_("error: couldn't exec %s: %s"), COMPRESS_PATH, strerror(errno));
 	    /*NOTREACHED*/
-	} else if (*srvcompprog) {
-	    char *base = g_strdup(srvcompprog);
+	} else if (*ds->srvcompprog) {
+	    char *base = g_strdup(ds->srvcompprog);
 	    log_add(L_INFO, "%s pid %ld", basename(base), (long)getpid());
 	    amfree(base);
 	    safe_fd(-1, 0);
 	    set_root_privs(-1);
-	    execlp(srvcompprog, srvcompprog, (char *)0);
-	    error(_("error: couldn't exec server custom compression '%s'.\n"), srvcompprog);
+	    execlp(ds->srvcompprog, ds->srvcompprog, (char *)0);
+	    error(_("error: couldn't exec server custom compression '%s'.\n"), ds->srvcompprog);
 	    /*NOTREACHED*/
 	}
     }
@@ -2038,6 +3086,7 @@ g_debug("event register %s %d", name, filter->fd);
  */
 static int
 runencrypt(
+    dump_state_t *ds,
     int		outfd,
     pid_t *	pid,
     encrypt_t	encrypttype)
@@ -2051,22 +3100,22 @@ runencrypt(
 
     /* outpipe[0] is pipe's stdin, outpipe[1] is stdout. */
     if (pipe(outpipe) < 0) {
-	g_free(errstr);
-	errstr = g_strdup_printf(_("pipe: %s"), strerror(errno));
+	g_free(ds->errstr);
+	ds->errstr = g_strdup_printf(_("pipe: %s"), strerror(errno));
 	return (-1);
     }
 
     /* errpipe[0] is pipe's output, outpipe[1] is input. */
     if (pipe(errpipe) < 0) {
-	g_free(errstr);
-	errstr = g_strdup_printf(_("pipe: %s"), strerror(errno));
+	g_free(ds->errstr);
+	ds->errstr = g_strdup_printf(_("pipe: %s"), strerror(errno));
 	return (-1);
     }
 
     switch (*pid = fork()) {
     case -1:
-	g_free(errstr);
-	errstr = g_strdup_printf(_("couldn't fork: %s"), strerror(errno));
+	g_free(ds->errstr);
+	ds->errstr = g_strdup_printf(_("couldn't fork: %s"), strerror(errno));
 	aclose(outpipe[0]);
 	aclose(outpipe[1]);
 	aclose(errpipe[0]);
@@ -2076,20 +3125,22 @@ runencrypt(
 	char *base;
 	rval = dup2(outpipe[1], outfd);
 	if (rval < 0) {
-	    g_free(errstr);
-	    errstr = g_strdup_printf(_("couldn't dup2: %s"), strerror(errno));
+	    g_free(ds->errstr);
+	    ds->errstr = g_strdup_printf(_("couldn't dup2: %s"), strerror(errno));
 	}
 	aclose(outpipe[1]);
 	aclose(outpipe[0]);
 	aclose(errpipe[1]);
 	filter = g_new0(filter_t, 1);
 	filter->fd = errpipe[0];
-	base = g_strdup(srv_encrypt);
+	base = g_strdup(ds->srv_encrypt);
 	filter->name = g_strdup(basename(base));
 	amfree(base);
 	filter->buffer = NULL;
 	filter->size = 0;
 	filter->allocated_size = 0;
+	filter->ds = ds;
+	ds->nfilters++;
 	filter->event = event_register((event_id_t)filter->fd, EV_READFD,
 				       handle_filter_stderr, filter);
 g_debug("event register %s %d", "encrypt data", filter->fd);
@@ -2110,14 +3161,14 @@ g_debug("event register %s %d", "encrypt data", filter->fd);
 	    /*NOTREACHED*/
 	}
 	close(errpipe[0]);
-	base = g_strdup(srv_encrypt);
+	base = g_strdup(ds->srv_encrypt);
 	log_add(L_INFO, "%s pid %ld", basename(base), (long)getpid());
 	amfree(base);
 	safe_fd(-1, 0);
-	if ((encrypttype == ENCRYPT_SERV_CUST) && *srv_encrypt) {
+	if ((encrypttype == ENCRYPT_SERV_CUST) && *ds->srv_encrypt) {
 	    set_root_privs(-1);
-	    execlp(srv_encrypt, srv_encrypt, (char *)0);
-	    error(_("error: couldn't exec server custom encryption '%s'.\n"), srv_encrypt);
+	    execlp(ds->srv_encrypt, ds->srv_encrypt, (char *)0);
+	    error(_("error: couldn't exec server custom encryption '%s'.\n"), ds->srv_encrypt);
 	    /*NOTREACHED*/
 	}
 	}
@@ -2126,6 +3177,7 @@ g_debug("event register %s %d", "encrypt data", filter->fd);
     return (-1);
 }
 
+/* -------------------- */
 
 /* -------------------- */
 
@@ -2135,22 +3187,23 @@ sendbackup_response(
     pkt_t *		pkt,
     security_handle_t *	sech)
 {
-    int ports[NSTREAMS], *response_error = datap;
+    dump_state_t *ds = datap;
+    int ports[NSTREAMS];
     guint i;
     char *p;
     char *tok;
     char *extra;
 
-    assert(response_error != NULL);
+    assert(ds != NULL);
     assert(sech != NULL);
 
-    security_close_connection(sech, hostname);
+    security_close_connection(sech, ds->hostname);
 
     if (pkt == NULL) {
-	g_free(errstr);
-	errstr = g_strdup_printf(_("[request failed: %s]"),
+	g_free(ds->errstr);
+	ds->errstr = g_strdup_printf(_("[request failed: %s]"),
                                  security_geterror(sech));
-	*response_error = 1;
+	startup_done(ds, 1);
 	return;
     }
 
@@ -2167,23 +3220,23 @@ sendbackup_response(
 
 	tok = strtok(NULL, "\n");
 	if (tok != NULL) {
-	    g_free(errstr);
-	    errstr = g_strdup_printf("NAK: %s", tok);
-	    *response_error = 1;
+	    g_free(ds->errstr);
+	    ds->errstr = g_strdup_printf("NAK: %s", tok);
+	    startup_done(ds, 1);
 	} else {
 bad_nak:
-	    g_free(errstr);
-	    errstr = g_strdup("request NAK");
-	    *response_error = 2;
+	    g_free(ds->errstr);
+	    ds->errstr = g_strdup("request NAK");
+	    startup_done(ds, 2);
 	}
 	return;
     }
 
     if (pkt->type != P_REP) {
-	g_free(errstr);
-	errstr = g_strdup_printf(_("received strange packet type %s: %s"),
+	g_free(ds->errstr);
+	ds->errstr = g_strdup_printf(_("received strange packet type %s: %s"),
                                  pkt_type2str(pkt->type), pkt->body);
-	*response_error = 1;
+	startup_done(ds, 1);
 	return;
     }
 
@@ -2191,7 +3244,7 @@ bad_nak:
 
     for(i = 0; i < NSTREAMS; i++) {
 	ports[i] = -1;
-	streams[i].fd = NULL;
+	ds->streams[i] = NULL;
     }
 
     p = pkt->body;
@@ -2206,9 +3259,9 @@ bad_nak:
 	    tok = strtok(NULL, "\n");
 	    if (tok == NULL)
 		tok = _("[bogus error packet]");
-	    g_free(errstr);
-	    errstr = g_strdup_printf("%s", tok);
-	    *response_error = 2;
+	    g_free(ds->errstr);
+	    ds->errstr = g_strdup_printf("%s", tok);
+	    startup_done(ds, 2);
 	    return;
 	}
 
@@ -2222,18 +3275,18 @@ bad_nak:
 	     */
 	    for (i = 0; i < NSTREAMS; i++) {
 		tok = strtok(NULL, " ");
-		if (tok == NULL || !g_str_equal(tok, streams[i].name)) {
+		if (tok == NULL || !g_str_equal(tok, stream_names[i])) {
 		    extra = g_strdup_printf(
 				_("CONNECT token is \"%s\": expected \"%s\""),
 				tok ? tok : "(null)",
-				streams[i].name);
+				stream_names[i]);
 		    goto parse_error;
 		}
 		tok = strtok(NULL, " \n");
 		if (tok == NULL || sscanf(tok, "%d", &ports[i]) != 1) {
 		    extra = g_strdup_printf(
 			_("CONNECT %s token is \"%s\": expected a port number"),
-			streams[i].name, tok ? tok : "(null)");
+			stream_names[i], tok ? tok : "(null)");
 		    goto parse_error;
 		}
 	    }
@@ -2258,10 +3311,10 @@ bad_nak:
 		    ch = ch;
 		    if (u)
 		       *u = '\0';
-		    am_release_feature_set(their_features);
-		    if((their_features = am_string_to_feature(tok)) == NULL) {
-                        g_free(errstr);
-                        errstr = g_strdup_printf(_("OPTIONS: bad features value: %s"),
+		    am_release_feature_set(ds->their_features);
+		    if((ds->their_features = am_string_to_feature(tok)) == NULL) {
+                        g_free(ds->errstr);
+                        ds->errstr = g_strdup_printf(_("OPTIONS: bad features value: %s"),
                                                  tok);
 			goto parse_error;
 		    }
@@ -2278,8 +3331,8 @@ bad_nak:
 	goto parse_error;
     }
 
-    if (dumper_kencrypt == KENCRYPT_WILL_DO)
-	dumper_kencrypt = KENCRYPT_YES;
+    if (ds->dumper_kencrypt == KENCRYPT_WILL_DO)
+	ds->dumper_kencrypt = KENCRYPT_YES;
 
     /*
      * Connect the streams to their remote ports
@@ -2287,11 +3340,11 @@ bad_nak:
     for (i = 0; i < NSTREAMS; i++) {
 	if (ports[i] == -1)
 	    continue;
-	streams[i].fd = security_stream_client(sech, ports[i]);
-	if (streams[i].fd == NULL) {
-            g_free(errstr);
-            errstr = g_strdup_printf(_("[could not connect %s stream: %s]"),
-                                     streams[i].name, security_geterror(sech));
+	ds->streams[i] = security_stream_client(sech, ports[i]);
+	if (ds->streams[i] == NULL) {
+            g_free(ds->errstr);
+            ds->errstr = g_strdup_printf(_("[could not connect %s stream: %s]"),
+                                     stream_names[i], security_geterror(sech));
 	    goto connect_error;
 	}
     }
@@ -2300,12 +3353,12 @@ bad_nak:
      * Authenticate the streams
      */
     for (i = 0; i < NSTREAMS; i++) {
-	if (streams[i].fd == NULL)
+	if (ds->streams[i] == NULL)
 	    continue;
-	if (security_stream_auth(streams[i].fd) < 0) {
-            g_free(errstr);
-            errstr = g_strdup_printf(_("[could not authenticate %s stream: %s]"),
-                                     streams[i].name, security_stream_geterror(streams[i].fd));
+	if (security_stream_auth(ds->streams[i]) < 0) {
+            g_free(ds->errstr);
+            ds->errstr = g_strdup_printf(_("[could not authenticate %s stream: %s]"),
+                                     stream_names[i], security_stream_geterror(ds->streams[i]));
 	    goto connect_error;
 	}
     }
@@ -2314,27 +3367,60 @@ bad_nak:
      * The MESGFD and DATAFD streams are mandatory.  If we didn't get
      * them, complain.
      */
-    if (streams[MESGFD].fd == NULL || streams[DATAFD].fd == NULL) {
-	g_free(errstr);
-	errstr = g_strdup("[couldn't open MESG or INDEX streams]");
+    if (ds->streams[MESGFD] == NULL || ds->streams[DATAFD] == NULL) {
+	g_free(ds->errstr);
+	ds->errstr = g_strdup("[couldn't open MESG or INDEX streams]");
 	goto connect_error;
     }
 
     /* everything worked */
-    *response_error = 0;
+    startup_done(ds, 0);
     return;
 
 parse_error:
-    g_free(errstr);
-    errstr = g_strdup_printf(_("[parse of reply message failed: %s]"),
+    g_free(ds->errstr);
+    ds->errstr = g_strdup_printf(_("[parse of reply message failed: %s]"),
                              extra ? extra : _("(no additional information)"));
     amfree(extra);
-    *response_error = 2;
+    startup_done(ds, 2);
     return;
 
 connect_error:
-    stop_dump();
-    *response_error = 1;
+    for (i = 0; i < NSTREAMS; i++) {
+	if (ds->streams[i] != NULL) {
+	    security_stream_close(ds->streams[i]);
+	    ds->streams[i] = NULL;
+	}
+    }
+    startup_done(ds, 1);
+}
+
+/*
+ * Called once the request for a dump has been answered, or has failed.
+ * RC is 0 if the dump can start, 1 if it should be tried again later, or
+ * 2 if it failed.
+ */
+static void
+startup_done(
+    dump_state_t *ds,
+    int		rc)
+{
+    char *q;
+
+    if (rc == 0) {
+	do_dump(ds);
+	return;
+    }
+
+    q = quote_string(ds->errstr);
+    putresult(rc == 2? FAILED : TRYAGAIN, "%s %s\n",
+	ds->handle, q);
+    if (rc == 2)
+	log_add(L_FAIL, "%s %s %s %d [%s]", ds->hostname, ds->qdiskname,
+	    dumper_timestamp, ds->level, ds->errstr);
+    amfree(q);
+    aclose(ds->db.fd);
+    dump_state_free(ds);
 }
 
 static char *
@@ -2342,7 +3428,7 @@ dumper_get_security_conf(
     char *	string,
     void *	arg)
 {
-        (void)arg;	/* Quiet unused parameter warning */
+        dump_state_t *ds = arg;
 
         if(!string || !*string)
                 return(NULL);
@@ -2352,15 +3438,15 @@ dumper_get_security_conf(
         } else if(g_str_equal(string, "krb5keytab")) {
                 return(getconf_str(CNF_KRB5KEYTAB));
         } else if(g_str_equal(string, "amandad_path")) {
-                return (amandad_path);
+                return (ds->amandad_path);
         } else if(g_str_equal(string, "client_username")) {
-                return (client_username);
+                return (ds->client_username);
         } else if(g_str_equal(string, "client_port")) {
-                return (client_port);
+                return (ds->client_port);
         } else if(g_str_equal(string, "ssh_keys")) {
-                return (ssh_keys);
+                return (ds->ssh_keys);
         } else if(g_str_equal(string, "kencrypt")) {
-		if (dumper_kencrypt == KENCRYPT_YES)
+		if (ds->dumper_kencrypt == KENCRYPT_YES)
                     return ("yes");
 		else
 		    return (NULL);
@@ -2368,24 +3454,18 @@ dumper_get_security_conf(
         return(NULL);
 }
 
+/*
+ * Send the sendbackup request for a dump; sendbackup_response is called
+ * with the reply.  Returns 0 if the request was sent, or 2 (with errstr
+ * set) if it could not be.
+ */
 static int
 startup_dump(
-    const char *hostname,
-    const char *disk,
-    const char *device,
-    int		level,
-    const char *dumpdate,
-    const char *progname,
-    const char *amandad_path,
-    const char *client_username,
-    const char *client_port,
-    const char *ssh_keys,
-    const char *auth,
-    const char *options)
+    dump_state_t *ds)
 {
     char *req;
-    int response_error;
     const security_driver_t *secdrv;
+    const char *auth = ds->auth;
     int has_features;
     int has_hostname;
     int has_device;
@@ -2393,19 +3473,12 @@ startup_dump(
     GString *reqbuf;
     gboolean legacy_api;
 
-    (void)disk;			/* Quiet unused parameter warning */
-    (void)amandad_path;		/* Quiet unused parameter warning */
-    (void)client_username;	/* Quiet unused parameter warning */
-    (void)client_port;		/* Quiet unused parameter warning */
-    (void)ssh_keys;		/* Quiet unused parameter warning */
-    (void)auth;			/* Quiet unused parameter warning */
-
-    has_features = am_has_feature(their_features, fe_req_options_features);
-    has_hostname = am_has_feature(their_features, fe_req_options_hostname);
-    has_config   = am_has_feature(their_features, fe_req_options_config);
-    has_device   = am_has_feature(their_features, fe_sendbackup_req_device);
+    has_features = am_has_feature(ds->their_features, fe_req_options_features);
+    has_hostname = am_has_feature(ds->their_features, fe_req_options_hostname);
+    has_config   = am_has_feature(ds->their_features, fe_req_options_config);
+    has_device   = am_has_feature(ds->their_features, fe_sendbackup_req_device);
 
-    legacy_api = (g_str_equal(progname, "DUMP") || g_str_equal(progname, "GNUTAR"));
+    legacy_api = (g_str_equal(ds->progname, "DUMP") || g_str_equal(ds->progname, "GNUTAR"));
 
     /*
      * Default to bsd authentication if none specified.  This is gross.
@@ -2421,44 +3494,44 @@ startup_dump(
         g_string_append_printf(reqbuf, "features=%s;", our_feature_string);
 
     if (has_hostname)
-        g_string_append_printf(reqbuf, "hostname=%s;", hostname);
+        g_string_append_printf(reqbuf, "hostname=%s;", ds->hostname);
 
     if (has_config)
         g_string_append_printf(reqbuf, "config=%s;", get_config_name());
 
     g_string_append_c(reqbuf, '\n');
 
-    amfree(dle_str);
-    if (am_has_feature(their_features, fe_req_xml)) {
+    amfree(ds->dle_str);
+    if (am_has_feature(ds->their_features, fe_req_xml)) {
         GString *strbuf = g_string_new("<dle>\n");
 	char *p, *pclean;
 
         g_string_append_printf(strbuf, "  <program>%s</program>\n  %s\n",
-            (!legacy_api) ? "APPLICATION" : progname, b64disk);
+            (!legacy_api) ? "APPLICATION" : ds->progname, ds->b64disk);
 
-        if (device && has_device)
-            g_string_append_printf(strbuf, "  %s\n", b64device);
+        if (ds->device && has_device)
+            g_string_append_printf(strbuf, "  %s\n", ds->b64device);
 
         g_string_append_printf(strbuf, "  <level>%d</level>\n%s</dle>\n",
-            level, options + 1);
+            ds->level, ds->options + 1);
 
         p = g_string_free(strbuf, FALSE);
-	pclean = clean_dle_str_for_client(p, their_features);
+	pclean = clean_dle_str_for_client(p, ds->their_features);
         g_string_append(reqbuf, pclean);
 	g_free(pclean);
-	dle_str = p;
+	ds->dle_str = p;
     } else if (legacy_api) {
-	g_free(errstr);
-	errstr = g_strdup("[does not support application-api]");
+	g_free(ds->errstr);
+	ds->errstr = g_strdup("[does not support application-api]");
         g_string_free(reqbuf, TRUE);
 	return 2;
     } else {
 	if (auth == NULL)
 	    auth = "BSDTCP";
 
-        g_string_append_printf(reqbuf, "%s %s %s %d %s OPTIONS %s\n", progname,
-            qdiskname, (device && has_device) ? device : "", level,
-            dumpdate, options);
+        g_string_append_printf(reqbuf, "%s %s %s %d %s OPTIONS %s\n", ds->progname,
+            ds->qdiskname, (ds->device && has_device) ? ds->device : "", ds->level,
+            ds->dumpdate, ds->options);
 
     }
 
@@ -2468,18 +3541,16 @@ startup_dump(
 
     secdrv = security_getdriver(auth);
     if (secdrv == NULL) {
-	g_free(errstr);
-	errstr = g_strdup_printf(_("[could not find security driver '%s']"),
+	g_free(ds->errstr);
+	ds->errstr = g_strdup_printf(_("[could not find security driver '%s']"),
                                  auth);
         g_free(req);
 	return 2;
     }
 
-    protocol_sendreq(hostname, secdrv, dumper_get_security_conf, req,
-	STARTUP_TIMEOUT, sendbackup_response, &response_error);
+    protocol_sendreq(ds->hostname, secdrv, dumper_get_security_conf, req,
+	STARTUP_TIMEOUT, sendbackup_response, ds);
 
     g_free(req);
-
-    protocol_run();
-    return response_error;
+    return 0;
 }
@@ -251,7 +251,7 @@ search_holding_disk(
 
 	holding_file = (char *)e->data;
 
-	if (!holding_file_get_dumpfile(holding_file, &file))
+	if (!holding_file_get_summary(holding_file, &file))
 	    continue;
 
 	if (file.dumplevel < 0 || file.dumplevel >= DUMP_LEVELS) {
@@ -738,6 +738,7 @@ search_logfile(
     off_t kb;
     off_t bytes;
     off_t orig_kb;
+    char *crc;
     int   taper_part = 0;
 
     g_return_val_if_fail(output_find != NULL, 0);
@@ -935,7 +936,19 @@ search_logfile(
 	    skip_non_whitespace(s, ch);
 	    rest_undo = s - 1;
 	    *rest_undo = '\0';
+	    crc = NULL;
 	    if (g_str_equal(rest, "[sec")) {
+		char *c = strstr(s, " crc crc32c:");
+		char *e = strchr(s, ']');
+
+		/* the checksum of a part written by the taper, if any; it is the
+		 * last item in the stats */
+		if (c && e && e - c == 12 + 8) {
+		    char crcbuf[16];
+		    g_strlcpy(crcbuf, c + 5, sizeof(crcbuf));
+		    crc = g_string_chunk_insert_const(string_chunk, crcbuf);
+		}
+
 		skip_whitespace(s, ch);
 		if(ch == '\0') {
 		    g_printf(_("strange log line in %s \"%s\"\n"),
@@ -1066,6 +1079,7 @@ search_logfile(
 		    new_output_find->kb=kb;
 		    new_output_find->bytes=bytes;
 		    new_output_find->orig_kb=orig_kb;
+		    new_output_find->crc=crc;
 		    new_output_find->next=NULL;
 		    if (curlog == L_SUCCESS) {
 			new_output_find->status = "OK";
@@ -1258,6 +1272,7 @@ dumps_match(
 	    curmatch->kb = cur_result->kb;
 	    curmatch->bytes = cur_result->bytes;
 	    curmatch->orig_kb = cur_result->orig_kb;
+	    curmatch->crc = cur_result->crc;
 	    curmatch->status = cur_result->status;
 	    curmatch->dump_status = cur_result->dump_status;
 	    curmatch->message = cur_result->message;
@@ -23,6 +23,7 @@ typedef struct find_result_s {
     off_t bytes;	/* may be 0 for older log files, can be compressed */
     off_t kb;		/* may be 0 for older log files, can be compressed */
     off_t orig_kb;      /* native size */
+    char *crc;		/* part checksum ("crc32c:xxxxxxxx"), or NULL */
     void *user_ptr;
 } find_result_t;
 
@@ -35,6 +35,7 @@
 #include "diskfile.h"
 #include "fileheader.h"
 #include "logfile.h"
+#include <utime.h>
 
 /*
  * utilities */
@@ -46,13 +47,6 @@
  */
 static int is_dir(char *fname);
 
-/* Is fname an empty file?
- *
- * @param fname: filename (fully qualified)
- * @returns: boolean
- */
-static int is_emptyfile(char *fname);
-
 /* sanity check that datestamp is of the form YYYYMMDD or 
  * YYYYMMDDhhmmss
  *
@@ -75,18 +69,6 @@ is_dir(
     return (statbuf.st_mode & S_IFDIR) == S_IFDIR;
 }
 
-static int
-is_emptyfile(
-    char *fname)
-{
-    struct stat statbuf;
-
-    if(stat(fname, &statbuf) == -1) return 0;
-
-    return ((statbuf.st_mode & S_IFDIR) != S_IFDIR) &&
-		(statbuf.st_size == (off_t)0);
-}
-
 static int
 is_datestr(
     char *fname)
@@ -134,6 +116,895 @@ is_datestr(
     return 1;
 }
 
+/*
+ * Manifest
+ *
+ * Each holding disk has a manifest, HDISK/.holding-manifest, which records
+ * what holding_file_get_dumpfile finds in each chunk of its holding
+ * directories, so that the holding files can be listed without reading the
+ * header of every chunk.  It is a text file with one record per line:
+ *
+ *   AMANDA HOLDING MANIFEST 1
+ *   FILE dir name size type host disk datestamp level partial origsize cont
+ *   CRUFT dir name			(a chunk without a readable header)
+ *   GONE dir name
+ *   FORGET dir
+ *   DIR dir mtime stamp [mtime_ns]	(the entries of dir are complete)
+ *
+ * Records are appended, each batch in one write, while holding the lock
+ * HDISK/.holding-manifest.lock.  When there are many more records than
+ * entries, the manifest is rewritten under a temporary name and renamed into
+ * place.  Readers take no lock: they ignore an incomplete last line, and
+ * start over when the manifest is replaced.
+ *
+ * The entries of a holding directory are used only while the directory's
+ * mtime is the one in its DIR record.  Where the filesystem keeps only whole
+ * seconds, that mtime must also be older than the time the record was made,
+ * since a change within the same second would not show.  A directory changed
+ * by a program which does not know about the manifest, or a missing or
+ * damaged manifest, thus makes the directory stale, and the next walk
+ * rebuilds its entries from the headers.  Changes made between
+ * holding_change_begin and holding_change_end are recorded in the entries,
+ * and the directory's new mtime with them if its names are then exactly its
+ * entries, so that a change by another program meanwhile is not hidden.
+ */
+
+#define MANIFEST_NAME		".holding-manifest"
+#define MANIFEST_MAGIC		"AMANDA HOLDING MANIFEST 1"
+#define MANIFEST_LOCK_TRIES	500	/* 10ms apart */
+#define MANIFEST_MIN_RECORDS	1024	/* before considering a rewrite */
+
+typedef struct {
+    char       *name;		/* in its holding directory */
+    off_t	size;		/* in bytes */
+    gboolean	readable;	/* else holding_file_get_dumpfile fails */
+    filetype_t	type;
+    char       *hostname;
+    char       *diskname;
+    char       *datestamp;
+    int		dumplevel;
+    int		is_partial;
+    off_t	orig_size;
+    char       *cont_filename;
+} manifest_entry_t;
+
+typedef struct {
+    time_t	mtime;		/* 0 if the entries may be incomplete */
+    long	mtime_ns;	/* nanoseconds of mtime, 0 if not kept */
+    time_t	stamp;		/* when mtime was recorded */
+    guint	changed;	/* serial of the last record applied to it */
+    GHashTable *entries;	/* name -> manifest_entry_t * */
+} manifest_dir_t;
+
+typedef struct {
+    char       *hdisk;
+    char       *filename;
+    dev_t	dev;
+    ino_t	ino;		/* 0 if there is no manifest */
+    off_t	offset;		/* how much of it has been read */
+    gboolean	damaged;	/* rewrite it at the next change */
+    guint	nrecords;
+    guint	nentries;
+    guint	serial;		/* of the records applied in this process */
+    GHashTable *dirs;		/* dir name -> manifest_dir_t * */
+} manifest_t;
+
+struct holding_change_s {
+    char       *hdisk;
+    char       *hdir;
+    char       *dir;
+    GSList     *names;		/* chunks to record */
+    file_lock  *lock;		/* NULL if the change is not recorded */
+    gboolean	was_current;
+    gboolean	was_missing;
+    time_t	mtime, stamp;	/* of the directory, if was_current */
+    long	mtime_ns;
+};
+
+/* the manifests read by this process, by holding disk; protected by
+ * manifest_mutex, which is never held while waiting for a manifest lock */
+static GHashTable *manifests = NULL;
+static GStaticMutex manifest_mutex = G_STATIC_MUTEX_INIT;
+
+static void
+free_manifest_entry(
+    gpointer data)
+{
+    manifest_entry_t *e = data;
+
+    g_free(e->name);
+    g_free(e->hostname);
+    g_free(e->diskname);
+    g_free(e->datestamp);
+    g_free(e->cont_filename);
+    g_free(e);
+}
+
+static manifest_entry_t *
+copy_manifest_entry(
+    manifest_entry_t *e)
+{
+    manifest_entry_t *copy = g_memdup(e, sizeof(*e));
+
+    copy->name = g_strdup(e->name);
+    copy->hostname = g_strdup(e->hostname);
+    copy->diskname = g_strdup(e->diskname);
+    copy->datestamp = g_strdup(e->datestamp);
+    copy->cont_filename = g_strdup(e->cont_filename);
+    return copy;
+}
+
+static void
+free_manifest_dir(
+    gpointer data)
+{
+    manifest_dir_t *md = data;
+
+    g_hash_table_destroy(md->entries);
+    g_free(md);
+}
+
+static void
+clear_manifest(
+    manifest_t *m)
+{
+    g_hash_table_remove_all(m->dirs);
+    m->offset = 0;
+    m->nrecords = 0;
+    m->nentries = 0;
+}
+
+/* Split the full pathname of a chunk into its holding disk, the name of its
+ * holding directory, and its own name.  Free the results with g_free. */
+static void
+split_chunk_path(
+    const char *chunk,
+    char **hdisk,
+    char **dir,
+    char **name)
+{
+    char *hdir = g_path_get_dirname(chunk);
+
+    *hdisk = g_path_get_dirname(hdir);
+    *dir = g_path_get_basename(hdir);
+    if (name)
+	*name = g_path_get_basename(chunk);
+    g_free(hdir);
+}
+
+/* Read a chunk as holding_file_get_dumpfile does, and make an entry of it.
+ *
+ * @returns: the entry, or NULL if the chunk does not exist
+ */
+static manifest_entry_t *
+read_manifest_entry(
+    char *chunk)
+{
+    manifest_entry_t *e;
+    struct stat st;
+    dumpfile_t file;
+
+    if (stat(chunk, &st) == -1)
+	return NULL;
+
+    e = g_new0(manifest_entry_t, 1);
+    e->name = g_path_get_basename(chunk);
+    e->size = st.st_size;
+    e->readable = holding_file_get_dumpfile(chunk, &file);
+    if (e->readable) {
+	e->type = file.type;
+	e->hostname = g_strdup(file.name);
+	e->diskname = g_strdup(file.disk);
+	e->datestamp = g_strdup(file.datestamp);
+	e->dumplevel = file.dumplevel;
+	e->is_partial = file.is_partial;
+	e->orig_size = file.orig_size;
+	e->cont_filename = g_strdup(file.cont_filename);
+    }
+    dumpfile_free_data(&file);
+    return e;
+}
+
+static void
+append_entry_record(
+    GString *records,
+    const char *dir,
+    const char *name,
+    manifest_entry_t *e)
+{
+    char *qdir = quote_string_always(dir);
+    char *qname = quote_string_always(name);
+
+    if (!e) {
+	g_string_append_printf(records, "GONE %s %s\n", qdir, qname);
+    } else if (!e->readable) {
+	g_string_append_printf(records, "CRUFT %s %s\n", qdir, qname);
+    } else {
+	char *qhost = quote_string_always(e->hostname);
+	char *qdisk = quote_string_always(e->diskname);
+	char *qdate = quote_string_always(e->datestamp);
+	char *qcont = quote_string_always(e->cont_filename);
+
+	g_string_append_printf(records, "FILE %s %s %lld %d %s %s %s %d %d %lld %s\n",
+			       qdir, qname, (long long)e->size, (int)e->type,
+			       qhost, qdisk, qdate, e->dumplevel, e->is_partial,
+			       (long long)e->orig_size, qcont);
+	g_free(qhost);
+	g_free(qdisk);
+	g_free(qdate);
+	g_free(qcont);
+    }
+    g_free(qdir);
+    g_free(qname);
+}
+
+static void
+append_dir_record(
+    GString *records,
+    const char *dir,
+    time_t mtime,
+    long mtime_ns,
+    time_t stamp)
+{
+    char *qdir = quote_string_always(dir);
+
+    g_string_append_printf(records, "DIR %s %lld %lld %ld\n", qdir,
+			   (long long)mtime, (long long)stamp, mtime_ns);
+    g_free(qdir);
+}
+
+/* The sub-second part of the mtime in ST, or 0 where it is not kept */
+static long
+stat_mtime_ns(
+    struct stat *st)
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    return (long)st->st_mtim.tv_nsec;
+#else
+    (void)st;
+    return 0;
+#endif
+}
+
+static manifest_dir_t *
+lookup_manifest_dir(
+    manifest_t *m,
+    const char *dir,
+    gboolean create)
+{
+    manifest_dir_t *md = g_hash_table_lookup(m->dirs, dir);
+
+    if (!md && create) {
+	md = g_new0(manifest_dir_t, 1);
+	md->entries = g_hash_table_new_full(g_str_hash, g_str_equal,
+					    NULL, free_manifest_entry);
+	g_hash_table_insert(m->dirs, g_strdup(dir), md);
+    }
+    return md;
+}
+
+/* Apply one record to the manifest in memory.
+ *
+ * @returns: FALSE if the record can't be parsed
+ */
+static gboolean
+apply_manifest_record(
+    manifest_t *m,
+    const char *line)
+{
+    gchar **tokens = split_quoted_strings(line);
+    guint ntokens = g_strv_length(tokens);
+    manifest_dir_t *md;
+    gboolean ok = TRUE;
+
+    if (ntokens < 2) {
+	ok = FALSE;
+    } else if (g_str_equal(tokens[0], "FORGET") && ntokens == 2) {
+	if ((md = lookup_manifest_dir(m, tokens[1], FALSE)) != NULL) {
+	    m->nentries -= g_hash_table_size(md->entries);
+	    g_hash_table_remove(m->dirs, tokens[1]);
+	}
+	md = lookup_manifest_dir(m, tokens[1], TRUE);
+	md->changed = ++m->serial;
+    } else if (g_str_equal(tokens[0], "DIR") && (ntokens == 4 || ntokens == 5)) {
+	md = lookup_manifest_dir(m, tokens[1], TRUE);
+	md->mtime = (time_t)g_ascii_strtoll(tokens[2], NULL, 10);
+	md->stamp = (time_t)g_ascii_strtoll(tokens[3], NULL, 10);
+	md->mtime_ns = ntokens == 5 ? (long)g_ascii_strtoll(tokens[4], NULL, 10) : 0;
+	md->changed = ++m->serial;
+    } else if ((g_str_equal(tokens[0], "GONE") && ntokens == 3)
+	    || (g_str_equal(tokens[0], "CRUFT") && ntokens == 3)
+	    || (g_str_equal(tokens[0], "FILE") && ntokens == 12)) {
+	md = lookup_manifest_dir(m, tokens[1], TRUE);
+	if (g_hash_table_remove(md->entries, tokens[2]))
+	    m->nentries--;
+	if (!g_str_equal(tokens[0], "GONE")) {
+	    manifest_entry_t *e = g_new0(manifest_entry_t, 1);
+
+	    e->name = g_strdup(tokens[2]);
+	    if (g_str_equal(tokens[0], "FILE")) {
+		e->readable = TRUE;
+		e->size = (off_t)g_ascii_strtoll(tokens[3], NULL, 10);
+		e->type = (filetype_t)atoi(tokens[4]);
+		e->hostname = g_strdup(tokens[5]);
+		e->diskname = g_strdup(tokens[6]);
+		e->datestamp = g_strdup(tokens[7]);
+		e->dumplevel = atoi(tokens[8]);
+		e->is_partial = atoi(tokens[9]);
+		e->orig_size = (off_t)g_ascii_strtoll(tokens[10], NULL, 10);
+		e->cont_filename = g_strdup(tokens[11]);
+	    }
+	    g_hash_table_insert(md->entries, e->name, e);
+	    m->nentries++;
+	}
+	md->changed = ++m->serial;
+    } else {
+	ok = FALSE;
+    }
+
+    g_strfreev(tokens);
+    return ok;
+}
+
+/* Apply the records in BUF (LEN bytes, ending with a newline), which begin
+ * with the first line of the manifest if WITH_MAGIC */
+static gboolean
+apply_manifest_records(
+    manifest_t *m,
+    char *buf,
+    size_t len,
+    gboolean with_magic)
+{
+    char *line = buf, *nl;
+
+    while (line < buf + len && (nl = memchr(line, '\n', buf + len - line))) {
+	*nl = '\0';
+	if (with_magic && line == buf) {
+	    if (!g_str_equal(line, MANIFEST_MAGIC))
+		return FALSE;
+	} else if (!apply_manifest_record(m, line)) {
+	    return FALSE;
+	}
+	m->nrecords++;
+	*nl = '\n';
+	line = nl + 1;
+    }
+    return TRUE;
+}
+
+/* Bring the manifest in memory up to date with the file: read what was
+ * appended since it was last read, or all of it if it was replaced. */
+static void
+read_manifest(
+    manifest_t *m)
+{
+    struct stat st;
+    char *buf, *end;
+    size_t len;
+    int fd;
+
+    if (stat(m->filename, &st) == -1) {
+	if (m->ino != 0) {
+	    clear_manifest(m);
+	    m->ino = 0;
+	}
+	return;
+    }
+
+    if (st.st_dev != m->dev || st.st_ino != m->ino || st.st_size < m->offset) {
+	clear_manifest(m);
+	m->dev = st.st_dev;
+	m->ino = st.st_ino;
+	m->damaged = FALSE;
+    }
+    if (st.st_size == m->offset || m->damaged)
+	return;
+
+    if ((fd = robust_open(m->filename, O_RDONLY, 0)) == -1) {
+	dbprintf(_("could not open %s: %s\n"), m->filename, strerror(errno));
+	return;
+    }
+    len = st.st_size - m->offset;
+    buf = g_malloc(len);
+    if (lseek(fd, m->offset, SEEK_SET) == -1)
+	len = 0;
+    else
+	len = read_fully(fd, buf, len, NULL);
+    aclose(fd);
+
+    /* only whole lines; the last one may still be being written */
+    for (end = buf + len; end > buf && end[-1] != '\n'; end--)
+	/* empty */;
+    if (end > buf) {
+	if (apply_manifest_records(m, buf, end - buf, m->offset == 0)) {
+	    m->offset += end - buf;
+	} else {
+	    dbprintf(_("%s is damaged; ignoring it\n"), m->filename);
+	    clear_manifest(m);
+	    m->damaged = TRUE;
+	}
+    }
+    g_free(buf);
+}
+
+/* Get the manifest of HDISK, up to date.  Call with manifest_mutex held. */
+static manifest_t *
+get_manifest(
+    const char *hdisk)
+{
+    manifest_t *m;
+
+    if (!manifests)
+	manifests = g_hash_table_new(g_str_hash, g_str_equal);
+
+    m = g_hash_table_lookup(manifests, hdisk);
+    if (!m) {
+	m = g_new0(manifest_t, 1);
+	m->hdisk = g_strdup(hdisk);
+	m->filename = g_strconcat(hdisk, "/", MANIFEST_NAME, NULL);
+	m->dirs = g_hash_table_new_full(g_str_hash, g_str_equal,
+					g_free, free_manifest_dir);
+	g_hash_table_insert(manifests, m->hdisk, m);
+    }
+
+    read_manifest(m);
+    return m;
+}
+
+static gboolean
+manifest_dir_is_current(
+    manifest_dir_t *md,
+    struct stat *st)
+{
+    return md && md->mtime != 0
+	&& st->st_mtime == md->mtime && stat_mtime_ns(st) == md->mtime_ns
+	&& (md->mtime < md->stamp || md->mtime_ns != 0);
+}
+
+/* Check that the names in holding directory HDIR are exactly the entries of
+ * MD, as after a change which another program may have raced with */
+static gboolean
+manifest_dir_names_match(
+    manifest_dir_t *md,
+    const char *hdir)
+{
+    DIR *dirp;
+    struct dirent *entry;
+    guint nnames = 0;
+    gboolean match = TRUE;
+
+    if ((dirp = opendir(hdir)) == NULL)
+	return FALSE;
+    while (match && (entry = readdir(dirp)) != NULL) {
+	if (is_dot_or_dotdot(entry->d_name))
+	    continue;
+	nnames++;
+	match = g_hash_table_lookup(md->entries, entry->d_name) != NULL;
+    }
+    closedir(dirp);
+
+    return match && nnames == g_hash_table_size(md->entries);
+}
+
+/* Replace the manifest file with what is in memory */
+static void
+rewrite_manifest(
+    manifest_t *m)
+{
+    GString *records = g_string_new(MANIFEST_MAGIC "\n");
+    GHashTableIter diter, eiter;
+    gpointer key, value;
+    char *tmpname = g_strconcat(m->filename, ".tmp", NULL);
+    struct stat st;
+    guint nrecords = 1;
+    int fd;
+
+    g_hash_table_iter_init(&diter, m->dirs);
+    while (g_hash_table_iter_next(&diter, &key, &value)) {
+	manifest_dir_t *md = value;
+	char *hdir = g_strconcat(m->hdisk, "/", (char *)key, NULL);
+
+	/* nothing worth keeping about directories which are gone */
+	if (stat(hdir, &st) == -1) {
+	    g_free(hdir);
+	    continue;
+	}
+	g_free(hdir);
+
+	g_hash_table_iter_init(&eiter, md->entries);
+	while (g_hash_table_iter_next(&eiter, NULL, &value)) {
+	    manifest_entry_t *e = value;
+	    append_entry_record(records, key, e->name, e);
+	    nrecords++;
+	}
+	if (md->mtime != 0) {
+	    append_dir_record(records, key, md->mtime, md->mtime_ns, md->stamp);
+	    nrecords++;
+	}
+    }
+
+    if ((fd = open(tmpname, O_WRONLY|O_CREAT|O_TRUNC, 0600)) == -1) {
+	dbprintf(_("could not create %s: %s\n"), tmpname, strerror(errno));
+    } else if (full_write(fd, records->str, records->len) < records->len
+	       || fsync(fd) == -1) {
+	dbprintf(_("could not write %s: %s\n"), tmpname, strerror(errno));
+	close(fd);
+	unlink(tmpname);
+    } else if (close(fd) == -1 || rename(tmpname, m->filename) == -1) {
+	dbprintf(_("could not rename %s to %s: %s\n"),
+		 tmpname, m->filename, strerror(errno));
+	unlink(tmpname);
+    } else {
+	/* start over from what was just written */
+	clear_manifest(m);
+	m->ino = 0;
+	m->damaged = FALSE;
+	read_manifest(m);
+    }
+
+    g_free(tmpname);
+    g_string_free(records, TRUE);
+}
+
+/* Apply RECORDS to the manifest and add them to the file, or rewrite the
+ * file if it needs it.  Call with the manifest lock and manifest_mutex held,
+ * just after get_manifest. */
+static void
+write_manifest_records(
+    manifest_t *m,
+    GString *records)
+{
+    gboolean rewrite;
+    int fd;
+
+    if (!apply_manifest_records(m, records->str, records->len, FALSE)) {
+	/* a bug; the records are ours */
+	dbprintf(_("bad manifest records: %s\n"), records->str);
+	m->damaged = TRUE;
+    }
+
+    rewrite = m->damaged || m->ino == 0
+	|| (m->nrecords > MANIFEST_MIN_RECORDS && m->nrecords > 4 * m->nentries);
+    if (rewrite) {
+	rewrite_manifest(m);
+	return;
+    }
+
+    if ((fd = open(m->filename, O_WRONLY|O_APPEND)) == -1
+	|| full_write(fd, records->str, records->len) < records->len) {
+	dbprintf(_("could not append to %s: %s\n"), m->filename, strerror(errno));
+	/* another process may have read part of the records, so they
+	 * can't be written again */
+	m->damaged = TRUE;
+    } else {
+	m->offset += records->len;
+    }
+    if (fd >= 0)
+	close(fd);
+}
+
+/* Take the lock of the manifest of HDISK, waiting a few seconds at most.
+ *
+ * @returns: the lock, or NULL
+ */
+static file_lock *
+lock_manifest(
+    const char *hdisk)
+{
+    char *lockname = g_strconcat(hdisk, "/", MANIFEST_NAME, ".lock", NULL);
+    file_lock *lock = file_lock_new(lockname);
+    int tries, rv = 1;
+
+    for (tries = 0; tries < MANIFEST_LOCK_TRIES; tries++) {
+	if ((rv = file_lock_lock(lock)) != 1)
+	    break;
+	g_usleep(10000);
+    }
+    if (rv != 0) {
+	if (rv == 1)
+	    dbprintf(_("%s is still locked; not recording changes\n"), lockname);
+	else
+	    dbprintf(_("could not lock %s: %s\n"), lockname, strerror(errno));
+	file_lock_free(lock);
+	lock = NULL;
+    }
+
+    g_free(lockname);
+    return lock;
+}
+
+/* Rebuild the entries of a holding directory from the headers of its chunks,
+ * and record them if the directory did not change meanwhile.
+ *
+ * @returns: a GPtrArray of manifest_entry_t *, or NULL if the directory
+ * can't be read
+ */
+static GPtrArray *
+scan_holding_dir(
+    char *hdisk,
+    char *dir)
+{
+    char *hdir = g_strconcat(hdisk, "/", dir, NULL);
+    manifest_t *m;
+    manifest_dir_t *md;
+    dev_t dev;
+    ino_t ino;
+    guint changed;
+    time_t started;
+    struct stat st;
+    DIR *dirp;
+    struct dirent *workdir;
+    GPtrArray *entries;
+    file_lock *lock;
+
+    g_static_mutex_lock(&manifest_mutex);
+    m = get_manifest(hdisk);
+    dev = m->dev;
+    ino = m->ino;
+    md = lookup_manifest_dir(m, dir, FALSE);
+    changed = md ? md->changed : 0;
+    g_static_mutex_unlock(&manifest_mutex);
+
+    started = time(NULL);
+    if (stat(hdir, &st) == -1 || (dirp = opendir(hdir)) == NULL) {
+        if (errno != ENOENT)
+           dbprintf(_("Warning: could not open holding dir %s: %s\n"),
+                  hdir, strerror(errno));
+	g_free(hdir);
+	return NULL;
+    }
+
+    entries = g_ptr_array_new();
+    while ((workdir = readdir(dirp)) != NULL) {
+	char *chunk;
+	manifest_entry_t *e;
+
+        if (is_dot_or_dotdot(workdir->d_name))
+            continue;
+
+	chunk = g_strconcat(hdir, "/", workdir->d_name, NULL);
+	if ((e = read_manifest_entry(chunk)) != NULL)
+	    g_ptr_array_add(entries, e);
+	g_free(chunk);
+    }
+    closedir(dirp);
+
+    /* record the entries, unless the directory or its entries in the
+     * manifest changed since the scan started; with whole-second mtimes, a
+     * change in the second the scan started would not show */
+    if ((st.st_mtime < started || stat_mtime_ns(&st) != 0)
+	&& (lock = lock_manifest(hdisk)) != NULL) {
+	struct stat now_st;
+
+	g_static_mutex_lock(&manifest_mutex);
+	m = get_manifest(hdisk);
+	md = lookup_manifest_dir(m, dir, FALSE);
+	if (m->dev == dev && m->ino == ino && (md ? md->changed : 0) == changed
+	    && stat(hdir, &now_st) == 0 && now_st.st_mtime == st.st_mtime
+	    && stat_mtime_ns(&now_st) == stat_mtime_ns(&st)) {
+	    GString *records = g_string_new(NULL);
+	    char *qdir = quote_string_always(dir);
+	    guint i;
+
+	    g_string_append_printf(records, "FORGET %s\n", qdir);
+	    for (i = 0; i < entries->len; i++) {
+		manifest_entry_t *e = g_ptr_array_index(entries, i);
+		append_entry_record(records, dir, e->name, e);
+	    }
+	    append_dir_record(records, dir, st.st_mtime, stat_mtime_ns(&st),
+			      time(NULL));
+	    write_manifest_records(m, records);
+	    g_string_free(records, TRUE);
+	    g_free(qdir);
+	}
+	g_static_mutex_unlock(&manifest_mutex);
+	file_lock_free(lock);
+    }
+
+    g_free(hdir);
+    return entries;
+}
+
+/* Get the entries of a holding directory, from the manifest if it is current
+ * there, else from the headers of its chunks.
+ *
+ * @returns: a GPtrArray of manifest_entry_t * to free with free_entries, or
+ * NULL if the directory can't be read
+ */
+static GPtrArray *
+get_holding_dir_entries(
+    char *hdir)
+{
+    char *hdisk = g_path_get_dirname(hdir);
+    char *dir = g_path_get_basename(hdir);
+    GPtrArray *entries = NULL;
+    struct stat st;
+
+    if (stat(hdir, &st) == 0) {
+	manifest_dir_t *md;
+
+	g_static_mutex_lock(&manifest_mutex);
+	md = lookup_manifest_dir(get_manifest(hdisk), dir, FALSE);
+	if (manifest_dir_is_current(md, &st)) {
+	    GHashTableIter iter;
+	    gpointer value;
+
+	    entries = g_ptr_array_sized_new(g_hash_table_size(md->entries));
+	    g_hash_table_iter_init(&iter, md->entries);
+	    while (g_hash_table_iter_next(&iter, NULL, &value))
+		g_ptr_array_add(entries, copy_manifest_entry(value));
+	}
+	g_static_mutex_unlock(&manifest_mutex);
+    }
+
+    if (!entries)
+	entries = scan_holding_dir(hdisk, dir);
+
+    g_free(hdisk);
+    g_free(dir);
+    return entries;
+}
+
+static void
+free_entries(
+    GPtrArray *entries)
+{
+    g_ptr_array_foreach(entries, (GFunc)free_manifest_entry, NULL);
+    g_ptr_array_free(entries, TRUE);
+}
+
+/* Get what holding_file_get_dumpfile finds in a chunk, from the manifest if
+ * its directory is current there, else from its header.  Chunks still being
+ * written are always read, since they grow.
+ *
+ * @returns: an entry to free with free_manifest_entry, or NULL if the chunk
+ * does not exist
+ */
+static manifest_entry_t *
+get_chunk_entry(
+    char *chunk)
+{
+    manifest_entry_t *e = NULL;
+    gboolean known = FALSE;
+    char *hdisk, *dir, *name, *hdir;
+    struct stat st;
+
+    split_chunk_path(chunk, &hdisk, &dir, &name);
+    hdir = g_path_get_dirname(chunk);
+    if (!g_str_has_suffix(name, ".tmp") && stat(hdir, &st) == 0) {
+	manifest_dir_t *md;
+
+	g_static_mutex_lock(&manifest_mutex);
+	md = lookup_manifest_dir(get_manifest(hdisk), dir, FALSE);
+	if (manifest_dir_is_current(md, &st)) {
+	    known = TRUE;
+	    if ((e = g_hash_table_lookup(md->entries, name)) != NULL)
+		e = copy_manifest_entry(e);
+	}
+	g_static_mutex_unlock(&manifest_mutex);
+    }
+    if (!known)
+	e = read_manifest_entry(chunk);
+
+    g_free(hdisk);
+    g_free(dir);
+    g_free(name);
+    g_free(hdir);
+    return e;
+}
+
+holding_change_t *
+holding_change_begin(
+    char *chunk)
+{
+    holding_change_t *change = g_new0(holding_change_t, 1);
+    char *name;
+    struct stat st;
+
+    split_chunk_path(chunk, &change->hdisk, &change->dir, &name);
+    change->hdir = g_path_get_dirname(chunk);
+    change->names = g_slist_prepend(NULL, name);
+
+    if ((change->lock = lock_manifest(change->hdisk)) != NULL) {
+	manifest_dir_t *md;
+
+	g_static_mutex_lock(&manifest_mutex);
+	md = lookup_manifest_dir(get_manifest(change->hdisk), change->dir, FALSE);
+	if (stat(change->hdir, &st) == 0) {
+	    change->was_current = manifest_dir_is_current(md, &st);
+	    if (change->was_current) {
+		change->mtime = md->mtime;
+		change->mtime_ns = md->mtime_ns;
+		change->stamp = md->stamp;
+	    }
+	} else if (errno == ENOENT) {
+	    /* a new directory, with nothing in it yet */
+	    change->was_current = change->was_missing = TRUE;
+	}
+	g_static_mutex_unlock(&manifest_mutex);
+    }
+
+    return change;
+}
+
+void
+holding_change_also(
+    holding_change_t *change,
+    char *chunk)
+{
+    change->names = g_slist_prepend(change->names, g_path_get_basename(chunk));
+}
+
+void
+holding_change_end(
+    holding_change_t *change)
+{
+    struct stat st;
+
+    if (!change->lock) {
+	/* show the change to anyone who may have a stale view of the
+	 * directory, e.g., after a header was rewritten in place */
+	utime(change->hdir, NULL);
+    } else {
+	GString *records = g_string_new(NULL);
+	manifest_t *m;
+	GSList *iter;
+
+	if (change->was_missing) {
+	    char *qdir = quote_string_always(change->dir);
+	    g_string_append_printf(records, "FORGET %s\n", qdir);
+	    g_free(qdir);
+	}
+	for (iter = change->names; iter != NULL; iter = iter->next) {
+	    char *chunk = g_strconcat(change->hdir, "/", (char *)iter->data, NULL);
+	    manifest_entry_t *e = read_manifest_entry(chunk);
+
+	    append_entry_record(records, change->dir, iter->data, e);
+	    if (e)
+		free_manifest_entry(e);
+	    g_free(chunk);
+	}
+
+	g_static_mutex_lock(&manifest_mutex);
+	m = get_manifest(change->hdisk);
+	write_manifest_records(m, records);
+
+	/* the directory stays current if its record is the one found at the
+	 * beginning, and its names are now exactly its entries, so that no
+	 * other program added or removed anything meanwhile; its new mtime is
+	 * recorded, taken before the names are read and checked after.  Else
+	 * the next walk rescans it, as it does a new directory. */
+	if (change->was_current && !change->was_missing
+	    && stat(change->hdir, &st) == 0) {
+	    manifest_dir_t *md = lookup_manifest_dir(m, change->dir, FALSE);
+	    struct stat now_st;
+
+	    if (md && md->mtime == change->mtime
+		&& md->mtime_ns == change->mtime_ns
+		&& md->stamp == change->stamp
+		&& manifest_dir_names_match(md, change->hdir)
+		&& stat(change->hdir, &now_st) == 0
+		&& now_st.st_mtime == st.st_mtime
+		&& stat_mtime_ns(&now_st) == stat_mtime_ns(&st)) {
+		g_string_truncate(records, 0);
+		append_dir_record(records, change->dir, st.st_mtime,
+				  stat_mtime_ns(&st), time(NULL));
+		write_manifest_records(m, records);
+	    }
+	}
+	g_static_mutex_unlock(&manifest_mutex);
+
+	g_string_free(records, TRUE);
+	file_lock_free(change->lock);
+    }
+
+    slist_free_full(change->names, g_free);
+    g_free(change->hdisk);
+    g_free(change->hdir);
+    g_free(change->dir);
+    g_free(change);
+}
+
 /*
  * Recursion functions
  *
@@ -185,7 +1056,7 @@ static void holding_walk_file(
     gpointer datap,
     holding_walk_fn per_chunk_fn)
 {
-    dumpfile_t file;
+    manifest_entry_t *e;
     char *filename = NULL;
 
     /* Loop through all cont_filenames (subsequent chunks) */
@@ -193,8 +1064,8 @@ static void holding_walk_file(
     while (filename != NULL && filename[0] != '\0') {
 	int is_cruft = 0;
 
-        /* get the header to look for cont_filename */
-        if (!holding_file_get_dumpfile(filename, &file)) {
+        /* look for cont_filename */
+        if ((e = get_chunk_entry(filename)) == NULL || !e->readable) {
 	    is_cruft = 1;
         }
 
@@ -208,8 +1079,9 @@ static void holding_walk_file(
 
         /* and go on to the next chunk if this wasn't cruft */
 	if (!is_cruft)
-	    filename = g_strdup(file.cont_filename);
-	dumpfile_free_data(&file);
+	    filename = g_strdup(e->cont_filename);
+	if (e)
+	    free_manifest_entry(e);
     }
 
     amfree(filename);
@@ -218,7 +1090,8 @@ static void holding_walk_file(
 /* Recurse over all holding files in a holding directory.
  *
  * Call per_file_fn for each file, and so on, stopping at the level given by 
- * stop_at.
+ * stop_at.  The chunks are taken from the manifest when the directory is
+ * current there.
  *
  * datap is passed, unchanged, to all holding_walk_fns.
  *
@@ -235,63 +1108,47 @@ static void holding_walk_dir(
     holding_walk_fn per_file_fn,
     holding_walk_fn per_chunk_fn)
 {
-    DIR *dir;
-    struct dirent *workdir;
+    GPtrArray *entries;
+    guint i;
     char *hfile = NULL;
-    dumpfile_t dumpf;
-    int dumpf_ok;
     int proceed = 1;
 
-    if ((dir = opendir(hdir)) == NULL) {
-        if (errno != ENOENT)
-           dbprintf(_("Warning: could not open holding dir %s: %s\n"),
-                  hdir, strerror(errno));
+    if ((entries = get_holding_dir_entries(hdir)) == NULL)
         return;
-    }
 
-    while ((workdir = readdir(dir)) != NULL) {
+    for (i = 0; i < entries->len; i++) {
+	manifest_entry_t *e = g_ptr_array_index(entries, i);
 	int is_cruft = 0;
 
-        if (is_dot_or_dotdot(workdir->d_name))
-            continue; /* expected cruft */
-
         g_free(hfile);
-        hfile = g_strconcat(hdir, "/", workdir->d_name, NULL);
-
-        /* filter out various undesirables */
-        if (is_emptyfile(hfile))
-            is_cruft = 1;
+        hfile = g_strconcat(hdir, "/", e->name, NULL);
 
-        if (is_dir(hfile)) {
-            is_cruft= 1;
-        }
-
-        if (!(dumpf_ok=holding_file_get_dumpfile(hfile, &dumpf)) ||
-            dumpf.type != F_DUMPFILE) {
-            if (dumpf_ok && dumpf.type == F_CONT_DUMPFILE)
+        /* filter out various undesirables; empty files and directories
+         * have no readable header */
+        if (!e->readable || e->type != F_DUMPFILE) {
+            if (e->readable && e->type == F_CONT_DUMPFILE)
                 continue; /* silently skip expected file */
 
             is_cruft = 1;
         }
 
-	if (dumpf.dumplevel < 0 || dumpf.dumplevel > 9) {
+	if (e->readable && (e->dumplevel < 0 || e->dumplevel > 9)) {
 	    is_cruft = 1;
 	}
 
 	if (per_file_fn) 
 	    proceed = per_file_fn(datap, 
 			hdir, 
-			workdir->d_name, 
+			e->name, 
 			hfile, 
 			is_cruft);
 	if (!is_cruft && proceed && stop_at != STOP_AT_FILE)
 	    holding_walk_file(hfile,
 		    datap,
 		    per_chunk_fn);
-	dumpfile_free_data(&dumpf);
     }
 
-    closedir(dir);
+    free_entries(entries);
     amfree(hfile);
 }
 
@@ -340,7 +1197,9 @@ holding_walk_disk(
         hdir = g_strconcat(hdisk, "/", workdir->d_name, NULL);
 
         /* detect cruft */
-        if (!is_dir(hdir)) {
+        if (g_str_has_prefix(workdir->d_name, MANIFEST_NAME)) {
+	    continue; /* the manifest and its lock */
+        } else if (!is_dir(hdir)) {
 	    is_cruft = 1;
         } else if (!is_datestr(workdir->d_name)) {
             /* EXT2/3 leave these in the root of each volume */
@@ -428,7 +1287,7 @@ typedef struct {
 } holding_get_datap_t;
 
 /* Functor for holding_get_*; adds 'element' or 'fqpath' to
- * the result.
+ * the result, which the caller sorts.
  */
 static int
 holding_get_walk_fn(
@@ -444,13 +1303,9 @@ holding_get_walk_fn(
     if (is_cruft) return 0;
 
     if (data->fullpaths)
-	data->result = g_slist_insert_sorted(data->result,
-		g_strdup(fqpath), 
-		g_compare_strings);
+	data->result = g_slist_prepend(data->result, g_strdup(fqpath));
     else
-	data->result = g_slist_insert_sorted(data->result, 
-		g_strdup(element), 
-		g_compare_strings);
+	data->result = g_slist_prepend(data->result, g_strdup(element));
 
     /* don't proceed any deeper */
     return 0;
@@ -467,7 +1322,7 @@ holding_get_disks(void)
 	STOP_AT_DISK,
 	holding_get_walk_fn, NULL, NULL, NULL);
 
-    return data.result;
+    return g_slist_sort(data.result, g_compare_strings);
 }
 
 GSList *
@@ -489,7 +1344,7 @@ holding_get_files(
 	    NULL, NULL, holding_get_walk_fn, NULL);
     }
 
-    return data.result;
+    return g_slist_sort(data.result, g_compare_strings);
 }
 
 GSList *
@@ -502,7 +1357,7 @@ holding_get_file_chunks(char *hfile)
     holding_walk_file(hfile, (gpointer)&data,
 	holding_get_walk_fn);
 
-    return data.result;
+    return g_slist_sort(data.result, g_compare_strings);
 }
 
 GSList *
@@ -520,7 +1375,7 @@ holding_get_files_for_flush(
     file_list = holding_get_files(NULL, 1);
     for (file_elt = file_list; file_elt != NULL; file_elt = file_elt->next) {
         /* get info on that file */
-	if (!holding_file_get_dumpfile((char *)file_elt->data, &file))
+	if (!holding_file_get_summary((char *)file_elt->data, &file))
 	    continue;
 
         if (file.type != F_DUMPFILE) {
@@ -546,16 +1401,14 @@ holding_get_files_for_flush(
             continue;
 	}
 
-        /* passed all tests -- we'll flush this file */
-        result_list = g_slist_insert_sorted(result_list, 
-	    g_strdup(file_elt->data), 
-	    g_compare_strings);
+        /* passed all tests -- we'll flush this file; file_list is sorted */
+        result_list = g_slist_prepend(result_list, g_strdup(file_elt->data));
 	dumpfile_free_data(&file);
     }
 
     if (file_list) slist_free_full(file_list, g_free);
 
-    return result_list;
+    return g_slist_reverse(result_list);
 }
 
 GSList *
@@ -568,7 +1421,7 @@ holding_get_all_datestamps(void)
     all_files = holding_get_files(NULL, 1);
     for (file = all_files; file != NULL; file = file->next) {
 	dumpfile_t dfile;
-	if (!holding_file_get_dumpfile((char *)file->data, &dfile))
+	if (!holding_file_get_summary((char *)file->data, &dfile))
 	    continue;
 	if (!g_slist_find_custom(datestamps, dfile.datestamp,
 				 g_compare_strings)) {
@@ -589,38 +1442,37 @@ holding_file_size(
     char *hfile,
     int strip_headers)
 {
-    dumpfile_t file;
+    manifest_entry_t *e;
     char *filename;
     off_t size = (off_t)0;
-    struct stat finfo;
 
     /* (note: we don't use holding_get_file_chunks here because that would
-     * entail opening each file twice) */
+     * entail looking up each chunk twice) */
 
     /* Loop through all cont_filenames (subsequent chunks) */
     filename = g_strdup(hfile);
     while (filename != NULL && filename[0] != '\0') {
-        /* stat the file for its size */
-        if (stat(filename, &finfo) == -1) {
-	    dbprintf(_("stat %s: %s\n"), filename, strerror(errno));
+        /* get the size of the chunk, and look for cont_filename */
+        if ((e = get_chunk_entry(filename)) == NULL) {
+	    dbprintf(_("stat %s: %s\n"), filename, strerror(ENOENT));
             size = -1;
 	    break;
         }
-        size += (finfo.st_size+(off_t)1023)/(off_t)1024;
+        size += (e->size+(off_t)1023)/(off_t)1024;
         if (strip_headers)
             size -= (off_t)(DISK_BLOCK_BYTES / 1024);
 
-        /* get the header to look for cont_filename */
-        if (!holding_file_get_dumpfile(filename, &file)) {
+        if (!e->readable) {
 	    dbprintf(_("holding_file_size: open of %s failed.\n"), filename);
+	    free_manifest_entry(e);
             size = -1;
 	    break;
         }
 
         /* on to the next chunk */
         g_free(filename);
-        filename = g_strdup(file.cont_filename);
-	dumpfile_free_data(&file);
+        filename = g_strdup(e->cont_filename);
+	free_manifest_entry(e);
     }
     amfree(filename);
     return size;
@@ -639,12 +1491,19 @@ holding_file_unlink(
         return 0;
 
     for (chunk = chunklist; chunk != NULL; chunk = chunk->next) {
-        if (unlink((char *)chunk->data)<0) {
+	holding_change_t *change = holding_change_begin((char *)chunk->data);
+	int failed = unlink((char *)chunk->data) < 0;
+
+	if (failed)
 	    dbprintf(_("holding_file_unlink: could not unlink %s: %s\n"),
                     (char *)chunk->data, strerror(errno));
+	holding_change_end(change);
+	if (failed) {
+	    slist_free_full(chunklist, g_free);
             return 0;
-        }
+	}
     }
+    slist_free_full(chunklist, g_free);
     return 1;
 }
 
@@ -673,6 +1532,34 @@ holding_file_get_dumpfile(
     return 1;
 }
 
+int
+holding_file_get_summary(
+    char *	fname,
+    dumpfile_t *file)
+{
+    manifest_entry_t *e;
+
+    fh_init(file);
+    file->type = F_UNKNOWN;
+    if ((e = get_chunk_entry(fname)) == NULL)
+	return 0;
+    if (!e->readable) {
+	free_manifest_entry(e);
+	return 0;
+    }
+
+    file->type = e->type;
+    g_strlcpy(file->name, e->hostname, sizeof(file->name));
+    g_strlcpy(file->disk, e->diskname, sizeof(file->disk));
+    g_strlcpy(file->datestamp, e->datestamp, sizeof(file->datestamp));
+    file->dumplevel = e->dumplevel;
+    file->is_partial = e->is_partial;
+    file->orig_size = e->orig_size;
+    g_strlcpy(file->cont_filename, e->cont_filename, sizeof(file->cont_filename));
+    free_manifest_entry(e);
+    return 1;
+}
+
 /*
  * Cleanup
  */
@@ -759,7 +1646,7 @@ holding_cleanup_file(
     }
 
 
-    stat = holding_file_get_dumpfile(fqpath, &file);
+    stat = holding_file_get_summary(fqpath, &file);
 
     if (!stat) {
 	if (data->verbose_output)
@@ -857,10 +1744,13 @@ holding_set_origsize(
     char        buffer[DISK_BLOCK_BYTES];
     char       *read_buffer;
     dumpfile_t  file;
+    holding_change_t *change;
 
+    change = holding_change_begin(holding_file);
     if((fd = robust_open(holding_file, O_RDWR, 0)) == -1) {
 	dbprintf(_("holding_set_origsize: open of %s failed: %s\n"),
 		 holding_file, strerror(errno));
+	holding_change_end(change);
 	return;
     }
 
@@ -868,6 +1758,7 @@ holding_set_origsize(
     if (buflen <= 0) {
 	dbprintf(_("holding_set_origsize: %s: empty file?\n"), holding_file);
 	close(fd);
+	holding_change_end(change);
 	return;
     }
     parse_file_header(buffer, &file, (size_t)buflen);
@@ -878,6 +1769,7 @@ holding_set_origsize(
     dumpfile_free_data(&file);
     amfree(read_buffer);
     close(fd);
+    holding_change_end(change);
 }
 
 int
@@ -895,12 +1787,17 @@ rename_tmp_holding(
     memset(buffer, 0, sizeof(buffer));
     filename = g_strdup(holding_file);
     while(filename != NULL && filename[0] != '\0') {
+	holding_change_t *change;
+
 	g_free(filename_tmp);
 	filename_tmp = g_strconcat(filename, ".tmp", NULL);
+	change = holding_change_begin(filename_tmp);
+	holding_change_also(change, filename);
 	if((fd = robust_open(filename_tmp,O_RDONLY, 0)) == -1) {
 	    dbprintf(_("rename_tmp_holding: open of %s failed: %s\n"),filename_tmp,strerror(errno));
 	    amfree(filename);
 	    amfree(filename_tmp);
+	    holding_change_end(change);
 	    return 0;
 	}
 	buflen = read_fully(fd, buffer, sizeof(buffer), NULL);
@@ -915,6 +1812,7 @@ rename_tmp_holding(
 	    dbprintf(_("rename_tmp_holding: %s: empty file?\n"), filename);
 	    amfree(filename);
 	    amfree(filename_tmp);
+	    holding_change_end(change);
 	    return 0;
 	}
 	parse_file_header(buffer, &file, (size_t)buflen);
@@ -926,6 +1824,7 @@ rename_tmp_holding(
 		dumpfile_free_data(&file);
 		amfree(filename);
 		amfree(filename_tmp);
+		holding_change_end(change);
 		return 0;
 
 	    }
@@ -943,11 +1842,13 @@ rename_tmp_holding(
 		amfree(filename_tmp);
 		free(header);
 		close(fd);
+		holding_change_end(change);
 		return 0;
 	    }
 	    free(header);
 	    close(fd);
 	}
+	holding_change_end(change);
 	g_free(filename);
 	filename = g_strdup(file.cont_filename);
 	dumpfile_free_data(&file);
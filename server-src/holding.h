@@ -43,7 +43,12 @@
  * /data/holding/20070306123456/videoserver._video_a   <-- holding file,
                                                            holding file chunk
  * /data/holding/20070306123456/videoserver._video_a.1 <-- holding file chunk
+ * /data/holding/.holding-manifest                     <-- manifest
  *
+ * The manifest of a holding disk records the header and size of each chunk
+ * in its holding directories, so that they can be listed without reading
+ * every header; see holding.c.  A directory which changed behind its back
+ * is rebuilt from the headers the next time it is walked.
  */
 
 #ifndef HOLDING_H
@@ -135,6 +140,18 @@ int
 holding_file_get_dumpfile(char *fname,
                           dumpfile_t *file);
 
+/* Like holding_file_get_dumpfile, but only fill in type, name, disk,
+ * datestamp, dumplevel, is_partial, orig_size and cont_filename, taking
+ * them from the manifest if it is current.
+ *
+ * @param fname: full pathname of holding file
+ * @param file: (result) dumpfile_t structure
+ * @returns: 1 on success, else 0
+ */
+int
+holding_file_get_summary(char *fname,
+                         dumpfile_t *file);
+
 /*
  * Maintenance
  */
@@ -191,4 +208,27 @@ rename_tmp_holding(char *holding_file,
 int
 mkholdingdir(char *diskdir);
 
+/* Record a change to holding file chunks in the manifest.  Call
+ * holding_change_begin before creating, renaming, rewriting or removing a
+ * chunk, and holding_change_end after; the latter records what it then finds
+ * in the chunk, and in any other chunk of the same holding directory given
+ * to holding_change_also (e.g., the new name of a renamed chunk).  The
+ * manifest is locked in between, so keep the change short, and do not begin
+ * another one.
+ *
+ * @param chunk: full pathname of the holding file chunk
+ * @returns: the change, for holding_change_end
+ */
+typedef struct holding_change_s holding_change_t;
+
+holding_change_t *
+holding_change_begin(char *chunk);
+
+void
+holding_change_also(holding_change_t *change,
+                    char *chunk);
+
+void
+holding_change_end(holding_change_t *change);
+
 #endif /* HOLDING_H */
@@ -32,9 +32,15 @@
 #include "amanda.h"
 #include "util.h"
 #include "conffile.h"
+#include "event.h"
 
 #include "logfile.h"
 
+/* in batch mode, write the lines once this many bytes are waiting, or once
+ * the first has waited this many seconds */
+#define LOG_BATCH_SIZE (64*1024)
+#define LOG_BATCH_SECONDS 1
+
 char *logtype_str[] = {
     "BOGUS",
     "FATAL",		/* program died for some reason, used by error() */
@@ -64,6 +70,21 @@ int multiline = -1;
 static char *logfile;
 static int logfd = -1;
 
+/* the thread adding a line, so that a line it logs meanwhile (e.g., through
+ * error()) is dropped instead of recursing */
+static GThread *in_log_add = NULL;
+
+/* lines not yet written, in batch mode; NULL otherwise.  Lines may be added
+ * from any thread (e.g., g_critical from an xfer thread), so the batch and
+ * the log file are guarded by log_mutex, but the timer which flushes the
+ * batch is only used from the thread which started the batch, which runs
+ * the event loop; a line from another thread is written at once. */
+static GStaticMutex log_mutex = G_STATIC_MUTEX_INIT;
+static GString *batch = NULL;
+static pid_t batch_pid;
+static GThread *batch_thread;
+static event_handle_t *batch_ev = NULL;
+
  /*
   * Note that technically we could use two locks, a read lock
   * from 0-EOF and a write-lock from EOF-EOF, thus leaving the
@@ -76,6 +97,11 @@ static int logfd = -1;
 /* local functions */
 static void open_log(void);
 static void close_log(void);
+static void log_batch_check_fork(void);
+static void log_batch_added(logtype_t typ);
+static void log_batch_write(void);
+static void log_batch_timeout(void *cookie);
+static void log_flush_atexit(void);
 
 void
 amanda_log_trace_log(
@@ -101,11 +127,11 @@ static void log_add_full_v(logtype_t typ, char *pname, char *format, va_list arg
     char *leader = NULL;
     char *xlated_fmt = gettext(format);
     char linebuf[STR_SIZE];
+    char *line;
     size_t n;
-    static gboolean in_log_add = 0;
 
     /* avoid recursion */
-    if (in_log_add)
+    if (in_log_add == g_thread_self())
 	return;
 
     /* format error message */
@@ -122,35 +148,196 @@ static void log_add_full_v(logtype_t typ, char *pname, char *format, va_list arg
     g_vsnprintf(linebuf, sizeof(linebuf)-2, xlated_fmt, argp);
 						/* -1 to allow for '\n' */
 
+    /* add a newline if necessary */
+    n = strlen(linebuf);
+    if(n == 0 || linebuf[n-1] != '\n') linebuf[n++] = '\n';
+    linebuf[n] = '\0';
+
+    g_static_mutex_lock(&log_mutex);
+    log_batch_check_fork();
+
     /* avoid recursive call from error() */
 
-    in_log_add = 1;
+    in_log_add = g_thread_self();
+
+    /* in batch mode, the line waits for the rest of the batch */
+
+    if (batch) {
+	g_string_append(batch, leader);
+	g_string_append_len(batch, linebuf, n);
+	amfree(leader);
+	if(multiline != -1) multiline++;
+	log_batch_added(typ);
+	in_log_add = NULL;
+	g_static_mutex_unlock(&log_mutex);
+	return;
+    }
+
+    /* append message to the log file, in a single write */
 
-    /* append message to the log file */
+    line = g_strconcat(leader, linebuf, NULL);
+    amfree(leader);
 
     if(multiline == -1) open_log();
 
-    if (full_write(logfd, leader, strlen(leader)) < strlen(leader)) {
+    n = strlen(line);
+    if (full_write(logfd, line, n) < n) {
 	error(_("log file write error: %s"), strerror(errno));
 	/*NOTREACHED*/
     }
 
-    amfree(leader);
+    amfree(line);
 
-    /* add a newline if necessary */
-    n = strlen(linebuf);
-    if(n == 0 || linebuf[n-1] != '\n') linebuf[n++] = '\n';
-    linebuf[n] = '\0';
+    if(multiline != -1) multiline++;
+    else close_log();
+
+    in_log_add = NULL;
+    g_static_mutex_unlock(&log_mutex);
+}
+
+/* A child forked from a process in batch mode, e.g., to exec a compressor,
+ * leaves the batch to its parent and writes its own lines directly.  Called
+ * with log_mutex held. */
+static void
+log_batch_check_fork(void)
+{
+    if (!batch || getpid() == batch_pid)
+	return;
+
+    g_string_free(batch, TRUE);
+    batch = NULL;
+    batch_ev = NULL;
+    if (logfd != -1) {
+	close(logfd);
+	logfd = -1;
+	amfree(logfile);
+    }
+}
+
+/* Decide whether the batch, to which a line of type TYP was just added, is
+ * to be written now.  Called with log_mutex held. */
+static void
+log_batch_added(
+    logtype_t typ)
+{
+    gboolean batch_thread_is_self = (g_thread_self() == batch_thread);
+
+    /* a multiline entry is written whole, unless the program is dying; a
+     * line from another thread cannot wait for the timer */
+    if (typ == L_FATAL || (multiline == -1 &&
+	    (typ == L_ERROR || typ == L_START || typ == L_FINISH ||
+	     batch->len >= LOG_BATCH_SIZE || !batch_thread_is_self))) {
+	if (batch_thread_is_self && batch_ev) {
+	    event_release(batch_ev);
+	    batch_ev = NULL;
+	}
+	log_batch_write();
+	return;
+    }
+
+    if (batch_thread_is_self && !batch_ev)
+	batch_ev = event_register((event_id_t)LOG_BATCH_SECONDS, EV_TIME,
+				  log_batch_timeout, NULL);
+}
 
-    if (full_write(logfd, linebuf, n) < n) {
+/* Write the batch.  Called with log_mutex held, and in_log_add set. */
+static void
+log_batch_write(void)
+{
+    if (!batch || batch->len == 0)
+	return;
+
+    open_log();
+
+    if (full_write(logfd, batch->str, batch->len) < batch->len) {
+	g_string_truncate(batch, 0);
 	error(_("log file write error: %s"), strerror(errno));
 	/*NOTREACHED*/
     }
+    g_string_truncate(batch, 0);
 
-    if(multiline != -1) multiline++;
-    else close_log();
+    close_log();
+}
+
+static void
+log_batch_timeout(
+    void *	cookie G_GNUC_UNUSED)
+{
+    if (multiline == -1)
+	log_flush();
+}
+
+static void
+log_flush_atexit(void)
+{
+    /* the event loop is gone by now */
+    batch_ev = NULL;
+    log_flush();
+}
+
+void
+log_start_batch(void)
+{
+    static gboolean atexit_registered = FALSE;
+
+    g_static_mutex_lock(&log_mutex);
+    if (batch) {
+	g_static_mutex_unlock(&log_mutex);
+	return;
+    }
+
+    batch = g_string_sized_new(LOG_BATCH_SIZE);
+    batch_pid = getpid();
+    batch_thread = g_thread_self();
+    g_static_mutex_unlock(&log_mutex);
+    if (!atexit_registered) {
+	atexit(log_flush_atexit);
+	atexit_registered = TRUE;
+    }
+}
+
+void
+log_flush(void)
+{
+    /* e.g., at exit, from error() in the middle of a write */
+    if (in_log_add == g_thread_self())
+	return;
+
+    g_static_mutex_lock(&log_mutex);
+    log_batch_check_fork();
+
+    if (batch_ev && g_thread_self() == batch_thread) {
+	event_release(batch_ev);
+	batch_ev = NULL;
+    }
+
+    in_log_add = g_thread_self();
+    log_batch_write();
+    in_log_add = NULL;
+    g_static_mutex_unlock(&log_mutex);
+}
+
+void
+log_end_batch(void)
+{
+    if (!batch)
+	return;
 
-    in_log_add = 0;
+    log_flush();
+
+    g_static_mutex_lock(&log_mutex);
+    if (batch) {
+	g_string_free(batch, TRUE);
+	batch = NULL;
+    }
+
+    /* close_log left the log file open for the next batch */
+    if (logfd != -1) {
+	close(logfd);
+	logfd = -1;
+	amfree(logfile);
+    }
+    g_static_mutex_unlock(&log_mutex);
 }
 
 void log_add(logtype_t typ, char *format, ...)
@@ -176,8 +363,13 @@ log_start_multiline(void)
 {
     assert(multiline == -1);
 
+    g_static_mutex_lock(&log_mutex);
+    in_log_add = g_thread_self();
     multiline = 0;
-    open_log();
+    if (!batch)
+	open_log();
+    in_log_add = NULL;
+    g_static_mutex_unlock(&log_mutex);
 }
 
 
@@ -185,8 +377,16 @@ void
 log_end_multiline(void)
 {
     assert(multiline != -1);
+
+    g_static_mutex_lock(&log_mutex);
+    in_log_add = g_thread_self();
     multiline = -1;
-    close_log();
+    if (batch)
+	log_batch_added(L_BOGUS);
+    else
+	close_log();
+    in_log_add = NULL;
+    g_static_mutex_unlock(&log_mutex);
 }
 
 
@@ -229,6 +429,19 @@ static void
 open_log(void)
 {
     char *conf_logdir;
+    struct stat path_stat, fd_stat;
+
+    /* in batch mode, the log file stays open from one batch to the next,
+     * unless it has been renamed since */
+    if (logfd != -1) {
+	if (stat(logfile, &path_stat) == 0 && fstat(logfd, &fd_stat) == 0 &&
+	    path_stat.st_dev == fd_stat.st_dev &&
+	    path_stat.st_ino == fd_stat.st_ino)
+	    goto lock;
+	close(logfd);
+	logfd = -1;
+	amfree(logfile);
+    }
 
     conf_logdir = config_dir_relative(getconf_str(CNF_LOGDIR));
     logfile = g_strjoin(NULL, conf_logdir, "/log", NULL);
@@ -241,6 +454,11 @@ open_log(void)
 	/*NOTREACHED*/
     }
 
+    /* don't hand the open log to the programs we run */
+    if (batch)
+	fcntl(logfd, F_SETFD, FD_CLOEXEC);
+
+lock:
     if(amflock(logfd, "log") == -1) {
 	error(_("could not lock log file %s: %s"), logfile, strerror(errno));
 	/*NOTREACHED*/
@@ -256,6 +474,9 @@ close_log(void)
 	/*NOTREACHED*/
     }
 
+    if (batch)
+	return;
+
     if(close(logfd) == -1) {
 	error(_("close log file: %s"), strerror(errno));
 	/*NOTREACHED*/
@@ -74,6 +74,17 @@ void log_add(logtype_t typ, char * format, ...) G_GNUC_PRINTF(2, 3);
 void log_add_full(logtype_t typ, char *pname, char *format, ...) G_GNUC_PRINTF(3, 4);
 void log_start_multiline(void);
 void log_end_multiline(void);
+
+/* In batch mode, lines are kept in memory and appended to the log together,
+ * in one write under one lock, by log_flush.  The log file is left open
+ * between batches.  A batch is written once it is large or a second old,
+ * when an ERROR, FATAL, START or FINISH line is added, and at exit.  A
+ * multiline entry is never split between batches.  The timer needs the
+ * event loop; a program that does not run one should call log_flush before
+ * it waits for anything. */
+void log_start_batch(void);
+void log_flush(void);
+void log_end_batch(void);
 void log_rename(char *datestamp);
 int get_logline(FILE *);
 
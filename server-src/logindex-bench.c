@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94085, USA, or: http://www.zmanda.com
+ */
+
+/* Measure how long it takes to read a trace log with get_logline, splitting
+ * out the host, disk and datestamp of each dump line as find.c does, and to
+ * read it with logindex_read; then how long it takes to find the lines about
+ * each dle in the index.
+ *
+ * Unless -f is given, the log is a synthetic one of about -n lines (100000
+ * by default), written to a temporary file, with the lines of an amdump run
+ * for a dle every eight lines or so.
+ */
+
+#include "amanda.h"
+#include "util.h"
+#include "glib-util.h"
+#include "logfile.h"
+#include "logindex.h"
+
+#include <getopt.h>
+
+static void
+usage(void)
+{
+    g_fprintf(stderr,
+"USAGE: logindex-bench [-n lines] [-f logfile]\n"
+"  Time reading a trace log with get_logline and with logindex_read.\n"
+"  Without -f, a synthetic log of about 'lines' lines (default 100000)\n"
+"  is written to a temporary file.\n");
+
+    exit(EXIT_FAILURE);
+}
+
+static char *
+write_synthetic_log(
+    int nb_lines)
+{
+    static const char *ts = "20100722000000";
+    char *filename = g_strdup("/tmp/logindex-bench.XXXXXX");
+    FILE *f;
+    int fd, i, level;
+
+    if ((fd = g_mkstemp(filename)) < 0 || (f = fdopen(fd, "w")) == NULL)
+	g_critical("could not create %s: %s", filename, strerror(errno));
+
+    g_fprintf(f, "INFO amdump amdump pid 1234\n");
+    g_fprintf(f, "START planner date %s\n", ts);
+    g_fprintf(f, "START driver date %s\n", ts);
+    g_fprintf(f, "START taper datestamp %s label BENCH-001 tape 1\n", ts);
+    for (i = 0; i * 8 < nb_lines; i++) {
+	char *host = g_strdup_printf("host%04d.example.com", i / 10);
+	char *qdisk = (i % 7 == 0) ? g_strdup_printf("\"/data/my files %d\"", i)
+				   : g_strdup_printf("/data/fs%d", i);
+
+	level = i % 3;
+	g_fprintf(f, "DISK planner %s %s\n", host, qdisk);
+	g_fprintf(f, "STATS driver estimate %s %s %s %d [sec 12 nkb 40000 ckb 20000 kps 1666]\n",
+		  host, qdisk, ts, level);
+	g_fprintf(f, "SUCCESS dumper %s %s %s %d [sec 10.2 kb 19980 kps 1958.8 orig-kb 40012]\n",
+		  host, qdisk, ts, level);
+	g_fprintf(f, "SUCCESS chunker %s %s %s %d [sec 10.3 kb 19980 kps 1940.1]\n",
+		  host, qdisk, ts, level);
+	g_fprintf(f, "STATS driver estimate %s %s %s %d [sec 10 nkb 40012 ckb 19980 kps 1958]\n",
+		  host, qdisk, ts, level);
+	g_fprintf(f, "PART taper BENCH-001 %d %s %s %s 1/-1 %d [sec 1.1 bytes 10485760 kps 9309.1]\n",
+		  2 * i + 1, host, qdisk, ts, level);
+	g_fprintf(f, "PART taper BENCH-001 %d %s %s %s 2/-1 %d [sec 1.0 bytes 9973760 kps 9740.0]\n",
+		  2 * i + 2, host, qdisk, ts, level);
+	g_fprintf(f, "DONE taper %s %s %s 2 %d [sec 2.1 bytes 20459520 kps 9514.3 orig-kb 40012]\n",
+		  host, qdisk, ts, level);
+	g_free(host);
+	g_free(qdisk);
+    }
+    g_fprintf(f, "FINISH driver date %s time 3600.0\n", ts);
+    fclose(f);
+
+    return filename;
+}
+
+/* what a consumer of get_logline does for each line about a dump */
+static int
+split_dle_line(void)
+{
+    char *s = curstr, *host, *qdisk, *disk, *date;
+    int ch = *s++;
+
+    if (curlog != L_SUCCESS && curlog != L_DONE && curlog != L_PART
+	&& curlog != L_STATS)
+	return 0;
+
+    if (curlog == L_PART) {
+	skip_whitespace(s, ch);
+	skip_quoted_string(s, ch);
+	skip_whitespace(s, ch);
+	skip_non_whitespace(s, ch);
+    } else if (curlog == L_STATS) {
+	skip_whitespace(s, ch);
+	skip_non_whitespace(s, ch);
+    }
+    skip_whitespace(s, ch);
+    host = s - 1;
+    skip_non_whitespace(s, ch);
+    s[-1] = '\0';
+    skip_whitespace(s, ch);
+    qdisk = s - 1;
+    skip_quoted_string(s, ch);
+    s[-1] = '\0';
+    skip_whitespace(s, ch);
+    date = s - 1;
+    skip_non_whitespace(s, ch);
+
+    disk = unquote_string(qdisk);
+    ch = (*host != '\0' && *disk != '\0' && *date != '\0');
+    g_free(disk);
+    return ch;
+}
+
+int
+main(int argc, char **argv)
+{
+    int nb_lines = 100000;
+    char *filename = NULL;
+    gboolean synthetic;
+    FILE *logf;
+    logindex_t *idx;
+    GPtrArray *dles;
+    GTimer *timer;
+    gdouble elapsed_logline, elapsed_index, elapsed_lookup;
+    guint lines = 0, dle_lines = 0, found = 0, i;
+    int c;
+
+    glib_init();
+    set_pname("logindex-bench");
+
+    while ((c = getopt(argc, argv, "n:f:")) != -1) {
+	switch (c) {
+	case 'n': nb_lines = atoi(optarg); break;
+	case 'f': filename = g_strdup(optarg); break;
+	default: usage();
+	}
+    }
+    if (optind != argc || nb_lines <= 0)
+	usage();
+
+    synthetic = (filename == NULL);
+    if (synthetic)
+	filename = write_synthetic_log(nb_lines);
+
+    timer = g_timer_new();
+
+    /* get_logline, one line at a time */
+    g_timer_start(timer);
+    if ((logf = fopen(filename, "r")) == NULL)
+	g_critical("could not open %s: %s", filename, strerror(errno));
+    while (get_logline(logf)) {
+	lines++;
+	dle_lines += split_dle_line();
+    }
+    fclose(logf);
+    elapsed_logline = g_timer_elapsed(timer, NULL);
+
+    /* logindex_read, all at once */
+    g_timer_start(timer);
+    if ((idx = logindex_read(filename)) == NULL)
+	g_critical("could not read %s: %s", filename, strerror(errno));
+    elapsed_index = g_timer_elapsed(timer, NULL);
+
+    /* the lines about each dle */
+    dles = logindex_dles(idx);
+    g_timer_start(timer);
+    for (i = 0; i < dles->len; i++) {
+	logindex_dle_t *dle = g_ptr_array_index(dles, i);
+	GArray *found_lines = logindex_lookup(idx, dle->hostname,
+					      dle->diskname, dle->datestamp);
+	found += found_lines->len;
+	g_array_free(found_lines, TRUE);
+    }
+    elapsed_lookup = g_timer_elapsed(timer, NULL);
+
+    g_printf("%s: %u lines, %u about a dump, %u dles\n",
+	     synthetic ? "synthetic log" : filename, lines, dle_lines,
+	     dles->len);
+    g_printf("get_logline:    %8.3f s\n", elapsed_logline);
+    g_printf("logindex_read:  %8.3f s (%u lines, %u indexed)\n",
+	     elapsed_index, logindex_nlines(idx), found);
+    g_printf("lookup each dle:%8.3f s\n", elapsed_lookup);
+
+    logindex_free(idx);
+    g_timer_destroy(timer);
+    if (synthetic)
+	unlink(filename);
+    g_free(filename);
+
+    return 0;
+}
@@ -0,0 +1,478 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94085, USA, or: http://www.zmanda.com
+ */
+
+#include "amanda.h"
+#include "util.h"
+#include "logindex.h"
+
+/* the lines about one dle; the dle comes first, so that the entry can be
+ * used as its own key */
+typedef struct dle_entry_s {
+    logindex_dle_t dle;
+    GArray *lines;			/* guint line numbers */
+} dle_entry_t;
+
+struct logindex_s {
+    char       *data;			/* the file, split into lines */
+    GArray     *lines;			/* logindex_line_t */
+    GStringChunk *chunk;
+    GHashTable *strings;		/* the host, disk and datestamp strings */
+    GHashTable *by_dle;			/* dle_entry_t -> itself */
+    GHashTable *by_host;		/* hostname -> GPtrArray of dle_entry_t */
+    GPtrArray  *dles;			/* dle_entry_t *, in file order */
+};
+
+static GHashTable *logtypes = NULL;	/* logtype_str -> logtype_t + 1 */
+static GHashTable *programs = NULL;	/* program_str -> program_t + 1 */
+
+static void
+init_names(void)
+{
+    int i;
+
+    if (logtypes)
+	return;
+    logtypes = g_hash_table_new(g_str_hash, g_str_equal);
+    for (i = L_BOGUS; i <= L_MARKER; i++)
+	g_hash_table_insert(logtypes, logtype_str[i], GINT_TO_POINTER(i + 1));
+    programs = g_hash_table_new(g_str_hash, g_str_equal);
+    for (i = P_UNKNOWN; i <= P_LAST; i++)
+	g_hash_table_insert(programs, program_str[i], GINT_TO_POINTER(i + 1));
+}
+
+/* keys are compared by address, since their strings are interned */
+static guint
+dle_hash(
+    gconstpointer key)
+{
+    const logindex_dle_t *dle = key;
+
+    return g_direct_hash(dle->hostname) ^ (g_direct_hash(dle->diskname) * 31)
+	 ^ (g_direct_hash(dle->datestamp) * 961);
+}
+
+static gboolean
+dle_equal(
+    gconstpointer a,
+    gconstpointer b)
+{
+    const logindex_dle_t *da = a, *db = b;
+
+    return da->hostname == db->hostname && da->diskname == db->diskname
+	&& da->datestamp == db->datestamp;
+}
+
+static char *
+intern(
+    logindex_t *idx,
+    char       *s)
+{
+    char *r = g_hash_table_lookup(idx->strings, s);
+
+    if (!r) {
+	r = g_string_chunk_insert(idx->chunk, s);
+	g_hash_table_insert(idx->strings, r, r);
+    }
+    return r;
+}
+
+/* the next token in S, as skip_non_whitespace or skip_quoted_string find
+ * it; sets *END past it, and returns NULL if there is none */
+static char *
+next_token(
+    char     *s,
+    char    **end,
+    gboolean  quoted)
+{
+    char *t;
+    int iq = 0;
+
+    while (g_ascii_isspace(*s))
+	s++;
+    if (*s == '\0')
+	return NULL;
+    for (t = s; *t != '\0' && (iq || !g_ascii_isspace(*t)); t++) {
+	if (!quoted)
+	    continue;
+	if (*t == '"') {
+	    iq = !iq;
+	} else if (*t == '\\' && t[1] != '\0') {
+	    t++;
+	}
+    }
+    *end = t;
+    return s;
+}
+
+/* index LINE if it is about a dump */
+static void
+index_dle_line(
+    logindex_t      *idx,
+    logindex_line_t *line,
+    guint            lineno)
+{
+    char *s = line->str, *e, *tok;
+    char *host, *qdisk, *disk, *datestamp = NULL;
+    logindex_dle_t key;
+    dle_entry_t *entry;
+    GPtrArray *host_dles;
+
+    switch (line->type) {
+    case L_PART:
+    case L_PARTPARTIAL:
+	/* the label and file number come first */
+	if (!next_token(s, &e, TRUE) || !next_token(e, &s, FALSE))
+	    return;
+	break;
+
+    case L_STATS:
+	if (!(tok = next_token(s, &e, FALSE)) || e - tok != 8
+	    || strncmp(tok, "estimate", 8) != 0)
+	    return;
+	s = e;
+	break;
+
+    case L_DISK:
+    case L_DONE:
+    case L_SUCCESS:
+    case L_PARTIAL:
+    case L_FAIL:
+    case L_STRANGE:
+    case L_CHUNK:
+    case L_CHUNKSUCCESS:
+	break;
+
+    default:
+	return;
+    }
+
+    if (!(tok = next_token(s, &e, FALSE)))
+	return;
+    host = g_strndup(tok, e - tok);
+    if (!(tok = next_token(e, &s, TRUE))) {
+	g_free(host);
+	return;
+    }
+    qdisk = g_strndup(tok, s - tok);
+    if (line->type != L_DISK) {
+	if (!(tok = next_token(s, &e, FALSE))) {
+	    g_free(host);
+	    g_free(qdisk);
+	    return;
+	}
+	datestamp = g_strndup(tok, e - tok);
+	s = e;
+    }
+    while (g_ascii_isspace(*s))
+	s++;
+
+    disk = unquote_string(qdisk);
+    line->hostname = intern(idx, host);
+    line->diskname = intern(idx, disk);
+    line->datestamp = datestamp ? intern(idx, datestamp) : NULL;
+    line->rest = s;
+    g_free(host);
+    g_free(qdisk);
+    g_free(disk);
+    g_free(datestamp);
+
+    key.hostname = line->hostname;
+    key.diskname = line->diskname;
+    key.datestamp = line->datestamp;
+    entry = g_hash_table_lookup(idx->by_dle, &key);
+    if (!entry) {
+	entry = g_new0(dle_entry_t, 1);
+	entry->dle = key;
+	entry->lines = g_array_new(FALSE, FALSE, sizeof(guint));
+	g_hash_table_insert(idx->by_dle, entry, entry);
+	g_ptr_array_add(idx->dles, entry);
+	host_dles = g_hash_table_lookup(idx->by_host, key.hostname);
+	if (!host_dles) {
+	    host_dles = g_ptr_array_new();
+	    g_hash_table_insert(idx->by_host, key.hostname, host_dles);
+	}
+	g_ptr_array_add(host_dles, entry);
+    }
+    g_array_append_val(entry->lines, lineno);
+}
+
+/* split the line starting at S, as get_logline does */
+static void
+add_line(
+    logindex_t *idx,
+    char       *s,
+    program_t  *prevprog)
+{
+    logindex_line_t line;
+    char *typestr, *progstr, *e;
+    gpointer p;
+
+    memset(&line, 0, sizeof(line));
+
+    if (s[0] == ' ' && s[1] == ' ') {
+	line.type = L_CONT;
+	line.prog = *prevprog;
+	while (g_ascii_isspace(*s))
+	    s++;
+	line.str = s;
+    } else {
+	e = s;
+	typestr = next_token(s, &e, FALSE);
+	if (*e != '\0')
+	    *e++ = '\0';
+	progstr = next_token(e, &s, FALSE);
+	if (progstr && *s != '\0')
+	    *s++ = '\0';
+	if (!progstr)
+	    s = e;
+	while (g_ascii_isspace(*s))
+	    s++;
+	line.str = s;
+
+	p = typestr ? g_hash_table_lookup(logtypes, typestr) : NULL;
+	line.type = p ? (logtype_t)(GPOINTER_TO_INT(p) - 1) : L_BOGUS;
+	p = progstr ? g_hash_table_lookup(programs, progstr) : NULL;
+	line.prog = p ? (program_t)(GPOINTER_TO_INT(p) - 1) : P_UNKNOWN;
+	*prevprog = line.prog;
+    }
+
+    g_array_append_val(idx->lines, line);
+    index_dle_line(idx, &g_array_index(idx->lines, logindex_line_t,
+				       idx->lines->len - 1),
+		   idx->lines->len - 1);
+}
+
+static gboolean
+read_file(
+    const char *filename,
+    char      **datap,
+    gsize      *sizep)
+{
+    struct stat st;
+    char *data;
+    gsize size = 0;
+    ssize_t n;
+    int fd, save_errno;
+
+    if ((fd = open(filename, O_RDONLY)) < 0)
+	return FALSE;
+    if (fstat(fd, &st) < 0) {
+	save_errno = errno;
+	close(fd);
+	errno = save_errno;
+	return FALSE;
+    }
+
+    /* the log may still be growing; read what is there now */
+    data = g_malloc(st.st_size + 1);
+    while (size < (gsize)st.st_size) {
+	n = read(fd, data + size, st.st_size - size);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    save_errno = errno;
+	    close(fd);
+	    g_free(data);
+	    errno = save_errno;
+	    return FALSE;
+	}
+	if (n == 0)
+	    break;
+	size += n;
+    }
+    close(fd);
+    data[size] = '\0';
+
+    *datap = data;
+    *sizep = size;
+    return TRUE;
+}
+
+static void
+free_ptr_array(
+    gpointer data)
+{
+    g_ptr_array_free(data, TRUE);
+}
+
+logindex_t *
+logindex_read(
+    const char *filename)
+{
+    logindex_t *idx;
+    char *data, *r, *w, *start;
+    gsize size;
+    program_t prevprog = P_UNKNOWN;
+    gboolean inquote = FALSE, escape = FALSE;
+
+    if (!read_file(filename, &data, &size))
+	return NULL;
+    init_names();
+
+    idx = g_new0(logindex_t, 1);
+    idx->data = data;
+    idx->lines = g_array_sized_new(FALSE, FALSE, sizeof(logindex_line_t),
+				   size / 80 + 1);
+    idx->chunk = g_string_chunk_new(16384);
+    idx->strings = g_hash_table_new(g_str_hash, g_str_equal);
+    idx->by_dle = g_hash_table_new(dle_hash, dle_equal);
+    idx->by_host = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+					 free_ptr_array);
+    idx->dles = g_ptr_array_new();
+
+    /* Split the lines in place, as agets does: a newline in quotes is part
+     * of the line, and an escaped newline is dropped.  Lines only get
+     * shorter, so W never passes R. */
+    start = w = data;
+    for (r = data; r < data + size; r++) {
+	if (*r == '\n' && !inquote) {
+	    if (escape) {
+		escape = FALSE;
+		w--;
+		continue;
+	    }
+	    *w = '\0';
+	    if (*start != '\0')
+		add_line(idx, start, &prevprog);
+	    start = ++w;
+	    continue;
+	}
+	if (*r == '\\') {
+	    escape = !escape;
+	} else {
+	    if (*r == '"' && !escape)
+		inquote = !inquote;
+	    escape = FALSE;
+	}
+	*w++ = *r;
+    }
+    *w = '\0';
+    if (*start != '\0')
+	add_line(idx, start, &prevprog);
+
+    return idx;
+}
+
+void
+logindex_free(
+    logindex_t *idx)
+{
+    guint i;
+
+    if (!idx)
+	return;
+    for (i = 0; i < idx->dles->len; i++) {
+	dle_entry_t *entry = g_ptr_array_index(idx->dles, i);
+	g_array_free(entry->lines, TRUE);
+	g_free(entry);
+    }
+    g_ptr_array_free(idx->dles, TRUE);
+    g_hash_table_destroy(idx->by_dle);
+    g_hash_table_destroy(idx->by_host);
+    g_hash_table_destroy(idx->strings);
+    g_string_chunk_free(idx->chunk);
+    g_array_free(idx->lines, TRUE);
+    g_free(idx->data);
+    g_free(idx);
+}
+
+guint
+logindex_nlines(
+    logindex_t *idx)
+{
+    return idx->lines->len;
+}
+
+logindex_line_t *
+logindex_line(
+    logindex_t *idx,
+    guint       i)
+{
+    if (i >= idx->lines->len)
+	return NULL;
+    return &g_array_index(idx->lines, logindex_line_t, i);
+}
+
+static gint
+compare_lineno(
+    gconstpointer a,
+    gconstpointer b)
+{
+    guint la = *(const guint *)a, lb = *(const guint *)b;
+
+    return la < lb ? -1 : la > lb;
+}
+
+GArray *
+logindex_lookup(
+    logindex_t *idx,
+    const char *hostname,
+    const char *diskname,
+    const char *datestamp)
+{
+    GArray *result = g_array_new(FALSE, FALSE, sizeof(guint));
+    char *host = NULL, *disk = NULL, *ds = NULL;
+    dle_entry_t *entry;
+    GPtrArray *entries;
+    guint i, nmatch = 0;
+
+    /* a name which is not interned is not in the log */
+    if ((hostname && !(host = g_hash_table_lookup(idx->strings, hostname)))
+	|| (diskname && !(disk = g_hash_table_lookup(idx->strings, diskname)))
+	|| (datestamp && !(ds = g_hash_table_lookup(idx->strings, datestamp))))
+	return result;
+
+    if (host && disk && ds) {
+	logindex_dle_t key;
+
+	key.hostname = host;
+	key.diskname = disk;
+	key.datestamp = ds;
+	entry = g_hash_table_lookup(idx->by_dle, &key);
+	if (entry)
+	    g_array_append_vals(result, entry->lines->data, entry->lines->len);
+	return result;
+    }
+
+    /* otherwise, look through the dles of the host, or all of them */
+    entries = host ? g_hash_table_lookup(idx->by_host, host) : idx->dles;
+    if (!entries)
+	return result;
+    for (i = 0; i < entries->len; i++) {
+	entry = g_ptr_array_index(entries, i);
+	if ((disk && entry->dle.diskname != disk)
+	    || (ds && entry->dle.datestamp != ds))
+	    continue;
+	g_array_append_vals(result, entry->lines->data, entry->lines->len);
+	nmatch++;
+    }
+    if (nmatch > 1)
+	g_array_sort(result, compare_lineno);
+
+    return result;
+}
+
+GPtrArray *
+logindex_dles(
+    logindex_t *idx)
+{
+    /* each entry starts with its logindex_dle_t */
+    return idx->dles;
+}
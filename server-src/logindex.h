@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) Zmanda Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94085, USA, or: http://www.zmanda.com
+ */
+
+/*
+ * An in-memory index of a trace log.
+ *
+ * logindex_read reads the whole log at once and splits each line as
+ * get_logline does.  The lines about a dump (DISK, DONE, PART, PARTPARTIAL,
+ * SUCCESS, PARTIAL, FAIL, STRANGE, CHUNK and CHUNKSUCCESS lines, and the
+ * driver's 'estimate' STATS lines) are also split into the host, the
+ * (unquoted) disk, the datestamp and the rest of the line, and indexed by
+ * host, disk and datestamp, so that the lines about one dle can be found
+ * without reading the others.
+ *
+ * The host, disk and datestamp strings are shared by all the lines with the
+ * same value, and live as long as the index.
+ */
+
+#ifndef LOGINDEX_H
+#define LOGINDEX_H
+
+#include "amanda.h"
+#include "logfile.h"
+
+typedef struct logindex_line_s {
+    logtype_t  type;
+    program_t  prog;
+    char      *str;		/* the rest of the line, as curstr */
+
+    /* for a line about a dump; NULL otherwise */
+    char      *hostname;
+    char      *diskname;
+    char      *datestamp;	/* NULL on a DISK line */
+    char      *rest;		/* what follows the datestamp */
+} logindex_line_t;
+
+/* A dle named in the log */
+typedef struct logindex_dle_s {
+    char      *hostname;
+    char      *diskname;
+    char      *datestamp;
+} logindex_dle_t;
+
+typedef struct logindex_s logindex_t;
+
+/* Read and index FILENAME.
+ *
+ * @returns: the index, or NULL with errno set if the file can't be read
+ */
+logindex_t *logindex_read(const char *filename);
+
+void logindex_free(logindex_t *idx);
+
+/* The number of lines, not counting the empty ones */
+guint logindex_nlines(logindex_t *idx);
+
+/* Line I of the log, from 0; NULL past the end */
+logindex_line_t *logindex_line(logindex_t *idx, guint i);
+
+/* The numbers of the lines about HOSTNAME, DISKNAME and DATESTAMP, in file
+ * order.  A NULL argument matches any value.  Free the array with
+ * g_array_free.
+ */
+GArray *logindex_lookup(logindex_t *idx, const char *hostname,
+			const char *diskname, const char *datestamp);
+
+/* The dles named in the log, as logindex_dle_t *, in the order they first
+ * appear; the array belongs to the index.
+ */
+GPtrArray *logindex_dles(logindex_t *idx);
+
+#endif /* LOGINDEX_H */
@@ -54,12 +54,12 @@ const char *cmdstr[] = {
 };
 
 
+static struct cmdargs *parse_cmd(char *line);
+
 struct cmdargs *
 getcmd(void)
 {
     char *line;
-    cmd_t cmd_i;
-    struct cmdargs *cmdargs = g_new0(struct cmdargs, 1);
 
     if (isatty(0)) {
 	g_printf("%s> ", get_pname());
@@ -68,6 +68,26 @@ getcmd(void)
     } else {
         line = agets(stdin);
     }
+
+    return parse_cmd(line);
+}
+
+struct cmdargs *
+getcmd_fd(
+    int fd)
+{
+    return parse_cmd(areads(fd));
+}
+
+/* split a command line into a struct cmdargs; frees LINE, and treats
+ * NULL (EOF) as QUIT */
+static struct cmdargs *
+parse_cmd(
+    char *line)
+{
+    cmd_t cmd_i;
+    struct cmdargs *cmdargs = g_new0(struct cmdargs, 1);
+
     if (line == NULL) {
 	line = g_strdup("QUIT");
     }
@@ -127,6 +147,9 @@ void putresult(cmd_t result, const char *format, ...)
 {
     va_list argp;
 
+    /* the driver may act on the result; let it find what we logged first */
+    log_flush();
+
     arglist_start(argp, format);
     dbprintf(_("putresult: %d %s\n"), result, cmdstr[result]);
     g_printf("%s ", cmdstr[result]);
@@ -61,6 +61,11 @@ struct cmdargs {
 };
 
 struct cmdargs *getcmd(void);
+
+/* Like getcmd, but read the command from FD with areads(), so that the
+ * caller can use areads_dataready(FD) to see if another command is already
+ * buffered.  Do not mix with getcmd() on the same descriptor. */
+struct cmdargs *getcmd_fd(int fd);
 struct cmdargs *get_pending_cmd(void);
 void free_cmdargs(struct cmdargs *cmdargs);
 void putresult(cmd_t result, const char *, ...) G_GNUC_PRINTF(2, 3);
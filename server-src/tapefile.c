@@ -35,25 +35,51 @@
 
 static tape_t *tape_list = NULL;
 
+/* indexes of tape_list, maintained along with it: the tapes by position
+ * (from 0), and, for each label and each datestamp, the first tape in the
+ * list with it and the number of tapes with it.  Adding or removing a tape
+ * only drops tape_by_pos; it and the positions are rebuilt by the next lookup
+ * that needs them, so a series of changes does not renumber the list each
+ * time. */
+static GPtrArray *tape_by_pos = NULL;
+static GHashTable *tape_by_label = NULL;
+static GHashTable *tape_by_date = NULL;
+
+typedef struct tape_key_s {
+    tape_t *first;
+    guint count;
+} tape_key_t;
+
 /* local functions */
 static tape_t *parse_tapeline(int *status, char *line);
-static tape_t *insert(tape_t *list, tape_t *tp);
+static gint compare_tapes(gconstpointer a, gconstpointer b);
+static void index_tapelist(void);
+static void index_positions(void);
+static tape_t *first_tape(GHashTable *index, const char *key);
+static void index_key(GHashTable *index, char *key, tape_t *tp, gboolean at_head);
+static void unindex_key(GHashTable *index, char *key, tape_t *tp, glong key_offset);
+static void link_tape(tape_t *tp);
+static void unlink_tape(tape_t *tp);
+static void free_tape(tape_t *tp);
 static time_t stamp2time(char *datestamp);
 
 int
 read_tapelist(
     char *tapefile)
 {
-    tape_t *tp;
+    tape_t *tp, *last;
     FILE *tapef;
-    int pos;
+    GPtrArray *tapes, *kept;
+    GHashTable *labels;
     char *line = NULL;
     int status = 0;
+    guint i;
 
-    tape_list = NULL;
+    clear_tapelist();
     if((tapef = fopen(tapefile,"r")) == NULL) {
 	if (errno == ENOENT) {
 	    /* no tapelist is equivalent to an empty tapelist */
+	    index_tapelist();
 	    return 0;
 	} else {
 	    g_debug("Error opening '%s': %s", tapefile, strerror(errno));
@@ -61,7 +87,10 @@ read_tapelist(
 	}
     }
 
+    tapes = g_ptr_array_new();
+    last = NULL;
     while((line = agets(tapef)) != NULL) {
+	last = NULL;
 	if (line[0] == '\0') {
 	    amfree(line);
 	    continue;
@@ -70,16 +99,56 @@ read_tapelist(
 	amfree(line);
 	if (tp == NULL && status != 0) {
 	    afclose(tapef);
+	    for (i = 0; i < tapes->len; i++)
+		free_tape(g_ptr_array_index(tapes, i));
+	    g_ptr_array_free(tapes, TRUE);
+	    index_tapelist();
 	    return 1;
 	}
-	if (tp != NULL)
-	    tape_list = insert(tape_list, tp);
+	if (tp != NULL) {
+	    g_ptr_array_add(tapes, tp);
+	    last = tp;
+	}
+    }
+
+    /* a last line without a newline is what a crash in the middle of
+     * Amanda::Tapelist appending to the file leaves; ignore it */
+    if (last != NULL && fseek(tapef, -1, SEEK_END) == 0 && getc(tapef) != '\n') {
+	g_ptr_array_remove_index(tapes, tapes->len - 1);
+	free_tape(last);
     }
     afclose(tapef);
 
-    for(pos=1,tp=tape_list; tp != NULL; pos++,tp=tp->next) {
-	tp->position = pos;
+    /* a later line for a label replaces the earlier ones; keep the file
+     * order in the position, so the sort below can leave tapes with the
+     * same datestamp in that order */
+    kept = g_ptr_array_new();
+    labels = g_hash_table_new(g_str_hash, g_str_equal);
+    for (i = tapes->len; i > 0; i--) {
+	tp = g_ptr_array_index(tapes, i - 1);
+	if (g_hash_table_lookup(labels, tp->label)) {
+	    free_tape(tp);
+	    continue;
+	}
+	g_hash_table_insert(labels, tp->label, tp);
+	tp->position = i;
+	g_ptr_array_add(kept, tp);
     }
+    g_hash_table_destroy(labels);
+    g_ptr_array_free(tapes, TRUE);
+
+    /* sort in reversed datestamp order, and link the list */
+    g_ptr_array_sort(kept, compare_tapes);
+    for (i = kept->len; i > 0; i--) {
+	tp = g_ptr_array_index(kept, i - 1);
+	tp->next = tape_list;
+	if (tape_list)
+	    tape_list->prev = tp;
+	tape_list = tp;
+    }
+    g_ptr_array_free(kept, TRUE);
+
+    index_tapelist();
 
     return 0;
 }
@@ -132,24 +201,31 @@ clear_tapelist(void)
     tape_t *tp, *next;
 
     for(tp = tape_list; tp; tp = next) {
-	amfree(tp->label);
-	amfree(tp->datestamp);
 	next = tp->next;
-	amfree(tp);
+	free_tape(tp);
     }
     tape_list = NULL;
+
+    if (tape_by_pos) {
+	g_ptr_array_free(tape_by_pos, TRUE);
+	tape_by_pos = NULL;
+    }
+    if (tape_by_label) {
+	g_hash_table_destroy(tape_by_label);
+	tape_by_label = NULL;
+    }
+    if (tape_by_date) {
+	g_hash_table_destroy(tape_by_date);
+	tape_by_date = NULL;
+    }
 }
 
 tape_t *
 lookup_tapelabel(
     const char *label)
 {
-    tape_t *tp;
-
-    for(tp = tape_list; tp != NULL; tp = tp->next) {
-	if(g_str_equal(label, tp->label)) return tp;
-    }
-    return NULL;
+    index_positions();
+    return first_tape(tape_by_label, label);
 }
 
 
@@ -158,12 +234,10 @@ tape_t *
 lookup_tapepos(
     int pos)
 {
-    tape_t *tp;
-
-    for(tp = tape_list; tp != NULL; tp = tp->next) {
-	if(tp->position == pos) return tp;
-    }
-    return NULL;
+    index_positions();
+    if (!tape_by_pos || pos < 1 || (guint)pos > tape_by_pos->len)
+	return NULL;
+    return g_ptr_array_index(tape_by_pos, pos - 1);
 }
 
 
@@ -171,24 +245,17 @@ tape_t *
 lookup_tapedate(
     char *datestamp)
 {
-    tape_t *tp;
-
-    for(tp = tape_list; tp != NULL; tp = tp->next) {
-	if(g_str_equal(tp->datestamp, datestamp)) return tp;
-    }
-    return NULL;
+    index_positions();
+    return first_tape(tape_by_date, datestamp);
 }
 
 int
 lookup_nb_tape(void)
 {
-    tape_t *tp;
-    int pos=0;
-
-    for(tp = tape_list; tp != NULL; tp = tp->next) {
-	pos=tp->position;
-    }
-    return pos;
+    index_positions();
+    if (!tape_by_pos)
+	return 0;
+    return tape_by_pos->len;
 }
 
 
@@ -210,6 +277,9 @@ lookup_last_reusable_tape(
     int tapecycle = getconf_int(CNF_TAPECYCLE);
     char *labelstr = getconf_str (CNF_LABELSTR);
 
+    /* callers use the position of the tape returned */
+    index_positions();
+
     /*
      * The idea here is we keep the last "several" reusable tapes we
      * find in a stack and then return the n-th oldest one to the
@@ -257,27 +327,13 @@ void
 remove_tapelabel(
     char *label)
 {
-    tape_t *tp, *prev, *next;
+    tape_t *tp;
 
-    tp = lookup_tapelabel(label);
+    /* not lookup_tapelabel, which would renumber the list */
+    tp = first_tape(tape_by_label, label);
     if(tp != NULL) {
-	prev = tp->prev;
-	next = tp->next;
-	/*@ignore@*/
-	if(prev != NULL)
-	    prev->next = next;
-	else /* begin of list */
-	    tape_list = next;
-	if(next != NULL)
-	    next->prev = prev;
-	/*@end@*/
-	while (next != NULL) {
-	    next->position--;
-	    next = next->next;
-	}
-	amfree(tp->datestamp);
-	amfree(tp->label);
-	amfree(tp);
+	unlink_tape(tp);
+	free_tape(tp);
     }
 }
 
@@ -287,29 +343,20 @@ add_tapelabel(
     char *label,
     char *comment)
 {
-    tape_t *cur, *new;
+    tape_t *new;
 
     /* insert a new record to the front of the list */
 
-    new = (tape_t *) g_malloc(sizeof(tape_t));
+    new = (tape_t *) g_malloc0(sizeof(tape_t));
 
     new->datestamp = g_strdup(datestamp);
-    new->position = 0;
     new->reuse = 1;
     new->label = g_strdup(label);
     new->comment = comment? g_strdup(comment) : NULL;
 
-    new->prev  = NULL;
-    if(tape_list != NULL) tape_list->prev = new;
-    new->next = tape_list;
-    tape_list = new;
-
-    /* scan list, updating positions */
-    cur = tape_list;
-    while(cur != NULL) {
-	cur->position++;
-	cur = cur->next;
-    }
+    if (!tape_by_label)
+	index_tapelist();
+    link_tape(new);
 
     return new;
 }
@@ -444,37 +491,178 @@ parse_tapeline(
 }
 
 
-/* insert in reversed datestamp order */
-/*@ignore@*/
+/* reversed datestamp order, keeping the order of the file (which read_tapelist
+ * has stashed in the position) for tapes with the same datestamp */
+static gint
+compare_tapes(
+    gconstpointer a,
+    gconstpointer b)
+{
+    tape_t *tpa = *(tape_t **)a;
+    tape_t *tpb = *(tape_t **)b;
+    int r = strcmp(tpb->datestamp, tpa->datestamp);
+
+    if (r != 0)
+	return r;
+    return tpa->position - tpb->position;
+}
+
+/* (re)build the indexes and positions from tape_list */
+static void
+index_tapelist(void)
+{
+    tape_t *tp;
+
+    if (tape_by_pos)
+	g_ptr_array_free(tape_by_pos, TRUE);
+    if (tape_by_label)
+	g_hash_table_destroy(tape_by_label);
+    if (tape_by_date)
+	g_hash_table_destroy(tape_by_date);
+
+    tape_by_pos = NULL;
+    tape_by_label = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    tape_by_date = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    for (tp = tape_list; tp != NULL; tp = tp->next) {
+	index_key(tape_by_label, tp->label, tp, FALSE);
+	index_key(tape_by_date, tp->datestamp, tp, FALSE);
+    }
+    index_positions();
+}
+
+/* rebuild tape_by_pos and the positions, if a change dropped them */
+static void
+index_positions(void)
+{
+    tape_t *tp;
+
+    if (tape_by_pos || !tape_by_label)
+	return;
+
+    tape_by_pos = g_ptr_array_new();
+    for (tp = tape_list; tp != NULL; tp = tp->next) {
+	g_ptr_array_add(tape_by_pos, tp);
+	tp->position = tape_by_pos->len;
+    }
+}
+
 static tape_t *
-insert(
-    tape_t *list,
+first_tape(
+    GHashTable *index,
+    const char *key)
+{
+    tape_key_t *entry;
+
+    if (!index)
+	return NULL;
+    entry = g_hash_table_lookup(index, key);
+    return entry? entry->first : NULL;
+}
+
+/* count TP under KEY; it is the first with KEY if it is AT_HEAD of the list,
+ * or if it is the first one counted */
+static void
+index_key(
+    GHashTable *index,
+    char *key,
+    tape_t *tp,
+    gboolean at_head)
+{
+    tape_key_t *entry = g_hash_table_lookup(index, key);
+
+    if (!entry) {
+	entry = g_new0(tape_key_t, 1);
+	entry->first = tp;
+	g_hash_table_insert(index, g_strdup(key), entry);
+    } else if (at_head) {
+	entry->first = tp;
+    }
+    entry->count++;
+}
+
+/* uncount TP, still linked, from KEY; if it was the first with KEY, the next
+ * one with it in the list, found at KEY_OFFSET in each tape, is now the first.
+ * In the sorted list that is the next tape for a datestamp, and labels are
+ * rarely repeated, so this search is short. */
+static void
+unindex_key(
+    GHashTable *index,
+    char *key,
+    tape_t *tp,
+    glong key_offset)
+{
+    tape_key_t *entry = g_hash_table_lookup(index, key);
+    tape_t *other;
+
+    if (--entry->count == 0) {
+	g_hash_table_remove(index, key);
+	return;
+    }
+    if (entry->first == tp) {
+	for (other = tp->next; other != NULL; other = other->next) {
+	    if (g_str_equal(G_STRUCT_MEMBER(char *, other, key_offset), key))
+		break;
+	}
+	entry->first = other;
+    }
+}
+
+/* insert TP at the head of the list, and into the indexes */
+static void
+link_tape(
     tape_t *tp)
 {
-    tape_t *prev, *cur;
+    tp->prev = NULL;
+    tp->next = tape_list;
+    if (tape_list)
+	tape_list->prev = tp;
+    tape_list = tp;
 
-    prev = NULL;
-    cur = list;
+    index_key(tape_by_label, tp->label, tp, TRUE);
+    index_key(tape_by_date, tp->datestamp, tp, TRUE);
 
-    while(cur != NULL && strcmp(cur->datestamp, tp->datestamp) >= 0) {
-	prev = cur;
-	cur = cur->next;
+    if (tape_by_pos) {
+	g_ptr_array_free(tape_by_pos, TRUE);
+	tape_by_pos = NULL;
     }
-    tp->prev = prev;
-    tp->next = cur;
-    if(prev == NULL) {
-	list = tp;
-#ifndef __lint
-    } else {
-	prev->next = tp;
-#endif
+}
+
+/* remove TP from the list and the indexes, without freeing it */
+static void
+unlink_tape(
+    tape_t *tp)
+{
+    unindex_key(tape_by_label, tp->label, tp, G_STRUCT_OFFSET(tape_t, label));
+    unindex_key(tape_by_date, tp->datestamp, tp, G_STRUCT_OFFSET(tape_t, datestamp));
+
+    /*@ignore@*/
+    if(tp->prev != NULL)
+	tp->prev->next = tp->next;
+    else /* begin of list */
+	tape_list = tp->next;
+    if(tp->next != NULL)
+	tp->next->prev = tp->prev;
+    /*@end@*/
+    tp->next = tp->prev = NULL;
+
+    if (tape_by_pos) {
+	g_ptr_array_free(tape_by_pos, TRUE);
+	tape_by_pos = NULL;
     }
-    if(cur !=NULL)
-	cur->prev = tp;
+}
 
-    return list;
+static void
+free_tape(
+    tape_t *tp)
+{
+    amfree(tp->datestamp);
+    amfree(tp->label);
+    amfree(tp->barcode);
+    amfree(tp->meta);
+    amfree(tp->comment);
+    amfree(tp);
 }
-/*@end@*/
 
 /*
  * Converts datestamp (an char of the form YYYYMMDD or YYYYMMDDHHMMSS) into a real
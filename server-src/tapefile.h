@@ -46,6 +46,10 @@ typedef struct tape_s {
     char *comment;
 } tape_t;
 
+/* The lookups are by index, and take constant time; the first one after
+ * add_tapelabel or remove_tapelabel renumbers the list.  read_tapelist takes
+ * the last line for a label, which Amanda::Tapelist appends for a new or
+ * relabeled volume, and ignores a last line without a newline. */
 int read_tapelist(char *tapefile);
 int write_tapelist(char *tapefile);
 void clear_tapelist(void);
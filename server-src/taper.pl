@@ -25,7 +25,7 @@ package main;
 
 use Amanda::Util qw( :constants );
 use Amanda::Config qw( :init :getconf );
-use Amanda::Logfile qw( :logtype_t log_add $amanda_log_trace_log );
+use Amanda::Logfile qw( :logtype_t log_add log_start_batch $amanda_log_trace_log );
 use Amanda::Debug qw( debug );
 use Amanda::Taper::Controller;
 use Getopt::Long;
@@ -62,6 +62,7 @@ $| = 1;
 select($old_fh);
 
 log_add($L_INFO, "taper pid $$");
+log_start_batch();
 Amanda::Debug::add_amanda_log_handler($amanda_log_trace_log);
 
 Amanda::Util::finish_setup($RUNNING_AS_DUMPUSER);
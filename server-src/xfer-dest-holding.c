@@ -307,6 +307,7 @@ holding_thread(
 	    char    *pc;
 	    int      fd;
 	    ssize_t  write_header_size;
+	    holding_change_t *change;
 
 	    if (self->use_bytes < HEADER_BLOCK_BYTES) {
 		self->chunk_status = CHUNK_NO_ROOM;
@@ -314,6 +315,7 @@ holding_thread(
 	    }
 
 	    tmp_filename = g_strjoin(NULL, self->new_filename, ".tmp", NULL);
+	    change = holding_change_begin(tmp_filename);
 	    pc = strrchr(tmp_filename, '/');
 	    g_assert(pc != NULL);
 	    *pc = '\0';
@@ -326,6 +328,7 @@ holding_thread(
 		g_free(mesg);
 		mesg = g_strdup_printf("Failed to open '%s': %s",
 				       tmp_filename, strerror(errno));
+		holding_change_end(change);
 		goto no_room;
 	    }
 	    if (self->filename == NULL) {
@@ -342,9 +345,11 @@ holding_thread(
 				       tmp_filename, strerror(errno));
 		close(fd);
 		unlink(tmp_filename);
+		holding_change_end(change);
 		g_free(tmp_filename);
 		goto no_room;
 	    }
+	    holding_change_end(change);
 	    self->use_bytes -= HEADER_BLOCK_BYTES;
 
 	    /* rewrite old_header */
@@ -563,6 +568,8 @@ close_chunk(
     char *cont_filename)
 {
     XferDestHolding *self = XFER_DEST_HOLDING(xdh);
+    char *tmp_filename = g_strjoin(NULL, self->filename, ".tmp", NULL);
+    holding_change_t *change = holding_change_begin(tmp_filename);
 
     lseek(self->fd, 0L, SEEK_SET);
     if (strcmp(self->filename, self->first_filename) == 0) {
@@ -578,6 +585,8 @@ close_chunk(
     }
     write_header(self, self->fd);
     close(self->fd);
+    holding_change_end(change);
+    g_free(tmp_filename);
     self->fd = -1;
     g_free(self->filename);
     self->filename = NULL;
@@ -37,6 +37,19 @@
 XferElement *xfer_source_holding(
     const char *filename);
 
+/* Skip the first BYTES bytes of dump data (not counting chunk headers), so
+ * that the transfer begins at that offset into the dump.  Chunks lying
+ * entirely before the offset are never read.  An offset past the end of the
+ * dump cancels the transfer with an error.  This must be called before the
+ * transfer starts.
+ *
+ * @param elt: the XferSourceHolding
+ * @param bytes: number of bytes to skip
+ */
+void xfer_source_holding_skip(
+    XferElement *elt,
+    guint64 bytes);
+
 
 /* A transfer destination that writes to holding file.
  *
@@ -50,6 +50,9 @@ typedef struct XferSourceHolding {
     int fd;
     char *next_filename;
 
+    /* bytes of dump data still to be skipped before the first buffer */
+    guint64 skip;
+
     XferElement *dest_taper;
 } XferSourceHolding;
 
@@ -72,6 +75,9 @@ start_new_chunk(
     char *hdrbuf = NULL;
     dumpfile_t hdr;
     size_t bytes_read;
+    struct stat st;
+    off_t data_offset = DISK_BLOCK_BYTES;
+    gboolean skip_chunk = FALSE;
 
     /* try to close an already-open file */
     if (self->fd != -1) {
@@ -87,6 +93,14 @@ start_new_chunk(
 
     /* if we have no next filename, then we're at EOF */
     if (!self->next_filename) {
+	/* running out of chunks while still skipping means the requested
+	 * offset lies beyond the end of the dump */
+	if (self->skip > 0) {
+	    xfer_cancel_with_error(XFER_ELEMENT(self),
+		"offset is %ju bytes past the end of the holding file",
+		(uintmax_t)self->skip);
+	    wait_until_xfer_cancelled(XFER_ELEMENT(self)->xfer);
+	}
 	return FALSE;
     }
 
@@ -116,23 +130,6 @@ start_new_chunk(
 	    self->dest_taper = iter;
     }
 
-    /* tell a XferDestTaper about the new file */
-    if (self->dest_taper) {
-	struct stat st;
-	if (fstat(self->fd, &st) < 0) {
-	    xfer_cancel_with_error(XFER_ELEMENT(self),
-		"while finding size of holding file '%s': %s",
-		self->next_filename, strerror(errno));
-	    wait_until_xfer_cancelled(XFER_ELEMENT(self)->xfer);
-	    return FALSE;
-	}
-
-	xfer_dest_taper_cache_inform(self->dest_taper,
-	    self->next_filename,
-	    DISK_BLOCK_BYTES,
-	    st.st_size - DISK_BLOCK_BYTES);
-    }
-
     /* read the header from the file and determine the filename of the next chunk */
     hdrbuf = g_malloc(DISK_BLOCK_BYTES);
     bytes_read = read_fully(self->fd, hdrbuf, DISK_BLOCK_BYTES, NULL);
@@ -158,6 +155,50 @@ start_new_chunk(
 	return FALSE;
     }
 
+    if (self->skip > 0 || self->dest_taper) {
+	if (fstat(self->fd, &st) < 0) {
+	    dumpfile_free_data(&hdr);
+	    xfer_cancel_with_error(XFER_ELEMENT(self),
+		"while finding size of holding file '%s': %s",
+		self->next_filename, strerror(errno));
+	    wait_until_xfer_cancelled(XFER_ELEMENT(self)->xfer);
+	    return FALSE;
+	}
+    }
+
+    /* skip any leading data the caller does not want; chunks that lie
+     * entirely before the desired offset are not read at all */
+    if (self->skip > 0) {
+	guint64 chunk_bytes = 0;
+
+	if (st.st_size > DISK_BLOCK_BYTES)
+	    chunk_bytes = st.st_size - DISK_BLOCK_BYTES;
+
+	if (self->skip >= chunk_bytes) {
+	    self->skip -= chunk_bytes;
+	    skip_chunk = TRUE;
+	} else {
+	    data_offset += self->skip;
+	    if (lseek(self->fd, data_offset, SEEK_SET) < 0) {
+		dumpfile_free_data(&hdr);
+		xfer_cancel_with_error(XFER_ELEMENT(self),
+		    "while seeking in holding file '%s': %s",
+		    self->next_filename, strerror(errno));
+		wait_until_xfer_cancelled(XFER_ELEMENT(self)->xfer);
+		return FALSE;
+	    }
+	    self->skip = 0;
+	}
+    }
+
+    /* tell a XferDestTaper about the new file */
+    if (self->dest_taper && !skip_chunk) {
+	xfer_dest_taper_cache_inform(self->dest_taper,
+	    self->next_filename,
+	    data_offset,
+	    st.st_size - data_offset);
+    }
+
     g_free(self->next_filename);
     if (hdr.cont_filename[0]) {
 	self->next_filename = g_strdup(hdr.cont_filename);
@@ -166,6 +207,9 @@ start_new_chunk(
     }
     dumpfile_free_data(&hdr);
 
+    if (skip_chunk)
+	return start_new_chunk(self);
+
     return TRUE;
 }
 
@@ -300,3 +344,14 @@ xfer_source_holding(
     return elt;
 }
 
+
+void
+xfer_source_holding_skip(
+    XferElement *elt,
+    guint64 bytes)
+{
+    XferSourceHolding *self = XFER_SOURCE_HOLDING(elt);
+
+    g_assert(self->fd == -1);
+    self->skip = bytes;
+}
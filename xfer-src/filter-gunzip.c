@@ -0,0 +1,464 @@
+/*
+ * Amanda, The Advanced Maryland Automatic Network Disk Archiver
+ * Copyright (c) 2008,2009 Zmanda, Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94085, USA, or: http://www.zmanda.com
+ */
+
+#include "amanda.h"
+#include "amxfer.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+
+/*
+ * Class declaration
+ *
+ * This declaration is entirely private; nothing but xfer_filter_gunzip() references
+ * it directly.
+ */
+
+GType xfer_filter_gunzip_get_type(void);
+#define XFER_FILTER_GUNZIP_TYPE (xfer_filter_gunzip_get_type())
+#define XFER_FILTER_GUNZIP(obj) G_TYPE_CHECK_INSTANCE_CAST((obj), xfer_filter_gunzip_get_type(), XferFilterGunzip)
+#define XFER_FILTER_GUNZIP_CONST(obj) G_TYPE_CHECK_INSTANCE_CAST((obj), xfer_filter_gunzip_get_type(), XferFilterGunzip const)
+#define XFER_FILTER_GUNZIP_CLASS(klass) G_TYPE_CHECK_CLASS_CAST((klass), xfer_filter_gunzip_get_type(), XferFilterGunzipClass)
+#define IS_XFER_FILTER_GUNZIP(obj) G_TYPE_CHECK_INSTANCE_TYPE((obj), xfer_filter_gunzip_get_type ())
+#define XFER_FILTER_GUNZIP_GET_CLASS(obj) G_TYPE_INSTANCE_GET_CLASS((obj), xfer_filter_gunzip_get_type(), XferFilterGunzipClass)
+
+static GObjectClass *parent_class = NULL;
+
+/* size of the buffers of uncompressed data */
+#define GUNZIP_BUFFER_SIZE (128*1024)
+
+/* most buffers waiting in the queue between the inflate thread and the rest
+ * of the transfer */
+#define GUNZIP_MAX_QUEUED 16
+
+/* a buffer in the queue; a NULL buf is EOF */
+typedef struct {
+    gpointer buf;
+    size_t size;
+} gunzip_buffer_t;
+
+/*
+ * Main object structure
+ */
+
+typedef struct XferFilterGunzip {
+    XferElement __parent__;
+
+    /* Decompression happens in its own thread, so that it overlaps with
+     * reading from the device and with writing the result.  In push mode, the
+     * queue holds compressed buffers from upstream, and the thread pushes the
+     * uncompressed data downstream; in pull mode, the thread pulls compressed
+     * buffers from upstream, and the queue holds uncompressed buffers for
+     * pull_buffer. */
+    GThread *thread;
+    GMutex *mutex;
+    GCond *cond;
+    GQueue *queue;
+
+    z_stream zs;
+    gboolean in_member;		/* inside a gzip member (not between members) */
+    gpointer outbuf;		/* partly-filled output buffer */
+} XferFilterGunzip;
+
+/*
+ * Class definition
+ */
+
+typedef struct {
+    XferElementClass __parent__;
+} XferFilterGunzipClass;
+
+/*
+ * Utilities
+ */
+
+/* add a buffer to the queue, waiting for room unless the xfer is cancelled */
+static void
+enqueue(
+    XferFilterGunzip *self,
+    gpointer buf,
+    size_t size)
+{
+    XferElement *elt = XFER_ELEMENT(self);
+    gunzip_buffer_t *gb = g_new(gunzip_buffer_t, 1);
+
+    gb->buf = buf;
+    gb->size = size;
+
+    g_mutex_lock(self->mutex);
+    while (buf && !elt->cancelled &&
+	   g_queue_get_length(self->queue) >= GUNZIP_MAX_QUEUED)
+	g_cond_wait(self->cond, self->mutex);
+    g_queue_push_tail(self->queue, gb);
+    g_cond_broadcast(self->cond);
+    g_mutex_unlock(self->mutex);
+}
+
+/* take a buffer from the queue, waiting if it is empty; returns NULL on EOF,
+ * or if the xfer is cancelled and STOP_ON_CANCEL is set */
+static gpointer
+dequeue(
+    XferFilterGunzip *self,
+    size_t *size,
+    gboolean stop_on_cancel)
+{
+    XferElement *elt = XFER_ELEMENT(self);
+    gunzip_buffer_t *gb;
+    gpointer buf;
+
+    g_mutex_lock(self->mutex);
+    while (g_queue_is_empty(self->queue) &&
+	   !(stop_on_cancel && elt->cancelled))
+	g_cond_wait(self->cond, self->mutex);
+    gb = g_queue_pop_head(self->queue);
+    g_cond_broadcast(self->cond);
+    g_mutex_unlock(self->mutex);
+
+    if (!gb) {
+	*size = 0;
+	return NULL;
+    }
+
+    buf = gb->buf;
+    *size = gb->size;
+    g_free(gb);
+    return buf;
+}
+
+/* hand a full (or final) output buffer to the rest of the transfer */
+static void
+emit_output(
+    XferFilterGunzip *self)
+{
+    XferElement *elt = XFER_ELEMENT(self);
+    size_t size = GUNZIP_BUFFER_SIZE - self->zs.avail_out;
+
+    if (size == 0)
+	return;
+
+    if (elt->output_mech == XFER_MECH_PUSH_BUFFER)
+	xfer_element_push_buffer(elt->downstream, self->outbuf, size);
+    else
+	enqueue(self, self->outbuf, size);
+
+    self->outbuf = NULL;
+    self->zs.avail_out = 0;
+}
+
+/* uncompress a buffer of gzip data.  Several gzip members may follow one
+ * another, as with gunzip; zero bytes between or after members are padding
+ * from the device, and are skipped.  Returns FALSE on error, after cancelling
+ * the xfer. */
+static gboolean
+inflate_buffer(
+    XferFilterGunzip *self,
+    guint8 *buf,
+    size_t len)
+{
+    XferElement *elt = XFER_ELEMENT(self);
+    int zerr;
+
+    self->zs.next_in = buf;
+    self->zs.avail_in = len;
+
+    while (self->zs.avail_in > 0 && !elt->cancelled) {
+	if (!self->in_member) {
+	    if (*self->zs.next_in == 0) {
+		self->zs.next_in++;
+		self->zs.avail_in--;
+		continue;
+	    }
+	    inflateReset(&self->zs);
+	    self->in_member = TRUE;
+	}
+
+	if (!self->outbuf) {
+	    self->outbuf = g_malloc(GUNZIP_BUFFER_SIZE);
+	    self->zs.next_out = self->outbuf;
+	    self->zs.avail_out = GUNZIP_BUFFER_SIZE;
+	}
+
+	zerr = inflate(&self->zs, Z_NO_FLUSH);
+	if (zerr == Z_STREAM_END) {
+	    self->in_member = FALSE;
+	} else if (zerr != Z_OK && zerr != Z_BUF_ERROR) {
+	    xfer_cancel_with_error(elt, _("error uncompressing data: %s"),
+		self->zs.msg? self->zs.msg : _("unknown zlib error"));
+	    return FALSE;
+	}
+
+	if (self->zs.avail_out == 0)
+	    emit_output(self);
+    }
+
+    return TRUE;
+}
+
+/* finish up at EOF from upstream; returns FALSE on error */
+static gboolean
+inflate_eof(
+    XferFilterGunzip *self)
+{
+    XferElement *elt = XFER_ELEMENT(self);
+
+    if (self->in_member && !elt->cancelled) {
+	xfer_cancel_with_error(elt, _("error uncompressing data: %s"),
+	    _("unexpected end of compressed data"));
+	return FALSE;
+    }
+
+    if (self->outbuf) {
+	emit_output(self);
+	amfree(self->outbuf);
+    }
+
+    return TRUE;
+}
+
+/*
+ * Implementation
+ */
+
+static gpointer
+inflate_thread(
+    gpointer data)
+{
+    XferFilterGunzip *self = XFER_FILTER_GUNZIP(data);
+    XferElement *elt = XFER_ELEMENT(self);
+    gboolean push = (elt->input_mech == XFER_MECH_PUSH_BUFFER);
+    gboolean ok = TRUE;
+    gpointer buf;
+    size_t size;
+
+    while (1) {
+	if (push)
+	    buf = dequeue(self, &size, TRUE);
+	else
+	    buf = xfer_element_pull_buffer(elt->upstream, &size);
+
+	if (!buf)
+	    break;
+
+	if (!elt->cancelled)
+	    ok = inflate_buffer(self, buf, size);
+	amfree(buf);
+
+	if (!ok)
+	    wait_until_xfer_cancelled(elt->xfer);
+
+	if (elt->cancelled) {
+	    /* in push mode, push_buffer discards anything further */
+	    if (!push && elt->expect_eof)
+		xfer_element_drain_buffers(elt->upstream);
+	    break;
+	}
+    }
+
+    if (!elt->cancelled && !inflate_eof(self))
+	wait_until_xfer_cancelled(elt->xfer);
+
+    /* pass along the EOF */
+    if (elt->output_mech == XFER_MECH_PUSH_BUFFER)
+	xfer_element_push_buffer(elt->downstream, NULL, 0);
+    else
+	enqueue(self, NULL, 0);
+
+    xfer_queue_message(elt->xfer, xmsg_new(elt, XMSG_DONE, 0));
+
+    return NULL;
+}
+
+static gboolean
+start_impl(
+    XferElement *elt)
+{
+    XferFilterGunzip *self = XFER_FILTER_GUNZIP(elt);
+
+    self->thread = g_thread_create(inflate_thread, (gpointer)self, TRUE, NULL);
+
+    /* the thread sends XMSG_DONE */
+    return TRUE;
+}
+
+static gboolean
+cancel_impl(
+    XferElement *elt,
+    gboolean expect_eof)
+{
+    XferFilterGunzip *self = XFER_FILTER_GUNZIP(elt);
+    gboolean rv;
+
+    rv = XFER_ELEMENT_CLASS(parent_class)->cancel(elt, expect_eof);
+
+    /* wake up anything waiting on the queue, so it notices */
+    g_mutex_lock(self->mutex);
+    g_cond_broadcast(self->cond);
+    g_mutex_unlock(self->mutex);
+
+    return rv;
+}
+
+static gpointer
+pull_buffer_impl(
+    XferElement *elt,
+    size_t *size)
+{
+    XferFilterGunzip *self = XFER_FILTER_GUNZIP(elt);
+
+    /* the inflate thread drains upstream, if necessary */
+    if (elt->cancelled) {
+	*size = 0;
+	return NULL;
+    }
+
+    return dequeue(self, size, TRUE);
+}
+
+static void
+push_buffer_impl(
+    XferElement *elt,
+    gpointer buf,
+    size_t len)
+{
+    XferFilterGunzip *self = XFER_FILTER_GUNZIP(elt);
+
+    /* drop the buffer if we've been cancelled */
+    if (elt->cancelled) {
+	amfree(buf);
+	return;
+    }
+
+    enqueue(self, buf, len);
+}
+
+static void
+instance_init(
+    XferElement *elt)
+{
+    XferFilterGunzip *self = XFER_FILTER_GUNZIP(elt);
+
+    elt->can_generate_eof = TRUE;
+
+    self->mutex = g_mutex_new();
+    self->cond = g_cond_new();
+    self->queue = g_queue_new();
+}
+
+static void
+finalize_impl(
+    GObject * obj_self)
+{
+    XferFilterGunzip *self = XFER_FILTER_GUNZIP(obj_self);
+    gunzip_buffer_t *gb;
+
+    if (self->thread)
+	g_thread_join(self->thread);
+
+    while ((gb = g_queue_pop_head(self->queue))) {
+	g_free(gb->buf);
+	g_free(gb);
+    }
+    g_queue_free(self->queue);
+    g_cond_free(self->cond);
+    g_mutex_free(self->mutex);
+
+    amfree(self->outbuf);
+    inflateEnd(&self->zs);
+
+    /* chain up */
+    G_OBJECT_CLASS(parent_class)->finalize(obj_self);
+}
+
+static void
+class_init(
+    XferFilterGunzipClass * selfc)
+{
+    XferElementClass *klass = XFER_ELEMENT_CLASS(selfc);
+    GObjectClass *goc = G_OBJECT_CLASS(selfc);
+    static xfer_element_mech_pair_t mech_pairs[] = {
+	{ XFER_MECH_PULL_BUFFER, XFER_MECH_PULL_BUFFER, XFER_NROPS(1), XFER_NTHREADS(1) },
+	{ XFER_MECH_PUSH_BUFFER, XFER_MECH_PUSH_BUFFER, XFER_NROPS(1), XFER_NTHREADS(1) },
+	{ XFER_MECH_NONE, XFER_MECH_NONE, XFER_NROPS(0), XFER_NTHREADS(0) },
+    };
+
+    klass->start = start_impl;
+    klass->cancel = cancel_impl;
+    klass->push_buffer = push_buffer_impl;
+    klass->pull_buffer = pull_buffer_impl;
+
+    klass->perl_class = "Amanda::Xfer::Filter::Gunzip";
+    klass->mech_pairs = mech_pairs;
+
+    goc->finalize = finalize_impl;
+
+    parent_class = g_type_class_peek_parent(selfc);
+}
+
+GType
+xfer_filter_gunzip_get_type (void)
+{
+    static GType type = 0;
+
+    if G_UNLIKELY(type == 0) {
+        static const GTypeInfo info = {
+            sizeof (XferFilterGunzipClass),
+            (GBaseInitFunc) NULL,
+            (GBaseFinalizeFunc) NULL,
+            (GClassInitFunc) class_init,
+            (GClassFinalizeFunc) NULL,
+            NULL /* class_data */,
+            sizeof (XferFilterGunzip),
+            0 /* n_preallocs */,
+            (GInstanceInitFunc) instance_init,
+            NULL
+        };
+
+        type = g_type_register_static (XFER_ELEMENT_TYPE, "XferFilterGunzip", &info, 0);
+    }
+
+    return type;
+}
+
+/* create an element of this class; prototype is in xfer-element.h */
+XferElement *
+xfer_filter_gunzip(void)
+{
+    XferFilterGunzip *self = (XferFilterGunzip *)g_object_new(XFER_FILTER_GUNZIP_TYPE, NULL);
+
+    /* 15 bits of window, plus 16 to expect a gzip header */
+    if (inflateInit2(&self->zs, 15 + 16) != Z_OK) {
+	g_warning("inflateInit2 failed: %s", self->zs.msg? self->zs.msg : "");
+	g_object_unref(self);
+	return NULL;
+    }
+
+    return XFER_ELEMENT(self);
+}
+
+#else /* HAVE_ZLIB */
+
+XferElement *
+xfer_filter_gunzip(void)
+{
+    return NULL;
+}
+
+#endif /* HAVE_ZLIB */
@@ -442,6 +442,17 @@ XferElement *xfer_filter_process(gchar **argv,
 XferElement *xfer_filter_xor(
     unsigned char xor_key);
 
+/* A transfer filter that uncompresses gzip data in-process, using zlib, rather
+ * than running gzip.  The work is done in a thread of its own.  Concatenated
+ * gzip members are uncompressed one after the other, and zero bytes between or
+ * after them (padding from a device) are ignored.
+ *
+ * Implemented in filter-gunzip.c
+ *
+ * @return: new element, or NULL if Amanda was built without zlib
+ */
+XferElement *xfer_filter_gunzip(void);
+
 /* A transfer destination that consumes all bytes it is given, optionally
  * validating that they match those produced by source_random
  *
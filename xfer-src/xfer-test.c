@@ -27,6 +27,9 @@
 #include "event.h"
 #include "simpleprng.h"
 #include "sockaddr-util.h"
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 /* Having tests repeat exactly is an advantage, so we use a hard-coded
  * random seed. */
@@ -1558,6 +1561,78 @@ test_xfer_files_filter(void)
     return test_xfer_files(TRUE);
 }
 
+#ifdef HAVE_ZLIB
+/****
+ * Uncompress a file holding two gzip members and some zero padding, as a
+ * device might return it
+ */
+
+static int
+test_xfer_gunzip(void)
+{
+    unsigned int i;
+    GSource *src;
+    char *filename = "xfer-test-gunzip.tmp"; /* current directory is writeable */
+    simpleprng_state_t prng;
+    char buf[65536];
+    char zeros[1000];
+    gzFile gz;
+    int fd;
+    Xfer *xfer;
+    XferElement *elements[3];
+
+    simpleprng_seed(&prng, RANDOM_SEED);
+    for (i = 0; i < 2; i++) {
+	gz = gzopen(filename, i? "ab" : "wb");
+	if (!gz)
+	    g_critical("Could not open '%s'", filename);
+	simpleprng_fill_buffer(&prng, buf, sizeof(buf));
+	gzwrite(gz, buf, sizeof(buf));
+	simpleprng_fill_buffer(&prng, buf, 12345);
+	gzwrite(gz, buf, 12345);
+	gzclose(gz);
+    }
+
+    fd = open(filename, O_WRONLY|O_APPEND, 0);
+    memset(zeros, 0, sizeof(zeros));
+    if (fd < 0 || write(fd, zeros, sizeof(zeros)) != sizeof(zeros))
+	g_critical("Could not pad '%s': %s", filename, strerror(errno));
+    close(fd);
+
+    fd = open(filename, O_RDONLY, 0);
+    if (fd < 0)
+	g_critical("Could not open '%s': %s", filename, strerror(errno));
+
+    elements[0] = xfer_source_fd(fd);
+    elements[1] = xfer_filter_gunzip();
+    elements[2] = xfer_dest_null(RANDOM_SEED);
+
+    xfer = xfer_new(elements, G_N_ELEMENTS(elements));
+    src = xfer_get_source(xfer);
+    g_source_set_callback(src, (GSourceFunc)test_xfer_generic_callback, NULL, NULL);
+    g_source_attach(src, NULL);
+    tu_dbg("Transfer: %s\n", xfer_repr(xfer));
+
+    /* unreference the elements */
+    for (i = 0; i < G_N_ELEMENTS(elements); i++) {
+	g_object_unref(elements[i]);
+	g_assert(G_OBJECT(elements[i])->ref_count == 1);
+	elements[i] = NULL;
+    }
+
+    xfer_start(xfer, 0, 0);
+
+    g_main_loop_run(default_main_loop());
+    g_assert(xfer->status == XFER_DONE);
+
+    xfer_unref(xfer);
+
+    unlink(filename); /* ignore any errors */
+
+    return 1;
+}
+#endif
+
 /*****
  * test each possible combination of source and destination mechansim
  */
@@ -1646,6 +1721,9 @@ main(int argc, char **argv)
 	TU_TEST(test_xfer_simple, 90),
 	TU_TEST(test_xfer_files_simple, 90),
 	TU_TEST(test_xfer_files_filter, 90),
+#ifdef HAVE_ZLIB
+	TU_TEST(test_xfer_gunzip, 90),
+#endif
         TU_TEST(test_glue_READFD_READFD, 90),
         TU_TEST(test_glue_READFD_WRITEFD, 90),
         TU_TEST(test_glue_READFD_PUSH, 90),
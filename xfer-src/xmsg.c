@@ -55,6 +55,7 @@ xmsg_free(
     /* and free any allocated attributes */
     if (msg->repr) g_free(msg->repr);
     if (msg->message) g_free(msg->message);
+    if (msg->crc) g_free(msg->crc);
 
     /* then free the XMsg itself */
     g_free(msg);
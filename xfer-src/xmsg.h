@@ -94,6 +94,12 @@ typedef enum {
      *		dumpfile; always 0 for XferSourceTaper)
      *  - fileno (the on-media file number used for this part, or 0 if no file
      *		  was used)
+     *  - crc (checksum of the data in the part, as "crc32c:xxxxxxxx"; NULL
+     *		if the element does not see the data)
+     *  - stalls (times the device ran out of data during the part)
+     *  - stall_duration (seconds the device spent waiting for data)
+     *  - slow_writes (writes much slower than the others, as when a tape
+     *		drive stops and repositions)
      */
     XMSG_PART_DONE = 5,
 
@@ -187,6 +193,18 @@ typedef struct XMsg {
 
     /* true if no more space on holding disk */
     gboolean no_room;
+
+    /* checksum of a part's data; see crc32c_part_t */
+    char *crc;
+
+    /* times a device ran out of data to write */
+    guint64 stalls;
+
+    /* time a device spent waiting for data, in seconds */
+    double stall_duration;
+
+    /* writes much slower than the others */
+    guint64 slow_writes;
 } XMsg;
 
 /*